@@ -0,0 +1,565 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Measures the cost of sending telemetry with IoTHubDeviceClient_LL over each protocol transport of the SDK. The
+transports talk to the loopback stand-ins of loopback_transports.h, so the results only depend on the client and
+can be compared from one commit to the next. Every scenario of the matrix (protocol, batching, payload size, number
+of application properties) sends the same number of messages keeping at most MAX_IN_FLIGHT of them unconfirmed, and
+reports:
+- messages per second and CPU time per message,
+- allocations and peak heap per message, when the SDK is built with memory_trace (gballoc),
+- p50/p99/max latency from IoTHubDeviceClient_LL_SendEventAsync to the confirmation, in ms and in DoWork calls,
+- the requests and bytes the loopback received.
+The results are written as JSON to the output file, a human readable summary goes to the console.
+
+usage: device_client_throughput [--messages <count>] [--output <file>] [--label <text>]
+--label is copied to the JSON, typically the commit being measured. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/map.h"
+#include "parson.h"
+
+#include "iothub_device_client_ll.h"
+#include "iothub_client_options.h"
+#include "iothub_client_version.h"
+#include "iothub_message.h"
+#include "iothubtransporthttp.h"
+
+#include "loopback_transports.h"
+
+#define DEFAULT_MESSAGE_COUNT       5000    /* messages sent by each scenario */
+#define MAX_IN_FLIGHT               100     /* the application waits for confirmations once that many messages are unconfirmed */
+#define MAX_IDLE_CYCLES             10000   /* a scenario gives up after that many DoWork calls without a confirmation */
+#define DEFAULT_OUTPUT_FILE         "device_client_throughput.json"
+
+static const char* CONNECTION_STRING = "HostName=loopback.azure-devices.net;DeviceId=benchmark-device;SharedAccessKey=ZmFrZWtleWZvcmJlbmNobWFya3M=";
+
+typedef struct BENCHMARK_PROTOCOL_TAG
+{
+    const char* name;
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol;
+    bool supports_batching;
+    LOOPBACK_COUNTERS* (*get_counters)(void);
+} BENCHMARK_PROTOCOL;
+
+static const BENCHMARK_PROTOCOL benchmark_protocols[] =
+{
+    { "mqtt", LoopbackMQTT_Protocol, false, LoopbackMQTT_GetCounters },
+    { "http", HTTP_Protocol, true, LoopbackHTTP_GetCounters }
+};
+
+static const size_t payload_sizes[] = { 16, 256, 4096 };
+static const size_t property_counts[] = { 0, 8 };
+
+typedef struct SENT_MESSAGE_TAG
+{
+    tickcounter_ms_t enqueued_ms;
+    size_t enqueued_cycle;
+    tickcounter_ms_t completed_ms;
+    size_t completed_cycle;
+    bool completed;
+} SENT_MESSAGE;
+
+typedef struct LATENCY_SUMMARY_TAG
+{
+    size_t p50;
+    size_t p99;
+    size_t max;
+} LATENCY_SUMMARY;
+
+typedef struct SCENARIO_RESULT_TAG
+{
+    size_t confirmed;
+    size_t failed;
+    size_t do_work_calls;
+    tickcounter_ms_t elapsed_ms;
+    double cpu_seconds;
+    LOOPBACK_COUNTERS loopback;
+    bool heap_measured;
+    size_t allocations;
+    size_t peak_heap_bytes;
+    LATENCY_SUMMARY latency_ms;
+    LATENCY_SUMMARY latency_do_work;
+} SCENARIO_RESULT;
+
+static TICK_COUNTER_HANDLE g_tick_counter;
+static size_t g_current_cycle;
+static size_t g_in_flight;
+static size_t g_confirmed;
+static size_t g_failed;
+
+static void send_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    SENT_MESSAGE* sent_message = (SENT_MESSAGE*)userContextCallback;
+
+    (void)tickcounter_get_current_ms(g_tick_counter, &sent_message->completed_ms);
+    sent_message->completed_cycle = g_current_cycle;
+    sent_message->completed = (result == IOTHUB_CLIENT_CONFIRMATION_OK);
+    if (sent_message->completed)
+    {
+        g_confirmed++;
+    }
+    else
+    {
+        g_failed++;
+    }
+    g_in_flight--;
+}
+
+static int send_message(IOTHUB_DEVICE_CLIENT_LL_HANDLE client, const unsigned char* payload, size_t payload_size, size_t property_count, SENT_MESSAGE* sent_message)
+{
+    int result;
+    IOTHUB_MESSAGE_HANDLE message = IoTHubMessage_CreateFromByteArray(payload, payload_size);
+    if (message == NULL)
+    {
+        (void)printf("ERROR: IoTHubMessage_CreateFromByteArray failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        MAP_HANDLE properties = IoTHubMessage_Properties(message);
+        size_t index;
+        result = 0;
+        for (index = 0; result == 0 && index < property_count; index++)
+        {
+            char key[32];
+            char value[32];
+            (void)sprintf(key, "property_%lu", (unsigned long)index);
+            (void)sprintf(value, "value_%lu", (unsigned long)index);
+            if (Map_AddOrUpdate(properties, key, value) != MAP_OK)
+            {
+                (void)printf("ERROR: Map_AddOrUpdate failed\r\n");
+                result = __LINE__;
+            }
+        }
+
+        if (result == 0)
+        {
+            (void)tickcounter_get_current_ms(g_tick_counter, &sent_message->enqueued_ms);
+            sent_message->enqueued_cycle = g_current_cycle;
+            sent_message->completed = false;
+            g_in_flight++;
+            if (IoTHubDeviceClient_LL_SendEventAsync(client, message, send_confirm_callback, sent_message) != IOTHUB_CLIENT_OK)
+            {
+                (void)printf("ERROR: IoTHubDeviceClient_LL_SendEventAsync failed\r\n");
+                g_in_flight--;
+                result = __LINE__;
+            }
+        }
+        IoTHubMessage_Destroy(message);
+    }
+    return result;
+}
+
+/* DoWork until every message sent so far is confirmed */
+static int wait_for_confirmations(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    size_t idle_cycles = 0;
+    size_t last_completed = g_confirmed + g_failed;
+
+    while (g_in_flight > 0 && idle_cycles < MAX_IDLE_CYCLES)
+    {
+        IoTHubDeviceClient_LL_DoWork(client);
+        g_current_cycle++;
+        if (g_confirmed + g_failed != last_completed)
+        {
+            last_completed = g_confirmed + g_failed;
+            idle_cycles = 0;
+        }
+        else
+        {
+            idle_cycles++;
+        }
+    }
+    return (g_in_flight == 0) ? 0 : __LINE__;
+}
+
+static int compare_size_t(const void* left, const void* right)
+{
+    size_t l = *(const size_t*)left;
+    size_t r = *(const size_t*)right;
+    return (l < r) ? -1 : ((l > r) ? 1 : 0);
+}
+
+static void summarize_latencies(size_t* latencies, size_t count, LATENCY_SUMMARY* summary)
+{
+    if (count == 0)
+    {
+        memset(summary, 0, sizeof(LATENCY_SUMMARY));
+    }
+    else
+    {
+        qsort(latencies, count, sizeof(size_t), compare_size_t);
+        summary->p50 = latencies[count / 2];
+        summary->p99 = latencies[(count * 99) / 100];
+        summary->max = latencies[count - 1];
+    }
+}
+
+static int summarize_messages(const SENT_MESSAGE* messages, size_t count, SCENARIO_RESULT* result)
+{
+    int error;
+    size_t* latencies = (size_t*)malloc((count == 0 ? 1 : count) * sizeof(size_t));
+    if (latencies == NULL)
+    {
+        (void)printf("ERROR: unable to allocate latencies\r\n");
+        error = __LINE__;
+    }
+    else
+    {
+        size_t completed = 0;
+        size_t index;
+
+        for (index = 0; index < count; index++)
+        {
+            if (messages[index].completed)
+            {
+                latencies[completed++] = (size_t)(messages[index].completed_ms - messages[index].enqueued_ms);
+            }
+        }
+        summarize_latencies(latencies, completed, &result->latency_ms);
+
+        completed = 0;
+        for (index = 0; index < count; index++)
+        {
+            if (messages[index].completed)
+            {
+                latencies[completed++] = messages[index].completed_cycle - messages[index].enqueued_cycle;
+            }
+        }
+        summarize_latencies(latencies, completed, &result->latency_do_work);
+
+        free(latencies);
+        error = 0;
+    }
+    return error;
+}
+
+static IOTHUB_DEVICE_CLIENT_LL_HANDLE create_client(const BENCHMARK_PROTOCOL* protocol, bool batching)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE result;
+
+    if ((result = IoTHubDeviceClient_LL_CreateFromConnectionString(CONNECTION_STRING, protocol->protocol)) == NULL)
+    {
+        (void)printf("ERROR: IoTHubDeviceClient_LL_CreateFromConnectionString failed\r\n");
+    }
+    else if (protocol->supports_batching && IoTHubDeviceClient_LL_SetOption(result, OPTION_BATCHING, &batching) != IOTHUB_CLIENT_OK)
+    {
+        (void)printf("ERROR: unable to set %s\r\n", OPTION_BATCHING);
+        IoTHubDeviceClient_LL_Destroy(result);
+        result = NULL;
+    }
+    return result;
+}
+
+static int run_scenario(const BENCHMARK_PROTOCOL* protocol, bool batching, size_t payload_size, size_t property_count, size_t message_count, SCENARIO_RESULT* result)
+{
+    int error;
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE client;
+    unsigned char* payload = (unsigned char*)malloc(payload_size);
+    SENT_MESSAGE* messages = (SENT_MESSAGE*)calloc(message_count + 1, sizeof(SENT_MESSAGE));
+
+    memset(result, 0, sizeof(SCENARIO_RESULT));
+    g_current_cycle = 0;
+    g_in_flight = 0;
+    g_confirmed = 0;
+    g_failed = 0;
+
+    if (payload == NULL || messages == NULL)
+    {
+        (void)printf("ERROR: unable to allocate the scenario\r\n");
+        error = __LINE__;
+    }
+    else if ((client = create_client(protocol, batching)) == NULL)
+    {
+        error = __LINE__;
+    }
+    else
+    {
+        (void)memset(payload, 'x', payload_size);
+
+        /* the first message opens the connection, it is not measured */
+        if ((error = send_message(client, payload, payload_size, property_count, &messages[message_count])) != 0 ||
+            (error = wait_for_confirmations(client)) != 0)
+        {
+            (void)printf("ERROR: the loopback %s connection did not come up\r\n", protocol->name);
+        }
+        else
+        {
+            LOOPBACK_COUNTERS* counters = protocol->get_counters();
+            tickcounter_ms_t start_ms = 0;
+            tickcounter_ms_t end_ms = 0;
+            clock_t start_cpu;
+            size_t sent = 0;
+            size_t idle_cycles = 0;
+
+            memset(counters, 0, sizeof(LOOPBACK_COUNTERS));
+            g_confirmed = 0;
+            g_failed = 0;
+            g_current_cycle = 0;
+#ifdef GB_MEASURE_MEMORY_FOR_THIS
+            gballoc_resetMetrics();
+#endif
+            start_cpu = clock();
+            (void)tickcounter_get_current_ms(g_tick_counter, &start_ms);
+
+            while (error == 0 && sent < message_count)
+            {
+                size_t completed_before = g_confirmed + g_failed;
+                while (error == 0 && sent < message_count && g_in_flight < MAX_IN_FLIGHT)
+                {
+                    error = send_message(client, payload, payload_size, property_count, &messages[sent++]);
+                }
+                IoTHubDeviceClient_LL_DoWork(client);
+                g_current_cycle++;
+
+                idle_cycles = (g_confirmed + g_failed == completed_before) ? idle_cycles + 1 : 0;
+                if (idle_cycles >= MAX_IDLE_CYCLES)
+                {
+                    (void)printf("ERROR: no confirmation for %d DoWork calls\r\n", MAX_IDLE_CYCLES);
+                    error = __LINE__;
+                }
+            }
+            if (error == 0)
+            {
+                error = wait_for_confirmations(client);
+            }
+
+            (void)tickcounter_get_current_ms(g_tick_counter, &end_ms);
+            result->cpu_seconds = (double)(clock() - start_cpu) / CLOCKS_PER_SEC;
+            result->elapsed_ms = end_ms - start_ms;
+#ifdef GB_MEASURE_MEMORY_FOR_THIS
+            result->heap_measured = true;
+            result->allocations = gballoc_getAllocationCount();
+            result->peak_heap_bytes = gballoc_getMaximumMemoryUsed();
+#endif
+            result->confirmed = g_confirmed;
+            result->failed = g_failed;
+            result->do_work_calls = g_current_cycle;
+            result->loopback = *counters;
+
+            if (error == 0)
+            {
+                error = summarize_messages(messages, sent, result);
+            }
+        }
+
+        IoTHubDeviceClient_LL_Destroy(client);
+    }
+
+    free(messages);
+    free(payload);
+    return error;
+}
+
+static double per_message(double value, size_t messages)
+{
+    return (messages == 0) ? 0.0 : value / (double)messages;
+}
+
+static int add_latency(JSON_Object* scenario_object, const char* name, const LATENCY_SUMMARY* summary)
+{
+    char path[64];
+    int result = 0;
+
+    (void)sprintf(path, "%s.p50", name);
+    result |= (json_object_dotset_number(scenario_object, path, (double)summary->p50) != JSONSuccess);
+    (void)sprintf(path, "%s.p99", name);
+    result |= (json_object_dotset_number(scenario_object, path, (double)summary->p99) != JSONSuccess);
+    (void)sprintf(path, "%s.max", name);
+    result |= (json_object_dotset_number(scenario_object, path, (double)summary->max) != JSONSuccess);
+    return result;
+}
+
+static int add_scenario(JSON_Array* scenarios, const char* protocol, bool batching, size_t payload_size, size_t property_count, const SCENARIO_RESULT* result)
+{
+    int error;
+    JSON_Value* scenario_value;
+    JSON_Object* scenario_object;
+    double elapsed_seconds = (result->elapsed_ms == 0) ? 0.001 : (double)result->elapsed_ms / 1000.0;
+
+    if ((scenario_value = json_value_init_object()) == NULL)
+    {
+        error = __LINE__;
+    }
+    else if ((scenario_object = json_value_get_object(scenario_value)) == NULL)
+    {
+        json_value_free(scenario_value);
+        error = __LINE__;
+    }
+    else
+    {
+        error = 0;
+        error |= (json_object_set_string(scenario_object, "protocol", protocol) != JSONSuccess);
+        error |= (json_object_set_boolean(scenario_object, "batching", batching) != JSONSuccess);
+        error |= (json_object_set_number(scenario_object, "payload_bytes", (double)payload_size) != JSONSuccess);
+        error |= (json_object_set_number(scenario_object, "properties", (double)property_count) != JSONSuccess);
+        error |= (json_object_set_number(scenario_object, "confirmed", (double)result->confirmed) != JSONSuccess);
+        error |= (json_object_set_number(scenario_object, "failed", (double)result->failed) != JSONSuccess);
+        error |= (json_object_set_number(scenario_object, "elapsed_ms", (double)result->elapsed_ms) != JSONSuccess);
+        error |= (json_object_set_number(scenario_object, "messages_per_second", (double)result->confirmed / elapsed_seconds) != JSONSuccess);
+        error |= (json_object_set_number(scenario_object, "cpu_us_per_message", per_message(result->cpu_seconds * 1000000.0, result->confirmed)) != JSONSuccess);
+        error |= (json_object_set_number(scenario_object, "do_work_calls", (double)result->do_work_calls) != JSONSuccess);
+        error |= (json_object_set_number(scenario_object, "loopback_requests", (double)result->loopback.requests) != JSONSuccess);
+        error |= (json_object_set_number(scenario_object, "loopback_bytes", (double)result->loopback.bytes) != JSONSuccess);
+        if (result->heap_measured)
+        {
+            error |= (json_object_set_number(scenario_object, "allocations_per_message", per_message((double)result->allocations, result->confirmed)) != JSONSuccess);
+            error |= (json_object_set_number(scenario_object, "peak_heap_bytes", (double)result->peak_heap_bytes) != JSONSuccess);
+        }
+        else
+        {
+            error |= (json_object_set_null(scenario_object, "allocations_per_message") != JSONSuccess);
+            error |= (json_object_set_null(scenario_object, "peak_heap_bytes") != JSONSuccess);
+        }
+        error |= add_latency(scenario_object, "latency_ms", &result->latency_ms);
+        error |= add_latency(scenario_object, "latency_do_work", &result->latency_do_work);
+
+        if (error != 0 || json_array_append_value(scenarios, scenario_value) != JSONSuccess)
+        {
+            json_value_free(scenario_value);
+            error = __LINE__;
+        }
+    }
+    return error;
+}
+
+static void print_scenario(const char* protocol, bool batching, size_t payload_size, size_t property_count, const SCENARIO_RESULT* result)
+{
+    double elapsed_seconds = (result->elapsed_ms == 0) ? 0.001 : (double)result->elapsed_ms / 1000.0;
+    (void)printf("%-4s batching=%-3s payload=%-5lu properties=%-2lu msg/s=%-9.0f cpu_us/msg=%-7.1f p50=%lums p99=%lums (%lu/%lu DoWork)",
+        protocol, batching ? "on" : "off", (unsigned long)payload_size, (unsigned long)property_count,
+        (double)result->confirmed / elapsed_seconds, per_message(result->cpu_seconds * 1000000.0, result->confirmed),
+        (unsigned long)result->latency_ms.p50, (unsigned long)result->latency_ms.p99,
+        (unsigned long)result->latency_do_work.p50, (unsigned long)result->latency_do_work.p99);
+    if (result->heap_measured)
+    {
+        (void)printf(" allocs/msg=%.1f", per_message((double)result->allocations, result->confirmed));
+    }
+    (void)printf("\r\n");
+}
+
+static int run_all_scenarios(size_t message_count, JSON_Array* scenarios)
+{
+    int result = 0;
+    size_t protocol_index;
+
+    for (protocol_index = 0; result == 0 && protocol_index < sizeof(benchmark_protocols) / sizeof(benchmark_protocols[0]); protocol_index++)
+    {
+        const BENCHMARK_PROTOCOL* protocol = &benchmark_protocols[protocol_index];
+        int batching;
+        for (batching = 0; result == 0 && batching <= (protocol->supports_batching ? 1 : 0); batching++)
+        {
+            size_t size_index;
+            for (size_index = 0; result == 0 && size_index < sizeof(payload_sizes) / sizeof(payload_sizes[0]); size_index++)
+            {
+                size_t property_index;
+                for (property_index = 0; result == 0 && property_index < sizeof(property_counts) / sizeof(property_counts[0]); property_index++)
+                {
+                    SCENARIO_RESULT scenario_result;
+                    if ((result = run_scenario(protocol, batching != 0, payload_sizes[size_index], property_counts[property_index], message_count, &scenario_result)) == 0)
+                    {
+                        print_scenario(protocol->name, batching != 0, payload_sizes[size_index], property_counts[property_index], &scenario_result);
+                        result = add_scenario(scenarios, protocol->name, batching != 0, payload_sizes[size_index], property_counts[property_index], &scenario_result);
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    int result;
+    size_t message_count = DEFAULT_MESSAGE_COUNT;
+    const char* output_file = DEFAULT_OUTPUT_FILE;
+    const char* label = "";
+    JSON_Value* root_value = NULL;
+    JSON_Object* root_object;
+    JSON_Value* scenarios_value = NULL;
+    int index;
+
+    result = 0;
+    for (index = 1; result == 0 && index < argc; index++)
+    {
+        if (strcmp(argv[index], "--messages") == 0 && index + 1 < argc && atoi(argv[index + 1]) > 0)
+        {
+            message_count = (size_t)atoi(argv[++index]);
+        }
+        else if (strcmp(argv[index], "--output") == 0 && index + 1 < argc)
+        {
+            output_file = argv[++index];
+        }
+        else if (strcmp(argv[index], "--label") == 0 && index + 1 < argc)
+        {
+            label = argv[++index];
+        }
+        else
+        {
+            (void)printf("usage: %s [--messages <count>] [--output <file>] [--label <text>]\r\n", argv[0]);
+            result = __LINE__;
+        }
+    }
+
+    if (result != 0)
+    {
+        /* usage already printed */
+    }
+#ifdef GB_MEASURE_MEMORY_FOR_THIS
+    else if (gballoc_init() != 0)
+    {
+        (void)printf("ERROR: gballoc_init failed\r\n");
+        result = __LINE__;
+    }
+#endif
+    else if ((g_tick_counter = tickcounter_create()) == NULL)
+    {
+        (void)printf("ERROR: tickcounter_create failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        if ((root_value = json_value_init_object()) == NULL ||
+            (root_object = json_value_get_object(root_value)) == NULL ||
+            (scenarios_value = json_value_init_array()) == NULL ||
+            json_object_set_string(root_object, "benchmark", "device_client_throughput") != JSONSuccess ||
+            json_object_set_string(root_object, "label", label) != JSONSuccess ||
+            json_object_set_string(root_object, "sdk_version", IOTHUB_SDK_VERSION) != JSONSuccess ||
+            json_object_set_number(root_object, "messages_per_scenario", (double)message_count) != JSONSuccess ||
+            json_object_set_number(root_object, "max_in_flight", MAX_IN_FLIGHT) != JSONSuccess ||
+            json_object_set_value(root_object, "scenarios", scenarios_value) != JSONSuccess)
+        {
+            (void)printf("ERROR: unable to create the JSON results\r\n");
+            json_value_free(scenarios_value);
+            result = __LINE__;
+        }
+        else if ((result = run_all_scenarios(message_count, json_value_get_array(scenarios_value))) != 0)
+        {
+            (void)printf("ERROR: benchmark failed (%d)\r\n", result);
+        }
+        else if (json_serialize_to_file_pretty(root_value, output_file) != JSONSuccess)
+        {
+            (void)printf("ERROR: unable to write %s\r\n", output_file);
+            result = __LINE__;
+        }
+        else
+        {
+            (void)printf("results written to %s\r\n", output_file);
+        }
+
+        json_value_free(root_value);
+        tickcounter_destroy(g_tick_counter);
+    }
+
+#ifdef GB_MEASURE_MEMORY_FOR_THIS
+    gballoc_deinit();
+#endif
+    return result;
+}
@@ -0,0 +1,432 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/xio.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/optimize_size.h"
+
+#include "iothubtransportmqtt.h"
+#include "internal/iothubtransport_mqtt_common.h"
+
+#include "loopback_transports.h"
+
+#define MQTT_PACKET_CONNECT         1
+#define MQTT_PACKET_PUBLISH         3
+#define MQTT_PACKET_SUBSCRIBE       8
+#define MQTT_PACKET_UNSUBSCRIBE     10
+#define MQTT_PACKET_PINGREQ         12
+
+#define MQTT_CONNACK                0x20
+#define MQTT_PUBACK                 0x40
+#define MQTT_SUBACK                 0x90
+#define MQTT_UNSUBACK               0xB0
+#define MQTT_PINGRESP               0xD0
+#define MQTT_GRANTED_QOS_1          0x01
+
+typedef enum LOOPBACK_IO_STATE_TAG
+{
+    LOOPBACK_IO_STATE_CLOSED,
+    LOOPBACK_IO_STATE_OPENING,
+    LOOPBACK_IO_STATE_OPEN
+} LOOPBACK_IO_STATE;
+
+typedef struct LOOPBACK_BUFFER_TAG
+{
+    unsigned char* bytes;
+    size_t size;
+    size_t capacity;
+} LOOPBACK_BUFFER;
+
+typedef struct LOOPBACK_MQTT_IO_TAG
+{
+    LOOPBACK_IO_STATE state;
+    ON_IO_OPEN_COMPLETE on_io_open_complete;
+    void* on_io_open_complete_context;
+    ON_BYTES_RECEIVED on_bytes_received;
+    void* on_bytes_received_context;
+    LOOPBACK_BUFFER from_client;    /* bytes written by the client and not parsed yet, a packet can span several sends */
+    LOOPBACK_BUFFER to_client;      /* answers of the broker, handed to the client at the next DoWork */
+    LOOPBACK_BUFFER held_pubacks;   /* PUBACKs over the link rate, released at the following DoWorks */
+} LOOPBACK_MQTT_IO;
+
+static LOOPBACK_COUNTERS g_mqtt_counters;
+static size_t g_pubacks_per_dowork;
+static TRANSPORT_PROVIDER g_loopback_mqtt_provider;
+
+static int append_bytes(LOOPBACK_BUFFER* buffer, const unsigned char* bytes, size_t size)
+{
+    int result;
+    if (buffer->size + size > buffer->capacity)
+    {
+        size_t new_capacity = (buffer->capacity == 0) ? 256 : buffer->capacity;
+        unsigned char* new_bytes;
+        while (new_capacity < buffer->size + size)
+        {
+            new_capacity *= 2;
+        }
+
+        if ((new_bytes = (unsigned char*)realloc(buffer->bytes, new_capacity)) == NULL)
+        {
+            LogError("unable to grow the loopback buffer to %lu bytes", (unsigned long)new_capacity);
+            result = __FAILURE__;
+        }
+        else
+        {
+            buffer->bytes = new_bytes;
+            buffer->capacity = new_capacity;
+            result = 0;
+        }
+    }
+    else
+    {
+        result = 0;
+    }
+
+    if (result == 0)
+    {
+        (void)memcpy(buffer->bytes + buffer->size, bytes, size);
+        buffer->size += size;
+    }
+    return result;
+}
+
+/*returns the length of the fixed header and sets remaining_length, 0 when the packet is not complete yet*/
+static size_t get_fixed_header_length(const unsigned char* bytes, size_t size, size_t* remaining_length)
+{
+    size_t result = 0;
+    size_t multiplier = 1;
+    size_t index;
+
+    *remaining_length = 0;
+    for (index = 1; index < size && index <= 4; index++)
+    {
+        *remaining_length += (bytes[index] & 0x7F) * multiplier;
+        if ((bytes[index] & 0x80) == 0)
+        {
+            result = index + 1;
+            break;
+        }
+        multiplier *= 128;
+    }
+    return result;
+}
+
+static int answer_packet(LOOPBACK_MQTT_IO* loopback_io, const unsigned char* packet, size_t header_length, size_t remaining_length)
+{
+    int result;
+    const unsigned char* variable_header = packet + header_length;
+
+    switch (packet[0] >> 4)
+    {
+        case MQTT_PACKET_CONNECT:
+        {
+            static const unsigned char connack[] = { MQTT_CONNACK, 0x02, 0x00, 0x00 };
+            result = append_bytes(&loopback_io->to_client, connack, sizeof(connack));
+            break;
+        }
+        case MQTT_PACKET_PUBLISH:
+        {
+            g_mqtt_counters.requests++;
+            if (((packet[0] >> 1) & 0x03) == 0 || remaining_length < 2)
+            {
+                result = 0;
+            }
+            else
+            {
+                /*the packet identifier follows the topic name*/
+                size_t topic_length = ((size_t)variable_header[0] << 8) | variable_header[1];
+                if (remaining_length < 2 + topic_length + 2)
+                {
+                    LogError("malformed PUBLISH packet");
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    unsigned char puback[] = { MQTT_PUBACK, 0x02, 0x00, 0x00 };
+                    puback[2] = variable_header[2 + topic_length];
+                    puback[3] = variable_header[2 + topic_length + 1];
+                    result = append_bytes((g_pubacks_per_dowork == 0) ? &loopback_io->to_client : &loopback_io->held_pubacks, puback, sizeof(puback));
+                }
+            }
+            break;
+        }
+        case MQTT_PACKET_SUBSCRIBE:
+        {
+            /*one granted QoS per topic filter, each filter is a length, the filter and the requested QoS*/
+            unsigned char suback[4 + 127];
+            size_t offset = 2;
+            size_t topic_count = 0;
+            while (offset + 2 <= remaining_length && topic_count < sizeof(suback) - 4)
+            {
+                offset += 2 + (((size_t)variable_header[offset] << 8) | variable_header[offset + 1]) + 1;
+                suback[4 + topic_count] = MQTT_GRANTED_QOS_1;
+                topic_count++;
+            }
+            suback[0] = MQTT_SUBACK;
+            suback[1] = (unsigned char)(2 + topic_count);
+            suback[2] = variable_header[0];
+            suback[3] = variable_header[1];
+            result = append_bytes(&loopback_io->to_client, suback, 4 + topic_count);
+            break;
+        }
+        case MQTT_PACKET_UNSUBSCRIBE:
+        {
+            unsigned char unsuback[] = { MQTT_UNSUBACK, 0x02, 0x00, 0x00 };
+            unsuback[2] = variable_header[0];
+            unsuback[3] = variable_header[1];
+            result = append_bytes(&loopback_io->to_client, unsuback, sizeof(unsuback));
+            break;
+        }
+        case MQTT_PACKET_PINGREQ:
+        {
+            static const unsigned char pingresp[] = { MQTT_PINGRESP, 0x00 };
+            result = append_bytes(&loopback_io->to_client, pingresp, sizeof(pingresp));
+            break;
+        }
+        default:
+        {
+            /*DISCONNECT and the acknowledgements of the client need no answer*/
+            result = 0;
+            break;
+        }
+    }
+    return result;
+}
+
+static int answer_complete_packets(LOOPBACK_MQTT_IO* loopback_io)
+{
+    int result = 0;
+    size_t consumed = 0;
+
+    while (result == 0 && loopback_io->from_client.size - consumed >= 2)
+    {
+        const unsigned char* packet = loopback_io->from_client.bytes + consumed;
+        size_t available = loopback_io->from_client.size - consumed;
+        size_t remaining_length;
+        size_t header_length = get_fixed_header_length(packet, available, &remaining_length);
+
+        if (header_length == 0 || header_length + remaining_length > available)
+        {
+            break;
+        }
+
+        result = answer_packet(loopback_io, packet, header_length, remaining_length);
+        consumed += header_length + remaining_length;
+    }
+
+    if (consumed > 0)
+    {
+        (void)memmove(loopback_io->from_client.bytes, loopback_io->from_client.bytes + consumed, loopback_io->from_client.size - consumed);
+        loopback_io->from_client.size -= consumed;
+    }
+    return result;
+}
+
+static OPTIONHANDLER_HANDLE loopback_mqtt_io_retrieveoptions(CONCRETE_IO_HANDLE handle)
+{
+    (void)handle;
+    return NULL;
+}
+
+static CONCRETE_IO_HANDLE loopback_mqtt_io_create(void* io_create_parameters)
+{
+    LOOPBACK_MQTT_IO* result;
+    (void)io_create_parameters;
+
+    if ((result = (LOOPBACK_MQTT_IO*)malloc(sizeof(LOOPBACK_MQTT_IO))) == NULL)
+    {
+        LogError("unable to allocate the loopback IO");
+    }
+    else
+    {
+        memset(result, 0, sizeof(LOOPBACK_MQTT_IO));
+        result->state = LOOPBACK_IO_STATE_CLOSED;
+    }
+    return (CONCRETE_IO_HANDLE)result;
+}
+
+static void loopback_mqtt_io_destroy(CONCRETE_IO_HANDLE handle)
+{
+    LOOPBACK_MQTT_IO* loopback_io = (LOOPBACK_MQTT_IO*)handle;
+    if (loopback_io != NULL)
+    {
+        free(loopback_io->from_client.bytes);
+        free(loopback_io->to_client.bytes);
+        free(loopback_io->held_pubacks.bytes);
+        free(loopback_io);
+    }
+}
+
+static int loopback_mqtt_io_open(CONCRETE_IO_HANDLE handle, ON_IO_OPEN_COMPLETE on_io_open_complete, void* on_io_open_complete_context, ON_BYTES_RECEIVED on_bytes_received, void* on_bytes_received_context, ON_IO_ERROR on_io_error, void* on_io_error_context)
+{
+    int result;
+    LOOPBACK_MQTT_IO* loopback_io = (LOOPBACK_MQTT_IO*)handle;
+    (void)on_io_error;
+    (void)on_io_error_context;
+
+    if (loopback_io == NULL || loopback_io->state != LOOPBACK_IO_STATE_CLOSED)
+    {
+        LogError("loopback IO cannot be opened");
+        result = __FAILURE__;
+    }
+    else
+    {
+        /*the open completes at the next DoWork, like a TLS handshake would*/
+        loopback_io->on_io_open_complete = on_io_open_complete;
+        loopback_io->on_io_open_complete_context = on_io_open_complete_context;
+        loopback_io->on_bytes_received = on_bytes_received;
+        loopback_io->on_bytes_received_context = on_bytes_received_context;
+        loopback_io->from_client.size = 0;
+        loopback_io->to_client.size = 0;
+        loopback_io->held_pubacks.size = 0;
+        loopback_io->state = LOOPBACK_IO_STATE_OPENING;
+        result = 0;
+    }
+    return result;
+}
+
+static int loopback_mqtt_io_close(CONCRETE_IO_HANDLE handle, ON_IO_CLOSE_COMPLETE on_io_close_complete, void* callback_context)
+{
+    int result;
+    LOOPBACK_MQTT_IO* loopback_io = (LOOPBACK_MQTT_IO*)handle;
+
+    if (loopback_io == NULL)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        loopback_io->state = LOOPBACK_IO_STATE_CLOSED;
+        if (on_io_close_complete != NULL)
+        {
+            on_io_close_complete(callback_context);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static int loopback_mqtt_io_send(CONCRETE_IO_HANDLE handle, const void* buffer, size_t size, ON_SEND_COMPLETE on_send_complete, void* callback_context)
+{
+    int result;
+    LOOPBACK_MQTT_IO* loopback_io = (LOOPBACK_MQTT_IO*)handle;
+
+    if (loopback_io == NULL || buffer == NULL || loopback_io->state != LOOPBACK_IO_STATE_OPEN)
+    {
+        LogError("loopback IO is not open");
+        result = __FAILURE__;
+    }
+    else if (append_bytes(&loopback_io->from_client, (const unsigned char*)buffer, size) != 0 ||
+        answer_complete_packets(loopback_io) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        g_mqtt_counters.bytes += size;
+        if (on_send_complete != NULL)
+        {
+            on_send_complete(callback_context, IO_SEND_OK);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static void loopback_mqtt_io_dowork(CONCRETE_IO_HANDLE handle)
+{
+    LOOPBACK_MQTT_IO* loopback_io = (LOOPBACK_MQTT_IO*)handle;
+
+    if (loopback_io != NULL)
+    {
+        if (loopback_io->state == LOOPBACK_IO_STATE_OPENING)
+        {
+            loopback_io->state = LOOPBACK_IO_STATE_OPEN;
+            if (loopback_io->on_io_open_complete != NULL)
+            {
+                loopback_io->on_io_open_complete(loopback_io->on_io_open_complete_context, IO_OPEN_OK);
+            }
+        }
+        else if (loopback_io->state == LOOPBACK_IO_STATE_OPEN)
+        {
+            if (loopback_io->held_pubacks.size > 0)
+            {
+                /*each PUBACK is 4 bytes*/
+                size_t release = g_pubacks_per_dowork * 4;
+                if (release == 0 || release > loopback_io->held_pubacks.size)
+                {
+                    release = loopback_io->held_pubacks.size;
+                }
+
+                if (append_bytes(&loopback_io->to_client, loopback_io->held_pubacks.bytes, release) == 0)
+                {
+                    (void)memmove(loopback_io->held_pubacks.bytes, loopback_io->held_pubacks.bytes + release, loopback_io->held_pubacks.size - release);
+                    loopback_io->held_pubacks.size -= release;
+                }
+            }
+
+            if (loopback_io->to_client.size > 0)
+            {
+                /*the client sends while it processes the answers, those go in a fresh buffer and wait for the next DoWork*/
+                LOOPBACK_BUFFER answers = loopback_io->to_client;
+                memset(&loopback_io->to_client, 0, sizeof(LOOPBACK_BUFFER));
+                loopback_io->on_bytes_received(loopback_io->on_bytes_received_context, answers.bytes, answers.size);
+                free(answers.bytes);
+            }
+        }
+    }
+}
+
+static int loopback_mqtt_io_setoption(CONCRETE_IO_HANDLE handle, const char* optionName, const void* value)
+{
+    /*TLS options such as the trusted certificates have nothing to configure here*/
+    (void)handle;
+    (void)optionName;
+    (void)value;
+    return 0;
+}
+
+static const IO_INTERFACE_DESCRIPTION loopback_mqtt_io_interface_description =
+{
+    loopback_mqtt_io_retrieveoptions,
+    loopback_mqtt_io_create,
+    loopback_mqtt_io_destroy,
+    loopback_mqtt_io_open,
+    loopback_mqtt_io_close,
+    loopback_mqtt_io_send,
+    loopback_mqtt_io_dowork,
+    loopback_mqtt_io_setoption
+};
+
+static XIO_HANDLE get_loopback_io(const char* fully_qualified_name, const MQTT_TRANSPORT_PROXY_OPTIONS* mqtt_transport_proxy_options)
+{
+    (void)fully_qualified_name;
+    (void)mqtt_transport_proxy_options;
+    return xio_create(&loopback_mqtt_io_interface_description, NULL);
+}
+
+static TRANSPORT_LL_HANDLE LoopbackMQTT_Create(const IOTHUBTRANSPORT_CONFIG* config)
+{
+    return IoTHubTransport_MQTT_Common_Create(config, get_loopback_io);
+}
+
+const TRANSPORT_PROVIDER* LoopbackMQTT_Protocol(void)
+{
+    /*everything but the IO is the MQTT transport of the SDK*/
+    g_loopback_mqtt_provider = *MQTT_Protocol();
+    g_loopback_mqtt_provider.IoTHubTransport_Create = LoopbackMQTT_Create;
+    return &g_loopback_mqtt_provider;
+}
+
+LOOPBACK_COUNTERS* LoopbackMQTT_GetCounters(void)
+{
+    return &g_mqtt_counters;
+}
+
+void LoopbackMQTT_SetPubacksPerDoWork(size_t pubacks_per_dowork)
+{
+    g_pubacks_per_dowork = pubacks_per_dowork;
+}
@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Loopback stand-ins for the IoT Hub endpoints used by device_client_throughput. The device client runs its real
+protocol transports and the stand-ins answer them from memory, so no network and no IoT Hub are needed:
+- MQTT: the MQTT transport of the SDK on top of an IO that plays the broker, it acknowledges every packet at the
+  next DoWork. LoopbackMQTT_SetPubacksPerDoWork limits the PUBACKs handed back per DoWork to model a slow link,
+  0 (the default) means no limit.
+- HTTP: the HTTP transport of the SDK on top of an HTTPAPI implementation that answers every request with 204. It
+  replaces the HTTPAPI_* functions of c-utility when the benchmark is linked. */
+
+#ifndef LOOPBACK_TRANSPORTS_H
+#define LOOPBACK_TRANSPORTS_H
+
+#include <stddef.h>
+
+#include "iothub_transport_ll.h"
+
+typedef struct LOOPBACK_COUNTERS_TAG
+{
+    size_t requests;        /* MQTT PUBLISH packets or HTTP requests */
+    size_t bytes;           /* MQTT packets or HTTP request bodies, in bytes */
+} LOOPBACK_COUNTERS;
+
+extern const TRANSPORT_PROVIDER* LoopbackMQTT_Protocol(void);
+extern LOOPBACK_COUNTERS* LoopbackMQTT_GetCounters(void);
+extern void LoopbackMQTT_SetPubacksPerDoWork(size_t pubacks_per_dowork);
+
+extern LOOPBACK_COUNTERS* LoopbackHTTP_GetCounters(void);
+
+#endif /* LOOPBACK_TRANSPORTS_H */
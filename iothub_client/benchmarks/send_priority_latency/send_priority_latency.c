@@ -0,0 +1,240 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Measures how long an alarm message waits in the device client send queue while the link is
+saturated by bulk telemetry. The client runs the MQTT transport of the SDK on top of the loopback
+broker of device_client_throughput, which acknowledges a fixed number of PUBLISH packets per DoWork,
+so latencies are reported in DoWork cycles and do not depend on the network. The scenario runs three
+times: with every message at IOTHUB_MESSAGE_PRIORITY_NORMAL (a single FIFO), with alarms at
+IOTHUB_MESSAGE_PRIORITY_HIGH and no limit on the messages in flight (the transport publishes the
+whole queue at once, so the ordering of the queue does not matter), and with alarms at
+IOTHUB_MESSAGE_PRIORITY_HIGH and OPTION_MAX_IN_FLIGHT_TELEMETRY at 64, the limit the transports apply by
+default once a prioritized message is queued. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/tickcounter.h"
+
+#include "iothub_client_ll.h"
+#include "iothub_client_options.h"
+#include "iothub_message.h"
+
+#include "loopback_transports.h"
+
+#define LINK_MESSAGES_PER_DO_WORK   8       /* how many PUBLISH packets the loopback broker acknowledges per DoWork */
+#define INITIAL_BACKLOG             4000    /* bulk messages already queued when the scenario starts */
+#define LOAD_CYCLES                 2000    /* cycles during which bulk keeps arriving at link speed */
+#define ALARM_PERIOD                40      /* one alarm every ALARM_PERIOD cycles */
+#define ALARM_COUNT                 (LOAD_CYCLES / ALARM_PERIOD)
+#define BULK_COUNT                  (INITIAL_BACKLOG + LOAD_CYCLES * LINK_MESSAGES_PER_DO_WORK)
+#define CONNECT_CYCLES              10      /* DoWork cycles given to the transport to connect before the load starts */
+#define NO_IN_FLIGHT_LIMIT          0
+#define DEFAULT_IN_FLIGHT_LIMIT     64
+
+typedef struct SENT_MESSAGE_TAG
+{
+    size_t enqueued_cycle;
+    size_t completed_cycle;
+    bool completed;
+} SENT_MESSAGE;
+
+static size_t g_current_cycle;
+static SENT_MESSAGE g_alarms[ALARM_COUNT];
+static SENT_MESSAGE g_bulk[BULK_COUNT];
+static const unsigned char g_payload[] = "{\"temperature\":21.5,\"humidity\":40}";
+
+static void send_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    SENT_MESSAGE* sent_message = (SENT_MESSAGE*)userContextCallback;
+    if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        sent_message->completed_cycle = g_current_cycle;
+        sent_message->completed = true;
+    }
+}
+
+static int send_message(IOTHUB_CLIENT_LL_HANDLE client, IOTHUB_MESSAGE_PRIORITY priority, SENT_MESSAGE* sent_message)
+{
+    int result;
+    IOTHUB_MESSAGE_HANDLE message = IoTHubMessage_CreateFromByteArray(g_payload, sizeof(g_payload) - 1);
+    if (message == NULL)
+    {
+        (void)printf("ERROR: IoTHubMessage_CreateFromByteArray failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        sent_message->enqueued_cycle = g_current_cycle;
+        sent_message->completed = false;
+        if (IoTHubMessage_SetPriority(message, priority) != IOTHUB_MESSAGE_OK ||
+            IoTHubClient_LL_SendEventAsync(client, message, send_confirm_callback, sent_message) != IOTHUB_CLIENT_OK)
+        {
+            (void)printf("ERROR: unable to send message\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+        IoTHubMessage_Destroy(message);
+    }
+    return result;
+}
+
+static int compare_size_t(const void* left, const void* right)
+{
+    size_t l = *(const size_t*)left;
+    size_t r = *(const size_t*)right;
+    return (l < r) ? -1 : ((l > r) ? 1 : 0);
+}
+
+static void print_latencies(const char* lane, const SENT_MESSAGE* messages, size_t count)
+{
+    size_t* latencies = (size_t*)malloc(count * sizeof(size_t));
+    if (latencies == NULL)
+    {
+        (void)printf("ERROR: unable to allocate latencies\r\n");
+    }
+    else
+    {
+        size_t completed = 0;
+        size_t sum = 0;
+        size_t i;
+        for (i = 0; i < count; i++)
+        {
+            if (messages[i].completed)
+            {
+                latencies[completed] = messages[i].completed_cycle - messages[i].enqueued_cycle;
+                sum += latencies[completed];
+                completed++;
+            }
+        }
+
+        if (completed == 0)
+        {
+            (void)printf("  %-6s no message completed\r\n", lane);
+        }
+        else
+        {
+            qsort(latencies, completed, sizeof(size_t), compare_size_t);
+            (void)printf("  %-6s messages=%-6lu min=%-6lu p50=%-6lu p99=%-6lu max=%-6lu avg=%.1f (DoWork cycles)\r\n",
+                lane, (unsigned long)completed, (unsigned long)latencies[0], (unsigned long)latencies[completed / 2],
+                (unsigned long)latencies[(completed * 99) / 100], (unsigned long)latencies[completed - 1], (double)sum / completed);
+        }
+        free(latencies);
+    }
+}
+
+static int run_scenario(const char* name, IOTHUB_MESSAGE_PRIORITY alarm_priority, size_t max_in_flight, TICK_COUNTER_HANDLE tick_counter)
+{
+    int result;
+    IOTHUB_CLIENT_CONFIG config;
+    IOTHUB_CLIENT_LL_HANDLE client;
+
+    memset(&config, 0, sizeof(config));
+    config.protocol = LoopbackMQTT_Protocol;
+    config.deviceId = "benchmark-device";
+    config.deviceKey = "ZmFrZWtleWZvcmJlbmNobWFya3M=";
+    config.iotHubName = "benchmark";
+    config.iotHubSuffix = "azure-devices.net";
+
+    if ((client = IoTHubClient_LL_Create(&config)) == NULL)
+    {
+        (void)printf("ERROR: IoTHubClient_LL_Create failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        tickcounter_ms_t start_ms = 0;
+        tickcounter_ms_t end_ms = 0;
+        size_t bulk_sent = 0;
+        size_t alarms_sent = 0;
+        IOTHUB_CLIENT_STATUS status = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+
+        memset(g_alarms, 0, sizeof(g_alarms));
+        memset(g_bulk, 0, sizeof(g_bulk));
+        g_current_cycle = 0;
+
+        if (IoTHubClient_LL_SetOption(client, OPTION_MAX_IN_FLIGHT_TELEMETRY, &max_in_flight) != IOTHUB_CLIENT_OK)
+        {
+            (void)printf("ERROR: unable to set %s\r\n", OPTION_MAX_IN_FLIGHT_TELEMETRY);
+            result = __LINE__;
+        }
+        else
+        {
+            size_t i;
+            for (i = 0; i < CONNECT_CYCLES; i++)
+            {
+                IoTHubClient_LL_DoWork(client);
+            }
+            result = 0;
+        }
+        (void)tickcounter_get_current_ms(tick_counter, &start_ms);
+
+        while (result == 0 && bulk_sent < INITIAL_BACKLOG)
+        {
+            result = send_message(client, IOTHUB_MESSAGE_PRIORITY_NORMAL, &g_bulk[bulk_sent++]);
+        }
+
+        /* bulk arrives exactly at link speed, so the backlog in front of each alarm stays the same */
+        while (result == 0 && g_current_cycle < LOAD_CYCLES)
+        {
+            size_t i;
+            for (i = 0; result == 0 && i < LINK_MESSAGES_PER_DO_WORK; i++)
+            {
+                result = send_message(client, IOTHUB_MESSAGE_PRIORITY_NORMAL, &g_bulk[bulk_sent++]);
+            }
+            if (result == 0 && (g_current_cycle % ALARM_PERIOD) == 0 && alarms_sent < ALARM_COUNT)
+            {
+                result = send_message(client, alarm_priority, &g_alarms[alarms_sent++]);
+            }
+            IoTHubClient_LL_DoWork(client);
+            g_current_cycle++;
+        }
+
+        while (result == 0 && status == IOTHUB_CLIENT_SEND_STATUS_BUSY)
+        {
+            IoTHubClient_LL_DoWork(client);
+            g_current_cycle++;
+            if (IoTHubClient_LL_GetSendStatus(client, &status) != IOTHUB_CLIENT_OK)
+            {
+                result = __LINE__;
+            }
+        }
+        (void)tickcounter_get_current_ms(tick_counter, &end_ms);
+
+        (void)printf("%s: %lu cycles, %lu ms\r\n", name, (unsigned long)g_current_cycle, (unsigned long)(end_ms - start_ms));
+        print_latencies("alarm", g_alarms, alarms_sent);
+        print_latencies("bulk", g_bulk, bulk_sent);
+
+        IoTHubClient_LL_Destroy(client);
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    TICK_COUNTER_HANDLE tick_counter = tickcounter_create();
+    if (tick_counter == NULL)
+    {
+        (void)printf("ERROR: tickcounter_create failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        (void)printf("transport: MQTT, link: %d messages/cycle, backlog: %d messages, one alarm every %d cycles\r\n",
+            LINK_MESSAGES_PER_DO_WORK, INITIAL_BACKLOG, ALARM_PERIOD);
+        LoopbackMQTT_SetPubacksPerDoWork(LINK_MESSAGES_PER_DO_WORK);
+
+        if ((result = run_scenario("single FIFO (alarms at NORMAL priority)", IOTHUB_MESSAGE_PRIORITY_NORMAL, DEFAULT_IN_FLIGHT_LIMIT, tick_counter)) == 0 &&
+            (result = run_scenario("alarms at HIGH priority, no in flight limit", IOTHUB_MESSAGE_PRIORITY_HIGH, NO_IN_FLIGHT_LIMIT, tick_counter)) == 0)
+        {
+            result = run_scenario("alarms at HIGH priority, max_in_flight_telemetry 64", IOTHUB_MESSAGE_PRIORITY_HIGH, DEFAULT_IN_FLIGHT_LIMIT, tick_counter);
+        }
+        tickcounter_destroy(tick_counter);
+    }
+    return result;
+}
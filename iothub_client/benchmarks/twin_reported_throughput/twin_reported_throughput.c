@@ -0,0 +1,301 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Measures reported properties throughput of the device client. The client runs on top of a fake
+transport that accepts every twin item handed to it by IoTHubClient_LL_DoWork and acknowledges it
+ACK_LATENCY_CYCLES DoWork cycles later, so a large number of twin operations are waiting for their
+acknowledgement at the same time. The scenario runs with the default settings, with
+twin_max_in_flight and with twin_coalesce_reported_state. Throughput is reported both in DoWork
+cycles (what the link sees) and in wall clock time (what the client costs). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#include "iothub_client_ll.h"
+#include "iothub_client_options.h"
+#include "internal/iothub_client_private.h"
+
+#define UPDATE_COUNT                20000   /* reported properties patches sent by the application */
+#define UPDATES_PER_CYCLE           50      /* patches sent between two DoWork calls */
+#define ACK_LATENCY_CYCLES          40      /* DoWork cycles between a twin item being handed to the transport and its acknowledgement */
+#define MAX_IN_FLIGHT               256     /* twin_max_in_flight used by the limited scenario */
+#define MAX_CYCLES                  100000  /* gives up if the updates are not all acknowledged by then */
+
+typedef struct PENDING_ACK_TAG
+{
+    uint32_t item_id;
+    size_t ack_cycle;
+} PENDING_ACK;
+
+typedef struct FAKE_TRANSPORT_TAG
+{
+    PENDING_ACK pending[UPDATE_COUNT];
+    size_t pending_head;
+    size_t pending_tail;
+    size_t operations;
+    size_t max_pending;
+} FAKE_TRANSPORT;
+
+static FAKE_TRANSPORT g_fake_transport;
+static size_t g_current_cycle;
+static size_t g_completed;
+
+/* fake transport: twin items are acknowledged in the order they were handed over, ACK_LATENCY_CYCLES later */
+static TRANSPORT_LL_HANDLE FakeTransport_Create(const IOTHUBTRANSPORT_CONFIG* config)
+{
+    (void)config;
+    memset(&g_fake_transport, 0, sizeof(g_fake_transport));
+    return (TRANSPORT_LL_HANDLE)&g_fake_transport;
+}
+
+static void FakeTransport_Destroy(TRANSPORT_LL_HANDLE handle)
+{
+    (void)handle;
+}
+
+static IOTHUB_DEVICE_HANDLE FakeTransport_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, PDLIST_ENTRY waitingToSend)
+{
+    (void)device;
+    (void)iotHubClientHandle;
+    (void)waitingToSend;
+    return (IOTHUB_DEVICE_HANDLE)handle;
+}
+
+static void FakeTransport_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
+{
+    (void)deviceHandle;
+}
+
+static void FakeTransport_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
+{
+    FAKE_TRANSPORT* transport = (FAKE_TRANSPORT*)handle;
+
+    while (transport->pending_head != transport->pending_tail &&
+        transport->pending[transport->pending_head].ack_cycle <= g_current_cycle)
+    {
+        IoTHubClientCore_LL_ReportedStateComplete(iotHubClientHandle, transport->pending[transport->pending_head].item_id, 204);
+        transport->pending_head++;
+    }
+}
+
+static int FakeTransport_SetRetryPolicy(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_RETRY_POLICY retryPolicy, size_t retryTimeoutLimitInSeconds)
+{
+    (void)handle;
+    (void)retryPolicy;
+    (void)retryTimeoutLimitInSeconds;
+    return 0;
+}
+
+static IOTHUB_CLIENT_RESULT FakeTransport_GetSendStatus(IOTHUB_DEVICE_HANDLE handle, IOTHUB_CLIENT_STATUS* iotHubClientStatus)
+{
+    (void)handle;
+    *iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+    return IOTHUB_CLIENT_OK;
+}
+
+static IOTHUB_CLIENT_RESULT FakeTransport_SetOption(TRANSPORT_LL_HANDLE handle, const char* optionName, const void* value)
+{
+    (void)handle;
+    (void)optionName;
+    (void)value;
+    return IOTHUB_CLIENT_OK;
+}
+
+static STRING_HANDLE FakeTransport_GetHostname(TRANSPORT_LL_HANDLE handle)
+{
+    (void)handle;
+    return STRING_construct("benchmark.azure-devices.net");
+}
+
+static int FakeTransport_Subscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    return 0;
+}
+
+static void FakeTransport_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+}
+
+static IOTHUB_PROCESS_ITEM_RESULT FakeTransport_ProcessItem(TRANSPORT_LL_HANDLE handle, IOTHUB_IDENTITY_TYPE item_type, IOTHUB_IDENTITY_INFO* iothub_item)
+{
+    IOTHUB_PROCESS_ITEM_RESULT result;
+    FAKE_TRANSPORT* transport = (FAKE_TRANSPORT*)handle;
+
+    if (item_type != IOTHUB_TYPE_DEVICE_TWIN || transport->pending_tail == UPDATE_COUNT)
+    {
+        result = IOTHUB_PROCESS_ERROR;
+    }
+    else
+    {
+        size_t pending_count;
+        transport->pending[transport->pending_tail].item_id = iothub_item->device_twin->item_id;
+        transport->pending[transport->pending_tail].ack_cycle = g_current_cycle + ACK_LATENCY_CYCLES;
+        transport->pending_tail++;
+        transport->operations++;
+
+        pending_count = transport->pending_tail - transport->pending_head;
+        if (pending_count > transport->max_pending)
+        {
+            transport->max_pending = pending_count;
+        }
+        result = IOTHUB_PROCESS_OK;
+    }
+    return result;
+}
+
+static IOTHUB_CLIENT_RESULT FakeTransport_SendMessageDisposition(MESSAGE_CALLBACK_INFO* messageData, IOTHUBMESSAGE_DISPOSITION_RESULT disposition)
+{
+    (void)messageData;
+    (void)disposition;
+    return IOTHUB_CLIENT_OK;
+}
+
+static int FakeTransport_DeviceMethod_Response(IOTHUB_DEVICE_HANDLE handle, METHOD_HANDLE methodId, const unsigned char* response, size_t response_size, int status_response)
+{
+    (void)handle;
+    (void)methodId;
+    (void)response;
+    (void)response_size;
+    (void)status_response;
+    return 0;
+}
+
+static TRANSPORT_PROVIDER g_fake_transport_provider =
+{
+    FakeTransport_SendMessageDisposition,
+    FakeTransport_Subscribe,
+    FakeTransport_Unsubscribe,
+    FakeTransport_DeviceMethod_Response,
+    FakeTransport_Subscribe,
+    FakeTransport_Unsubscribe,
+    FakeTransport_ProcessItem,
+    FakeTransport_GetHostname,
+    FakeTransport_SetOption,
+    FakeTransport_Create,
+    FakeTransport_Destroy,
+    FakeTransport_Register,
+    FakeTransport_Unregister,
+    FakeTransport_Subscribe,
+    FakeTransport_Unsubscribe,
+    FakeTransport_DoWork,
+    FakeTransport_SetRetryPolicy,
+    FakeTransport_GetSendStatus
+};
+
+static const TRANSPORT_PROVIDER* FakeTransport_Provider(void)
+{
+    return &g_fake_transport_provider;
+}
+
+static void reported_state_callback(int status_code, void* userContextCallback)
+{
+    (void)userContextCallback;
+    if (status_code < 300)
+    {
+        g_completed++;
+    }
+}
+
+static int run_scenario(const char* name, size_t max_in_flight, bool coalesce, TICK_COUNTER_HANDLE tick_counter)
+{
+    int result;
+    IOTHUB_CLIENT_CONFIG config;
+    IOTHUB_CLIENT_LL_HANDLE client;
+
+    memset(&config, 0, sizeof(config));
+    config.protocol = FakeTransport_Provider;
+    config.deviceId = "benchmark-device";
+    config.deviceKey = "ZmFrZWtleWZvcmJlbmNobWFya3M=";
+    config.iotHubName = "benchmark";
+    config.iotHubSuffix = "azure-devices.net";
+
+    if ((client = IoTHubClient_LL_Create(&config)) == NULL)
+    {
+        (void)printf("ERROR: IoTHubClient_LL_Create failed\r\n");
+        result = __LINE__;
+    }
+    else if (IoTHubClient_LL_SetOption(client, OPTION_TWIN_MAX_IN_FLIGHT, &max_in_flight) != IOTHUB_CLIENT_OK ||
+        IoTHubClient_LL_SetOption(client, OPTION_TWIN_COALESCE_REPORTED_STATE, &coalesce) != IOTHUB_CLIENT_OK)
+    {
+        (void)printf("ERROR: IoTHubClient_LL_SetOption failed\r\n");
+        IoTHubClient_LL_Destroy(client);
+        result = __LINE__;
+    }
+    else
+    {
+        tickcounter_ms_t start_ms = 0;
+        tickcounter_ms_t end_ms = 0;
+        size_t sent = 0;
+        char patch[64];
+
+        g_current_cycle = 0;
+        g_completed = 0;
+        result = 0;
+        (void)tickcounter_get_current_ms(tick_counter, &start_ms);
+
+        while (result == 0 && g_completed < UPDATE_COUNT && g_current_cycle < MAX_CYCLES)
+        {
+            size_t i;
+            for (i = 0; result == 0 && i < UPDATES_PER_CYCLE && sent < UPDATE_COUNT; i++)
+            {
+                int length = sprintf(patch, "{\"sequence\":%lu,\"sensor%lu\":{\"value\":%lu}}", (unsigned long)sent, (unsigned long)(sent % 8), (unsigned long)sent);
+                if (IoTHubClient_LL_SendReportedState(client, (const unsigned char*)patch, (size_t)length, reported_state_callback, NULL) != IOTHUB_CLIENT_OK)
+                {
+                    (void)printf("ERROR: IoTHubClient_LL_SendReportedState failed\r\n");
+                    result = __LINE__;
+                }
+                sent++;
+            }
+            IoTHubClient_LL_DoWork(client);
+            g_current_cycle++;
+        }
+        (void)tickcounter_get_current_ms(tick_counter, &end_ms);
+
+        if (result == 0 && g_completed < UPDATE_COUNT)
+        {
+            (void)printf("ERROR: only %lu of %d reported state callbacks completed\r\n", (unsigned long)g_completed, UPDATE_COUNT);
+            result = __LINE__;
+        }
+
+        (void)printf("%s:\r\n  updates=%lu twin operations=%lu max in flight=%lu cycles=%lu updates/cycle=%.1f wall=%lu ms",
+            name, (unsigned long)g_completed, (unsigned long)g_fake_transport.operations, (unsigned long)g_fake_transport.max_pending,
+            (unsigned long)g_current_cycle, (double)g_completed / g_current_cycle, (unsigned long)(end_ms - start_ms));
+        if (end_ms > start_ms)
+        {
+            (void)printf(" updates/s=%.0f", (double)g_completed * 1000 / (end_ms - start_ms));
+        }
+        (void)printf("\r\n");
+
+        IoTHubClient_LL_Destroy(client);
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    TICK_COUNTER_HANDLE tick_counter = tickcounter_create();
+    if (tick_counter == NULL)
+    {
+        (void)printf("ERROR: tickcounter_create failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        (void)printf("updates: %d, %d per cycle, acknowledgement after %d cycles\r\n", UPDATE_COUNT, UPDATES_PER_CYCLE, ACK_LATENCY_CYCLES);
+
+        if ((result = run_scenario("no in flight limit", 0, false, tick_counter)) == 0 &&
+            (result = run_scenario("twin_max_in_flight=256", MAX_IN_FLIGHT, false, tick_counter)) == 0)
+        {
+            result = run_scenario("twin_coalesce_reported_state", 0, true, tick_counter);
+        }
+        tickcounter_destroy(tick_counter);
+    }
+    return result;
+}
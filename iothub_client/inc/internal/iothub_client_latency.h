@@ -0,0 +1,46 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef IOTHUB_CLIENT_LATENCY_H
+#define IOTHUB_CLIENT_LATENCY_H
+
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#include "iothub_client_statistics.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define IOTHUB_CLIENT_LATENCY_EVENT_VALUES      \
+    IOTHUB_CLIENT_LATENCY_EVENT_ENQUEUED,       \
+    IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED,       \
+    IOTHUB_CLIENT_LATENCY_EVENT_ENCODED,        \
+    IOTHUB_CLIENT_LATENCY_EVENT_WRITTEN,        \
+    IOTHUB_CLIENT_LATENCY_EVENT_COMPLETED,      \
+    IOTHUB_CLIENT_LATENCY_EVENT_COUNT
+
+DEFINE_ENUM(IOTHUB_CLIENT_LATENCY_EVENT, IOTHUB_CLIENT_LATENCY_EVENT_VALUES);
+
+/*the time at which a message went through each event, an event is only stamped the first time it happens so that a
+retransmission does not hide the time the first attempt took*/
+typedef struct IOTHUB_CLIENT_LATENCY_STAMPS_TAG
+{
+    tickcounter_ms_t at[IOTHUB_CLIENT_LATENCY_EVENT_COUNT];
+    unsigned int stamped; /*bit mask of the stamped events*/
+} IOTHUB_CLIENT_LATENCY_STAMPS;
+
+MOCKABLE_FUNCTION(, void, IoTHubClient_Latency_ResetStamps, IOTHUB_CLIENT_LATENCY_STAMPS*, stamps);
+MOCKABLE_FUNCTION(, void, IoTHubClient_Latency_Stamp, IOTHUB_CLIENT_LATENCY_STAMPS*, stamps, IOTHUB_CLIENT_LATENCY_EVENT, latency_event, tickcounter_ms_t, now);
+MOCKABLE_FUNCTION(, void, IoTHubClient_Latency_RecordStages, IOTHUB_CLIENT_STATISTICS*, statistics, const IOTHUB_CLIENT_LATENCY_STAMPS*, stamps);
+MOCKABLE_FUNCTION(, void, IoTHubClient_Latency_Record, IOTHUB_CLIENT_LATENCY_HISTOGRAM*, histogram, tickcounter_ms_t, value);
+MOCKABLE_FUNCTION(, void, IoTHubClient_Latency_Merge, IOTHUB_CLIENT_LATENCY_HISTOGRAM*, destination, const IOTHUB_CLIENT_LATENCY_HISTOGRAM*, source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_LATENCY_H */
@@ -0,0 +1,116 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file   iothub_client_offline_store.h
+*   @brief  Durable, disk backed spool for telemetry that does not fit in the in-memory
+*           waitingToSend list while the client is disconnected.
+*
+*   @details Messages are serialized and appended to a log made of fixed size, memory-mapped
+*            segment files kept in a single directory. Messages are read back in the order they
+*            were appended. The offset of the oldest message not yet acknowledged by the service is
+*            checkpointed in the same directory, so that after a crash or restart every message
+*            that was not acknowledged is replayed (at-least-once delivery).
+*/
+
+#ifndef IOTHUB_CLIENT_OFFLINE_STORE_H
+#define IOTHUB_CLIENT_OFFLINE_STORE_H
+
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#include "iothub_message.h"
+#include "iothub_client_core_common.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#endif
+
+#define OFFLINE_STORE_DEFAULT_SEGMENT_SIZE      (1024 * 1024)
+#define OFFLINE_STORE_DEFAULT_MAX_SIZE          (16 * 1024 * 1024)
+
+typedef struct OFFLINE_STORE_INSTANCE_TAG* OFFLINE_STORE_HANDLE;
+
+/** @brief  Configuration of an offline store instance */
+typedef struct OFFLINE_STORE_CONFIG_TAG
+{
+    /* Directory where segment and checkpoint files are kept. Created if it does not exist. */
+    const char* directory;
+    /* Size, in bytes, of each segment file. A single serialized message cannot be larger than a segment. */
+    size_t segment_size;
+    /* Maximum number of bytes the store may use on disk (rounded down to a multiple of segment_size, at least two segments). */
+    size_t max_size;
+    /* When the store is full: true drops the oldest segment to make room, false rejects the new message. */
+    bool drop_oldest;
+} OFFLINE_STORE_CONFIG;
+
+/**
+    * @brief    Opens (or creates) the offline store in config->directory, recovering any segments and the
+    *           checkpoint left behind by a previous instance.
+    *
+    * @param    config  Pointer to an @c OFFLINE_STORE_CONFIG structure
+    *
+    * @return   A non-NULL @c OFFLINE_STORE_HANDLE on success, NULL otherwise.
+    */
+MOCKABLE_FUNCTION(, OFFLINE_STORE_HANDLE, IoTHubClient_OfflineStore_Create, const OFFLINE_STORE_CONFIG*, config);
+
+/**
+    * @brief    Flushes the store and closes it. Confirmation callbacks of messages still on disk are invoked with
+    *           @c IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY; the messages themselves stay on disk and are
+    *           replayed by the next instance opened on the same directory.
+    */
+MOCKABLE_FUNCTION(, void, IoTHubClient_OfflineStore_Destroy, OFFLINE_STORE_HANDLE, handle);
+
+/**
+    * @brief    Serializes @p message and appends it to the end of the store.
+    *
+    * @remarks  @p callback and @p context are kept in memory only and handed back by
+    *           @c IoTHubClient_OfflineStore_Pop. Messages recovered from disk after a restart have no callback.
+    *           The record survives a crash of the process right away, and a power loss once
+    *           @c IoTHubClient_OfflineStore_Flush has run.
+    *
+    * @return   0 on success, non-zero if the message cannot be stored (e.g. the store is full and configured to drop newest).
+    */
+MOCKABLE_FUNCTION(, int, IoTHubClient_OfflineStore_Push, OFFLINE_STORE_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, message, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, callback, void*, context);
+
+/**
+    * @brief    Reads the oldest message not yet handed out.
+    *
+    * @remarks  The message stays on disk until @c IoTHubClient_OfflineStore_Complete is called with the returned @p offset.
+    *
+    * @return   0 on success, non-zero if the store is empty or the record cannot be read.
+    */
+MOCKABLE_FUNCTION(, int, IoTHubClient_OfflineStore_Pop, OFFLINE_STORE_HANDLE, handle, IOTHUB_MESSAGE_HANDLE*, message, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK*, callback, void**, context, uint64_t*, offset);
+
+/**
+    * @brief    Marks the message at @p offset as done. The checkpoint advances over every contiguous
+    *           completed message; it is written to disk by the next @c IoTHubClient_OfflineStore_Flush.
+    */
+MOCKABLE_FUNCTION(, int, IoTHubClient_OfflineStore_Complete, OFFLINE_STORE_HANDLE, handle, uint64_t, offset);
+
+/**
+    * @brief    Flushes the records pushed since the previous call, persists the checkpoint if it moved
+    *           and deletes the segments entirely behind it.
+    *
+    * @remarks  Meant to be called once per DoWork rather than after every Push or Complete. Messages
+    *           completed but not yet flushed are replayed after a crash.
+    *
+    * @return   0 on success, non-zero otherwise.
+    */
+MOCKABLE_FUNCTION(, int, IoTHubClient_OfflineStore_Flush, OFFLINE_STORE_HANDLE, handle);
+
+/**
+    * @brief    Returns the number of messages on disk that have not been handed out by @c IoTHubClient_OfflineStore_Pop.
+    */
+MOCKABLE_FUNCTION(, size_t, IoTHubClient_OfflineStore_GetCount, OFFLINE_STORE_HANDLE, handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_OFFLINE_STORE_H */
@@ -18,6 +18,9 @@
 #include "iothub_client_core_ll.h"
 #include "internal/iothub_transport_ll_private.h"
 #include "internal/iothubtransport.h"
+#ifdef USE_LATENCY_TRACING
+#include "internal/iothub_client_latency.h"
+#endif
 
 #ifdef __cplusplus
 extern "C"
@@ -54,8 +57,42 @@ typedef struct IOTHUB_MESSAGE_LIST_TAG
     void* context; 
     DLIST_ENTRY entry;
     tickcounter_ms_t ms_timesOutAfter; /* a value of "0" means "no timeout", if the IOTHUBCLIENT_LL's handle tickcounter > msTimesOutAfer then the message shall timeout*/
+    IOTHUB_MESSAGE_PRIORITY priority; /* waitingToSend is kept ordered by priority, transports send from its head */
+#ifdef USE_LATENCY_TRACING
+    IOTHUB_CLIENT_LATENCY_STAMPS latency_stamps;
+#endif
 }IOTHUB_MESSAGE_LIST;
 
+#ifdef USE_LATENCY_TRACING
+MOCKABLE_FUNCTION(, void, IoTHubClientCore_LL_TraceLatency, IOTHUB_CLIENT_CORE_LL_HANDLE, handle, IOTHUB_MESSAGE_LIST*, message, IOTHUB_CLIENT_LATENCY_EVENT, latency_event);
+
+/*stamps a message with the current time of the LL handle, see iothub_client_statistics.h for the stages*/
+#define IOTHUB_CLIENT_LATENCY_TRACE(handle, message, latency_event) IoTHubClientCore_LL_TraceLatency(handle, message, latency_event)
+#else
+#define IOTHUB_CLIENT_LATENCY_TRACE(handle, message, latency_event) (void)0
+#endif
+
+#ifdef USE_CLIENT_METRICS
+MOCKABLE_FUNCTION(, void, IoTHubClientCore_LL_CountMetric, IOTHUB_CLIENT_CORE_LL_HANDLE, handle, IOTHUB_CLIENT_METRIC, metric, uint64_t, amount);
+MOCKABLE_FUNCTION(, void, IoTHubClientCore_LL_CountEventCompleted, IOTHUB_CLIENT_CORE_LL_HANDLE, handle, IOTHUB_MESSAGE_LIST*, message, IOTHUB_CLIENT_CONFIRMATION_RESULT, result);
+MOCKABLE_FUNCTION(, void, IoTHubClientCore_LL_SetQueueDepth, IOTHUB_CLIENT_CORE_LL_HANDLE, handle, IOTHUB_CLIENT_QUEUE, queue, size_t, depth);
+
+/*the transports feed the metrics of their LL handle from the thread running its DoWork, see iothub_client_metrics.h*/
+#define IOTHUB_CLIENT_METRIC_ADD(handle, metric, amount) IoTHubClientCore_LL_CountMetric(handle, metric, amount)
+#define IOTHUB_CLIENT_METRIC_EVENT_COMPLETED(handle, message, result) IoTHubClientCore_LL_CountEventCompleted(handle, message, result)
+#define IOTHUB_CLIENT_METRIC_QUEUE_DEPTH(handle, queue, depth) IoTHubClientCore_LL_SetQueueDepth(handle, queue, depth)
+#else
+#define IOTHUB_CLIENT_METRIC_ADD(handle, metric, amount) (void)0
+#define IOTHUB_CLIENT_METRIC_EVENT_COMPLETED(handle, message, result) (void)0
+#define IOTHUB_CLIENT_METRIC_QUEUE_DEPTH(handle, queue, depth) (void)0
+#endif
+
+typedef struct IOTHUB_REPORTED_STATE_CALLBACK_INFO_TAG
+{
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reported_state_callback;
+    void* context;
+} IOTHUB_REPORTED_STATE_CALLBACK_INFO;
+
 typedef struct IOTHUB_DEVICE_TWIN_TAG
 {
     uint32_t item_id;
@@ -66,6 +103,9 @@ typedef struct IOTHUB_DEVICE_TWIN_TAG
     DLIST_ENTRY entry;
     IOTHUB_CLIENT_CORE_LL_HANDLE client_handle;
     IOTHUB_DEVICE_HANDLE device_handle;
+    IOTHUB_REPORTED_STATE_CALLBACK_INFO* coalesced_callbacks; /* callbacks of the later patches merged into report_data_handle, completed after reported_state_callback */
+    size_t coalesced_callback_count;
+    struct IOTHUB_DEVICE_TWIN_TAG* next_in_ack_index; /* next item of the same ack index bucket, see IoTHubClientCore_LL_ReportedStateComplete */
 } IOTHUB_DEVICE_TWIN;
 
 union IOTHUB_IDENTITY_INFO_TAG
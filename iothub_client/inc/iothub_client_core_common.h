@@ -146,6 +146,14 @@ extern "C"
     DEFINE_ENUM(DEVICE_TWIN_UPDATE_STATE, DEVICE_TWIN_UPDATE_STATE_VALUES);
 
     typedef void(*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK)(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback);
+
+    typedef struct IOTHUB_CLIENT_EVENT_CONFIRMATION_TAG
+    {
+        void* userContextCallback;
+        IOTHUB_CLIENT_CONFIRMATION_RESULT result;
+    } IOTHUB_CLIENT_EVENT_CONFIRMATION;
+
+    typedef void(*IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK)(const IOTHUB_CLIENT_EVENT_CONFIRMATION* confirmations, size_t count, void* userContextCallback);
     typedef void(*IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK)(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* userContextCallback);
     typedef IOTHUBMESSAGE_DISPOSITION_RESULT (*IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC)(IOTHUB_MESSAGE_HANDLE message, void* userContextCallback);
 
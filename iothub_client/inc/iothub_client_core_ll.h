@@ -29,6 +29,8 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG* IOTHUB_CLIENT_CORE_LL_HAND
 #include "azure_c_shared_utility/umock_c_prod.h"
 #include "iothub_transport_ll.h"
 #include "iothub_client_core_common.h"
+#include "iothub_client_statistics.h"
+#include "iothub_client_metrics.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -63,6 +65,14 @@ extern "C"
 
 #endif /*DONT_USE_UPLOADTOBLOB*/
 
+#ifdef USE_LATENCY_TRACING
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClientCore_LL_GetStatistics, IOTHUB_CLIENT_CORE_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATISTICS*, statistics);
+#endif /*USE_LATENCY_TRACING*/
+
+#ifdef USE_CLIENT_METRICS
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClientCore_LL_GetMetrics, IOTHUB_CLIENT_CORE_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_METRICS*, metrics);
+#endif /*USE_CLIENT_METRICS*/
+
 #ifdef __cplusplus
 }
 #endif
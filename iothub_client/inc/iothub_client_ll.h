@@ -398,6 +398,32 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG* IOTHUB_CLIENT_LL_HANDLE;
 
 #endif /*DONT_USE_UPLOADTOBLOB*/
 
+#ifdef USE_LATENCY_TRACING
+     /**
+     * @brief    Copies the latency histograms of the telemetry messages acknowledged so far, see iothub_client_statistics.h.
+     *           Only available when the SDK is built with use_latency_tracing.
+     *
+     * @param    iotHubClientHandle  The handle created by a call to the create function.
+     * @param    statistics          Out parameter receiving the histograms.
+     *
+     * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+     */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetStatistics, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATISTICS*, statistics);
+#endif /* USE_LATENCY_TRACING */
+
+#ifdef USE_CLIENT_METRICS
+     /**
+     * @brief    Copies the counters and queue depths of the client, see iothub_client_metrics.h.
+     *           Only available when the SDK is built with use_client_metrics.
+     *
+     * @param    iotHubClientHandle  The handle created by a call to the create function.
+     * @param    metrics             Out parameter receiving the snapshot.
+     *
+     * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+     */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetMetrics, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_METRICS*, metrics);
+#endif /* USE_CLIENT_METRICS */
+
 #ifdef __cplusplus
 }
 #endif
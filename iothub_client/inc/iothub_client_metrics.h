@@ -0,0 +1,72 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Counters and queue depths reported by the transports, collected when the SDK is built with use_client_metrics */
+
+#ifndef IOTHUB_CLIENT_METRICS_H
+#define IOTHUB_CLIENT_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/macro_utils.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define IOTHUB_CLIENT_METRIC_VALUES                     \
+    IOTHUB_CLIENT_METRIC_EVENTS_SENT,                   \
+    IOTHUB_CLIENT_METRIC_EVENT_BYTES_SENT,              \
+    IOTHUB_CLIENT_METRIC_EVENTS_FAILED,                 \
+    IOTHUB_CLIENT_METRIC_MESSAGES_RECEIVED,             \
+    IOTHUB_CLIENT_METRIC_MESSAGE_BYTES_RECEIVED,        \
+    IOTHUB_CLIENT_METRIC_SEND_RETRIES,                  \
+    IOTHUB_CLIENT_METRIC_RECONNECTS,                    \
+    IOTHUB_CLIENT_METRIC_AUTH_REFRESHES,                \
+    IOTHUB_CLIENT_METRIC_THROTTLED,                     \
+    IOTHUB_CLIENT_METRIC_COUNT
+
+    /** @brief  The counters of a device client, they only ever grow.
+    *
+    *   EVENTS_SENT:            telemetry messages acknowledged by the IoT Hub.
+    *   EVENT_BYTES_SENT:       payload bytes of the acknowledged telemetry messages.
+    *   EVENTS_FAILED:          telemetry messages confirmed with any other result than IOTHUB_CLIENT_CONFIRMATION_OK.
+    *   MESSAGES_RECEIVED:      cloud to device messages handed to the client.
+    *   MESSAGE_BYTES_RECEIVED: payload bytes of the cloud to device messages.
+    *   SEND_RETRIES:           MQTT PUBLISH packets sent again after their acknowledgement timed out, HTTP telemetry requests put back
+    *                           in the queue after a failure.
+    *   RECONNECTS:             connections established after the first one, SAS token refreshes included (MQTT), or devices
+    *                           restarted by a connection retry (AMQP).
+    *   AUTH_REFRESHES:         reconnections made to renew an expiring SAS token (MQTT).
+    *   THROTTLED:              requests answered with status 429, telemetry and cloud to device over HTTP, reported properties on all
+    *                           the protocols.
+    */
+    DEFINE_ENUM(IOTHUB_CLIENT_METRIC, IOTHUB_CLIENT_METRIC_VALUES);
+
+#define IOTHUB_CLIENT_QUEUE_VALUES                      \
+    IOTHUB_CLIENT_QUEUE_WAITING_TO_SEND,                \
+    IOTHUB_CLIENT_QUEUE_WAITING_FOR_ACK,                \
+    IOTHUB_CLIENT_QUEUE_IN_PROGRESS,                    \
+    IOTHUB_CLIENT_QUEUE_COUNT
+
+    /** @brief  The telemetry queues of a device client.
+    *
+    *   WAITING_TO_SEND:    messages not picked up by the transport yet, submissions queued by IoTHubClient_SendEventAsync included.
+    *   WAITING_FOR_ACK:    MQTT PUBLISH packets waiting for their PUBACK.
+    *   IN_PROGRESS:        messages handed to the AMQP messenger and not settled yet.
+    */
+    DEFINE_ENUM(IOTHUB_CLIENT_QUEUE, IOTHUB_CLIENT_QUEUE_VALUES);
+
+    /** @brief  A snapshot of the metrics of a device client, or of all the devices of a shared transport. */
+    typedef struct IOTHUB_CLIENT_METRICS_TAG
+    {
+        uint64_t counters[IOTHUB_CLIENT_METRIC_COUNT];
+        size_t queue_depths[IOTHUB_CLIENT_QUEUE_COUNT];
+    } IOTHUB_CLIENT_METRICS;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_METRICS_H */
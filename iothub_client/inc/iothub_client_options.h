@@ -33,8 +33,32 @@ extern "C"
     static STATIC_VAR_UNUSED const char* OPTION_CBS_REQUEST_TIMEOUT = "cbs_request_timeout";
 
     static STATIC_VAR_UNUSED const char* OPTION_MIN_POLLING_TIME = "MinimumPollingTime";
+    /*
+    * @brief    When greater than MinimumPollingTime (unsigned int, in seconds), the HTTP transport polls a device that just received
+    *           a message every MinimumPollingTime and doubles the interval after every poll without message, up to this value.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MAX_POLLING_TIME = "MaximumPollingTime";
     static STATIC_VAR_UNUSED const char* OPTION_BATCHING = "Batching";
 
+    /*
+    * @brief    Number of connections (unsigned int, 1 to 16, default 1) the HTTP transport serves its devices on concurrently.
+    *           Every connection past the first is served by its own thread for as long as it exists.
+    *           Has to be set before the options that the transport passes down to its HTTP connections, such as TrustedCerts.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_HTTP_CONNECTION_POOL_SIZE = "http_connection_pool_size";
+    /*
+    * @brief    Time (unsigned int, in milliseconds, 0 for none) into a DoWork of the HTTP transport after which the devices that
+    *           have not been served yet are left for the next DoWork, which serves them first. Only used with a connection pool.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_HTTP_DEVICE_DEADLINE_MS = "http_device_deadline_ms";
+
+    /*
+    * @brief    Number of events (size_t) that IoTHubClient_SendEventAsync can queue for the worker thread without taking the lock that
+    *           the worker thread holds for the whole of a DoWork. Events sent while the queue is full take that lock as before.
+    *           0 (default) sends every event under the lock. Set it before the first IoTHubClient_SendEventAsync.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_SEND_EVENT_RING_SIZE = "send_event_ring_size";
+
     static STATIC_VAR_UNUSED const char* OPTION_MESSAGE_TIMEOUT = "messageTimeout";
     static STATIC_VAR_UNUSED const char* OPTION_BLOB_UPLOAD_TIMEOUT_SECS = "blob_upload_timeout_secs";
     static STATIC_VAR_UNUSED const char* OPTION_PRODUCT_INFO = "product_info";
@@ -66,6 +90,55 @@ extern "C"
     //diagnostic sampling percentage value, [0-100]
     static STATIC_VAR_UNUSED const char* OPTION_DIAGNOSTIC_SAMPLING_PERCENTAGE = "diag_sampling_percentage";
 
+    /*
+    * @brief    When set to true (a pointer to bool), IoTHubClient_LL_SendReportedState merges a new reported properties patch into the last
+    *           patch that has not been handed to the transport yet (last writer wins per property, nested objects are merged) instead of
+    *           queuing a new twin operation. The callbacks of all the merged patches are invoked, in order, when the merged patch completes.
+    *           Patches that are not JSON objects are queued as usual. The default is false.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_TWIN_COALESCE_REPORTED_STATE = "twin_coalesce_reported_state";
+
+    /*
+    * @brief    Maximum number of device twin operations (a pointer to size_t) that IoTHubClient_LL_DoWork hands to the transport before
+    *           their acknowledgements come back. Every queued operation is handed over in the same DoWork call until the limit is reached.
+    *           The default, 0, means no limit. See OPTION_TWIN_ACK_TIMEOUT to free the slots of operations whose acknowledgement is lost.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_TWIN_MAX_IN_FLIGHT = "twin_max_in_flight";
+
+    /*
+    * @brief    Milliseconds (a pointer to tickcounter_ms_t) a device twin operation handed to the transport waits for its acknowledgement.
+    *           After that its callback gets status 408, it no longer counts against OPTION_TWIN_MAX_IN_FLIGHT and a late acknowledgement is
+    *           ignored. Applies to operations handed to the transport after the option is set. The default, 0, means they wait forever.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_TWIN_ACK_TIMEOUT = "twin_ack_timeout_ms";
+
+    /*
+    * @brief    Maximum number of telemetry messages (a pointer to size_t) the MQTT and AMQP transports have on the wire waiting for their
+    *           acknowledgement. Further messages stay in the send queue of the client, where high priority messages (see IoTHubMessage_SetPriority)
+    *           are taken first. 0 means no limit. When the option is not set there is no limit until the first message with a priority other
+    *           than IOTHUB_MESSAGE_PRIORITY_NORMAL is queued; from then on the limit is 64.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MAX_IN_FLIGHT_TELEMETRY = "max_in_flight_telemetry";
+
+    /*
+    * @brief Offline store options, only available when the SDK is built with use_offline_store.
+    *        OPTION_OFFLINE_STORE_DIRECTORY (const char*) enables the store: once more than OPTION_OFFLINE_STORE_RAM_THRESHOLD (size_t*, messages)
+    *        events are waiting to be sent, new events are spooled to memory-mapped segment files of OPTION_OFFLINE_STORE_SEGMENT_SIZE (size_t*, bytes)
+    *        in that directory, using at most OPTION_OFFLINE_STORE_MAX_SIZE (size_t*, bytes) of disk. When the store is full, OPTION_OFFLINE_STORE_DROP_OLDEST (bool*)
+    *        selects between dropping the oldest spooled events and rejecting new ones. The size and drop options must be set before the directory.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_OFFLINE_STORE_DIRECTORY = "offline_store_directory";
+    static STATIC_VAR_UNUSED const char* OPTION_OFFLINE_STORE_RAM_THRESHOLD = "offline_store_ram_threshold";
+    static STATIC_VAR_UNUSED const char* OPTION_OFFLINE_STORE_MAX_SIZE = "offline_store_max_size";
+    static STATIC_VAR_UNUSED const char* OPTION_OFFLINE_STORE_SEGMENT_SIZE = "offline_store_segment_size";
+    static STATIC_VAR_UNUSED const char* OPTION_OFFLINE_STORE_DROP_OLDEST = "offline_store_drop_oldest";
+
+    /*
+    * @brief    Read only, IoTHubClientCore_LL_GetOption returns a pointer to the IOTHUB_CLIENT_STATISTICS the LL handle updates while sending
+    *           telemetry. Only available when the SDK is built with use_latency_tracing.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_LATENCY_STATISTICS = "latency_statistics";
+
 #ifdef __cplusplus
 }
 #endif
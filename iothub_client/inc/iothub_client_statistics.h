@@ -0,0 +1,77 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Latency statistics of the telemetry send pipeline, collected when the SDK is built with use_latency_tracing */
+
+#ifndef IOTHUB_CLIENT_STATISTICS_H
+#define IOTHUB_CLIENT_STATISTICS_H
+
+#include <stdint.h>
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*values below IOTHUB_CLIENT_LATENCY_EXACT_BUCKETS milliseconds have a bucket each, every power of two above is split
+into IOTHUB_CLIENT_LATENCY_SUB_BUCKETS buckets, which bounds the error of a reported value to 1/8th of it*/
+#define IOTHUB_CLIENT_LATENCY_EXACT_BUCKETS     16
+#define IOTHUB_CLIENT_LATENCY_SUB_BUCKETS       8
+#define IOTHUB_CLIENT_LATENCY_BUCKET_COUNT      (IOTHUB_CLIENT_LATENCY_EXACT_BUCKETS + (32 - 4) * IOTHUB_CLIENT_LATENCY_SUB_BUCKETS)
+
+#define IOTHUB_CLIENT_LATENCY_STAGE_VALUES                  \
+    IOTHUB_CLIENT_LATENCY_STAGE_ENQUEUE,                    \
+    IOTHUB_CLIENT_LATENCY_STAGE_WAITING_TO_SEND,            \
+    IOTHUB_CLIENT_LATENCY_STAGE_ENCODING,                   \
+    IOTHUB_CLIENT_LATENCY_STAGE_SOCKET_WRITE,               \
+    IOTHUB_CLIENT_LATENCY_STAGE_ACKNOWLEDGEMENT,            \
+    IOTHUB_CLIENT_LATENCY_STAGE_CALLBACK_DISPATCH,          \
+    IOTHUB_CLIENT_LATENCY_STAGE_TOTAL,                      \
+    IOTHUB_CLIENT_LATENCY_STAGE_COUNT
+
+    /** @brief  The stages of a telemetry message, from IoTHubClient_SendEventAsync to its confirmation callback.
+    *
+    *   ENQUEUE:            from IoTHubClient_SendEventAsync until the message is queued in the LL layer (convenience layer only).
+    *   WAITING_TO_SEND:    time spent queued, until the transport picks the message up.
+    *   ENCODING:           building the MQTT PUBLISH, AMQP message or HTTP request.
+    *   SOCKET_WRITE:       handing the encoded message to the protocol client (MQTT only).
+    *   ACKNOWLEDGEMENT:    waiting for the PUBACK, the AMQP disposition or the HTTP response.
+    *   CALLBACK_DISPATCH:  from the acknowledgement until the confirmation callback is invoked (convenience layer only).
+    *   TOTAL:              from the LL queue to the acknowledgement.
+    */
+    DEFINE_ENUM(IOTHUB_CLIENT_LATENCY_STAGE, IOTHUB_CLIENT_LATENCY_STAGE_VALUES);
+
+    /** @brief  A latency histogram, all values are in milliseconds. */
+    typedef struct IOTHUB_CLIENT_LATENCY_HISTOGRAM_TAG
+    {
+        uint64_t count;
+        uint64_t sum;
+        uint32_t min;
+        uint32_t max;
+        uint32_t buckets[IOTHUB_CLIENT_LATENCY_BUCKET_COUNT];
+    } IOTHUB_CLIENT_LATENCY_HISTOGRAM;
+
+    typedef struct IOTHUB_CLIENT_STATISTICS_TAG
+    {
+        IOTHUB_CLIENT_LATENCY_HISTOGRAM stages[IOTHUB_CLIENT_LATENCY_STAGE_COUNT];
+    } IOTHUB_CLIENT_STATISTICS;
+
+#ifdef USE_LATENCY_TRACING
+    /**
+    * @brief    Returns the latency under which @p percentile percents of the recorded values fall.
+    *
+    * @param    histogram   A histogram returned in an IOTHUB_CLIENT_STATISTICS.
+    * @param    percentile  A value between 0 and 100.
+    *
+    * @return   The highest value of the bucket holding the percentile, capped by the largest recorded value. 0 when the histogram is empty.
+    */
+    MOCKABLE_FUNCTION(, uint32_t, IoTHubClient_LatencyHistogram_GetPercentile, const IOTHUB_CLIENT_LATENCY_HISTOGRAM*, histogram, double, percentile);
+#endif /* USE_LATENCY_TRACING */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_STATISTICS_H */
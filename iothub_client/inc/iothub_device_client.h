@@ -125,6 +125,30 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_SendEventAsync, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
 
+    /**
+    * @brief	Sets up a callback that receives the delivery confirmations of the events sent
+    * 			with ::IoTHubDeviceClient_SendEventAsync in batches, one call per pass of the worker
+    * 			thread, instead of one callback per event.
+    *
+    * @param	iotHubClientHandle		   	The handle created by a call to the create function.
+    * @param	eventConfirmationBatchCallback	The callback receiving an array of @c count
+    * 										confirmations. Each entry holds the @c userContextCallback
+    * 										given to ::IoTHubDeviceClient_SendEventAsync and the result of
+    * 										the delivery. The array is only valid for the duration of
+    * 										the call. While set, the per event callbacks given to
+    * 										::IoTHubDeviceClient_SendEventAsync are not called. The user can
+    * 										specify a @c NULL value here to go back to the per event
+    * 										callbacks.
+    * @param	userContextCallback			User specified context that will be provided to the
+    * 										callback. This can be @c NULL.
+    *
+    *			@b NOTE: The application behavior is undefined if the user calls
+    *			the ::IoTHubDeviceClient_Destroy function from within any callback.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_SetEventConfirmationBatchCallback, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK, eventConfirmationBatchCallback, void*, userContextCallback);
+
     /**
     * @brief	This function returns the current sending status for IoTHubClient.
     *
@@ -361,6 +385,33 @@ extern "C"
 
 #endif /* DONT_USE_UPLOADTOBLOB */
 
+#ifdef USE_LATENCY_TRACING
+    /**
+    * @brief    Copies the latency histograms of the telemetry messages acknowledged so far, see iothub_client_statistics.h.
+    *           Only available when the SDK is built with use_latency_tracing.
+    *           The convenience layer adds the ENQUEUE and CALLBACK_DISPATCH stages, which the LL layer does not see.
+    *
+    * @param    iotHubClientHandle  The handle created by a call to the create function.
+    * @param    statistics          Out parameter receiving the histograms.
+    *
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_GetStatistics, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATISTICS*, statistics);
+#endif /* USE_LATENCY_TRACING */
+
+#ifdef USE_CLIENT_METRICS
+    /**
+    * @brief    Copies the counters and queue depths of the client, see iothub_client_metrics.h.
+    *           Only available when the SDK is built with use_client_metrics.
+    *
+    * @param    iotHubClientHandle  The handle created by a call to the create function.
+    * @param    metrics             Out parameter receiving the snapshot.
+    *
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_GetMetrics, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_METRICS*, metrics);
+#endif /* USE_CLIENT_METRICS */
+
 #ifdef __cplusplus
 }
 #endif
@@ -42,6 +42,16 @@ IOTHUBMESSAGE_UNKNOWN \
 */
 DEFINE_ENUM(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
 
+#define IOTHUB_MESSAGE_PRIORITY_VALUES \
+IOTHUB_MESSAGE_PRIORITY_NORMAL, \
+IOTHUB_MESSAGE_PRIORITY_HIGH \
+
+/** @brief Enumeration specifying the local send priority of a message.
+*   Messages of higher priority are sent before any message of lower priority
+*   still waiting in the device client; the priority is not sent to the service.
+*/
+DEFINE_ENUM(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
+
 typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG* IOTHUB_MESSAGE_HANDLE;
 
 /** @brief diagnostic related data*/
@@ -262,6 +272,30 @@ MOCKABLE_FUNCTION(, const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA*, IoTHubMessag
 */
 MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetDiagnosticPropertyData, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA*, diagnosticData);
 
+/**
+* @brief   Sets the send priority of the message. Messages default to IOTHUB_MESSAGE_PRIORITY_NORMAL.
+*          The MQTT and AMQP transports only take messages from the send queue while fewer than
+*          OPTION_MAX_IN_FLIGHT_TELEMETRY messages wait for their acknowledgement, the priority
+*          orders the messages that are still queued. Unless that option is set, the limit
+*          only applies once a message of IOTHUB_MESSAGE_PRIORITY_HIGH has been queued.
+*
+* @param   iotHubMessageHandle Handle to the message.
+* @param   priority The priority used to order the message in the device client send queue.
+*
+* @return  Returns IOTHUB_MESSAGE_OK if the priority was set successfully
+*          or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY, priority);
+
+/**
+* @brief   Gets the send priority of the message.
+*
+* @param   iotHubMessageHandle Handle to the message.
+*
+* @return  The priority of the message, or IOTHUB_MESSAGE_PRIORITY_NORMAL if @p iotHubMessageHandle is NULL.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_PRIORITY, IoTHubMessage_GetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+
 /**
 * @brief   Frees all resources associated with the given message handle.
 *
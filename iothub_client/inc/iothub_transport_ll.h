@@ -15,6 +15,7 @@ extern "C"
 #endif
 
 #include "azure_c_shared_utility/umock_c_prod.h"
+#include "iothub_client_metrics.h"
 
 typedef void* TRANSPORT_LL_HANDLE;
 typedef void* IOTHUB_DEVICE_HANDLE;
@@ -33,6 +34,19 @@ MOCKABLE_FUNCTION(, TRANSPORT_HANDLE, IoTHubTransport_Create, IOTHUB_CLIENT_TRAN
 MOCKABLE_FUNCTION(, void, IoTHubTransport_Destroy, TRANSPORT_HANDLE, transportHandle);
 MOCKABLE_FUNCTION(, TRANSPORT_LL_HANDLE, IoTHubTransport_GetLLTransport, TRANSPORT_HANDLE, transportHandle);
 
+#ifdef USE_CLIENT_METRICS
+/**
+* @brief    Adds up the metrics of every client using a shared transport, see iothub_client_metrics.h.
+*           Only available when the SDK is built with use_client_metrics.
+*
+* @param    transportHandle The handle created by IoTHubTransport_Create.
+* @param    metrics         Out parameter receiving the sum.
+*
+* @return   0 upon success, non-zero otherwise.
+*/
+MOCKABLE_FUNCTION(, int, IoTHubTransport_GetMetrics, TRANSPORT_HANDLE, transportHandle, IOTHUB_CLIENT_METRICS*, metrics);
+#endif /* USE_CLIENT_METRICS */
+
 #ifdef __cplusplus
 }
 #endif
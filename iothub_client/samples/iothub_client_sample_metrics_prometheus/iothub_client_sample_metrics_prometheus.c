@@ -0,0 +1,236 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "iothub_client.h"
+#include "iothub_client_options.h"
+#include "iothub_client_metrics.h"
+#include "iothub_message.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/platform.h"
+
+/* This sample sends telemetry with the convenience APIs of iothub_client and every few seconds writes the metrics of the
+client to a file in the Prometheus text exposition format, ready to be picked up by the textfile collector of the node
+exporter. The SDK must be built with -Duse_client_metrics=ON. */
+
+// The protocol you wish to use should be uncommented
+//
+#define SAMPLE_MQTT
+//#define SAMPLE_MQTT_OVER_WEBSOCKETS
+//#define SAMPLE_AMQP
+//#define SAMPLE_AMQP_OVER_WEBSOCKETS
+//#define SAMPLE_HTTP
+
+#ifdef SAMPLE_MQTT
+    #include "iothubtransportmqtt.h"
+#endif // SAMPLE_MQTT
+#ifdef SAMPLE_MQTT_OVER_WEBSOCKETS
+    #include "iothubtransportmqtt_websockets.h"
+#endif // SAMPLE_MQTT_OVER_WEBSOCKETS
+#ifdef SAMPLE_AMQP
+    #include "iothubtransportamqp.h"
+#endif // SAMPLE_AMQP
+#ifdef SAMPLE_AMQP_OVER_WEBSOCKETS
+    #include "iothubtransportamqp_websockets.h"
+#endif // SAMPLE_AMQP_OVER_WEBSOCKETS
+#ifdef SAMPLE_HTTP
+    #include "iothubtransporthttp.h"
+#endif // SAMPLE_HTTP
+
+#ifdef SET_TRUSTED_CERT_IN_SAMPLES
+#include "certs.h"
+#endif // SET_TRUSTED_CERT_IN_SAMPLES
+
+/* Paste in your device connection string  */
+static const char* connectionString = "[device connection string]";
+/* The label every metric is written with */
+static const char* deviceLabel = "[device id]";
+/* The file the metrics are written to, a temporary file next to it is renamed over it so the collector never reads half of it */
+static const char* metricsFile = "iothub_client.prom";
+static const char* metricsTempFile = "iothub_client.prom.tmp";
+
+#define MESSAGE_COUNT           100
+#define SEND_INTERVAL_MS        1000
+#define EXPORT_EVERY_N_MESSAGES 5
+
+typedef struct METRIC_DESCRIPTION_TAG
+{
+    const char* name;
+    const char* help;
+} METRIC_DESCRIPTION;
+
+/* in the order of IOTHUB_CLIENT_METRIC */
+static const METRIC_DESCRIPTION counter_descriptions[IOTHUB_CLIENT_METRIC_COUNT] =
+{
+    { "iothub_client_events_sent_total", "Telemetry messages acknowledged by the IoT Hub." },
+    { "iothub_client_event_bytes_sent_total", "Payload bytes of the acknowledged telemetry messages." },
+    { "iothub_client_events_failed_total", "Telemetry messages confirmed with an error." },
+    { "iothub_client_messages_received_total", "Cloud to device messages received." },
+    { "iothub_client_message_bytes_received_total", "Payload bytes of the cloud to device messages received." },
+    { "iothub_client_send_retries_total", "Telemetry sends retried by the transport." },
+    { "iothub_client_reconnects_total", "Connections established again by the transport." },
+    { "iothub_client_auth_refreshes_total", "Reconnections made to renew the SAS token." },
+    { "iothub_client_throttled_total", "Requests throttled by the IoT Hub." }
+};
+
+/* in the order of IOTHUB_CLIENT_QUEUE */
+static const char* queue_labels[IOTHUB_CLIENT_QUEUE_COUNT] =
+{
+    "waiting_to_send",
+    "waiting_for_ack",
+    "in_progress"
+};
+
+static void send_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    (void)userContextCallback;
+    if (result != IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        (void)printf("Message confirmed with result %s\r\n", ENUM_TO_STRING(IOTHUB_CLIENT_CONFIRMATION_RESULT, result));
+    }
+}
+
+static int write_metrics(FILE* file, const IOTHUB_CLIENT_METRICS* metrics)
+{
+    int result = 0;
+    size_t index;
+
+    for (index = 0; index < IOTHUB_CLIENT_METRIC_COUNT && result >= 0; index++)
+    {
+        result = fprintf(file, "# HELP %s %s\n# TYPE %s counter\n%s{device=\"%s\"} %llu\n",
+            counter_descriptions[index].name, counter_descriptions[index].help,
+            counter_descriptions[index].name,
+            counter_descriptions[index].name, deviceLabel, (unsigned long long)metrics->counters[index]);
+    }
+
+    if (result >= 0)
+    {
+        result = fprintf(file, "# HELP iothub_client_queue_depth Telemetry messages held by each queue of the client.\n# TYPE iothub_client_queue_depth gauge\n");
+    }
+
+    for (index = 0; index < IOTHUB_CLIENT_QUEUE_COUNT && result >= 0; index++)
+    {
+        result = fprintf(file, "iothub_client_queue_depth{device=\"%s\",queue=\"%s\"} %lu\n",
+            deviceLabel, queue_labels[index], (unsigned long)metrics->queue_depths[index]);
+    }
+
+    return (result < 0) ? result : 0;
+}
+
+static void export_metrics(IOTHUB_CLIENT_HANDLE iothub_handle)
+{
+    IOTHUB_CLIENT_METRICS metrics;
+    FILE* file;
+
+    if (IoTHubClient_GetMetrics(iothub_handle, &metrics) != IOTHUB_CLIENT_OK)
+    {
+        (void)printf("Failure reading the client metrics\r\n");
+    }
+    else if ((file = fopen(metricsTempFile, "w")) == NULL)
+    {
+        (void)printf("Failure opening %s\r\n", metricsTempFile);
+    }
+    else
+    {
+        int write_result = write_metrics(file, &metrics);
+        if (fclose(file) != 0 || write_result != 0)
+        {
+            (void)printf("Failure writing %s\r\n", metricsTempFile);
+        }
+        else
+        {
+#ifdef WIN32
+            // rename does not replace an existing file on Windows
+            (void)remove(metricsFile);
+#endif
+            if (rename(metricsTempFile, metricsFile) != 0)
+            {
+                (void)printf("Failure renaming %s to %s\r\n", metricsTempFile, metricsFile);
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol;
+    IOTHUB_CLIENT_HANDLE iothub_handle;
+
+    // Select the Protocol to use with the connection
+#ifdef SAMPLE_MQTT
+    protocol = MQTT_Protocol;
+#endif // SAMPLE_MQTT
+#ifdef SAMPLE_MQTT_OVER_WEBSOCKETS
+    protocol = MQTT_WebSocket_Protocol;
+#endif // SAMPLE_MQTT_OVER_WEBSOCKETS
+#ifdef SAMPLE_AMQP
+    protocol = AMQP_Protocol;
+#endif // SAMPLE_AMQP
+#ifdef SAMPLE_AMQP_OVER_WEBSOCKETS
+    protocol = AMQP_Protocol_over_WebSocketsTls;
+#endif // SAMPLE_AMQP_OVER_WEBSOCKETS
+#ifdef SAMPLE_HTTP
+    protocol = HTTP_Protocol;
+#endif // SAMPLE_HTTP
+
+    // Used to initialize IoTHub SDK subsystem
+    (void)platform_init();
+
+    if ((iothub_handle = IoTHubClient_CreateFromConnectionString(connectionString, protocol)) == NULL)
+    {
+        (void)printf("Failure creating the IoTHub client handle\r\n");
+    }
+    else
+    {
+        size_t index;
+
+#ifdef SET_TRUSTED_CERT_IN_SAMPLES
+        // Setting the Trusted Certificate.  This is only necessary on system with without
+        // built in certificate stores.
+        (void)IoTHubClient_SetOption(iothub_handle, OPTION_TRUSTED_CERT, certificates);
+#endif // SET_TRUSTED_CERT_IN_SAMPLES
+
+        (void)printf("Sending %d messages, the metrics are written to %s\r\n", MESSAGE_COUNT, metricsFile);
+
+        for (index = 0; index < MESSAGE_COUNT; index++)
+        {
+            char telemetry_msg[64];
+            IOTHUB_MESSAGE_HANDLE message_handle;
+
+            (void)sprintf_s(telemetry_msg, sizeof(telemetry_msg), "{\"index\":%lu}", (unsigned long)index);
+            if ((message_handle = IoTHubMessage_CreateFromString(telemetry_msg)) == NULL)
+            {
+                (void)printf("Failure creating message %lu\r\n", (unsigned long)index);
+            }
+            else
+            {
+                if (IoTHubClient_SendEventAsync(iothub_handle, message_handle, send_confirm_callback, NULL) != IOTHUB_CLIENT_OK)
+                {
+                    (void)printf("Failure sending message %lu\r\n", (unsigned long)index);
+                }
+
+                // The message is copied to the sdk so the we can destroy it
+                IoTHubMessage_Destroy(message_handle);
+            }
+
+            if ((index + 1) % EXPORT_EVERY_N_MESSAGES == 0)
+            {
+                export_metrics(iothub_handle);
+            }
+
+            ThreadAPI_Sleep(SEND_INTERVAL_MS);
+        }
+
+        export_metrics(iothub_handle);
+
+        // Clean up the iothub sdk handle
+        IoTHubClient_Destroy(iothub_handle);
+    }
+
+    // Free all the sdk subsystem
+    platform_deinit();
+
+    return 0;
+}
@@ -38,6 +38,11 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClie
     return IoTHubClientCore_SendEventAsync((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClient_SetEventConfirmationBatchCallback(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK eventConfirmationBatchCallback, void* userContextCallback)
+{
+    return IoTHubClientCore_SetEventConfirmationBatchCallback((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, eventConfirmationBatchCallback, userContextCallback);
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
 {
     return IoTHubClientCore_GetSendStatus((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, iotHubClientStatus);
@@ -116,3 +121,17 @@ IOTHUB_CLIENT_RESULT IoTHubClient_UploadMultipleBlocksToBlobAsyncEx(IOTHUB_CLIEN
 }
 
 #endif /*DONT_USE_UPLOADTOBLOB*/
+
+#ifdef USE_LATENCY_TRACING
+IOTHUB_CLIENT_RESULT IoTHubClient_GetStatistics(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATISTICS* statistics)
+{
+    return IoTHubClientCore_GetStatistics((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, statistics);
+}
+#endif /*USE_LATENCY_TRACING*/
+
+#ifdef USE_CLIENT_METRICS
+IOTHUB_CLIENT_RESULT IoTHubClient_GetMetrics(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_METRICS* metrics)
+{
+    return IoTHubClientCore_GetMetrics((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, metrics);
+}
+#endif /*USE_CLIENT_METRICS*/
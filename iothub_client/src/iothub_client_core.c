@@ -7,10 +7,12 @@
 
 #include <signal.h>
 #include <stddef.h>
+#include <string.h>
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "iothub_client_core.h"
 #include "iothub_client_core_ll.h"
+#include "iothub_client_options.h"
 #include "internal/iothubtransport.h"
 #include "internal/iothub_client_private.h"
 #include "internal/iothubtransport.h"
@@ -20,7 +22,17 @@
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 
+#define CALLBACK_PAYLOAD_BLOCK_SIZE     512
+#define CALLBACK_POOL_MAX_FREE_ITEMS    64
+
 struct IOTHUB_QUEUE_CONTEXT_TAG;
+struct SEND_EVENT_SUBMISSION_TAG;
+
+/*an IOTHUB_QUEUE_CONTEXT or a payload block parked in one of the free lists of the instance*/
+typedef struct CALLBACK_POOL_ITEM_TAG
+{
+    struct CALLBACK_POOL_ITEM_TAG* next;
+} CALLBACK_POOL_ITEM;
 
 typedef struct IOTHUB_CLIENT_CORE_INSTANCE_TAG
 {
@@ -45,6 +57,27 @@ typedef struct IOTHUB_CLIENT_CORE_INSTANCE_TAG
     struct IOTHUB_QUEUE_CONTEXT_TAG* connection_status_user_context;
     struct IOTHUB_QUEUE_CONTEXT_TAG* message_user_context;
     struct IOTHUB_QUEUE_CONTEXT_TAG* method_user_context;
+    /*events submitted by IoTHubClient_SendEventAsync while OPTION_SEND_EVENT_RING_SIZE is set, drained by the worker thread*/
+    LOCK_HANDLE sendEventRingLock;
+    struct SEND_EVENT_SUBMISSION_TAG* sendEventRing;
+    size_t sendEventRingSize;
+    size_t sendEventRingHead;
+    size_t sendEventRingCount;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK event_confirm_batch_callback;
+    void* event_confirm_batch_user_context;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION* confirmation_batch; /*only used by the thread dispatching the user callbacks*/
+    size_t confirmation_batch_capacity;
+    /*recycled per request queue contexts and callback payload blocks, only touched with LockHandle held*/
+    CALLBACK_POOL_ITEM* free_queue_contexts;
+    size_t free_queue_context_count;
+    CALLBACK_POOL_ITEM* free_payload_blocks;
+    size_t free_payload_block_count;
+#ifdef USE_LATENCY_TRACING
+    /*the stages the LL layer does not see, only touched with LockHandle held*/
+    TICK_COUNTER_HANDLE latencyTickCounter;
+    IOTHUB_CLIENT_LATENCY_HISTOGRAM enqueue_latency;
+    IOTHUB_CLIENT_LATENCY_HISTOGRAM callback_dispatch_latency;
+#endif
 } IOTHUB_CLIENT_CORE_INSTANCE;
 
 #ifndef DONT_USE_UPLOADTOBLOB
@@ -97,6 +130,11 @@ typedef struct DEVICE_TWIN_CALLBACK_INFO_TAG
 typedef struct EVENT_CONFIRM_CALLBACK_INFO_TAG
 {
     IOTHUB_CLIENT_CONFIRMATION_RESULT confirm_result;
+#ifdef USE_LATENCY_TRACING
+    tickcounter_ms_t queued_at;
+    tickcounter_ms_t dispatch_latency;
+    bool dispatched;
+#endif
 } EVENT_CONFIRM_CALLBACK_INFO;
 
 typedef struct REPORTED_STATE_CALLBACK_INFO_TAG
@@ -138,6 +176,16 @@ typedef struct IOTHUB_QUEUE_CONTEXT_TAG
     void* userContextCallback;
 } IOTHUB_QUEUE_CONTEXT;
 
+typedef struct SEND_EVENT_SUBMISSION_TAG
+{
+    IOTHUB_MESSAGE_HANDLE messageHandle; /*a clone owned by the ring*/
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback;
+    void* userContextCallback;
+#ifdef USE_LATENCY_TRACING
+    tickcounter_ms_t submitted_at;
+#endif
+} SEND_EVENT_SUBMISSION;
+
 /*used by unittests only*/
 const size_t IoTHubClientCore_ThreadTerminationOffset = offsetof(IOTHUB_CLIENT_CORE_INSTANCE, StopThread);
 
@@ -195,6 +243,121 @@ static void garbageCollectorImpl(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstan
 }
 #endif
 
+/*the pool functions must be called with iotHubClientInstance->LockHandle held*/
+static IOTHUB_QUEUE_CONTEXT* acquire_queue_context(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, void* userContextCallback)
+{
+    IOTHUB_QUEUE_CONTEXT* result;
+    if (iotHubClientInstance->free_queue_contexts != NULL)
+    {
+        result = (IOTHUB_QUEUE_CONTEXT*)iotHubClientInstance->free_queue_contexts;
+        iotHubClientInstance->free_queue_contexts = iotHubClientInstance->free_queue_contexts->next;
+        iotHubClientInstance->free_queue_context_count--;
+    }
+    else
+    {
+        result = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT));
+    }
+
+    if (result != NULL)
+    {
+        result->iotHubClientHandle = iotHubClientInstance;
+        result->userContextCallback = userContextCallback;
+    }
+    return result;
+}
+
+static void release_queue_context(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, IOTHUB_QUEUE_CONTEXT* queue_context)
+{
+    if (iotHubClientInstance->free_queue_context_count < CALLBACK_POOL_MAX_FREE_ITEMS)
+    {
+        CALLBACK_POOL_ITEM* item = (CALLBACK_POOL_ITEM*)queue_context;
+        item->next = iotHubClientInstance->free_queue_contexts;
+        iotHubClientInstance->free_queue_contexts = item;
+        iotHubClientInstance->free_queue_context_count++;
+    }
+    else
+    {
+        free(queue_context);
+    }
+}
+
+/*payloads up to CALLBACK_PAYLOAD_BLOCK_SIZE bytes are copied in recycled blocks, larger ones are allocated on their own*/
+static unsigned char* acquire_payload_block(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, size_t size)
+{
+    unsigned char* result;
+    if (size > CALLBACK_PAYLOAD_BLOCK_SIZE)
+    {
+        result = (unsigned char*)malloc(size);
+    }
+    else if (iotHubClientInstance->free_payload_blocks != NULL)
+    {
+        result = (unsigned char*)iotHubClientInstance->free_payload_blocks;
+        iotHubClientInstance->free_payload_blocks = iotHubClientInstance->free_payload_blocks->next;
+        iotHubClientInstance->free_payload_block_count--;
+    }
+    else
+    {
+        result = (unsigned char*)malloc(CALLBACK_PAYLOAD_BLOCK_SIZE);
+    }
+    return result;
+}
+
+static void release_payload_block(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, unsigned char* block, size_t size)
+{
+    if ((size <= CALLBACK_PAYLOAD_BLOCK_SIZE) && (iotHubClientInstance->free_payload_block_count < CALLBACK_POOL_MAX_FREE_ITEMS))
+    {
+        CALLBACK_POOL_ITEM* item = (CALLBACK_POOL_ITEM*)block;
+        item->next = iotHubClientInstance->free_payload_blocks;
+        iotHubClientInstance->free_payload_blocks = item;
+        iotHubClientInstance->free_payload_block_count++;
+    }
+    else
+    {
+        free(block);
+    }
+}
+
+static void free_callback_pools(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    while (iotHubClientInstance->free_queue_contexts != NULL)
+    {
+        CALLBACK_POOL_ITEM* item = iotHubClientInstance->free_queue_contexts;
+        iotHubClientInstance->free_queue_contexts = item->next;
+        free(item);
+    }
+    while (iotHubClientInstance->free_payload_blocks != NULL)
+    {
+        CALLBACK_POOL_ITEM* item = iotHubClientInstance->free_payload_blocks;
+        iotHubClientInstance->free_payload_blocks = item->next;
+        free(item);
+    }
+    iotHubClientInstance->free_queue_context_count = 0;
+    iotHubClientInstance->free_payload_block_count = 0;
+}
+
+#ifdef USE_LATENCY_TRACING
+/*a time that cannot be read counts as 0, record_latency_since drops the samples that end before they start*/
+static tickcounter_ms_t get_latency_now(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    tickcounter_ms_t result;
+    if ((iotHubClientInstance->latencyTickCounter == NULL) || (tickcounter_get_current_ms(iotHubClientInstance->latencyTickCounter, &result) != 0))
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*must be called with iotHubClientInstance->LockHandle held*/
+static void record_latency_since(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, IOTHUB_CLIENT_LATENCY_HISTOGRAM* histogram, tickcounter_ms_t since)
+{
+    tickcounter_ms_t now = get_latency_now(iotHubClientInstance);
+    if (now >= since)
+    {
+        IoTHubClient_Latency_Record(histogram, now - since);
+    }
+}
+#endif
+
 static bool iothub_ll_message_callback(MESSAGE_CALLBACK_INFO* messageData, void* userContextCallback)
 {
     bool result;
@@ -341,11 +504,15 @@ static void iothub_ll_event_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT r
         queue_cb_info.type = CALLBACK_TYPE_EVENT_CONFIRM;
         queue_cb_info.userContextCallback = queue_context->userContextCallback;
         queue_cb_info.iothub_callback.event_confirm_cb_info.confirm_result = result;
+#ifdef USE_LATENCY_TRACING
+        queue_cb_info.iothub_callback.event_confirm_cb_info.queued_at = get_latency_now(queue_context->iotHubClientHandle);
+        queue_cb_info.iothub_callback.event_confirm_cb_info.dispatched = false;
+#endif
         if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
         {
             LogError("event confirm callback vector push failed.");
         }
-        free(queue_context);
+        release_queue_context(queue_context->iotHubClientHandle, queue_context);
     }
 }
 
@@ -362,7 +529,7 @@ static void iothub_ll_reported_state_callback(int status_code, void* userContext
         {
             LogError("reported state callback vector push failed.");
         }
-        free(queue_context);
+        release_queue_context(queue_context->iotHubClientHandle, queue_context);
     }
 }
 
@@ -385,7 +552,7 @@ static void iothub_ll_device_twin_callback(DEVICE_TWIN_UPDATE_STATE update_state
         }
         else
         {
-            queue_cb_info.iothub_callback.dev_twin_cb_info.payLoad = (unsigned char*)malloc(size);
+            queue_cb_info.iothub_callback.dev_twin_cb_info.payLoad = acquire_payload_block(queue_context->iotHubClientHandle, size);
             if (queue_cb_info.iothub_callback.dev_twin_cb_info.payLoad == NULL)
             {
                 LogError("failure allocating payload in device twin callback.");
@@ -405,7 +572,7 @@ static void iothub_ll_device_twin_callback(DEVICE_TWIN_UPDATE_STATE update_state
             {
                 if (queue_cb_info.iothub_callback.dev_twin_cb_info.payLoad != NULL)
                 {
-                    free(queue_cb_info.iothub_callback.dev_twin_cb_info.payLoad);
+                    release_payload_block(queue_context->iotHubClientHandle, queue_cb_info.iothub_callback.dev_twin_cb_info.payLoad, queue_cb_info.iothub_callback.dev_twin_cb_info.size);
                 }
                 LogError("device twin callback userContextCallback vector push failed.");
             }
@@ -417,13 +584,64 @@ static void iothub_ll_device_twin_callback(DEVICE_TWIN_UPDATE_STATE update_state
     }
 }
 
+/*grows the array handed to the batch confirmation callback, it is reused from one dispatch to the next*/
+static bool reserve_confirmation_batch(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, size_t count)
+{
+    bool result;
+    if (count <= iotHubClientInstance->confirmation_batch_capacity)
+    {
+        result = true;
+    }
+    else
+    {
+        IOTHUB_CLIENT_EVENT_CONFIRMATION* newBatch = (IOTHUB_CLIENT_EVENT_CONFIRMATION*)realloc(iotHubClientInstance->confirmation_batch, count * sizeof(IOTHUB_CLIENT_EVENT_CONFIRMATION));
+        if (newBatch == NULL)
+        {
+            LogError("failed growing the confirmation batch, confirmations are delivered one by one");
+            result = false;
+        }
+        else
+        {
+            iotHubClientInstance->confirmation_batch = newBatch;
+            iotHubClientInstance->confirmation_batch_capacity = count;
+            result = true;
+        }
+    }
+    return result;
+}
+
+/*collects the confirmation for the batch callback, or hands it over on its own when there is no room for it*/
+static void add_to_confirmation_batch(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, size_t* batch_count, IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK event_confirm_batch_callback, void* event_confirm_batch_user_context, const USER_CALLBACK_INFO* queued_cb)
+{
+    if (*batch_count < iotHubClientInstance->confirmation_batch_capacity)
+    {
+        iotHubClientInstance->confirmation_batch[*batch_count].userContextCallback = queued_cb->userContextCallback;
+        iotHubClientInstance->confirmation_batch[*batch_count].result = queued_cb->iothub_callback.event_confirm_cb_info.confirm_result;
+        (*batch_count)++;
+    }
+    else
+    {
+        IOTHUB_CLIENT_EVENT_CONFIRMATION confirmation;
+        confirmation.userContextCallback = queued_cb->userContextCallback;
+        confirmation.result = queued_cb->iothub_callback.event_confirm_cb_info.confirm_result;
+        event_confirm_batch_callback(&confirmation, 1, event_confirm_batch_user_context);
+    }
+}
+
 static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, VECTOR_HANDLE call_backs)
 {
     size_t callbacks_length = VECTOR_size(call_backs);
     size_t index;
+    size_t batch_count = 0;
+    bool has_payload_blocks = false;
+#ifdef USE_LATENCY_TRACING
+    bool has_dispatch_latencies = false;
+#endif
 
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK desired_state_callback = NULL;
     IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK event_confirm_callback = NULL;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK event_confirm_batch_callback = NULL;
+    void* event_confirm_batch_user_context = NULL;
     IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reported_state_callback = NULL;
     IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connection_status_callback = NULL;
     IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC device_method_callback = NULL;
@@ -441,6 +659,8 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
     {
         desired_state_callback = iotHubClientInstance->desired_state_callback;
         event_confirm_callback = iotHubClientInstance->event_confirm_callback;
+        event_confirm_batch_callback = iotHubClientInstance->event_confirm_batch_callback;
+        event_confirm_batch_user_context = iotHubClientInstance->event_confirm_batch_user_context;
         reported_state_callback = iotHubClientInstance->reported_state_callback;
         connection_status_callback = iotHubClientInstance->connection_status_callback;
         device_method_callback = iotHubClientInstance->device_method_callback;
@@ -458,6 +678,10 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
         (void)Unlock(iotHubClientInstance->LockHandle);
     }
 
+    if (event_confirm_batch_callback != NULL)
+    {
+        (void)reserve_confirmation_batch(iotHubClientInstance, callbacks_length);
+    }
 
     for (index = 0; index < callbacks_length; index++)
     {
@@ -479,12 +703,27 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
 
                 if (queued_cb->iothub_callback.dev_twin_cb_info.payLoad)
                 {
-                    free(queued_cb->iothub_callback.dev_twin_cb_info.payLoad);
+                    /*given back to the pool once all the callbacks ran*/
+                    has_payload_blocks = true;
                 }
                 break;
             }
             case CALLBACK_TYPE_EVENT_CONFIRM:
-                if (event_confirm_callback)
+#ifdef USE_LATENCY_TRACING
+                if (event_confirm_batch_callback || event_confirm_callback)
+                {
+                    /*read without the lock, the tickcounter is only written when it is created*/
+                    tickcounter_ms_t now = get_latency_now(iotHubClientInstance);
+                    queued_cb->iothub_callback.event_confirm_cb_info.dispatched = (now >= queued_cb->iothub_callback.event_confirm_cb_info.queued_at);
+                    queued_cb->iothub_callback.event_confirm_cb_info.dispatch_latency = now - queued_cb->iothub_callback.event_confirm_cb_info.queued_at;
+                    has_dispatch_latencies = true;
+                }
+#endif
+                if (event_confirm_batch_callback)
+                {
+                    add_to_confirmation_batch(iotHubClientInstance, &batch_count, event_confirm_batch_callback, event_confirm_batch_user_context, queued_cb);
+                }
+                else if (event_confirm_callback)
                 {
                     event_confirm_callback(queued_cb->iothub_callback.event_confirm_cb_info.confirm_result, queued_cb->userContextCallback);
                 }
@@ -569,9 +808,287 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
             }
         }
     }
+
+    if (batch_count > 0)
+    {
+        event_confirm_batch_callback(iotHubClientInstance->confirmation_batch, batch_count, event_confirm_batch_user_context);
+    }
+
+#ifdef USE_LATENCY_TRACING
+    /*recorded at once, so the lock is taken once per dispatch and not per confirmation*/
+    if (has_dispatch_latencies)
+    {
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            LogError("failed locking for recording the callback dispatch latencies");
+        }
+        else
+        {
+            for (index = 0; index < callbacks_length; index++)
+            {
+                USER_CALLBACK_INFO* queued_cb = (USER_CALLBACK_INFO*)VECTOR_element(call_backs, index);
+                if ((queued_cb != NULL) && (queued_cb->type == CALLBACK_TYPE_EVENT_CONFIRM) && queued_cb->iothub_callback.event_confirm_cb_info.dispatched)
+                {
+                    IoTHubClient_Latency_Record(&iotHubClientInstance->callback_dispatch_latency, queued_cb->iothub_callback.event_confirm_cb_info.dispatch_latency);
+                }
+            }
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+#endif
+
+    if (has_payload_blocks)
+    {
+        bool locked = (Lock(iotHubClientInstance->LockHandle) == LOCK_OK);
+        if (!locked)
+        {
+            LogError("failed locking for returning the callback payloads, they are freed instead");
+        }
+
+        for (index = 0; index < callbacks_length; index++)
+        {
+            USER_CALLBACK_INFO* queued_cb = (USER_CALLBACK_INFO*)VECTOR_element(call_backs, index);
+            if ((queued_cb != NULL) && (queued_cb->type == CALLBACK_TYPE_DEVICE_TWIN) && (queued_cb->iothub_callback.dev_twin_cb_info.payLoad != NULL))
+            {
+                if (locked)
+                {
+                    release_payload_block(iotHubClientInstance, queued_cb->iothub_callback.dev_twin_cb_info.payLoad, queued_cb->iothub_callback.dev_twin_cb_info.size);
+                }
+                else
+                {
+                    free(queued_cb->iothub_callback.dev_twin_cb_info.payLoad);
+                }
+            }
+        }
+
+        if (locked)
+        {
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
     VECTOR_destroy(call_backs);
 }
 
+/*must be called with iotHubClientInstance->LockHandle held*/
+static IOTHUB_CLIENT_RESULT send_event_to_ll(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientInstance->created_with_transport_handle == 0)
+    {
+        iotHubClientInstance->event_confirm_callback = eventConfirmationCallback;
+    }
+
+    /*the batch confirmation callback is fed by the queued confirmations, whatever the per event callback is*/
+    if (iotHubClientInstance->event_confirm_batch_callback == NULL && (iotHubClientInstance->created_with_transport_handle != 0 || eventConfirmationCallback == NULL))
+    {
+        result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUBCLIENT_07_001: [ IoTHubClient_SendEventAsync shall allocate a IOTHUB_QUEUE_CONTEXT object to be sent to the IoTHubClientCore_LL_SendEventAsync function as a user context. ] */
+        IOTHUB_QUEUE_CONTEXT* queue_context = acquire_queue_context(iotHubClientInstance, userContextCallback);
+        if (queue_context == NULL)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Failed allocating QUEUE_CONTEXT");
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClientCore_LL_SendEventAsync, while passing the IoTHubClientCore_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
+            /* Codes_SRS_IOTHUBCLIENT_01_013: [When IoTHubClientCore_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClientCore_LL_SendEventAsync.] */
+            result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, iothub_ll_event_confirm_callback, queue_context);
+            if (result != IOTHUB_CLIENT_OK)
+            {
+                LogError("IoTHubClientCore_LL_SendEventAsync failed");
+                release_queue_context(iotHubClientInstance, queue_context);
+            }
+        }
+    }
+    return result;
+}
+
+/*hands the events waiting in the ring to the LL layer, in the order they were submitted. Must be called with
+iotHubClientInstance->LockHandle held, which makes the caller the only consumer of the ring: the submitters only
+write past the entries counted here, so the entries are sent without holding the ring lock.*/
+static void drain_send_event_ring(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    if (iotHubClientInstance->sendEventRing != NULL)
+    {
+        size_t head;
+        size_t count;
+
+        if (Lock(iotHubClientInstance->sendEventRingLock) != LOCK_OK)
+        {
+            LogError("failed locking the send event ring");
+            count = 0;
+            head = 0;
+        }
+        else
+        {
+            head = iotHubClientInstance->sendEventRingHead;
+            count = iotHubClientInstance->sendEventRingCount;
+            (void)Unlock(iotHubClientInstance->sendEventRingLock);
+        }
+
+        if (count > 0)
+        {
+            size_t index;
+            for (index = 0; index < count; index++)
+            {
+                SEND_EVENT_SUBMISSION* submission = &iotHubClientInstance->sendEventRing[(head + index) % iotHubClientInstance->sendEventRingSize];
+                if (send_event_to_ll(iotHubClientInstance, submission->messageHandle, submission->eventConfirmationCallback, submission->userContextCallback) != IOTHUB_CLIENT_OK)
+                {
+                    /*SendEventAsync already returned, the failure can only be reported through the confirmation callback*/
+                    LogError("failed handing a submitted event to the LL layer");
+                    if (submission->eventConfirmationCallback != NULL)
+                    {
+                        if (iotHubClientInstance->created_with_transport_handle == 0)
+                        {
+                            USER_CALLBACK_INFO queue_cb_info;
+                            queue_cb_info.type = CALLBACK_TYPE_EVENT_CONFIRM;
+                            queue_cb_info.userContextCallback = submission->userContextCallback;
+                            queue_cb_info.iothub_callback.event_confirm_cb_info.confirm_result = IOTHUB_CLIENT_CONFIRMATION_ERROR;
+#ifdef USE_LATENCY_TRACING
+                            queue_cb_info.iothub_callback.event_confirm_cb_info.queued_at = get_latency_now(iotHubClientInstance);
+                            queue_cb_info.iothub_callback.event_confirm_cb_info.dispatched = false;
+#endif
+                            if (VECTOR_push_back(iotHubClientInstance->saved_user_callback_list, &queue_cb_info, 1) != 0)
+                            {
+                                LogError("event confirm callback vector push failed.");
+                            }
+                        }
+                        else
+                        {
+                            submission->eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, submission->userContextCallback);
+                        }
+                    }
+                }
+#ifdef USE_LATENCY_TRACING
+                else
+                {
+                    record_latency_since(iotHubClientInstance, &iotHubClientInstance->enqueue_latency, submission->submitted_at);
+                }
+#endif
+                IoTHubMessage_Destroy(submission->messageHandle);
+            }
+
+            if (Lock(iotHubClientInstance->sendEventRingLock) != LOCK_OK)
+            {
+                /*the entries were sent and their messages destroyed, they cannot be left in the ring*/
+                LogError("failed locking the send event ring, releasing it without lock");
+            }
+            iotHubClientInstance->sendEventRingHead = (head + count) % iotHubClientInstance->sendEventRingSize;
+            iotHubClientInstance->sendEventRingCount -= count;
+            (void)Unlock(iotHubClientInstance->sendEventRingLock);
+        }
+    }
+}
+
+/*returns true when the event was queued in the ring. Only the ring lock is taken, so this does not wait for a DoWork
+that holds the instance lock.*/
+static bool submit_to_send_event_ring(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    bool result;
+    IOTHUB_MESSAGE_HANDLE messageClone;
+
+    if (iotHubClientInstance->sendEventRingLock == NULL)
+    {
+        result = false;
+    }
+    else if ((messageClone = IoTHubMessage_Clone(eventMessageHandle)) == NULL)
+    {
+        /*the instance lock path reports the error*/
+        result = false;
+    }
+    else
+    {
+        if (Lock(iotHubClientInstance->sendEventRingLock) != LOCK_OK)
+        {
+            LogError("failed locking the send event ring");
+            result = false;
+        }
+        else
+        {
+            if ((iotHubClientInstance->sendEventRing == NULL) || (iotHubClientInstance->sendEventRingCount == iotHubClientInstance->sendEventRingSize))
+            {
+                /*full, the caller sends under the instance lock after draining the ring, which keeps the events in order*/
+                result = false;
+            }
+            else
+            {
+                SEND_EVENT_SUBMISSION* submission = &iotHubClientInstance->sendEventRing[(iotHubClientInstance->sendEventRingHead + iotHubClientInstance->sendEventRingCount) % iotHubClientInstance->sendEventRingSize];
+                submission->messageHandle = messageClone;
+                submission->eventConfirmationCallback = eventConfirmationCallback;
+                submission->userContextCallback = userContextCallback;
+#ifdef USE_LATENCY_TRACING
+                submission->submitted_at = get_latency_now(iotHubClientInstance);
+#endif
+                iotHubClientInstance->sendEventRingCount++;
+                result = true;
+            }
+            (void)Unlock(iotHubClientInstance->sendEventRingLock);
+        }
+
+        if (!result)
+        {
+            IoTHubMessage_Destroy(messageClone);
+        }
+    }
+    return result;
+}
+
+/*must be called with iotHubClientInstance->LockHandle held*/
+static IOTHUB_CLIENT_RESULT set_send_event_ring_size(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, size_t ringSize)
+{
+    IOTHUB_CLIENT_RESULT result;
+    SEND_EVENT_SUBMISSION* newRing;
+
+    if (ringSize == 0)
+    {
+        newRing = NULL;
+        result = IOTHUB_CLIENT_OK;
+    }
+    else if ((newRing = (SEND_EVENT_SUBMISSION*)malloc(ringSize * sizeof(SEND_EVENT_SUBMISSION))) == NULL)
+    {
+        LogError("failed allocating the send event ring");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else if ((iotHubClientInstance->sendEventRingLock == NULL) && ((iotHubClientInstance->sendEventRingLock = Lock_Init()) == NULL))
+    {
+        LogError("failed creating the send event ring lock");
+        free(newRing);
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        result = IOTHUB_CLIENT_OK;
+    }
+
+    if ((result == IOTHUB_CLIENT_OK) && (iotHubClientInstance->sendEventRingLock != NULL))
+    {
+        /*the events already submitted go out before the ring is replaced*/
+        drain_send_event_ring(iotHubClientInstance);
+
+        if (Lock(iotHubClientInstance->sendEventRingLock) != LOCK_OK)
+        {
+            LogError("failed locking the send event ring");
+            free(newRing);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            free(iotHubClientInstance->sendEventRing);
+            iotHubClientInstance->sendEventRing = newRing;
+            iotHubClientInstance->sendEventRingSize = ringSize;
+            iotHubClientInstance->sendEventRingHead = 0;
+            iotHubClientInstance->sendEventRingCount = 0;
+            (void)Unlock(iotHubClientInstance->sendEventRingLock);
+        }
+    }
+    return result;
+}
+
 static void ScheduleWork_Thread_ForMultiplexing(void* iotHubClientHandle)
 {
     IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
@@ -581,6 +1098,8 @@ static void ScheduleWork_Thread_ForMultiplexing(void* iotHubClientHandle)
 #endif
     if (Lock(iotHubClientInstance->LockHandle) == LOCK_OK)
     {
+        drain_send_event_ring(iotHubClientInstance);
+
         VECTOR_HANDLE call_backs = VECTOR_move(iotHubClientInstance->saved_user_callback_list);
         (void)Unlock(iotHubClientInstance->LockHandle);
 
@@ -617,6 +1136,7 @@ static int ScheduleWork_Thread(void* threadArgument)
             {
                 /* Codes_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_SendEvent or IoTHubClient_SetMessageCallback shall call IoTHubClientCore_LL_DoWork every 1 ms.] */
                 /* Codes_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClientCore_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
+                drain_send_event_ring(iotHubClientInstance);
                 IoTHubClientCore_LL_DoWork(iotHubClientInstance->IoTHubClientLLHandle);
 
 #ifndef DONT_USE_UPLOADTOBLOB
@@ -843,6 +1363,28 @@ static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(const IOTHUB_CLIENT_C
                     result->message_callback = NULL;
                     result->message_user_context = NULL;
                     result->method_user_context = NULL;
+                    result->sendEventRingLock = NULL;
+                    result->sendEventRing = NULL;
+                    result->sendEventRingSize = 0;
+                    result->sendEventRingHead = 0;
+                    result->sendEventRingCount = 0;
+                    result->event_confirm_batch_callback = NULL;
+                    result->event_confirm_batch_user_context = NULL;
+                    result->confirmation_batch = NULL;
+                    result->confirmation_batch_capacity = 0;
+                    result->free_queue_contexts = NULL;
+                    result->free_queue_context_count = 0;
+                    result->free_payload_blocks = NULL;
+                    result->free_payload_block_count = 0;
+#ifdef USE_LATENCY_TRACING
+                    memset(&result->enqueue_latency, 0, sizeof(result->enqueue_latency));
+                    memset(&result->callback_dispatch_latency, 0, sizeof(result->callback_dispatch_latency));
+                    if ((result->latencyTickCounter = tickcounter_create()) == NULL)
+                    {
+                        /*the LL layer still collects its stages*/
+                        LogError("unable to create the tickcounter of the latency statistics");
+                    }
+#endif
                 }
             }
         }
@@ -1015,6 +1557,9 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
         }
 #endif
 
+        /*events still in the ring are given to the LL layer, which confirms them as destroyed*/
+        drain_send_event_ring(iotHubClientInstance);
+
         /* Codes_SRS_IOTHUBCLIENT_01_006: [That includes destroying the IoTHubClientCore_LL instance by calling IoTHubClientCore_LL_Destroy.] */
         IoTHubClientCore_LL_Destroy(iotHubClientInstance->IoTHubClientLLHandle);
 
@@ -1026,6 +1571,11 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
 
         vector_size = VECTOR_size(iotHubClientInstance->saved_user_callback_list);
         size_t index = 0;
+        size_t batch_count = 0;
+        if (iotHubClientInstance->event_confirm_batch_callback != NULL)
+        {
+            (void)reserve_confirmation_batch(iotHubClientInstance, vector_size);
+        }
         for (index = 0; index < vector_size; index++)
         {
             USER_CALLBACK_INFO* queue_cb_info = (USER_CALLBACK_INFO*)VECTOR_element(iotHubClientInstance->saved_user_callback_list, index);
@@ -1045,15 +1595,41 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
                 }
                 else if (queue_cb_info->type == CALLBACK_TYPE_EVENT_CONFIRM)
                 {
-                    if (iotHubClientInstance->event_confirm_callback)
+                    if (iotHubClientInstance->event_confirm_batch_callback)
+                    {
+                        add_to_confirmation_batch(iotHubClientInstance, &batch_count, iotHubClientInstance->event_confirm_batch_callback, iotHubClientInstance->event_confirm_batch_user_context, queue_cb_info);
+                    }
+                    else if (iotHubClientInstance->event_confirm_callback)
                     {
                         iotHubClientInstance->event_confirm_callback(queue_cb_info->iothub_callback.event_confirm_cb_info.confirm_result, queue_cb_info->userContextCallback);
                     }
                 }
             }
         }
+        if (batch_count > 0)
+        {
+            iotHubClientInstance->event_confirm_batch_callback(iotHubClientInstance->confirmation_batch, batch_count, iotHubClientInstance->event_confirm_batch_user_context);
+        }
         VECTOR_destroy(iotHubClientInstance->saved_user_callback_list);
 
+        if (iotHubClientInstance->confirmation_batch != NULL)
+        {
+            free(iotHubClientInstance->confirmation_batch);
+        }
+        free_callback_pools(iotHubClientInstance);
+#ifdef USE_LATENCY_TRACING
+        if (iotHubClientInstance->latencyTickCounter != NULL)
+        {
+            tickcounter_destroy(iotHubClientInstance->latencyTickCounter);
+        }
+#endif
+
+        if (iotHubClientInstance->sendEventRingLock != NULL)
+        {
+            free(iotHubClientInstance->sendEventRing);
+            Lock_Deinit(iotHubClientInstance->sendEventRingLock);
+        }
+
         if (iotHubClientInstance->TransportHandle == NULL)
         {
             /* Codes_SRS_IOTHUBCLIENT_01_032: [If the lock was allocated in IoTHubClient_Create, it shall be also freed..] */
@@ -1092,6 +1668,9 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
     else
     {
         IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+#ifdef USE_LATENCY_TRACING
+        tickcounter_ms_t submitted_at = get_latency_now(iotHubClientInstance);
+#endif
 
         /* Codes_SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
         if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
@@ -1102,8 +1681,12 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
         }
         else
         {
+            if (submit_to_send_event_ring(iotHubClientInstance, eventMessageHandle, eventConfirmationCallback, userContextCallback))
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
             /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-            if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+            else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
             {
                 /* Codes_SRS_IOTHUBCLIENT_01_026: [If acquiring the lock fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
                 result = IOTHUB_CLIENT_ERROR;
@@ -1111,47 +1694,133 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
             }
             else
             {
-                if (iotHubClientInstance->created_with_transport_handle == 0)
+                /*events waiting in the ring go first*/
+                drain_send_event_ring(iotHubClientInstance);
+
+                result = send_event_to_ll(iotHubClientInstance, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+#ifdef USE_LATENCY_TRACING
+                if (result == IOTHUB_CLIENT_OK)
                 {
-                    iotHubClientInstance->event_confirm_callback = eventConfirmationCallback;
+                    record_latency_since(iotHubClientInstance, &iotHubClientInstance->enqueue_latency, submitted_at);
                 }
+#endif
 
-                if (iotHubClientInstance->created_with_transport_handle != 0 || eventConfirmationCallback == NULL)
+                /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+                (void)Unlock(iotHubClientInstance->LockHandle);
+            }
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_SetEventConfirmationBatchCallback(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK eventConfirmationBatchCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /*the events already handed to the LL layer keep the way they were sent, the next dispatch delivers their confirmations to whichever callback is set then*/
+            iotHubClientInstance->event_confirm_batch_callback = eventConfirmationBatchCallback;
+            iotHubClientInstance->event_confirm_batch_user_context = userContextCallback;
+            result = IOTHUB_CLIENT_OK;
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
+#ifdef USE_LATENCY_TRACING
+IOTHUB_CLIENT_RESULT IoTHubClientCore_GetStatistics(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATISTICS* statistics)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if ((iotHubClientHandle == NULL) || (statistics == NULL))
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("invalid arg iotHubClientHandle=%p, statistics=%p", iotHubClientHandle, statistics);
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            if ((result = IoTHubClientCore_LL_GetStatistics(iotHubClientInstance->IoTHubClientLLHandle, statistics)) == IOTHUB_CLIENT_OK)
+            {
+                IoTHubClient_Latency_Merge(&statistics->stages[IOTHUB_CLIENT_LATENCY_STAGE_ENQUEUE], &iotHubClientInstance->enqueue_latency);
+                IoTHubClient_Latency_Merge(&statistics->stages[IOTHUB_CLIENT_LATENCY_STAGE_CALLBACK_DISPATCH], &iotHubClientInstance->callback_dispatch_latency);
+            }
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+#endif /*USE_LATENCY_TRACING*/
+
+#ifdef USE_CLIENT_METRICS
+IOTHUB_CLIENT_RESULT IoTHubClientCore_GetMetrics(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_METRICS* metrics)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if ((iotHubClientHandle == NULL) || (metrics == NULL))
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("invalid arg iotHubClientHandle=%p, metrics=%p", iotHubClientHandle, metrics);
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            if (((result = IoTHubClientCore_LL_GetMetrics(iotHubClientInstance->IoTHubClientLLHandle, metrics)) == IOTHUB_CLIENT_OK) &&
+                (iotHubClientInstance->sendEventRingLock != NULL))
+            {
+                /*the submissions the worker thread has not handed to the LL layer yet are waiting to be sent as well*/
+                if (Lock(iotHubClientInstance->sendEventRingLock) != LOCK_OK)
                 {
-                    result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+                    LogError("Could not acquire the send event ring lock, its submissions are not counted");
                 }
                 else
                 {
-                    /* Codes_SRS_IOTHUBCLIENT_07_001: [ IoTHubClient_SendEventAsync shall allocate a IOTHUB_QUEUE_CONTEXT object to be sent to the IoTHubClientCore_LL_SendEventAsync function as a user context. ] */
-                    IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT));
-                    if (queue_context == NULL)
-                    {
-                        result = IOTHUB_CLIENT_ERROR;
-                        LogError("Failed allocating QUEUE_CONTEXT");
-                    }
-                    else
-                    {
-                        queue_context->iotHubClientHandle = iotHubClientInstance;
-                        queue_context->userContextCallback = userContextCallback;
-                        /* Codes_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClientCore_LL_SendEventAsync, while passing the IoTHubClientCore_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
-                        /* Codes_SRS_IOTHUBCLIENT_01_013: [When IoTHubClientCore_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClientCore_LL_SendEventAsync.] */
-                        result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, iothub_ll_event_confirm_callback, queue_context);
-                        if (result != IOTHUB_CLIENT_OK)
-                        {
-                            LogError("IoTHubClientCore_LL_SendEventAsync failed");
-                            free(queue_context);
-                        }
-                    }
+                    metrics->queue_depths[IOTHUB_CLIENT_QUEUE_WAITING_TO_SEND] += iotHubClientInstance->sendEventRingCount;
+                    (void)Unlock(iotHubClientInstance->sendEventRingLock);
                 }
-
-                /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-                (void)Unlock(iotHubClientInstance->LockHandle);
             }
+            (void)Unlock(iotHubClientInstance->LockHandle);
         }
     }
 
     return result;
 }
+#endif /*USE_CLIENT_METRICS*/
 
 IOTHUB_CLIENT_RESULT IoTHubClientCore_GetSendStatus(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
 {
@@ -1495,11 +2164,18 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetOption(IOTHUB_CLIENT_CORE_HANDLE iotHub
         }
         else
         {
-            /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClientCore_LL_SetOption passing the same parameters and return what IoTHubClientCore_LL_SetOption returns.] */
-            result = IoTHubClientCore_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
-            if (result != IOTHUB_CLIENT_OK)
+            if (strcmp(optionName, OPTION_SEND_EVENT_RING_SIZE) == 0)
+            {
+                result = set_send_event_ring_size(iotHubClientInstance, *(const size_t*)value);
+            }
+            else
             {
-                LogError("IoTHubClientCore_LL_SetOption failed");
+                /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClientCore_LL_SetOption passing the same parameters and return what IoTHubClientCore_LL_SetOption returns.] */
+                result = IoTHubClientCore_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubClientCore_LL_SetOption failed");
+                }
             }
 
             (void)Unlock(iotHubClientInstance->LockHandle);
@@ -1632,7 +2308,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendReportedState(IOTHUB_CLIENT_CORE_HANDL
                 else
                 {
                     /* Codes_SRS_IOTHUBCLIENT_07_003: [ IoTHubClient_SendReportedState shall allocate a IOTHUB_QUEUE_CONTEXT object to be sent to the IoTHubClientCore_LL_SendReportedState function as a user context. ] */
-                    IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT));
+                    IOTHUB_QUEUE_CONTEXT* queue_context = acquire_queue_context(iotHubClientInstance, userContextCallback);
                     if (queue_context == NULL)
                     {
                         result = IOTHUB_CLIENT_ERROR;
@@ -1640,15 +2316,13 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendReportedState(IOTHUB_CLIENT_CORE_HANDL
                     }
                     else
                     {
-                        queue_context->iotHubClientHandle = iotHubClientInstance;
-                        queue_context->userContextCallback = userContextCallback;
                         /*Codes_SRS_IOTHUBCLIENT_10_017: [** `IoTHubClient_SendReportedState` shall call `IoTHubClientCore_LL_SendReportedState`, while passing the `IoTHubClientCore_LL handle` created by `IoTHubClientCore_LL_Create` along with the parameters `reportedState`, `size`, `iothub_ll_reported_state_callback` and IOTHUB_QUEUE_CONTEXT variable. ]*/
                         /*Codes_SRS_IOTHUBCLIENT_10_018: [** When `IoTHubClientCore_LL_SendReportedState` is called, `IoTHubClient_SendReportedState` shall return the result of `IoTHubClientCore_LL_SendReportedState`. **]*/
                         result = IoTHubClientCore_LL_SendReportedState(iotHubClientInstance->IoTHubClientLLHandle, reportedState, size, iothub_ll_reported_state_callback, queue_context);
                         if (result != IOTHUB_CLIENT_OK)
                         {
                             LogError("IoTHubClientCore_LL_SendReportedState failed");
-                            free(queue_context);
+                            release_queue_context(iotHubClientInstance, queue_context);
                         }
                     }
                 }
@@ -13,6 +13,7 @@
 #include "azure_c_shared_utility/constbuffer.h"
 #include "azure_c_shared_utility/platform.h"
 
+#include "parson.h"
 #include "iothub_client_core_ll.h"
 #include "internal/iothub_client_authorization.h"
 #include "iothub_transport_ll.h"
@@ -26,8 +27,18 @@
 #include "internal/iothub_client_ll_uploadtoblob.h"
 #endif
 
+#ifdef USE_OFFLINE_STORE
+#include "internal/iothub_client_offline_store.h"
+#endif
+
 #define LOG_ERROR_RESULT LogError("result = %s", ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, result));
 #define INDEFINITE_TIME ((time_t)(-1))
+#define TWIN_ACK_INDEX_SIZE 64 /*power of two, item ids are sequential so the low bits spread them evenly*/
+#define TWIN_ACK_TIMEOUT_STATUS_CODE 408
+
+#ifdef USE_OFFLINE_STORE
+#define DEFAULT_OFFLINE_STORE_RAM_THRESHOLD 64
+#endif
 
 DEFINE_ENUM_STRINGS(IOTHUB_CLIENT_FILE_UPLOAD_RESULT, IOTHUB_CLIENT_FILE_UPLOAD_RESULT_VALUES);
 DEFINE_ENUM_STRINGS(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_RESULT_VALUES);
@@ -98,8 +109,35 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG
     IOTHUB_AUTHORIZATION_HANDLE authorization_module;
     STRING_HANDLE product_info;
     IOTHUB_DIAGNOSTIC_SETTING_DATA diagnostic_setting;
+    bool coalesce_reported_state; /*merge new reported state patches into the last one still waiting in iot_msg_queue*/
+    IOTHUB_DEVICE_TWIN* iot_ack_index[TWIN_ACK_INDEX_SIZE]; /*the items of iot_ack_queue hashed by item_id*/
+    size_t iot_ack_count;
+    size_t twin_max_in_flight; /*0 means no limit*/
+    tickcounter_ms_t twin_ack_timeout; /*0 means twin items wait for their acknowledgement forever*/
+#ifdef USE_OFFLINE_STORE
+    OFFLINE_STORE_HANDLE offline_store;
+    OFFLINE_STORE_CONFIG offline_store_config;
+    size_t offline_store_ram_threshold; /*number of messages kept in waitingToSend before new ones are spooled to disk*/
+#endif
+#ifdef USE_LATENCY_TRACING
+    IOTHUB_CLIENT_STATISTICS latency_statistics; /*stages of the messages acknowledged by the transport of this handle*/
+#endif
+#ifdef USE_CLIENT_METRICS
+    IOTHUB_CLIENT_METRICS metrics; /*waitingToSend is counted when the metrics are read, the other queues are reported by the transport*/
+#endif
 }IOTHUB_CLIENT_CORE_LL_HANDLE_DATA;
 
+#ifdef USE_OFFLINE_STORE
+/*wraps the user callback of a message replayed from the offline store, so the store learns when the message is done*/
+typedef struct OFFLINE_STORE_REPLAY_CONTEXT_TAG
+{
+    OFFLINE_STORE_HANDLE offline_store;
+    uint64_t offset;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+}OFFLINE_STORE_REPLAY_CONTEXT;
+#endif
+
 static const char HOSTNAME_TOKEN[] = "HostName";
 static const char DEVICEID_TOKEN[] = "DeviceId";
 static const char X509_TOKEN[] = "x509";
@@ -135,6 +173,10 @@ static void setTransportProtocol(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData,
 static void device_twin_data_destroy(IOTHUB_DEVICE_TWIN* client_item)
 {
     CONSTBUFFER_Destroy(client_item->report_data_handle);
+    if (client_item->coalesced_callbacks != NULL)
+    {
+        free(client_item->coalesced_callbacks);
+    }
     free(client_item);
 }
 
@@ -439,6 +481,14 @@ static IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* initialize_iothub_client(const IOTHUB_
 
                             result->diagnostic_setting.currentMessageNumber = 0;
                             result->diagnostic_setting.diagSamplingPercentage = 0;
+#ifdef USE_OFFLINE_STORE
+                            result->offline_store = NULL;
+                            result->offline_store_config.directory = NULL;
+                            result->offline_store_config.segment_size = OFFLINE_STORE_DEFAULT_SEGMENT_SIZE;
+                            result->offline_store_config.max_size = OFFLINE_STORE_DEFAULT_MAX_SIZE;
+                            result->offline_store_config.drop_oldest = false;
+                            result->offline_store_ram_threshold = DEFAULT_OFFLINE_STORE_RAM_THRESHOLD;
+#endif
                             /*Codes_SRS_IOTHUBCLIENT_LL_25_124: [ `IoTHubClientCore_LL_Create` shall set the default retry policy as Exponential backoff with jitter and if succeed and return a `non-NULL` handle. ]*/
                             if (IoTHubClientCore_LL_SetRetryPolicy(result, IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER, 0) != IOTHUB_CLIENT_OK)
                             {
@@ -473,6 +523,36 @@ static IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* initialize_iothub_client(const IOTHUB_
     return result;
 }
 
+/*nowTick of 0 means the time is unknown, the item then never times out*/
+static void add_to_ack_queue(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_DEVICE_TWIN* queue_data, tickcounter_ms_t nowTick)
+{
+    size_t bucket = queue_data->item_id & (TWIN_ACK_INDEX_SIZE - 1);
+    queue_data->ms_timesOutAfter = (nowTick == 0 || handleData->twin_ack_timeout == 0) ? 0 : nowTick + handleData->twin_ack_timeout;
+    DList_InsertTailList(&(handleData->iot_ack_queue), &(queue_data->entry));
+    queue_data->next_in_ack_index = handleData->iot_ack_index[bucket];
+    handleData->iot_ack_index[bucket] = queue_data;
+    handleData->iot_ack_count++;
+}
+
+/*unlinks the item from the index only, the caller removes it from iot_ack_queue once its callbacks ran*/
+static IOTHUB_DEVICE_TWIN* remove_from_ack_index(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, uint32_t item_id)
+{
+    IOTHUB_DEVICE_TWIN** link = &(handleData->iot_ack_index[item_id & (TWIN_ACK_INDEX_SIZE - 1)]);
+    IOTHUB_DEVICE_TWIN* result;
+
+    while ((result = *link) != NULL && result->item_id != item_id)
+    {
+        link = &(result->next_in_ack_index);
+    }
+
+    if (result != NULL)
+    {
+        *link = result->next_in_ack_index;
+        handleData->iot_ack_count--;
+    }
+    return result;
+}
+
 static uint32_t get_next_item_id(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
 {    
     if (handleData->data_msg_id+1 >= UINT32_MAX)
@@ -513,6 +593,9 @@ static IOTHUB_DEVICE_TWIN* dev_twin_data_create(IOTHUB_CLIENT_CORE_LL_HANDLE_DAT
             result->reported_state_callback = reportedStateCallback;
             result->client_handle = handleData;
             result->device_handle = handleData->deviceHandle;
+            result->coalesced_callbacks = NULL;
+            result->coalesced_callback_count = 0;
+            result->next_in_ack_index = NULL;
         }
     }
     else
@@ -980,6 +1063,11 @@ void IoTHubClientCore_LL_Destroy(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle
             free(temp);
         }
 
+#ifdef USE_OFFLINE_STORE
+        /*messages still in the offline store stay on disk and are sent by the next client using the same directory*/
+        IoTHubClient_OfflineStore_Destroy(handleData->offline_store);
+#endif
+
         /* Codes_SRS_IOTHUBCLIENT_LL_07_007: [ IoTHubClientCore_LL_Destroy shall iterate the device twin queues and destroy any remaining items. ] */
         while ((unsend = DList_RemoveHeadList(&(handleData->iot_msg_queue))) != &(handleData->iot_msg_queue))
         {
@@ -1031,6 +1119,128 @@ static int attach_ms_timesOutAfter(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData
     return result;
 }
 
+/*Codes_SRS_IOTHUBCLIENT_LL_33_001: [ IoTHubClientCore_LL_SendEventAsync shall insert the new record in waitingToSend after every record of the same or higher priority and before every record of lower priority. ]*/
+static void insert_by_priority(PDLIST_ENTRY waitingToSend, IOTHUB_MESSAGE_LIST* newEntry)
+{
+    /*transports send from the head of waitingToSend, so keeping it ordered is enough for high priority messages to go first.
+    The common case (all messages of the same priority) stops at the tail without walking the list.*/
+    PDLIST_ENTRY insertBefore = waitingToSend;
+    while (insertBefore->Blink != waitingToSend &&
+        containingRecord(insertBefore->Blink, IOTHUB_MESSAGE_LIST, entry)->priority < newEntry->priority)
+    {
+        insertBefore = insertBefore->Blink;
+    }
+    /*inserting at the "tail" of an entry links the new entry right before it*/
+    DList_InsertTailList(insertBefore, &(newEntry->entry));
+}
+
+#ifdef USE_OFFLINE_STORE
+static void offline_store_replay_complete(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    OFFLINE_STORE_REPLAY_CONTEXT* replay_context = (OFFLINE_STORE_REPLAY_CONTEXT*)userContextCallback;
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_32_005: [ A message moved from the offline store shall be removed from disk once its confirmation callback is invoked with any result other than IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY. ]*/
+    if (result != IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY &&
+        IoTHubClient_OfflineStore_Complete(replay_context->offline_store, replay_context->offset) != 0)
+    {
+        LogError("unable to complete message in offline store");
+    }
+
+    if (replay_context->callback != NULL)
+    {
+        replay_context->callback(result, replay_context->context);
+    }
+    free(replay_context);
+}
+
+static size_t count_waiting_to_send(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, size_t limit)
+{
+    size_t result = 0;
+    PDLIST_ENTRY entry = handleData->waitingToSend.Flink;
+    while (entry != &(handleData->waitingToSend) && result < limit)
+    {
+        result++;
+        entry = entry->Flink;
+    }
+    return result;
+}
+
+/*new messages go to disk while older ones are still on disk (to keep ordering) or while waitingToSend is full*/
+static bool should_spool_to_offline_store(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+{
+    return (handleData->offline_store != NULL) &&
+        ((IoTHubClient_OfflineStore_GetCount(handleData->offline_store) > 0) ||
+        (count_waiting_to_send(handleData, handleData->offline_store_ram_threshold) >= handleData->offline_store_ram_threshold));
+}
+
+static int replay_from_offline_store(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+{
+    int result;
+    IOTHUB_MESSAGE_HANDLE messageHandle;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    uint64_t offset;
+
+    if (IoTHubClient_OfflineStore_Pop(handleData->offline_store, &messageHandle, &callback, &context, &offset) != 0)
+    {
+        LogError("unable to read message from offline store");
+        result = __FAILURE__;
+    }
+    else
+    {
+        IOTHUB_MESSAGE_LIST* newEntry = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
+        OFFLINE_STORE_REPLAY_CONTEXT* replay_context = (OFFLINE_STORE_REPLAY_CONTEXT*)malloc(sizeof(OFFLINE_STORE_REPLAY_CONTEXT));
+
+        if (newEntry == NULL || replay_context == NULL || attach_ms_timesOutAfter(handleData, newEntry) != 0)
+        {
+            LogError("unable to queue message replayed from offline store");
+            free(newEntry);
+            free(replay_context);
+            IoTHubMessage_Destroy(messageHandle);
+            (void)IoTHubClient_OfflineStore_Complete(handleData->offline_store, offset);
+            if (callback != NULL)
+            {
+                callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, context);
+            }
+            result = __FAILURE__;
+        }
+        else
+        {
+            /*the message timeout starts when the message leaves the offline store*/
+            replay_context->offline_store = handleData->offline_store;
+            replay_context->offset = offset;
+            replay_context->callback = callback;
+            replay_context->context = context;
+            newEntry->messageHandle = messageHandle;
+            newEntry->callback = offline_store_replay_complete;
+            newEntry->context = replay_context;
+            newEntry->priority = IoTHubMessage_GetPriority(messageHandle);
+#ifdef USE_LATENCY_TRACING
+            IoTHubClient_Latency_ResetStamps(&newEntry->latency_stamps);
+#endif
+            insert_by_priority(&(handleData->waitingToSend), newEntry);
+            IOTHUB_CLIENT_LATENCY_TRACE(handleData, newEntry, IOTHUB_CLIENT_LATENCY_EVENT_ENQUEUED);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void refill_from_offline_store(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+{
+    if (handleData->offline_store != NULL)
+    {
+        size_t waiting = count_waiting_to_send(handleData, handleData->offline_store_ram_threshold);
+        while (waiting < handleData->offline_store_ram_threshold &&
+            IoTHubClient_OfflineStore_GetCount(handleData->offline_store) > 0 &&
+            replay_from_offline_store(handleData) == 0)
+        {
+            waiting++;
+        }
+    }
+}
+#endif /*USE_OFFLINE_STORE*/
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1082,12 +1292,38 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HA
                 }
                 else
                 {
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-                    newEntry->callback = eventConfirmationCallback;
-                    newEntry->context = userContextCallback;
-                    DList_InsertTailList(&(iotHubClientHandle->waitingToSend), &(newEntry->entry));
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClientCore_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
-                    result = IOTHUB_CLIENT_OK;
+                    newEntry->priority = IoTHubMessage_GetPriority(newEntry->messageHandle);
+#ifdef USE_OFFLINE_STORE
+                    /*Codes_SRS_IOTHUBCLIENT_LL_33_002: [ Messages of priority IOTHUB_MESSAGE_PRIORITY_HIGH shall never be appended to the offline store. ]*/
+                    if (newEntry->priority == IOTHUB_MESSAGE_PRIORITY_NORMAL && should_spool_to_offline_store(handleData))
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_LL_32_003: [ offline_store_ram_threshold (a pointer to size_t) - while the offline store holds messages, or waitingToSend holds at least *value messages, IoTHubClient_LL_SendEventAsync shall append new messages to the offline store instead of waitingToSend. ]*/
+                        if (IoTHubClient_OfflineStore_Push(handleData->offline_store, newEntry->messageHandle, eventConfirmationCallback, userContextCallback) != 0)
+                        {
+                            result = IOTHUB_CLIENT_ERROR;
+                            LOG_ERROR_RESULT;
+                        }
+                        else
+                        {
+                            result = IOTHUB_CLIENT_OK;
+                        }
+                        IoTHubMessage_Destroy(newEntry->messageHandle);
+                        free(newEntry);
+                    }
+                    else
+#endif
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
+                        newEntry->callback = eventConfirmationCallback;
+                        newEntry->context = userContextCallback;
+#ifdef USE_LATENCY_TRACING
+                        IoTHubClient_Latency_ResetStamps(&newEntry->latency_stamps);
+#endif
+                        insert_by_priority(&(iotHubClientHandle->waitingToSend), newEntry);
+                        IOTHUB_CLIENT_LATENCY_TRACE(iotHubClientHandle, newEntry, IOTHUB_CLIENT_LATENCY_EVENT_ENQUEUED);
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClientCore_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
+                        result = IOTHUB_CLIENT_OK;
+                    }
                 }
             }
         }
@@ -1255,12 +1491,14 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendMessageDisposition(IOTHUB_CLIENT_CO
     return result;
 }
 
-static void DoTimeouts(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+/*returns the current tick, or 0 when it cannot be read*/
+static tickcounter_ms_t DoTimeouts(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
 {
     tickcounter_ms_t nowTick;
     if (tickcounter_get_current_ms(handleData->tickCounter, &nowTick) != 0)
     {
         LogError("unable to get the current ms, timeouts will not be processed");
+        nowTick = 0;
     }
     else
     {
@@ -1286,7 +1524,32 @@ static void DoTimeouts(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
                 currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
             }
         }
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_35_004: [ IoTHubClientCore_LL_DoWork shall fail with status code 408 every twin item the transport has not acknowledged within twin_ack_timeout_ms and remove it from the ack queue. ]*/
+        /*Codes_SRS_IOTHUBCLIENT_LL_35_006: [ Twin items without a deadline shall be skipped and shall not keep the items behind them from timing out. ]*/
+        /*items enter iot_ack_queue in time order, so the walk stops at the first deadline that has not passed*/
+        DLIST_ENTRY* currentItemInAckQueue = handleData->iot_ack_queue.Flink;
+        while (currentItemInAckQueue != &(handleData->iot_ack_queue))
+        {
+            IOTHUB_DEVICE_TWIN* queue_data = containingRecord(currentItemInAckQueue, IOTHUB_DEVICE_TWIN, entry);
+            PDLIST_ENTRY theNext = currentItemInAckQueue->Flink; /*completing the item removes it from the queue*/
+            if (queue_data->ms_timesOutAfter == 0)
+            {
+                currentItemInAckQueue = theNext;
+            }
+            else if (queue_data->ms_timesOutAfter >= nowTick)
+            {
+                break;
+            }
+            else
+            {
+                LogError("twin item %u was not acknowledged in time", (unsigned int)queue_data->item_id);
+                IoTHubClientCore_LL_ReportedStateComplete(handleData, queue_data->item_id, TWIN_ACK_TIMEOUT_STATUS_CODE);
+                currentItemInAckQueue = theNext;
+            }
+        }
     }
+    return nowTick;
 }
 
 void IoTHubClientCore_LL_DoWork(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
@@ -1295,11 +1558,18 @@ void IoTHubClientCore_LL_DoWork(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
     if (iotHubClientHandle != NULL)
     {
         IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
-        DoTimeouts(handleData);
+        tickcounter_ms_t nowTick = DoTimeouts(handleData);
+
+#ifdef USE_OFFLINE_STORE
+        /*Codes_SRS_IOTHUBCLIENT_LL_32_004: [ IoTHubClient_LL_DoWork shall move messages from the offline store to waitingToSend while waitingToSend holds less than offline_store_ram_threshold messages. The timeout of a message moved from the offline store starts when it is moved. ]*/
+        refill_from_offline_store(handleData);
+#endif
 
         /*Codes_SRS_IOTHUBCLIENT_LL_07_008: [ IoTHubClientCore_LL_DoWork shall iterate the message queue and execute the underlying transports IoTHubTransport_ProcessItem function for each item. ] */
+        /*Codes_SRS_IOTHUBCLIENT_LL_35_002: [ If twin_max_in_flight is not 0, IoTHubClientCore_LL_DoWork shall stop handing items to the transport once twin_max_in_flight items are waiting for their acknowledgement. ]*/
         DLIST_ENTRY* client_item = handleData->iot_msg_queue.Flink;
-        while (client_item != &(handleData->iot_msg_queue)) /*while we are not at the end of the list*/
+        while (client_item != &(handleData->iot_msg_queue) && /*while we are not at the end of the list*/
+            (handleData->twin_max_in_flight == 0 || handleData->iot_ack_count < handleData->twin_max_in_flight))
         {
             PDLIST_ENTRY next_item = client_item->Flink;
 
@@ -1318,7 +1588,7 @@ void IoTHubClientCore_LL_DoWork(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
                 if (process_results == IOTHUB_PROCESS_OK)
                 {
                     /*Codes_SRS_IOTHUBCLIENT_LL_07_011: [ If 'IoTHubTransport_ProcessItem' returns IOTHUB_PROCESS_OK IoTHubClientCore_LL_DoWork shall add the IOTHUB_DEVICE_TWIN to the ack queue. ]*/
-                    DList_InsertTailList(&(iotHubClientHandle->iot_ack_queue), &(queue_data->entry));
+                    add_to_ack_queue(handleData, queue_data, nowTick);
                 }
                 else
                 {
@@ -1333,6 +1603,14 @@ void IoTHubClientCore_LL_DoWork(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 
         /*Codes_SRS_IOTHUBCLIENT_LL_02_021: [Otherwise, IoTHubClientCore_LL_DoWork shall invoke the underlaying layer's _DoWork function.]*/
         handleData->IoTHubTransport_DoWork(handleData->transportHandle, iotHubClientHandle);
+
+#ifdef USE_OFFLINE_STORE
+        /*Codes_SRS_IOTHUBCLIENT_LL_32_007: [ After the transport's _DoWork, IoTHubClient_LL_DoWork shall flush the offline store once, persisting the messages stored and acknowledged during this call. ]*/
+        if (handleData->offline_store != NULL && IoTHubClient_OfflineStore_Flush(handleData->offline_store) != 0)
+        {
+            LogError("Failed flushing the offline store");
+        }
+#endif
     }
 }
 
@@ -1353,6 +1631,12 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_GetSendStatus(IOTHUB_CLIENT_CORE_LL_HAN
         /* Codes_SRS_IOTHUBCLIENT_09_008: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there is currently no items to be sent] */
         /* Codes_SRS_IOTHUBCLIENT_09_009: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently items to be sent] */
         result = handleData->IoTHubTransport_GetSendStatus(handleData->deviceHandle, iotHubClientStatus);
+#ifdef USE_OFFLINE_STORE
+        if (result == IOTHUB_CLIENT_OK && IoTHubClient_OfflineStore_GetCount(handleData->offline_store) > 0)
+        {
+            *iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        }
+#endif
     }
 
     return result;
@@ -1377,6 +1661,11 @@ void IoTHubClientCore_LL_SendComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, PDLIS
         while ((oldest = DList_RemoveHeadList(completed)) != completed)
         {
             IOTHUB_MESSAGE_LIST* messageList = (IOTHUB_MESSAGE_LIST*)containingRecord(oldest, IOTHUB_MESSAGE_LIST, entry);
+            if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+            {
+                IOTHUB_CLIENT_LATENCY_TRACE(handle, messageList, IOTHUB_CLIENT_LATENCY_EVENT_COMPLETED);
+            }
+            IOTHUB_CLIENT_METRIC_EVENT_COMPLETED(handle, messageList, result);
             /*Codes_SRS_IOTHUBCLIENT_LL_02_026: [If any callback is NULL then there shall not be a callback call.]*/
             if (messageList->callback != NULL)
             {
@@ -1388,6 +1677,138 @@ void IoTHubClientCore_LL_SendComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, PDLIS
     }
 }
 
+#ifdef USE_LATENCY_TRACING
+void IoTHubClientCore_LL_TraceLatency(IOTHUB_CLIENT_CORE_LL_HANDLE handle, IOTHUB_MESSAGE_LIST* message, IOTHUB_CLIENT_LATENCY_EVENT latency_event)
+{
+    tickcounter_ms_t now;
+    if ((handle == NULL) || (message == NULL))
+    {
+        LogError("invalid arg handle=%p, message=%p", handle, message);
+    }
+    else if (tickcounter_get_current_ms(handle->tickCounter, &now) != 0)
+    {
+        LogError("unable to get the current relative tickcount");
+    }
+    else
+    {
+        IoTHubClient_Latency_Stamp(&message->latency_stamps, latency_event, now);
+        if (latency_event == IOTHUB_CLIENT_LATENCY_EVENT_COMPLETED)
+        {
+            IoTHubClient_Latency_RecordStages(&handle->latency_statistics, &message->latency_stamps);
+        }
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_GetStatistics(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATISTICS* statistics)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if ((iotHubClientHandle == NULL) || (statistics == NULL))
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("invalid argument iotHubClientHandle(%p); statistics(%p)", iotHubClientHandle, statistics);
+    }
+    else
+    {
+        (void)memcpy(statistics, &iotHubClientHandle->latency_statistics, sizeof(IOTHUB_CLIENT_STATISTICS));
+        result = IOTHUB_CLIENT_OK;
+    }
+    return result;
+}
+#endif /*USE_LATENCY_TRACING*/
+
+#ifdef USE_CLIENT_METRICS
+static size_t get_message_size(IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    size_t result;
+    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(messageHandle);
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        const unsigned char* source;
+        if (IoTHubMessage_GetByteArray(messageHandle, &source, &result) != IOTHUB_MESSAGE_OK)
+        {
+            result = 0;
+        }
+    }
+    else if (contentType == IOTHUBMESSAGE_STRING)
+    {
+        const char* source = IoTHubMessage_GetString(messageHandle);
+        result = (source == NULL) ? 0 : strlen(source);
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+void IoTHubClientCore_LL_CountMetric(IOTHUB_CLIENT_CORE_LL_HANDLE handle, IOTHUB_CLIENT_METRIC metric, uint64_t amount)
+{
+    if ((handle == NULL) || (metric >= IOTHUB_CLIENT_METRIC_COUNT))
+    {
+        LogError("invalid arg handle=%p, metric=%d", handle, (int)metric);
+    }
+    else
+    {
+        handle->metrics.counters[metric] += amount;
+    }
+}
+
+void IoTHubClientCore_LL_CountEventCompleted(IOTHUB_CLIENT_CORE_LL_HANDLE handle, IOTHUB_MESSAGE_LIST* message, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    if ((handle == NULL) || (message == NULL))
+    {
+        LogError("invalid arg handle=%p, message=%p", handle, message);
+    }
+    else if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        handle->metrics.counters[IOTHUB_CLIENT_METRIC_EVENTS_SENT]++;
+        handle->metrics.counters[IOTHUB_CLIENT_METRIC_EVENT_BYTES_SENT] += get_message_size(message->messageHandle);
+    }
+    else
+    {
+        handle->metrics.counters[IOTHUB_CLIENT_METRIC_EVENTS_FAILED]++;
+    }
+}
+
+void IoTHubClientCore_LL_SetQueueDepth(IOTHUB_CLIENT_CORE_LL_HANDLE handle, IOTHUB_CLIENT_QUEUE queue, size_t depth)
+{
+    if ((handle == NULL) || (queue >= IOTHUB_CLIENT_QUEUE_COUNT))
+    {
+        LogError("invalid arg handle=%p, queue=%d", handle, (int)queue);
+    }
+    else
+    {
+        handle->metrics.queue_depths[queue] = depth;
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_GetMetrics(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_METRICS* metrics)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if ((iotHubClientHandle == NULL) || (metrics == NULL))
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("invalid argument iotHubClientHandle(%p); metrics(%p)", iotHubClientHandle, metrics);
+    }
+    else
+    {
+        /*the transports take messages out of waitingToSend themselves, so its depth is only known by walking it*/
+        size_t waitingToSend = 0;
+        PDLIST_ENTRY entry = iotHubClientHandle->waitingToSend.Flink;
+        while (entry != &(iotHubClientHandle->waitingToSend))
+        {
+            waitingToSend++;
+            entry = entry->Flink;
+        }
+        iotHubClientHandle->metrics.queue_depths[IOTHUB_CLIENT_QUEUE_WAITING_TO_SEND] = waitingToSend;
+
+        (void)memcpy(metrics, &iotHubClientHandle->metrics, sizeof(IOTHUB_CLIENT_METRICS));
+        result = IOTHUB_CLIENT_OK;
+    }
+    return result;
+}
+#endif /*USE_CLIENT_METRICS*/
+
 int IoTHubClientCore_LL_DeviceMethodComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, const char* method_name, const unsigned char* payLoad, size_t size, METHOD_HANDLE response_id)
 {
     int result;
@@ -1475,23 +1896,27 @@ void IoTHubClientCore_LL_ReportedStateComplete(IOTHUB_CLIENT_CORE_LL_HANDLE hand
         IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)handle;
 
         /* Codes_SRS_IOTHUBCLIENT_LL_07_003: [ IoTHubClientCore_LL_ReportedStateComplete shall enumerate through the IOTHUB_DEVICE_TWIN structures in queue_handle. ]*/
-        DLIST_ENTRY* client_item = handleData->iot_ack_queue.Flink;
-        while (client_item != &(handleData->iot_ack_queue)) /*while we are not at the end of the list*/
+        /*Codes_SRS_IOTHUBCLIENT_LL_35_003: [ IoTHubClientCore_LL_ReportedStateComplete shall find the item by hashing item_id, without walking the ack queue. ]*/
+        IOTHUB_DEVICE_TWIN* queue_data = remove_from_ack_index(handleData, item_id);
+        if (status_code == 429)
         {
-            PDLIST_ENTRY next_item = client_item->Flink;
-            IOTHUB_DEVICE_TWIN* queue_data = containingRecord(client_item, IOTHUB_DEVICE_TWIN, entry);
-            if (queue_data->item_id == item_id)
+            IOTHUB_CLIENT_METRIC_ADD(handle, IOTHUB_CLIENT_METRIC_THROTTLED, 1);
+        }
+        if (queue_data != NULL)
+        {
+            size_t index;
+            if (queue_data->reported_state_callback != NULL)
             {
-                if (queue_data->reported_state_callback != NULL)
-                {
-                    queue_data->reported_state_callback(status_code, queue_data->context);
-                }
-                /*Codes_SRS_IOTHUBCLIENT_LL_07_009: [ IoTHubClientCore_LL_ReportedStateComplete shall remove the IOTHUB_DEVICE_TWIN item from the ack queue.]*/
-                DList_RemoveEntryList(client_item);
-                device_twin_data_destroy(queue_data);
-                break;
+                queue_data->reported_state_callback(status_code, queue_data->context);
             }
-            client_item = next_item;
+            /*Codes_SRS_IOTHUBCLIENT_LL_34_003: [ IoTHubClientCore_LL_ReportedStateComplete shall invoke the callbacks of all the patches merged into the completed item, in the order the patches were sent. ]*/
+            for (index = 0; index < queue_data->coalesced_callback_count; index++)
+            {
+                queue_data->coalesced_callbacks[index].reported_state_callback(status_code, queue_data->coalesced_callbacks[index].context);
+            }
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_009: [ IoTHubClientCore_LL_ReportedStateComplete shall remove the IOTHUB_DEVICE_TWIN item from the ack queue.]*/
+            DList_RemoveEntryList(&(queue_data->entry));
+            device_twin_data_destroy(queue_data);
         }
     }
 }
@@ -1517,6 +1942,10 @@ bool IoTHubClientCore_LL_MessageCallback(IOTHUB_CLIENT_CORE_LL_HANDLE handle, ME
 
         /* Codes_SRS_IOTHUBCLIENT_LL_09_004: [IoTHubClientCore_LL_GetLastMessageReceiveTime shall return lastMessageReceiveTime in localtime] */
         handleData->lastMessageReceiveTime = get_time(NULL);
+#ifdef USE_CLIENT_METRICS
+        handleData->metrics.counters[IOTHUB_CLIENT_METRIC_MESSAGES_RECEIVED]++;
+        handleData->metrics.counters[IOTHUB_CLIENT_METRIC_MESSAGE_BYTES_RECEIVED] += get_message_size(messageData->messageHandle);
+#endif
         switch (handleData->messageCallback.type)
         {
             case CALLBACK_TYPE_NONE:
@@ -1759,6 +2188,24 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetOption(IOTHUB_CLIENT_CORE_LL_HANDLE
                 result = IOTHUB_CLIENT_OK;
             }
         }
+        else if (strcmp(optionName, OPTION_TWIN_MAX_IN_FLIGHT) == 0)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_35_001: [ "twin_max_in_flight" - value is a pointer to a size_t, the maximum number of twin items handed to the transport and not yet acknowledged. 0, the default, means no limit. ]*/
+            handleData->twin_max_in_flight = *(const size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(optionName, OPTION_TWIN_ACK_TIMEOUT) == 0)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_35_005: [ "twin_ack_timeout_ms" - value is a pointer to a tickcounter_ms_t, the time twin items handed to the transport from then on wait for their acknowledgement. 0, the default, means they wait forever. ]*/
+            handleData->twin_ack_timeout = *(const tickcounter_ms_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(optionName, OPTION_TWIN_COALESCE_REPORTED_STATE) == 0)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_34_001: [ "twin_coalesce_reported_state" - value is a pointer to a bool that enables or disables merging of reported state patches that are still queued. ]*/
+            handleData->coalesce_reported_state = *(const bool*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
         else if (strcmp(optionName, OPTION_BLOB_UPLOAD_TIMEOUT_SECS) == 0)
         {
 #ifndef DONT_USE_UPLOADTOBLOB
@@ -1774,6 +2221,75 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetOption(IOTHUB_CLIENT_CORE_LL_HANDLE
             result = IOTHUB_CLIENT_ERROR;
 #endif /*DONT_USE_UPLOADTOBLOB*/
         }
+#ifdef USE_OFFLINE_STORE
+        else if (strcmp(optionName, OPTION_OFFLINE_STORE_RAM_THRESHOLD) == 0)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_32_006: [ If `offline_store_ram_threshold` is 0, `IoTHubClient_LL_SetOption` shall fail and return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+            if (*(const size_t*)value == 0)
+            {
+                LogError("%s must be at least 1, the messages in the offline store are only replayed into waitingToSend", optionName);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                handleData->offline_store_ram_threshold = *(const size_t*)value;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        else if (
+            (strcmp(optionName, OPTION_OFFLINE_STORE_MAX_SIZE) == 0) ||
+            (strcmp(optionName, OPTION_OFFLINE_STORE_SEGMENT_SIZE) == 0) ||
+            (strcmp(optionName, OPTION_OFFLINE_STORE_DROP_OLDEST) == 0)
+            )
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_32_002: [ offline_store_max_size, offline_store_segment_size (pointers to size_t) and offline_store_drop_oldest (a pointer to bool) shall configure the offline store and shall fail once offline_store_directory has been set. ]*/
+            if (handleData->offline_store != NULL)
+            {
+                LogError("%s must be set before %s", optionName, OPTION_OFFLINE_STORE_DIRECTORY);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                if (strcmp(optionName, OPTION_OFFLINE_STORE_MAX_SIZE) == 0)
+                {
+                    handleData->offline_store_config.max_size = *(const size_t*)value;
+                }
+                else if (strcmp(optionName, OPTION_OFFLINE_STORE_SEGMENT_SIZE) == 0)
+                {
+                    handleData->offline_store_config.segment_size = *(const size_t*)value;
+                }
+                else
+                {
+                    handleData->offline_store_config.drop_oldest = *(const bool*)value;
+                }
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        else if (strcmp(optionName, OPTION_OFFLINE_STORE_DIRECTORY) == 0)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_32_001: [ If the USE_OFFLINE_STORE compiler switch is defined, offline_store_directory - IoTHubClient_LL_SetOption shall create an offline store in the directory given by value (a const char*), and shall fail if an offline store was already created. ]*/
+            if (handleData->offline_store != NULL)
+            {
+                LogError("the offline store is already enabled");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                handleData->offline_store_config.directory = (const char*)value;
+                handleData->offline_store = IoTHubClient_OfflineStore_Create(&handleData->offline_store_config);
+                handleData->offline_store_config.directory = NULL;
+                if (handleData->offline_store == NULL)
+                {
+                    LogError("unable to create the offline store");
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else
+                {
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+        }
+#endif /*USE_OFFLINE_STORE*/
         else
         {
             // This section is unusual for SetOption calls because it attempts to pass unhandled options
@@ -1812,6 +2328,14 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_GetOption(IOTHUB_CLIENT_CORE_LL_HANDLE
         result = IOTHUB_CLIENT_OK;
         *value = iotHubClientHandle->product_info;
     }
+#ifdef USE_LATENCY_TRACING
+    else if (strcmp(optionName, OPTION_LATENCY_STATISTICS) == 0)
+    {
+        /*the statistics keep changing with the next DoWork, IoTHubClientCore_LL_GetStatistics returns a copy*/
+        result = IOTHUB_CLIENT_OK;
+        *value = &iotHubClientHandle->latency_statistics;
+    }
+#endif
     else
     {
         result = IOTHUB_CLIENT_INVALID_ARG;
@@ -1859,6 +2383,219 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetDeviceTwinCallback(IOTHUB_CLIENT_COR
     return result;
 }
 
+static JSON_Value* parse_reported_state(const unsigned char* reportedState, size_t size)
+{
+    JSON_Value* result;
+    /*the reported state is not NULL terminated*/
+    char* json_string = (char*)malloc(size + 1);
+    if (json_string == NULL)
+    {
+        LogError("Failure allocating reported state copy");
+        result = NULL;
+    }
+    else
+    {
+        (void)memcpy(json_string, reportedState, size);
+        json_string[size] = '\0';
+        result = json_parse_string(json_string);
+        free(json_string);
+    }
+    return result;
+}
+
+/*last writer wins per property; nested objects are merged so that a later patch only overrides the properties it carries*/
+static int merge_reported_state_object(JSON_Object* destination, const JSON_Object* source)
+{
+    int result = 0;
+    size_t count = json_object_get_count(source);
+    size_t index;
+    for (index = 0; index < count && result == 0; index++)
+    {
+        const char* name = json_object_get_name(source, index);
+        JSON_Value* source_value = json_object_get_value(source, name);
+        JSON_Object* destination_object = json_object_get_object(destination, name);
+        if (destination_object != NULL && json_value_get_type(source_value) == JSONObject)
+        {
+            result = merge_reported_state_object(destination_object, json_value_get_object(source_value));
+        }
+        else
+        {
+            JSON_Value* copy = json_value_deep_copy(source_value);
+            if (copy == NULL)
+            {
+                LogError("Failure copying reported property %s", name);
+                result = __FAILURE__;
+            }
+            else if (json_object_set_value(destination, name, copy) != JSONSuccess)
+            {
+                LogError("Failure setting reported property %s", name);
+                json_value_free(copy);
+                result = __FAILURE__;
+            }
+        }
+    }
+    return result;
+}
+
+/*a patch that turns a property the pending patch deletes (null) back into an object cannot be merged: the service has to see the deletion first so that the object replaces the property instead of being merged into its old value*/
+static bool can_merge_reported_state_object(const JSON_Object* destination, const JSON_Object* source)
+{
+    bool result = true;
+    size_t count = json_object_get_count(source);
+    size_t index;
+    for (index = 0; index < count && result; index++)
+    {
+        const char* name = json_object_get_name(source, index);
+        JSON_Value* destination_value = json_object_get_value(destination, name);
+        JSON_Value* source_value = json_object_get_value(source, name);
+        if (destination_value != NULL && json_value_get_type(source_value) == JSONObject)
+        {
+            if (json_value_get_type(destination_value) == JSONNull)
+            {
+                result = false;
+            }
+            else if (json_value_get_type(destination_value) == JSONObject)
+            {
+                result = can_merge_reported_state_object(json_value_get_object(destination_value), json_value_get_object(source_value));
+            }
+        }
+    }
+    return result;
+}
+
+/*true when merging source into destination yields source, i.e. source sets every property destination carries*/
+static bool reported_state_object_covers(const JSON_Object* source, const JSON_Object* destination)
+{
+    bool result = true;
+    size_t count = json_object_get_count(destination);
+    size_t index;
+    for (index = 0; index < count && result; index++)
+    {
+        const char* name = json_object_get_name(destination, index);
+        JSON_Value* source_value = json_object_get_value(source, name);
+        if (source_value == NULL)
+        {
+            result = false;
+        }
+        else if (json_value_get_type(source_value) == JSONObject && json_value_get_type(json_object_get_value(destination, name)) == JSONObject)
+        {
+            result = reported_state_object_covers(json_value_get_object(source_value), json_object_get_object(destination, name));
+        }
+    }
+    return result;
+}
+
+static void replace_pending_reported_state(IOTHUB_DEVICE_TWIN* pending, CONSTBUFFER_HANDLE data, IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback, void* userContextCallback)
+{
+    CONSTBUFFER_Destroy(pending->report_data_handle);
+    pending->report_data_handle = data;
+    if (reportedStateCallback != NULL)
+    {
+        pending->coalesced_callbacks[pending->coalesced_callback_count].reported_state_callback = reportedStateCallback;
+        pending->coalesced_callbacks[pending->coalesced_callback_count].context = userContextCallback;
+        pending->coalesced_callback_count++;
+    }
+}
+
+static int coalesce_reported_state(IOTHUB_DEVICE_TWIN* pending, const unsigned char* reportedState, size_t size, IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback, void* userContextCallback)
+{
+    int result;
+    const CONSTBUFFER* pending_content = CONSTBUFFER_GetContent(pending->report_data_handle);
+    JSON_Value* merged;
+    JSON_Value* patch;
+
+    if (pending_content == NULL)
+    {
+        LogError("Failure getting the pending reported state");
+        result = __FAILURE__;
+    }
+    else if ((merged = parse_reported_state(pending_content->buffer, pending_content->size)) == NULL)
+    {
+        LogError("Pending reported state is not valid JSON, not merging");
+        result = __FAILURE__;
+    }
+    else
+    {
+        if ((patch = parse_reported_state(reportedState, size)) == NULL)
+        {
+            LogError("Reported state is not valid JSON, not merging");
+            result = __FAILURE__;
+        }
+        else
+        {
+            JSON_Object* merged_object = json_value_get_object(merged);
+            JSON_Object* patch_object = json_value_get_object(patch);
+            IOTHUB_REPORTED_STATE_CALLBACK_INFO* callbacks = pending->coalesced_callbacks;
+            char* serialized;
+
+            if (merged_object == NULL || patch_object == NULL)
+            {
+                /*only objects can be merged, anything else is sent as it is*/
+                result = __FAILURE__;
+            }
+            /*Codes_SRS_IOTHUBCLIENT_LL_34_004: [ If reportedState sets to an object a property that the queued patch sets to null, IoTHubClientCore_LL_SendReportedState shall not merge and shall queue reportedState as a separate patch. ]*/
+            else if (!can_merge_reported_state_object(merged_object, patch_object))
+            {
+                LogInfo("Reported state re-creates a deleted property, not merging");
+                result = __FAILURE__;
+            }
+            else if (reportedStateCallback != NULL &&
+                (callbacks = (IOTHUB_REPORTED_STATE_CALLBACK_INFO*)realloc(pending->coalesced_callbacks, (pending->coalesced_callback_count + 1) * sizeof(IOTHUB_REPORTED_STATE_CALLBACK_INFO))) == NULL)
+            {
+                LogError("Failure allocating reported state callback");
+                result = __FAILURE__;
+            }
+            else
+            {
+                CONSTBUFFER_HANDLE merged_data;
+                pending->coalesced_callbacks = callbacks;
+
+                /*Codes_SRS_IOTHUBCLIENT_LL_34_005: [ If reportedState sets every property of the queued patch, IoTHubClientCore_LL_SendReportedState shall replace the queued patch with reportedState as given. ]*/
+                if (reported_state_object_covers(patch_object, merged_object))
+                {
+                    if ((merged_data = CONSTBUFFER_Create(reportedState, size)) == NULL)
+                    {
+                        LogError("Failure allocating reported state");
+                        result = __FAILURE__;
+                    }
+                    else
+                    {
+                        replace_pending_reported_state(pending, merged_data, reportedStateCallback, userContextCallback);
+                        result = 0;
+                    }
+                }
+                else if (merge_reported_state_object(merged_object, patch_object) != 0)
+                {
+                    LogError("Failure merging reported state");
+                    result = __FAILURE__;
+                }
+                else if ((serialized = json_serialize_to_string(merged)) == NULL)
+                {
+                    LogError("Failure serializing merged reported state");
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    if ((merged_data = CONSTBUFFER_Create((const unsigned char*)serialized, strlen(serialized))) == NULL)
+                    {
+                        LogError("Failure allocating merged reported state");
+                        result = __FAILURE__;
+                    }
+                    else
+                    {
+                        replace_pending_reported_state(pending, merged_data, reportedStateCallback, userContextCallback);
+                        result = 0;
+                    }
+                    json_free_serialized_string(serialized);
+                }
+            }
+            json_value_free(patch);
+        }
+        json_value_free(merged);
+    }
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendReportedState(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, const unsigned char* reportedState, size_t size, IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1873,29 +2610,40 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendReportedState(IOTHUB_CLIENT_CORE_LL
     else
     {
         IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
-        /* Codes_SRS_IOTHUBCLIENT_LL_10_014: [IoTHubClientCore_LL_SendReportedState shall construct and queue the reported a Device_Twin structure for transmition by the underlying transport.] */
-        IOTHUB_DEVICE_TWIN* client_data = dev_twin_data_create(handleData, get_next_item_id(handleData), reportedState, size, reportedStateCallback, userContextCallback);
-        if (client_data == NULL)
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_34_002: [ If twin_coalesce_reported_state is enabled and iot_msg_queue is not empty, IoTHubClientCore_LL_SendReportedState shall merge reportedState into the last queued patch and return IOTHUB_CLIENT_OK. ]*/
+        if (handleData->coalesce_reported_state &&
+            !DList_IsListEmpty(&(handleData->iot_msg_queue)) &&
+            coalesce_reported_state(containingRecord(handleData->iot_msg_queue.Blink, IOTHUB_DEVICE_TWIN, entry), reportedState, size, reportedStateCallback, userContextCallback) == 0)
         {
-            /* Codes_SRS_IOTHUBCLIENT_LL_10_015: [If any error is encountered IoTHubClientCore_LL_SendReportedState shall return IOTHUB_CLIENT_ERROR.] */
-            LogError("Failure constructing device twin data");
-            result = IOTHUB_CLIENT_ERROR;
+            result = IOTHUB_CLIENT_OK;
         }
         else
         {
-            if (handleData->IoTHubTransport_Subscribe_DeviceTwin(handleData->transportHandle) != 0)
+            /* Codes_SRS_IOTHUBCLIENT_LL_10_014: [IoTHubClientCore_LL_SendReportedState shall construct and queue the reported a Device_Twin structure for transmition by the underlying transport.] */
+            IOTHUB_DEVICE_TWIN* client_data = dev_twin_data_create(handleData, get_next_item_id(handleData), reportedState, size, reportedStateCallback, userContextCallback);
+            if (client_data == NULL)
             {
-                LogError("Failure adding device twin data to queue");
-                device_twin_data_destroy(client_data);
+                /* Codes_SRS_IOTHUBCLIENT_LL_10_015: [If any error is encountered IoTHubClientCore_LL_SendReportedState shall return IOTHUB_CLIENT_ERROR.] */
+                LogError("Failure constructing device twin data");
                 result = IOTHUB_CLIENT_ERROR;
             }
             else
             {
-                /* Codes_SRS_IOTHUBCLIENT_LL_07_001: [ IoTHubClientCore_LL_SendReportedState shall queue the constructed reportedState data to be consumed by the targeted transport. ] */
-                DList_InsertTailList(&(iotHubClientHandle->iot_msg_queue), &(client_data->entry));
+                if (handleData->IoTHubTransport_Subscribe_DeviceTwin(handleData->transportHandle) != 0)
+                {
+                    LogError("Failure adding device twin data to queue");
+                    device_twin_data_destroy(client_data);
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else
+                {
+                    /* Codes_SRS_IOTHUBCLIENT_LL_07_001: [ IoTHubClientCore_LL_SendReportedState shall queue the constructed reportedState data to be consumed by the targeted transport. ] */
+                    DList_InsertTailList(&(iotHubClientHandle->iot_msg_queue), &(client_data->entry));
 
-                /* Codes_SRS_IOTHUBCLIENT_LL_10_016: [ Otherwise IoTHubClientCore_LL_SendReportedState shall succeed and return IOTHUB_CLIENT_OK.] */
-                result = IOTHUB_CLIENT_OK;
+                    /* Codes_SRS_IOTHUBCLIENT_LL_10_016: [ Otherwise IoTHubClientCore_LL_SendReportedState shall succeed and return IOTHUB_CLIENT_OK.] */
+                    result = IOTHUB_CLIENT_OK;
+                }
             }
         }
     }
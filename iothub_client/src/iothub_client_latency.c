@@ -0,0 +1,195 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+
+#include "internal/iothub_client_latency.h"
+
+#define EVENT_BIT(latency_event)    (1u << (unsigned int)(latency_event))
+
+typedef struct LATENCY_STAGE_SPAN_TAG
+{
+    IOTHUB_CLIENT_LATENCY_STAGE stage;
+    IOTHUB_CLIENT_LATENCY_EVENT from;
+    IOTHUB_CLIENT_LATENCY_EVENT to;
+} LATENCY_STAGE_SPAN;
+
+/*the stages measured by the LL layer, a stage is only recorded when both of its events were stamped. The
+acknowledgement starts at the last event the transport reported before it, see get_acknowledgement_start.*/
+static const LATENCY_STAGE_SPAN stage_spans[] =
+{
+    { IOTHUB_CLIENT_LATENCY_STAGE_WAITING_TO_SEND, IOTHUB_CLIENT_LATENCY_EVENT_ENQUEUED, IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED },
+    { IOTHUB_CLIENT_LATENCY_STAGE_ENCODING, IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED, IOTHUB_CLIENT_LATENCY_EVENT_ENCODED },
+    { IOTHUB_CLIENT_LATENCY_STAGE_SOCKET_WRITE, IOTHUB_CLIENT_LATENCY_EVENT_ENCODED, IOTHUB_CLIENT_LATENCY_EVENT_WRITTEN },
+    { IOTHUB_CLIENT_LATENCY_STAGE_TOTAL, IOTHUB_CLIENT_LATENCY_EVENT_ENQUEUED, IOTHUB_CLIENT_LATENCY_EVENT_COMPLETED }
+};
+
+static size_t get_bucket_index(uint32_t value)
+{
+    size_t result;
+    if (value < IOTHUB_CLIENT_LATENCY_EXACT_BUCKETS)
+    {
+        result = value;
+    }
+    else
+    {
+        unsigned int msb = 4;
+        while ((msb < 31) && ((value >> (msb + 1)) != 0))
+        {
+            msb++;
+        }
+        /*the 3 bits under the most significant one pick the sub bucket*/
+        result = IOTHUB_CLIENT_LATENCY_EXACT_BUCKETS + (msb - 4) * IOTHUB_CLIENT_LATENCY_SUB_BUCKETS + ((value >> (msb - 3)) & (IOTHUB_CLIENT_LATENCY_SUB_BUCKETS - 1));
+    }
+    return result;
+}
+
+static uint32_t get_bucket_highest_value(size_t index)
+{
+    uint32_t result;
+    if (index < IOTHUB_CLIENT_LATENCY_EXACT_BUCKETS)
+    {
+        result = (uint32_t)index;
+    }
+    else
+    {
+        unsigned int msb = 4 + (unsigned int)((index - IOTHUB_CLIENT_LATENCY_EXACT_BUCKETS) / IOTHUB_CLIENT_LATENCY_SUB_BUCKETS);
+        uint64_t sub_bucket = (index - IOTHUB_CLIENT_LATENCY_EXACT_BUCKETS) % IOTHUB_CLIENT_LATENCY_SUB_BUCKETS;
+        uint64_t highest = ((IOTHUB_CLIENT_LATENCY_SUB_BUCKETS + sub_bucket + 1) << (msb - 3)) - 1;
+        result = (highest > UINT32_MAX) ? UINT32_MAX : (uint32_t)highest;
+    }
+    return result;
+}
+
+/*MQTT reports the socket write, HTTP the encoding and AMQP only hands the messages over to its messenger*/
+static IOTHUB_CLIENT_LATENCY_EVENT get_acknowledgement_start(const IOTHUB_CLIENT_LATENCY_STAMPS* stamps)
+{
+    IOTHUB_CLIENT_LATENCY_EVENT result;
+    if ((stamps->stamped & EVENT_BIT(IOTHUB_CLIENT_LATENCY_EVENT_WRITTEN)) != 0)
+    {
+        result = IOTHUB_CLIENT_LATENCY_EVENT_WRITTEN;
+    }
+    else if ((stamps->stamped & EVENT_BIT(IOTHUB_CLIENT_LATENCY_EVENT_ENCODED)) != 0)
+    {
+        result = IOTHUB_CLIENT_LATENCY_EVENT_ENCODED;
+    }
+    else
+    {
+        result = IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED;
+    }
+    return result;
+}
+
+static void record_span(IOTHUB_CLIENT_STATISTICS* statistics, IOTHUB_CLIENT_LATENCY_STAGE stage, const IOTHUB_CLIENT_LATENCY_STAMPS* stamps, IOTHUB_CLIENT_LATENCY_EVENT from, IOTHUB_CLIENT_LATENCY_EVENT to)
+{
+    if (((stamps->stamped & EVENT_BIT(from)) != 0) && ((stamps->stamped & EVENT_BIT(to)) != 0) && (stamps->at[to] >= stamps->at[from]))
+    {
+        IoTHubClient_Latency_Record(&statistics->stages[stage], stamps->at[to] - stamps->at[from]);
+    }
+}
+
+void IoTHubClient_Latency_ResetStamps(IOTHUB_CLIENT_LATENCY_STAMPS* stamps)
+{
+    stamps->stamped = 0;
+}
+
+void IoTHubClient_Latency_Stamp(IOTHUB_CLIENT_LATENCY_STAMPS* stamps, IOTHUB_CLIENT_LATENCY_EVENT latency_event, tickcounter_ms_t now)
+{
+    if ((stamps->stamped & EVENT_BIT(latency_event)) == 0)
+    {
+        stamps->at[latency_event] = now;
+        stamps->stamped |= EVENT_BIT(latency_event);
+    }
+}
+
+void IoTHubClient_Latency_RecordStages(IOTHUB_CLIENT_STATISTICS* statistics, const IOTHUB_CLIENT_LATENCY_STAMPS* stamps)
+{
+    size_t index;
+    for (index = 0; index < sizeof(stage_spans) / sizeof(stage_spans[0]); index++)
+    {
+        record_span(statistics, stage_spans[index].stage, stamps, stage_spans[index].from, stage_spans[index].to);
+    }
+
+    record_span(statistics, IOTHUB_CLIENT_LATENCY_STAGE_ACKNOWLEDGEMENT, stamps, get_acknowledgement_start(stamps), IOTHUB_CLIENT_LATENCY_EVENT_COMPLETED);
+}
+
+void IoTHubClient_Latency_Record(IOTHUB_CLIENT_LATENCY_HISTOGRAM* histogram, tickcounter_ms_t value)
+{
+    /*the last bucket holds everything above 2^32 ms*/
+    uint32_t clamped = (value > UINT32_MAX) ? UINT32_MAX : (uint32_t)value;
+
+    if (histogram->count == 0 || clamped < histogram->min)
+    {
+        histogram->min = clamped;
+    }
+    if (clamped > histogram->max)
+    {
+        histogram->max = clamped;
+    }
+    histogram->count++;
+    histogram->sum += clamped;
+    histogram->buckets[get_bucket_index(clamped)]++;
+}
+
+void IoTHubClient_Latency_Merge(IOTHUB_CLIENT_LATENCY_HISTOGRAM* destination, const IOTHUB_CLIENT_LATENCY_HISTOGRAM* source)
+{
+    if (source->count > 0)
+    {
+        size_t index;
+        if (destination->count == 0 || source->min < destination->min)
+        {
+            destination->min = source->min;
+        }
+        if (source->max > destination->max)
+        {
+            destination->max = source->max;
+        }
+        destination->count += source->count;
+        destination->sum += source->sum;
+        for (index = 0; index < IOTHUB_CLIENT_LATENCY_BUCKET_COUNT; index++)
+        {
+            destination->buckets[index] += source->buckets[index];
+        }
+    }
+}
+
+uint32_t IoTHubClient_LatencyHistogram_GetPercentile(const IOTHUB_CLIENT_LATENCY_HISTOGRAM* histogram, double percentile)
+{
+    uint32_t result;
+    if (histogram == NULL || histogram->count == 0)
+    {
+        result = 0;
+    }
+    else if (percentile <= 0.0)
+    {
+        result = histogram->min;
+    }
+    else
+    {
+        uint64_t rank = (percentile >= 100.0) ? histogram->count : (uint64_t)((double)histogram->count * percentile / 100.0 + 0.5);
+        uint64_t seen = 0;
+        size_t index = 0;
+
+        if (rank == 0)
+        {
+            rank = 1;
+        }
+
+        while (index < IOTHUB_CLIENT_LATENCY_BUCKET_COUNT - 1 && seen + histogram->buckets[index] < rank)
+        {
+            seen += histogram->buckets[index];
+            index++;
+        }
+
+        result = get_bucket_highest_value(index);
+        if (result > histogram->max)
+        {
+            result = histogram->max;
+        }
+    }
+    return result;
+}
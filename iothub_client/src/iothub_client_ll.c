@@ -139,3 +139,17 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadMultipleBlocksToBlobEx(IOTHUB_CLIENT_
 }
 
 #endif
+
+#ifdef USE_LATENCY_TRACING
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetStatistics(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATISTICS* statistics)
+{
+    return IoTHubClientCore_LL_GetStatistics((IOTHUB_CLIENT_CORE_LL_HANDLE)iotHubClientHandle, statistics);
+}
+#endif /*USE_LATENCY_TRACING*/
+
+#ifdef USE_CLIENT_METRICS
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetMetrics(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_METRICS* metrics)
+{
+    return IoTHubClientCore_LL_GetMetrics((IOTHUB_CLIENT_CORE_LL_HANDLE)iotHubClientHandle, metrics);
+}
+#endif /*USE_CLIENT_METRICS*/
@@ -0,0 +1,1591 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/map.h"
+
+#include "internal/iothub_client_offline_store.h"
+
+#define SEGMENT_HEADER_SIZE         16
+#define RECORD_HEADER_SIZE          8
+#define SEGMENT_FORMAT_VERSION      1
+#define MESSAGE_FORMAT_VERSION      1
+#define NULL_STRING_LENGTH          0xFFFFFFFF
+#define CHECKPOINT_FILE_SIZE        12
+#define MIN_SEGMENT_COUNT           2
+
+static const unsigned char SEGMENT_MAGIC[8] = { 'I', 'O', 'T', 'S', 'P', 'O', 'O', 'L' };
+static const char SEGMENT_FILE_EXTENSION[] = ".seg";
+static const char CHECKPOINT_FILE_NAME[] = "checkpoint";
+static const char CHECKPOINT_TMP_FILE_NAME[] = "checkpoint.tmp";
+
+typedef struct OFFLINE_STORE_SEGMENT_TAG
+{
+    DLIST_ENTRY entry;
+    uint64_t base_offset;   /* logical offset of the first byte of this segment */
+    size_t capacity;        /* size of the segment file */
+    size_t used;            /* bytes written, including the segment header */
+    size_t synced;          /* bytes known to be flushed to disk */
+    char* file_path;
+    unsigned char* data;    /* mapped view of the file, NULL when not mapped */
+#if defined(WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} OFFLINE_STORE_SEGMENT;
+
+/* confirmation callbacks are only kept in memory, they cannot survive a restart */
+typedef struct PENDING_CALLBACK_TAG
+{
+    DLIST_ENTRY entry;
+    uint64_t offset;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+} PENDING_CALLBACK;
+
+/* records handed out by Pop and not yet completed, in offset order */
+typedef struct IN_FLIGHT_RECORD_TAG
+{
+    DLIST_ENTRY entry;
+    uint64_t offset;
+    uint64_t end_offset;
+    bool completed;
+} IN_FLIGHT_RECORD;
+
+typedef struct OFFLINE_STORE_INSTANCE_TAG
+{
+    char* directory;
+    size_t segment_size;
+    size_t max_segments;
+    bool drop_oldest;
+    DLIST_ENTRY segments;
+    size_t segment_count;
+    uint64_t next_segment_base;
+    OFFLINE_STORE_SEGMENT* read_segment;
+    size_t read_position;
+    uint64_t checkpoint;
+    bool is_checkpoint_dirty;   /* checkpoint moved since it was last written to disk */
+    size_t unread_count;
+    DLIST_ENTRY pending_callbacks;
+    DLIST_ENTRY in_flight;
+} OFFLINE_STORE_INSTANCE;
+
+typedef struct RECORD_WRITER_TAG
+{
+    unsigned char* buffer;  /* NULL when only computing the serialized size */
+    size_t position;
+} RECORD_WRITER;
+
+typedef struct RECORD_READER_TAG
+{
+    const unsigned char* buffer;
+    size_t size;
+    size_t position;
+} RECORD_READER;
+
+static uint32_t compute_crc32(const unsigned char* data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+        int bit;
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void encode_uint32(unsigned char* destination, uint32_t value)
+{
+    destination[0] = (unsigned char)(value & 0xFF);
+    destination[1] = (unsigned char)((value >> 8) & 0xFF);
+    destination[2] = (unsigned char)((value >> 16) & 0xFF);
+    destination[3] = (unsigned char)((value >> 24) & 0xFF);
+}
+
+static uint32_t decode_uint32(const unsigned char* source)
+{
+    return (uint32_t)source[0] | ((uint32_t)source[1] << 8) | ((uint32_t)source[2] << 16) | ((uint32_t)source[3] << 24);
+}
+
+static void encode_uint64(unsigned char* destination, uint64_t value)
+{
+    encode_uint32(destination, (uint32_t)(value & 0xFFFFFFFF));
+    encode_uint32(destination + 4, (uint32_t)(value >> 32));
+}
+
+static uint64_t decode_uint64(const unsigned char* source)
+{
+    return (uint64_t)decode_uint32(source) | ((uint64_t)decode_uint32(source + 4) << 32);
+}
+
+static char* make_path(const char* directory, const char* file_name)
+{
+    char* result;
+    size_t length = strlen(directory) + strlen(file_name) + 2;
+    if ((result = (char*)malloc(length)) == NULL)
+    {
+        LogError("Failed allocating file path");
+    }
+    else
+    {
+        (void)snprintf(result, length, "%s/%s", directory, file_name);
+    }
+    return result;
+}
+
+/* platform file primitives */
+
+static int make_directory(const char* path)
+{
+    int result;
+#if defined(WIN32)
+    if (CreateDirectoryA(path, NULL) == 0 && GetLastError() != ERROR_ALREADY_EXISTS)
+#else
+    if (mkdir(path, 0700) != 0 && errno != EEXIST)
+#endif
+    {
+        LogError("Failed creating offline store directory %s", path);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static int replace_file(const char* source, const char* destination)
+{
+    int result;
+#if defined(WIN32)
+    if (MoveFileExA(source, destination, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) == 0)
+#else
+    if (rename(source, destination) != 0)
+#endif
+    {
+        LogError("Failed replacing %s", destination);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static int segment_open_file(OFFLINE_STORE_SEGMENT* segment, bool create)
+{
+    int result;
+#if defined(WIN32)
+    segment->file = CreateFileA(segment->file_path, GENERIC_READ | GENERIC_WRITE, 0, NULL, create ? CREATE_NEW : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (segment->file == INVALID_HANDLE_VALUE)
+    {
+        LogError("Failed opening segment %s", segment->file_path);
+        result = __FAILURE__;
+    }
+    else
+    {
+        LARGE_INTEGER file_size;
+        if (!create && GetFileSizeEx(segment->file, &file_size) != 0)
+        {
+            segment->capacity = (size_t)file_size.QuadPart;
+        }
+
+        if (segment->capacity <= SEGMENT_HEADER_SIZE ||
+            (segment->mapping = CreateFileMappingA(segment->file, NULL, PAGE_READWRITE, 0, (DWORD)segment->capacity, NULL)) == NULL)
+        {
+            LogError("Failed creating file mapping for segment %s", segment->file_path);
+            (void)CloseHandle(segment->file);
+            segment->file = INVALID_HANDLE_VALUE;
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+#else
+    segment->fd = open(segment->file_path, O_RDWR | (create ? (O_CREAT | O_EXCL) : 0), 0600);
+    if (segment->fd < 0)
+    {
+        LogError("Failed opening segment %s (errno=%d)", segment->file_path, errno);
+        result = __FAILURE__;
+    }
+    else
+    {
+        struct stat file_stat;
+        if (create)
+        {
+            if (ftruncate(segment->fd, (off_t)segment->capacity) != 0)
+            {
+                LogError("Failed sizing segment %s (errno=%d)", segment->file_path, errno);
+                (void)close(segment->fd);
+                segment->fd = -1;
+                result = __FAILURE__;
+            }
+            else
+            {
+                result = 0;
+            }
+        }
+        else if (fstat(segment->fd, &file_stat) != 0 || file_stat.st_size <= SEGMENT_HEADER_SIZE)
+        {
+            LogError("Segment %s is too small to be valid", segment->file_path);
+            (void)close(segment->fd);
+            segment->fd = -1;
+            result = __FAILURE__;
+        }
+        else
+        {
+            segment->capacity = (size_t)file_stat.st_size;
+            result = 0;
+        }
+    }
+#endif
+    return result;
+}
+
+static int segment_map(OFFLINE_STORE_SEGMENT* segment)
+{
+    int result;
+    if (segment->data != NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+#if defined(WIN32)
+        segment->data = (unsigned char*)MapViewOfFile(segment->mapping, FILE_MAP_ALL_ACCESS, 0, 0, segment->capacity);
+        if (segment->data == NULL)
+#else
+        void* view = mmap(NULL, segment->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+        segment->data = (view == MAP_FAILED) ? NULL : (unsigned char*)view;
+        if (segment->data == NULL)
+#endif
+        {
+            LogError("Failed mapping segment %s", segment->file_path);
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static int segment_flush(OFFLINE_STORE_SEGMENT* segment, size_t position, size_t size)
+{
+    int result;
+#if defined(WIN32)
+    if (!FlushViewOfFile(segment->data + position, size) || !FlushFileBuffers(segment->file))
+#else
+    /* msync wants a page aligned address */
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t page_start = position - (position % page_size);
+    if (msync(segment->data + page_start, position + size - page_start, MS_SYNC) != 0)
+#endif
+    {
+        LogError("Failed flushing segment %s", segment->file_path);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/* flushes the records appended since the last sync */
+static int segment_sync(OFFLINE_STORE_SEGMENT* segment)
+{
+    int result;
+    if (segment->data == NULL || segment->synced >= segment->used)
+    {
+        result = 0;
+    }
+    else if (segment_flush(segment, segment->synced, segment->used - segment->synced) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        segment->synced = segment->used;
+        result = 0;
+    }
+    return result;
+}
+
+static void segment_unmap(OFFLINE_STORE_SEGMENT* segment)
+{
+    if (segment->data != NULL)
+    {
+#if defined(WIN32)
+        (void)FlushViewOfFile(segment->data, 0);
+        (void)UnmapViewOfFile(segment->data);
+#else
+        (void)msync(segment->data, segment->capacity, MS_ASYNC);
+        (void)munmap(segment->data, segment->capacity);
+#endif
+        segment->data = NULL;
+    }
+}
+
+static void segment_destroy(OFFLINE_STORE_SEGMENT* segment, bool delete_file)
+{
+    segment_unmap(segment);
+#if defined(WIN32)
+    if (segment->mapping != NULL)
+    {
+        (void)CloseHandle(segment->mapping);
+    }
+    if (segment->file != INVALID_HANDLE_VALUE)
+    {
+        (void)CloseHandle(segment->file);
+    }
+#else
+    if (segment->fd >= 0)
+    {
+        (void)close(segment->fd);
+    }
+#endif
+    if (delete_file && remove(segment->file_path) != 0)
+    {
+        LogError("Failed deleting segment %s", segment->file_path);
+    }
+    free(segment->file_path);
+    free(segment);
+}
+
+static OFFLINE_STORE_SEGMENT* segment_create(const char* directory, uint64_t base_offset, size_t capacity)
+{
+    OFFLINE_STORE_SEGMENT* result;
+    char file_name[32];
+
+    (void)snprintf(file_name, sizeof(file_name), "%020llu%s", (unsigned long long)base_offset, SEGMENT_FILE_EXTENSION);
+
+    if ((result = (OFFLINE_STORE_SEGMENT*)malloc(sizeof(OFFLINE_STORE_SEGMENT))) == NULL)
+    {
+        LogError("Failed allocating segment");
+    }
+    else
+    {
+        memset(result, 0, sizeof(OFFLINE_STORE_SEGMENT));
+#if defined(WIN32)
+        result->file = INVALID_HANDLE_VALUE;
+#else
+        result->fd = -1;
+#endif
+        result->base_offset = base_offset;
+        result->capacity = capacity;
+
+        if ((result->file_path = make_path(directory, file_name)) == NULL)
+        {
+            LogError("Failed creating segment path");
+            free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+/* records */
+
+static void writer_put_bytes(RECORD_WRITER* writer, const void* source, size_t size)
+{
+    if (writer->buffer != NULL && size > 0)
+    {
+        (void)memcpy(writer->buffer + writer->position, source, size);
+    }
+    writer->position += size;
+}
+
+static void writer_put_uint32(RECORD_WRITER* writer, uint32_t value)
+{
+    unsigned char encoded[4];
+    encode_uint32(encoded, value);
+    writer_put_bytes(writer, encoded, sizeof(encoded));
+}
+
+static void writer_put_string(RECORD_WRITER* writer, const char* value)
+{
+    if (value == NULL)
+    {
+        writer_put_uint32(writer, NULL_STRING_LENGTH);
+    }
+    else
+    {
+        size_t length = strlen(value);
+        writer_put_uint32(writer, (uint32_t)length);
+        writer_put_bytes(writer, value, length);
+    }
+}
+
+static int serialize_message(IOTHUB_MESSAGE_HANDLE message, RECORD_WRITER* writer)
+{
+    int result;
+    const unsigned char* body;
+    size_t body_size;
+    const char* const* keys;
+    const char* const* values;
+    size_t property_count;
+    IOTHUBMESSAGE_CONTENT_TYPE content_type = IoTHubMessage_GetContentType(message);
+    MAP_HANDLE properties = IoTHubMessage_Properties(message);
+
+    if (content_type == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        result = (IoTHubMessage_GetByteArray(message, &body, &body_size) == IOTHUB_MESSAGE_OK) ? 0 : __FAILURE__;
+    }
+    else if (content_type == IOTHUBMESSAGE_STRING && (body = (const unsigned char*)IoTHubMessage_GetString(message)) != NULL)
+    {
+        body_size = strlen((const char*)body);
+        result = 0;
+    }
+    else
+    {
+        result = __FAILURE__;
+    }
+
+    if (result != 0)
+    {
+        LogError("Failed getting message body");
+    }
+    else if (properties == NULL || Map_GetInternals(properties, &keys, &values, &property_count) != MAP_OK)
+    {
+        LogError("Failed getting message properties");
+        result = __FAILURE__;
+    }
+    else
+    {
+        const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA* diagnostic_data = IoTHubMessage_GetDiagnosticPropertyData(message);
+        size_t index;
+        unsigned char header[2];
+
+        header[0] = MESSAGE_FORMAT_VERSION;
+        header[1] = (unsigned char)content_type;
+        writer_put_bytes(writer, header, sizeof(header));
+        writer_put_string(writer, IoTHubMessage_GetMessageId(message));
+        writer_put_string(writer, IoTHubMessage_GetCorrelationId(message));
+        writer_put_string(writer, IoTHubMessage_GetContentTypeSystemProperty(message));
+        writer_put_string(writer, IoTHubMessage_GetContentEncodingSystemProperty(message));
+        writer_put_string(writer, diagnostic_data == NULL ? NULL : diagnostic_data->diagnosticId);
+        writer_put_string(writer, diagnostic_data == NULL ? NULL : diagnostic_data->diagnosticCreationTimeUtc);
+        writer_put_uint32(writer, (uint32_t)property_count);
+        for (index = 0; index < property_count; index++)
+        {
+            writer_put_string(writer, keys[index]);
+            writer_put_string(writer, values[index]);
+        }
+        writer_put_uint32(writer, (uint32_t)body_size);
+        writer_put_bytes(writer, body, body_size);
+    }
+    return result;
+}
+
+static int reader_get_uint32(RECORD_READER* reader, uint32_t* value)
+{
+    int result;
+    if (reader->size - reader->position < 4)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        *value = decode_uint32(reader->buffer + reader->position);
+        reader->position += 4;
+        result = 0;
+    }
+    return result;
+}
+
+/* returns a NULL terminated copy of the next string, *value is NULL when the string was not set */
+static int reader_get_string(RECORD_READER* reader, char** value)
+{
+    int result;
+    uint32_t length;
+    if (reader_get_uint32(reader, &length) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else if (length == NULL_STRING_LENGTH)
+    {
+        *value = NULL;
+        result = 0;
+    }
+    else if (reader->size - reader->position < length)
+    {
+        result = __FAILURE__;
+    }
+    else if ((*value = (char*)malloc((size_t)length + 1)) == NULL)
+    {
+        LogError("Failed allocating string");
+        result = __FAILURE__;
+    }
+    else
+    {
+        (void)memcpy(*value, reader->buffer + reader->position, length);
+        (*value)[length] = '\0';
+        reader->position += length;
+        result = 0;
+    }
+    return result;
+}
+
+static int set_message_string(IOTHUB_MESSAGE_HANDLE message, RECORD_READER* reader, IOTHUB_MESSAGE_RESULT(*setter)(IOTHUB_MESSAGE_HANDLE, const char*))
+{
+    int result;
+    char* value;
+    if (reader_get_string(reader, &value) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = (value == NULL || setter(message, value) == IOTHUB_MESSAGE_OK) ? 0 : __FAILURE__;
+        free(value);
+    }
+    return result;
+}
+
+static int set_message_diagnostic_data(IOTHUB_MESSAGE_HANDLE message, RECORD_READER* reader)
+{
+    int result;
+    IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA diagnostic_data;
+    diagnostic_data.diagnosticId = NULL;
+    diagnostic_data.diagnosticCreationTimeUtc = NULL;
+
+    if (reader_get_string(reader, &diagnostic_data.diagnosticId) != 0 ||
+        reader_get_string(reader, &diagnostic_data.diagnosticCreationTimeUtc) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else if (diagnostic_data.diagnosticId != NULL && diagnostic_data.diagnosticCreationTimeUtc != NULL &&
+        IoTHubMessage_SetDiagnosticPropertyData(message, &diagnostic_data) != IOTHUB_MESSAGE_OK)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    free(diagnostic_data.diagnosticId);
+    free(diagnostic_data.diagnosticCreationTimeUtc);
+    return result;
+}
+
+static int set_message_properties(IOTHUB_MESSAGE_HANDLE message, RECORD_READER* reader, uint32_t property_count)
+{
+    int result = 0;
+    MAP_HANDLE properties = IoTHubMessage_Properties(message);
+    uint32_t index;
+
+    for (index = 0; index < property_count && result == 0; index++)
+    {
+        char* key = NULL;
+        char* value = NULL;
+        if (properties == NULL ||
+            reader_get_string(reader, &key) != 0 ||
+            reader_get_string(reader, &value) != 0 ||
+            key == NULL || value == NULL ||
+            Map_AddOrUpdate(properties, key, value) != MAP_OK)
+        {
+            result = __FAILURE__;
+        }
+        free(key);
+        free(value);
+    }
+    return result;
+}
+
+/* the offsets of each field are not known until the body is reached, so the record is read in two passes */
+static IOTHUB_MESSAGE_HANDLE deserialize_message(const unsigned char* buffer, size_t size)
+{
+    IOTHUB_MESSAGE_HANDLE result = NULL;
+    RECORD_READER reader;
+    uint32_t property_count;
+    uint32_t body_size;
+    uint32_t index;
+
+    reader.buffer = buffer;
+    reader.size = size;
+    reader.position = 2;
+
+    /* first pass: skip the six system property strings and the application properties to find the body */
+    for (index = 0; index < 6; index++)
+    {
+        uint32_t length;
+        if (reader_get_uint32(&reader, &length) != 0 || (length != NULL_STRING_LENGTH && reader.size - reader.position < length))
+        {
+            break;
+        }
+        reader.position += (length == NULL_STRING_LENGTH) ? 0 : length;
+    }
+
+    if (size < 2 || buffer[0] != MESSAGE_FORMAT_VERSION || index != 6 || reader_get_uint32(&reader, &property_count) != 0)
+    {
+        LogError("Invalid offline store record");
+    }
+    else
+    {
+        for (index = 0; index < property_count * 2; index++)
+        {
+            uint32_t length;
+            if (reader_get_uint32(&reader, &length) != 0 || length == NULL_STRING_LENGTH || reader.size - reader.position < length)
+            {
+                break;
+            }
+            reader.position += length;
+        }
+
+        if (index != property_count * 2 || reader_get_uint32(&reader, &body_size) != 0 || reader.size - reader.position != body_size)
+        {
+            LogError("Invalid offline store record");
+        }
+        else
+        {
+            const unsigned char* body = reader.buffer + reader.position;
+            if (buffer[1] == IOTHUBMESSAGE_BYTEARRAY)
+            {
+                result = IoTHubMessage_CreateFromByteArray(body, body_size);
+            }
+            else
+            {
+                char* text = (char*)malloc((size_t)body_size + 1);
+                if (text != NULL)
+                {
+                    (void)memcpy(text, body, body_size);
+                    text[body_size] = '\0';
+                    result = IoTHubMessage_CreateFromString(text);
+                    free(text);
+                }
+            }
+
+            if (result == NULL)
+            {
+                LogError("Failed creating message from offline store record");
+            }
+            else
+            {
+                /* second pass: apply the properties */
+                reader.position = 2;
+                if (set_message_string(result, &reader, IoTHubMessage_SetMessageId) != 0 ||
+                    set_message_string(result, &reader, IoTHubMessage_SetCorrelationId) != 0 ||
+                    set_message_string(result, &reader, IoTHubMessage_SetContentTypeSystemProperty) != 0 ||
+                    set_message_string(result, &reader, IoTHubMessage_SetContentEncodingSystemProperty) != 0 ||
+                    set_message_diagnostic_data(result, &reader) != 0 ||
+                    reader_get_uint32(&reader, &property_count) != 0 ||
+                    set_message_properties(result, &reader, property_count) != 0)
+                {
+                    LogError("Failed restoring message properties from offline store record");
+                    IoTHubMessage_Destroy(result);
+                    result = NULL;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/* checkpoint */
+
+static int write_checkpoint(OFFLINE_STORE_INSTANCE* store)
+{
+    int result;
+    char* checkpoint_path = make_path(store->directory, CHECKPOINT_FILE_NAME);
+    char* tmp_path = make_path(store->directory, CHECKPOINT_TMP_FILE_NAME);
+
+    if (checkpoint_path == NULL || tmp_path == NULL)
+    {
+        LogError("Failed creating checkpoint paths");
+        result = __FAILURE__;
+    }
+    else
+    {
+        unsigned char content[CHECKPOINT_FILE_SIZE];
+        FILE* file;
+
+        encode_uint64(content, store->checkpoint);
+        encode_uint32(content + 8, compute_crc32(content, 8));
+
+        /* write-then-rename, so a crash leaves either the old or the new checkpoint, never a torn one */
+        if ((file = fopen(tmp_path, "wb")) == NULL)
+        {
+            LogError("Failed opening %s", tmp_path);
+            result = __FAILURE__;
+        }
+        else
+        {
+            size_t written = fwrite(content, 1, sizeof(content), file);
+            if (fflush(file) != 0 || written != sizeof(content))
+            {
+                LogError("Failed writing %s", tmp_path);
+                (void)fclose(file);
+                result = __FAILURE__;
+            }
+            else
+            {
+#if !defined(WIN32)
+                (void)fsync(fileno(file));
+#endif
+                (void)fclose(file);
+                result = replace_file(tmp_path, checkpoint_path);
+            }
+        }
+    }
+
+    free(checkpoint_path);
+    free(tmp_path);
+    return result;
+}
+
+static uint64_t read_checkpoint(const char* directory)
+{
+    uint64_t result = 0;
+    char* checkpoint_path = make_path(directory, CHECKPOINT_FILE_NAME);
+    if (checkpoint_path != NULL)
+    {
+        FILE* file = fopen(checkpoint_path, "rb");
+        if (file != NULL)
+        {
+            unsigned char content[CHECKPOINT_FILE_SIZE];
+            if (fread(content, 1, sizeof(content), file) != sizeof(content) ||
+                decode_uint32(content + 8) != compute_crc32(content, 8))
+            {
+                LogError("Offline store checkpoint is corrupt, replaying all stored messages");
+            }
+            else
+            {
+                result = decode_uint64(content);
+            }
+            (void)fclose(file);
+        }
+        free(checkpoint_path);
+    }
+    return result;
+}
+
+/* segment bookkeeping */
+
+static OFFLINE_STORE_SEGMENT* get_oldest_segment(OFFLINE_STORE_INSTANCE* store)
+{
+    return (store->segments.Flink == &store->segments) ? NULL : containingRecord(store->segments.Flink, OFFLINE_STORE_SEGMENT, entry);
+}
+
+static OFFLINE_STORE_SEGMENT* get_write_segment(OFFLINE_STORE_INSTANCE* store)
+{
+    return (store->segments.Blink == &store->segments) ? NULL : containingRecord(store->segments.Blink, OFFLINE_STORE_SEGMENT, entry);
+}
+
+static OFFLINE_STORE_SEGMENT* get_next_segment(OFFLINE_STORE_INSTANCE* store, OFFLINE_STORE_SEGMENT* segment)
+{
+    return (segment->entry.Flink == &store->segments) ? NULL : containingRecord(segment->entry.Flink, OFFLINE_STORE_SEGMENT, entry);
+}
+
+/* only the read and the write segments are kept mapped */
+static void release_segment_view(OFFLINE_STORE_INSTANCE* store, OFFLINE_STORE_SEGMENT* segment)
+{
+    if (segment != store->read_segment && segment != get_write_segment(store))
+    {
+        if (segment_sync(segment) != 0)
+        {
+            /* the kernel still writes the pages back, only the crash guarantee is lost */
+            LogError("Offline store segment %s is not yet durable", segment->file_path);
+        }
+        segment_unmap(segment);
+    }
+}
+
+static void remove_segment(OFFLINE_STORE_INSTANCE* store, OFFLINE_STORE_SEGMENT* segment)
+{
+    (void)DList_RemoveEntryList(&segment->entry);
+    store->segment_count--;
+    segment_destroy(segment, true);
+}
+
+/* deletes the segments whose records are all behind the checkpoint */
+static void collect_segments(OFFLINE_STORE_INSTANCE* store)
+{
+    OFFLINE_STORE_SEGMENT* oldest;
+    while ((oldest = get_oldest_segment(store)) != NULL &&
+        oldest != get_write_segment(store) &&
+        oldest != store->read_segment &&
+        oldest->base_offset + oldest->used <= store->checkpoint)
+    {
+        remove_segment(store, oldest);
+    }
+}
+
+static size_t count_records(const OFFLINE_STORE_SEGMENT* segment, size_t position)
+{
+    size_t result = 0;
+    while (position + RECORD_HEADER_SIZE <= segment->used)
+    {
+        position += RECORD_HEADER_SIZE + decode_uint32(segment->data + position);
+        result++;
+    }
+    return result;
+}
+
+static int drop_oldest_segment(OFFLINE_STORE_INSTANCE* store)
+{
+    int result;
+    OFFLINE_STORE_SEGMENT* oldest = get_oldest_segment(store);
+    OFFLINE_STORE_SEGMENT* next = (oldest == NULL) ? NULL : get_next_segment(store, oldest);
+
+    if (next == NULL)
+    {
+        LogError("Cannot drop the segment being written");
+        result = __FAILURE__;
+    }
+    else if (oldest == store->read_segment && segment_map(oldest) != 0)
+    {
+        LogError("Failed mapping the oldest segment");
+        result = __FAILURE__;
+    }
+    else
+    {
+        PDLIST_ENTRY pending;
+        size_t dropped;
+
+        if (oldest == store->read_segment)
+        {
+            dropped = count_records(oldest, store->read_position);
+            store->read_segment = next;
+            store->read_position = SEGMENT_HEADER_SIZE;
+        }
+        else
+        {
+            /* the read cursor is already past this segment, only in-flight records remain and those live in RAM */
+            dropped = 0;
+        }
+        store->unread_count -= dropped;
+        LogError("Offline store is full, dropping %lu unsent message(s)", (unsigned long)dropped);
+
+        while ((pending = store->pending_callbacks.Flink) != &store->pending_callbacks &&
+            containingRecord(pending, PENDING_CALLBACK, entry)->offset < next->base_offset)
+        {
+            PENDING_CALLBACK* pending_callback = containingRecord(pending, PENDING_CALLBACK, entry);
+            (void)DList_RemoveEntryList(pending);
+            pending_callback->callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, pending_callback->context);
+            free(pending_callback);
+        }
+
+        if (store->checkpoint < next->base_offset)
+        {
+            store->checkpoint = next->base_offset;
+            /* written right away: the dropped segment file is deleted below */
+            if (write_checkpoint(store) != 0)
+            {
+                LogError("Failed persisting offline store checkpoint");
+                store->is_checkpoint_dirty = true;
+            }
+            else
+            {
+                store->is_checkpoint_dirty = false;
+            }
+        }
+
+        remove_segment(store, oldest);
+        result = 0;
+    }
+    return result;
+}
+
+static OFFLINE_STORE_SEGMENT* get_segment_for_append(OFFLINE_STORE_INSTANCE* store, size_t record_size)
+{
+    OFFLINE_STORE_SEGMENT* result = get_write_segment(store);
+
+    if (result == NULL || result->capacity - result->used < record_size)
+    {
+        OFFLINE_STORE_SEGMENT* previous = result;
+
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_025: [ If the store already holds its maximum number of segments and drop_oldest is true, IoTHubClient_OfflineStore_Push shall delete the oldest segment, invoke the callback of each of its unread messages with IOTHUB_CLIENT_CONFIRMATION_ERROR and move the checkpoint past it. ]*/
+        while (store->drop_oldest && store->segment_count >= store->max_segments)
+        {
+            if (drop_oldest_segment(store) != 0)
+            {
+                break;
+            }
+        }
+
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_024: [ If the store already holds its maximum number of segments and drop_oldest is false, IoTHubClient_OfflineStore_Push shall fail and return a non-zero value. ]*/
+        if (store->segment_count >= store->max_segments)
+        {
+            LogError("Offline store is full, rejecting message");
+            result = NULL;
+        }
+        else if ((result = segment_create(store->directory, store->next_segment_base, store->segment_size)) == NULL)
+        {
+            LogError("Failed creating segment");
+        }
+        else if (segment_open_file(result, true) != 0)
+        {
+            LogError("Failed creating segment file");
+            segment_destroy(result, false);
+            result = NULL;
+        }
+        else if (segment_map(result) != 0)
+        {
+            LogError("Failed mapping new segment");
+            segment_destroy(result, true);
+            result = NULL;
+        }
+        else
+        {
+            (void)memcpy(result->data, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+            encode_uint32(result->data + 8, SEGMENT_FORMAT_VERSION);
+            encode_uint32(result->data + 12, (uint32_t)result->capacity);
+            result->used = SEGMENT_HEADER_SIZE;
+
+            DList_InsertTailList(&store->segments, &result->entry);
+            store->segment_count++;
+            store->next_segment_base = result->base_offset + result->capacity;
+
+            if (store->read_segment == NULL)
+            {
+                store->read_segment = result;
+                store->read_position = SEGMENT_HEADER_SIZE;
+            }
+
+            if (previous != NULL)
+            {
+                release_segment_view(store, previous);
+            }
+        }
+    }
+    return result;
+}
+
+/* recovery */
+
+static int compare_offsets(const void* left, const void* right)
+{
+    uint64_t a = *(const uint64_t*)left;
+    uint64_t b = *(const uint64_t*)right;
+    return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+static int parse_segment_file_name(const char* file_name, uint64_t* base_offset)
+{
+    int result;
+    size_t length = strlen(file_name);
+    size_t extension_length = sizeof(SEGMENT_FILE_EXTENSION) - 1;
+    char* end;
+
+    if (length <= extension_length || strcmp(file_name + length - extension_length, SEGMENT_FILE_EXTENSION) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        *base_offset = (uint64_t)strtoull(file_name, &end, 10);
+        result = (end == file_name + length - extension_length) ? 0 : __FAILURE__;
+    }
+    return result;
+}
+
+static int add_segment_base(uint64_t** bases, size_t* count, size_t* allocated, uint64_t base_offset)
+{
+    int result;
+    if (*count == *allocated)
+    {
+        size_t new_allocated = (*allocated == 0) ? 8 : (*allocated * 2);
+        uint64_t* resized = (uint64_t*)realloc(*bases, new_allocated * sizeof(uint64_t));
+        if (resized == NULL)
+        {
+            LogError("Failed growing segment list");
+            result = __FAILURE__;
+        }
+        else
+        {
+            *bases = resized;
+            *allocated = new_allocated;
+            result = 0;
+        }
+    }
+    else
+    {
+        result = 0;
+    }
+
+    if (result == 0)
+    {
+        (*bases)[(*count)++] = base_offset;
+    }
+    return result;
+}
+
+static int list_segment_files(const char* directory, uint64_t** bases, size_t* count)
+{
+    int result = 0;
+    size_t allocated = 0;
+    uint64_t base_offset;
+
+    *bases = NULL;
+    *count = 0;
+
+#if defined(WIN32)
+    {
+        WIN32_FIND_DATAA find_data;
+        HANDLE find_handle;
+        char* pattern = make_path(directory, "*.seg");
+        if (pattern == NULL)
+        {
+            result = __FAILURE__;
+        }
+        else
+        {
+            if ((find_handle = FindFirstFileA(pattern, &find_data)) != INVALID_HANDLE_VALUE)
+            {
+                do
+                {
+                    if (parse_segment_file_name(find_data.cFileName, &base_offset) == 0)
+                    {
+                        result = add_segment_base(bases, count, &allocated, base_offset);
+                    }
+                } while (result == 0 && FindNextFileA(find_handle, &find_data) != 0);
+                (void)FindClose(find_handle);
+            }
+            free(pattern);
+        }
+    }
+#else
+    {
+        DIR* dir = opendir(directory);
+        if (dir == NULL)
+        {
+            LogError("Failed opening offline store directory %s", directory);
+            result = __FAILURE__;
+        }
+        else
+        {
+            struct dirent* dir_entry;
+            while (result == 0 && (dir_entry = readdir(dir)) != NULL)
+            {
+                if (parse_segment_file_name(dir_entry->d_name, &base_offset) == 0)
+                {
+                    result = add_segment_base(bases, count, &allocated, base_offset);
+                }
+            }
+            (void)closedir(dir);
+        }
+    }
+#endif
+
+    if (result != 0)
+    {
+        free(*bases);
+        *bases = NULL;
+        *count = 0;
+    }
+    else if (*count > 1)
+    {
+        qsort(*bases, *count, sizeof(uint64_t), compare_offsets);
+    }
+    return result;
+}
+
+/* finds the end of the valid records of a segment left by a previous instance; a torn or corrupt tail is discarded */
+static void scan_segment(OFFLINE_STORE_INSTANCE* store, OFFLINE_STORE_SEGMENT* segment)
+{
+    size_t position = SEGMENT_HEADER_SIZE;
+    while (segment->capacity - position >= RECORD_HEADER_SIZE)
+    {
+        uint32_t length = decode_uint32(segment->data + position);
+        if (length == 0 ||
+            length > segment->capacity - position - RECORD_HEADER_SIZE ||
+            decode_uint32(segment->data + position + 4) != compute_crc32(segment->data + position + RECORD_HEADER_SIZE, length))
+        {
+            break;
+        }
+
+        if (segment->base_offset + position >= store->checkpoint)
+        {
+            store->unread_count++;
+        }
+        position += RECORD_HEADER_SIZE + length;
+    }
+
+    segment->used = position;
+    segment->synced = position;
+    if (position < segment->capacity)
+    {
+        /* clear a possibly torn record so that appends continue on a clean tail */
+        memset(segment->data + position, 0, (segment->capacity - position < RECORD_HEADER_SIZE) ? segment->capacity - position : RECORD_HEADER_SIZE);
+    }
+}
+
+static int recover_segments(OFFLINE_STORE_INSTANCE* store)
+{
+    int result;
+    uint64_t* bases;
+    size_t count;
+
+    if (list_segment_files(store->directory, &bases, &count) != 0)
+    {
+        LogError("Failed listing offline store segments");
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t index;
+        result = 0;
+
+        for (index = 0; index < count && result == 0; index++)
+        {
+            OFFLINE_STORE_SEGMENT* segment = segment_create(store->directory, bases[index], 0);
+            if (segment == NULL)
+            {
+                result = __FAILURE__;
+            }
+            else if (segment_open_file(segment, false) != 0 || segment_map(segment) != 0 ||
+                memcmp(segment->data, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 ||
+                decode_uint32(segment->data + 8) != SEGMENT_FORMAT_VERSION)
+            {
+                LogError("Discarding invalid offline store segment %s", segment->file_path);
+                segment_destroy(segment, true);
+            }
+            else
+            {
+                scan_segment(store, segment);
+                segment_unmap(segment);
+                DList_InsertTailList(&store->segments, &segment->entry);
+                store->segment_count++;
+                store->next_segment_base = segment->base_offset + segment->capacity;
+            }
+        }
+        free(bases);
+
+        if (result == 0)
+        {
+            PDLIST_ENTRY entry;
+            OFFLINE_STORE_SEGMENT* write_segment = get_write_segment(store);
+
+            if (write_segment == NULL)
+            {
+                store->next_segment_base = store->checkpoint;
+            }
+            else if (segment_map(write_segment) != 0)
+            {
+                result = __FAILURE__;
+            }
+
+            /* place the read cursor on the first record after the checkpoint */
+            store->read_segment = write_segment;
+            store->read_position = (write_segment == NULL) ? 0 : write_segment->used;
+            for (entry = store->segments.Flink; entry != &store->segments; entry = entry->Flink)
+            {
+                OFFLINE_STORE_SEGMENT* segment = containingRecord(entry, OFFLINE_STORE_SEGMENT, entry);
+                if (segment->base_offset + segment->used > store->checkpoint)
+                {
+                    store->read_segment = segment;
+                    store->read_position = (store->checkpoint > segment->base_offset + SEGMENT_HEADER_SIZE) ? (size_t)(store->checkpoint - segment->base_offset) : SEGMENT_HEADER_SIZE;
+                    break;
+                }
+            }
+
+            collect_segments(store);
+        }
+    }
+    return result;
+}
+
+static void destroy_store(OFFLINE_STORE_INSTANCE* store, IOTHUB_CLIENT_CONFIRMATION_RESULT pending_result)
+{
+    PDLIST_ENTRY entry;
+
+    while ((entry = DList_RemoveHeadList(&store->pending_callbacks)) != &store->pending_callbacks)
+    {
+        PENDING_CALLBACK* pending_callback = containingRecord(entry, PENDING_CALLBACK, entry);
+        pending_callback->callback(pending_result, pending_callback->context);
+        free(pending_callback);
+    }
+
+    while ((entry = DList_RemoveHeadList(&store->in_flight)) != &store->in_flight)
+    {
+        free(containingRecord(entry, IN_FLIGHT_RECORD, entry));
+    }
+
+    while ((entry = DList_RemoveHeadList(&store->segments)) != &store->segments)
+    {
+        segment_destroy(containingRecord(entry, OFFLINE_STORE_SEGMENT, entry), false);
+    }
+
+    free(store->directory);
+    free(store);
+}
+
+OFFLINE_STORE_HANDLE IoTHubClient_OfflineStore_Create(const OFFLINE_STORE_CONFIG* config)
+{
+    OFFLINE_STORE_INSTANCE* result;
+
+    /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_001: [ If config or config->directory is NULL, or config->segment_size cannot hold a segment header and one record header, IoTHubClient_OfflineStore_Create shall fail and return NULL. ]*/
+    if (config == NULL || config->directory == NULL || config->segment_size <= SEGMENT_HEADER_SIZE + RECORD_HEADER_SIZE || config->segment_size > UINT32_MAX)
+    {
+        LogError("Invalid argument (config=%p)", config);
+        result = NULL;
+    }
+    else if ((result = (OFFLINE_STORE_INSTANCE*)malloc(sizeof(OFFLINE_STORE_INSTANCE))) == NULL)
+    {
+        LogError("Failed allocating offline store");
+    }
+    else
+    {
+        memset(result, 0, sizeof(OFFLINE_STORE_INSTANCE));
+        DList_InitializeListHead(&result->segments);
+        DList_InitializeListHead(&result->pending_callbacks);
+        DList_InitializeListHead(&result->in_flight);
+        result->segment_size = config->segment_size;
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_003: [ The store shall use at most config->max_size / config->segment_size segments, and never less than 2. ]*/
+        result->max_segments = config->max_size / config->segment_size;
+        if (result->max_segments < MIN_SEGMENT_COUNT)
+        {
+            result->max_segments = MIN_SEGMENT_COUNT;
+        }
+        result->drop_oldest = config->drop_oldest;
+
+        if (mallocAndStrcpy_s(&result->directory, config->directory) != 0)
+        {
+            LogError("Failed copying offline store directory");
+            free(result);
+            result = NULL;
+        }
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_002: [ IoTHubClient_OfflineStore_Create shall create config->directory if it does not exist. ]*/
+        else if (make_directory(result->directory) != 0)
+        {
+            LogError("Failed creating offline store directory");
+            destroy_store(result, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_004: [ IoTHubClient_OfflineStore_Create shall read the checkpoint and the segment files left in the directory by a previous instance, discarding segments with an invalid header and truncating each segment at its first record with an invalid length or crc. ]*/
+            result->checkpoint = read_checkpoint(result->directory);
+            if (recover_segments(result) != 0)
+            {
+                LogError("Failed recovering offline store");
+                destroy_store(result, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
+                result = NULL;
+            }
+            else if (result->unread_count > 0)
+            {
+                LogInfo("Offline store recovered %lu unsent message(s)", (unsigned long)result->unread_count);
+            }
+        }
+    }
+    return result;
+}
+
+void IoTHubClient_OfflineStore_Destroy(OFFLINE_STORE_HANDLE handle)
+{
+    /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_010: [ If handle is NULL, IoTHubClient_OfflineStore_Destroy shall do nothing. ]*/
+    if (handle != NULL)
+    {
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_011: [ IoTHubClient_OfflineStore_Destroy shall invoke the callback of each message pushed but not yet popped with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY. ]*/
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_013: [ IoTHubClient_OfflineStore_Destroy shall flush the records and persist the checkpoint as IoTHubClient_OfflineStore_Flush does before closing the store. ]*/
+        if (IoTHubClient_OfflineStore_Flush(handle) != 0)
+        {
+            LogError("Failed flushing offline store, unacknowledged messages may be replayed");
+        }
+
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_012: [ IoTHubClient_OfflineStore_Destroy shall unmap and close the segment files without deleting them. ]*/
+        destroy_store(handle, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
+    }
+}
+
+int IoTHubClient_OfflineStore_Push(OFFLINE_STORE_HANDLE handle, IOTHUB_MESSAGE_HANDLE message, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback, void* context)
+{
+    int result;
+    RECORD_WRITER sizer;
+
+    sizer.buffer = NULL;
+    sizer.position = 0;
+
+    /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_020: [ If handle or message is NULL, IoTHubClient_OfflineStore_Push shall fail and return a non-zero value. ]*/
+    if (handle == NULL || message == NULL)
+    {
+        LogError("Invalid argument (handle=%p, message=%p)", handle, message);
+        result = __FAILURE__;
+    }
+    else if (serialize_message(message, &sizer) != 0)
+    {
+        LogError("Failed serializing message");
+        result = __FAILURE__;
+    }
+    /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_022: [ If the serialized message does not fit in an empty segment, IoTHubClient_OfflineStore_Push shall fail and return a non-zero value. ]*/
+    else if (sizer.position > handle->segment_size - SEGMENT_HEADER_SIZE - RECORD_HEADER_SIZE)
+    {
+        LogError("Message of %lu bytes does not fit in an offline store segment", (unsigned long)sizer.position);
+        result = __FAILURE__;
+    }
+    else
+    {
+        PENDING_CALLBACK* pending_callback = NULL;
+        OFFLINE_STORE_SEGMENT* segment;
+
+        if (callback != NULL && (pending_callback = (PENDING_CALLBACK*)malloc(sizeof(PENDING_CALLBACK))) == NULL)
+        {
+            LogError("Failed allocating pending callback");
+            result = __FAILURE__;
+        }
+        else if ((segment = get_segment_for_append(handle, RECORD_HEADER_SIZE + sizer.position)) == NULL ||
+            segment_map(segment) != 0)
+        {
+            LogError("No room in the offline store");
+            free(pending_callback);
+            result = __FAILURE__;
+        }
+        else
+        {
+            RECORD_WRITER writer;
+            unsigned char* record = segment->data + segment->used;
+
+            writer.buffer = record + RECORD_HEADER_SIZE;
+            writer.position = 0;
+            (void)serialize_message(message, &writer);
+
+            /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_026: [ IoTHubClient_OfflineStore_Push shall write the record length after the payload and crc, so that a record torn by a crash is never considered valid. ]*/
+            encode_uint32(record + 4, compute_crc32(writer.buffer, writer.position));
+            encode_uint32(record, (uint32_t)writer.position);
+
+            /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_028: [ IoTHubClient_OfflineStore_Push shall only write the record to the mapped segment and leave flushing it to disk to IoTHubClient_OfflineStore_Flush. ]*/
+            if (pending_callback != NULL)
+            {
+                pending_callback->offset = segment->base_offset + segment->used;
+                pending_callback->callback = callback;
+                pending_callback->context = context;
+                DList_InsertTailList(&handle->pending_callbacks, &pending_callback->entry);
+            }
+
+            segment->used += RECORD_HEADER_SIZE + writer.position;
+            handle->unread_count++;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int IoTHubClient_OfflineStore_Pop(OFFLINE_STORE_HANDLE handle, IOTHUB_MESSAGE_HANDLE* message, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK* callback, void** context, uint64_t* offset)
+{
+    int result;
+
+    /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_030: [ If any argument is NULL, IoTHubClient_OfflineStore_Pop shall fail and return a non-zero value. ]*/
+    if (handle == NULL || message == NULL || callback == NULL || context == NULL || offset == NULL)
+    {
+        LogError("Invalid argument (handle=%p, message=%p, callback=%p, context=%p, offset=%p)", handle, message, callback, context, offset);
+        result = __FAILURE__;
+    }
+    else
+    {
+        OFFLINE_STORE_SEGMENT* segment = handle->read_segment;
+
+        /* move past fully read segments */
+        while (segment != NULL && handle->read_position >= segment->used && segment != get_write_segment(handle))
+        {
+            OFFLINE_STORE_SEGMENT* next = get_next_segment(handle, segment);
+            handle->read_segment = next;
+            handle->read_position = SEGMENT_HEADER_SIZE;
+            release_segment_view(handle, segment);
+            segment = next;
+        }
+
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_031: [ If there are no unread messages, IoTHubClient_OfflineStore_Pop shall fail and return a non-zero value. ]*/
+        if (segment == NULL || handle->read_position >= segment->used || handle->unread_count == 0)
+        {
+            result = __FAILURE__;
+        }
+        else if (segment_map(segment) != 0)
+        {
+            LogError("Failed mapping offline store segment");
+            result = __FAILURE__;
+        }
+        else
+        {
+            IN_FLIGHT_RECORD* in_flight;
+            const unsigned char* record = segment->data + handle->read_position;
+            uint32_t length = decode_uint32(record);
+            uint64_t record_offset = segment->base_offset + handle->read_position;
+
+            /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_034: [ If allocating memory fails, IoTHubClient_OfflineStore_Pop shall leave the record unread and return a non-zero value. ]*/
+            if ((in_flight = (IN_FLIGHT_RECORD*)malloc(sizeof(IN_FLIGHT_RECORD))) == NULL)
+            {
+                LogError("Failed allocating in-flight record");
+                result = __FAILURE__;
+            }
+            else
+            {
+                PDLIST_ENTRY pending = handle->pending_callbacks.Flink;
+                PENDING_CALLBACK* pending_callback = NULL;
+
+                handle->read_position += RECORD_HEADER_SIZE + length;
+                handle->unread_count--;
+
+                if (pending != &handle->pending_callbacks && containingRecord(pending, PENDING_CALLBACK, entry)->offset == record_offset)
+                {
+                    pending_callback = containingRecord(pending, PENDING_CALLBACK, entry);
+                    (void)DList_RemoveEntryList(pending);
+                }
+
+                if ((*message = deserialize_message(record + RECORD_HEADER_SIZE, length)) == NULL)
+                {
+                    /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_033: [ If the record cannot be turned back into a message, IoTHubClient_OfflineStore_Pop shall skip it, invoke its callback with IOTHUB_CLIENT_CONFIRMATION_ERROR and return a non-zero value. ]*/
+                    LogError("Failed reading message at offset %llu, skipping it", (unsigned long long)record_offset);
+                    free(in_flight);
+                    if (pending_callback != NULL)
+                    {
+                        pending_callback->callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, pending_callback->context);
+                    }
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    in_flight->offset = record_offset;
+                    in_flight->end_offset = segment->base_offset + handle->read_position;
+                    in_flight->completed = false;
+                    DList_InsertTailList(&handle->in_flight, &in_flight->entry);
+
+                    *callback = (pending_callback != NULL) ? pending_callback->callback : NULL;
+                    *context = (pending_callback != NULL) ? pending_callback->context : NULL;
+                    *offset = record_offset;
+                    result = 0;
+                }
+
+                free(pending_callback);
+            }
+        }
+    }
+    return result;
+}
+
+int IoTHubClient_OfflineStore_Complete(OFFLINE_STORE_HANDLE handle, uint64_t offset)
+{
+    int result;
+
+    if (handle == NULL)
+    {
+        LogError("Invalid argument (handle=NULL)");
+        result = __FAILURE__;
+    }
+    else
+    {
+        PDLIST_ENTRY entry;
+        uint64_t checkpoint = handle->checkpoint;
+
+        for (entry = handle->in_flight.Flink; entry != &handle->in_flight; entry = entry->Flink)
+        {
+            IN_FLIGHT_RECORD* in_flight = containingRecord(entry, IN_FLIGHT_RECORD, entry);
+            if (in_flight->offset == offset)
+            {
+                in_flight->completed = true;
+                break;
+            }
+        }
+
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_040: [ If handle is NULL or offset was not returned by IoTHubClient_OfflineStore_Pop, IoTHubClient_OfflineStore_Complete shall fail and return a non-zero value. ]*/
+        if (entry == &handle->in_flight)
+        {
+            LogError("Offset %llu is not in flight", (unsigned long long)offset);
+            result = __FAILURE__;
+        }
+        else
+        {
+            while ((entry = handle->in_flight.Flink) != &handle->in_flight && containingRecord(entry, IN_FLIGHT_RECORD, entry)->completed)
+            {
+                IN_FLIGHT_RECORD* in_flight = containingRecord(entry, IN_FLIGHT_RECORD, entry);
+                if (in_flight->end_offset > checkpoint)
+                {
+                    checkpoint = in_flight->end_offset;
+                }
+                (void)DList_RemoveEntryList(entry);
+                free(in_flight);
+            }
+
+            /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_041: [ IoTHubClient_OfflineStore_Complete shall advance the checkpoint past every contiguous completed message starting from the oldest popped message. ]*/
+            /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_042: [ IoTHubClient_OfflineStore_Complete shall not write to disk, it shall only mark the checkpoint to be persisted by the next IoTHubClient_OfflineStore_Flush. ]*/
+            if (checkpoint != handle->checkpoint)
+            {
+                handle->checkpoint = checkpoint;
+                handle->is_checkpoint_dirty = true;
+            }
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int IoTHubClient_OfflineStore_Flush(OFFLINE_STORE_HANDLE handle)
+{
+    int result;
+
+    /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_060: [ If handle is NULL, IoTHubClient_OfflineStore_Flush shall fail and return a non-zero value. ]*/
+    if (handle == NULL)
+    {
+        LogError("Invalid argument (handle=NULL)");
+        result = __FAILURE__;
+    }
+    else
+    {
+        PDLIST_ENTRY entry;
+        result = 0;
+
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_061: [ IoTHubClient_OfflineStore_Flush shall flush to disk every record written since the previous flush. ]*/
+        for (entry = handle->segments.Flink; entry != &handle->segments; entry = entry->Flink)
+        {
+            if (segment_sync(containingRecord(entry, OFFLINE_STORE_SEGMENT, entry)) != 0)
+            {
+                result = __FAILURE__;
+            }
+        }
+
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_062: [ If the checkpoint moved since it was last persisted, IoTHubClient_OfflineStore_Flush shall persist it. ]*/
+        /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_063: [ Once the checkpoint is persisted, IoTHubClient_OfflineStore_Flush shall delete the segment files that are entirely behind it, except the ones being read from or written to. ]*/
+        if (handle->is_checkpoint_dirty)
+        {
+            /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_064: [ If persisting the checkpoint fails, IoTHubClient_OfflineStore_Flush shall keep it marked so that the next call retries, and return a non-zero value. ]*/
+            if (write_checkpoint(handle) != 0)
+            {
+                LogError("Failed persisting offline store checkpoint");
+                result = __FAILURE__;
+            }
+            else
+            {
+                handle->is_checkpoint_dirty = false;
+                collect_segments(handle);
+            }
+        }
+    }
+    return result;
+}
+
+size_t IoTHubClient_OfflineStore_GetCount(OFFLINE_STORE_HANDLE handle)
+{
+    /*Codes_SRS_IOTHUB_OFFLINE_STORE_32_050: [ IoTHubClient_OfflineStore_GetCount shall return the number of unread messages, or 0 if handle is NULL. ]*/
+    return (handle == NULL) ? 0 : handle->unread_count;
+}
@@ -38,6 +38,11 @@ IOTHUB_CLIENT_RESULT IoTHubDeviceClient_SendEventAsync(IOTHUB_DEVICE_CLIENT_HAND
     return IoTHubClientCore_SendEventAsync((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
 }
 
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_SetEventConfirmationBatchCallback(IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK eventConfirmationBatchCallback, void* userContextCallback)
+{
+    return IoTHubClientCore_SetEventConfirmationBatchCallback((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, eventConfirmationBatchCallback, userContextCallback);
+}
+
 IOTHUB_CLIENT_RESULT IoTHubDeviceClient_GetSendStatus(IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
 {
     return IoTHubClientCore_GetSendStatus((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, iotHubClientStatus);
@@ -106,3 +111,17 @@ IOTHUB_CLIENT_RESULT IoTHubDeviceClient_UploadMultipleBlocksToBlobAsync(IOTHUB_D
 }
 
 #endif /*DONT_USE_UPLOADTOBLOB*/
+
+#ifdef USE_LATENCY_TRACING
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_GetStatistics(IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATISTICS* statistics)
+{
+    return IoTHubClientCore_GetStatistics((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, statistics);
+}
+#endif /*USE_LATENCY_TRACING*/
+
+#ifdef USE_CLIENT_METRICS
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_GetMetrics(IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_METRICS* metrics)
+{
+    return IoTHubClientCore_GetMetrics((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, metrics);
+}
+#endif /*USE_CLIENT_METRICS*/
@@ -29,6 +29,7 @@ typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
     char* userDefinedContentType;
     char* contentEncoding;
     IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA_HANDLE diagnosticData;
+    IOTHUB_MESSAGE_PRIORITY priority;
 }IOTHUB_MESSAGE_HANDLE_DATA;
 
 static bool ContainsOnlyUsAscii(const char* asciiValue)
@@ -272,6 +273,8 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
         {
             memset(result, 0, sizeof(*result));
             result->contentType = source->contentType;
+            /*Codes_SRS_IOTHUBMESSAGE_33_003: [IoTHubMessage_Clone shall copy the priority of the source message.]*/
+            result->priority = source->priority;
 
             if (source->messageId != NULL && mallocAndStrcpy_s(&result->messageId, source->messageId) != 0)
             {
@@ -761,6 +764,42 @@ IOTHUB_MESSAGE_RESULT IoTHubMessage_SetDiagnosticPropertyData(IOTHUB_MESSAGE_HAN
     return result;
 }
 
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    IOTHUB_MESSAGE_RESULT result;
+    /* Codes_SRS_IOTHUBMESSAGE_33_001: [If iotHubMessageHandle is NULL or priority is not a valid IOTHUB_MESSAGE_PRIORITY value, IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+    if (iotHubMessageHandle == NULL ||
+        (priority != IOTHUB_MESSAGE_PRIORITY_NORMAL && priority != IOTHUB_MESSAGE_PRIORITY_HIGH))
+    {
+        LogError("Invalid argument (iotHubMessageHandle=%p, priority=%d)", iotHubMessageHandle, (int)priority);
+        result = IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUBMESSAGE_33_002: [IoTHubMessage_SetPriority shall store priority in the message and return IOTHUB_MESSAGE_OK.] */
+        iotHubMessageHandle->priority = priority;
+        result = IOTHUB_MESSAGE_OK;
+    }
+    return result;
+}
+
+IOTHUB_MESSAGE_PRIORITY IoTHubMessage_GetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    IOTHUB_MESSAGE_PRIORITY result;
+    /* Codes_SRS_IOTHUBMESSAGE_33_004: [If iotHubMessageHandle is NULL, IoTHubMessage_GetPriority shall return IOTHUB_MESSAGE_PRIORITY_NORMAL.] */
+    if (iotHubMessageHandle == NULL)
+    {
+        LogError("Invalid argument (iotHubMessageHandle is NULL)");
+        result = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUBMESSAGE_33_005: [IoTHubMessage_GetPriority shall return the priority of the message, IOTHUB_MESSAGE_PRIORITY_NORMAL unless IoTHubMessage_SetPriority was called.] */
+        result = iotHubMessageHandle->priority;
+    }
+    return result;
+}
+
 void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
 {
     /*Codes_SRS_IOTHUBMESSAGE_01_004: [If iotHubMessageHandle is NULL, IoTHubMessage_Destroy shall do nothing.] */
@@ -4,10 +4,13 @@
 #include <stdlib.h> 
 #include <signal.h>
 #include <stddef.h>
+#include <string.h>
 #include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/vector.h"
 
@@ -16,6 +19,35 @@
 #include "iothub_transport_ll.h"
 #include "iothub_client_core.h"
 
+/*number of threads running the clients' work (user callbacks included) next to the transport worker thread*/
+#define MULTIPLEXED_DISPATCH_THREAD_COUNT 4
+/*an idle dispatch thread is parked on the dispatch condition, the timeout only bounds how long it sleeps through a lost post*/
+#define MULTIPLEXED_DISPATCH_IDLE_WAIT_MS 1000
+
+typedef struct MULTIPLEXED_CLIENT_TAG
+{
+    IOTHUB_CLIENT_CORE_HANDLE clientHandle;
+    bool isQueued;
+    bool isRunning;
+    bool isRemoved; /*the client was ended while running, the thread running it frees the record*/
+    struct MULTIPLEXED_CLIENT_TAG* nextQueued;
+} MULTIPLEXED_CLIENT;
+
+/*the client a thread is running, so a client destroyed from one of its own callbacks does not wait for itself*/
+#if defined(_MSC_VER)
+static __declspec(thread) MULTIPLEXED_CLIENT* dispatchedClient = NULL;
+#define IS_DISPATCHED_BY_CALLER(client) (dispatchedClient == (client))
+#define SET_DISPATCHED_BY_CALLER(client) (dispatchedClient = (client))
+#elif defined(__GNUC__)
+static __thread MULTIPLEXED_CLIENT* dispatchedClient = NULL;
+#define IS_DISPATCHED_BY_CALLER(client) (dispatchedClient == (client))
+#define SET_DISPATCHED_BY_CALLER(client) (dispatchedClient = (client))
+#else
+/*without thread local storage a running client is always left to the thread running it to free*/
+#define IS_DISPATCHED_BY_CALLER(client) true
+#define SET_DISPATCHED_BY_CALLER(client) ((void)0)
+#endif
+
 typedef struct TRANSPORT_HANDLE_DATA_TAG
 {
     TRANSPORT_LL_HANDLE transportLLHandle;
@@ -23,11 +55,25 @@ typedef struct TRANSPORT_HANDLE_DATA_TAG
     LOCK_HANDLE lockHandle;
     sig_atomic_t stopThread;
     TRANSPORT_PROVIDER_FIELDS;
-    VECTOR_HANDLE clients;
+    VECTOR_HANDLE clients; /*of MULTIPLEXED_CLIENT*, guarded by clientsLockHandle like the dispatch queue*/
     LOCK_HANDLE clientsLockHandle;
     IOTHUB_CLIENT_MULTIPLEXED_DO_WORK clientDoWork;
+    size_t clientsVersion;
+    MULTIPLEXED_CLIENT* dispatchQueueHead;
+    MULTIPLEXED_CLIENT* dispatchQueueTail;
+    COND_HANDLE dispatchCondition; /*posted under clientsLockHandle when a client is queued or the dispatch threads stop*/
+    sig_atomic_t stopDispatch;
 } TRANSPORT_HANDLE_DATA;
 
+/*the worker thread's copy of the clients, refreshed only when clientsVersion changes*/
+typedef struct CLIENTS_SNAPSHOT_TAG
+{
+    MULTIPLEXED_CLIENT** clients;
+    size_t count;
+    size_t capacity;
+    size_t version;
+} CLIENTS_SNAPSHOT;
+
 /* Used for Unit test */
 const size_t IoTHubTransport_ThreadTerminationOffset = offsetof(TRANSPORT_HANDLE_DATA, stopThread);
 
@@ -97,15 +143,25 @@ TRANSPORT_HANDLE IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoco
                     free(result);
                     result = NULL;
                 }
+                else if ((result->dispatchCondition = Condition_Init()) == NULL)
+                {
+                    LogError("dispatch condition not created.");
+                    Lock_Deinit(result->clientsLockHandle);
+                    Lock_Deinit(result->lockHandle);
+                    transportProtocol->IoTHubTransport_Destroy(result->transportLLHandle);
+                    free(result);
+                    result = NULL;
+                }
                 else
                 {
                     /*Codes_SRS_IOTHUBTRANSPORT_17_038: [ IoTHubTransport_Create shall call VECTOR_Create to make a list of IOTHUB_CLIENT_CORE_HANDLE using this transport. ]*/
-                    result->clients = VECTOR_create(sizeof(IOTHUB_CLIENT_CORE_HANDLE));
+                    result->clients = VECTOR_create(sizeof(MULTIPLEXED_CLIENT*));
                     if (result->clients == NULL)
                     {
                         /*Codes_SRS_IOTHUBTRANSPORT_17_039: [ If the Vector creation fails, IoTHubTransport_Create shall return NULL. ]*/
                         /*Codes_SRS_IOTHUBTRANSPORT_17_009: [ IoTHubTransport_Create shall clean up any resources it creates if the function does not succeed. ]*/
                         LogError("clients list not created.");
+                        Condition_Deinit(result->dispatchCondition);
                         Lock_Deinit(result->clientsLockHandle);
                         Lock_Deinit(result->lockHandle);
                         transportProtocol->IoTHubTransport_Destroy(result->transportLLHandle);
@@ -116,7 +172,11 @@ TRANSPORT_HANDLE IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoco
                     {
                         /*Codes_SRS_IOTHUBTRANSPORT_17_001: [ IoTHubTransport_Create shall return a non-NULL handle on success.]*/
                         result->stopThread = 1;
+                        result->stopDispatch = 1;
                         result->clientDoWork = NULL;
+                        result->clientsVersion = 0;
+                        result->dispatchQueueHead = NULL;
+                        result->dispatchQueueTail = NULL;
                         result->workerThreadHandle = NULL; /* create thread when work needs to be done */
                         result->IoTHubTransport_GetHostname = transportProtocol->IoTHubTransport_GetHostname;
                         result->IoTHubTransport_SetOption = transportProtocol->IoTHubTransport_SetOption;
@@ -138,7 +198,96 @@ TRANSPORT_HANDLE IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoco
     return result;
 }
 
-static void multiplexed_client_do_work(TRANSPORT_HANDLE_DATA* transportData)
+static void remove_from_dispatch_queue(TRANSPORT_HANDLE_DATA* transportData, MULTIPLEXED_CLIENT* client)
+{
+    MULTIPLEXED_CLIENT* previous = NULL;
+    MULTIPLEXED_CLIENT* current = transportData->dispatchQueueHead;
+
+    while ((current != NULL) && (current != client))
+    {
+        previous = current;
+        current = current->nextQueued;
+    }
+
+    if (current != NULL)
+    {
+        if (previous == NULL)
+        {
+            transportData->dispatchQueueHead = current->nextQueued;
+        }
+        else
+        {
+            previous->nextQueued = current->nextQueued;
+        }
+
+        if (transportData->dispatchQueueTail == current)
+        {
+            transportData->dispatchQueueTail = previous;
+        }
+        current->nextQueued = NULL;
+        current->isQueued = false;
+    }
+}
+
+static MULTIPLEXED_CLIENT* pop_dispatch_queue(TRANSPORT_HANDLE_DATA* transportData)
+{
+    MULTIPLEXED_CLIENT* result = transportData->dispatchQueueHead;
+    if (result != NULL)
+    {
+        transportData->dispatchQueueHead = result->nextQueued;
+        if (transportData->dispatchQueueHead == NULL)
+        {
+            transportData->dispatchQueueTail = NULL;
+        }
+        result->nextQueued = NULL;
+        result->isQueued = false;
+        result->isRunning = true;
+    }
+    return result;
+}
+
+static bool refresh_clients_snapshot(TRANSPORT_HANDLE_DATA* transportData, CLIENTS_SNAPSHOT* snapshot)
+{
+    bool result;
+    size_t numberOfClients = VECTOR_size(transportData->clients);
+
+    if (numberOfClients > snapshot->capacity)
+    {
+        MULTIPLEXED_CLIENT** newClients = (MULTIPLEXED_CLIENT**)malloc(numberOfClients * sizeof(MULTIPLEXED_CLIENT*));
+        if (newClients == NULL)
+        {
+            LogError("failed allocating the clients snapshot");
+            result = false;
+        }
+        else
+        {
+            free(snapshot->clients);
+            snapshot->clients = newClients;
+            snapshot->capacity = numberOfClients;
+            result = true;
+        }
+    }
+    else
+    {
+        result = true;
+    }
+
+    if (result)
+    {
+        size_t iterator;
+        for (iterator = 0; iterator < numberOfClients; iterator++)
+        {
+            snapshot->clients[iterator] = *(MULTIPLEXED_CLIENT**)VECTOR_element(transportData->clients, iterator);
+        }
+        snapshot->count = numberOfClients;
+        snapshot->version = transportData->clientsVersion;
+    }
+    return result;
+}
+
+/*queues every client that is neither queued nor running. A client is run by one thread at a time, so its callbacks keep their
+order, and a slow callback only holds up its own client.*/
+static void multiplexed_client_do_work(TRANSPORT_HANDLE_DATA* transportData, CLIENTS_SNAPSHOT* snapshot)
 {
     if (Lock(transportData->clientsLockHandle) != LOCK_OK)
     {
@@ -146,17 +295,29 @@ static void multiplexed_client_do_work(TRANSPORT_HANDLE_DATA* transportData)
     }
     else
     {
-        size_t numberOfClients;
         size_t iterator;
 
-        numberOfClients = VECTOR_size(transportData->clients);
-        for (iterator = 0; iterator < numberOfClients; iterator++)
+        if ((snapshot->version != transportData->clientsVersion) && (!refresh_clients_snapshot(transportData, snapshot)))
         {
-            IOTHUB_CLIENT_CORE_HANDLE* clientHandle = (IOTHUB_CLIENT_CORE_HANDLE*)VECTOR_element(transportData->clients, iterator);
+            snapshot->count = 0;
+        }
 
-            if (clientHandle != NULL)
+        for (iterator = 0; iterator < snapshot->count; iterator++)
+        {
+            MULTIPLEXED_CLIENT* client = snapshot->clients[iterator];
+            if (!client->isQueued && !client->isRunning)
             {
-                transportData->clientDoWork(*clientHandle);
+                client->isQueued = true;
+                if (transportData->dispatchQueueTail == NULL)
+                {
+                    transportData->dispatchQueueHead = client;
+                }
+                else
+                {
+                    transportData->dispatchQueueTail->nextQueued = client;
+                }
+                transportData->dispatchQueueTail = client;
+                (void)Condition_Post(transportData->dispatchCondition);
             }
         }
 
@@ -167,9 +328,105 @@ static void multiplexed_client_do_work(TRANSPORT_HANDLE_DATA* transportData)
     }
 }
 
+/*runs one queued client, returns false if there was none*/
+static bool dispatch_one_client(TRANSPORT_HANDLE_DATA* transportData)
+{
+    bool result;
+    MULTIPLEXED_CLIENT* client;
+
+    if (Lock(transportData->clientsLockHandle) != LOCK_OK)
+    {
+        LogError("failed to lock for dispatch_one_client");
+        client = NULL;
+    }
+    else
+    {
+        client = pop_dispatch_queue(transportData);
+        (void)Unlock(transportData->clientsLockHandle);
+    }
+
+    if (client == NULL)
+    {
+        result = false;
+    }
+    else
+    {
+        SET_DISPATCHED_BY_CALLER(client);
+        transportData->clientDoWork(client->clientHandle);
+        SET_DISPATCHED_BY_CALLER(NULL);
+
+        if (Lock(transportData->clientsLockHandle) != LOCK_OK)
+        {
+            LogError("failed to lock for dispatch_one_client");
+        }
+        else
+        {
+            client->isRunning = false;
+            if (client->isRemoved)
+            {
+                free(client);
+            }
+            (void)Unlock(transportData->clientsLockHandle);
+        }
+        result = true;
+    }
+    return result;
+}
+
+static int dispatch_thread(void* threadArgument)
+{
+    TRANSPORT_HANDLE_DATA* transportData = (TRANSPORT_HANDLE_DATA*)threadArgument;
+
+    while (!transportData->stopDispatch)
+    {
+        if (!dispatch_one_client(transportData))
+        {
+            if (Lock(transportData->clientsLockHandle) != LOCK_OK)
+            {
+                LogError("failed to lock for dispatch_thread");
+                ThreadAPI_Sleep(1);
+            }
+            else
+            {
+                if ((transportData->dispatchQueueHead == NULL) && !transportData->stopDispatch)
+                {
+                    (void)Condition_Wait(transportData->dispatchCondition, transportData->clientsLockHandle, MULTIPLEXED_DISPATCH_IDLE_WAIT_MS);
+                }
+                (void)Unlock(transportData->clientsLockHandle);
+            }
+        }
+    }
+
+    ThreadAPI_Exit(0);
+    return 0;
+}
+
 static int transport_worker_thread(void* threadArgument)
 {
     TRANSPORT_HANDLE_DATA* transportData = (TRANSPORT_HANDLE_DATA*)threadArgument;
+    THREAD_HANDLE dispatchThreads[MULTIPLEXED_DISPATCH_THREAD_COUNT];
+    size_t dispatchThreadCount = 0;
+    CLIENTS_SNAPSHOT snapshot;
+    size_t index;
+
+    snapshot.clients = NULL;
+    snapshot.count = 0;
+    snapshot.capacity = 0;
+    snapshot.version = (size_t)-1;
+
+    transportData->stopDispatch = 0;
+    for (index = 0; index < MULTIPLEXED_DISPATCH_THREAD_COUNT; index++)
+    {
+        if (ThreadAPI_Create(&dispatchThreads[dispatchThreadCount], dispatch_thread, transportData) != THREADAPI_OK)
+        {
+            /*with no dispatch thread at all the clients are run on this thread*/
+            LogError("failed creating a dispatch thread");
+        }
+        else
+        {
+            dispatchThreadCount++;
+        }
+    }
 
     while (1)
     {
@@ -191,22 +448,53 @@ static int transport_worker_thread(void* threadArgument)
             }
         }
 
-        multiplexed_client_do_work(transportData);
+        multiplexed_client_do_work(transportData, &snapshot);
+
+        if (dispatchThreadCount == 0)
+        {
+            while (dispatch_one_client(transportData))
+            {
+            }
+        }
 
         /*Codes_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]*/
         ThreadAPI_Sleep(1);
     }
 
+    if (Lock(transportData->clientsLockHandle) != LOCK_OK)
+    {
+        LogError("failed to lock for stopping the dispatch threads");
+        transportData->stopDispatch = 1;
+    }
+    else
+    {
+        transportData->stopDispatch = 1;
+        for (index = 0; index < dispatchThreadCount; index++)
+        {
+            (void)Condition_Post(transportData->dispatchCondition);
+        }
+        (void)Unlock(transportData->clientsLockHandle);
+    }
+    for (index = 0; index < dispatchThreadCount; index++)
+    {
+        int res;
+        if (ThreadAPI_Join(dispatchThreads[index], &res) != THREADAPI_OK)
+        {
+            LogError("ThreadAPI_Join failed for a dispatch thread");
+        }
+    }
+    free(snapshot.clients);
+
     ThreadAPI_Exit(0);
     return 0;
 }
 
 static bool find_by_handle(const void* element, const void* value)
 {
-    /* data stored at element is device handle */
-    const IOTHUB_CLIENT_CORE_HANDLE * guess = (const IOTHUB_CLIENT_CORE_HANDLE *)element;
+    /* data stored at element is the client's dispatch record */
+    const MULTIPLEXED_CLIENT* const* guess = (const MULTIPLEXED_CLIENT* const*)element;
     const IOTHUB_CLIENT_CORE_HANDLE match = (const IOTHUB_CLIENT_CORE_HANDLE)value;
-    return (*guess == match);
+    return ((*guess)->clientHandle == match);
 }
 
 static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle)
@@ -235,15 +523,31 @@ static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * trans
             if (addToList)
             {
                 /*Codes_SRS_IOTHUBTRANSPORT_17_021: [ If handle is not found, then clientHandle shall be added to the list. ]*/
-                if (VECTOR_push_back(transportData->clients, &clientHandle, 1) != 0)
+                MULTIPLEXED_CLIENT* client = (MULTIPLEXED_CLIENT*)malloc(sizeof(MULTIPLEXED_CLIENT));
+                if (client == NULL)
                 {
-                    LogError("Failed adding device to list (VECTOR_push_back failed)");
-                    /*Codes_SRS_IOTHUBTRANSPORT_17_042: [ If Adding to the client list fails, IoTHubTransport_StartWorkerThread shall return IOTHUB_CLIENT_ERROR. ]*/
+                    LogError("Failed allocating the client dispatch record");
                     result = IOTHUB_CLIENT_ERROR;
                 }
                 else
                 {
-                    result = IOTHUB_CLIENT_OK;
+                    client->clientHandle = clientHandle;
+                    client->isQueued = false;
+                    client->isRunning = false;
+                    client->isRemoved = false;
+                    client->nextQueued = NULL;
+                    if (VECTOR_push_back(transportData->clients, &client, 1) != 0)
+                    {
+                        LogError("Failed adding device to list (VECTOR_push_back failed)");
+                        /*Codes_SRS_IOTHUBTRANSPORT_17_042: [ If Adding to the client list fails, IoTHubTransport_StartWorkerThread shall return IOTHUB_CLIENT_ERROR. ]*/
+                        free(client);
+                        result = IOTHUB_CLIENT_ERROR;
+                    }
+                    else
+                    {
+                        transportData->clientsVersion++;
+                        result = IOTHUB_CLIENT_OK;
+                    }
                 }
             }
             else
@@ -290,6 +594,7 @@ static void wait_worker_thread(TRANSPORT_HANDLE_DATA * transportData)
 static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle)
 {
     bool okToJoin;
+    bool isEndedByItself = false;
 
     if (Lock(transportData->clientsLockHandle) != LOCK_OK)
     {
@@ -301,8 +606,33 @@ static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTH
         void* element = VECTOR_find_if(transportData->clients, find_by_handle, clientHandle);
         if (element != NULL)
         {
+            MULTIPLEXED_CLIENT* client = *(MULTIPLEXED_CLIENT**)element;
+
             /*Codes_SRS_IOTHUBTRANSPORT_17_026: [ IoTHubTransport_EndWorkerThread shall remove clientHandlehandle from handle list. ]*/
             VECTOR_erase(transportData->clients, element, 1);
+            transportData->clientsVersion++;
+
+            /*the client's work may be queued or running on a dispatch thread, it is not touched again once this returns*/
+            remove_from_dispatch_queue(transportData, client);
+            if (client->isRunning && IS_DISPATCHED_BY_CALLER(client))
+            {
+                /*ended from one of its own callbacks: waiting would never return, the running thread frees the record*/
+                client->isRemoved = true;
+                isEndedByItself = true;
+            }
+            else
+            {
+                while (client->isRunning)
+                {
+                    (void)Unlock(transportData->clientsLockHandle);
+                    ThreadAPI_Sleep(1);
+                    while (Lock(transportData->clientsLockHandle) != LOCK_OK)
+                    {
+                        ThreadAPI_Sleep(1);
+                    }
+                }
+                free(client);
+            }
         }
         /*Codes_SRS_IOTHUBTRANSPORT_17_025: [ If the worker thread does not exist, then IoTHubTransport_EndWorkerThread shall return. ]*/
         if (transportData->workerThreadHandle != NULL)
@@ -310,7 +640,8 @@ static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTH
             if (VECTOR_size(transportData->clients) == 0)
             {
                 stop_worker_thread(transportData);
-                okToJoin = true;
+                /*a dispatch thread cannot join the worker thread that joins it, IoTHubTransport_Destroy does*/
+                okToJoin = !isEndedByItself;
             }
             else
             {
@@ -351,7 +682,14 @@ void IoTHubTransport_Destroy(TRANSPORT_HANDLE transportHandle)
         /*Codes_SRS_IOTHUBTRANSPORT_17_010: [ IoTHubTransport_Destroy shall free all resources. ]*/
         Lock_Deinit(transportData->lockHandle);
         (transportData->IoTHubTransport_Destroy)(transportData->transportLLHandle);
+        while (VECTOR_size(transportData->clients) > 0)
+        {
+            MULTIPLEXED_CLIENT** element = (MULTIPLEXED_CLIENT**)VECTOR_front(transportData->clients);
+            free(*element);
+            VECTOR_erase(transportData->clients, element, 1);
+        }
         VECTOR_destroy(transportData->clients);
+        Condition_Deinit(transportData->dispatchCondition);
         Lock_Deinit(transportData->clientsLockHandle);
         free(transportHandle);
     }
@@ -451,3 +789,60 @@ void IoTHubTransport_JoinWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_C
         wait_worker_thread(transportData);
     }
 }
+
+#ifdef USE_CLIENT_METRICS
+int IoTHubTransport_GetMetrics(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_METRICS* metrics)
+{
+    int result;
+    if ((transportHandle == NULL) || (metrics == NULL))
+    {
+        LogError("Invalid NULL argument, transportHandle [%p], metrics [%p].", transportHandle, metrics);
+        result = __FAILURE__;
+    }
+    else
+    {
+        TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+
+        /*the clients lock keeps the clients from being destroyed while they are read, it is never taken under the transport lock*/
+        if (Lock(transportData->clientsLockHandle) != LOCK_OK)
+        {
+            LogError("failed to lock for IoTHubTransport_GetMetrics");
+            result = __FAILURE__;
+        }
+        else
+        {
+            size_t numberOfClients = VECTOR_size(transportData->clients);
+            size_t iterator;
+
+            memset(metrics, 0, sizeof(IOTHUB_CLIENT_METRICS));
+            result = 0;
+            for (iterator = 0; iterator < numberOfClients; iterator++)
+            {
+                MULTIPLEXED_CLIENT* client = *(MULTIPLEXED_CLIENT**)VECTOR_element(transportData->clients, iterator);
+                IOTHUB_CLIENT_METRICS clientMetrics;
+                if (IoTHubClientCore_GetMetrics(client->clientHandle, &clientMetrics) != IOTHUB_CLIENT_OK)
+                {
+                    LogError("failed getting the metrics of client %p", client->clientHandle);
+                    result = __FAILURE__;
+                    break;
+                }
+                else
+                {
+                    size_t index;
+                    for (index = 0; index < IOTHUB_CLIENT_METRIC_COUNT; index++)
+                    {
+                        metrics->counters[index] += clientMetrics.counters[index];
+                    }
+                    for (index = 0; index < IOTHUB_CLIENT_QUEUE_COUNT; index++)
+                    {
+                        metrics->queue_depths[index] += clientMetrics.queue_depths[index];
+                    }
+                }
+            }
+
+            (void)Unlock(transportData->clientsLockHandle);
+        }
+    }
+    return result;
+}
+#endif /*USE_CLIENT_METRICS*/
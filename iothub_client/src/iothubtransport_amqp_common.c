@@ -43,6 +43,7 @@
 #define DEFAULT_CBS_REQUEST_TIMEOUT_SECS          30
 #define DEFAULT_DEVICE_STATE_CHANGE_TIMEOUT_SECS  60
 #define DEFAULT_EVENT_SEND_TIMEOUT_SECS           300
+#define DEFAULT_MAX_IN_FLIGHT_TELEMETRY           64
 #define DEFAULT_SAS_TOKEN_LIFETIME_SECS           3600
 #define DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS       1800
 #define MAX_NUMBER_OF_DEVICE_FAILURES             5
@@ -120,6 +121,8 @@ typedef struct AMQP_TRANSPORT_INSTANCE_TAG
     size_t option_sas_token_refresh_time_secs;                          // Device-specific option.
     size_t option_cbs_request_timeout_secs;                             // Device-specific option.
     size_t option_send_event_timeout_secs;                              // Device-specific option.
+    size_t option_max_in_flight_telemetry;                              // Maximum number of events each device has handed to device_send_event_async; 0 means no limit.
+    bool is_max_in_flight_telemetry_set;                                // By the option, or to the default once a prioritized event was queued.
 
                                                                         // Auth module used to generating handle authorization
     IOTHUB_AUTHORIZATION_HANDLE authorization_module;                   // with either SAS Token, x509 Certs, and Device SAS Token
@@ -143,6 +146,7 @@ typedef struct AMQP_TRANSPORT_DEVICE_INSTANCE_TAG
     bool subscribe_methods_needed;                                       // Indicates if should subscribe for device methods.
     // is the transport subscribed for methods?
     bool subscribed_for_methods;                                         // Indicates if device is subscribed for device methods.
+    size_t events_in_progress;                                          // Number of events handed to device_send_event_async and not completed yet.
 } AMQP_TRANSPORT_DEVICE_INSTANCE;
 
 typedef struct MESSAGE_DISPOSITION_CONTEXT_TAG
@@ -868,6 +872,8 @@ static void prepare_device_for_connection_retry(AMQP_TRANSPORT_DEVICE_INSTANCE*
 
     registered_device->number_of_previous_failures = 0;
     registered_device->number_of_send_event_complete_failures = 0;
+
+    IOTHUB_CLIENT_METRIC_ADD(registered_device->iothub_client_handle, IOTHUB_CLIENT_METRIC_RECONNECTS, 1);
 }
 
 static void prepare_for_connection_retry(AMQP_TRANSPORT_INSTANCE* transport_instance)
@@ -1010,6 +1016,18 @@ static void on_event_send_complete(IOTHUB_MESSAGE_LIST* message, D2C_EVENT_SEND_
         registered_device->number_of_send_event_complete_failures = 0;
     }
 
+    // messages sent over AMQP do not go through IoTHubClientCore_LL_SendComplete
+    if (result == D2C_EVENT_SEND_COMPLETE_RESULT_OK)
+    {
+        IOTHUB_CLIENT_LATENCY_TRACE(registered_device->iothub_client_handle, message, IOTHUB_CLIENT_LATENCY_EVENT_COMPLETED);
+    }
+    IOTHUB_CLIENT_METRIC_EVENT_COMPLETED(registered_device->iothub_client_handle, message, get_iothub_client_confirmation_result_from(result));
+    if (registered_device->events_in_progress > 0)
+    {
+        registered_device->events_in_progress--;
+    }
+    IOTHUB_CLIENT_METRIC_QUEUE_DEPTH(registered_device->iothub_client_handle, IOTHUB_CLIENT_QUEUE_IN_PROGRESS, registered_device->events_in_progress);
+
     // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_056: [If `message->callback` is not NULL, it shall invoked with the `iothub_send_result`]
     if (message->callback != NULL)
     {
@@ -1031,19 +1049,37 @@ static void on_event_send_complete(IOTHUB_MESSAGE_LIST* message, D2C_EVENT_SEND_
 }
 
 // @brief
-//     Gets events from wait to send list and sends to service in the order they were added.
+//     Gets events from wait to send list and sends to service in the order they are queued, until the in flight limit is reached.
 // @returns
 //     0 if all events could be sent to the next layer successfully, non-zero otherwise.
 static int send_pending_events(AMQP_TRANSPORT_DEVICE_INSTANCE* device_state)
 {
     int result;
     IOTHUB_MESSAGE_LIST* message;
+    AMQP_TRANSPORT_INSTANCE* transport_instance = device_state->transport_instance;
+    size_t max_in_flight;
 
     result = RESULT_OK;
 
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_27_003: [Until the `max_in_flight_telemetry` option is set, events shall not be limited until an event of priority other than IOTHUB_MESSAGE_PRIORITY_NORMAL is found at the head of `registered_device->wait_to_send_list`; from then on the limit shall be 64]
+    if (!transport_instance->is_max_in_flight_telemetry_set && device_state->waiting_to_send->Flink != device_state->waiting_to_send &&
+        containingRecord(device_state->waiting_to_send->Flink, IOTHUB_MESSAGE_LIST, entry)->priority != IOTHUB_MESSAGE_PRIORITY_NORMAL)
+    {
+        transport_instance->option_max_in_flight_telemetry = DEFAULT_MAX_IN_FLIGHT_TELEMETRY;
+        transport_instance->is_max_in_flight_telemetry_set = true;
+    }
+    max_in_flight = transport_instance->option_max_in_flight_telemetry;
+
     // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_047: [If the registered device is started, each event on `registered_device->wait_to_send_list` shall be removed from the list and sent using device_send_event_async()]
-    while ((message = get_next_event_to_send(device_state)) != NULL)
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_27_001: [Events shall be left on `registered_device->wait_to_send_list` while `option_max_in_flight_telemetry` events of the device are waiting for `on_event_send_complete`]
+    while ((max_in_flight == 0 || device_state->events_in_progress < max_in_flight) &&
+        (message = get_next_event_to_send(device_state)) != NULL)
     {
+        IOTHUB_CLIENT_LATENCY_TRACE(device_state->iothub_client_handle, message, IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED);
+        // counted before the call, on_event_send_complete takes it off when device_send_event_async fails as well
+        device_state->events_in_progress++;
+        IOTHUB_CLIENT_METRIC_QUEUE_DEPTH(device_state->iothub_client_handle, IOTHUB_CLIENT_QUEUE_IN_PROGRESS, device_state->events_in_progress);
+
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_048: [device_send_event_async() shall be invoked passing `on_event_send_complete`]
         if (device_send_event_async(device_state->device_handle, message, on_event_send_complete, device_state) != RESULT_OK)
         {
@@ -1453,6 +1489,8 @@ TRANSPORT_LL_HANDLE IoTHubTransport_AMQP_Common_Create(const IOTHUBTRANSPORT_CON
                 instance->option_sas_token_refresh_time_secs = DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS;
                 instance->option_cbs_request_timeout_secs = DEFAULT_CBS_REQUEST_TIMEOUT_SECS;
                 instance->option_send_event_timeout_secs = DEFAULT_EVENT_SEND_TIMEOUT_SECS;
+                instance->option_max_in_flight_telemetry = 0;
+                instance->is_max_in_flight_telemetry_set = false;
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_12_002: [The connection idle timeout parameter default value shall be set to 240000 milliseconds using connection_set_idle_timeout()]
                 instance->svc2cl_keep_alive_timeout_secs = DEFAULT_SERVICE_KEEP_ALIVE_FREQ_SECS;
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_99_001: [The remote idle timeout ratio shall be set to 0.5 using connection_set_remote_idle_timeout_empty_frame_send_ratio()]
@@ -1957,6 +1995,13 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_AMQP_Common_SetOption(TRANSPORT_LL_HANDLE h
                 result = IOTHUB_CLIENT_OK;
             }
         }
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_27_002: [If `option` is `max_in_flight_telemetry`, `value` shall be saved on `instance->option_max_in_flight_telemetry`]
+        else if (strcmp(OPTION_MAX_IN_FLIGHT_TELEMETRY, option) == 0)
+        {
+            transport_instance->option_max_in_flight_telemetry = *(size_t*)value;
+            transport_instance->is_max_in_flight_telemetry_set = true;
+            result = IOTHUB_CLIENT_OK;
+        }
         else if ((strcmp(OPTION_SERVICE_SIDE_KEEP_ALIVE_FREQ_SECS, option) == 0) || (strcmp(OPTION_C2D_KEEP_ALIVE_FREQ_SECS, option) == 0))
         {
             transport_instance->svc2cl_keep_alive_timeout_secs = *(size_t*)value;
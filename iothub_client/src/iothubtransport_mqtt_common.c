@@ -48,6 +48,8 @@
 #define FAILED_CONN_BACKOFF_VALUE           5
 #define STATUS_CODE_FAILURE_VALUE           500
 #define STATUS_CODE_TIMEOUT_VALUE           408
+#define ACK_WAITING_INDEX_SIZE              64 // power of two, indexed by the low bits of the packet id
+#define DEFAULT_MAX_IN_FLIGHT_TELEMETRY     64
 
 #define DEFAULT_RETRY_POLICY                IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER
 #define DEFAULT_RETRY_TIMEOUT_IN_SECONDS    0
@@ -190,12 +192,16 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
     // Internal lists for message tracking
     PDLIST_ENTRY waitingToSend;
     DLIST_ENTRY ack_waiting_queue;
+    struct MQTT_DEVICE_TWIN_ITEM_TAG* ack_waiting_index[ACK_WAITING_INDEX_SIZE]; // the items of ack_waiting_queue hashed by packet_id
 
     // Message tracking
     CONTROL_PACKET_TYPE currPacketState;
 
     // Telemetry specific
     DLIST_ENTRY telemetry_waitingForAck;
+    size_t telemetry_in_flight_count; // number of entries in telemetry_waitingForAck
+    size_t max_in_flight_telemetry; // 0 means no limit
+    bool is_max_in_flight_telemetry_set; // by the option, or to the default once a prioritized message was queued
     bool auto_url_encode_decode;
 
     // Controls frequency of reconnection logic.
@@ -210,6 +216,9 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
     char* http_proxy_username;
     char* http_proxy_password;
     bool isProductInfoSet;
+#ifdef USE_CLIENT_METRICS
+    bool has_connected; // every CONNACK after the first one counts as a reconnection
+#endif
 } MQTTTRANSPORT_HANDLE_DATA, *PMQTTTRANSPORT_HANDLE_DATA;
 
 typedef struct MQTT_DEVICE_TWIN_ITEM_TAG
@@ -221,6 +230,7 @@ typedef struct MQTT_DEVICE_TWIN_ITEM_TAG
     uint32_t iothub_msg_id;
     IOTHUB_DEVICE_TWIN* device_twin_data;
     DEVICE_TWIN_MSG_TYPE device_twin_msg_type;
+    struct MQTT_DEVICE_TWIN_ITEM_TAG* next_in_index;
     DLIST_ENTRY entry;
 } MQTT_DEVICE_TWIN_ITEM;
 
@@ -350,6 +360,31 @@ static uint16_t get_next_packet_id(PMQTTTRANSPORT_HANDLE_DATA transport_data)
     return transport_data->packetId;
 }
 
+static void add_to_ack_waiting_index(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_DEVICE_TWIN_ITEM* mqtt_info)
+{
+    size_t bucket = mqtt_info->packet_id & (ACK_WAITING_INDEX_SIZE - 1);
+    mqtt_info->next_in_index = transport_data->ack_waiting_index[bucket];
+    transport_data->ack_waiting_index[bucket] = mqtt_info;
+}
+
+// Returns the twin item waiting for the response to packet_id, unlinked from the index but still in ack_waiting_queue
+static MQTT_DEVICE_TWIN_ITEM* remove_from_ack_waiting_index(PMQTTTRANSPORT_HANDLE_DATA transport_data, size_t packet_id)
+{
+    MQTT_DEVICE_TWIN_ITEM** link = &transport_data->ack_waiting_index[packet_id & (ACK_WAITING_INDEX_SIZE - 1)];
+    MQTT_DEVICE_TWIN_ITEM* result;
+
+    while ((result = *link) != NULL && result->packet_id != packet_id)
+    {
+        link = &result->next_in_index;
+    }
+
+    if (result != NULL)
+    {
+        *link = result->next_in_index;
+    }
+    return result;
+}
+
 static const char* retrieve_mqtt_return_codes(CONNECT_RETURN_CODE rtn_code)
 {
     switch (rtn_code)
@@ -827,6 +862,7 @@ static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data,
         }
         else
         {
+            IOTHUB_CLIENT_LATENCY_TRACE(transport_data->llClientHandle, mqttMsgEntry->iotHubMessageEntry, IOTHUB_CLIENT_LATENCY_EVENT_ENCODED);
             if (tickcounter_get_current_ms(transport_data->msgTickCounter, &mqttMsgEntry->msgPublishTime) != 0)
             {
                 LogError("Failed retrieving tickcounter info");
@@ -841,6 +877,7 @@ static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data,
                 }
                 else
                 {
+                    IOTHUB_CLIENT_LATENCY_TRACE(transport_data->llClientHandle, mqttMsgEntry->iotHubMessageEntry, IOTHUB_CLIENT_LATENCY_EVENT_WRITTEN);
                     mqttMsgEntry->retryCount++;
                     result = 0;
                 }
@@ -934,6 +971,7 @@ static int publish_device_twin_get_message(MQTTTRANSPORT_HANDLE_DATA* transport_
                 else
                 {
                     DList_InsertTailList(&transport_data->ack_waiting_queue, &mqtt_info->entry);
+                    add_to_ack_waiting_index(transport_data, mqtt_info);
                     result = 0;
                 }
                 mqttmessage_destroy(mqtt_get_msg);
@@ -1267,29 +1305,22 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
                     }
                     else
                     {
-                        PDLIST_ENTRY dev_twin_item = transportData->ack_waiting_queue.Flink;
-                        while (dev_twin_item != &transportData->ack_waiting_queue)
+                        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_35_001: [ mqtt_notification_callback shall find the twin item waiting for request_id by hashing it, without walking ack_waiting_queue. ] */
+                        MQTT_DEVICE_TWIN_ITEM* msg_entry = remove_from_ack_waiting_index(transportData, request_id);
+                        if (msg_entry != NULL)
                         {
-                            DLIST_ENTRY saveListEntry;
-                            saveListEntry.Flink = dev_twin_item->Flink;
-                            MQTT_DEVICE_TWIN_ITEM* msg_entry = containingRecord(dev_twin_item, MQTT_DEVICE_TWIN_ITEM, entry);
-                            if (request_id == msg_entry->packet_id)
+                            (void)DList_RemoveEntryList(&msg_entry->entry);
+                            if (msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES)
                             {
-                                (void)DList_RemoveEntryList(dev_twin_item);
-                                if (msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES)
-                                {
-                                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_054: [ If type is IOTHUB_TYPE_DEVICE_TWIN, then on success if msg_type is RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_RetrievePropertyComplete... ] */
-                                    IoTHubClientCore_LL_RetrievePropertyComplete(transportData->llClientHandle, DEVICE_TWIN_UPDATE_COMPLETE, payload->message, payload->length);
-                                }
-                                else
-                                {
-                                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_055: [ if device_twin_msg_type is not RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_ReportedStateComplete ] */
-                                    IoTHubClientCore_LL_ReportedStateComplete(transportData->llClientHandle, msg_entry->iothub_msg_id, status_code);
-                                }
-                                free(msg_entry);
-                                break;
+                                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_054: [ If type is IOTHUB_TYPE_DEVICE_TWIN, then on success if msg_type is RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_RetrievePropertyComplete... ] */
+                                IoTHubClientCore_LL_RetrievePropertyComplete(transportData->llClientHandle, DEVICE_TWIN_UPDATE_COMPLETE, payload->message, payload->length);
+                            }
+                            else
+                            {
+                                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_055: [ if device_twin_msg_type is not RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_ReportedStateComplete ] */
+                                IoTHubClientCore_LL_ReportedStateComplete(transportData->llClientHandle, msg_entry->iothub_msg_id, status_code);
                             }
-                            dev_twin_item = saveListEntry.Flink;
+                            free(msg_entry);
                         }
                     }
                 }
@@ -1405,6 +1436,7 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                         if (puback->packetId == mqttMsgEntry->packet_id)
                         {
                             (void)DList_RemoveEntryList(currentListEntry); //First remove the item from Waiting for Ack List.
+                            transport_data->telemetry_in_flight_count--;
                             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
                             free(mqttMsgEntry);
                         }
@@ -1432,6 +1464,14 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                         // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_008: [ Upon successful connection the retry control shall be reset using retry_control_reset() ]
                         retry_control_reset(transport_data->retry_control_handle);
 
+#ifdef USE_CLIENT_METRICS
+                        if (transport_data->has_connected)
+                        {
+                            IOTHUB_CLIENT_METRIC_ADD(transport_data->llClientHandle, IOTHUB_CLIENT_METRIC_RECONNECTS, 1);
+                        }
+                        transport_data->has_connected = true;
+#endif
+
                         IoTHubClientCore_LL_ConnectionStatusCallBack(transport_data->llClientHandle, IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
                     }
                     else
@@ -1980,6 +2020,7 @@ static int InitializeConnection(PMQTTTRANSPORT_HANDLE_DATA transport_data)
                 {
                     /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_058: [ If the sas token has timed out IoTHubTransport_MQTT_Common_DoWork shall disconnect from the mqtt client and destroy the transport information and wait for reconnect. ] */
                     OPTIONHANDLER_HANDLE options = xio_retrieveoptions(transport_data->xioTransport);
+                    IOTHUB_CLIENT_METRIC_ADD(transport_data->llClientHandle, IOTHUB_CLIENT_METRIC_AUTH_REFRESHES, 1);
                     set_saved_tls_options(transport_data, options);
                     (void)mqtt_client_disconnect(transport_data->mqttClient, NULL, NULL);
                     xio_destroy(transport_data->xioTransport);
@@ -2096,6 +2137,9 @@ static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLI
                     {
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_010: [IoTHubTransport_MQTT_Common_Create shall allocate memory to save its internal state where all topics, hostname, device_id, device_key, sasTokenSr and client handle shall be saved.] */
                         DList_InitializeListHead(&(state->telemetry_waitingForAck));
+                        state->telemetry_in_flight_count = 0;
+                        state->max_in_flight_telemetry = 0;
+                        state->is_max_in_flight_telemetry_set = false;
                         DList_InitializeListHead(&(state->ack_waiting_queue));
                         state->isDestroyCalled = false;
                         state->isRegistered = false;
@@ -2121,6 +2165,9 @@ static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLI
                         srand((unsigned int)get_time(NULL));
                         state->authorization_module = auth_module;
                         state->isProductInfoSet = false;
+#ifdef USE_CLIENT_METRICS
+                        state->has_connected = false;
+#endif
                         state->option_sas_token_lifetime_secs = SAS_TOKEN_DEFAULT_LIFETIME;
                         state->auto_url_encode_decode = false;
                     }
@@ -2224,6 +2271,7 @@ void IoTHubTransport_MQTT_Common_Destroy(TRANSPORT_LL_HANDLE handle)
         {
             PDLIST_ENTRY currentEntry = DList_RemoveHeadList(&transport_data->telemetry_waitingForAck);
             MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
+            transport_data->telemetry_in_flight_count--;
             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
             free(mqttMsgEntry);
         }
@@ -2554,6 +2602,7 @@ IOTHUB_PROCESS_ITEM_RESULT IoTHubTransport_MQTT_Common_ProcessItem(TRANSPORT_LL_
                     }
                     else
                     {
+                        add_to_ack_waiting_index(transport_data, mqtt_info);
                         result = IOTHUB_PROCESS_OK;
                     }
                 }
@@ -2634,6 +2683,7 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                         {
                             PDLIST_ENTRY current_entry;
                             (void)DList_RemoveEntryList(currentListEntry);
+                            transport_data->telemetry_in_flight_count--;
                             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
                             free(mqttMsgEntry);
 
@@ -2661,9 +2711,11 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                             }
                             else
                             {
+                                IOTHUB_CLIENT_METRIC_ADD(transport_data->llClientHandle, IOTHUB_CLIENT_METRIC_SEND_RETRIES, 1);
                                 if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
                                 {
                                     (void)DList_RemoveEntryList(currentListEntry);
+                                    transport_data->telemetry_in_flight_count--;
                                     sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
                                     free(mqttMsgEntry);
                                 }
@@ -2674,8 +2726,19 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                 }
 
                 currentListEntry = transport_data->waitingToSend->Flink;
+
+                /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_27_003: [ Until the "max_in_flight_telemetry" option is set, IoTHubTransport_MQTT_Common_DoWork shall not limit the telemetry messages waiting for their PUBACK, until it finds a message of priority other than IOTHUB_MESSAGE_PRIORITY_NORMAL at the head of "waitingToSend"; from then on the limit shall be 64. ]*/
+                if (!transport_data->is_max_in_flight_telemetry_set && currentListEntry != transport_data->waitingToSend &&
+                    containingRecord(currentListEntry, IOTHUB_MESSAGE_LIST, entry)->priority != IOTHUB_MESSAGE_PRIORITY_NORMAL)
+                {
+                    transport_data->max_in_flight_telemetry = DEFAULT_MAX_IN_FLIGHT_TELEMETRY;
+                    transport_data->is_max_in_flight_telemetry_set = true;
+                }
+
                 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransport_MQTT_Common_DoWork shall inspect the "waitingToSend" DLIST passed in config structure.] */
-                while (currentListEntry != transport_data->waitingToSend)
+                /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_27_001: [ IoTHubTransport_MQTT_Common_DoWork shall stop taking messages from "waitingToSend" once `max_in_flight_telemetry` messages are waiting for their PUBACK, so that the remaining messages keep their place in the priority ordered queue. ]*/
+                while (currentListEntry != transport_data->waitingToSend &&
+                    (transport_data->max_in_flight_telemetry == 0 || transport_data->telemetry_in_flight_count < transport_data->max_in_flight_telemetry))
                 {
                     IOTHUB_MESSAGE_LIST* iothubMsgList = containingRecord(currentListEntry, IOTHUB_MESSAGE_LIST, entry);
                     DLIST_ENTRY savedFromCurrentListEntry;
@@ -2684,6 +2747,7 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                     /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransport_MQTT_Common_DoWork shall inspect the "waitingToSend" DLIST passed in config structure.] */
                     size_t messageLength;
                     const unsigned char* messagePayload = RetrieveMessagePayload(iothubMsgList->messageHandle, &messageLength);
+                    IOTHUB_CLIENT_LATENCY_TRACE(transport_data->llClientHandle, iothubMsgList, IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED);
                     if (messageLength == 0 || messagePayload == NULL)
                     {
                         LogError("Failure result from IoTHubMessage_GetData");
@@ -2711,6 +2775,7 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                             {
                                 (void)(DList_RemoveEntryList(currentListEntry));
                                 DList_InsertTailList(&(transport_data->telemetry_waitingForAck), &(mqttMsgEntry->entry));
+                                transport_data->telemetry_in_flight_count++;
                             }
                         }
                     }
@@ -2719,6 +2784,8 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
             }
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_030: [IoTHubTransport_MQTT_Common_DoWork shall call mqtt_client_dowork everytime it is called if it is connected.] */
             mqtt_client_dowork(transport_data->mqttClient);
+            // the PUBACKs are processed by mqtt_client_dowork, the depth is taken once it returned
+            IOTHUB_CLIENT_METRIC_QUEUE_DEPTH(transport_data->llClientHandle, IOTHUB_CLIENT_QUEUE_WAITING_FOR_ACK, transport_data->telemetry_in_flight_count);
         }
     }
 }
@@ -2788,6 +2855,13 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_SetOption(TRANSPORT_LL_HANDLE h
             transport_data->auto_url_encode_decode = *((bool*)value);
             result = IOTHUB_CLIENT_OK;
         }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_27_002: [ If the option parameter is set to "max_in_flight_telemetry" then the value shall be a size_t_ptr and the value will determine the maximum number of telemetry messages waiting for their PUBACK, 0 meaning no limit. ]*/
+        else if (strcmp(OPTION_MAX_IN_FLIGHT_TELEMETRY, option) == 0)
+        {
+            transport_data->max_in_flight_telemetry = *((size_t*)value);
+            transport_data->is_max_in_flight_telemetry_set = true;
+            result = IOTHUB_CLIENT_OK;
+        }
         /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_052: [ If the option parameter is set to "sas_token_lifetime" then the value shall be a size_t_ptr and the value will determine the mqtt sas token lifetime.] */
         else if (strcmp(OPTION_SAS_TOKEN_LIFETIME, option) == 0)
         {
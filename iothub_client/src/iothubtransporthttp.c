@@ -24,6 +24,10 @@
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/httpheaders.h"
 #include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 
 #define IOTHUB_APP_PREFIX "iothub-app-"
 static const char* IOTHUB_MESSAGE_ID = "iothub-messageid";
@@ -41,6 +45,12 @@ static const char* IOTHUB_CONTENT_ENCODING_C2D = "ContentEncoding";
 /*the default is 25 minutes*/
 #define DEFAULT_GETMINIMUMPOLLINGTIME ((unsigned int)25*60) 
 
+/*the time between 2 GETs of a device is spread by up to 1/POLLING_JITTER_DIVISOR of the device's polling interval*/
+#define POLLING_JITTER_DIVISOR 4
+
+/*DoWork never runs more than MAXIMUM_CONNECTION_POOL_SIZE requests at the same time, no matter how many devices are registered*/
+#define MAXIMUM_CONNECTION_POOL_SIZE 16
+
 #define MAXIMUM_MESSAGE_SIZE (255*1024-1)
 #define MAXIMUM_PAYLOAD_OVERHEAD 384
 #define MAXIMUM_PROPERTY_OVERHEAD 16
@@ -54,7 +64,22 @@ typedef struct HTTPTRANSPORT_HANDLE_DATA_TAG
     HTTPAPIEX_HANDLE httpApiExHandle;
     bool doBatchedTransfers;
     unsigned int getMinimumPollingTime;
+    unsigned int getMaximumPollingTime; /*0 unless the polling interval of the devices adapts between the minimum and this*/
     VECTOR_HANDLE perDeviceList;
+
+    /*connections used next to httpApiExHandle when OPTION_HTTP_CONNECTION_POOL_SIZE is greater than 1, each with the thread serving it*/
+    struct HTTPTRANSPORT_WORKER_TAG** pooledWorkers;
+    size_t pooledConnectionCount;
+    bool wereConnectionOptionsSet;
+    LOCK_HANDLE dispatchLock;
+    bool isDispatching;
+    struct HTTPTRANSPORT_DISPATCH_TAG* dispatch; /*the pass the pooled workers serve, NULL between passes. Guarded by dispatchLock*/
+    size_t passNumber;
+    size_t busyWorkerCount;
+    COND_HANDLE passDoneCondition; /*posted when the last busy pooled worker is done with the pass*/
+    TICK_COUNTER_HANDLE tickCounter;
+    tickcounter_ms_t deviceDeadlineMs;
+    size_t nextDeviceIndex;
 }HTTPTRANSPORT_HANDLE_DATA;
 
 typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
@@ -70,15 +95,48 @@ typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
     HTTP_HEADERS_HANDLE messageHTTPrequestHeaders;
     STRING_HANDLE abandonHTTPrelativePathBegin;
     HTTPAPIEX_SAS_HANDLE sasObject;
+    HTTPAPIEX_HANDLE httpApiExHandle; /*connection the device is served on during DoWork, NULL otherwise*/
     bool DoWork_PullMessage;
     time_t lastPollTime;
     bool isFirstPoll;
+    unsigned int pollingInterval; /*seconds, grows while the GETs return no message and drops back to the minimum when one does*/
+    unsigned int pollingDelay; /*seconds after lastPollTime the next GET is allowed, pollingInterval plus jitter*/
 
     IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle;
     PDLIST_ENTRY waitingToSend;
     DLIST_ENTRY eventConfirmations; /*holds items for event confirmations*/
+
+    /*what the worker serving the device completed, handed to the client layer by the thread calling DoWork once the workers are joined*/
+    DLIST_ENTRY completedEvents;
+    IOTHUB_CLIENT_CONFIRMATION_RESULT completedEventsResult;
+    MESSAGE_CALLBACK_INFO* receivedMessage;
+    bool isPollToSchedule;
+    bool wasMessageReceived;
 } HTTPTRANSPORT_PERDEVICE_DATA;
 
+typedef struct HTTPTRANSPORT_DISPATCH_TAG
+{
+    HTTPTRANSPORT_HANDLE_DATA* handleData;
+    size_t* deviceIndexes; /*indexes in perDeviceList of the devices that have work to do, in the order they are served*/
+    size_t deviceCount;
+    size_t nextPosition;
+    size_t firstDeferredPosition;
+    size_t pooledWorkerCount; /*the pooled workers taking part in the pass, next to the calling thread*/
+    bool hasDeadline;
+    tickcounter_ms_t passStartMs;
+} HTTPTRANSPORT_DISPATCH;
+
+typedef struct HTTPTRANSPORT_WORKER_TAG
+{
+    HTTPTRANSPORT_HANDLE_DATA* handleData;
+    size_t index; /*in pooledWorkers*/
+    HTTPAPIEX_HANDLE connection;
+    THREAD_HANDLE thread;
+    COND_HANDLE passCondition; /*posted when a pass needs the worker or the worker has to stop*/
+    size_t lastPass;
+    bool isStopping;
+} HTTPTRANSPORT_WORKER;
+
 typedef struct MESSAGE_DISPOSITION_CONTEXT_TAG
 {
     HTTPTRANSPORT_HANDLE_DATA* handleData;
@@ -609,8 +667,14 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_128: [ IoTHubTransportHttp_Register shall mark this device as unsubscribed. ]*/
                 result->DoWork_PullMessage = false;
                 result->isFirstPoll = true;
+                result->pollingInterval = 0;
+                result->pollingDelay = 0;
+                result->httpApiExHandle = NULL;
                 result->waitingToSend = waitingToSend;
                 DList_InitializeListHead(&(result->eventConfirmations));
+                DList_InitializeListHead(&(result->completedEvents));
+                result->receivedMessage = NULL;
+                result->isPollToSchedule = false;
                 result->transportHandle = (HTTPTRANSPORT_HANDLE_DATA *)handle;
             }
             else
@@ -772,6 +836,182 @@ static bool create_httpApiExHandle(HTTPTRANSPORT_HANDLE_DATA* handleData, const
     return result;
 }
 
+static void serveDevices(HTTPTRANSPORT_DISPATCH* dispatch, HTTPAPIEX_HANDLE connection);
+
+/*a pooled worker lives as long as its connection and serves the passes of DoWork that need it*/
+static int serveDevicesThread(void* context)
+{
+    HTTPTRANSPORT_WORKER* worker = (HTTPTRANSPORT_WORKER*)context;
+    HTTPTRANSPORT_HANDLE_DATA* handleData = worker->handleData;
+
+    (void)Lock(handleData->dispatchLock);
+    while (!worker->isStopping)
+    {
+        HTTPTRANSPORT_DISPATCH* dispatch = handleData->dispatch;
+        if ((dispatch != NULL) && (worker->lastPass != handleData->passNumber) && (worker->index < dispatch->pooledWorkerCount))
+        {
+            worker->lastPass = handleData->passNumber;
+            (void)Unlock(handleData->dispatchLock);
+
+            serveDevices(dispatch, worker->connection);
+
+            (void)Lock(handleData->dispatchLock);
+            if (--handleData->busyWorkerCount == 0)
+            {
+                (void)Condition_Post(handleData->passDoneCondition);
+            }
+        }
+        else
+        {
+            (void)Condition_Wait(worker->passCondition, handleData->dispatchLock, 0);
+        }
+    }
+    (void)Unlock(handleData->dispatchLock);
+    return 0;
+}
+
+static void destroy_pooledWorker(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_WORKER* worker)
+{
+    int threadResult;
+
+    (void)Lock(handleData->dispatchLock);
+    worker->isStopping = true;
+    (void)Condition_Post(worker->passCondition);
+    (void)Unlock(handleData->dispatchLock);
+
+    if (ThreadAPI_Join(worker->thread, &threadResult) != THREADAPI_OK)
+    {
+        LogError("unable to ThreadAPI_Join");
+    }
+    Condition_Deinit(worker->passCondition);
+    HTTPAPIEX_Destroy(worker->connection);
+    free(worker);
+}
+
+static HTTPTRANSPORT_WORKER* create_pooledWorker(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t index)
+{
+    HTTPTRANSPORT_WORKER* result = (HTTPTRANSPORT_WORKER*)malloc(sizeof(HTTPTRANSPORT_WORKER));
+    if (result == NULL)
+    {
+        LogError("unable to malloc");
+    }
+    else
+    {
+        result->handleData = handleData;
+        result->index = index;
+        result->lastPass = handleData->passNumber;
+        result->isStopping = false;
+        if ((result->connection = HTTPAPIEX_Create(STRING_c_str(handleData->hostName))) == NULL)
+        {
+            LogError("unable to HTTPAPIEX_Create");
+            free(result);
+            result = NULL;
+        }
+        else if ((result->passCondition = Condition_Init()) == NULL)
+        {
+            LogError("unable to Condition_Init");
+            HTTPAPIEX_Destroy(result->connection);
+            free(result);
+            result = NULL;
+        }
+        else if (ThreadAPI_Create(&result->thread, serveDevicesThread, result) != THREADAPI_OK)
+        {
+            LogError("unable to ThreadAPI_Create");
+            Condition_Deinit(result->passCondition);
+            HTTPAPIEX_Destroy(result->connection);
+            free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+static void destroy_connectionPool(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    size_t i;
+    for (i = 0; i < handleData->pooledConnectionCount; i++)
+    {
+        destroy_pooledWorker(handleData, handleData->pooledWorkers[i]);
+    }
+    free(handleData->pooledWorkers);
+    handleData->pooledWorkers = NULL;
+    handleData->pooledConnectionCount = 0;
+
+    if (handleData->passDoneCondition != NULL)
+    {
+        Condition_Deinit(handleData->passDoneCondition);
+        handleData->passDoneCondition = NULL;
+    }
+    if (handleData->dispatchLock != NULL)
+    {
+        (void)Lock_Deinit(handleData->dispatchLock);
+        handleData->dispatchLock = NULL;
+    }
+}
+
+/*grows or shrinks the connections DoWork spreads the devices over, poolSize counts httpApiExHandle too*/
+static int resize_connectionPool(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t poolSize)
+{
+    int result;
+
+    if (handleData->wereConnectionOptionsSet && (poolSize - 1 > handleData->pooledConnectionCount))
+    {
+        /*the options already passed to HTTPAPIEX cannot be replayed on new connections*/
+        LogError("connection pool size has to be set before the options of the HTTP connection");
+        result = __FAILURE__;
+    }
+    else
+    {
+        while (handleData->pooledConnectionCount > poolSize - 1)
+        {
+            handleData->pooledConnectionCount--;
+            destroy_pooledWorker(handleData, handleData->pooledWorkers[handleData->pooledConnectionCount]);
+        }
+
+        result = 0;
+        if (poolSize - 1 > handleData->pooledConnectionCount)
+        {
+            HTTPTRANSPORT_WORKER** newWorkers = (HTTPTRANSPORT_WORKER**)realloc(handleData->pooledWorkers, (poolSize - 1) * sizeof(HTTPTRANSPORT_WORKER*));
+            if (newWorkers == NULL)
+            {
+                LogError("unable to realloc the connection pool");
+                result = __FAILURE__;
+            }
+            else
+            {
+                handleData->pooledWorkers = newWorkers;
+                if ((handleData->dispatchLock == NULL) && ((handleData->dispatchLock = Lock_Init()) == NULL))
+                {
+                    LogError("unable to Lock_Init");
+                    result = __FAILURE__;
+                }
+                else if ((handleData->passDoneCondition == NULL) && ((handleData->passDoneCondition = Condition_Init()) == NULL))
+                {
+                    LogError("unable to Condition_Init");
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_41_006: [ Every pooled connection shall be served by its own thread, created by ThreadAPI_Create with the connection and joined by ThreadAPI_Join when the connection is destroyed. ]*/
+                    while ((result == 0) && (handleData->pooledConnectionCount < poolSize - 1))
+                    {
+                        HTTPTRANSPORT_WORKER* worker = create_pooledWorker(handleData, handleData->pooledConnectionCount);
+                        if (worker == NULL)
+                        {
+                            result = __FAILURE__;
+                        }
+                        else
+                        {
+                            handleData->pooledWorkers[handleData->pooledConnectionCount++] = worker;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
 static void destroy_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
 {
     VECTOR_destroy(handleData->perDeviceList);
@@ -850,6 +1090,22 @@ static TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONF
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_011: [ Otherwise, IoTHubTransportHttp_Create shall succeed and return a non-NULL value. ]*/
                 result->doBatchedTransfers = false;
                 result->getMinimumPollingTime = DEFAULT_GETMINIMUMPOLLINGTIME;
+                result->getMaximumPollingTime = 0;
+                result->pooledWorkers = NULL;
+                result->pooledConnectionCount = 0;
+                result->wereConnectionOptionsSet = false;
+                result->dispatchLock = NULL;
+                result->isDispatching = false;
+                result->dispatch = NULL;
+                result->passNumber = 0;
+                result->busyWorkerCount = 0;
+                result->passDoneCondition = NULL;
+                result->tickCounter = NULL;
+                result->deviceDeadlineMs = 0;
+                result->nextDeviceIndex = 0;
+
+                /*Codes_SRS_TRANSPORTMULTITHTTP_42_005: [ IoTHubTransportHttp_Create shall seed the random number generator used for the polling jitter once, from get_time. ]*/
+                srand((unsigned int)get_time(NULL));
             }
             else
             {
@@ -885,6 +1141,11 @@ static void IoTHubTransportHttp_Destroy(TRANSPORT_LL_HANDLE handle)
 
         destroy_hostName((HTTPTRANSPORT_HANDLE_DATA *)handle);
         destroy_httpApiExHandle((HTTPTRANSPORT_HANDLE_DATA *)handle);
+        destroy_connectionPool((HTTPTRANSPORT_HANDLE_DATA *)handle);
+        if (handleData->tickCounter != NULL)
+        {
+            tickcounter_destroy(handleData->tickCounter);
+        }
         destroy_perDeviceList((HTTPTRANSPORT_HANDLE_DATA *)handle);
         free(handle);
     }
@@ -1350,6 +1611,64 @@ static void reversePutListBackIn(PDLIST_ENTRY source, PDLIST_ENTRY destination)
     DList_InitializeListHead(source);
 }
 
+/*the events of a failed telemetry request stay in waitingToSend and the next DoWork sends them again, statusCode is 0 when the
+request could not be executed*/
+static void count_event_retry(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, unsigned int statusCode)
+{
+#ifdef USE_CLIENT_METRICS
+    IOTHUB_CLIENT_METRIC_ADD(iotHubClientHandle, IOTHUB_CLIENT_METRIC_SEND_RETRIES, 1);
+    if (statusCode == 429)
+    {
+        IOTHUB_CLIENT_METRIC_ADD(iotHubClientHandle, IOTHUB_CLIENT_METRIC_THROTTLED, 1);
+    }
+#else
+    (void)iotHubClientHandle;
+    (void)statusCode;
+#endif
+}
+
+/*a device is served on its own connection while DoWork dispatches it, and on httpApiExHandle otherwise*/
+static HTTPAPIEX_HANDLE get_device_connection(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+    return (deviceData->httpApiExHandle != NULL) ? deviceData->httpApiExHandle : handleData->httpApiExHandle;
+}
+
+/*the user callbacks run on the thread calling DoWork: while the devices are served concurrently the confirmations are kept in
+completedEvents and handed to the client layer once the workers are joined*/
+static void send_complete(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    if (handleData->isDispatching)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_41_002: [ While the devices are served concurrently, the workers shall not call IoTHubClientCore_LL_SendComplete nor IoTHubClientCore_LL_MessageCallback. ]*/
+        /*DoEvent completes one batch or one message of a device per pass*/
+        while (!DList_IsListEmpty(&(deviceData->eventConfirmations)))
+        {
+            DList_InsertTailList(&(deviceData->completedEvents), DList_RemoveHeadList(&(deviceData->eventConfirmations)));
+        }
+        deviceData->completedEventsResult = result;
+    }
+    else
+    {
+        IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), result);
+    }
+}
+
+#ifdef USE_LATENCY_TRACING
+/*makePayload takes the messages out of waitingToSend while it encodes them, so a batch gets its dequeue and encoding
+stamps once the payload is built: the encoding of a batch counts as waiting time*/
+static void trace_batched_events(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
+{
+    PDLIST_ENTRY entry = deviceData->eventConfirmations.Flink;
+    while (entry != &(deviceData->eventConfirmations))
+    {
+        IOTHUB_MESSAGE_LIST* message = containingRecord(entry, IOTHUB_MESSAGE_LIST, entry);
+        IOTHUB_CLIENT_LATENCY_TRACE(iotHubClientHandle, message, IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED);
+        IOTHUB_CLIENT_LATENCY_TRACE(iotHubClientHandle, message, IOTHUB_CLIENT_LATENCY_EVENT_ENCODED);
+        entry = entry->Flink;
+    }
+}
+#endif
+
 static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 {
 
@@ -1396,9 +1715,12 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                         else
                         {
                             unsigned int statusCode;
+#ifdef USE_LATENCY_TRACING
+                            trace_batched_events(deviceData, iotHubClientHandle);
+#endif
                             if (HTTPAPIEX_SAS_ExecuteRequest(
                                 deviceData->sasObject,
-                                handleData->httpApiExHandle,
+                                get_device_connection(handleData, deviceData),
                                 HTTPAPI_REQUEST_POST,
                                 STRING_c_str(deviceData->eventHTTPrelativePath),
                                 deviceData->eventHTTPrequestHeaders,
@@ -1412,13 +1734,14 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                                 //items go back to waitingToSend
                                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
                                 reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+                                count_event_retry(iotHubClientHandle, 0);
                             }
                             else
                             {
                                 if (statusCode < 300)
                                 {
                                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The batched items shall be removed from waitingToSend.] */
-                                    IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK);
+                                    send_complete(handleData, deviceData, iotHubClientHandle, IOTHUB_CLIENT_CONFIRMATION_OK);
                                 }
                                 else
                                 {
@@ -1426,6 +1749,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
                                     LogError("unexpected HTTP status code (%u)", statusCode);
                                     reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+                                    count_event_retry(iotHubClientHandle, statusCode);
                                 }
                             }
                         }
@@ -1436,7 +1760,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                 }
                 case MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT:
                 {
-                    IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_ERROR); /*takes care of emptying the list too*/
+                    send_complete(handleData, deviceData, iotHubClientHandle, IOTHUB_CLIENT_CONFIRMATION_ERROR); /*takes care of emptying the list too*/
                     break;
                 }
                 case MAKE_PAYLOAD_ERROR:
@@ -1464,6 +1788,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
             size_t originalMessageSize = 0;
             IOTHUB_MESSAGE_LIST* message = containingRecord(deviceData->waitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry);
             IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message->messageHandle);
+            IOTHUB_CLIENT_LATENCY_TRACE(iotHubClientHandle, message, IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED);
 
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_073: [The message size is computed from the length of the payload + 384.]*/
             if (!(
@@ -1494,7 +1819,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                 {
                     PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
                     DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                    IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_ERROR); /*takes care of emptying the list too*/
+                    send_complete(handleData, deviceData, iotHubClientHandle, IOTHUB_CLIENT_CONFIRMATION_ERROR); /*takes care of emptying the list too*/
                 }
                 else
                 {
@@ -1544,7 +1869,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                                         /*Codes_SRS_TRANSPORTMULTITHTTP_17_072: [The message size shall be limited to 255KB -1 bytes.] */
                                         PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
                                         DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                                        IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_ERROR); /*takes care of emptying the list too*/
+                                        send_complete(handleData, deviceData, iotHubClientHandle, IOTHUB_CLIENT_CONFIRMATION_ERROR); /*takes care of emptying the list too*/
                                         goOn = false;
                                     }
                                     else
@@ -1642,6 +1967,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                                         {
                                             unsigned int statusCode = 0;
                                             HTTPAPIEX_RESULT r;
+                                            IOTHUB_CLIENT_LATENCY_TRACE(iotHubClientHandle, message, IOTHUB_CLIENT_LATENCY_EVENT_ENCODED);
                                             if (deviceData->deviceSasToken != NULL)
                                             {
                                                 /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
@@ -1654,7 +1980,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 
                                                 /*Codes_SRS_TRANSPORTMULTITHTTP_03_003: [If a deviceSasToken exists, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_ExecuteRequest passing the following parameters] */
                                                 else if ((r = HTTPAPIEX_ExecuteRequest(
-                                                    handleData->httpApiExHandle,
+                                                    get_device_connection(handleData, deviceData),
                                                     HTTPAPI_REQUEST_POST,
                                                     STRING_c_str(deviceData->eventHTTPrelativePath),
                                                     clonedEventHTTPrequestHeaders,
@@ -1672,7 +1998,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                                                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_080: [If a deviceSasToken does not exist, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters] */
                                                 if ((r = HTTPAPIEX_SAS_ExecuteRequest(
                                                     deviceData->sasObject,
-                                                    handleData->httpApiExHandle,
+                                                    get_device_connection(handleData, deviceData),
                                                     HTTPAPI_REQUEST_POST,
                                                     STRING_c_str(deviceData->eventHTTPrelativePath),
                                                     clonedEventHTTPrequestHeaders,
@@ -1692,14 +2018,19 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                                                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_082: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend.] */
                                                     PDLIST_ENTRY justSent = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
                                                     DList_InsertTailList(&(deviceData->eventConfirmations), justSent);
-                                                    IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK); /*takes care of emptying the list too*/
+                                                    send_complete(handleData, deviceData, iotHubClientHandle, IOTHUB_CLIENT_CONFIRMATION_OK); /*takes care of emptying the list too*/
                                                 }
                                                 else
                                                 {
                                                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_081: [If HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
                                                     LogError("unexpected HTTP status code (%u)", statusCode);
+                                                    count_event_retry(iotHubClientHandle, statusCode);
                                                 }
                                             }
+                                            else
+                                            {
+                                                count_event_retry(iotHubClientHandle, 0);
+                                            }
                                         }
                                         BUFFER_delete(toBeSend);
                                     }
@@ -1821,7 +2152,7 @@ static bool abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
                                 result = false;
                             }
                             else if ((r = HTTPAPIEX_ExecuteRequest(
-                                handleData->httpApiExHandle,
+                                get_device_connection(handleData, deviceData),
                                 (action == IOTHUBMESSAGE_ABANDONED) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
                                 STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"   */
                                 abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
@@ -1840,7 +2171,7 @@ static bool abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
                         }
                         else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
                             deviceData->sasObject,
-                            handleData->httpApiExHandle,
+                            get_device_connection(handleData, deviceData),
                             (action == IOTHUBMESSAGE_ABANDONED) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
                             STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"   */
                             abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
@@ -1998,17 +2329,78 @@ static MESSAGE_CALLBACK_INFO* MESSAGE_CALLBACK_INFO_Create(IOTHUB_MESSAGE_HANDLE
     return result;
 }
 
+static void deliver_message(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, MESSAGE_CALLBACK_INFO* messageData)
+{
+    if (!IoTHubClientCore_LL_MessageCallback(iotHubClientHandle, messageData))
+    {
+        LogError("IoTHubClientCore_LL_MessageCallback failed");
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClientCore_LL_MessageCallback returns false then _DoWork shall "abandon" the message.] */
+        (void)IoTHubTransportHttp_SendMessageDisposition(messageData, IOTHUBMESSAGE_ABANDONED);
+    }
+}
+
+static bool isPollingAllowed(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, time_t timeNow)
+{
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_123: [After client creation, the first GET shall be allowed no matter what the value of GetMinimumPollingTime.] */
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_124: [If time is not available then all calls shall be treated as if they are the first one.] */
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_122: [A GET request that happens earlier than GetMinimumPollingTime shall be ignored.] */
+    unsigned int requiredDelay = (deviceData->pollingDelay > handleData->getMinimumPollingTime) ? deviceData->pollingDelay : handleData->getMinimumPollingTime;
+    return deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > requiredDelay);
+}
+
+/*with MaximumPollingTime set, a device that just got a message polls again after MinimumPollingTime and every GET that
+comes back empty doubles the interval up to MaximumPollingTime. The jitter keeps devices registered together from polling in lockstep.*/
+static void scheduleNextPoll(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, bool wasMessageReceived)
+{
+    unsigned int jitter;
+
+    if (handleData->getMaximumPollingTime <= handleData->getMinimumPollingTime)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_42_001: [ When "MaximumPollingTime" is not larger than "MinimumPollingTime", the polling interval of a device shall be "MinimumPollingTime". ]*/
+        deviceData->pollingInterval = handleData->getMinimumPollingTime;
+    }
+    else if (wasMessageReceived || (deviceData->pollingInterval < handleData->getMinimumPollingTime))
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_42_002: [ Otherwise, a GET that returns a message shall reset the polling interval of the device to "MinimumPollingTime". ]*/
+        deviceData->pollingInterval = handleData->getMinimumPollingTime;
+    }
+    else if (deviceData->pollingInterval > handleData->getMaximumPollingTime / 2)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_42_003: [ Otherwise, a GET that returns no message shall double the polling interval of the device, up to "MaximumPollingTime". ]*/
+        deviceData->pollingInterval = handleData->getMaximumPollingTime;
+    }
+    else
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_42_003: [ Otherwise, a GET that returns no message shall double the polling interval of the device, up to "MaximumPollingTime". ]*/
+        deviceData->pollingInterval *= 2;
+    }
+
+    /*Codes_SRS_TRANSPORTMULTITHTTP_42_004: [ The time until the next GET of a device shall be its polling interval plus a random jitter of up to 1/4 of the polling interval. ]*/
+    jitter = (unsigned int)((deviceData->pollingInterval / POLLING_JITTER_DIVISOR) * (rand() / (double)RAND_MAX));
+    deviceData->pollingDelay = deviceData->pollingInterval + jitter;
+}
+
+/*rand is not called from the workers, the next poll of a device served concurrently is scheduled once the workers are joined*/
+static void poll_complete(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, bool wasMessageReceived)
+{
+    if (handleData->isDispatching)
+    {
+        deviceData->isPollToSchedule = true;
+        deviceData->wasMessageReceived = wasMessageReceived;
+    }
+    else
+    {
+        scheduleNextPoll(handleData, deviceData, wasMessageReceived);
+    }
+}
+
 static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_083: [ If device is not subscribed then _DoWork shall advance to the next action. ] */
     if (deviceData->DoWork_PullMessage)
     {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_123: [After client creation, the first GET shall be allowed no matter what the value of GetMinimumPollingTime.] */
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_124: [If time is not available then all calls shall be treated as if they are the first one.] */
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_122: [A GET request that happens earlier than GetMinimumPollingTime shall be ignored.] */
         time_t timeNow = get_time(NULL);
-        bool isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > handleData->getMinimumPollingTime);
-        if (isPollingAllowed)
+        if (isPollingAllowed(handleData, deviceData, timeNow))
         {
             HTTP_HEADERS_HANDLE responseHTTPHeaders = HTTPHeaders_Alloc();
             if (responseHTTPHeaders == NULL)
@@ -2038,7 +2430,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                             LogError("Unable to replace the old SAS Token.");
                         }
                         else if ((r = HTTPAPIEX_ExecuteRequest(
-                            handleData->httpApiExHandle,
+                            get_device_connection(handleData, deviceData),
                             HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
                             STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
                             deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
@@ -2064,7 +2456,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                     */
                     else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
                         deviceData->sasObject,
-                        handleData->httpApiExHandle,
+                        get_device_connection(handleData, deviceData),
                         HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
                         STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
                         deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
@@ -2089,6 +2481,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                             deviceData->isFirstPoll = false;
                             deviceData->lastPollTime = timeNow;
                         }
+                        poll_complete(handleData, deviceData, (statusCode == 200));
                         if (statusCode == 204)
                         {
                             /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
@@ -2100,6 +2493,12 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                         {
                             /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
                             LogError("expected status code was 200, but actually was received %u... moving on", statusCode);
+#ifdef USE_CLIENT_METRICS
+                            if (statusCode == 429)
+                            {
+                                IOTHUB_CLIENT_METRIC_ADD(iotHubClientHandle, IOTHUB_CLIENT_METRIC_THROTTLED, 1);
+                            }
+#endif
                         }
                         else
                         {
@@ -2259,24 +2658,14 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                                                         LogError("HTTP Transport layer failed to report ABANDON disposition");
                                                     }
                                                 }
+                                                else if (handleData->isDispatching)
+                                                {
+                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_41_002: [ While the devices are served concurrently, the workers shall not call IoTHubClientCore_LL_SendComplete nor IoTHubClientCore_LL_MessageCallback. ]*/
+                                                    deviceData->receivedMessage = messageData;
+                                                }
                                                 else
                                                 {
-                                                    bool abandon;
-                                                    if (IoTHubClientCore_LL_MessageCallback(iotHubClientHandle, messageData))
-                                                    {
-                                                        abandon = false;
-                                                    }
-                                                    else
-                                                    {
-                                                        LogError("IoTHubClientCore_LL_MessageCallback failed");
-                                                        abandon = true;
-                                                    }
-
-                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClientCore_LL_MessageCallback returns false then _DoWork shall "abandon" the message.] */
-                                                    if (abandon)
-                                                    {
-                                                        (void)IoTHubTransportHttp_SendMessageDisposition(messageData, IOTHUBMESSAGE_ABANDONED);
-                                                    }
+                                                    deliver_message(iotHubClientHandle, messageData);
                                                 }
                                             }
                                         }
@@ -2308,6 +2697,181 @@ static IOTHUB_PROCESS_ITEM_RESULT IoTHubTransportHttp_ProcessItem(TRANSPORT_LL_H
     return IOTHUB_PROCESS_ERROR;
 }
 
+static bool hasPendingWork(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, time_t timeNow)
+{
+    return !DList_IsListEmpty(deviceData->waitingToSend) || (deviceData->DoWork_PullMessage && isPollingAllowed(handleData, deviceData, timeNow));
+}
+
+static bool isPastDeadline(HTTPTRANSPORT_DISPATCH* dispatch)
+{
+    bool result;
+    tickcounter_ms_t nowMs;
+    if (!dispatch->hasDeadline)
+    {
+        result = false;
+    }
+    else if (tickcounter_get_current_ms(dispatch->handleData->tickCounter, &nowMs) != 0)
+    {
+        LogError("unable to tickcounter_get_current_ms");
+        result = false;
+    }
+    else
+    {
+        result = (nowMs - dispatch->passStartMs) >= dispatch->handleData->deviceDeadlineMs;
+    }
+    return result;
+}
+
+/*takes the next device of the pass until there is none left, the requests of a device all go over the worker's connection*/
+static void serveDevices(HTTPTRANSPORT_DISPATCH* dispatch, HTTPAPIEX_HANDLE connection)
+{
+    HTTPTRANSPORT_HANDLE_DATA* handleData = dispatch->handleData;
+    bool isDone = false;
+
+    while (!isDone)
+    {
+        size_t position;
+        (void)Lock(handleData->dispatchLock);
+        position = dispatch->nextPosition++;
+        (void)Unlock(handleData->dispatchLock);
+
+        if (position >= dispatch->deviceCount)
+        {
+            isDone = true;
+        }
+        else if (isPastDeadline(dispatch))
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_41_005: [ If OPTION_HTTP_DEVICE_DEADLINE_MS is not 0, the devices not started within it since the start of the pass shall be left to the next call to IoTHubTransportHttp_DoWork, which shall start with the first of them. ]*/
+            /*the device is served first by the next pass*/
+            (void)Lock(handleData->dispatchLock);
+            if (position < dispatch->firstDeferredPosition)
+            {
+                dispatch->firstDeferredPosition = position;
+            }
+            (void)Unlock(handleData->dispatchLock);
+        }
+        else
+        {
+            IOTHUB_DEVICE_HANDLE* listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, dispatch->deviceIndexes[position]);
+            HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+            perDeviceItem->httpApiExHandle = connection;
+            DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+            DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+            perDeviceItem->httpApiExHandle = NULL;
+        }
+    }
+}
+
+/*called on the thread calling DoWork once the pooled workers are done with the pass, in the order the devices were served. The confirmations come
+before the message like they do when DoWork serves the devices itself.*/
+static void completeDevice(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+    if (deviceData->isPollToSchedule)
+    {
+        deviceData->isPollToSchedule = false;
+        scheduleNextPoll(handleData, deviceData, deviceData->wasMessageReceived);
+    }
+
+    if (!DList_IsListEmpty(&(deviceData->completedEvents)))
+    {
+        IoTHubClientCore_LL_SendComplete(deviceData->iotHubClientHandle, &(deviceData->completedEvents), deviceData->completedEventsResult);
+    }
+
+    if (deviceData->receivedMessage != NULL)
+    {
+        /*the disposition of the message goes over httpApiExHandle*/
+        MESSAGE_CALLBACK_INFO* messageData = deviceData->receivedMessage;
+        deviceData->receivedMessage = NULL;
+        deliver_message(deviceData->iotHubClientHandle, messageData);
+    }
+}
+
+/*serves the devices that have something to send or to poll on up to 1 + pooledConnectionCount connections at the same time.
+Every pass starts one device further in perDeviceList than the previous one, or at the first device that missed the deadline,
+so that no device is always served last. Returns false when there is not enough work to dispatch, DoWork then serves the devices itself.*/
+static bool dispatchDevices(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t deviceListSize)
+{
+    bool result;
+    HTTPTRANSPORT_DISPATCH dispatch;
+    size_t startIndex = handleData->nextDeviceIndex % deviceListSize;
+    time_t timeNow = get_time(NULL);
+    size_t i;
+
+    dispatch.handleData = handleData;
+    dispatch.deviceCount = 0;
+    dispatch.nextPosition = 0;
+    dispatch.firstDeferredPosition = deviceListSize;
+
+    if ((dispatch.deviceIndexes = (size_t*)malloc(deviceListSize * sizeof(size_t))) == NULL)
+    {
+        LogError("unable to malloc");
+        result = false;
+    }
+    else
+    {
+        size_t workerCount;
+
+        for (i = 0; i < deviceListSize; i++)
+        {
+            size_t deviceIndex = (startIndex + i) % deviceListSize;
+            IOTHUB_DEVICE_HANDLE* listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, deviceIndex);
+            if (hasPendingWork(handleData, *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem), timeNow))
+            {
+                dispatch.deviceIndexes[dispatch.deviceCount++] = deviceIndex;
+            }
+        }
+
+        workerCount = (dispatch.deviceCount < handleData->pooledConnectionCount + 1) ? dispatch.deviceCount : handleData->pooledConnectionCount + 1;
+        if (workerCount < 2)
+        {
+            result = false;
+        }
+        else
+        {
+            dispatch.hasDeadline = (handleData->deviceDeadlineMs > 0) && (tickcounter_get_current_ms(handleData->tickCounter, &dispatch.passStartMs) == 0);
+            dispatch.pooledWorkerCount = workerCount - 1;
+            handleData->isDispatching = true;
+
+            /*Codes_SRS_TRANSPORTMULTITHTTP_41_001: [ If OPTION_HTTP_CONNECTION_POOL_SIZE is greater than 1 and more than one device has work to do, IoTHubTransportHttp_DoWork shall serve those devices on the calling thread and on the threads of the pooled connections, and wait for those threads to be done with them before IoTHubTransportHttp_DoWork returns. ]*/
+            (void)Lock(handleData->dispatchLock);
+            handleData->dispatch = &dispatch;
+            handleData->passNumber++;
+            handleData->busyWorkerCount = dispatch.pooledWorkerCount;
+            for (i = 0; i < dispatch.pooledWorkerCount; i++)
+            {
+                (void)Condition_Post(handleData->pooledWorkers[i]->passCondition);
+            }
+            (void)Unlock(handleData->dispatchLock);
+
+            /*the calling thread serves devices too, on httpApiExHandle*/
+            serveDevices(&dispatch, handleData->httpApiExHandle);
+
+            (void)Lock(handleData->dispatchLock);
+            while (handleData->busyWorkerCount > 0)
+            {
+                (void)Condition_Wait(handleData->passDoneCondition, handleData->dispatchLock, 0);
+            }
+            handleData->dispatch = NULL;
+            (void)Unlock(handleData->dispatchLock);
+
+            handleData->isDispatching = false;
+
+            /*Codes_SRS_TRANSPORTMULTITHTTP_41_003: [ Once the pooled threads are done with the pass, IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete and IoTHubClientCore_LL_MessageCallback for what they completed, on the calling thread. ]*/
+            for (i = 0; i < dispatch.deviceCount; i++)
+            {
+                IOTHUB_DEVICE_HANDLE* listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, dispatch.deviceIndexes[i]);
+                completeDevice(handleData, *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem));
+            }
+
+            /*Codes_SRS_TRANSPORTMULTITHTTP_41_004: [ Every pass shall start one device further in the device list than the previous pass. ]*/
+            handleData->nextDeviceIndex = (dispatch.firstDeferredPosition < dispatch.deviceCount) ? dispatch.deviceIndexes[dispatch.firstDeferredPosition] : startIndex + 1;
+            result = true;
+        }
+        free(dispatch.deviceIndexes);
+    }
+    return result;
+}
+
 static void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_049: [ If handle is NULL, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
@@ -2322,13 +2886,16 @@ static void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list, using the iotHubClientHandle field saved in the IOTHUB_DEVICE_HANDLE. ]*/
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
-        for (size_t i = 0; i < deviceListSize; i++)
+        if ((handleData->pooledConnectionCount == 0) || (deviceListSize < 2) || !dispatchDevices(handleData, deviceListSize))
         {
-            listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
-            HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
-            DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
-            DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+            for (size_t i = 0; i < deviceListSize; i++)
+            {
+                listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+                HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+                DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+                DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
 
+            }
         }
     }
     else
@@ -2413,6 +2980,43 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
             handleData->getMinimumPollingTime = *(unsigned int*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        else if (strcmp(OPTION_MAX_POLLING_TIME, option) == 0)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_42_006: [ "MaximumPollingTime" ]*/
+            handleData->getMaximumPollingTime = *(unsigned int*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(OPTION_HTTP_CONNECTION_POOL_SIZE, option) == 0)
+        {
+            unsigned int poolSize = *(unsigned int*)value;
+            if ((poolSize == 0) || (poolSize > MAXIMUM_CONNECTION_POOL_SIZE))
+            {
+                result = IOTHUB_CLIENT_INVALID_ARG;
+                LogError("connection pool size %u is not between 1 and %d", poolSize, MAXIMUM_CONNECTION_POOL_SIZE);
+            }
+            else if (resize_connectionPool(handleData, poolSize) != 0)
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("unable to resize the connection pool");
+            }
+            else
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        else if (strcmp(OPTION_HTTP_DEVICE_DEADLINE_MS, option) == 0)
+        {
+            if ((handleData->tickCounter == NULL) && ((handleData->tickCounter = tickcounter_create()) == NULL))
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("unable to tickcounter_create");
+            }
+            else
+            {
+                handleData->deviceDeadlineMs = *(unsigned int*)value;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
         else
         {
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_126: [ "TrustedCerts"] */
@@ -2421,8 +3025,15 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_118: [Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code.] */
             HTTPAPIEX_RESULT HTTPAPIEX_result = HTTPAPIEX_SetOption(handleData->httpApiExHandle, option, value);
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_119: [The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes:] */
+            size_t i;
+            for (i = 0; (HTTPAPIEX_result == HTTPAPIEX_OK) && (i < handleData->pooledConnectionCount); i++)
+            {
+                HTTPAPIEX_result = HTTPAPIEX_SetOption(handleData->pooledWorkers[i]->connection, option, value);
+            }
+
             if (HTTPAPIEX_result == HTTPAPIEX_OK)
             {
+                handleData->wereConnectionOptionsSet = true;
                 result = IOTHUB_CLIENT_OK;
             }
             else if (HTTPAPIEX_result == HTTPAPIEX_INVALID_ARG)
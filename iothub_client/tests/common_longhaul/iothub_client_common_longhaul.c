@@ -10,6 +10,7 @@
 #include "azure_c_shared_utility/platform.h"
 #include "azure_c_shared_utility/uuid.h"
 #include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "iothub_client_options.h"
 #include "iothub_client.h"
@@ -64,6 +65,7 @@ typedef struct IOTHUB_LONGHAUL_RESOURCES_TAG
     IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE iotHubSvcDevTwinHandle;
     IOTHUB_TEST_HANDLE iotHubTestHandle;
     IOTHUB_PROVISIONED_DEVICE* deviceInfo;
+    size_t number_of_sas_devices;
     unsigned int counter;
 } IOTHUB_LONGHAUL_RESOURCES;
 
@@ -720,11 +722,14 @@ void longhaul_tests_deinit(IOTHUB_LONGHAUL_RESOURCES_HANDLE handle)
     }
 }
 
-IOTHUB_LONGHAUL_RESOURCES_HANDLE longhaul_tests_init()
+static IOTHUB_LONGHAUL_RESOURCES* create_longhaul_resources(size_t number_of_sas_devices)
 {
     IOTHUB_LONGHAUL_RESOURCES* result;
+    IOTHUB_ACCOUNT_CONFIG account_config;
     UUID uuid;
 
+    account_config.number_of_sas_devices = number_of_sas_devices;
+
     if (UUID_generate(&uuid) != 0)
     {
         LogError("Failed to generate test ID number");
@@ -758,7 +763,7 @@ IOTHUB_LONGHAUL_RESOURCES_HANDLE longhaul_tests_init()
                 longhaul_tests_deinit(result);
                 result = NULL;
             }
-            else if ((result->iotHubAccountInfo = IoTHubAccount_Init()) == NULL)
+            else if ((result->iotHubAccountInfo = IoTHubAccount_Init_With_Config(&account_config)) == NULL)
             {
                 LogError("Failed initializing accounts");
                 longhaul_tests_deinit(result);
@@ -772,6 +777,7 @@ IOTHUB_LONGHAUL_RESOURCES_HANDLE longhaul_tests_init()
             }
             else
             {
+                result->number_of_sas_devices = number_of_sas_devices;
                 platform_init();
             }
         }
@@ -780,6 +786,62 @@ IOTHUB_LONGHAUL_RESOURCES_HANDLE longhaul_tests_init()
     return result;
 }
 
+IOTHUB_LONGHAUL_RESOURCES_HANDLE longhaul_tests_init()
+{
+    return create_longhaul_resources(1);
+}
+
+IOTHUB_LONGHAUL_RESOURCES_HANDLE longhaul_load_tests_init(size_t number_of_devices)
+{
+    IOTHUB_LONGHAUL_RESOURCES* result;
+
+    if (number_of_devices == 0)
+    {
+        LogError("Invalid argument (number_of_devices is 0)");
+        result = NULL;
+    }
+    else
+    {
+        result = create_longhaul_resources(number_of_devices);
+    }
+
+    return result;
+}
+
+static int set_device_client_options_and_callbacks(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul)
+{
+    int result;
+    bool trace = false;
+
+#ifdef SET_TRUSTED_CERT_IN_SAMPLES
+    (void)IoTHubClient_SetOption(iotHubClientHandle, OPTION_TRUSTED_CERT, certificates);
+#endif
+    (void)IoTHubClient_SetOption(iotHubClientHandle, OPTION_LOG_TRACE, &trace);
+    (void)IoTHubClient_SetOption(iotHubClientHandle, OPTION_PRODUCT_INFO, "C-SDK-LongHaul");
+
+    if (IoTHubClient_SetConnectionStatusCallback(iotHubClientHandle, connection_status_callback, iotHubLonghaul) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Failed setting the connection status callback");
+        result = __FAILURE__;
+    }
+    else if (IoTHubClient_SetMessageCallback(iotHubClientHandle, on_c2d_message_received, iotHubLonghaul) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Failed to set the cloud-to-device message callback");
+        result = __FAILURE__;
+    }
+    else if (IoTHubClient_SetDeviceMethodCallback(iotHubClientHandle, on_device_method_received, iotHubLonghaul) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Failed to set the device method callback");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_HANDLE longhaul_initialize_device_client(IOTHUB_LONGHAUL_RESOURCES_HANDLE handle, IOTHUB_PROVISIONED_DEVICE* deviceToUse, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol)
 {
     IOTHUB_CLIENT_HANDLE result;
@@ -801,44 +863,17 @@ IOTHUB_CLIENT_HANDLE longhaul_initialize_device_client(IOTHUB_LONGHAUL_RESOURCES
         IoTHubClient_Destroy(result);
         result = NULL;
     }
+    else if (set_device_client_options_and_callbacks(result, (IOTHUB_LONGHAUL_RESOURCES*)handle) != 0)
+    {
+        LogError("Failed setting the device client options and callbacks");
+        IoTHubClient_Destroy(result);
+        result = NULL;
+    }
     else
     {
-        bool trace = false;
-
         IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaulRsrcs = (IOTHUB_LONGHAUL_RESOURCES*)handle;
         iotHubLonghaulRsrcs->iotHubClientHandle = result;
-
-#ifdef SET_TRUSTED_CERT_IN_SAMPLES
-        (void)IoTHubClient_SetOption(result, OPTION_TRUSTED_CERT, certificates);
-#endif
-        (void)IoTHubClient_SetOption(result, OPTION_LOG_TRACE, &trace);
-        (void)IoTHubClient_SetOption(result, OPTION_PRODUCT_INFO, "C-SDK-LongHaul");
-
-        if (IoTHubClient_SetConnectionStatusCallback(result, connection_status_callback, handle) != IOTHUB_CLIENT_OK)
-        {
-            LogError("Failed setting the connection status callback");
-            IoTHubClient_Destroy(result);
-            iotHubLonghaulRsrcs->iotHubClientHandle = NULL;
-            result = NULL;
-        }
-        else if (IoTHubClient_SetMessageCallback(result, on_c2d_message_received, handle) != IOTHUB_CLIENT_OK)
-        {
-            LogError("Failed to set the cloud-to-device message callback");
-            IoTHubClient_Destroy(result);
-            iotHubLonghaulRsrcs->iotHubClientHandle = NULL;
-            result = NULL;
-        }
-        else if (IoTHubClient_SetDeviceMethodCallback(result, on_device_method_received, handle) != IOTHUB_CLIENT_OK)
-        {
-            LogError("Failed to set the device method callback");
-            IoTHubClient_Destroy(result);
-            iotHubLonghaulRsrcs->iotHubClientHandle = NULL;
-            result = NULL;
-        }
-        else
-        {
-            iotHubLonghaulRsrcs->deviceInfo = deviceToUse;
-        }
+        iotHubLonghaulRsrcs->deviceInfo = deviceToUse;
     }
 
     return result;
@@ -1242,10 +1277,9 @@ static void on_c2d_message_sent(void* context, IOTHUB_MESSAGING_RESULT messaging
     }
 }
 
-static int send_c2d(const void* context)
+static int send_c2d_to_device(IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul, const char* device_id)
 {
     int result;
-    IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul = (IOTHUB_LONGHAUL_RESOURCES*)context;
     unsigned int message_id;
 
     if ((message_id = generate_unique_id(iotHubLonghaul)) == 0)
@@ -1273,31 +1307,39 @@ static int send_c2d(const void* context)
             }
             else
             {
+                C2D_MESSAGE_INFO c2d_msg_info;
+                c2d_msg_info.message_id = message_id;
+                c2d_msg_info.time_queued = time(NULL);
+                c2d_msg_info.send_result = 0;
+
                 send_context->message_id = message_id;
                 send_context->iotHubLonghaul = iotHubLonghaul;
 
-                if (IoTHubMessaging_SendAsync(iotHubLonghaul->iotHubSvcMsgHandle, iotHubLonghaul->deviceInfo->deviceId, message, on_c2d_message_sent, send_context) != IOTHUB_MESSAGING_OK)
+                // Queued before sending, the send callback runs on the messaging thread and may come first otherwise.
+                if (iothub_client_statistics_add_c2d_info(iotHubLonghaul->iotHubClientStats, C2D_QUEUED, &c2d_msg_info) != 0)
                 {
-                    LogError("Failed sending c2d message");
+                    LogError("Failed adding c2d message statistics info (message_id=%d)", message_id);
                     free(send_context);
                     result = __FAILURE__;
                 }
-                else
+                else if (IoTHubMessaging_SendAsync(iotHubLonghaul->iotHubSvcMsgHandle, device_id, message, on_c2d_message_sent, send_context) != IOTHUB_MESSAGING_OK)
                 {
-                    result = 0;
-                }
+                    LogError("Failed sending c2d message");
+                    free(send_context);
 
-                {
-                    C2D_MESSAGE_INFO c2d_msg_info;
-                    c2d_msg_info.message_id = message_id;
-                    c2d_msg_info.time_queued = time(NULL);
-                    c2d_msg_info.send_result = result;
+                    c2d_msg_info.send_callback_result = IOTHUB_MESSAGING_ERROR;
+                    c2d_msg_info.time_sent = c2d_msg_info.time_queued;
 
-                    if (iothub_client_statistics_add_c2d_info(iotHubLonghaul->iotHubClientStats, C2D_QUEUED, &c2d_msg_info) != 0)
+                    if (iothub_client_statistics_add_c2d_info(iotHubLonghaul->iotHubClientStats, C2D_SENT, &c2d_msg_info) != 0)
                     {
-                        LogError("Failed adding c2d message statistics info (message_id=%d)", message_id);
-                        result = __FAILURE__;
+                        LogError("Failed adding send info for c2d message %d", message_id);
                     }
+
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    result = 0;
                 }
             }
 
@@ -1308,59 +1350,78 @@ static int send_c2d(const void* context)
     return result;
 }
 
-static int invoke_device_method(const void* context)
+static int send_c2d(const void* context)
 {
-    int result;
     IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul = (IOTHUB_LONGHAUL_RESOURCES*)context;
-    unsigned int method_id;
 
-    if ((method_id = generate_unique_id(iotHubLonghaul)) == 0)
+    return send_c2d_to_device(iotHubLonghaul, iotHubLonghaul->deviceInfo->deviceId);
+}
+
+static int invoke_device_method_on_device(IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul, IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE method_handle, const char* device_id, unsigned int method_id, double time_invoked)
+{
+    int result;
+    char* message;
+
+    if ((message = create_message(iotHubLonghaul->test_id, method_id)) == NULL)
     {
-        LogError("Failed generating device method id");
+        LogError("Failed creating C2D message text");
         result = __FAILURE__;
     }
     else
     {
-        char* message;
+        int responseStatus;
+        unsigned char* responsePayload = NULL;
+        size_t responseSize;
 
-        if ((message = create_message(iotHubLonghaul->test_id, method_id)) == NULL)
+        DEVICE_METHOD_INFO device_method_info;
+        device_method_info.method_id = method_id;
+        device_method_info.time_invoked = time_invoked;
+
+        if ((device_method_info.method_result = IoTHubDeviceMethod_Invoke(
+            method_handle,
+            device_id,
+            LONGHAUL_DEVICE_METHOD_NAME,
+            message,
+            MAX_DEVICE_METHOD_TRAVEL_TIME_SECS,
+            &responseStatus, &responsePayload, &responseSize)) != IOTHUB_DEVICE_METHOD_OK)
         {
-            LogError("Failed creating C2D message text");
+            LogError("Failed invoking device method");
+        }
+        else
+        {
+            free(responsePayload);
+        }
+
+        if (iothub_client_statistics_add_device_method_info(iotHubLonghaul->iotHubClientStats, DEVICE_METHOD_INVOKED, &device_method_info) != 0)
+        {
+            LogError("Failed adding device method statistics info (method_id=%d)", method_id);
             result = __FAILURE__;
         }
         else
         {
-            int responseStatus;
-            unsigned char* responsePayload;
-            size_t responseSize;
+            result = 0;
+        }
 
-            DEVICE_METHOD_INFO device_method_info;
-            device_method_info.method_id = method_id;
-            device_method_info.time_invoked = time(NULL);
+        free(message);
+    }
 
-            if ((device_method_info.method_result = IoTHubDeviceMethod_Invoke(
-                iotHubLonghaul->iotHubSvcDevMethodHandle, 
-                iotHubLonghaul->deviceInfo->deviceId, 
-                LONGHAUL_DEVICE_METHOD_NAME, 
-                message, 
-                MAX_DEVICE_METHOD_TRAVEL_TIME_SECS, 
-                &responseStatus, &responsePayload, &responseSize)) != IOTHUB_DEVICE_METHOD_OK)
-            {
-                LogError("Failed invoking device method");
-            }
+    return result;
+}
 
-            if (iothub_client_statistics_add_device_method_info(iotHubLonghaul->iotHubClientStats, DEVICE_METHOD_INVOKED, &device_method_info) != 0)
-            {
-                LogError("Failed adding device method statistics info (method_id=%d)", method_id);
-                result = __FAILURE__;
-            }
-            else
-            {
-                result = 0;
-            }
+static int invoke_device_method(const void* context)
+{
+    int result;
+    IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul = (IOTHUB_LONGHAUL_RESOURCES*)context;
+    unsigned int method_id;
 
-            free(message);
-        }
+    if ((method_id = generate_unique_id(iotHubLonghaul)) == 0)
+    {
+        LogError("Failed generating device method id");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = invoke_device_method_on_device(iotHubLonghaul, iotHubLonghaul->iotHubSvcDevMethodHandle, iotHubLonghaul->deviceInfo->deviceId, method_id, time(NULL));
     }
 
     return result;
@@ -1397,72 +1458,77 @@ static int get_twin_desired_version(const char* twin)
     return result;
 }
 
-static int update_device_twin_desired_property(const void* context)
+static int update_device_twin_desired_property_on_device(IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul, IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE twin_handle, const char* device_id, unsigned int update_id, double time_updated)
 {
     int result;
-    IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul = (IOTHUB_LONGHAUL_RESOURCES*)context;
-    unsigned int update_id;
+    char* message;
 
-    if ((update_id = generate_unique_id(iotHubLonghaul)) == 0)
+    if ((message = create_twin_desired_properties_update(iotHubLonghaul->test_id, update_id)) == NULL)
     {
-        LogError("Failed generating device method id");
+        LogError("Failed creating twin desired property update");
         result = __FAILURE__;
     }
     else
     {
-        char* message;
+        char* update_response;
+        DEVICE_TWIN_DESIRED_INFO device_twin_info;
+        device_twin_info.update_id = update_id;
+        device_twin_info.time_updated = time_updated;
 
-        if ((message = create_twin_desired_properties_update(iotHubLonghaul->test_id, update_id)) == NULL)
+        if ((update_response = IoTHubDeviceTwin_UpdateTwin(twin_handle, device_id, message)) == NULL)
         {
-            LogError("Failed creating twin desired property update");
-            result = __FAILURE__;
+            LogError("Failed sending twin desired properties update");
+            device_twin_info.update_result = -1;
         }
         else
         {
-            char* update_response;
-            DEVICE_TWIN_DESIRED_INFO device_twin_info;
-            device_twin_info.update_id = update_id;
-            device_twin_info.time_updated = time(NULL);
+            device_twin_info.update_result = get_twin_desired_version(update_response);
+            free(update_response);
+        }
 
-            if ((update_response = IoTHubDeviceTwin_UpdateTwin(
-                iotHubLonghaul->iotHubSvcDevTwinHandle,
-                iotHubLonghaul->deviceInfo->deviceId,
-                message)) == NULL)
+        if (Lock(iotHubLonghaul->lock) != LOCK_OK)
+        {
+            LogError("Failed locking (%s, %d)", iotHubLonghaul->test_id, update_id);
+            result = __FAILURE__;
+        }
+        else
+        {
+            if (iothub_client_statistics_add_device_twin_desired_info(iotHubLonghaul->iotHubClientStats, DEVICE_TWIN_UPDATE_SENT, &device_twin_info) != 0)
             {
-                LogError("Failed sending twin desired properties update");
-                device_twin_info.update_result = -1;
+                LogError("Failed adding twin reported properties statistics info (update_id=%d)", update_id);
+                result = __FAILURE__;
             }
             else
             {
-                device_twin_info.update_result = get_twin_desired_version(update_response);
-                free(update_response);
+                result = 0;
             }
 
-            if (Lock(iotHubLonghaul->lock) != LOCK_OK)
+            if (Unlock(iotHubLonghaul->lock) != LOCK_OK)
             {
-                LogError("Failed locking (%s, %d)", iotHubLonghaul->test_id, update_id);
-                result = __FAILURE__;
+                LogError("Failed unlocking (%s, %d)", iotHubLonghaul->test_id, update_id);
             }
-            else
-            {
-                if (iothub_client_statistics_add_device_twin_desired_info(iotHubLonghaul->iotHubClientStats, DEVICE_TWIN_UPDATE_SENT, &device_twin_info) != 0)
-                {
-                    LogError("Failed adding twin reported properties statistics info (update_id=%d)", update_id);
-                    result = __FAILURE__;
-                }
-                else
-                {
-                    result = 0;
-                }
+        }
 
-                if (Unlock(iotHubLonghaul->lock) != LOCK_OK)
-                {
-                    LogError("Failed unlocking (%s, %d)", iotHubLonghaul->test_id, update_id);
-                }
-            }
+        free(message);
+    }
 
-            free(message);
-        }
+    return result;
+}
+
+static int update_device_twin_desired_property(const void* context)
+{
+    int result;
+    IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul = (IOTHUB_LONGHAUL_RESOURCES*)context;
+    unsigned int update_id;
+
+    if ((update_id = generate_unique_id(iotHubLonghaul)) == 0)
+    {
+        LogError("Failed generating device method id");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = update_device_twin_desired_property_on_device(iotHubLonghaul, iotHubLonghaul->iotHubSvcDevTwinHandle, iotHubLonghaul->deviceInfo->deviceId, update_id, time(NULL));
     }
 
     return result;
@@ -2032,4 +2098,1069 @@ int longhaul_run_twin_reported_properties_tests(IOTHUB_LONGHAUL_RESOURCES_HANDLE
     }
 
     return result;
-}
\ No newline at end of file
+}
+
+// Load generation
+
+#define LOAD_SERVICE_QUEUE_SIZE         1024
+#define LOAD_SERVICE_IDLE_WAIT_MS       10
+#define LOAD_SCHEDULER_MAX_WAIT_MS      100
+#define LOAD_LATE_THRESHOLD_MS          1000
+#define LOAD_DRAIN_TIME_SECS            60
+
+typedef enum LOAD_OPERATION_TAG
+{
+    LOAD_TELEMETRY,
+    LOAD_C2D,
+    LOAD_DEVICE_METHOD,
+    LOAD_TWIN_DESIRED,
+    LOAD_TWIN_REPORTED,
+    LOAD_OPERATION_COUNT
+} LOAD_OPERATION;
+
+static const char* LOAD_OPERATION_NAMES[LOAD_OPERATION_COUNT] = { "telemetry", "c2d", "device methods", "twin desired", "twin reported" };
+
+static const double LOAD_OPERATION_MAX_TRAVEL_TIME_SECS[LOAD_OPERATION_COUNT] =
+{
+    MAX_TELEMETRY_TRAVEL_TIME_SECS,
+    MAX_C2D_TRAVEL_TIME_SECS,
+    MAX_DEVICE_METHOD_TRAVEL_TIME_SECS,
+    MAX_TWIN_DESIRED_PROP_TRAVEL_TIME_SECS,
+    MAX_TWIN_REPORTED_PROP_TRAVEL_TIME_SECS
+};
+
+typedef struct LOAD_DEVICE_TAG
+{
+    IOTHUB_PROVISIONED_DEVICE* deviceInfo;
+    IOTHUB_CLIENT_HANDLE iotHubClientHandle;
+} LOAD_DEVICE;
+
+typedef struct LOAD_SCHEDULE_TAG
+{
+    double interval_ms;
+    double next_due_ms;     // Since the start of the run.
+    size_t next_device;
+    size_t issued;
+    size_t issued_late;
+    size_t failed_to_issue;
+    size_t dropped;         // Service calls that did not fit in the queue of the service threads.
+} LOAD_SCHEDULE;
+
+typedef struct LOAD_SERVICE_REQUEST_TAG
+{
+    LOAD_OPERATION operation;
+    LOAD_DEVICE* device;
+    unsigned int id;
+    double time_started;
+} LOAD_SERVICE_REQUEST;
+
+typedef struct LOAD_RUN_TAG LOAD_RUN;
+
+typedef struct LOAD_SERVICE_WORKER_TAG
+{
+    LOAD_RUN* load;
+    THREAD_HANDLE thread;
+    IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE iotHubSvcDevMethodHandle;
+    IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE iotHubSvcDevTwinHandle;
+} LOAD_SERVICE_WORKER;
+
+struct LOAD_RUN_TAG
+{
+    IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul;
+    const LONGHAUL_LOAD_PROFILE* profile;
+    LOAD_DEVICE* devices;
+    TRANSPORT_HANDLE* transports;
+    size_t transport_count;
+    LOAD_SERVICE_WORKER* workers;
+    LOAD_SCHEDULE schedules[LOAD_OPERATION_COUNT];
+
+    // The wall clock at the start of the run plus the tick counter stamps the load events with millisecond resolution.
+    TICK_COUNTER_HANDLE tick_counter;
+    time_t start_time;
+    tickcounter_ms_t start_ms;
+
+    // Service calls that block run on the service threads, so they never hold back the schedule.
+    LOCK_HANDLE lock;
+    bool is_running;
+    LOAD_SERVICE_REQUEST service_requests[LOAD_SERVICE_QUEUE_SIZE];
+    size_t first_service_request;
+    size_t service_request_count;
+};
+
+typedef struct LOAD_SEND_CONTEXT_TAG
+{
+    LOAD_RUN* load;
+    LOAD_DEVICE* device;
+    unsigned int id;
+    double time_queued;
+} LOAD_SEND_CONTEXT;
+
+// Milliseconds since the start of the run, negative if the tick counter could not be read.
+static double get_load_elapsed_ms(LOAD_RUN* load)
+{
+    double result;
+    tickcounter_ms_t current_ms;
+
+    // Read by the scheduler and by the client callbacks.
+    if (Lock(load->lock) != LOCK_OK)
+    {
+        LogError("Failed locking the load tick counter");
+        result = -1;
+    }
+    else
+    {
+        if (tickcounter_get_current_ms(load->tick_counter, &current_ms) != 0)
+        {
+            LogError("Failed reading the load tick counter");
+            result = -1;
+        }
+        else
+        {
+            result = (double)(current_ms - load->start_ms);
+        }
+
+        if (Unlock(load->lock) != LOCK_OK)
+        {
+            LogError("Failed unlocking the load tick counter");
+        }
+    }
+
+    return result;
+}
+
+static double get_load_time(const LOAD_RUN* load, double elapsed_ms)
+{
+    return (elapsed_ms < 0 ? (double)INDEFINITE_TIME : (double)load->start_time + elapsed_ms / 1000.0);
+}
+
+static LOAD_SEND_CONTEXT* create_load_send_context(LOAD_RUN* load, LOAD_DEVICE* device, unsigned int id, double time_queued)
+{
+    LOAD_SEND_CONTEXT* result;
+
+    if ((result = (LOAD_SEND_CONTEXT*)malloc(sizeof(LOAD_SEND_CONTEXT))) == NULL)
+    {
+        LogError("Failed allocating the load send context");
+    }
+    else
+    {
+        result->load = load;
+        result->device = device;
+        result->id = id;
+        result->time_queued = time_queued;
+    }
+
+    return result;
+}
+
+static int enqueue_load_service_request(LOAD_RUN* load, LOAD_OPERATION operation, LOAD_DEVICE* device, unsigned int id, double time_started)
+{
+    int result;
+
+    if (Lock(load->lock) != LOCK_OK)
+    {
+        LogError("Failed locking the load service requests");
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (load->service_request_count == LOAD_SERVICE_QUEUE_SIZE)
+        {
+            load->schedules[operation].dropped++;
+            result = __FAILURE__;
+        }
+        else
+        {
+            LOAD_SERVICE_REQUEST* request = &load->service_requests[(load->first_service_request + load->service_request_count) % LOAD_SERVICE_QUEUE_SIZE];
+            request->operation = operation;
+            request->device = device;
+            request->id = id;
+            request->time_started = time_started;
+            load->service_request_count++;
+            result = 0;
+        }
+
+        if (Unlock(load->lock) != LOCK_OK)
+        {
+            LogError("Failed unlocking the load service requests");
+        }
+    }
+
+    return result;
+}
+
+static bool dequeue_load_service_request(LOAD_RUN* load, LOAD_SERVICE_REQUEST* request, bool* is_running)
+{
+    bool result;
+
+    if (Lock(load->lock) != LOCK_OK)
+    {
+        LogError("Failed locking the load service requests");
+        result = false;
+    }
+    else
+    {
+        if (load->service_request_count == 0)
+        {
+            result = false;
+        }
+        else
+        {
+            *request = load->service_requests[load->first_service_request];
+            load->first_service_request = (load->first_service_request + 1) % LOAD_SERVICE_QUEUE_SIZE;
+            load->service_request_count--;
+            result = true;
+        }
+
+        *is_running = load->is_running;
+
+        if (Unlock(load->lock) != LOCK_OK)
+        {
+            LogError("Failed unlocking the load service requests");
+        }
+    }
+
+    return result;
+}
+
+static void check_load_twin_reported_update(LOAD_SERVICE_WORKER* worker, const LOAD_SERVICE_REQUEST* request)
+{
+    IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul = worker->load->iotHubLonghaul;
+    char* twin;
+
+    if ((twin = IoTHubDeviceTwin_GetTwin(worker->iotHubSvcDevTwinHandle, request->device->deviceInfo->deviceId)) == NULL)
+    {
+        LogError("Failed getting the twin document of device %s", request->device->deviceInfo->deviceId);
+    }
+    else
+    {
+        int property_count;
+        unsigned int message_id;
+        char test_id[40];
+        int version;
+
+        if (parse_twin_reported_properties(twin, &property_count, test_id, &message_id, &version) != 0)
+        {
+            LogError("Failed parsing the device twin reported properties");
+        }
+        // Ids only grow and the updates of a device are applied in order, so a later update in the twin means this one was applied too.
+        else if (property_count == 2 && strcmp(test_id, iotHubLonghaul->test_id) == 0 && message_id >= request->id)
+        {
+            DEVICE_TWIN_REPORTED_INFO info;
+            info.update_id = request->id;
+            info.time_received = get_load_time(worker->load, get_load_elapsed_ms(worker->load));
+
+            if (info.time_received == INDEFINITE_TIME)
+            {
+                LogError("Failed setting the receive time for twin update %d", info.update_id);
+            }
+
+            if (iothub_client_statistics_add_device_twin_reported_info(iotHubLonghaul->iotHubClientStats, DEVICE_TWIN_UPDATE_RECEIVED, &info) != 0)
+            {
+                LogError("Failed adding receive info for twin update %d", info.update_id);
+            }
+        }
+        else
+        {
+            LogError("Twin update %d not found on the service side (device %s)", request->id, request->device->deviceInfo->deviceId);
+        }
+
+        free(twin);
+    }
+}
+
+static int run_load_service_requests(void* context)
+{
+    LOAD_SERVICE_WORKER* worker = (LOAD_SERVICE_WORKER*)context;
+    IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul = worker->load->iotHubLonghaul;
+    LOAD_SERVICE_REQUEST request;
+    bool has_request;
+    bool is_running;
+
+    // Once the run is over the requests left in the queue are still served.
+    do
+    {
+        if ((has_request = dequeue_load_service_request(worker->load, &request, &is_running)))
+        {
+            if (request.operation == LOAD_DEVICE_METHOD)
+            {
+                (void)invoke_device_method_on_device(iotHubLonghaul, worker->iotHubSvcDevMethodHandle, request.device->deviceInfo->deviceId, request.id, request.time_started);
+            }
+            else if (request.operation == LOAD_TWIN_DESIRED)
+            {
+                (void)update_device_twin_desired_property_on_device(iotHubLonghaul, worker->iotHubSvcDevTwinHandle, request.device->deviceInfo->deviceId, request.id, request.time_started);
+            }
+            else
+            {
+                check_load_twin_reported_update(worker, &request);
+            }
+        }
+        else if (is_running)
+        {
+            ThreadAPI_Sleep(LOAD_SERVICE_IDLE_WAIT_MS);
+        }
+    } while (has_request || is_running);
+
+    return 0;
+}
+
+static void on_load_telemetry_confirmed(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    if (userContextCallback == NULL)
+    {
+        LogError("Invalid argument (userContextCallback is NULL)");
+    }
+    else
+    {
+        LOAD_SEND_CONTEXT* send_context = (LOAD_SEND_CONTEXT*)userContextCallback;
+        IOTHUB_CLIENT_STATISTICS_HANDLE stats = send_context->load->iotHubLonghaul->iotHubClientStats;
+
+        TELEMETRY_INFO telemetry_info;
+        telemetry_info.message_id = send_context->id;
+        telemetry_info.send_callback_result = result;
+        telemetry_info.time_sent = send_context->time_queued;
+
+        if (iothub_client_statistics_add_telemetry_info(stats, TELEMETRY_SENT, &telemetry_info) != 0)
+        {
+            LogError("Failed adding telemetry statistics info (message_id=%d)", send_context->id);
+        }
+        else if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+        {
+            // There is no event hub listener per device, the acknowledgement of IoT Hub stands for the arrival.
+            telemetry_info.time_received = get_load_time(send_context->load, get_load_elapsed_ms(send_context->load));
+
+            if (iothub_client_statistics_add_telemetry_info(stats, TELEMETRY_RECEIVED, &telemetry_info) != 0)
+            {
+                LogError("Failed adding receive info for message %d", send_context->id);
+            }
+        }
+
+        free(send_context);
+    }
+}
+
+static int send_load_telemetry(LOAD_RUN* load, LOAD_DEVICE* device, double time_scheduled)
+{
+    int result;
+    IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul = load->iotHubLonghaul;
+    unsigned int message_id;
+
+    if ((message_id = generate_unique_id(iotHubLonghaul)) == 0)
+    {
+        LogError("Failed generating telemetry message id");
+        result = __FAILURE__;
+    }
+    else
+    {
+        IOTHUB_MESSAGE_HANDLE message;
+
+        if ((message = create_iothub_message(iotHubLonghaul->test_id, message_id)) == NULL)
+        {
+            LogError("Failed creating telemetry message");
+            result = __FAILURE__;
+        }
+        else
+        {
+            LOAD_SEND_CONTEXT* send_context;
+
+            if ((send_context = create_load_send_context(load, device, message_id, time_scheduled)) == NULL)
+            {
+                LogError("Failed allocating context for telemetry message");
+                result = __FAILURE__;
+            }
+            else
+            {
+                TELEMETRY_INFO telemetry_info;
+                telemetry_info.message_id = message_id;
+                telemetry_info.time_queued = time_scheduled;
+                telemetry_info.send_result = 0;
+
+                // Queued before sending, the confirmation runs on the client thread and may come first otherwise.
+                if (iothub_client_statistics_add_telemetry_info(iotHubLonghaul->iotHubClientStats, TELEMETRY_QUEUED, &telemetry_info) != 0)
+                {
+                    LogError("Failed adding telemetry statistics info (message_id=%d)", message_id);
+                    free(send_context);
+                    result = __FAILURE__;
+                }
+                else if (IoTHubClient_SendEventAsync(device->iotHubClientHandle, message, on_load_telemetry_confirmed, send_context) != IOTHUB_CLIENT_OK)
+                {
+                    LogError("Failed sending telemetry message");
+                    free(send_context);
+
+                    telemetry_info.send_callback_result = IOTHUB_CLIENT_CONFIRMATION_ERROR;
+                    telemetry_info.time_sent = time_scheduled;
+
+                    if (iothub_client_statistics_add_telemetry_info(iotHubLonghaul->iotHubClientStats, TELEMETRY_SENT, &telemetry_info) != 0)
+                    {
+                        LogError("Failed adding telemetry statistics info (message_id=%d)", message_id);
+                    }
+
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    result = 0;
+                }
+            }
+
+            IoTHubMessage_Destroy(message);
+        }
+    }
+
+    return result;
+}
+
+static void on_load_twin_report_state_completed(int status_code, void* userContextCallback)
+{
+    if (userContextCallback == NULL)
+    {
+        LogError("Invalid argument (userContextCallback=NULL)");
+    }
+    else
+    {
+        LOAD_SEND_CONTEXT* send_context = (LOAD_SEND_CONTEXT*)userContextCallback;
+        DEVICE_TWIN_REPORTED_INFO device_twin_info;
+        device_twin_info.update_id = send_context->id;
+        device_twin_info.time_sent = send_context->time_queued;
+        device_twin_info.send_status_code = status_code;
+
+        if (iothub_client_statistics_add_device_twin_reported_info(send_context->load->iotHubLonghaul->iotHubClientStats, DEVICE_TWIN_UPDATE_SENT, &device_twin_info) != 0)
+        {
+            LogError("Failed adding device twin reported properties statistics info (update_id=%d)", send_context->id);
+        }
+        else if (status_code >= 200 && status_code < 300 &&
+            enqueue_load_service_request(send_context->load, LOAD_TWIN_REPORTED, send_context->device, send_context->id, send_context->time_queued) != 0)
+        {
+            LogError("Failed queueing the service side check of twin update %d", send_context->id);
+        }
+
+        free(send_context);
+    }
+}
+
+static int send_load_twin_reported_update(LOAD_RUN* load, LOAD_DEVICE* device, double time_scheduled)
+{
+    int result;
+    IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul = load->iotHubLonghaul;
+    unsigned int update_id;
+
+    if ((update_id = generate_unique_id(iotHubLonghaul)) == 0)
+    {
+        LogError("Failed generating twin update id");
+        result = __FAILURE__;
+    }
+    else
+    {
+        char* message;
+
+        if ((message = create_message(iotHubLonghaul->test_id, update_id)) == NULL)
+        {
+            LogError("Failed creating twin reported property update");
+            result = __FAILURE__;
+        }
+        else
+        {
+            LOAD_SEND_CONTEXT* send_context;
+
+            if ((send_context = create_load_send_context(load, device, update_id, time_scheduled)) == NULL)
+            {
+                LogError("Failed allocating context for sending twin reported update");
+                result = __FAILURE__;
+            }
+            else
+            {
+                DEVICE_TWIN_REPORTED_INFO device_twin_info;
+                device_twin_info.update_id = update_id;
+                device_twin_info.time_queued = time_scheduled;
+                device_twin_info.update_result = IOTHUB_CLIENT_OK;
+
+                if (iothub_client_statistics_add_device_twin_reported_info(iotHubLonghaul->iotHubClientStats, DEVICE_TWIN_UPDATE_QUEUED, &device_twin_info) != 0)
+                {
+                    LogError("Failed adding device twin reported properties statistics info (update_id=%d)", update_id);
+                    free(send_context);
+                    result = __FAILURE__;
+                }
+                else if (IoTHubClient_SendReportedState(device->iotHubClientHandle, (const unsigned char*)message, strlen(message), on_load_twin_report_state_completed, send_context) != IOTHUB_CLIENT_OK)
+                {
+                    LogError("Failed sending twin reported properties update");
+                    free(send_context);
+
+                    device_twin_info.time_sent = time_scheduled;
+                    device_twin_info.send_status_code = -1;
+
+                    if (iothub_client_statistics_add_device_twin_reported_info(iotHubLonghaul->iotHubClientStats, DEVICE_TWIN_UPDATE_SENT, &device_twin_info) != 0)
+                    {
+                        LogError("Failed adding device twin reported properties statistics info (update_id=%d)", update_id);
+                    }
+
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    result = 0;
+                }
+            }
+
+            free(message);
+        }
+    }
+
+    return result;
+}
+
+static int issue_load_operation(LOAD_RUN* load, LOAD_OPERATION operation, LOAD_DEVICE* device, double time_scheduled)
+{
+    int result;
+
+    if (operation == LOAD_TELEMETRY)
+    {
+        result = send_load_telemetry(load, device, time_scheduled);
+    }
+    else if (operation == LOAD_C2D)
+    {
+        result = send_c2d_to_device(load->iotHubLonghaul, device->deviceInfo->deviceId);
+    }
+    else if (operation == LOAD_TWIN_REPORTED)
+    {
+        result = send_load_twin_reported_update(load, device, time_scheduled);
+    }
+    else
+    {
+        unsigned int id;
+
+        if ((id = generate_unique_id(load->iotHubLonghaul)) == 0)
+        {
+            LogError("Failed generating %s id", LOAD_OPERATION_NAMES[operation]);
+            result = __FAILURE__;
+        }
+        else
+        {
+            // Dropped requests are counted by the queue and not added to the statistics.
+            result = enqueue_load_service_request(load, operation, device, id, time_scheduled);
+        }
+    }
+
+    return result;
+}
+
+static int run_load_schedule(LOAD_RUN* load, size_t totalDurationInSeconds)
+{
+    int result;
+
+    if ((load->start_time = time(NULL)) == INDEFINITE_TIME || tickcounter_get_current_ms(load->tick_counter, &load->start_ms) != 0)
+    {
+        LogError("Failed setting the load start time");
+        result = __FAILURE__;
+    }
+    else
+    {
+        double total_ms = 1000.0 * totalDurationInSeconds;
+        double elapsed_ms = 0;
+
+        result = 0;
+
+        while (result == 0 && elapsed_ms < total_ms)
+        {
+            double next_due_ms = total_ms;
+            size_t i;
+
+            for (i = 0; i < LOAD_OPERATION_COUNT; i++)
+            {
+                LOAD_SCHEDULE* schedule = &load->schedules[i];
+
+                if (schedule->interval_ms > 0)
+                {
+                    // Everything that is due gets issued, however late, so the offered load does not drop when the hub slows down.
+                    while (schedule->next_due_ms <= elapsed_ms)
+                    {
+                        double time_scheduled = get_load_time(load, schedule->next_due_ms);
+
+                        if (elapsed_ms - schedule->next_due_ms > LOAD_LATE_THRESHOLD_MS)
+                        {
+                            schedule->issued_late++;
+                        }
+
+                        if (issue_load_operation(load, (LOAD_OPERATION)i, &load->devices[schedule->next_device], time_scheduled) != 0)
+                        {
+                            schedule->failed_to_issue++;
+                        }
+
+                        schedule->issued++;
+                        schedule->next_device = (schedule->next_device + 1) % load->profile->number_of_devices;
+                        schedule->next_due_ms += schedule->interval_ms;
+                    }
+
+                    if (schedule->next_due_ms < next_due_ms)
+                    {
+                        next_due_ms = schedule->next_due_ms;
+                    }
+                }
+            }
+
+            if (next_due_ms > elapsed_ms)
+            {
+                double wait_ms = next_due_ms - elapsed_ms;
+                ThreadAPI_Sleep((unsigned int)(wait_ms < LOAD_SCHEDULER_MAX_WAIT_MS ? wait_ms : LOAD_SCHEDULER_MAX_WAIT_MS));
+            }
+
+            if ((elapsed_ms = get_load_elapsed_ms(load)) < 0)
+            {
+                result = __FAILURE__;
+            }
+        }
+    }
+
+    return result;
+}
+
+static void destroy_load_run(LOAD_RUN* load)
+{
+    if (load->workers != NULL)
+    {
+        size_t i;
+
+        for (i = 0; i < load->profile->service_threads; i++)
+        {
+            if (load->workers[i].iotHubSvcDevTwinHandle != NULL)
+            {
+                IoTHubDeviceTwin_Destroy(load->workers[i].iotHubSvcDevTwinHandle);
+            }
+
+            if (load->workers[i].iotHubSvcDevMethodHandle != NULL)
+            {
+                IoTHubDeviceMethod_Destroy(load->workers[i].iotHubSvcDevMethodHandle);
+            }
+        }
+
+        free(load->workers);
+    }
+
+    if (load->devices != NULL)
+    {
+        size_t i;
+
+        for (i = 0; i < load->profile->number_of_devices; i++)
+        {
+            if (load->devices[i].iotHubClientHandle != NULL)
+            {
+                IoTHubClient_Destroy(load->devices[i].iotHubClientHandle);
+            }
+        }
+
+        free(load->devices);
+    }
+
+    // The clients on a shared transport must be gone before the transport.
+    if (load->transports != NULL)
+    {
+        size_t i;
+
+        for (i = 0; i < load->transport_count; i++)
+        {
+            if (load->transports[i] != NULL)
+            {
+                IoTHubTransport_Destroy(load->transports[i]);
+            }
+        }
+
+        free(load->transports);
+    }
+
+    if (load->tick_counter != NULL)
+    {
+        tickcounter_destroy(load->tick_counter);
+    }
+
+    if (load->lock != NULL)
+    {
+        Lock_Deinit(load->lock);
+    }
+
+    free(load);
+}
+
+static IOTHUB_CLIENT_HANDLE create_load_device_client(LOAD_RUN* load, size_t device_index)
+{
+    IOTHUB_CLIENT_HANDLE result;
+    const LONGHAUL_LOAD_PROFILE* profile = load->profile;
+    IOTHUB_PROVISIONED_DEVICE* deviceInfo = load->devices[device_index].deviceInfo;
+
+    if (device_index < profile->number_of_multiplexed_devices)
+    {
+        IOTHUB_ACCOUNT_INFO_HANDLE account = load->iotHubLonghaul->iotHubAccountInfo;
+        size_t transport_index = device_index / profile->devices_per_transport;
+
+        if (load->transports[transport_index] == NULL &&
+            (load->transports[transport_index] = IoTHubTransport_Create(profile->multiplexed_protocol, IoTHubAccount_GetIoTHubName(account), IoTHubAccount_GetIoTHubSuffix(account))) == NULL)
+        {
+            LogError("Failed creating shared transport %lu", (unsigned long)transport_index);
+            result = NULL;
+        }
+        else
+        {
+            IOTHUB_CLIENT_CONFIG client_config;
+            (void)memset(&client_config, 0, sizeof(IOTHUB_CLIENT_CONFIG));
+            client_config.protocol = profile->multiplexed_protocol;
+            client_config.deviceId = deviceInfo->deviceId;
+            client_config.deviceKey = deviceInfo->primaryAuthentication;
+            client_config.iotHubName = IoTHubAccount_GetIoTHubName(account);
+            client_config.iotHubSuffix = IoTHubAccount_GetIoTHubSuffix(account);
+
+            if ((result = IoTHubClient_CreateWithTransport(load->transports[transport_index], &client_config)) == NULL)
+            {
+                LogError("Could not create IoTHubClient on shared transport for device %s", deviceInfo->deviceId);
+            }
+        }
+    }
+    else if ((result = IoTHubClient_CreateFromConnectionString(deviceInfo->connectionString, profile->dedicated_protocol)) == NULL)
+    {
+        LogError("Could not create IoTHubClient for device %s", deviceInfo->deviceId);
+    }
+
+    return result;
+}
+
+static LOAD_RUN* create_load_run(IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul, const LONGHAUL_LOAD_PROFILE* profile)
+{
+    LOAD_RUN* result;
+
+    if ((result = (LOAD_RUN*)malloc(sizeof(LOAD_RUN))) == NULL)
+    {
+        LogError("Failed allocating the load run");
+    }
+    else
+    {
+        double rates[LOAD_OPERATION_COUNT];
+        size_t i;
+
+        (void)memset(result, 0, sizeof(LOAD_RUN));
+        result->iotHubLonghaul = iotHubLonghaul;
+        result->profile = profile;
+        result->transport_count = profile->number_of_multiplexed_devices == 0 ? 0 :
+            (profile->number_of_multiplexed_devices + profile->devices_per_transport - 1) / profile->devices_per_transport;
+
+        rates[LOAD_TELEMETRY] = profile->telemetry_per_second;
+        rates[LOAD_C2D] = profile->c2d_per_second;
+        rates[LOAD_DEVICE_METHOD] = profile->device_methods_per_second;
+        rates[LOAD_TWIN_DESIRED] = profile->twin_desired_per_second;
+        rates[LOAD_TWIN_REPORTED] = profile->twin_reported_per_second;
+
+        for (i = 0; i < LOAD_OPERATION_COUNT; i++)
+        {
+            result->schedules[i].interval_ms = rates[i] > 0 ? 1000.0 / rates[i] : 0;
+        }
+
+        if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("Failed creating the load lock");
+            destroy_load_run(result);
+            result = NULL;
+        }
+        else if ((result->tick_counter = tickcounter_create()) == NULL)
+        {
+            LogError("Failed creating the load tick counter");
+            destroy_load_run(result);
+            result = NULL;
+        }
+        else if ((result->devices = (LOAD_DEVICE*)malloc(sizeof(LOAD_DEVICE) * profile->number_of_devices)) == NULL ||
+            (result->transport_count > 0 && (result->transports = (TRANSPORT_HANDLE*)malloc(sizeof(TRANSPORT_HANDLE) * result->transport_count)) == NULL) ||
+            (profile->service_threads > 0 && (result->workers = (LOAD_SERVICE_WORKER*)malloc(sizeof(LOAD_SERVICE_WORKER) * profile->service_threads)) == NULL))
+        {
+            LogError("Failed allocating the load devices, transports or service threads");
+            destroy_load_run(result);
+            result = NULL;
+        }
+        else
+        {
+            IOTHUB_PROVISIONED_DEVICE** provisioned_devices = IoTHubAccount_GetSASDevices(iotHubLonghaul->iotHubAccountInfo);
+
+            (void)memset(result->devices, 0, sizeof(LOAD_DEVICE) * profile->number_of_devices);
+
+            if (result->transports != NULL)
+            {
+                (void)memset(result->transports, 0, sizeof(TRANSPORT_HANDLE) * result->transport_count);
+            }
+
+            if (result->workers != NULL)
+            {
+                (void)memset(result->workers, 0, sizeof(LOAD_SERVICE_WORKER) * profile->service_threads);
+            }
+
+            for (i = 0; i < profile->number_of_devices; i++)
+            {
+                LOAD_DEVICE* device = &result->devices[i];
+                device->deviceInfo = provisioned_devices[i];
+
+                if ((device->iotHubClientHandle = create_load_device_client(result, i)) == NULL)
+                {
+                    break;
+                }
+                else if (set_device_client_options_and_callbacks(device->iotHubClientHandle, iotHubLonghaul) != 0)
+                {
+                    LogError("Failed setting the options and callbacks of device %s", device->deviceInfo->deviceId);
+                    break;
+                }
+                else if (profile->twin_desired_per_second > 0 &&
+                    IoTHubClient_SetDeviceTwinCallback(device->iotHubClientHandle, on_device_twin_update_received, iotHubLonghaul) != IOTHUB_CLIENT_OK)
+                {
+                    LogError("Failed subscribing device %s for twin desired properties updates", device->deviceInfo->deviceId);
+                    break;
+                }
+            }
+
+            if (i < profile->number_of_devices)
+            {
+                destroy_load_run(result);
+                result = NULL;
+            }
+            else
+            {
+                for (i = 0; i < profile->service_threads; i++)
+                {
+                    LOAD_SERVICE_WORKER* worker = &result->workers[i];
+                    worker->load = result;
+
+                    // Each thread gets service clients of its own, their calls block until the hub responds.
+                    if ((worker->iotHubSvcDevMethodHandle = IoTHubDeviceMethod_Create(iotHubLonghaul->iotHubServiceClientHandle)) == NULL ||
+                        (worker->iotHubSvcDevTwinHandle = IoTHubDeviceTwin_Create(iotHubLonghaul->iotHubServiceClientHandle)) == NULL)
+                    {
+                        LogError("Failed creating the service clients of the load service threads");
+                        break;
+                    }
+                }
+
+                if (i < profile->service_threads)
+                {
+                    destroy_load_run(result);
+                    result = NULL;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+static void stop_load_service_threads(LOAD_RUN* load, size_t thread_count)
+{
+    size_t i;
+
+    if (Lock(load->lock) != LOCK_OK)
+    {
+        LogError("Failed locking the load service requests");
+    }
+    else
+    {
+        load->is_running = false;
+
+        if (Unlock(load->lock) != LOCK_OK)
+        {
+            LogError("Failed unlocking the load service requests");
+        }
+    }
+
+    for (i = 0; i < thread_count; i++)
+    {
+        int thread_result;
+
+        if (ThreadAPI_Join(load->workers[i].thread, &thread_result) != THREADAPI_OK)
+        {
+            LogError("Failed joining load service thread %lu", (unsigned long)i);
+        }
+    }
+}
+
+static int start_load_service_threads(LOAD_RUN* load)
+{
+    int result;
+    size_t i;
+
+    load->is_running = true;
+
+    for (i = 0; i < load->profile->service_threads; i++)
+    {
+        if (ThreadAPI_Create(&load->workers[i].thread, run_load_service_requests, &load->workers[i]) != THREADAPI_OK)
+        {
+            LogError("Failed creating load service thread %lu", (unsigned long)i);
+            break;
+        }
+    }
+
+    if (i < load->profile->service_threads)
+    {
+        stop_load_service_threads(load, i);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+
+    return result;
+}
+
+static int get_load_operation_summary(IOTHUB_CLIENT_STATISTICS_HANDLE stats, LOAD_OPERATION operation, size_t* sent, size_t* received, double* max_travel_time_secs)
+{
+    int result;
+
+    if (operation == LOAD_TELEMETRY)
+    {
+        IOTHUB_CLIENT_STATISTICS_TELEMETRY_SUMMARY summary;
+        result = iothub_client_statistics_get_telemetry_summary(stats, &summary);
+        *sent = summary.messages_sent;
+        *received = summary.messages_received;
+        *max_travel_time_secs = summary.max_travel_time_secs;
+    }
+    else if (operation == LOAD_C2D)
+    {
+        IOTHUB_CLIENT_STATISTICS_C2D_SUMMARY summary;
+        result = iothub_client_statistics_get_c2d_summary(stats, &summary);
+        *sent = summary.messages_sent;
+        *received = summary.messages_received;
+        *max_travel_time_secs = summary.max_travel_time_secs;
+    }
+    else if (operation == LOAD_DEVICE_METHOD)
+    {
+        IOTHUB_CLIENT_STATISTICS_DEVICE_METHOD_SUMMARY summary;
+        result = iothub_client_statistics_get_device_method_summary(stats, &summary);
+        *sent = summary.methods_invoked;
+        *received = summary.methods_received;
+        *max_travel_time_secs = summary.max_travel_time_secs;
+    }
+    else
+    {
+        IOTHUB_CLIENT_STATISTICS_DEVICE_TWIN_SUMMARY summary;
+        result = (operation == LOAD_TWIN_DESIRED ?
+            iothub_client_statistics_get_device_twin_desired_summary(stats, &summary) :
+            iothub_client_statistics_get_device_twin_reported_summary(stats, &summary));
+        *sent = summary.updates_sent;
+        *received = summary.updates_received;
+        *max_travel_time_secs = summary.max_travel_time_secs;
+    }
+
+    return result;
+}
+
+static int check_load_results(LOAD_RUN* load)
+{
+    int result = 0;
+    IOTHUB_CLIENT_STATISTICS_HANDLE stats = load->iotHubLonghaul->iotHubClientStats;
+    char* stats_json;
+    size_t i;
+
+    if ((stats_json = iothub_client_statistics_to_json(stats)) != NULL)
+    {
+        LogInfo("Longhaul load stats: %s", stats_json);
+        json_free_serialized_string(stats_json);
+    }
+
+    for (i = 0; i < LOAD_OPERATION_COUNT; i++)
+    {
+        LOAD_SCHEDULE* schedule = &load->schedules[i];
+
+        if (schedule->interval_ms > 0)
+        {
+            size_t sent;
+            size_t received;
+            double max_travel_time_secs;
+
+            if (get_load_operation_summary(stats, (LOAD_OPERATION)i, &sent, &received, &max_travel_time_secs) != 0)
+            {
+                LogError("Failed gettting %s statistics summary", LOAD_OPERATION_NAMES[i]);
+                result = __FAILURE__;
+            }
+            else
+            {
+                LogInfo("Summary (%s): issued=%lu, late=%lu, failed to issue=%lu, dropped=%lu; sent=%lu, received=%lu; max travel time=%f secs",
+                    LOAD_OPERATION_NAMES[i], (unsigned long)schedule->issued, (unsigned long)schedule->issued_late, (unsigned long)schedule->failed_to_issue,
+                    (unsigned long)schedule->dropped, (unsigned long)sent, (unsigned long)received, max_travel_time_secs);
+
+                if (sent == 0 || received != sent || schedule->dropped > 0 || max_travel_time_secs > LOAD_OPERATION_MAX_TRAVEL_TIME_SECS[i])
+                {
+                    result = __FAILURE__;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+int longhaul_run_load_tests(IOTHUB_LONGHAUL_RESOURCES_HANDLE handle, const LONGHAUL_LOAD_PROFILE* profile, size_t totalDurationInSeconds)
+{
+    int result;
+
+    if (handle == NULL || profile == NULL)
+    {
+        LogError("Invalid argument (handle=%p, profile=%p)", handle, profile);
+        result = __FAILURE__;
+    }
+    else
+    {
+        IOTHUB_LONGHAUL_RESOURCES* iotHubLonghaul = (IOTHUB_LONGHAUL_RESOURCES*)handle;
+        bool needs_service_threads = (profile->device_methods_per_second > 0 || profile->twin_desired_per_second > 0 || profile->twin_reported_per_second > 0);
+        LOAD_RUN* load;
+
+        if (profile->number_of_devices == 0 || profile->number_of_devices > iotHubLonghaul->number_of_sas_devices ||
+            profile->number_of_multiplexed_devices > profile->number_of_devices ||
+            (profile->number_of_multiplexed_devices > 0 && (profile->devices_per_transport == 0 || profile->multiplexed_protocol == NULL)) ||
+            (profile->number_of_multiplexed_devices < profile->number_of_devices && profile->dedicated_protocol == NULL) ||
+            (needs_service_threads && profile->service_threads == 0))
+        {
+            LogError("Invalid load profile (devices=%lu of %lu provisioned, multiplexed=%lu, devices per transport=%lu, service threads=%lu)",
+                (unsigned long)profile->number_of_devices, (unsigned long)iotHubLonghaul->number_of_sas_devices, (unsigned long)profile->number_of_multiplexed_devices,
+                (unsigned long)profile->devices_per_transport, (unsigned long)profile->service_threads);
+            result = __FAILURE__;
+        }
+        else if (longhaul_initialize_service_client(iotHubLonghaul) == NULL)
+        {
+            LogError("Failed to initialize IoT hub service client");
+            result = __FAILURE__;
+        }
+        else if (profile->c2d_per_second > 0 && iotHubLonghaul->iotHubSvcMsgHandle == NULL &&
+            longhaul_initialize_service_c2d_messaging_client(iotHubLonghaul) == NULL)
+        {
+            LogError("Failed to initialize IoT hub service c2d messaging client");
+            result = __FAILURE__;
+        }
+        else if ((load = create_load_run(iotHubLonghaul, profile)) == NULL)
+        {
+            LogError("Failed creating the load devices");
+            result = __FAILURE__;
+        }
+        else
+        {
+            if (start_load_service_threads(load) != 0)
+            {
+                LogError("Failed starting the load service threads");
+                result = __FAILURE__;
+            }
+            else
+            {
+                int schedule_result;
+
+                // Wait for the devices to connect and the service to ack their subscriptions...
+                ThreadAPI_Sleep(DEVICE_METHOD_SUB_WAIT_TIME_MS);
+
+                schedule_result = run_load_schedule(load, totalDurationInSeconds);
+
+                // Extra time for the last operations, the service threads still check the twin updates acknowledged meanwhile.
+                ThreadAPI_Sleep(LOAD_DRAIN_TIME_SECS * 1000);
+
+                stop_load_service_threads(load, profile->service_threads);
+
+                if (check_load_results(load) != 0 || schedule_result != 0)
+                {
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    result = 0;
+                }
+            }
+
+            destroy_load_run(load);
+        }
+    }
+
+    return result;
+}
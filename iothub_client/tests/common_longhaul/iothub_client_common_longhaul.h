@@ -12,7 +12,32 @@
 
 typedef struct IOTHUB_LONGHAUL_RESOURCES_TAG* IOTHUB_LONGHAUL_RESOURCES_HANDLE;
 
+// Load generation: many simulated devices driven at fixed aggregate rates, with statistics aggregated across all of them.
+// Operations are issued on schedule whether or not the previous ones completed (open loop), so a slow hub or gateway
+// shows up as growing travel times and in flight counts instead of a lower send rate.
+typedef struct LONGHAUL_LOAD_PROFILE_TAG
+{
+    // The first number_of_multiplexed_devices devices share transports, devices_per_transport on each;
+    // the others get a client and connection of their own. Multiplexing needs AMQP or HTTP, and SAS devices.
+    size_t number_of_devices;
+    size_t number_of_multiplexed_devices;
+    size_t devices_per_transport;
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER multiplexed_protocol;
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER dedicated_protocol;
+
+    // Target rates across all devices, in operations per second; 0 disables the operation.
+    double telemetry_per_second;
+    double c2d_per_second;
+    double device_methods_per_second;
+    double twin_desired_per_second;
+    double twin_reported_per_second;
+
+    // Threads running the service calls that block (device methods, twin updates and reads).
+    size_t service_threads;
+} LONGHAUL_LOAD_PROFILE;
+
 extern IOTHUB_LONGHAUL_RESOURCES_HANDLE longhaul_tests_init();
+extern IOTHUB_LONGHAUL_RESOURCES_HANDLE longhaul_load_tests_init(size_t number_of_devices);
 extern void longhaul_tests_deinit(IOTHUB_LONGHAUL_RESOURCES_HANDLE handle);
 
 extern IOTHUB_ACCOUNT_INFO_HANDLE longhaul_get_account_info(IOTHUB_LONGHAUL_RESOURCES_HANDLE handle);
@@ -30,4 +55,6 @@ extern int longhaul_run_device_methods_tests(IOTHUB_LONGHAUL_RESOURCES_HANDLE ha
 extern int longhaul_run_twin_desired_properties_tests(IOTHUB_LONGHAUL_RESOURCES_HANDLE handle, size_t iterationDurationInSeconds, size_t totalDurationInSeconds);
 extern int longhaul_run_twin_reported_properties_tests(IOTHUB_LONGHAUL_RESOURCES_HANDLE handle, size_t iterationDurationInSeconds, size_t totalDurationInSeconds);
 
+extern int longhaul_run_load_tests(IOTHUB_LONGHAUL_RESOURCES_HANDLE handle, const LONGHAUL_LOAD_PROFILE* profile, size_t totalDurationInSeconds);
+
 #endif // IOTHUB_CLIENT_COMMON_LONGHAUL_H
\ No newline at end of file
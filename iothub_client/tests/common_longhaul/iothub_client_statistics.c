@@ -2,17 +2,34 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <limits.h>
 #include "iothub_client_statistics.h"
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/xlogging.h"
-#include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "parson.h"
 
 #define INDEFINITE_TIME ((time_t)-1)
 
+// Travel times are recorded in seconds. Values under HISTOGRAM_EXACT_BUCKETS have a bucket each, every power of two
+// above is split into HISTOGRAM_SUB_BUCKETS buckets, so a percentile is off by at most 1/8th of its value.
+#define HISTOGRAM_EXACT_BUCKETS         16
+#define HISTOGRAM_SUB_BUCKETS           8
+#define HISTOGRAM_BUCKET_COUNT          (HISTOGRAM_EXACT_BUCKETS + (32 - 4) * HISTOGRAM_SUB_BUCKETS)
+
+// Rates are reported over the last hour, in one minute slots.
+#define RATE_WINDOW_SLOT_SECS           60
+#define RATE_WINDOW_SLOT_COUNT          60
+
+#define IN_FLIGHT_INITIAL_CAPACITY      64
+#define CONNECTION_STATUS_HISTORY_SIZE  16
+
+#define ITEM_EVENT_STARTED              0x01
+#define ITEM_EVENT_RECEIVED             0x02
+
 DEFINE_ENUM_STRINGS(TELEMETRY_EVENT_TYPE, TELEMETRY_EVENT_TYPE_VALUES)
 DEFINE_ENUM_STRINGS(C2D_EVENT_TYPE, C2D_EVENT_TYPE_VALUES)
 DEFINE_ENUM_STRINGS(DEVICE_METHOD_EVENT_TYPE, DEVICE_METHOD_EVENT_TYPE_VALUES)
@@ -26,564 +43,694 @@ typedef struct CONNECTION_STATUS_INFO_TAG
     IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason;
 } CONNECTION_STATUS_INFO;
 
-typedef struct IOTHUB_CLIENT_STATISTICS_TAG
+typedef struct TRAVEL_TIME_HISTOGRAM_TAG
 {
-    SINGLYLINKEDLIST_HANDLE connection_status_history;
-    SINGLYLINKEDLIST_HANDLE telemetry_events;
-    SINGLYLINKEDLIST_HANDLE c2d_messages;
-    SINGLYLINKEDLIST_HANDLE device_methods;
-    SINGLYLINKEDLIST_HANDLE twin_reported_properties;
-    SINGLYLINKEDLIST_HANDLE twin_desired_properties;
-} IOTHUB_CLIENT_STATISTICS;
-
-static bool destroy_connection_status_info(const void* item, const void* match_context, bool* continue_processing)
+    uint64_t count;
+    uint64_t sum;
+    uint32_t min;
+    uint32_t max;
+    uint32_t buckets[HISTOGRAM_BUCKET_COUNT];
+} TRAVEL_TIME_HISTOGRAM;
+
+typedef struct RATE_WINDOW_SLOT_TAG
 {
-    (void)match_context;
-    free((void*)item);
-    *continue_processing = true;
-    return true;
-}
+    long long minute;
+    size_t sent;
+    size_t received;
+} RATE_WINDOW_SLOT;
 
-static bool destroy_telemetry_event(const void* item, const void* match_context, bool* continue_processing)
+// An item (message, method or twin update) from its first event until it was both started and received.
+typedef struct IN_FLIGHT_ITEM_TAG
 {
-    (void)match_context;
-    free((void*)item);
-    *continue_processing = true;
-    return true;
-}
-
-static bool destroy_c2d_message_info(const void* item, const void* match_context, bool* continue_processing)
+    size_t id;
+    double time_started;
+    double time_received;
+    unsigned char events;
+    bool in_use;
+} IN_FLIGHT_ITEM;
+
+typedef struct EVENT_TRACKER_TAG
 {
-    (void)match_context;
-    free((void*)item);
-    *continue_processing = true;
-    return true;
-}
+    // Open addressing table keyed by item id, with linear probing. Items leave it as soon as they complete.
+    IN_FLIGHT_ITEM* in_flight;
+    size_t capacity;
+    size_t in_flight_count;
 
-static bool destroy_device_method_info(const void* item, const void* match_context, bool* continue_processing)
+    bool has_items;
+    size_t highest_id;
+
+    size_t sent;
+    size_t received;
+    size_t failed;
+    size_t duplicates;
+
+    TRAVEL_TIME_HISTOGRAM travel_time;
+    RATE_WINDOW_SLOT rate_window[RATE_WINDOW_SLOT_COUNT];
+} EVENT_TRACKER;
+
+typedef struct IOTHUB_CLIENT_LONGHAUL_STATISTICS_TAG
+{
+    // Callbacks of several device and service clients add events concurrently.
+    LOCK_HANDLE lock;
+
+    size_t connection_status_changes;
+    size_t times_authenticated;
+    size_t times_unauthenticated;
+    CONNECTION_STATUS_INFO connection_status_history[CONNECTION_STATUS_HISTORY_SIZE];
+
+    EVENT_TRACKER telemetry;
+    EVENT_TRACKER c2d_messages;
+    EVENT_TRACKER device_methods;
+    EVENT_TRACKER twin_desired_properties;
+    EVENT_TRACKER twin_reported_properties;
+} IOTHUB_CLIENT_LONGHAUL_STATISTICS;
+
+static size_t get_bucket_index(uint32_t value)
 {
-    (void)match_context;
-    free((void*)item);
-    *continue_processing = true;
-    return true;
+    size_t result;
+
+    if (value < HISTOGRAM_EXACT_BUCKETS)
+    {
+        result = value;
+    }
+    else
+    {
+        unsigned int msb = 4;
+
+        while ((msb < 31) && ((value >> (msb + 1)) != 0))
+        {
+            msb++;
+        }
+
+        // The 3 bits under the most significant one pick the sub bucket.
+        result = HISTOGRAM_EXACT_BUCKETS + (msb - 4) * HISTOGRAM_SUB_BUCKETS + ((value >> (msb - 3)) & (HISTOGRAM_SUB_BUCKETS - 1));
+    }
+
+    return result;
 }
 
-static bool destroy_twin_reported_property_info(const void* item, const void* match_context, bool* continue_processing)
+static uint32_t get_bucket_highest_value(size_t index)
 {
-    (void)match_context;
-    free((void*)item);
-    *continue_processing = true;
-    return true;
+    uint32_t result;
+
+    if (index < HISTOGRAM_EXACT_BUCKETS)
+    {
+        result = (uint32_t)index;
+    }
+    else
+    {
+        unsigned int msb = 4 + (unsigned int)((index - HISTOGRAM_EXACT_BUCKETS) / HISTOGRAM_SUB_BUCKETS);
+        uint64_t sub_bucket = (index - HISTOGRAM_EXACT_BUCKETS) % HISTOGRAM_SUB_BUCKETS;
+        uint64_t highest = ((HISTOGRAM_SUB_BUCKETS + sub_bucket + 1) << (msb - 3)) - 1;
+
+        result = (highest > UINT32_MAX) ? UINT32_MAX : (uint32_t)highest;
+    }
+
+    return result;
 }
 
-static bool destroy_twin_desired_property_info(const void* item, const void* match_context, bool* continue_processing)
+static void record_travel_time(TRAVEL_TIME_HISTOGRAM* histogram, double time_started, double time_received)
 {
-    (void)match_context;
-    free((void*)item);
-    *continue_processing = true;
-    return true;
+    double travel_time = time_received - time_started;
+    uint32_t value;
+
+    // Both ends are stamped on this machine, but not always with the same resolution, so the receive side can be stamped first.
+    if (travel_time <= 0)
+    {
+        value = 0;
+    }
+    else if (travel_time >= UINT32_MAX)
+    {
+        value = UINT32_MAX;
+    }
+    else
+    {
+        value = (uint32_t)travel_time;
+    }
+
+    if (histogram->count == 0 || value < histogram->min)
+    {
+        histogram->min = value;
+    }
+
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+
+    histogram->count++;
+    histogram->sum += value;
+    histogram->buckets[get_bucket_index(value)]++;
 }
 
-void iothub_client_statistics_destroy(IOTHUB_CLIENT_STATISTICS_HANDLE handle)
+static uint32_t get_travel_time_percentile(const TRAVEL_TIME_HISTOGRAM* histogram, double percentile)
 {
-    if (handle != NULL)
+    uint32_t result;
+
+    if (histogram->count == 0)
+    {
+        result = 0;
+    }
+    else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
+        uint64_t rank = (uint64_t)((percentile / 100.0) * (double)histogram->count + 0.5);
+        uint64_t seen = 0;
+        size_t index;
 
-        if (stats->connection_status_history != NULL)
+        if (rank == 0)
         {
-            if (singlylinkedlist_remove_if(stats->connection_status_history, destroy_connection_status_info, NULL) != 0)
-            {
-                LogError("Failed releasing connection status history items");
-            }
-            singlylinkedlist_destroy(stats->connection_status_history);
+            rank = 1;
         }
 
-        if (stats->telemetry_events != NULL)
-        {
-            if (singlylinkedlist_remove_if(stats->telemetry_events, destroy_telemetry_event, NULL) != 0)
-            {
-                LogError("Failed releasing telemetry events");
-            }
-            singlylinkedlist_destroy(stats->telemetry_events);
-        }
+        result = histogram->max;
 
-        if (stats->c2d_messages != NULL)
+        for (index = 0; index < HISTOGRAM_BUCKET_COUNT; index++)
         {
-            if (singlylinkedlist_remove_if(stats->c2d_messages, destroy_c2d_message_info, NULL) != 0)
+            seen += histogram->buckets[index];
+
+            if (seen >= rank)
             {
-                LogError("Failed releasing c2d message events");
+                uint32_t highest = get_bucket_highest_value(index);
+                result = (highest < histogram->max) ? highest : histogram->max;
+                break;
             }
-            singlylinkedlist_destroy(stats->c2d_messages);
         }
+    }
+
+    return result;
+}
+
+static long long get_current_minute(void)
+{
+    time_t now = time(NULL);
+
+    return (now == INDEFINITE_TIME ? -1 : (long long)now / RATE_WINDOW_SLOT_SECS);
+}
 
-        if (stats->device_methods != NULL)
+static void record_rate(EVENT_TRACKER* tracker, bool is_received)
+{
+    long long minute = get_current_minute();
+
+    if (minute >= 0)
+    {
+        RATE_WINDOW_SLOT* slot = &tracker->rate_window[minute % RATE_WINDOW_SLOT_COUNT];
+
+        if (slot->minute != minute)
         {
-            if (singlylinkedlist_remove_if(stats->device_methods, destroy_device_method_info, NULL) != 0)
-            {
-                LogError("Failed releasing device method events");
-            }
-            singlylinkedlist_destroy(stats->device_methods);
+            slot->minute = minute;
+            slot->sent = 0;
+            slot->received = 0;
         }
 
-        if (stats->twin_reported_properties != NULL)
+        if (is_received)
         {
-            if (singlylinkedlist_remove_if(stats->twin_reported_properties, destroy_twin_reported_property_info, NULL) != 0)
-            {
-                LogError("Failed releasing twin reported property event");
-            }
-            singlylinkedlist_destroy(stats->twin_reported_properties);
+            slot->received++;
         }
-
-        if (stats->twin_desired_properties != NULL)
+        else
         {
-            if (singlylinkedlist_remove_if(stats->twin_desired_properties, destroy_twin_desired_property_info, NULL) != 0)
-            {
-                LogError("Failed releasing twin desired property event");
-            }
-            singlylinkedlist_destroy(stats->twin_desired_properties);
+            slot->sent++;
         }
-
-        free(handle);
     }
 }
 
-IOTHUB_CLIENT_STATISTICS_HANDLE iothub_client_statistics_create(void)
+static void count_sent(EVENT_TRACKER* tracker)
 {
-    IOTHUB_CLIENT_STATISTICS* stats;
+    tracker->sent++;
+    record_rate(tracker, false);
+}
 
-    if ((stats = ((IOTHUB_CLIENT_STATISTICS*)malloc(sizeof(IOTHUB_CLIENT_STATISTICS)))) == NULL)
+static size_t get_in_flight_slot(size_t id, size_t capacity)
+{
+    // Fibonacci hashing, the ids are sequential so the low bits alone would cluster.
+    return (size_t)(((uint64_t)id * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+}
+
+static int initialize_event_tracker(EVENT_TRACKER* tracker)
+{
+    int result;
+
+    if ((tracker->in_flight = (IN_FLIGHT_ITEM*)calloc(IN_FLIGHT_INITIAL_CAPACITY, sizeof(IN_FLIGHT_ITEM))) == NULL)
     {
-        LogError("Failed allocating IOTHUB_CLIENT_STATISTICS");
+        LogError("Failed allocating the in flight items table");
+        result = __FAILURE__;
     }
     else
     {
-        memset(stats, 0, sizeof(IOTHUB_CLIENT_STATISTICS));
+        tracker->capacity = IN_FLIGHT_INITIAL_CAPACITY;
+        result = 0;
+    }
 
-        if ((stats->connection_status_history = singlylinkedlist_create()) == NULL)
-        {
-            LogError("Failed creating list for connection status info");
-            iothub_client_statistics_destroy(stats);
-            stats = NULL;
-        }
-        else if ((stats->telemetry_events = singlylinkedlist_create()) == NULL)
-        {
-            LogError("Failed creating list for telemetry events");
-            iothub_client_statistics_destroy(stats);
-            stats = NULL;
-        }
-        else if ((stats->c2d_messages = singlylinkedlist_create()) == NULL)
-        {
-            LogError("Failed creating list for c2d messages");
-            iothub_client_statistics_destroy(stats);
-            stats = NULL;
-        }
-        else if ((stats->device_methods = singlylinkedlist_create()) == NULL)
-        {
-            LogError("Failed creating list for device methods");
-            iothub_client_statistics_destroy(stats);
-            stats = NULL;
-        }
-        else if ((stats->twin_reported_properties = singlylinkedlist_create()) == NULL)
-        {
-            LogError("Failed creating list for twin reported properties");
-            iothub_client_statistics_destroy(stats);
-            stats = NULL;
-        }
-        else if ((stats->twin_desired_properties = singlylinkedlist_create()) == NULL)
+    return result;
+}
+
+static IN_FLIGHT_ITEM* find_in_flight_item(EVENT_TRACKER* tracker, size_t id)
+{
+    IN_FLIGHT_ITEM* result = NULL;
+    size_t slot = get_in_flight_slot(id, tracker->capacity);
+
+    while (tracker->in_flight[slot].in_use)
+    {
+        if (tracker->in_flight[slot].id == id)
         {
-            LogError("Failed creating list for twin desired properties");
-            iothub_client_statistics_destroy(stats);
-            stats = NULL;
+            result = &tracker->in_flight[slot];
+            break;
         }
+
+        slot = (slot + 1) & (tracker->capacity - 1);
     }
 
-    return stats;
+    return result;
 }
 
-static void serialize_connection_status(const void* item, const void* action_context, bool* continue_processing)
+static void insert_in_flight_item(IN_FLIGHT_ITEM* table, size_t capacity, const IN_FLIGHT_ITEM* item)
 {
-    JSON_Array* conn_status_array = json_value_get_array((const JSON_Value*)action_context);
+    size_t slot = get_in_flight_slot(item->id, capacity);
 
-    if (conn_status_array == NULL)
+    while (table[slot].in_use)
     {
-        LogError("Failed to retrieve the connection status json array");
+        slot = (slot + 1) & (capacity - 1);
     }
-    else
+
+    table[slot] = *item;
+}
+
+static IN_FLIGHT_ITEM* add_in_flight_item(EVENT_TRACKER* tracker, size_t id)
+{
+    IN_FLIGHT_ITEM* result;
+
+    // Keeping the load under a half keeps the probe sequences short.
+    if ((tracker->in_flight_count + 1) * 2 > tracker->capacity)
     {
-        CONNECTION_STATUS_INFO* info = (CONNECTION_STATUS_INFO*)item;
-        JSON_Value* info_json;
+        size_t new_capacity = tracker->capacity * 2;
+        IN_FLIGHT_ITEM* new_table;
 
-        if ((info_json = json_value_init_object()) == NULL)
+        if ((new_table = (IN_FLIGHT_ITEM*)calloc(new_capacity, sizeof(IN_FLIGHT_ITEM))) == NULL)
         {
-            LogError("Failed creating connection status json");
+            LogError("Failed growing the in flight items table to %lu items", (unsigned long)new_capacity);
         }
         else
         {
-            JSON_Object* info_json_obj;
+            size_t index;
 
-            if ((info_json_obj = json_value_get_object(info_json)) == NULL)
-            {
-                LogError("Failed getting json object");
-                json_value_free(info_json);
-            }
-            else
+            for (index = 0; index < tracker->capacity; index++)
             {
-                if (json_object_set_string(info_json_obj, "time", (info->time == INDEFINITE_TIME ? "undefined" : ctime((&info->time)))) != JSONSuccess)
-                {
-                    LogError("Failed serializing connection status time");
-                    json_value_free(info_json);
-                }
-                else if (json_object_set_string(info_json_obj, "status", ENUM_TO_STRING(IOTHUB_CLIENT_CONNECTION_STATUS, info->status)) != JSONSuccess)
+                if (tracker->in_flight[index].in_use)
                 {
-                    LogError("Failed serializing connection status");
-                    json_value_free(info_json);
-                }
-                else if (json_object_set_string(info_json_obj, "reason", ENUM_TO_STRING(IOTHUB_CLIENT_CONNECTION_STATUS_REASON, info->reason)) != JSONSuccess)
-                {
-                    LogError("Failed serializing connection status reason");
-                    json_value_free(info_json);
-                }
-                else if (json_array_append_value(conn_status_array, info_json) != 0)
-                {
-                    LogError("Failed appending connection status json");
-                    json_value_free(info_json);
+                    insert_in_flight_item(new_table, new_capacity, &tracker->in_flight[index]);
                 }
             }
+
+            free(tracker->in_flight);
+            tracker->in_flight = new_table;
+            tracker->capacity = new_capacity;
+        }
+    }
+
+    if ((tracker->in_flight_count + 1) * 2 > tracker->capacity)
+    {
+        result = NULL;
+    }
+    else
+    {
+        IN_FLIGHT_ITEM item;
+
+        item.id = id;
+        item.time_started = INDEFINITE_TIME;
+        item.time_received = INDEFINITE_TIME;
+        item.events = 0;
+        item.in_use = true;
+
+        insert_in_flight_item(tracker->in_flight, tracker->capacity, &item);
+        tracker->in_flight_count++;
+
+        if (!tracker->has_items || id > tracker->highest_id)
+        {
+            tracker->highest_id = id;
+            tracker->has_items = true;
         }
+
+        result = find_in_flight_item(tracker, id);
     }
 
-    *continue_processing = true;
+    return result;
+}
+
+static void remove_in_flight_item(EVENT_TRACKER* tracker, IN_FLIGHT_ITEM* item)
+{
+    size_t mask = tracker->capacity - 1;
+    size_t hole = (size_t)(item - tracker->in_flight);
+    size_t slot = (hole + 1) & mask;
+
+    tracker->in_flight[hole].in_use = false;
+    tracker->in_flight_count--;
+
+    // Backward shift deletion: move up every item of the cluster that can no longer be reached past the hole.
+    while (tracker->in_flight[slot].in_use)
+    {
+        size_t home = get_in_flight_slot(tracker->in_flight[slot].id, tracker->capacity);
+
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            tracker->in_flight[hole] = tracker->in_flight[slot];
+            tracker->in_flight[slot].in_use = false;
+            hole = slot;
+        }
+
+        slot = (slot + 1) & mask;
+    }
 }
 
-static void serialize_telemetry_event(const void* item, const void* action_context, bool* continue_processing)
+// Events for ids at or below the highest one tracked arrived after their item completed.
+static bool is_duplicate_event(EVENT_TRACKER* tracker, size_t id)
 {
-    JSON_Array* telemetry_array = json_value_get_array((const JSON_Value*)action_context);
+    bool result;
 
-    if (telemetry_array == NULL)
+    if (tracker->has_items && id <= tracker->highest_id)
     {
-        LogError("Failed to retrieve the telemetry events json array");
+        tracker->duplicates++;
+        result = true;
     }
     else
     {
-        TELEMETRY_INFO* info = (TELEMETRY_INFO*)item;
-        JSON_Value* info_json;
+        result = false;
+    }
 
-        if ((info_json = json_value_init_object()) == NULL)
+    return result;
+}
+
+static void set_item_started(IN_FLIGHT_ITEM* item, double time_started)
+{
+    item->time_started = time_started;
+    item->events |= ITEM_EVENT_STARTED;
+}
+
+static void set_item_received(IN_FLIGHT_ITEM* item, double time_received)
+{
+    // Only the first receive counts, the service clients might report the same item more than once.
+    if ((item->events & ITEM_EVENT_RECEIVED) == 0)
+    {
+        item->time_received = time_received;
+        item->events |= ITEM_EVENT_RECEIVED;
+    }
+}
+
+static void complete_item_if_done(EVENT_TRACKER* tracker, IN_FLIGHT_ITEM* item)
+{
+    if ((item->events & (ITEM_EVENT_STARTED | ITEM_EVENT_RECEIVED)) == (ITEM_EVENT_STARTED | ITEM_EVENT_RECEIVED))
+    {
+        if (item->time_started != INDEFINITE_TIME && item->time_received != INDEFINITE_TIME)
         {
-            LogError("Failed creating telemetry event json");
+            record_travel_time(&tracker->travel_time, item->time_started, item->time_received);
         }
-        else
-        {
-            JSON_Object* info_json_obj;
 
-            if ((info_json_obj = json_value_get_object(info_json)) == NULL)
-            {
-                LogError("Failed getting json object");
-                json_value_free(info_json);
-            }
-            else
-            {
-                if (json_object_set_number(info_json_obj, "id", info->message_id) != JSONSuccess)
-                {
-                    LogError("Failed serializing telemetry event id");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "enqueue.time", (info->time_queued == INDEFINITE_TIME ? "undefined" : ctime(&info->time_queued))) != JSONSuccess)
-                {
-                    LogError("Failed serializing telemetry event enqueue time");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_number(info_json_obj, "enqueue.result", info->send_result) != JSONSuccess)
-                {
-                    LogError("Failed serializing telemetry event enqueue result");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "send.time", (info->time_sent == INDEFINITE_TIME ? "undefined" : ctime(&info->time_sent))) != JSONSuccess)
-                {
-                    LogError("Failed serializing telemetry event send time");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "send.result", ENUM_TO_STRING(IOTHUB_CLIENT_CONFIRMATION_RESULT, info->send_callback_result)) != JSONSuccess)
-                {
-                    LogError("Failed serializing telemetry event send result");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "receive.time", (info->time_received == INDEFINITE_TIME ? "undefined" : ctime(&info->time_received))) != JSONSuccess)
-                {
-                    LogError("Failed serializing telemetry event receive time");
-                    json_value_free(info_json);
-                }
-                else if (json_array_append_value(telemetry_array, info_json) != 0)
-                {
-                    LogError("Failed appending telemetry event json");
-                    json_value_free(info_json);
-                }
-            }
-        }
+        tracker->received++;
+        record_rate(tracker, true);
+        remove_in_flight_item(tracker, item);
     }
-
-    *continue_processing = true;
 }
 
-static void serialize_c2d_event(const void* item, const void* action_context, bool* continue_processing)
+static void summarize_event_tracker(const EVENT_TRACKER* tracker, size_t* sent, size_t* received, double* min_travel_time_secs, double* max_travel_time_secs)
 {
-    JSON_Array* c2d_array = json_value_get_array((const JSON_Value*)action_context);
+    *sent = tracker->sent;
+    *received = tracker->received;
 
-    if (c2d_array == NULL)
+    if (tracker->travel_time.count == 0)
     {
-        LogError("Failed to retrieve the c2d events json array");
+        *min_travel_time_secs = LONG_MAX;
+        *max_travel_time_secs = 0;
     }
     else
     {
-        C2D_MESSAGE_INFO* info = (C2D_MESSAGE_INFO*)item;
-        JSON_Value* info_json;
+        *min_travel_time_secs = tracker->travel_time.min;
+        *max_travel_time_secs = tracker->travel_time.max;
+    }
+}
+
+void iothub_client_statistics_destroy(IOTHUB_CLIENT_STATISTICS_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        if ((info_json = json_value_init_object()) == NULL)
+        free(stats->telemetry.in_flight);
+        free(stats->c2d_messages.in_flight);
+        free(stats->device_methods.in_flight);
+        free(stats->twin_desired_properties.in_flight);
+        free(stats->twin_reported_properties.in_flight);
+
+        if (stats->lock != NULL)
         {
-            LogError("Failed creating c2d event json");
+            Lock_Deinit(stats->lock);
         }
-        else
-        {
-            JSON_Object* info_json_obj;
 
-            if ((info_json_obj = json_value_get_object(info_json)) == NULL)
-            {
-                LogError("Failed getting json object");
-                json_value_free(info_json);
-            }
-            else
-            {
-                if (json_object_set_number(info_json_obj, "id", info->message_id) != JSONSuccess)
-                {
-                    LogError("Failed serializing c2d event id");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "enqueue.time", (info->time_queued == INDEFINITE_TIME ? "undefined" : ctime(&info->time_queued))) != JSONSuccess)
-                {
-                    LogError("Failed serializing c2d event enqueue time");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_number(info_json_obj, "enqueue.result", info->send_result) != JSONSuccess)
-                {
-                    LogError("Failed serializing c2d event enqueue result");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "send.time", (info->time_sent == INDEFINITE_TIME ? "undefined" : ctime(&info->time_sent))) != JSONSuccess)
-                {
-                    LogError("Failed serializing c2d event send time");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "send.result", ENUM_TO_STRING(IOTHUB_MESSAGING_RESULT, info->send_callback_result)) != JSONSuccess)
-                {
-                    LogError("Failed serializing c2d event send result");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "receive.time", (info->time_received == INDEFINITE_TIME ? "undefined" : ctime(&info->time_received))) != JSONSuccess)
-                {
-                    LogError("Failed serializing c2d event receive time");
-                    json_value_free(info_json);
-                }
-                else if (json_array_append_value(c2d_array, info_json) != 0)
-                {
-                    LogError("Failed appending c2d event json");
-                    json_value_free(info_json);
-                }
-            }
-        }
+        free(handle);
     }
-
-    *continue_processing = true;
 }
 
-static void serialize_device_method_event(const void* item, const void* action_context, bool* continue_processing)
+IOTHUB_CLIENT_STATISTICS_HANDLE iothub_client_statistics_create(void)
 {
-    JSON_Array* c2d_array = json_value_get_array((const JSON_Value*)action_context);
+    IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats;
 
-    if (c2d_array == NULL)
+    if ((stats = ((IOTHUB_CLIENT_LONGHAUL_STATISTICS*)malloc(sizeof(IOTHUB_CLIENT_LONGHAUL_STATISTICS)))) == NULL)
     {
-        LogError("Failed to retrieve the device method events json array");
+        LogError("Failed allocating IOTHUB_CLIENT_LONGHAUL_STATISTICS");
     }
     else
     {
-        DEVICE_METHOD_INFO* info = (DEVICE_METHOD_INFO*)item;
-        JSON_Value* info_json;
+        size_t index;
+
+        memset(stats, 0, sizeof(IOTHUB_CLIENT_LONGHAUL_STATISTICS));
 
-        if ((info_json = json_value_init_object()) == NULL)
+        for (index = 0; index < RATE_WINDOW_SLOT_COUNT; index++)
         {
-            LogError("Failed creating device method event json");
+            stats->telemetry.rate_window[index].minute = -1;
+            stats->c2d_messages.rate_window[index].minute = -1;
+            stats->device_methods.rate_window[index].minute = -1;
+            stats->twin_desired_properties.rate_window[index].minute = -1;
+            stats->twin_reported_properties.rate_window[index].minute = -1;
         }
-        else
-        {
-            JSON_Object* info_json_obj;
 
-            if ((info_json_obj = json_value_get_object(info_json)) == NULL)
-            {
-                LogError("Failed getting json object");
-                json_value_free(info_json);
-            }
-            else
-            {
-                if (json_object_set_number(info_json_obj, "id", info->method_id) != JSONSuccess)
-                {
-                    LogError("Failed serializing device method event id");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "send.time", (info->time_invoked == INDEFINITE_TIME ? "undefined" : ctime(&info->time_invoked))) != JSONSuccess)
-                {
-                    LogError("Failed serializing device method event send time");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "send.result", ENUM_TO_STRING(IOTHUB_DEVICE_METHOD_RESULT, info->method_result)) != JSONSuccess)
-                {
-                    LogError("Failed serializing device method event send result");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "receive.time", (info->time_received == INDEFINITE_TIME ? "undefined" : ctime(&info->time_received))) != JSONSuccess)
-                {
-                    LogError("Failed serializing device method event receive time");
-                    json_value_free(info_json);
-                }
-                else if (json_array_append_value(c2d_array, info_json) != 0)
-                {
-                    LogError("Failed appending device method event json");
-                    json_value_free(info_json);
-                }
-            }
+        if ((stats->lock = Lock_Init()) == NULL)
+        {
+            LogError("Failed creating the statistics lock");
+            iothub_client_statistics_destroy(stats);
+            stats = NULL;
+        }
+        else if (initialize_event_tracker(&stats->telemetry) != 0)
+        {
+            LogError("Failed creating the tracker for telemetry events");
+            iothub_client_statistics_destroy(stats);
+            stats = NULL;
+        }
+        else if (initialize_event_tracker(&stats->c2d_messages) != 0)
+        {
+            LogError("Failed creating the tracker for c2d messages");
+            iothub_client_statistics_destroy(stats);
+            stats = NULL;
+        }
+        else if (initialize_event_tracker(&stats->device_methods) != 0)
+        {
+            LogError("Failed creating the tracker for device methods");
+            iothub_client_statistics_destroy(stats);
+            stats = NULL;
+        }
+        else if (initialize_event_tracker(&stats->twin_desired_properties) != 0)
+        {
+            LogError("Failed creating the tracker for twin desired properties");
+            iothub_client_statistics_destroy(stats);
+            stats = NULL;
+        }
+        else if (initialize_event_tracker(&stats->twin_reported_properties) != 0)
+        {
+            LogError("Failed creating the tracker for twin reported properties");
+            iothub_client_statistics_destroy(stats);
+            stats = NULL;
         }
     }
 
-    *continue_processing = true;
+    return stats;
 }
 
-static void serialize_device_twin_reported_event(const void* item, const void* action_context, bool* continue_processing)
+static JSON_Value* serialize_connection_status(IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats)
 {
-    JSON_Array* device_twin_array = json_value_get_array((const JSON_Value*)action_context);
+    JSON_Value* result;
+    JSON_Value* history_value;
 
-    if (device_twin_array == NULL)
+    if ((result = json_value_init_object()) == NULL)
+    {
+        LogError("Failed creating connection status json");
+    }
+    else if ((history_value = json_value_init_array()) == NULL)
     {
-        LogError("Failed to retrieve the device twin events json array");
+        LogError("Failed creating json array for connection status history");
+        json_value_free(result);
+        result = NULL;
     }
     else
     {
-        DEVICE_TWIN_REPORTED_INFO* info = (DEVICE_TWIN_REPORTED_INFO*)item;
-        JSON_Value* info_json;
+        JSON_Object* result_obj = json_value_get_object(result);
+        JSON_Array* history_array = json_value_get_array(history_value);
+        size_t kept = (stats->connection_status_changes < CONNECTION_STATUS_HISTORY_SIZE ? stats->connection_status_changes : CONNECTION_STATUS_HISTORY_SIZE);
+        size_t index;
 
-        if ((info_json = json_value_init_object()) == NULL)
-        {
-            LogError("Failed creating device twin event json");
-        }
-        else
+        // Oldest first, the same order the history used to be listed in.
+        for (index = stats->connection_status_changes - kept; index < stats->connection_status_changes; index++)
         {
+            CONNECTION_STATUS_INFO* info = &stats->connection_status_history[index % CONNECTION_STATUS_HISTORY_SIZE];
+            JSON_Value* info_json;
             JSON_Object* info_json_obj;
 
-            if ((info_json_obj = json_value_get_object(info_json)) == NULL)
+            if ((info_json = json_value_init_object()) == NULL)
+            {
+                LogError("Failed creating connection status json");
+            }
+            else if ((info_json_obj = json_value_get_object(info_json)) == NULL)
             {
                 LogError("Failed getting json object");
                 json_value_free(info_json);
             }
-            else
+            else if (json_object_set_string(info_json_obj, "time", (info->time == INDEFINITE_TIME ? "undefined" : ctime(&info->time))) != JSONSuccess)
             {
-                if (json_object_set_number(info_json_obj, "id", info->update_id) != JSONSuccess)
-                {
-                    LogError("Failed serializing device twin event id");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "enqueue.time", (info->time_queued == INDEFINITE_TIME ? "undefined" : ctime(&info->time_queued))) != JSONSuccess)
-                {
-                    LogError("Failed serializing device twin event enqueue time");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "enqueue.result", ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, info->update_result)) != JSONSuccess)
-                {
-                    LogError("Failed serializing device twin event send result");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "send.time", (info->time_sent == INDEFINITE_TIME ? "undefined" : ctime(&info->time_sent))) != JSONSuccess)
-                {
-                    LogError("Failed serializing device twin event send time");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_number(info_json_obj, "send.result", info->send_status_code) != JSONSuccess)
-                {
-                    LogError("Failed serializing device twin event send result");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "receive.time", (info->time_received == INDEFINITE_TIME ? "undefined" : ctime(&info->time_received))) != JSONSuccess)
-                {
-                    LogError("Failed serializing device twin event receive time");
-                    json_value_free(info_json);
-                }
-                else if (json_array_append_value(device_twin_array, info_json) != 0)
-                {
-                    LogError("Failed appending device twin event json");
-                    json_value_free(info_json);
-                }
+                LogError("Failed serializing connection status time");
+                json_value_free(info_json);
+            }
+            else if (json_object_set_string(info_json_obj, "status", ENUM_TO_STRING(IOTHUB_CLIENT_CONNECTION_STATUS, info->status)) != JSONSuccess)
+            {
+                LogError("Failed serializing connection status");
+                json_value_free(info_json);
+            }
+            else if (json_object_set_string(info_json_obj, "reason", ENUM_TO_STRING(IOTHUB_CLIENT_CONNECTION_STATUS_REASON, info->reason)) != JSONSuccess)
+            {
+                LogError("Failed serializing connection status reason");
+                json_value_free(info_json);
+            }
+            else if (json_array_append_value(history_array, info_json) != JSONSuccess)
+            {
+                LogError("Failed appending connection status json");
+                json_value_free(info_json);
             }
         }
+
+        if (json_object_set_number(result_obj, "changes", (double)stats->connection_status_changes) != JSONSuccess ||
+            json_object_set_number(result_obj, "authenticated", (double)stats->times_authenticated) != JSONSuccess ||
+            json_object_set_number(result_obj, "unauthenticated", (double)stats->times_unauthenticated) != JSONSuccess)
+        {
+            LogError("Failed serializing connection status counters");
+            json_value_free(history_value);
+        }
+        else if (json_object_set_value(result_obj, "last changes", history_value) != JSONSuccess)
+        {
+            LogError("Failed adding connection status history to json object");
+            json_value_free(history_value);
+        }
     }
 
-    *continue_processing = true;
+    return result;
 }
 
-static void serialize_device_twin_desired_event(const void* item, const void* action_context, bool* continue_processing)
+static JSON_Value* serialize_event_tracker(const EVENT_TRACKER* tracker)
 {
-    JSON_Array* device_twin_array = json_value_get_array((const JSON_Value*)action_context);
+    JSON_Value* result;
 
-    if (device_twin_array == NULL)
+    if ((result = json_value_init_object()) == NULL)
     {
-        LogError("Failed to retrieve the device twin events json array");
+        LogError("Failed creating event tracker json");
     }
     else
     {
-        DEVICE_TWIN_DESIRED_INFO* info = (DEVICE_TWIN_DESIRED_INFO*)item;
-        JSON_Value* info_json;
-
-        if ((info_json = json_value_init_object()) == NULL)
+        JSON_Object* result_obj = json_value_get_object(result);
+        const TRAVEL_TIME_HISTOGRAM* travel_time = &tracker->travel_time;
+        long long current_minute = get_current_minute();
+        long long window_minutes = 1;
+        size_t sent_last_hour = 0;
+        size_t received_last_hour = 0;
+        size_t index;
+
+        for (index = 0; index < RATE_WINDOW_SLOT_COUNT; index++)
         {
-            LogError("Failed creating device twin event json");
-        }
-        else
-        {
-            JSON_Object* info_json_obj;
+            const RATE_WINDOW_SLOT* slot = &tracker->rate_window[index];
 
-            if ((info_json_obj = json_value_get_object(info_json)) == NULL)
-            {
-                LogError("Failed getting json object");
-                json_value_free(info_json);
-            }
-            else
+            if (slot->minute >= 0 && current_minute - slot->minute < RATE_WINDOW_SLOT_COUNT)
             {
-                if (json_object_set_number(info_json_obj, "id", info->update_id) != JSONSuccess)
-                {
-                    LogError("Failed serializing device twin event id");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "send.time", (info->time_updated == INDEFINITE_TIME ? "undefined" : ctime(&info->time_updated))) != JSONSuccess)
-                {
-                    LogError("Failed serializing device twin event send time");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_number(info_json_obj, "send.result", info->update_result) != JSONSuccess)
-                {
-                    LogError("Failed serializing device twin event send result");
-                    json_value_free(info_json);
-                }
-                else if (json_object_dotset_string(info_json_obj, "receive.time", (info->time_received == INDEFINITE_TIME ? "undefined" : ctime(&info->time_received))) != JSONSuccess)
-                {
-                    LogError("Failed serializing device twin event receive time");
-                    json_value_free(info_json);
-                }
-                else if (json_array_append_value(device_twin_array, info_json) != 0)
+                sent_last_hour += slot->sent;
+                received_last_hour += slot->received;
+
+                // Runs shorter than the window are averaged over the minutes they lasted.
+                if (current_minute - slot->minute + 1 > window_minutes)
                 {
-                    LogError("Failed appending device twin event json");
-                    json_value_free(info_json);
+                    window_minutes = current_minute - slot->minute + 1;
                 }
             }
         }
+
+        if (json_object_set_number(result_obj, "sent", (double)tracker->sent) != JSONSuccess)
+        {
+            LogError("Failed serializing sent count");
+        }
+        else if (json_object_set_number(result_obj, "received", (double)tracker->received) != JSONSuccess)
+        {
+            LogError("Failed serializing received count");
+        }
+        else if (json_object_set_number(result_obj, "failed", (double)tracker->failed) != JSONSuccess)
+        {
+            LogError("Failed serializing failed count");
+        }
+        else if (json_object_set_number(result_obj, "in flight", (double)tracker->in_flight_count) != JSONSuccess)
+        {
+            LogError("Failed serializing in flight count");
+        }
+        else if (json_object_set_number(result_obj, "duplicates", (double)tracker->duplicates) != JSONSuccess)
+        {
+            LogError("Failed serializing duplicates count");
+        }
+        else if (json_object_dotset_number(result_obj, "travel time secs.min", travel_time->min) != JSONSuccess)
+        {
+            LogError("Failed serializing min travel time");
+        }
+        else if (json_object_dotset_number(result_obj, "travel time secs.mean", (travel_time->count == 0 ? 0 : (double)travel_time->sum / (double)travel_time->count)) != JSONSuccess)
+        {
+            LogError("Failed serializing mean travel time");
+        }
+        else if (json_object_dotset_number(result_obj, "travel time secs.p50", get_travel_time_percentile(travel_time, 50)) != JSONSuccess)
+        {
+            LogError("Failed serializing median travel time");
+        }
+        else if (json_object_dotset_number(result_obj, "travel time secs.p90", get_travel_time_percentile(travel_time, 90)) != JSONSuccess)
+        {
+            LogError("Failed serializing 90th percentile travel time");
+        }
+        else if (json_object_dotset_number(result_obj, "travel time secs.p99", get_travel_time_percentile(travel_time, 99)) != JSONSuccess)
+        {
+            LogError("Failed serializing 99th percentile travel time");
+        }
+        else if (json_object_dotset_number(result_obj, "travel time secs.max", travel_time->max) != JSONSuccess)
+        {
+            LogError("Failed serializing max travel time");
+        }
+        else if (json_object_dotset_number(result_obj, "last hour.sent per minute", (double)sent_last_hour / (double)window_minutes) != JSONSuccess)
+        {
+            LogError("Failed serializing send rate");
+        }
+        else if (json_object_dotset_number(result_obj, "last hour.received per minute", (double)received_last_hour / (double)window_minutes) != JSONSuccess)
+        {
+            LogError("Failed serializing receive rate");
+        }
     }
 
-    *continue_processing = true;
+    return result;
+}
+
+static void add_json_section(JSON_Object* root_object, const char* name, JSON_Value* section)
+{
+    if (section == NULL)
+    {
+        LogError("Failed serializing %s", name);
+    }
+    else if (json_object_dotset_value(root_object, name, section) != JSONSuccess)
+    {
+        LogError("Failed adding %s to json object", name);
+        json_value_free(section);
+    }
 }
 
 char* iothub_client_statistics_to_json(IOTHUB_CLIENT_STATISTICS_HANDLE handle)
@@ -597,125 +744,54 @@ char* iothub_client_statistics_to_json(IOTHUB_CLIENT_STATISTICS_HANDLE handle)
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS* stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        JSON_Value* root_value;
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        if ((root_value = json_value_init_object()) == NULL)
+        if (Lock(stats->lock) != LOCK_OK)
         {
-            LogError("Failed creating root json value");
+            LogError("Failed locking the statistics");
             result = NULL;
         }
         else
         {
-            JSON_Object* root_object;
+            JSON_Value* root_value;
 
-            if ((root_object = json_value_get_object(root_value)) == NULL)
+            if ((root_value = json_value_init_object()) == NULL)
             {
-                LogError("Failed creating root json object");
+                LogError("Failed creating root json value");
                 result = NULL;
             }
             else
             {
-                JSON_Value* conn_status_array;
-                JSON_Value* telemetry_array;
-                JSON_Value* c2d_array;
-                JSON_Value* methods_array;
-                JSON_Value* twin_desired_array;
-                JSON_Value* twin_reported_array;
-
-                // Connection Status
-                if ((conn_status_array = json_value_init_array()) == NULL)
-                {
-                    LogError("Failed creating json array for connection status");
-                }
-                else if (singlylinkedlist_foreach(stats->connection_status_history, serialize_connection_status, conn_status_array) != 0)
-                {
-                    LogError("Failed adding connection status instances to json array");
-                }
-                else if ((json_object_set_value(root_object, "connection status", conn_status_array)) != JSONSuccess)
-                {
-                    LogError("Failed adding connection status array to json object");
-                }
-                
-                // Telemetry
-                if ((telemetry_array = json_value_init_array()) == NULL)
-                {
-                    LogError("Failed creating json array for telemetry events");
-                }
-                else if (singlylinkedlist_foreach(stats->telemetry_events, serialize_telemetry_event, telemetry_array) != 0)
-                {
-                    LogError("Failed adding telemetry event to json array");
-                }
-                else if ((json_object_set_value(root_object, "telemetry", telemetry_array)) != JSONSuccess)
-                {
-                    LogError("Failed adding telemetry events array to json object");
-                }
-
-                // C2D
-                if ((c2d_array = json_value_init_array()) == NULL)
-                {
-                    LogError("Failed creating json array for c2d events");
-                }
-                else if (singlylinkedlist_foreach(stats->c2d_messages, serialize_c2d_event, c2d_array) != 0)
-                {
-                    LogError("Failed adding c2d event to json array");
-                }
-                else if ((json_object_set_value(root_object, "c2d", c2d_array)) != JSONSuccess)
-                {
-                    LogError("Failed adding c2d events array to json object");
-                }
-                    
-                // Device Methods
-                if ((methods_array = json_value_init_array()) == NULL)
-                {
-                    LogError("Failed creating json array for device method events");
-                }
-                else if (singlylinkedlist_foreach(stats->device_methods, serialize_device_method_event, methods_array) != 0)
-                {
-                    LogError("Failed adding device method event to json array");
-                }
-                else if ((json_object_set_value(root_object, "device methods", methods_array)) != JSONSuccess)
-                {
-                    LogError("Failed adding device method events array to json object");
-                }
+                JSON_Object* root_object;
 
-                // Device Twin Desired Properties
-                if ((twin_desired_array = json_value_init_array()) == NULL)
+                if ((root_object = json_value_get_object(root_value)) == NULL)
                 {
-                    LogError("Failed creating json array for device twin desired properties events");
+                    LogError("Failed creating root json object");
+                    result = NULL;
                 }
-                else if (singlylinkedlist_foreach(stats->twin_desired_properties, serialize_device_twin_desired_event, twin_desired_array) != 0)
-                {
-                    LogError("Failed adding device twin event to json array");
-                }
-                else if ((json_object_dotset_value(root_object, "device twin.desired properties", twin_desired_array)) != JSONSuccess)
+                else
                 {
-                    LogError("Failed adding device twin desired properties events array to json object");
-                }
+                    add_json_section(root_object, "connection status", serialize_connection_status(stats));
+                    add_json_section(root_object, "telemetry", serialize_event_tracker(&stats->telemetry));
+                    add_json_section(root_object, "c2d", serialize_event_tracker(&stats->c2d_messages));
+                    add_json_section(root_object, "device methods", serialize_event_tracker(&stats->device_methods));
+                    add_json_section(root_object, "device twin.desired properties", serialize_event_tracker(&stats->twin_desired_properties));
+                    add_json_section(root_object, "device twin.reported properties", serialize_event_tracker(&stats->twin_reported_properties));
 
-                // Device Twin Reported Properties
-                if ((twin_reported_array = json_value_init_array()) == NULL)
-                {
-                    LogError("Failed creating json array for device twin reported properties events");
-                }
-                else if (singlylinkedlist_foreach(stats->twin_reported_properties, serialize_device_twin_reported_event, twin_reported_array) != 0)
-                {
-                    LogError("Failed adding device twin event to json array");
-                }
-                else if ((json_object_dotset_value(root_object, "device twin.reported properties", twin_reported_array)) != JSONSuccess)
-                {
-                    LogError("Failed adding device twin reported properties events array to json object");
+                    if ((result = json_serialize_to_string_pretty(root_value)) == NULL)
+                    {
+                        LogError("Failed serializing json to string");
+                    }
                 }
 
-                if ((result = json_serialize_to_string_pretty(root_value)) == NULL)
-                {
-                    LogError("Failed serializing json to string");
-                }
+                json_value_free(root_value);
             }
 
-            json_value_free(root_value);
+            if (Unlock(stats->lock) != LOCK_OK)
+            {
+                LogError("Failed unlocking the statistics");
+            }
         }
-
     }
 
     return result;
@@ -732,33 +808,41 @@ int iothub_client_statistics_add_connection_status(IOTHUB_CLIENT_STATISTICS_HAND
     }
     else
     {
-        CONNECTION_STATUS_INFO* conn_status;
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        if ((conn_status = (CONNECTION_STATUS_INFO*)malloc(sizeof(CONNECTION_STATUS_INFO))) == NULL)
+        if (Lock(stats->lock) != LOCK_OK)
         {
-            LogError("Failed allocating CONNECTION_STATUS_INFO");
+            LogError("Failed locking the statistics");
             result = __FAILURE__;
         }
         else
         {
-            IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
+            CONNECTION_STATUS_INFO* conn_status = &stats->connection_status_history[stats->connection_status_changes % CONNECTION_STATUS_HISTORY_SIZE];
 
-            if (singlylinkedlist_add(stats->connection_status_history, conn_status) == NULL)
+            conn_status->status = status;
+            conn_status->reason = reason;
+
+            if ((conn_status->time = time(NULL)) == INDEFINITE_TIME)
             {
-                LogError("Failed adding CONNECTION_STATUS_INFO");
-                result = __FAILURE__;
+                LogError("Failed setting the connection status info time");
+            }
+
+            if (status == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED)
+            {
+                stats->times_authenticated++;
             }
             else
             {
-                conn_status->status = status;
-                conn_status->reason = reason;
+                stats->times_unauthenticated++;
+            }
 
-                if ((conn_status->time = time(NULL)) == INDEFINITE_TIME)
-                {
-                    LogError("Failed setting the connection status info time");
-                }
+            stats->connection_status_changes++;
 
-                result = 0;
+            result = 0;
+
+            if (Unlock(stats->lock) != LOCK_OK)
+            {
+                LogError("Failed unlocking the statistics");
             }
         }
     }
@@ -766,14 +850,6 @@ int iothub_client_statistics_add_connection_status(IOTHUB_CLIENT_STATISTICS_HAND
     return result;
 }
 
-static bool find_telemetry_info_by_id(LIST_ITEM_HANDLE list_item, const void* match_context)
-{
-    TELEMETRY_INFO* match_info = (TELEMETRY_INFO*)match_context;
-    TELEMETRY_INFO* item_info = (TELEMETRY_INFO*)singlylinkedlist_item_get_value(list_item);
-
-    return (item_info->message_id == match_info->message_id);
-}
-
 int iothub_client_statistics_add_telemetry_info(IOTHUB_CLIENT_STATISTICS_HANDLE handle, TELEMETRY_EVENT_TYPE type, TELEMETRY_INFO* info)
 {
     int result;
@@ -785,61 +861,69 @@ int iothub_client_statistics_add_telemetry_info(IOTHUB_CLIENT_STATISTICS_HANDLE
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        TELEMETRY_INFO* queued_info;
-        LIST_ITEM_HANDLE list_item = singlylinkedlist_find(stats->telemetry_events, find_telemetry_info_by_id, info);
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        if (list_item == NULL)
+        if (Lock(stats->lock) != LOCK_OK)
         {
-            if (type != TELEMETRY_QUEUED)
-            {
-                LogError("Telemetry info not found for message %d (%d)", info->message_id, type);
-                result = __FAILURE__;
-            }
-            else if ((queued_info = (TELEMETRY_INFO*)malloc(sizeof(TELEMETRY_INFO))) == NULL)
-            {
-                LogError("Failed clonning the TELEMETRY_INFO");
-                result = __FAILURE__;
-            }
-            else if (singlylinkedlist_add(stats->telemetry_events, queued_info) == NULL)
-            {
-                LogError("Failed adding telemetry info (message id: %d)", info->message_id);
-                free(queued_info);
-                result = __FAILURE__;
-            }
-            else
-            {
-                queued_info->message_id = info->message_id;
-                queued_info->time_queued = info->time_queued;
-                queued_info->send_result = info->send_result;
-                queued_info->time_sent = INDEFINITE_TIME;
-                queued_info->send_callback_result = IOTHUB_CLIENT_ERROR;
-                queued_info->time_received = INDEFINITE_TIME;
-
-                result = 0;
-            }
+            LogError("Failed locking the statistics");
+            result = __FAILURE__;
         }
         else
         {
-            if ((queued_info = (TELEMETRY_INFO*)singlylinkedlist_item_get_value(list_item)) == NULL)
+            EVENT_TRACKER* tracker = &stats->telemetry;
+            IN_FLIGHT_ITEM* queued_info = find_in_flight_item(tracker, info->message_id);
+
+            if (queued_info == NULL)
             {
-                LogError("Failed retrieving queued telemetry info (message id: %d)", info->message_id);
-                result = __FAILURE__;
+                if (type != TELEMETRY_QUEUED)
+                {
+                    if (is_duplicate_event(tracker, info->message_id))
+                    {
+                        result = 0;
+                    }
+                    else
+                    {
+                        LogError("Telemetry info not found for message %d (%d)", info->message_id, type);
+                        result = __FAILURE__;
+                    }
+                }
+                else if ((queued_info = add_in_flight_item(tracker, info->message_id)) == NULL)
+                {
+                    LogError("Failed adding telemetry info (message id: %d)", info->message_id);
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    count_sent(tracker);
+                    result = 0;
+                }
             }
             else
             {
                 if (type == TELEMETRY_SENT)
                 {
-                    queued_info->time_sent = info->time_sent;
-                    queued_info->send_callback_result = info->send_callback_result;
+                    set_item_started(queued_info, info->time_sent);
+
+                    if (info->send_callback_result != IOTHUB_CLIENT_CONFIRMATION_OK)
+                    {
+                        tracker->failed++;
+                    }
+
+                    complete_item_if_done(tracker, queued_info);
                 }
                 else if (type == TELEMETRY_RECEIVED)
                 {
-                    queued_info->time_received = info->time_received;
+                    set_item_received(queued_info, info->time_received);
+                    complete_item_if_done(tracker, queued_info);
                 }
 
                 result = 0;
             }
+
+            if (Unlock(stats->lock) != LOCK_OK)
+            {
+                LogError("Failed unlocking the statistics");
+            }
         }
     }
 
@@ -857,54 +941,30 @@ int iothub_client_statistics_get_telemetry_summary(IOTHUB_CLIENT_STATISTICS_HAND
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        LIST_ITEM_HANDLE list_item;
-
-        (void)memset(summary, 0, sizeof(IOTHUB_CLIENT_STATISTICS_TELEMETRY_SUMMARY));
-        summary->min_travel_time_secs = LONG_MAX;
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        list_item = singlylinkedlist_get_head_item(stats->telemetry_events);
-
-        while (list_item != NULL)
+        if (Lock(stats->lock) != LOCK_OK)
+        {
+            LogError("Failed locking the statistics");
+            result = __FAILURE__;
+        }
+        else
         {
-            TELEMETRY_INFO* telemetry_info = (TELEMETRY_INFO*)singlylinkedlist_item_get_value(list_item);
+            (void)memset(summary, 0, sizeof(IOTHUB_CLIENT_STATISTICS_TELEMETRY_SUMMARY));
+            summarize_event_tracker(&stats->telemetry, &summary->messages_sent, &summary->messages_received, &summary->min_travel_time_secs, &summary->max_travel_time_secs);
 
-            summary->messages_sent = summary->messages_sent + 1;
+            result = 0;
 
-            if (telemetry_info->time_received != INDEFINITE_TIME)
+            if (Unlock(stats->lock) != LOCK_OK)
             {
-                double travel_time = difftime(telemetry_info->time_received, telemetry_info->time_sent);
-
-                if (travel_time < summary->min_travel_time_secs)
-                {
-                    summary->min_travel_time_secs = travel_time;
-                }
-
-                if (travel_time > summary->max_travel_time_secs)
-                {
-                    summary->max_travel_time_secs = travel_time;
-                }
-
-                summary->messages_received = summary->messages_received + 1;
+                LogError("Failed unlocking the statistics");
             }
-
-            list_item = singlylinkedlist_get_next_item(list_item);
         }
-
-        result = 0;
     }
 
     return result;
 }
 
-static bool find_c2d_message_info_by_id(LIST_ITEM_HANDLE list_item, const void* match_context)
-{
-    C2D_MESSAGE_INFO* match_info = (C2D_MESSAGE_INFO*)match_context;
-    C2D_MESSAGE_INFO* item_info = (C2D_MESSAGE_INFO*)singlylinkedlist_item_get_value(list_item);
-
-    return (item_info->message_id == match_info->message_id);
-}
-
 int iothub_client_statistics_add_c2d_info(IOTHUB_CLIENT_STATISTICS_HANDLE handle, C2D_EVENT_TYPE type, C2D_MESSAGE_INFO* info)
 {
     int result;
@@ -916,65 +976,74 @@ int iothub_client_statistics_add_c2d_info(IOTHUB_CLIENT_STATISTICS_HANDLE handle
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        C2D_MESSAGE_INFO* queued_info;
-        LIST_ITEM_HANDLE list_item = singlylinkedlist_find(stats->c2d_messages, find_c2d_message_info_by_id, info);
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        if (list_item == NULL)
+        if (Lock(stats->lock) != LOCK_OK)
         {
-            if (type != C2D_QUEUED)
-            {
-                LogError("C2D message info not found for message %d (%d)", info->message_id, type);
-                result = __FAILURE__;
-            }
-            else if ((queued_info = (C2D_MESSAGE_INFO*)malloc(sizeof(C2D_MESSAGE_INFO))) == NULL)
-            {
-                LogError("Failed clonning the C2D_MESSAGE_INFO");
-                result = __FAILURE__;
-            }
-            else if (singlylinkedlist_add(stats->c2d_messages, queued_info) == NULL)
-            {
-                LogError("Failed adding c2d message info (message id: %d)", info->message_id);
-                free(queued_info);
-                result = __FAILURE__;
-            }
-            else
-            {
-                queued_info->message_id = info->message_id;
-                queued_info->time_queued = info->time_queued;
-                queued_info->send_result = info->send_result;
-                queued_info->time_received = INDEFINITE_TIME;
-                queued_info->time_sent = INDEFINITE_TIME;
-
-                result = 0;
-            }
+            LogError("Failed locking the statistics");
+            result = __FAILURE__;
         }
         else
         {
-            if ((queued_info = (C2D_MESSAGE_INFO*)singlylinkedlist_item_get_value(list_item)) == NULL)
+            EVENT_TRACKER* tracker = &stats->c2d_messages;
+            IN_FLIGHT_ITEM* queued_info = find_in_flight_item(tracker, info->message_id);
+
+            if (queued_info == NULL)
             {
-                LogError("Failed retrieving queued c2d message info (message id: %d)", info->message_id);
-                result = __FAILURE__;
+                if (type != C2D_QUEUED)
+                {
+                    if (is_duplicate_event(tracker, info->message_id))
+                    {
+                        result = 0;
+                    }
+                    else
+                    {
+                        LogError("C2D message info not found for message %d (%d)", info->message_id, type);
+                        result = __FAILURE__;
+                    }
+                }
+                else if (add_in_flight_item(tracker, info->message_id) == NULL)
+                {
+                    LogError("Failed adding c2d message info (message id: %d)", info->message_id);
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    result = 0;
+                }
             }
             else
             {
                 if (type == C2D_SENT)
                 {
-                    queued_info->time_sent = info->time_sent;
-                    queued_info->send_callback_result = info->send_callback_result;
+                    set_item_started(queued_info, info->time_sent);
+                    count_sent(tracker);
+
+                    if (info->send_callback_result != IOTHUB_MESSAGING_OK)
+                    {
+                        tracker->failed++;
+                    }
+
+                    complete_item_if_done(tracker, queued_info);
                     result = 0;
                 }
                 else if (type == C2D_RECEIVED)
                 {
-                    queued_info->time_received = info->time_received;
+                    set_item_received(queued_info, info->time_received);
+                    complete_item_if_done(tracker, queued_info);
                     result = 0;
                 }
                 else
                 {
-                    LogError("C2D message %d in queue, invalid event type (%d)", info->message_id, ENUM_TO_STRING(C2D_EVENT_TYPE, type));
+                    LogError("C2D message %d in queue, invalid event type (%s)", info->message_id, ENUM_TO_STRING(C2D_EVENT_TYPE, type));
                     result = __FAILURE__;
                 }
             }
+
+            if (Unlock(stats->lock) != LOCK_OK)
+            {
+                LogError("Failed unlocking the statistics");
+            }
         }
     }
 
@@ -992,58 +1061,30 @@ int iothub_client_statistics_get_c2d_summary(IOTHUB_CLIENT_STATISTICS_HANDLE han
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        LIST_ITEM_HANDLE list_item;
-
-        (void)memset(summary, 0, sizeof(IOTHUB_CLIENT_STATISTICS_C2D_SUMMARY));
-        summary->min_travel_time_secs = LONG_MAX;
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        list_item = singlylinkedlist_get_head_item(stats->c2d_messages);
-
-        while (list_item != NULL)
+        if (Lock(stats->lock) != LOCK_OK)
         {
-            C2D_MESSAGE_INFO* c2d_msg_info = (C2D_MESSAGE_INFO*)singlylinkedlist_item_get_value(list_item);
-
-            if (c2d_msg_info->time_sent != INDEFINITE_TIME)
-            {
-                summary->messages_sent = summary->messages_sent + 1;
-
-                if (c2d_msg_info->time_received != INDEFINITE_TIME)
-                {
-                    double travel_time = difftime(c2d_msg_info->time_received, c2d_msg_info->time_sent);
-
-                    if (travel_time < summary->min_travel_time_secs)
-                    {
-                        summary->min_travel_time_secs = travel_time;
-                    }
+            LogError("Failed locking the statistics");
+            result = __FAILURE__;
+        }
+        else
+        {
+            (void)memset(summary, 0, sizeof(IOTHUB_CLIENT_STATISTICS_C2D_SUMMARY));
+            summarize_event_tracker(&stats->c2d_messages, &summary->messages_sent, &summary->messages_received, &summary->min_travel_time_secs, &summary->max_travel_time_secs);
 
-                    if (travel_time > summary->max_travel_time_secs)
-                    {
-                        summary->max_travel_time_secs = travel_time;
-                    }
+            result = 0;
 
-                    summary->messages_received = summary->messages_received + 1;
-                }
+            if (Unlock(stats->lock) != LOCK_OK)
+            {
+                LogError("Failed unlocking the statistics");
             }
-
-            list_item = singlylinkedlist_get_next_item(list_item);
         }
-
-        result = 0;
     }
 
     return result;
 }
 
-
-static bool find_device_method_info_by_id(LIST_ITEM_HANDLE list_item, const void* match_context)
-{
-    DEVICE_METHOD_INFO* match_info = (DEVICE_METHOD_INFO*)match_context;
-    DEVICE_METHOD_INFO* item_info = (DEVICE_METHOD_INFO*)singlylinkedlist_item_get_value(list_item);
-
-    return (item_info->method_id == match_info->method_id);
-}
-
 int iothub_client_statistics_add_device_method_info(IOTHUB_CLIENT_STATISTICS_HANDLE handle, DEVICE_METHOD_EVENT_TYPE type, DEVICE_METHOD_INFO* info)
 {
     int result;
@@ -1055,56 +1096,63 @@ int iothub_client_statistics_add_device_method_info(IOTHUB_CLIENT_STATISTICS_HAN
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        DEVICE_METHOD_INFO* queued_info;
-        LIST_ITEM_HANDLE list_item = singlylinkedlist_find(stats->device_methods, find_device_method_info_by_id, info);
-
-        result = __FAILURE__;
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        if (list_item == NULL)
+        if (Lock(stats->lock) != LOCK_OK)
         {
-            if ((queued_info = (DEVICE_METHOD_INFO*)malloc(sizeof(DEVICE_METHOD_INFO))) == NULL)
-            {
-                LogError("Failed clonning the DEVICE_METHOD_INFO");
-            }
-            else if (singlylinkedlist_add(stats->device_methods, queued_info) == NULL)
-            {
-                LogError("Failed adding device methods info (method id: %d)", info->method_id);
-                free(queued_info);
-                queued_info = NULL;
-            }
-            else
-            {
-                memset(queued_info, 0, sizeof(DEVICE_METHOD_INFO));
-                queued_info->method_id = info->method_id;
-                queued_info->time_invoked = INDEFINITE_TIME;
-                queued_info->time_received = INDEFINITE_TIME;
-            }
+            LogError("Failed locking the statistics");
+            result = __FAILURE__;
         }
         else
         {
-            if ((queued_info = (DEVICE_METHOD_INFO*)singlylinkedlist_item_get_value(list_item)) == NULL)
-            {
-                LogError("Failed retrieving queued device method info (method id: %d)", info->method_id);
-            }
-        }
+            EVENT_TRACKER* tracker = &stats->device_methods;
+            IN_FLIGHT_ITEM* queued_info = find_in_flight_item(tracker, info->method_id);
 
-        if (queued_info != NULL)
-        {
-            if (type == DEVICE_METHOD_INVOKED)
+            result = __FAILURE__;
+
+            // The device usually gets the method before IoTHubDeviceMethod_Invoke returns, so either event can come first.
+            if (queued_info == NULL)
             {
-                queued_info->time_invoked = info->time_invoked;
-                queued_info->method_result = info->method_result;
-                result = 0;
+                if (is_duplicate_event(tracker, info->method_id))
+                {
+                    result = 0;
+                }
+                else if ((queued_info = add_in_flight_item(tracker, info->method_id)) == NULL)
+                {
+                    LogError("Failed adding device methods info (method id: %d)", info->method_id);
+                }
             }
-            else if (type == DEVICE_METHOD_RECEIVED)
+
+            if (queued_info != NULL)
             {
-                queued_info->time_received = info->time_received;
-                result = 0;
+                if (type == DEVICE_METHOD_INVOKED)
+                {
+                    set_item_started(queued_info, info->time_invoked);
+                    count_sent(tracker);
+
+                    if (info->method_result != IOTHUB_DEVICE_METHOD_OK)
+                    {
+                        tracker->failed++;
+                    }
+
+                    complete_item_if_done(tracker, queued_info);
+                    result = 0;
+                }
+                else if (type == DEVICE_METHOD_RECEIVED)
+                {
+                    set_item_received(queued_info, info->time_received);
+                    complete_item_if_done(tracker, queued_info);
+                    result = 0;
+                }
+                else
+                {
+                    LogError("Device method %d in queue; invalid event type (%s)", info->method_id, ENUM_TO_STRING(DEVICE_METHOD_EVENT_TYPE, type));
+                }
             }
-            else
+
+            if (Unlock(stats->lock) != LOCK_OK)
             {
-                LogError("Device method %d in queue; invalid event type (%d)", info->method_id, ENUM_TO_STRING(DEVICE_METHOD_EVENT_TYPE, type));
+                LogError("Failed unlocking the statistics");
             }
         }
     }
@@ -1123,65 +1171,30 @@ int iothub_client_statistics_get_device_method_summary(IOTHUB_CLIENT_STATISTICS_
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        LIST_ITEM_HANDLE list_item;
-
-        (void)memset(summary, 0, sizeof(IOTHUB_CLIENT_STATISTICS_DEVICE_METHOD_SUMMARY));
-        summary->min_travel_time_secs = LONG_MAX;
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        list_item = singlylinkedlist_get_head_item(stats->device_methods);
-
-        while (list_item != NULL)
+        if (Lock(stats->lock) != LOCK_OK)
         {
-            DEVICE_METHOD_INFO* device_method_info = (DEVICE_METHOD_INFO*)singlylinkedlist_item_get_value(list_item);
-
-            if (device_method_info->time_invoked != INDEFINITE_TIME)
-            {
-                summary->methods_invoked = summary->methods_invoked + 1;
-
-                if (device_method_info->time_received != INDEFINITE_TIME)
-                {
-                    double travel_time = difftime(device_method_info->time_received, device_method_info->time_invoked);
-
-                    if (travel_time < summary->min_travel_time_secs)
-                    {
-                        summary->min_travel_time_secs = travel_time;
-                    }
+            LogError("Failed locking the statistics");
+            result = __FAILURE__;
+        }
+        else
+        {
+            (void)memset(summary, 0, sizeof(IOTHUB_CLIENT_STATISTICS_DEVICE_METHOD_SUMMARY));
+            summarize_event_tracker(&stats->device_methods, &summary->methods_invoked, &summary->methods_received, &summary->min_travel_time_secs, &summary->max_travel_time_secs);
 
-                    if (travel_time > summary->max_travel_time_secs)
-                    {
-                        summary->max_travel_time_secs = travel_time;
-                    }
+            result = 0;
 
-                    summary->methods_received = summary->methods_received + 1;
-                }
+            if (Unlock(stats->lock) != LOCK_OK)
+            {
+                LogError("Failed unlocking the statistics");
             }
-
-            list_item = singlylinkedlist_get_next_item(list_item);
         }
-
-        result = 0;
     }
 
     return result;
 }
 
-static bool find_device_twin_info_by_id(LIST_ITEM_HANDLE list_item, const void* match_context)
-{
-    DEVICE_TWIN_DESIRED_INFO* match_info = (DEVICE_TWIN_DESIRED_INFO*)match_context;
-    DEVICE_TWIN_DESIRED_INFO* item_info = (DEVICE_TWIN_DESIRED_INFO*)singlylinkedlist_item_get_value(list_item);
-
-    return (item_info->update_id == match_info->update_id);
-}
-
-static bool find_device_twin_reported_info_by_id(LIST_ITEM_HANDLE list_item, const void* match_context)
-{
-    DEVICE_TWIN_REPORTED_INFO* match_info = (DEVICE_TWIN_REPORTED_INFO*)match_context;
-    DEVICE_TWIN_REPORTED_INFO* item_info = (DEVICE_TWIN_REPORTED_INFO*)singlylinkedlist_item_get_value(list_item);
-
-    return (item_info->update_id == match_info->update_id);
-}
-
 int iothub_client_statistics_add_device_twin_desired_info(IOTHUB_CLIENT_STATISTICS_HANDLE handle, DEVICE_TWIN_EVENT_TYPE type, DEVICE_TWIN_DESIRED_INFO* info)
 {
     int result;
@@ -1193,58 +1206,63 @@ int iothub_client_statistics_add_device_twin_desired_info(IOTHUB_CLIENT_STATISTI
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        DEVICE_TWIN_DESIRED_INFO* queued_info;
-        LIST_ITEM_HANDLE list_item = singlylinkedlist_find(stats->twin_desired_properties, find_device_twin_info_by_id, info);
-
-        LogInfo("type=%s, id=%d)", ENUM_TO_STRING(DEVICE_TWIN_EVENT_TYPE, type), info->update_id);
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        if (list_item == NULL)
+        if (Lock(stats->lock) != LOCK_OK)
+        {
+            LogError("Failed locking the statistics");
+            result = __FAILURE__;
+        }
+        else
         {
-            if (type != DEVICE_TWIN_UPDATE_SENT)
+            EVENT_TRACKER* tracker = &stats->twin_desired_properties;
+            IN_FLIGHT_ITEM* queued_info = find_in_flight_item(tracker, info->update_id);
+
+            LogInfo("type=%s, id=%d)", ENUM_TO_STRING(DEVICE_TWIN_EVENT_TYPE, type), info->update_id);
+
+            result = __FAILURE__;
+
+            // The device may get the update before IoTHubDeviceTwin_UpdateTwin returns, so either event can come first.
+            if (type != DEVICE_TWIN_UPDATE_SENT && type != DEVICE_TWIN_UPDATE_RECEIVED)
             {
                 LogError("Invalid info type (update id=%d, type=%s)", info->update_id, ENUM_TO_STRING(DEVICE_TWIN_EVENT_TYPE, type));
-                result = __FAILURE__;
-            }
-            else if ((queued_info = (DEVICE_TWIN_DESIRED_INFO*)malloc(sizeof(DEVICE_TWIN_DESIRED_INFO))) == NULL)
-            {
-                LogError("Failed clonning the DEVICE_TWIN_DESIRED_INFO");
-                result = __FAILURE__;
             }
-            else if (singlylinkedlist_add(stats->twin_desired_properties, queued_info) == NULL)
+            else if (queued_info == NULL)
             {
-                LogError("Failed adding device twin info (update id: %d)", info->update_id);
-                free(queued_info);
-                result = __FAILURE__;
+                if (is_duplicate_event(tracker, info->update_id))
+                {
+                    result = 0;
+                }
+                else if ((queued_info = add_in_flight_item(tracker, info->update_id)) == NULL)
+                {
+                    LogError("Failed adding device twin info (update id: %d)", info->update_id);
+                }
             }
-            else
-            {
-                memset(queued_info, 0, sizeof(DEVICE_TWIN_DESIRED_INFO));
-                queued_info->update_id = info->update_id;
-                queued_info->time_updated = info->time_updated;
-                queued_info->update_result = info->update_result;
-                queued_info->time_received = INDEFINITE_TIME;
 
-                result = 0;
-            }
-        }
-        else
-        {
-            if ((queued_info = (DEVICE_TWIN_DESIRED_INFO*)singlylinkedlist_item_get_value(list_item)) == NULL)
-            {
-                LogError("Failed retrieving queued device twin info (update id: %d)", info->update_id);
-                result = __FAILURE__;
-            }
-            else if (type == DEVICE_TWIN_UPDATE_RECEIVED)
+            if (queued_info != NULL)
             {
-                queued_info->time_received = info->time_received;
+                if (type == DEVICE_TWIN_UPDATE_SENT)
+                {
+                    set_item_started(queued_info, info->time_updated);
+                    count_sent(tracker);
+
+                    if (info->update_result < 0)
+                    {
+                        tracker->failed++;
+                    }
+                }
+                else
+                {
+                    set_item_received(queued_info, info->time_received);
+                }
 
+                complete_item_if_done(tracker, queued_info);
                 result = 0;
             }
-            else
+
+            if (Unlock(stats->lock) != LOCK_OK)
             {
-                LogError("Device twin %d in queue; invalid event type (%d)", info->update_id, ENUM_TO_STRING(DEVICE_TWIN_EVENT_TYPE, type));
-                result = __FAILURE__;
+                LogError("Failed unlocking the statistics");
             }
         }
     }
@@ -1263,44 +1281,25 @@ int iothub_client_statistics_get_device_twin_desired_summary(IOTHUB_CLIENT_STATI
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        LIST_ITEM_HANDLE list_item;
-
-        (void)memset(summary, 0, sizeof(IOTHUB_CLIENT_STATISTICS_DEVICE_TWIN_SUMMARY));
-        summary->min_travel_time_secs = LONG_MAX;
-
-        list_item = singlylinkedlist_get_head_item(stats->twin_desired_properties);
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        while (list_item != NULL)
+        if (Lock(stats->lock) != LOCK_OK)
         {
-            DEVICE_TWIN_DESIRED_INFO* device_twin_info = (DEVICE_TWIN_DESIRED_INFO*)singlylinkedlist_item_get_value(list_item);
-
-            if (device_twin_info->time_updated != INDEFINITE_TIME)
-            {
-                summary->updates_sent = summary->updates_sent + 1;
-
-                if (device_twin_info->time_received != INDEFINITE_TIME)
-                {
-                    double travel_time = difftime(device_twin_info->time_received, device_twin_info->time_updated);
-
-                    if (travel_time < summary->min_travel_time_secs)
-                    {
-                        summary->min_travel_time_secs = travel_time;
-                    }
+            LogError("Failed locking the statistics");
+            result = __FAILURE__;
+        }
+        else
+        {
+            (void)memset(summary, 0, sizeof(IOTHUB_CLIENT_STATISTICS_DEVICE_TWIN_SUMMARY));
+            summarize_event_tracker(&stats->twin_desired_properties, &summary->updates_sent, &summary->updates_received, &summary->min_travel_time_secs, &summary->max_travel_time_secs);
 
-                    if (travel_time > summary->max_travel_time_secs)
-                    {
-                        summary->max_travel_time_secs = travel_time;
-                    }
+            result = 0;
 
-                    summary->updates_received = summary->updates_received + 1;
-                }
+            if (Unlock(stats->lock) != LOCK_OK)
+            {
+                LogError("Failed unlocking the statistics");
             }
-
-            list_item = singlylinkedlist_get_next_item(list_item);
         }
-
-        result = 0;
     }
 
     return result;
@@ -1317,70 +1316,78 @@ int iothub_client_statistics_add_device_twin_reported_info(IOTHUB_CLIENT_STATIST
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        DEVICE_TWIN_REPORTED_INFO* queued_info;
-        LIST_ITEM_HANDLE list_item = singlylinkedlist_find(stats->twin_reported_properties, find_device_twin_reported_info_by_id, info);
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        if (list_item == NULL)
+        if (Lock(stats->lock) != LOCK_OK)
         {
-            if (type != DEVICE_TWIN_UPDATE_QUEUED)
-            {
-                LogError("Invalid info type (update id=%d, type=%s)", info->update_id, ENUM_TO_STRING(DEVICE_TWIN_EVENT_TYPE, type));
-                result = __FAILURE__;
-            }
-            else if ((queued_info = (DEVICE_TWIN_REPORTED_INFO*)malloc(sizeof(DEVICE_TWIN_REPORTED_INFO))) == NULL)
-            {
-                LogError("Failed clonning the DEVICE_TWIN_REPORTED_INFO");
-                result = __FAILURE__;
-            }
-            else if (singlylinkedlist_add(stats->twin_reported_properties, queued_info) == NULL)
-            {
-                LogError("Failed adding device twin info (update id: %d)", info->update_id);
-                free(queued_info);
-                result = __FAILURE__;
-            }
-            else
-            {
-                memset(queued_info, 0, sizeof(DEVICE_TWIN_REPORTED_INFO));
-                queued_info->update_id = info->update_id;
-                queued_info->time_queued = info->time_queued;
-                queued_info->update_result = info->update_result;
-                queued_info->time_sent = INDEFINITE_TIME;
-                queued_info->time_received = INDEFINITE_TIME;
-
-                result = 0;
-            }
+            LogError("Failed locking the statistics");
+            result = __FAILURE__;
         }
         else
         {
-            if ((queued_info = (DEVICE_TWIN_REPORTED_INFO*)singlylinkedlist_item_get_value(list_item)) == NULL)
+            EVENT_TRACKER* tracker = &stats->twin_reported_properties;
+            IN_FLIGHT_ITEM* queued_info = find_in_flight_item(tracker, info->update_id);
+
+            if (queued_info == NULL)
             {
-                LogError("Failed retrieving queued device twin info (update id: %d)", info->update_id);
-                result = __FAILURE__;
+                if (type != DEVICE_TWIN_UPDATE_QUEUED)
+                {
+                    // The service client reads the twin on every iteration, so the same update is usually received several times.
+                    if (type == DEVICE_TWIN_UPDATE_RECEIVED && is_duplicate_event(tracker, info->update_id))
+                    {
+                        result = 0;
+                    }
+                    else
+                    {
+                        LogError("Invalid info type (update id=%d, type=%s)", info->update_id, ENUM_TO_STRING(DEVICE_TWIN_EVENT_TYPE, type));
+                        result = __FAILURE__;
+                    }
+                }
+                else if (add_in_flight_item(tracker, info->update_id) == NULL)
+                {
+                    LogError("Failed adding device twin info (update id: %d)", info->update_id);
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    count_sent(tracker);
+
+                    if (info->update_result != IOTHUB_CLIENT_OK)
+                    {
+                        tracker->failed++;
+                    }
+
+                    result = 0;
+                }
             }
-            else  if (type == DEVICE_TWIN_UPDATE_SENT)
+            else if (type == DEVICE_TWIN_UPDATE_SENT)
             {
-                queued_info->time_sent = info->time_sent;
-                queued_info->send_status_code = info->send_status_code;
-                    
+                set_item_started(queued_info, info->time_sent);
+
+                if (info->send_status_code < 200 || info->send_status_code >= 300)
+                {
+                    tracker->failed++;
+                }
+
+                complete_item_if_done(tracker, queued_info);
                 result = 0;
             }
             else if (type == DEVICE_TWIN_UPDATE_RECEIVED)
             {
-                // Due to the nature of the service client, this function might be called several times for the same
-                // test and message ID, so we must ensure only the first call sets the receive time.
-                if (queued_info->time_received == INDEFINITE_TIME)
-                {
-                    queued_info->time_received = info->time_received;
-                }
-
+                set_item_received(queued_info, info->time_received);
+                complete_item_if_done(tracker, queued_info);
                 result = 0;
             }
             else
             {
-                LogError("Device twin %d in queue; invalid event type (%d)", info->update_id, ENUM_TO_STRING(DEVICE_TWIN_EVENT_TYPE, type));
+                LogError("Device twin %d in queue; invalid event type (%s)", info->update_id, ENUM_TO_STRING(DEVICE_TWIN_EVENT_TYPE, type));
                 result = __FAILURE__;
             }
+
+            if (Unlock(stats->lock) != LOCK_OK)
+            {
+                LogError("Failed unlocking the statistics");
+            }
         }
     }
 
@@ -1398,42 +1405,26 @@ int iothub_client_statistics_get_device_twin_reported_summary(IOTHUB_CLIENT_STAT
     }
     else
     {
-        IOTHUB_CLIENT_STATISTICS_HANDLE stats = (IOTHUB_CLIENT_STATISTICS*)handle;
-        LIST_ITEM_HANDLE list_item;
-
-        (void)memset(summary, 0, sizeof(IOTHUB_CLIENT_STATISTICS_DEVICE_TWIN_SUMMARY));
-        summary->min_travel_time_secs = LONG_MAX;
+        IOTHUB_CLIENT_LONGHAUL_STATISTICS* stats = (IOTHUB_CLIENT_LONGHAUL_STATISTICS*)handle;
 
-        list_item = singlylinkedlist_get_head_item(stats->twin_reported_properties);
-
-        while (list_item != NULL)
+        if (Lock(stats->lock) != LOCK_OK)
+        {
+            LogError("Failed locking the statistics");
+            result = __FAILURE__;
+        }
+        else
         {
-            DEVICE_TWIN_REPORTED_INFO* device_twin_info = (DEVICE_TWIN_REPORTED_INFO*)singlylinkedlist_item_get_value(list_item);
+            (void)memset(summary, 0, sizeof(IOTHUB_CLIENT_STATISTICS_DEVICE_TWIN_SUMMARY));
+            summarize_event_tracker(&stats->twin_reported_properties, &summary->updates_sent, &summary->updates_received, &summary->min_travel_time_secs, &summary->max_travel_time_secs);
 
-            summary->updates_sent = summary->updates_sent + 1;
+            result = 0;
 
-            if (device_twin_info->time_sent != INDEFINITE_TIME && device_twin_info->time_received != INDEFINITE_TIME)
+            if (Unlock(stats->lock) != LOCK_OK)
             {
-                double travel_time = difftime(device_twin_info->time_received, device_twin_info->time_sent);
-
-                if (travel_time < summary->min_travel_time_secs)
-                {
-                    summary->min_travel_time_secs = travel_time;
-                }
-
-                if (travel_time > summary->max_travel_time_secs)
-                {
-                    summary->max_travel_time_secs = travel_time;
-                }
-
-                summary->updates_received = summary->updates_received + 1;
+                LogError("Failed unlocking the statistics");
             }
-
-            list_item = singlylinkedlist_get_next_item(list_item);
         }
-
-        result = 0;
     }
 
     return result;
-}
\ No newline at end of file
+}
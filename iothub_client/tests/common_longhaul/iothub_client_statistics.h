@@ -1,8 +1,14 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
-#ifndef IOTHUB_CLIENT_STATISTICS_H
-#define IOTHUB_CLIENT_STATISTICS_H
+#ifndef IOTHUB_CLIENT_LONGHAUL_STATISTICS_H
+#define IOTHUB_CLIENT_LONGHAUL_STATISTICS_H
+
+/* Statistics of the longhaul tests. Events are aggregated as they are added: an item is tracked by id only while it
+is in flight, travel times go to a histogram and send/receive rates to a one hour sliding window, so the memory used
+and the cost of the summaries and of iothub_client_statistics_to_json do not depend on the length of the run.
+Events for an id that already completed (e.g. a twin update read again by the service client) are counted as
+duplicates. All the functions can be called from any thread, the callbacks of many devices share one instance. */
 
 #include <stdlib.h>
 #include <stddef.h>
@@ -40,17 +46,18 @@ DEFINE_ENUM(DEVICE_METHOD_EVENT_TYPE, DEVICE_METHOD_EVENT_TYPE_VALUES)
 DEFINE_ENUM(DEVICE_TWIN_EVENT_TYPE, DEVICE_TWIN_EVENT_TYPE_VALUES)
 
 
+// Event times are in seconds since the epoch, the load generator stamps them with millisecond resolution.
 typedef struct TELEMETRY_INFO_TAG
 {
     size_t message_id;
 
-    time_t time_queued;
+    double time_queued;
     size_t send_result;
     
-    time_t time_sent;
+    double time_sent;
     IOTHUB_CLIENT_CONFIRMATION_RESULT send_callback_result;
     
-    time_t time_received;
+    double time_received;
 } TELEMETRY_INFO;
 
 typedef struct IOTHUB_CLIENT_STATISTICS_TELEMETRY_SUMMARY_TAG
@@ -65,13 +72,13 @@ typedef struct C2D_MESSAGE_INFO_TAG
 {
     size_t message_id;
 
-    time_t time_queued;
+    double time_queued;
     size_t send_result;
 
-    time_t time_sent;
+    double time_sent;
     IOTHUB_MESSAGING_RESULT send_callback_result;
 
-    time_t time_received;
+    double time_received;
 } C2D_MESSAGE_INFO;
 
 typedef struct IOTHUB_CLIENT_STATISTICS_C2D_SUMMARY_TAG
@@ -86,10 +93,10 @@ typedef struct DEVICE_METHOD_INFO_TAG
 {
     size_t method_id;
 
-    time_t time_invoked;
+    double time_invoked;
     IOTHUB_DEVICE_METHOD_RESULT method_result;
 
-    time_t time_received;
+    double time_received;
 } DEVICE_METHOD_INFO;
 
 typedef struct IOTHUB_CLIENT_STATISTICS_DEVICE_METHOD_SUMMARY_TAG
@@ -104,23 +111,23 @@ typedef struct DEVICE_TWIN_DESIRED_INFO_TAG
 {
     size_t update_id;
 
-    time_t time_updated;
+    double time_updated;
     int update_result;
 
-    time_t time_received;
+    double time_received;
 } DEVICE_TWIN_DESIRED_INFO;
 
 typedef struct DEVICE_TWIN_REPORTED_INFO_TAG
 {
     size_t update_id;
 
-    time_t time_queued;
+    double time_queued;
     IOTHUB_CLIENT_RESULT update_result;
 
-    time_t time_sent;
+    double time_sent;
     int send_status_code;
 
-    time_t time_received;
+    double time_received;
 } DEVICE_TWIN_REPORTED_INFO;
 
 typedef struct IOTHUB_CLIENT_STATISTICS_DEVICE_TWIN_SUMMARY_TAG
@@ -131,7 +138,7 @@ typedef struct IOTHUB_CLIENT_STATISTICS_DEVICE_TWIN_SUMMARY_TAG
     double max_travel_time_secs;
 } IOTHUB_CLIENT_STATISTICS_DEVICE_TWIN_SUMMARY;
 
-typedef struct IOTHUB_CLIENT_STATISTICS_TAG* IOTHUB_CLIENT_STATISTICS_HANDLE;
+typedef struct IOTHUB_CLIENT_LONGHAUL_STATISTICS_TAG* IOTHUB_CLIENT_STATISTICS_HANDLE;
 
 extern IOTHUB_CLIENT_STATISTICS_HANDLE iothub_client_statistics_create(void);
 
@@ -161,4 +168,4 @@ extern int iothub_client_statistics_get_device_twin_reported_summary(IOTHUB_CLIE
 
 extern void iothub_client_statistics_destroy(IOTHUB_CLIENT_STATISTICS_HANDLE handle);
 
-#endif // IOTHUB_CLIENT_STATISTICS_H
+#endif // IOTHUB_CLIENT_LONGHAUL_STATISTICS_H
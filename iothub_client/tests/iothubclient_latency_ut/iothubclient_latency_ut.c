@@ -0,0 +1,235 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+
+#include "internal/iothub_client_latency.h"
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static IOTHUB_CLIENT_LATENCY_HISTOGRAM g_histogram;
+static IOTHUB_CLIENT_STATISTICS g_statistics;
+static IOTHUB_CLIENT_LATENCY_STAMPS g_stamps;
+
+static void record_range(IOTHUB_CLIENT_LATENCY_HISTOGRAM* histogram, uint32_t first, uint32_t last)
+{
+    uint32_t value;
+    for (value = first; value <= last; value++)
+    {
+        IoTHubClient_Latency_Record(histogram, value);
+    }
+}
+
+BEGIN_TEST_SUITE(iothubclient_latency_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    (void)umock_c_init(on_umock_c_error);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("Could not acquire test serialization mutex.");
+    }
+    memset(&g_histogram, 0, sizeof(g_histogram));
+    memset(&g_statistics, 0, sizeof(g_statistics));
+    IoTHubClient_Latency_ResetStamps(&g_stamps);
+}
+
+TEST_FUNCTION_CLEANUP(method_cleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+TEST_FUNCTION(IoTHubClient_Latency_Record_keeps_count_sum_min_and_max)
+{
+    // arrange
+
+    // act
+    IoTHubClient_Latency_Record(&g_histogram, 30);
+    IoTHubClient_Latency_Record(&g_histogram, 7);
+    IoTHubClient_Latency_Record(&g_histogram, 120);
+
+    // assert
+    ASSERT_ARE_EQUAL(uint64_t, 3, g_histogram.count);
+    ASSERT_ARE_EQUAL(uint64_t, 157, g_histogram.sum);
+    ASSERT_ARE_EQUAL(uint32_t, 7, g_histogram.min);
+    ASSERT_ARE_EQUAL(uint32_t, 120, g_histogram.max);
+}
+
+TEST_FUNCTION(IoTHubClient_Latency_Record_keeps_small_values_exact)
+{
+    // arrange
+    record_range(&g_histogram, 0, 15);
+
+    // act
+    uint32_t median = IoTHubClient_LatencyHistogram_GetPercentile(&g_histogram, 50.0);
+
+    // assert
+    ASSERT_ARE_EQUAL(uint32_t, 7, median);
+}
+
+TEST_FUNCTION(IoTHubClient_LatencyHistogram_GetPercentile_is_within_an_eighth_of_the_value)
+{
+    // arrange
+    record_range(&g_histogram, 1, 1000);
+
+    // act
+    uint32_t p50 = IoTHubClient_LatencyHistogram_GetPercentile(&g_histogram, 50.0);
+    uint32_t p90 = IoTHubClient_LatencyHistogram_GetPercentile(&g_histogram, 90.0);
+    uint32_t p100 = IoTHubClient_LatencyHistogram_GetPercentile(&g_histogram, 100.0);
+
+    // assert
+    ASSERT_IS_TRUE(p50 >= 500 && p50 <= 500 + 500 / 8);
+    ASSERT_IS_TRUE(p90 >= 900 && p90 <= 900 + 900 / 8);
+    ASSERT_ARE_EQUAL(uint32_t, 1000, p100);
+}
+
+TEST_FUNCTION(IoTHubClient_Latency_Record_clamps_huge_values_to_the_last_bucket)
+{
+    // arrange
+
+    // act
+    IoTHubClient_Latency_Record(&g_histogram, (tickcounter_ms_t)UINT32_MAX + 1000);
+
+    // assert
+    ASSERT_ARE_EQUAL(uint32_t, 1, g_histogram.buckets[IOTHUB_CLIENT_LATENCY_BUCKET_COUNT - 1]);
+    ASSERT_ARE_EQUAL(uint32_t, UINT32_MAX, IoTHubClient_LatencyHistogram_GetPercentile(&g_histogram, 99.0));
+}
+
+TEST_FUNCTION(IoTHubClient_LatencyHistogram_GetPercentile_with_empty_histogram_returns_0)
+{
+    // arrange
+
+    // act
+    uint32_t result = IoTHubClient_LatencyHistogram_GetPercentile(&g_histogram, 99.0);
+
+    // assert
+    ASSERT_ARE_EQUAL(uint32_t, 0, result);
+}
+
+TEST_FUNCTION(IoTHubClient_Latency_Merge_adds_the_source)
+{
+    // arrange
+    IOTHUB_CLIENT_LATENCY_HISTOGRAM source;
+    memset(&source, 0, sizeof(source));
+    IoTHubClient_Latency_Record(&g_histogram, 40);
+    IoTHubClient_Latency_Record(&source, 3);
+    IoTHubClient_Latency_Record(&source, 90);
+
+    // act
+    IoTHubClient_Latency_Merge(&g_histogram, &source);
+
+    // assert
+    ASSERT_ARE_EQUAL(uint64_t, 3, g_histogram.count);
+    ASSERT_ARE_EQUAL(uint64_t, 133, g_histogram.sum);
+    ASSERT_ARE_EQUAL(uint32_t, 3, g_histogram.min);
+    ASSERT_ARE_EQUAL(uint32_t, 90, g_histogram.max);
+}
+
+TEST_FUNCTION(IoTHubClient_Latency_Stamp_keeps_the_first_time_of_an_event)
+{
+    // arrange
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_ENQUEUED, 100);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED, 110);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED, 500);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_COMPLETED, 600);
+
+    // act
+    IoTHubClient_Latency_RecordStages(&g_statistics, &g_stamps);
+
+    // assert
+    ASSERT_ARE_EQUAL(uint64_t, 10, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_WAITING_TO_SEND].sum);
+    ASSERT_ARE_EQUAL(uint64_t, 500, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_TOTAL].sum);
+}
+
+TEST_FUNCTION(IoTHubClient_Latency_RecordStages_measures_all_the_stages_of_a_written_message)
+{
+    // arrange
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_ENQUEUED, 100);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED, 120);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_ENCODED, 121);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_WRITTEN, 125);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_COMPLETED, 200);
+
+    // act
+    IoTHubClient_Latency_RecordStages(&g_statistics, &g_stamps);
+
+    // assert
+    ASSERT_ARE_EQUAL(uint64_t, 20, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_WAITING_TO_SEND].sum);
+    ASSERT_ARE_EQUAL(uint64_t, 1, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_ENCODING].sum);
+    ASSERT_ARE_EQUAL(uint64_t, 4, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_SOCKET_WRITE].sum);
+    ASSERT_ARE_EQUAL(uint64_t, 75, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_ACKNOWLEDGEMENT].sum);
+    ASSERT_ARE_EQUAL(uint64_t, 100, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_TOTAL].sum);
+    ASSERT_ARE_EQUAL(uint64_t, 0, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_ENQUEUE].count);
+    ASSERT_ARE_EQUAL(uint64_t, 0, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_CALLBACK_DISPATCH].count);
+}
+
+TEST_FUNCTION(IoTHubClient_Latency_RecordStages_without_write_measures_the_acknowledgement_from_the_encoding)
+{
+    // arrange
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_ENQUEUED, 100);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_DEQUEUED, 120);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_ENCODED, 130);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_COMPLETED, 200);
+
+    // act
+    IoTHubClient_Latency_RecordStages(&g_statistics, &g_stamps);
+
+    // assert
+    ASSERT_ARE_EQUAL(uint64_t, 0, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_SOCKET_WRITE].count);
+    ASSERT_ARE_EQUAL(uint64_t, 70, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_ACKNOWLEDGEMENT].sum);
+}
+
+TEST_FUNCTION(IoTHubClient_Latency_ResetStamps_forgets_the_previous_events)
+{
+    // arrange
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_ENQUEUED, 100);
+
+    // act
+    IoTHubClient_Latency_ResetStamps(&g_stamps);
+    IoTHubClient_Latency_Stamp(&g_stamps, IOTHUB_CLIENT_LATENCY_EVENT_COMPLETED, 200);
+    IoTHubClient_Latency_RecordStages(&g_statistics, &g_stamps);
+
+    // assert
+    ASSERT_ARE_EQUAL(uint64_t, 0, g_statistics.stages[IOTHUB_CLIENT_LATENCY_STAGE_TOTAL].count);
+}
+
+END_TEST_SUITE(iothubclient_latency_ut)
@@ -0,0 +1,721 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/map.h"
+#include "iothub_message.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_offline_store.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    extern void real_DList_InitializeListHead(PDLIST_ENTRY listHead);
+    extern int real_DList_IsListEmpty(const PDLIST_ENTRY listHead);
+    extern void real_DList_InsertTailList(PDLIST_ENTRY listHead, PDLIST_ENTRY listEntry);
+    extern void real_DList_InsertHeadList(PDLIST_ENTRY listHead, PDLIST_ENTRY listEntry);
+    extern void real_DList_AppendTailList(PDLIST_ENTRY listHead, PDLIST_ENTRY ListToAppend);
+    extern int real_DList_RemoveEntryList(PDLIST_ENTRY listEntry);
+    extern PDLIST_ENTRY real_DList_RemoveHeadList(PDLIST_ENTRY listHead);
+    extern int real_mallocAndStrcpy_s(char** destination, const char* source);
+#ifdef __cplusplus
+}
+#endif
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static IOTHUB_MESSAGE_HANDLE TEST_MESSAGE_HANDLE = (IOTHUB_MESSAGE_HANDLE)0x12;
+static IOTHUB_MESSAGE_HANDLE TEST_RESTORED_MESSAGE_HANDLE = (IOTHUB_MESSAGE_HANDLE)0x13;
+static MAP_HANDLE TEST_MAP_HANDLE = (MAP_HANDLE)0x14;
+
+static const unsigned char TEST_BODY[] = { 'h', 'e', 'l', 'l', 'o' };
+static const char* TEST_DIRECTORY = "offline_store_ut_data";
+
+/* a 5 byte body serializes to 39 bytes, 47 with its record header: 5 records fit in a 256 byte segment */
+#define TEST_SEGMENT_SIZE           256
+#define TEST_RECORDS_PER_SEGMENT    5
+
+static size_t g_callback_count;
+static IOTHUB_CLIENT_CONFIRMATION_RESULT g_callback_result;
+
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const unsigned char** buffer, size_t* size)
+{
+    (void)iotHubMessageHandle;
+    *buffer = TEST_BODY;
+    *size = sizeof(TEST_BODY);
+    return IOTHUB_MESSAGE_OK;
+}
+
+static MAP_RESULT my_Map_GetInternals(MAP_HANDLE handle, const char*const** keys, const char*const** values, size_t* count)
+{
+    (void)handle;
+    *keys = NULL;
+    *values = NULL;
+    *count = 0;
+    return MAP_OK;
+}
+
+static void test_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    (void)userContextCallback;
+    g_callback_result = result;
+    g_callback_count++;
+}
+
+static void remove_test_directory(void)
+{
+    char command[128];
+#if defined(WIN32)
+    (void)snprintf(command, sizeof(command), "rmdir /s /q %s 2>nul", TEST_DIRECTORY);
+#else
+    (void)snprintf(command, sizeof(command), "rm -rf %s", TEST_DIRECTORY);
+#endif
+    (void)system(command);
+}
+
+static OFFLINE_STORE_HANDLE create_test_store(size_t max_segments, bool drop_oldest)
+{
+    OFFLINE_STORE_CONFIG config;
+    config.directory = TEST_DIRECTORY;
+    config.segment_size = TEST_SEGMENT_SIZE;
+    config.max_size = TEST_SEGMENT_SIZE * max_segments;
+    config.drop_oldest = drop_oldest;
+    return IoTHubClient_OfflineStore_Create(&config);
+}
+
+static bool checkpoint_file_exists(void)
+{
+    char path[128];
+    FILE* file;
+    (void)snprintf(path, sizeof(path), "%s/checkpoint", TEST_DIRECTORY);
+    file = fopen(path, "rb");
+    if (file != NULL)
+    {
+        (void)fclose(file);
+    }
+    return file != NULL;
+}
+
+static void push_messages(OFFLINE_STORE_HANDLE handle, size_t count)
+{
+    size_t index;
+    for (index = 0; index < count; index++)
+    {
+        int result = IoTHubClient_OfflineStore_Push(handle, TEST_MESSAGE_HANDLE, test_confirmation_callback, NULL);
+        ASSERT_ARE_EQUAL(int, 0, result);
+    }
+}
+
+BEGIN_TEST_SUITE(iothubclient_offline_store_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    (void)umock_c_init(on_umock_c_error);
+
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_bool_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(PDLIST_ENTRY, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(const PDLIST_ENTRY, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_RESULT, int);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InitializeListHead, real_DList_InitializeListHead);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_IsListEmpty, real_DList_IsListEmpty);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InsertTailList, real_DList_InsertTailList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InsertHeadList, real_DList_InsertHeadList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_AppendTailList, real_DList_AppendTailList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_RemoveEntryList, real_DList_RemoveEntryList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_RemoveHeadList, real_DList_RemoveHeadList);
+    REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, real_mallocAndStrcpy_s);
+
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetContentType, IOTHUBMESSAGE_BYTEARRAY);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetByteArray, my_IoTHubMessage_GetByteArray);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_Properties, TEST_MAP_HANDLE);
+    REGISTER_GLOBAL_MOCK_HOOK(Map_GetInternals, my_Map_GetInternals);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_CreateFromByteArray, TEST_RESTORED_MESSAGE_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_CreateFromByteArray, NULL);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("Could not acquire test serialization mutex.");
+    }
+    umock_c_reset_all_calls();
+    remove_test_directory();
+    g_callback_count = 0;
+    g_callback_result = IOTHUB_CLIENT_CONFIRMATION_OK;
+}
+
+TEST_FUNCTION_CLEANUP(method_cleanup)
+{
+    remove_test_directory();
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_001: [ If config or config->directory is NULL, or config->segment_size cannot hold a segment header and one record header, IoTHubClient_OfflineStore_Create shall fail and return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Create_with_NULL_config_fails)
+{
+    // act
+    OFFLINE_STORE_HANDLE handle = IoTHubClient_OfflineStore_Create(NULL);
+
+    // assert
+    ASSERT_IS_NULL(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_001: [ If config or config->directory is NULL, or config->segment_size cannot hold a segment header and one record header, IoTHubClient_OfflineStore_Create shall fail and return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Create_with_NULL_directory_fails)
+{
+    // arrange
+    OFFLINE_STORE_CONFIG config;
+    config.directory = NULL;
+    config.segment_size = TEST_SEGMENT_SIZE;
+    config.max_size = TEST_SEGMENT_SIZE * 2;
+    config.drop_oldest = false;
+
+    // act
+    OFFLINE_STORE_HANDLE handle = IoTHubClient_OfflineStore_Create(&config);
+
+    // assert
+    ASSERT_IS_NULL(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_001: [ If config or config->directory is NULL, or config->segment_size cannot hold a segment header and one record header, IoTHubClient_OfflineStore_Create shall fail and return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Create_with_too_small_segment_fails)
+{
+    // arrange
+    OFFLINE_STORE_CONFIG config;
+    config.directory = TEST_DIRECTORY;
+    config.segment_size = 16;
+    config.max_size = TEST_SEGMENT_SIZE * 2;
+    config.drop_oldest = false;
+
+    // act
+    OFFLINE_STORE_HANDLE handle = IoTHubClient_OfflineStore_Create(&config);
+
+    // assert
+    ASSERT_IS_NULL(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_002: [ IoTHubClient_OfflineStore_Create shall create config->directory if it does not exist. ]*/
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_050: [ IoTHubClient_OfflineStore_GetCount shall return the number of unread messages, or 0 if handle is NULL. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Create_succeeds)
+{
+    // act
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+
+    // assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_010: [ If handle is NULL, IoTHubClient_OfflineStore_Destroy shall do nothing. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Destroy_with_NULL_handle_does_nothing)
+{
+    // act
+    IoTHubClient_OfflineStore_Destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_050: [ IoTHubClient_OfflineStore_GetCount shall return the number of unread messages, or 0 if handle is NULL. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_GetCount_with_NULL_handle_returns_0)
+{
+    // act
+    size_t count = IoTHubClient_OfflineStore_GetCount(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, count);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_020: [ If handle or message is NULL, IoTHubClient_OfflineStore_Push shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Push_with_NULL_handle_fails)
+{
+    // act
+    int result = IoTHubClient_OfflineStore_Push(NULL, TEST_MESSAGE_HANDLE, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_020: [ If handle or message is NULL, IoTHubClient_OfflineStore_Push shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Push_with_NULL_message_fails)
+{
+    // arrange
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+
+    // act
+    int result = IoTHubClient_OfflineStore_Push(handle, NULL, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_022: [ If the serialized message does not fit in an empty segment, IoTHubClient_OfflineStore_Push shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Push_message_larger_than_segment_fails)
+{
+    // arrange
+    OFFLINE_STORE_HANDLE handle;
+    OFFLINE_STORE_CONFIG config;
+    config.directory = TEST_DIRECTORY;
+    config.segment_size = 48;
+    config.max_size = 96;
+    config.drop_oldest = false;
+    handle = IoTHubClient_OfflineStore_Create(&config);
+
+    // act
+    int result = IoTHubClient_OfflineStore_Push(handle, TEST_MESSAGE_HANDLE, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_021: [ IoTHubClient_OfflineStore_Push shall serialize the body, message id, correlation id, content type, content encoding, diagnostic data and application properties of message. ]*/
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_027: [ On success IoTHubClient_OfflineStore_Push shall keep callback and context in memory and return 0. ]*/
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_032: [ IoTHubClient_OfflineStore_Pop shall create a new IOTHUB_MESSAGE_HANDLE from the oldest unread record and return it in message, with its offset in offset and the callback and context given to IoTHubClient_OfflineStore_Push (NULL for messages recovered from disk). ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Pop_returns_pushed_message)
+{
+    // arrange
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    uint64_t offset;
+    int result;
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    result = IoTHubClient_OfflineStore_Push(handle, TEST_MESSAGE_HANDLE, test_confirmation_callback, (void*)0x42);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, sizeof(TEST_BODY)))
+        .ValidateArgumentBuffer(1, TEST_BODY, sizeof(TEST_BODY));
+
+    // act
+    result = IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &offset);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_RESTORED_MESSAGE_HANDLE, message);
+    ASSERT_IS_TRUE(callback == test_confirmation_callback);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)0x42, context);
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_030: [ If any argument is NULL, IoTHubClient_OfflineStore_Pop shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Pop_with_NULL_offset_fails)
+{
+    // arrange
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    push_messages(handle, 1);
+
+    // act
+    int result = IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_031: [ If there are no unread messages, IoTHubClient_OfflineStore_Pop shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Pop_on_empty_store_fails)
+{
+    // arrange
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    uint64_t offset;
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+
+    // act
+    int result = IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &offset);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_033: [ If the record cannot be turned back into a message, IoTHubClient_OfflineStore_Pop shall skip it, invoke its callback with IOTHUB_CLIENT_CONFIRMATION_ERROR and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Pop_when_message_create_fails_skips_record)
+{
+    // arrange
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    uint64_t offset;
+    int result;
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    push_messages(handle, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    result = IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &offset);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_callback_count);
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_CONFIRMATION_ERROR, g_callback_result);
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_034: [ If allocating memory fails, IoTHubClient_OfflineStore_Pop shall leave the record unread and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Pop_when_malloc_fails_keeps_record)
+{
+    // arrange
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    uint64_t offset;
+    int result;
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    push_messages(handle, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    result = IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &offset);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, g_callback_count);
+    ASSERT_ARE_EQUAL(size_t, 1, IoTHubClient_OfflineStore_GetCount(handle));
+
+    result = IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &offset);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(callback == test_confirmation_callback);
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_011: [ IoTHubClient_OfflineStore_Destroy shall invoke the callback of each message pushed but not yet popped with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Destroy_completes_pending_callbacks)
+{
+    // arrange
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    push_messages(handle, 3);
+
+    // act
+    IoTHubClient_OfflineStore_Destroy(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 3, g_callback_count);
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, g_callback_result);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_005: [ Every valid record at or after the checkpoint shall be counted as unread and returned by subsequent calls to IoTHubClient_OfflineStore_Pop, in offset order. ]*/
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_013: [ IoTHubClient_OfflineStore_Destroy shall flush the records and persist the checkpoint as IoTHubClient_OfflineStore_Flush does before closing the store. ]*/
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_012: [ IoTHubClient_OfflineStore_Destroy shall unmap and close the segment files without deleting them. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Create_recovers_messages_across_segments)
+{
+    // arrange
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    uint64_t offset;
+    int result;
+    OFFLINE_STORE_HANDLE handle = create_test_store(4, false);
+    push_messages(handle, TEST_RECORDS_PER_SEGMENT + 2);
+    IoTHubClient_OfflineStore_Destroy(handle);
+
+    // act
+    handle = create_test_store(4, false);
+
+    // assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(size_t, TEST_RECORDS_PER_SEGMENT + 2, IoTHubClient_OfflineStore_GetCount(handle));
+    result = IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &offset);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_NULL((void*)callback);
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_040: [ If handle is NULL or offset was not returned by IoTHubClient_OfflineStore_Pop, IoTHubClient_OfflineStore_Complete shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Complete_with_unknown_offset_fails)
+{
+    // arrange
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    push_messages(handle, 1);
+
+    // act
+    int result = IoTHubClient_OfflineStore_Complete(handle, 1234);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_041: [ IoTHubClient_OfflineStore_Complete shall advance the checkpoint past every contiguous completed message starting from the oldest popped message. ]*/
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_042: [ IoTHubClient_OfflineStore_Complete shall not write to disk, it shall only mark the checkpoint to be persisted by the next IoTHubClient_OfflineStore_Flush. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Complete_does_not_write_checkpoint)
+{
+    // arrange
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    uint64_t offset;
+    int result;
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    push_messages(handle, 2);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &offset));
+
+    // act
+    result = IoTHubClient_OfflineStore_Complete(handle, offset);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_FALSE(checkpoint_file_exists());
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_060: [ If handle is NULL, IoTHubClient_OfflineStore_Flush shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Flush_with_NULL_handle_fails)
+{
+    // arrange
+
+    // act
+    int result = IoTHubClient_OfflineStore_Flush(NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_061: [ IoTHubClient_OfflineStore_Flush shall flush to disk every record written since the previous flush. ]*/
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_062: [ If the checkpoint moved since it was last persisted, IoTHubClient_OfflineStore_Flush shall persist it. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Flush_persists_checkpoint)
+{
+    // arrange
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    uint64_t first_offset;
+    uint64_t second_offset;
+    int result;
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    push_messages(handle, 3);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &first_offset));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &second_offset));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_OfflineStore_Complete(handle, first_offset));
+
+    // act
+    result = IoTHubClient_OfflineStore_Flush(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(checkpoint_file_exists());
+    IoTHubClient_OfflineStore_Destroy(handle);
+    handle = create_test_store(2, false);
+    /* the second message was popped but not completed, so it is replayed along with the third */
+    ASSERT_ARE_EQUAL(size_t, 2, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_013: [ IoTHubClient_OfflineStore_Destroy shall flush the records and persist the checkpoint as IoTHubClient_OfflineStore_Flush does before closing the store. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Destroy_persists_checkpoint)
+{
+    // arrange
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    uint64_t offset;
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    push_messages(handle, 3);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &offset));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_OfflineStore_Complete(handle, offset));
+
+    // act
+    IoTHubClient_OfflineStore_Destroy(handle);
+
+    // assert
+    ASSERT_IS_TRUE(checkpoint_file_exists());
+    handle = create_test_store(2, false);
+    ASSERT_ARE_EQUAL(size_t, 2, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_041: [ IoTHubClient_OfflineStore_Complete shall advance the checkpoint past every contiguous completed message starting from the oldest popped message. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Complete_out_of_order_does_not_move_checkpoint)
+{
+    // arrange
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+    uint64_t first_offset;
+    uint64_t second_offset;
+    int result;
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    push_messages(handle, 2);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &first_offset));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_OfflineStore_Pop(handle, &message, &callback, &context, &second_offset));
+
+    // act
+    result = IoTHubClient_OfflineStore_Complete(handle, second_offset);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    IoTHubClient_OfflineStore_Destroy(handle);
+    handle = create_test_store(2, false);
+    ASSERT_ARE_EQUAL(size_t, 2, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_003: [ The store shall use at most config->max_size / config->segment_size segments, and never less than 2. ]*/
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_024: [ If the store already holds its maximum number of segments and drop_oldest is false, IoTHubClient_OfflineStore_Push shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Push_when_full_and_drop_newest_fails)
+{
+    // arrange
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, false);
+    push_messages(handle, 2 * TEST_RECORDS_PER_SEGMENT);
+
+    // act
+    int result = IoTHubClient_OfflineStore_Push(handle, TEST_MESSAGE_HANDLE, test_confirmation_callback, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_callback_count);
+    ASSERT_ARE_EQUAL(size_t, 2 * TEST_RECORDS_PER_SEGMENT, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_OFFLINE_STORE_32_025: [ If the store already holds its maximum number of segments and drop_oldest is true, IoTHubClient_OfflineStore_Push shall delete the oldest segment, invoke the callback of each of its unread messages with IOTHUB_CLIENT_CONFIRMATION_ERROR and move the checkpoint past it. ]*/
+TEST_FUNCTION(IoTHubClient_OfflineStore_Push_when_full_and_drop_oldest_drops_oldest_segment)
+{
+    // arrange
+    OFFLINE_STORE_HANDLE handle = create_test_store(2, true);
+    push_messages(handle, 2 * TEST_RECORDS_PER_SEGMENT);
+
+    // act
+    int result = IoTHubClient_OfflineStore_Push(handle, TEST_MESSAGE_HANDLE, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, TEST_RECORDS_PER_SEGMENT, g_callback_count);
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_CONFIRMATION_ERROR, g_callback_result);
+    ASSERT_ARE_EQUAL(size_t, TEST_RECORDS_PER_SEGMENT + 1, IoTHubClient_OfflineStore_GetCount(handle));
+
+    // cleanup
+    IoTHubClient_OfflineStore_Destroy(handle);
+}
+
+END_TEST_SUITE(iothubclient_offline_store_ut)
@@ -32,6 +32,7 @@ static const IOTHUB_CLIENT_CONFIG* TEST_CLIENT_CONFIG = (IOTHUB_CLIENT_CONFIG*)0
 static IOTHUB_MESSAGE_HANDLE TEST_MESSAGE_HANDLE = (IOTHUB_MESSAGE_HANDLE)0x1116;
 static TRANSPORT_HANDLE TEST_TRANSPORT_HANDLE = (TRANSPORT_HANDLE)0x1119;
 static IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK TEST_EVENT_CONFIRMATION_CALLBACK = (IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK)0x0002;
+static IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK TEST_EVENT_CONFIRMATION_BATCH_CALLBACK = (IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK)0x000D;
 static IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC TEST_MESSAGE_CALLBACK_ASYNC = (IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC)0x0003;
 static IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK TEST_CONNECTION_STATUS_CALLBACK = (IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK)0x0004;
 static IOTHUB_CLIENT_RETRY_POLICY TEST_RETRY_POLICY = (IOTHUB_CLIENT_RETRY_POLICY)0x0005;
@@ -95,6 +96,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONFIG, void*);
     REGISTER_UMOCK_ALIAS_TYPE(TRANSPORT_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_EVENT_CONFIRMATION_BATCH_CALLBACK, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_RETRY_POLICY, void*);
@@ -112,6 +114,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_CreateWithTransport, TEST_IOTHUB_CLIENT_CORE_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_CreateFromDeviceAuth, TEST_IOTHUB_CLIENT_CORE_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SendEventAsync, IOTHUB_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetEventConfirmationBatchCallback, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_GetSendStatus, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetMessageCallback, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetConnectionStatusCallback, IOTHUB_CLIENT_OK);
@@ -214,6 +217,19 @@ TEST_FUNCTION(IoTHubClient_SendEventAsync_Test)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+TEST_FUNCTION(IoTHubClient_SetEventConfirmationBatchCallback_Test)
+{
+    //arrange
+    STRICT_EXPECTED_CALL(IoTHubClientCore_SetEventConfirmationBatchCallback(TEST_IOTHUB_CLIENT_CORE_HANDLE, TEST_EVENT_CONFIRMATION_BATCH_CALLBACK, NULL));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_SetEventConfirmationBatchCallback(TEST_IOTHUB_CLIENT_HANDLE, TEST_EVENT_CONFIRMATION_BATCH_CALLBACK, NULL);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 TEST_FUNCTION(IoTHubClient_GetSendStatus_Test)
 {
     //arrange
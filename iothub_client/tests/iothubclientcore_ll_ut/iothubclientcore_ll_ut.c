@@ -4,9 +4,11 @@
 #ifdef __cplusplus
 #include <cstdlib>
 #include <cstddef>
+#include <cstring>
 #else
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
 #endif
 
 static void* my_gballoc_malloc(size_t size)
@@ -178,6 +180,12 @@ static const char* TEST_DEVICE_METHOD_RESPONSE = "{device:method, response:true}
 
 const unsigned char TEST_REPORTED_STATE[] = { 0x01, 0x02, 0x03 };
 const size_t TEST_REPORTED_SIZE = sizeof(TEST_REPORTED_STATE) / sizeof(TEST_REPORTED_STATE[0]);
+static const char* TEST_REPORTED_STATE_PATCH_1 = "{\"a\":1,\"b\":{\"x\":1,\"y\":2}}";
+static const char* TEST_REPORTED_STATE_PATCH_2 = "{\"a\":2,\"b\":{\"y\":3}}";
+static const char* TEST_REPORTED_STATE_MERGED = "{\"a\":2,\"b\":{\"x\":1,\"y\":3}}";
+static const char* TEST_REPORTED_STATE_PATCH_COVERING = "{\"a\":3.10,\"b\":{\"x\":2,\"y\":4},\"c\":true}";
+static const char* TEST_REPORTED_STATE_PATCH_DELETE = "{\"b\":null}";
+static const char* TEST_REPORTED_STATE_PATCH_RECREATE = "{\"b\":{\"z\":1}}";
 
 static const TRANSPORT_PROVIDER* provideFAKE(void);
 
@@ -350,9 +358,21 @@ static void my_tickcounter_destroy(TICK_COUNTER_HANDLE tick_counter)
 
 static CONSTBUFFER_HANDLE my_CONSTBUFFER_Create(const unsigned char* source, size_t size)
 {
-    (void)source;
-    (void)size;
-    return (CONSTBUFFER_HANDLE)my_gballoc_malloc(1);
+    /*keeps a copy of the content so that the reported state merge can read it back*/
+    CONSTBUFFER* result = (CONSTBUFFER*)my_gballoc_malloc(sizeof(CONSTBUFFER) + size);
+    unsigned char* content = (unsigned char*)(result + 1);
+    if (source != NULL)
+    {
+        (void)memcpy(content, source, size);
+    }
+    result->buffer = content;
+    result->size = size;
+    return (CONSTBUFFER_HANDLE)result;
+}
+
+static const CONSTBUFFER* my_CONSTBUFFER_GetContent(CONSTBUFFER_HANDLE constbufferHandle)
+{
+    return (const CONSTBUFFER*)constbufferHandle;
 }
 
 static void my_CONSTBUFFER_Destroy(CONSTBUFFER_HANDLE constbufferHandle)
@@ -513,6 +533,17 @@ static void destroy_test_message_info(MESSAGE_CALLBACK_INFO* oneMessageData)
     free(oneMessageData);
 }
 
+/*with use_client_metrics the payload of every acknowledged event and received message is measured*/
+static void setup_message_size_metric(IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+#ifdef USE_CLIENT_METRICS
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(messageHandle))
+        .SetReturn(IOTHUBMESSAGE_UNKNOWN);
+#else
+    (void)messageHandle;
+#endif
+}
+
 static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 {
     char temp_str[256];
@@ -538,6 +569,11 @@ TEST_SUITE_INITIALIZE(suite_init)
     result = umocktypes_stdint_register_types();
     ASSERT_ARE_EQUAL(int, 0, result);
 
+#ifdef USE_CLIENT_METRICS
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+#endif
+
     REGISTER_UMOCK_ALIAS_TYPE(XIO_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(STRING_TOKENIZER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
@@ -560,6 +596,10 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_DISPOSITION_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_PROCESS_ITEM_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_STATUS, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_PRIORITY, int);
+#ifdef USE_CLIENT_METRICS
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, int);
+#endif
     REGISTER_UMOCK_ALIAS_TYPE(DEVICE_TWIN_UPDATE_STATE, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONNECTION_STATUS, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONNECTION_STATUS_REASON, int);
@@ -626,6 +666,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
 
     REGISTER_GLOBAL_MOCK_HOOK(STRING_new, my_STRING_new);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_new, NULL);
@@ -644,6 +685,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(CONSTBUFFER_Create, NULL);
 
     REGISTER_GLOBAL_MOCK_HOOK(CONSTBUFFER_Destroy, my_CONSTBUFFER_Destroy);
+    REGISTER_GLOBAL_MOCK_HOOK(CONSTBUFFER_GetContent, my_CONSTBUFFER_GetContent);
 
     REGISTER_GLOBAL_MOCK_HOOK(STRING_TOKENIZER_create, my_STRING_TOKENIZER_create);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_TOKENIZER_create, NULL);
@@ -1788,6 +1830,8 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_succeeds)
         .IgnoreArgument(1)
         .IgnoreArgument(2);
 
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+
     STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1844,6 +1888,62 @@ TEST_FUNCTION(IoTHubClientCore_LL_Destroy_after_sendEvent_succeeds)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_33_001: [ IoTHubClientCore_LL_SendEventAsync shall insert the new record in waitingToSend after every record of the same or higher priority and before every record of lower priority. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_high_priority_goes_before_normal_priority)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+        .SetReturn(IOTHUB_MESSAGE_PRIORITY_HIGH);
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG));
+
+    /*the high priority message is completed first, then the normal ones in the order they were sent*/
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)3));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)2));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(IGNORED_PTR_ARG));
+
+#ifndef DONT_USE_UPLOADTOBLOB
+    STRICT_EXPECTED_CALL(IoTHubClient_LL_UploadToBlob_Destroy(IGNORED_PTR_ARG));
+#endif
+
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
+    IoTHubClientCore_LL_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /*Tests_SRS_IoTHubClientCore_LL_02_014: [If cloning and/or adding the information fails for any reason, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
 TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_fails)
 {
@@ -1870,6 +1970,8 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_fails)
         .IgnoreArgument(1)
         .IgnoreArgument(2);
 
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+
     STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1877,7 +1979,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_fails)
     umock_c_negative_tests_snapshot();
 
     // act
-    size_t calls_cannot_fail[] = { 4 };
+    size_t calls_cannot_fail[] = { 4, 5 };
     size_t count = umock_c_negative_tests_call_count();
     for (size_t index = 0; index < count; index++)
     {
@@ -2210,6 +2312,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_1_items_with_callback_succee
 
     STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    setup_message_size_metric((IOTHUB_MESSAGE_HANDLE)1);
     STRICT_EXPECTED_CALL(eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
     STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
     STRICT_EXPECTED_CALL(gballoc_free(one));
@@ -2258,18 +2361,21 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_3_items_with_callback_succee
 
     STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    setup_message_size_metric((IOTHUB_MESSAGE_HANDLE)1);
     STRICT_EXPECTED_CALL(eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
     STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
     STRICT_EXPECTED_CALL(gballoc_free(one));
 
     STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    setup_message_size_metric((IOTHUB_MESSAGE_HANDLE)2);
     STRICT_EXPECTED_CALL(eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)2));
     STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)2));
     STRICT_EXPECTED_CALL(gballoc_free(two));
 
     STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    setup_message_size_metric((IOTHUB_MESSAGE_HANDLE)3);
     STRICT_EXPECTED_CALL(eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)3));
     STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)3));
     STRICT_EXPECTED_CALL(gballoc_free(three));
@@ -2644,17 +2750,20 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_3_items_one_without_callback
 
     STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    setup_message_size_metric((IOTHUB_MESSAGE_HANDLE)1);
     STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
     STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
     STRICT_EXPECTED_CALL(gballoc_free(one));
 
     STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    setup_message_size_metric((IOTHUB_MESSAGE_HANDLE)2);
     STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)2));
     STRICT_EXPECTED_CALL(gballoc_free(two));
 
     STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    setup_message_size_metric((IOTHUB_MESSAGE_HANDLE)3);
     STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)3));
     STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)3));
     STRICT_EXPECTED_CALL(gballoc_free(three));
@@ -2790,6 +2899,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_unsubscribed_returns_fals
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    setup_message_size_metric(TEST_MESSAGE_HANDLE);
 
     //act
     bool result = IoTHubClientCore_LL_MessageCallback(handle, testMessage);
@@ -2814,6 +2924,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallback_calls_cli
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    setup_message_size_metric(TEST_MESSAGE_HANDLE);
     STRICT_EXPECTED_CALL(test_message_callback_async(testMessage->messageHandle, (void*)11));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SendMessageDisposition(testMessage, IOTHUBMESSAGE_ACCEPTED));
 
@@ -2838,6 +2949,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallback_calls_cli
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    setup_message_size_metric(TEST_MESSAGE_HANDLE);
     STRICT_EXPECTED_CALL(test_message_callback_async(testMessage->messageHandle, (void*)11));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SendMessageDisposition(testMessage, IOTHUBMESSAGE_ACCEPTED))
         .SetReturn(IOTHUB_CLIENT_ERROR);
@@ -2863,6 +2975,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallbackEx_calls_c
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    setup_message_size_metric(TEST_MESSAGE_HANDLE);
     STRICT_EXPECTED_CALL(messageCallbackEx(testMessage, (void*)11));
 
     //act
@@ -2887,6 +3000,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallbackEx_calls_c
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    setup_message_size_metric(TEST_MESSAGE_HANDLE);
     STRICT_EXPECTED_CALL(messageCallbackEx(testMessage, (void*)11));
 
     //act
@@ -2911,6 +3025,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallbackEx_calls_c
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    setup_message_size_metric(TEST_MESSAGE_HANDLE);
     STRICT_EXPECTED_CALL(messageCallbackEx(testMessage, (void*)11))
         .SetReturn(false);
 
@@ -2935,6 +3050,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallbackEx_calls_c
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    setup_message_size_metric(TEST_MESSAGE_HANDLE);
     STRICT_EXPECTED_CALL(messageCallbackEx(testMessage, (void*)11))
         .SetReturn(false);
 
@@ -3024,6 +3140,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_GetLastMessageReceiveTime_MessagesReceived_suc
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    setup_message_size_metric(TEST_MESSAGE_HANDLE);
     STRICT_EXPECTED_CALL(test_message_callback_async(testMessage->messageHandle, (void*)11));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SendMessageDisposition(testMessage, IOTHUBMESSAGE_ACCEPTED));
 
@@ -4283,173 +4400,223 @@ TEST_FUNCTION(IoTHubClientCore_LL_ReportedStateComplete_succeed)
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_07_002: [ if handle is NULL then IoTHubClientCore_LL_ReportedStateComplete shall do nothing. ]*/
-TEST_FUNCTION(IoTHubClientCore_LL_ReportedStateComplete_NULL_fail)
+/*Tests_SRS_IOTHUBCLIENT_LL_35_001: [ "twin_max_in_flight" - value is a pointer to a size_t, the maximum number of twin items handed to the transport and not yet acknowledged. 0, the default, means no limit. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_twin_max_in_flight_succeeds)
 {
     //arrange
+    size_t max_in_flight = 4;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
 
     //act
-    IoTHubClientCore_LL_ReportedStateComplete(NULL, 2, TEST_DEVICE_STATUS_CODE);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_MAX_IN_FLIGHT, &max_in_flight);
 
     //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
+    IoTHubClientCore_LL_Destroy(h);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_07_018: [ If deviceMethodCallback is not NULL IoTHubClientCore_LL_DeviceMethodComplete shall execute deviceMethodCallback and return the status. ] */
-TEST_FUNCTION(IoTHubClientCore_LL_DeviceMethodComplete_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_35_002: [ If twin_max_in_flight is not 0, IoTHubClientCore_LL_DoWork shall stop handing items to the transport once twin_max_in_flight items are waiting for their acknowledgement. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_twin_max_in_flight_limits_ProcessItem)
 {
     //arrange
+    size_t max_in_flight = 2;
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceMethodCallback(h, deviceMethodCallback, (void*)1);
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_MAX_IN_FLIGHT, &max_in_flight);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, NULL);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, NULL);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, NULL);
     umock_c_reset_all_calls();
 
-    size_t len = 1;
-    unsigned char* resp = (unsigned char*)my_gballoc_malloc(len);
-    resp[0] = 0xa;
-
-    STRICT_EXPECTED_CALL(deviceMethodCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument_method_name()
-        .IgnoreArgument_payload()
-        .IgnoreArgument_size()
-        .IgnoreArgument_userContextCallback()
-        .CopyOutArgumentBuffer_response(&resp, sizeof(unsigned char**))
-        .CopyOutArgumentBuffer_resp_size(&len, sizeof(size_t));
-
-    EXPECTED_CALL(FAKE_IoTHubTransport_DeviceMethod_Response(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
-        .IgnoreArgument_ptr();
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_ProcessItem(IGNORED_PTR_ARG, IOTHUB_TYPE_DEVICE_TWIN, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_ProcessItem(IGNORED_PTR_ARG, IOTHUB_TYPE_DEVICE_TWIN, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, h));
 
     //act
-    int status = IoTHubClientCore_LL_DeviceMethodComplete(h, TEST_METHOD_NAME, (const unsigned char*)TEST_STRING_VALUE, strlen(TEST_STRING_VALUE), TEST_METHOD_ID);
+    IoTHubClientCore_LL_DoWork(h);
 
     //assert
-    ASSERT_ARE_EQUAL(int, 0, status);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_07_018: [ If deviceMethodCallback is not NULL IoTHubClientCore_LL_DeviceMethodComplete shall execute deviceMethodCallback and return the status. ] */
-TEST_FUNCTION(IoTHubClientCore_LL_DeviceMethodComplete_payload_NULL_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_35_002: [ If twin_max_in_flight is not 0, IoTHubClientCore_LL_DoWork shall stop handing items to the transport once twin_max_in_flight items are waiting for their acknowledgement. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_twin_max_in_flight_resumes_after_ReportedStateComplete)
 {
     //arrange
+    size_t max_in_flight = 1;
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceMethodCallback(h, deviceMethodCallback, (void*)1);
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_MAX_IN_FLIGHT, &max_in_flight);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, NULL);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, NULL);
+    IoTHubClientCore_LL_DoWork(h);
+    IoTHubClientCore_LL_ReportedStateComplete(h, 2, TEST_DEVICE_STATUS_CODE);
     umock_c_reset_all_calls();
 
-    size_t len = 0;
-    unsigned char* resp = NULL;
-
-    STRICT_EXPECTED_CALL(deviceMethodCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument_method_name()
-        .IgnoreArgument_payload()
-        .IgnoreArgument_size()
-        .IgnoreArgument_userContextCallback()
-        .CopyOutArgumentBuffer_response(&resp, sizeof(unsigned char**))
-        .CopyOutArgumentBuffer_resp_size(&len, sizeof(size_t));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_ProcessItem(IGNORED_PTR_ARG, IOTHUB_TYPE_DEVICE_TWIN, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, h));
 
     //act
-    int status = IoTHubClientCore_LL_DeviceMethodComplete(h, TEST_METHOD_NAME, (const unsigned char*)TEST_STRING_VALUE, strlen(TEST_STRING_VALUE), TEST_METHOD_ID);
+    IoTHubClientCore_LL_DoWork(h);
 
     //assert
-    ASSERT_ARE_NOT_EQUAL(int, 0, status);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
     IoTHubClientCore_LL_Destroy(h);
 }
 
-TEST_FUNCTION(IoTHubClientCore_LL_DeviceMethodComplete_Async_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_35_005: [ "twin_ack_timeout_ms" - value is a pointer to a tickcounter_ms_t, the time twin items handed to the transport from then on wait for their acknowledgement. 0, the default, means they wait forever. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_twin_ack_timeout_succeeds)
 {
     //arrange
+    tickcounter_ms_t ack_timeout = 60000;
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    (void)IoTHubClientCore_LL_SetDeviceMethodCallback_Ex(h, iothub_client_inbound_device_method_callback, (void*)1);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(iothub_client_inbound_device_method_callback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
     //act
-    int status = IoTHubClientCore_LL_DeviceMethodComplete(h, TEST_METHOD_NAME, (const unsigned char*)TEST_STRING_VALUE, strlen(TEST_STRING_VALUE), TEST_METHOD_ID);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_ACK_TIMEOUT, &ack_timeout);
 
     //assert
-    ASSERT_ARE_EQUAL(int, 0, status);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_07_019: [ If deviceMethodCallback is NULL IoTHubClientCore_LL_DeviceMethodComplete shall return 404. ] */
-TEST_FUNCTION(IoTHubClientCore_LL_DeviceMethodComplete_No_callback_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_35_005: [ "twin_ack_timeout_ms" - value is a pointer to a tickcounter_ms_t, the time twin items handed to the transport from then on wait for their acknowledgement. 0, the default, means they wait forever. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_twin_ack_timeout_default_waits_forever)
 {
     //arrange
+    size_t max_in_flight = 1;
+    tickcounter_ms_t timeIsNow = 999999999UL;
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_MAX_IN_FLIGHT, &max_in_flight);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, (void*)1);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, (void*)2);
+    IoTHubClientCore_LL_DoWork(h);
     umock_c_reset_all_calls();
 
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, h));
+
     //act
-    int result = IoTHubClientCore_LL_DeviceMethodComplete(h, TEST_METHOD_NAME, (const unsigned char*)TEST_STRING_VALUE, strlen(TEST_STRING_VALUE), TEST_METHOD_ID);
+    IoTHubClientCore_LL_DoWork(h);
 
     //assert
-    ASSERT_ARE_EQUAL(int, 0, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_07_017: [ If `handle` or response is NULL then `IoTHubClientCore_LL_DeviceMethodComplete` shall return 500. ] */
-TEST_FUNCTION(IoTHubClientCore_LL_DeviceMethodComplete_handle_NULL_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_35_004: [ IoTHubClientCore_LL_DoWork shall fail with status code 408 every twin item the transport has not acknowledged within twin_ack_timeout_ms and remove it from the ack queue. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_twin_ack_timeout_frees_max_in_flight_slot)
 {
     //arrange
+    size_t max_in_flight = 1;
+    tickcounter_ms_t ack_timeout = 60000;
+    tickcounter_ms_t timeIsNow = 999999999UL;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_MAX_IN_FLIGHT, &max_in_flight);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_ACK_TIMEOUT, &ack_timeout);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, (void*)1);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, (void*)2);
+    IoTHubClientCore_LL_DoWork(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+    STRICT_EXPECTED_CALL(iothub_reported_state_callback(408, (void*)1));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_ProcessItem(IGNORED_PTR_ARG, IOTHUB_TYPE_DEVICE_TWIN, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, h));
 
     //act
-    int result = IoTHubClientCore_LL_DeviceMethodComplete(NULL, TEST_METHOD_NAME, (const unsigned char*)TEST_STRING_VALUE, strlen(TEST_STRING_VALUE), TEST_METHOD_ID);
+    IoTHubClientCore_LL_DoWork(h);
 
     //assert
-    ASSERT_ARE_NOT_EQUAL(int, 0, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_001: [ IoTHubClientCore_LL_SetDeviceTwinCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceTwinCallback_iothubclienthandle_NULL_fail)
+/*Tests_SRS_IOTHUBCLIENT_LL_35_006: [ Twin items without a deadline shall be skipped and shall not keep the items behind them from timing out. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_twin_ack_timeout_skips_items_without_deadline)
 {
     //arrange
+    tickcounter_ms_t ack_timeout = 1000;
+    tickcounter_ms_t timeIsNow = 999999999UL;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_ACK_TIMEOUT, &ack_timeout);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, (void*)1);
+    /*the tick counter reads 0 in this DoWork, a time that is not known, so the first item gets no deadline*/
+    g_current_ms = (tickcounter_ms_t)0 - 1000;
+    IoTHubClientCore_LL_DoWork(h);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, (void*)2);
+    IoTHubClientCore_LL_DoWork(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+    STRICT_EXPECTED_CALL(iothub_reported_state_callback(408, (void*)2));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, h));
 
     //act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(NULL, iothub_device_twin_callback, (void*)1);
+    IoTHubClientCore_LL_DoWork(h);
 
     //assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
+    IoTHubClientCore_LL_Destroy(h);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_07_016: [ If deviceTwinCallback is set and DEVICE_TWIN_UPDATE_COMPLETE has been encountered then IoTHubClientCore_LL_RetrievePropertyComplete shall call deviceTwinCallback.] */
-TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_35_003: [ IoTHubClientCore_LL_ReportedStateComplete shall find the item by hashing item_id, without walking the ack queue. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_ReportedStateComplete_out_of_order_succeed)
 {
     //arrange
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, iothub_device_twin_callback, NULL);
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, (void*)1);
+    (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, (void*)2);
+    IoTHubClientCore_LL_DoWork(h);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(iothub_device_twin_callback(DEVICE_TWIN_UPDATE_COMPLETE, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument_update_state()
-        .IgnoreArgument_userContextCallback()
-        .IgnoreArgument_payLoad()
-        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(iothub_reported_state_callback(TEST_DEVICE_STATUS_CODE, (void*)2));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(iothub_reported_state_callback(TEST_DEVICE_STATUS_CODE, (void*)1));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     //act
-    IoTHubClientCore_LL_RetrievePropertyComplete(h, DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0);
+    IoTHubClientCore_LL_ReportedStateComplete(h, 3, TEST_DEVICE_STATUS_CODE);
+    IoTHubClientCore_LL_ReportedStateComplete(h, 2, TEST_DEVICE_STATUS_CODE);
 
     //assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
@@ -4458,97 +4625,147 @@ TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_succeed)
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_07_013: [ If handle is NULL then IoTHubClientCore_LL_RetrievePropertyComplete shall do nothing.] */
-TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_iothubclienthandle_NULL_fail)
+/*Tests_SRS_IOTHUBCLIENT_LL_35_003: [ IoTHubClientCore_LL_ReportedStateComplete shall find the item by hashing item_id, without walking the ack queue. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_ReportedStateComplete_same_bucket_succeed)
 {
     //arrange
+    size_t index;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    /*item 2 and item 66 land in the same bucket of the ack index*/
+    for (index = 0; index < 65; index++)
+    {
+        (void)IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, (void*)(index + 1));
+    }
+    IoTHubClientCore_LL_DoWork(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(iothub_reported_state_callback(TEST_DEVICE_STATUS_CODE, (void*)1));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(iothub_reported_state_callback(TEST_DEVICE_STATUS_CODE, (void*)65));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     //act
-    IoTHubClientCore_LL_RetrievePropertyComplete(NULL, DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0);
+    IoTHubClientCore_LL_ReportedStateComplete(h, 2, TEST_DEVICE_STATUS_CODE);
+    IoTHubClientCore_LL_ReportedStateComplete(h, 66, TEST_DEVICE_STATUS_CODE);
 
     //assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
+    IoTHubClientCore_LL_Destroy(h);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_07_014: [ If deviceTwinCallback is NULL then IoTHubClientCore_LL_RetrievePropertyComplete shall do nothing.] */
-TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_deviceTwincallback_NULL_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_34_001: [ "twin_coalesce_reported_state" - value is a pointer to a bool that enables or disables merging of reported state patches that are still queued. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_twin_coalesce_reported_state_succeeds)
 {
     //arrange
+    bool coalesce = true;
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-
     umock_c_reset_all_calls();
 
     //act
-    IoTHubClientCore_LL_RetrievePropertyComplete(h, DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_COALESCE_REPORTED_STATE, &coalesce);
 
     //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_07_015: [ If the the update_state parameter is DEVICE_TWIN_UPDATE_PARTIAL and a DEVICE_TWIN_UPDATE_COMPLETE has not been previously recieved then IoTHubClientCore_LL_RetrievePropertyComplete shall do nothing.] */
-TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_update_partial_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_34_002: [ If twin_coalesce_reported_state is enabled and iot_msg_queue is not empty, IoTHubClientCore_LL_SendReportedState shall merge reportedState into the last queued patch and return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendReportedState_coalesces_pending_patch_succeed)
 {
     //arrange
+    bool coalesce = true;
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, iothub_device_twin_callback, NULL);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_COALESCE_REPORTED_STATE, &coalesce);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendReportedState(h, (const unsigned char*)TEST_REPORTED_STATE_PATCH_1, strlen(TEST_REPORTED_STATE_PATCH_1), iothub_reported_state_callback, (void*)1);
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-
     umock_c_reset_all_calls();
 
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_GetContent(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(IGNORED_PTR_ARG, strlen(TEST_REPORTED_STATE_MERGED)))
+        .ValidateArgumentBuffer(1, TEST_REPORTED_STATE_MERGED, strlen(TEST_REPORTED_STATE_MERGED));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+
     //act
-    IoTHubClientCore_LL_RetrievePropertyComplete(h, DEVICE_TWIN_UPDATE_PARTIAL, NULL, 0);
+    result = IoTHubClientCore_LL_SendReportedState(h, (const unsigned char*)TEST_REPORTED_STATE_PATCH_2, strlen(TEST_REPORTED_STATE_PATCH_2), iothub_reported_state_callback, (void*)2);
 
     //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_07_016: [ If deviceTwinCallback is set and DEVICE_TWIN_UPDATE_COMPLETE has been encountered then IoTHubClientCore_LL_RetrievePropertyComplete shall call deviceTwinCallback.] */
-TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_update_partial_before_complete_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_34_002: [ If twin_coalesce_reported_state is enabled and iot_msg_queue is not empty, IoTHubClientCore_LL_SendReportedState shall merge reportedState into the last queued patch and return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendReportedState_coalesce_not_json_queues_patch_succeed)
 {
     //arrange
+    bool coalesce = true;
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, iothub_device_twin_callback, NULL);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_COALESCE_REPORTED_STATE, &coalesce);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, NULL);
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(iothub_device_twin_callback(DEVICE_TWIN_UPDATE_PARTIAL, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument_update_state()
-        .IgnoreArgument_userContextCallback()
-        .IgnoreArgument_payLoad()
-        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_GetContent(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    setup_IoTHubClientCore_LL_sendreportedstate_mocks();
 
     //act
-    IoTHubClientCore_LL_RetrievePropertyComplete(h, DEVICE_TWIN_UPDATE_PARTIAL, NULL, 0);
-    IoTHubClientCore_LL_RetrievePropertyComplete(h, DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0);
+    result = IoTHubClientCore_LL_SendReportedState(h, TEST_REPORTED_STATE, TEST_REPORTED_SIZE, iothub_reported_state_callback, NULL);
 
     //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_006: [ If deviceTwinCallback is NULL, then IoTHubClientCore_LL_SetDeviceTwinCallback shall call the underlying layer's _Unsubscribe function and return IOTHUB_CLIENT_OK.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceTwinCallback_unsubscribe_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_34_004: [ If reportedState sets to an object a property that the queued patch sets to null, IoTHubClientCore_LL_SendReportedState shall not merge and shall queue reportedState as a separate patch. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendReportedState_coalesce_recreating_deleted_property_queues_patch_succeed)
 {
     //arrange
+    bool coalesce = true;
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_COALESCE_REPORTED_STATE, &coalesce);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendReportedState(h, (const unsigned char*)TEST_REPORTED_STATE_PATCH_DELETE, strlen(TEST_REPORTED_STATE_PATCH_DELETE), iothub_reported_state_callback, (void*)1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unsubscribe_DeviceTwin(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_GetContent(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(IGNORED_PTR_ARG, strlen(TEST_REPORTED_STATE_PATCH_RECREATE)))
+        .ValidateArgumentBuffer(1, TEST_REPORTED_STATE_PATCH_RECREATE, strlen(TEST_REPORTED_STATE_PATCH_RECREATE));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe_DeviceTwin(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     //act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, NULL, NULL);
+    result = IoTHubClientCore_LL_SendReportedState(h, (const unsigned char*)TEST_REPORTED_STATE_PATCH_RECREATE, strlen(TEST_REPORTED_STATE_PATCH_RECREATE), iothub_reported_state_callback, (void*)2);
 
     //assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
@@ -4558,18 +4775,30 @@ TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceTwinCallback_unsubscribe_succeed)
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_002: [ If deviceTwinCallback is not NULL, then IoTHubClientCore_LL_SetDeviceTwinCallback shall call the underlying layer's _Subscribe function.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceTwinCallback_subscribe_succeed)
+/*Tests_SRS_IOTHUBCLIENT_LL_34_005: [ If reportedState sets every property of the queued patch, IoTHubClientCore_LL_SendReportedState shall replace the queued patch with reportedState as given. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendReportedState_coalesce_covering_patch_keeps_payload_succeed)
 {
     //arrange
+    bool coalesce = true;
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_COALESCE_REPORTED_STATE, &coalesce);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendReportedState(h, (const unsigned char*)TEST_REPORTED_STATE_PATCH_1, strlen(TEST_REPORTED_STATE_PATCH_1), iothub_reported_state_callback, (void*)1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe_DeviceTwin(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_GetContent(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(IGNORED_PTR_ARG, strlen(TEST_REPORTED_STATE_PATCH_COVERING)))
+        .ValidateArgumentBuffer(1, TEST_REPORTED_STATE_PATCH_COVERING, strlen(TEST_REPORTED_STATE_PATCH_COVERING));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
 
     //act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, iothub_device_twin_callback, (void*)1);
+    result = IoTHubClientCore_LL_SendReportedState(h, (const unsigned char*)TEST_REPORTED_STATE_PATCH_COVERING, strlen(TEST_REPORTED_STATE_PATCH_COVERING), iothub_reported_state_callback, (void*)2);
 
     //assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
@@ -4579,30 +4808,357 @@ TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceTwinCallback_subscribe_succeed)
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_003: [ If the underlying layer's _Subscribe function fails, then IoTHubClientCore_LL_SetDeviceTwinCallback shall fail and return IOTHUB_CLIENT_ERROR.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceTwinCallback_subscribe_fail)
+/*Tests_SRS_IOTHUBCLIENT_LL_34_003: [ IoTHubClientCore_LL_ReportedStateComplete shall invoke the callbacks of all the patches merged into the completed item, in the order the patches were sent. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_ReportedStateComplete_coalesced_succeed)
 {
     //arrange
+    bool coalesce = true;
     IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_TWIN_COALESCE_REPORTED_STATE, &coalesce);
+    (void)IoTHubClientCore_LL_SendReportedState(h, (const unsigned char*)TEST_REPORTED_STATE_PATCH_1, strlen(TEST_REPORTED_STATE_PATCH_1), iothub_reported_state_callback, (void*)1);
+    (void)IoTHubClientCore_LL_SendReportedState(h, (const unsigned char*)TEST_REPORTED_STATE_PATCH_2, strlen(TEST_REPORTED_STATE_PATCH_2), iothub_reported_state_callback, (void*)2);
+
+    IoTHubClientCore_LL_DoWork(h);
+
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe_DeviceTwin(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle()
-        .SetReturn(__FAILURE__);
+    STRICT_EXPECTED_CALL(iothub_reported_state_callback(TEST_DEVICE_STATUS_CODE, (void*)1));
+    STRICT_EXPECTED_CALL(iothub_reported_state_callback(TEST_DEVICE_STATUS_CODE, (void*)2));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     //act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, iothub_device_twin_callback, (void*)1);
+    IoTHubClientCore_LL_ReportedStateComplete(h, 2, TEST_DEVICE_STATUS_CODE);
 
     //assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
     IoTHubClientCore_LL_Destroy(h);
 }
 
-/* Test_SRS_IoTHubClientCore_LL_07_021: [ If handle is NULL then IoTHubClientCore_LL_SetDeviceMethodCallback_Ex shall return IOTHUB_CLIENT_INVALID_ARG.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceMethodCallback_Ex_handle_NULL_fail)
+/*Tests_SRS_IoTHubClientCore_LL_07_002: [ if handle is NULL then IoTHubClientCore_LL_ReportedStateComplete shall do nothing. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_ReportedStateComplete_NULL_fail)
+{
+    //arrange
+
+    //act
+    IoTHubClientCore_LL_ReportedStateComplete(NULL, 2, TEST_DEVICE_STATUS_CODE);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_07_018: [ If deviceMethodCallback is not NULL IoTHubClientCore_LL_DeviceMethodComplete shall execute deviceMethodCallback and return the status. ] */
+TEST_FUNCTION(IoTHubClientCore_LL_DeviceMethodComplete_succeed)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceMethodCallback(h, deviceMethodCallback, (void*)1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+    umock_c_reset_all_calls();
+
+    size_t len = 1;
+    unsigned char* resp = (unsigned char*)my_gballoc_malloc(len);
+    resp[0] = 0xa;
+
+    STRICT_EXPECTED_CALL(deviceMethodCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_method_name()
+        .IgnoreArgument_payload()
+        .IgnoreArgument_size()
+        .IgnoreArgument_userContextCallback()
+        .CopyOutArgumentBuffer_response(&resp, sizeof(unsigned char**))
+        .CopyOutArgumentBuffer_resp_size(&len, sizeof(size_t));
+
+    EXPECTED_CALL(FAKE_IoTHubTransport_DeviceMethod_Response(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    //act
+    int status = IoTHubClientCore_LL_DeviceMethodComplete(h, TEST_METHOD_NAME, (const unsigned char*)TEST_STRING_VALUE, strlen(TEST_STRING_VALUE), TEST_METHOD_ID);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, 0, status);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_07_018: [ If deviceMethodCallback is not NULL IoTHubClientCore_LL_DeviceMethodComplete shall execute deviceMethodCallback and return the status. ] */
+TEST_FUNCTION(IoTHubClientCore_LL_DeviceMethodComplete_payload_NULL_succeed)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceMethodCallback(h, deviceMethodCallback, (void*)1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+    umock_c_reset_all_calls();
+
+    size_t len = 0;
+    unsigned char* resp = NULL;
+
+    STRICT_EXPECTED_CALL(deviceMethodCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_method_name()
+        .IgnoreArgument_payload()
+        .IgnoreArgument_size()
+        .IgnoreArgument_userContextCallback()
+        .CopyOutArgumentBuffer_response(&resp, sizeof(unsigned char**))
+        .CopyOutArgumentBuffer_resp_size(&len, sizeof(size_t));
+
+    //act
+    int status = IoTHubClientCore_LL_DeviceMethodComplete(h, TEST_METHOD_NAME, (const unsigned char*)TEST_STRING_VALUE, strlen(TEST_STRING_VALUE), TEST_METHOD_ID);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, status);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_DeviceMethodComplete_Async_succeed)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetDeviceMethodCallback_Ex(h, iothub_client_inbound_device_method_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(iothub_client_inbound_device_method_callback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    int status = IoTHubClientCore_LL_DeviceMethodComplete(h, TEST_METHOD_NAME, (const unsigned char*)TEST_STRING_VALUE, strlen(TEST_STRING_VALUE), TEST_METHOD_ID);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, 0, status);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_07_019: [ If deviceMethodCallback is NULL IoTHubClientCore_LL_DeviceMethodComplete shall return 404. ] */
+TEST_FUNCTION(IoTHubClientCore_LL_DeviceMethodComplete_No_callback_succeed)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    int result = IoTHubClientCore_LL_DeviceMethodComplete(h, TEST_METHOD_NAME, (const unsigned char*)TEST_STRING_VALUE, strlen(TEST_STRING_VALUE), TEST_METHOD_ID);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_07_017: [ If `handle` or response is NULL then `IoTHubClientCore_LL_DeviceMethodComplete` shall return 500. ] */
+TEST_FUNCTION(IoTHubClientCore_LL_DeviceMethodComplete_handle_NULL_succeed)
+{
+    //arrange
+
+    //act
+    int result = IoTHubClientCore_LL_DeviceMethodComplete(NULL, TEST_METHOD_NAME, (const unsigned char*)TEST_STRING_VALUE, strlen(TEST_STRING_VALUE), TEST_METHOD_ID);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_001: [ IoTHubClientCore_LL_SetDeviceTwinCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceTwinCallback_iothubclienthandle_NULL_fail)
+{
+    //arrange
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(NULL, iothub_device_twin_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_07_016: [ If deviceTwinCallback is set and DEVICE_TWIN_UPDATE_COMPLETE has been encountered then IoTHubClientCore_LL_RetrievePropertyComplete shall call deviceTwinCallback.] */
+TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_succeed)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, iothub_device_twin_callback, NULL);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(iothub_device_twin_callback(DEVICE_TWIN_UPDATE_COMPLETE, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_update_state()
+        .IgnoreArgument_userContextCallback()
+        .IgnoreArgument_payLoad()
+        .IgnoreArgument_size();
+
+    //act
+    IoTHubClientCore_LL_RetrievePropertyComplete(h, DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_07_013: [ If handle is NULL then IoTHubClientCore_LL_RetrievePropertyComplete shall do nothing.] */
+TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_iothubclienthandle_NULL_fail)
+{
+    //arrange
+
+    //act
+    IoTHubClientCore_LL_RetrievePropertyComplete(NULL, DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_07_014: [ If deviceTwinCallback is NULL then IoTHubClientCore_LL_RetrievePropertyComplete shall do nothing.] */
+TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_deviceTwincallback_NULL_succeed)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubClientCore_LL_RetrievePropertyComplete(h, DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_07_015: [ If the the update_state parameter is DEVICE_TWIN_UPDATE_PARTIAL and a DEVICE_TWIN_UPDATE_COMPLETE has not been previously recieved then IoTHubClientCore_LL_RetrievePropertyComplete shall do nothing.] */
+TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_update_partial_succeed)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, iothub_device_twin_callback, NULL);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubClientCore_LL_RetrievePropertyComplete(h, DEVICE_TWIN_UPDATE_PARTIAL, NULL, 0);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_07_016: [ If deviceTwinCallback is set and DEVICE_TWIN_UPDATE_COMPLETE has been encountered then IoTHubClientCore_LL_RetrievePropertyComplete shall call deviceTwinCallback.] */
+TEST_FUNCTION(IoTHubClientCore_LL_RetrievePropertyComplete_update_partial_before_complete_succeed)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, iothub_device_twin_callback, NULL);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(iothub_device_twin_callback(DEVICE_TWIN_UPDATE_PARTIAL, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_update_state()
+        .IgnoreArgument_userContextCallback()
+        .IgnoreArgument_payLoad()
+        .IgnoreArgument_size();
+
+    //act
+    IoTHubClientCore_LL_RetrievePropertyComplete(h, DEVICE_TWIN_UPDATE_PARTIAL, NULL, 0);
+    IoTHubClientCore_LL_RetrievePropertyComplete(h, DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_006: [ If deviceTwinCallback is NULL, then IoTHubClientCore_LL_SetDeviceTwinCallback shall call the underlying layer's _Unsubscribe function and return IOTHUB_CLIENT_OK.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceTwinCallback_unsubscribe_succeed)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unsubscribe_DeviceTwin(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, NULL, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_002: [ If deviceTwinCallback is not NULL, then IoTHubClientCore_LL_SetDeviceTwinCallback shall call the underlying layer's _Subscribe function.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceTwinCallback_subscribe_succeed)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe_DeviceTwin(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, iothub_device_twin_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_003: [ If the underlying layer's _Subscribe function fails, then IoTHubClientCore_LL_SetDeviceTwinCallback shall fail and return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceTwinCallback_subscribe_fail)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe_DeviceTwin(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle()
+        .SetReturn(__FAILURE__);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetDeviceTwinCallback(h, iothub_device_twin_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/* Test_SRS_IoTHubClientCore_LL_07_021: [ If handle is NULL then IoTHubClientCore_LL_SetDeviceMethodCallback_Ex shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetDeviceMethodCallback_Ex_handle_NULL_fail)
 {
     //arrange
 
@@ -5015,4 +5571,262 @@ TEST_FUNCTION(IoTHubClientCore_LL_SetOption_diag_sampling_percentage_fails)
 }
 
 
+#ifdef USE_CLIENT_METRICS
+TEST_FUNCTION(IoTHubClientCore_LL_GetMetrics_with_NULL_handle_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetMetrics(NULL, &metrics);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetMetrics_with_NULL_metrics_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetMetrics(h, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetMetrics_after_create_returns_zeros)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    size_t index;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)memset(&metrics, 0xFF, sizeof(metrics));
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetMetrics(h, &metrics);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    for (index = 0; index < IOTHUB_CLIENT_METRIC_COUNT; index++)
+    {
+        ASSERT_ARE_EQUAL(uint64_t, 0, metrics.counters[index]);
+    }
+    for (index = 0; index < IOTHUB_CLIENT_QUEUE_COUNT; index++)
+    {
+        ASSERT_ARE_EQUAL(size_t, 0, metrics.queue_depths[index]);
+    }
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetMetrics_counts_the_messages_waiting_to_send)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetMetrics(h, &metrics);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 2, metrics.queue_depths[IOTHUB_CLIENT_QUEUE_WAITING_TO_SEND]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_CountMetric_adds_to_the_counter)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubClientCore_LL_CountMetric(h, IOTHUB_CLIENT_METRIC_SEND_RETRIES, 2);
+    IoTHubClientCore_LL_CountMetric(h, IOTHUB_CLIENT_METRIC_SEND_RETRIES, 3);
+    IoTHubClientCore_LL_CountMetric(h, IOTHUB_CLIENT_METRIC_THROTTLED, 1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_LL_GetMetrics(h, &metrics));
+    ASSERT_ARE_EQUAL(uint64_t, 5, metrics.counters[IOTHUB_CLIENT_METRIC_SEND_RETRIES]);
+    ASSERT_ARE_EQUAL(uint64_t, 1, metrics.counters[IOTHUB_CLIENT_METRIC_THROTTLED]);
+    ASSERT_ARE_EQUAL(uint64_t, 0, metrics.counters[IOTHUB_CLIENT_METRIC_RECONNECTS]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_CountMetric_with_invalid_metric_does_nothing)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    size_t index;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubClientCore_LL_CountMetric(h, IOTHUB_CLIENT_METRIC_COUNT, 1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_LL_GetMetrics(h, &metrics));
+    for (index = 0; index < IOTHUB_CLIENT_METRIC_COUNT; index++)
+    {
+        ASSERT_ARE_EQUAL(uint64_t, 0, metrics.counters[index]);
+    }
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_CountEventCompleted_counts_the_bytes_of_an_acknowledged_byte_array)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    IOTHUB_MESSAGE_LIST message;
+    const unsigned char* buffer = (const unsigned char*)"0123456789";
+    size_t size = 10;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    message.messageHandle = TEST_MESSAGE_HANDLE;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE))
+        .SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer_buffer(&buffer, sizeof(buffer))
+        .CopyOutArgumentBuffer_size(&size, sizeof(size));
+
+    //act
+    IoTHubClientCore_LL_CountEventCompleted(h, &message, IOTHUB_CLIENT_CONFIRMATION_OK);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_LL_GetMetrics(h, &metrics));
+    ASSERT_ARE_EQUAL(uint64_t, 1, metrics.counters[IOTHUB_CLIENT_METRIC_EVENTS_SENT]);
+    ASSERT_ARE_EQUAL(uint64_t, 10, metrics.counters[IOTHUB_CLIENT_METRIC_EVENT_BYTES_SENT]);
+    ASSERT_ARE_EQUAL(uint64_t, 0, metrics.counters[IOTHUB_CLIENT_METRIC_EVENTS_FAILED]);
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_CountEventCompleted_counts_the_bytes_of_an_acknowledged_string)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    IOTHUB_MESSAGE_LIST message;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    message.messageHandle = TEST_MESSAGE_HANDLE;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE))
+        .SetReturn(IOTHUBMESSAGE_STRING);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetString(TEST_MESSAGE_HANDLE))
+        .SetReturn("abcd");
+
+    //act
+    IoTHubClientCore_LL_CountEventCompleted(h, &message, IOTHUB_CLIENT_CONFIRMATION_OK);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_LL_GetMetrics(h, &metrics));
+    ASSERT_ARE_EQUAL(uint64_t, 1, metrics.counters[IOTHUB_CLIENT_METRIC_EVENTS_SENT]);
+    ASSERT_ARE_EQUAL(uint64_t, 4, metrics.counters[IOTHUB_CLIENT_METRIC_EVENT_BYTES_SENT]);
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_CountEventCompleted_counts_a_failed_event)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    IOTHUB_MESSAGE_LIST message;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    message.messageHandle = TEST_MESSAGE_HANDLE;
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubClientCore_LL_CountEventCompleted(h, &message, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_LL_GetMetrics(h, &metrics));
+    ASSERT_ARE_EQUAL(uint64_t, 0, metrics.counters[IOTHUB_CLIENT_METRIC_EVENTS_SENT]);
+    ASSERT_ARE_EQUAL(uint64_t, 1, metrics.counters[IOTHUB_CLIENT_METRIC_EVENTS_FAILED]);
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_counts_the_received_message)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageCallback_Ex(h, messageCallbackEx, (void*)11);
+    MESSAGE_CALLBACK_INFO* testMessage = make_test_message_info(TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE))
+        .SetReturn(IOTHUBMESSAGE_STRING);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetString(TEST_MESSAGE_HANDLE))
+        .SetReturn("abc");
+    STRICT_EXPECTED_CALL(messageCallbackEx(testMessage, (void*)11));
+
+    //act
+    (void)IoTHubClientCore_LL_MessageCallback(h, testMessage);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_LL_GetMetrics(h, &metrics));
+    ASSERT_ARE_EQUAL(uint64_t, 1, metrics.counters[IOTHUB_CLIENT_METRIC_MESSAGES_RECEIVED]);
+    ASSERT_ARE_EQUAL(uint64_t, 3, metrics.counters[IOTHUB_CLIENT_METRIC_MESSAGE_BYTES_RECEIVED]);
+
+    //cleanup
+    destroy_test_message_info(testMessage);
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_SetQueueDepth_replaces_the_depth)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubClientCore_LL_SetQueueDepth(h, IOTHUB_CLIENT_QUEUE_WAITING_FOR_ACK, 7);
+    IoTHubClientCore_LL_SetQueueDepth(h, IOTHUB_CLIENT_QUEUE_WAITING_FOR_ACK, 3);
+    IoTHubClientCore_LL_SetQueueDepth(h, IOTHUB_CLIENT_QUEUE_COUNT, 5);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_LL_GetMetrics(h, &metrics));
+    ASSERT_ARE_EQUAL(size_t, 3, metrics.queue_depths[IOTHUB_CLIENT_QUEUE_WAITING_FOR_ACK]);
+    ASSERT_ARE_EQUAL(size_t, 0, metrics.queue_depths[IOTHUB_CLIENT_QUEUE_IN_PROGRESS]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+#endif /*USE_CLIENT_METRICS*/
+
 END_TEST_SUITE(iothubclientcore_ll_ut)
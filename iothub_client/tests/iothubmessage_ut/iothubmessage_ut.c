@@ -84,6 +84,9 @@ IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_RESULT_VALUES)
 TEST_DEFINE_ENUM_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
 IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
 
+TEST_DEFINE_ENUM_TYPE(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
+
 DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
 
 static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
@@ -1753,4 +1756,100 @@ TEST_FUNCTION(IoTHubMessage_GetProperty_Fail)
     IoTHubMessage_Destroy(h);
 }
 
+/* Tests_SRS_IOTHUBMESSAGE_33_001: [If iotHubMessageHandle is NULL or priority is not a valid IOTHUB_MESSAGE_PRIORITY value, IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubMessage_SetPriority_NULL_handle_Fails)
+{
+    //arrange
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(NULL, IOTHUB_MESSAGE_PRIORITY_HIGH);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+/* Tests_SRS_IOTHUBMESSAGE_33_001: [If iotHubMessageHandle is NULL or priority is not a valid IOTHUB_MESSAGE_PRIORITY value, IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubMessage_SetPriority_invalid_priority_Fails)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(h, (IOTHUB_MESSAGE_PRIORITY)42);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_NORMAL, IoTHubMessage_GetPriority(h));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/* Tests_SRS_IOTHUBMESSAGE_33_002: [IoTHubMessage_SetPriority shall store priority in the message and return IOTHUB_MESSAGE_OK.] */
+/* Tests_SRS_IOTHUBMESSAGE_33_005: [IoTHubMessage_GetPriority shall return the priority of the message, IOTHUB_MESSAGE_PRIORITY_NORMAL unless IoTHubMessage_SetPriority was called.] */
+TEST_FUNCTION(IoTHubMessage_SetPriority_Succeeds)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_PRIORITY defaultPriority = IoTHubMessage_GetPriority(h);
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(h, IOTHUB_MESSAGE_PRIORITY_HIGH);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_NORMAL, defaultPriority);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_HIGH, IoTHubMessage_GetPriority(h));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/* Tests_SRS_IOTHUBMESSAGE_33_004: [If iotHubMessageHandle is NULL, IoTHubMessage_GetPriority shall return IOTHUB_MESSAGE_PRIORITY_NORMAL.] */
+TEST_FUNCTION(IoTHubMessage_GetPriority_NULL_handle_returns_NORMAL)
+{
+    //arrange
+
+    //act
+    IOTHUB_MESSAGE_PRIORITY result = IoTHubMessage_GetPriority(NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_NORMAL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+/* Tests_SRS_IOTHUBMESSAGE_33_003: [IoTHubMessage_Clone shall copy the priority of the source message.] */
+TEST_FUNCTION(IoTHubMessage_Clone_copies_priority)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_SetPriority(h, IOTHUB_MESSAGE_PRIORITY_HIGH);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Map_Clone(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_MESSAGE_HANDLE r = IoTHubMessage_Clone(h);
+
+    //assert
+    ASSERT_IS_NOT_NULL(r);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_HIGH, IoTHubMessage_GetPriority(r));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(r);
+    IoTHubMessage_Destroy(h);
+}
+
 END_TEST_SUITE(iothubmessage_ut)
@@ -369,6 +369,7 @@ static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 #define TEST_USER_SVC2CL_KEEP_ALIVE_FREQ_SECS      123
 #define TEST_DEFAULT_REMOTE_IDLE_TIMEOUT_RATIO     0.50    
 #define TEST_USER_REMOTE_IDLE_TIMEOUT_RATIO        0.875
+#define TEST_DEFAULT_MAX_IN_FLIGHT_TELEMETRY       64
 #define DEFAULT_RETRY_POLICY                      IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER
 #define DEFAULT_MAX_RETRY_TIME_IN_SECS            0
 
@@ -4008,6 +4009,106 @@ TEST_FUNCTION(DoWork_success)
     destroy_transport(handle, device_handle, NULL);
 }
 
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_27_001: [Events shall be left on `registered_device->wait_to_send_list` while `option_max_in_flight_telemetry` events of the device are waiting for `on_event_send_complete`]
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_27_002: [If `option` is `max_in_flight_telemetry`, `value` shall be saved on `instance->option_max_in_flight_telemetry`]
+TEST_FUNCTION(DoWork_leaves_events_queued_over_max_in_flight_telemetry)
+{
+    // arrange
+    IOTHUB_MESSAGE_LIST message1;
+    IOTHUB_MESSAGE_LIST message2;
+    size_t max_in_flight = 1;
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_OK, IoTHubTransport_AMQP_Common_SetOption(handle, OPTION_MAX_IN_FLIGHT_TELEMETRY, &max_in_flight));
+
+    memset(&message1, 0, sizeof(message1));
+    memset(&message2, 0, sizeof(message2));
+    real_DList_InsertTailList(&TEST_waitingToSend, &message1.entry);
+    real_DList_InsertTailList(&TEST_waitingToSend, &message2.entry);
+    umock_c_reset_all_calls();
+
+    // act
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, &message2.entry, TEST_waitingToSend.Flink);
+    ASSERT_ARE_EQUAL(void_ptr, &TEST_waitingToSend, message2.entry.Flink);
+
+    // cleanup
+    real_DList_RemoveEntryList(&message2.entry);
+    destroy_transport(handle, device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_27_003: [Until the `max_in_flight_telemetry` option is set, events shall not be limited until an event of priority other than IOTHUB_MESSAGE_PRIORITY_NORMAL is found at the head of `registered_device->wait_to_send_list`; from then on the limit shall be 64]
+TEST_FUNCTION(DoWork_without_max_in_flight_telemetry_sends_every_event)
+{
+    // arrange
+    IOTHUB_MESSAGE_LIST messages[TEST_DEFAULT_MAX_IN_FLIGHT_TELEMETRY + 1];
+    size_t i;
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+
+    memset(messages, 0, sizeof(messages));
+    for (i = 0; i < TEST_DEFAULT_MAX_IN_FLIGHT_TELEMETRY + 1; i++)
+    {
+        real_DList_InsertTailList(&TEST_waitingToSend, &messages[i].entry);
+    }
+    umock_c_reset_all_calls();
+
+    // act
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, &TEST_waitingToSend, TEST_waitingToSend.Flink);
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_27_003: [Until the `max_in_flight_telemetry` option is set, events shall not be limited until an event of priority other than IOTHUB_MESSAGE_PRIORITY_NORMAL is found at the head of `registered_device->wait_to_send_list`; from then on the limit shall be 64]
+TEST_FUNCTION(DoWork_with_high_priority_event_limits_in_flight_telemetry_to_the_default)
+{
+    // arrange
+    IOTHUB_MESSAGE_LIST messages[TEST_DEFAULT_MAX_IN_FLIGHT_TELEMETRY + 1];
+    size_t i;
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+
+    memset(messages, 0, sizeof(messages));
+    messages[0].priority = IOTHUB_MESSAGE_PRIORITY_HIGH;
+    for (i = 0; i < TEST_DEFAULT_MAX_IN_FLIGHT_TELEMETRY + 1; i++)
+    {
+        real_DList_InsertTailList(&TEST_waitingToSend, &messages[i].entry);
+    }
+    umock_c_reset_all_calls();
+
+    // act
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, &messages[TEST_DEFAULT_MAX_IN_FLIGHT_TELEMETRY].entry, TEST_waitingToSend.Flink);
+    ASSERT_ARE_EQUAL(void_ptr, &TEST_waitingToSend, messages[TEST_DEFAULT_MAX_IN_FLIGHT_TELEMETRY].entry.Flink);
+
+    // cleanup
+    real_DList_RemoveEntryList(&messages[TEST_DEFAULT_MAX_IN_FLIGHT_TELEMETRY].entry);
+    destroy_transport(handle, device_handle, NULL);
+}
+
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_115: [If the AMQP connection is closed by the service side, the connection retry logic shall be triggered]
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_126: [The connection retry shall be attempted only if retry_control_should_retry() returns RETRY_ACTION_NOW, or if it fails]
 TEST_FUNCTION(on_amqp_connection_state_changed_CLOSED_unexpectedly)
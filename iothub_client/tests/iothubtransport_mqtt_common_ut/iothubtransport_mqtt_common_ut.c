@@ -3917,6 +3917,92 @@ TEST_FUNCTION(IoTHubTransport_MQTT_Common_DoWork_with_1_event_item_succeeds)
     IoTHubTransport_MQTT_Common_Destroy(handle);
 }
 
+/* Tests_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_27_001: [ IoTHubTransport_MQTT_Common_DoWork shall stop taking messages from "waitingToSend" once `max_in_flight_telemetry` messages are waiting for their PUBACK, so that the remaining messages keep their place in the priority ordered queue. ]*/
+/* Tests_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_27_002: [ If the option parameter is set to "max_in_flight_telemetry" then the value shall be a size_t_ptr and the value will determine the maximum number of telemetry messages waiting for their PUBACK, 0 meaning no limit. ]*/
+TEST_FUNCTION(IoTHubTransport_MQTT_Common_DoWork_with_2_event_items_and_max_in_flight_1_sends_1)
+{
+    // arrange
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+    SUBSCRIBE_ACK suback;
+    suback.packetId = 1234;
+    suback.qosCount = 1;
+    suback.qosReturn = QosValue;
+    size_t max_in_flight = 1;
+
+    IOTHUB_MESSAGE_LIST message1;
+    IOTHUB_MESSAGE_LIST message2;
+    memset(&message1, 0, sizeof(IOTHUB_MESSAGE_LIST));
+    memset(&message2, 0, sizeof(IOTHUB_MESSAGE_LIST));
+    message1.messageHandle = TEST_IOTHUB_MSG_BYTEARRAY;
+    message2.messageHandle = TEST_IOTHUB_MSG_BYTEARRAY;
+
+    DList_InsertTailList(config.waitingToSend, &(message1.entry));
+    DList_InsertTailList(config.waitingToSend, &(message2.entry));
+    TRANSPORT_LL_HANDLE handle = IoTHubTransport_MQTT_Common_Create(&config, get_IO_transport);
+    (void)IoTHubTransport_MQTT_Common_SetOption(handle, OPTION_MAX_IN_FLIGHT_TELEMETRY, &max_in_flight);
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+    setup_initialize_connection_mocks();
+    IoTHubTransport_MQTT_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    umock_c_reset_all_calls();
+
+    setup_IoTHubTransport_MQTT_Common_DoWork_events_mocks(NULL, NULL, 0, TEST_IOTHUB_MSG_BYTEARRAY, false, NULL, NULL, NULL, NULL, NULL, NULL, false);
+
+    // act
+    IoTHubTransport_MQTT_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, &(message2.entry), config.waitingToSend->Flink);
+
+    //cleanup
+    IoTHubTransport_MQTT_Common_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_27_003: [ Until the "max_in_flight_telemetry" option is set, IoTHubTransport_MQTT_Common_DoWork shall not limit the telemetry messages waiting for their PUBACK, until it finds a message of priority other than IOTHUB_MESSAGE_PRIORITY_NORMAL at the head of "waitingToSend"; from then on the limit shall be 64. ]*/
+TEST_FUNCTION(IoTHubTransport_MQTT_Common_DoWork_with_2_event_items_and_no_max_in_flight_sends_2)
+{
+    // arrange
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+    SUBSCRIBE_ACK suback;
+    suback.packetId = 1234;
+    suback.qosCount = 1;
+    suback.qosReturn = QosValue;
+
+    IOTHUB_MESSAGE_LIST message1;
+    IOTHUB_MESSAGE_LIST message2;
+    memset(&message1, 0, sizeof(IOTHUB_MESSAGE_LIST));
+    memset(&message2, 0, sizeof(IOTHUB_MESSAGE_LIST));
+    message1.messageHandle = TEST_IOTHUB_MSG_BYTEARRAY;
+    message2.messageHandle = TEST_IOTHUB_MSG_BYTEARRAY;
+
+    DList_InsertTailList(config.waitingToSend, &(message1.entry));
+    DList_InsertTailList(config.waitingToSend, &(message2.entry));
+    TRANSPORT_LL_HANDLE handle = IoTHubTransport_MQTT_Common_Create(&config, get_IO_transport);
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+    setup_initialize_connection_mocks();
+    IoTHubTransport_MQTT_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    umock_c_reset_all_calls();
+
+    setup_IoTHubTransport_MQTT_Common_DoWork_events_mocks(NULL, NULL, 0, TEST_IOTHUB_MSG_BYTEARRAY, false, NULL, NULL, NULL, NULL, NULL, NULL, false);
+    setup_IoTHubTransport_MQTT_Common_DoWork_events_mocks(NULL, NULL, 0, TEST_IOTHUB_MSG_BYTEARRAY, false, NULL, NULL, NULL, NULL, NULL, NULL, false);
+
+    // act
+    IoTHubTransport_MQTT_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, config.waitingToSend, config.waitingToSend->Flink);
+
+    //cleanup
+    IoTHubTransport_MQTT_Common_Destroy(handle);
+}
+
 TEST_FUNCTION(IoTHubTransport_MQTT_Common_DoWork_with_1_event_item_fail)
 {
     // arrange
@@ -5,10 +5,12 @@
 #include <cstdlib>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #else
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #endif
 
 static void* my_gballoc_malloc(size_t size)
@@ -37,6 +39,7 @@ static void my_gballoc_free(void* ptr)
 #define ENABLE_MOCKS
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
@@ -212,6 +215,14 @@ static void clientDoWork(void* clientHandle)
     clientDoWork_calls++;
 }
 
+static TRANSPORT_HANDLE g_ending_transport_handle = NULL;
+static bool g_ending_ok_to_join = true;
+static void clientDoWork_ending_itself(void* clientHandle)
+{
+    clientDoWork_calls++;
+    g_ending_ok_to_join = IoTHubTransport_SignalEndWorkerThread(g_ending_transport_handle, (IOTHUB_CLIENT_CORE_HANDLE)clientHandle);
+}
+
 static LOCK_HANDLE my_Lock_Init(void)
 {
     return (LOCK_HANDLE)my_gballoc_malloc(1);
@@ -223,6 +234,16 @@ static LOCK_RESULT my_Lock_Deinit(LOCK_HANDLE handle)
     return LOCK_OK;
 }
 
+static COND_HANDLE my_Condition_Init(void)
+{
+    return (COND_HANDLE)my_gballoc_malloc(1);
+}
+
+static void my_Condition_Deinit(COND_HANDLE handle)
+{
+    my_gballoc_free(handle);
+}
+
 static VECTOR_HANDLE my_VECTOR_create(size_t elementSize)
 {
     (void)elementSize;
@@ -266,6 +287,17 @@ static void my_FAKE_IoTHubTransport_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CL
     g_num_of_calls++;
 }
 
+#ifdef USE_CLIENT_METRICS
+static IOTHUB_CLIENT_RESULT g_get_metrics_result = IOTHUB_CLIENT_OK;
+static IOTHUB_CLIENT_RESULT my_IoTHubClientCore_GetMetrics(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_METRICS* metrics)
+{
+    (void)memset(metrics, 0, sizeof(IOTHUB_CLIENT_METRICS));
+    metrics->counters[IOTHUB_CLIENT_METRIC_EVENTS_SENT] = (iotHubClientHandle == TEST_IOTHUB_CLIENT_CORE_HANDLE1) ? 1 : 2;
+    metrics->queue_depths[IOTHUB_CLIENT_QUEUE_WAITING_TO_SEND] = (iotHubClientHandle == TEST_IOTHUB_CLIENT_CORE_HANDLE1) ? 3 : 4;
+    return g_get_metrics_result;
+}
+#endif
+
 static TEST_MUTEX_HANDLE g_testByTest;
 static TEST_MUTEX_HANDLE g_dllByDll;
 
@@ -289,6 +321,13 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(PREDICATE_FUNCTION, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CORE_LL_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+#ifdef USE_CLIENT_METRICS
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CORE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_RESULT, int);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_GetMetrics, my_IoTHubClientCore_GetMetrics);
+#endif
 
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
@@ -304,6 +343,12 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
 
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Init, my_Condition_Init);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Deinit, my_Condition_Deinit);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Post, COND_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Wait, COND_OK);
+
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_create, real_VECTOR_create);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_create, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_move, real_VECTOR_move);
@@ -312,6 +357,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_push_back, __FAILURE__);
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_element, real_VECTOR_element);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_element, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_front, real_VECTOR_front);
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_find_if, real_VECTOR_find_if);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_find_if, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_erase, real_VECTOR_erase);
@@ -348,7 +394,11 @@ TEST_FUNCTION_INITIALIZE(method_init)
     g_num_of_calls = 0;
     g_how_many_dowork_calls = 0;
     g_transport_handle = NULL;
-
+    g_ending_transport_handle = NULL;
+    g_ending_ok_to_join = true;
+#ifdef USE_CLIENT_METRICS
+    g_get_metrics_result = IOTHUB_CLIENT_OK;
+#endif
 }
 
 TEST_FUNCTION_CLEANUP(method_cleanup)
@@ -376,6 +426,7 @@ static void setup_IoTHubTransport_Create(void)
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Create(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock_Init());
     STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
     STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
 }
 
@@ -502,7 +553,9 @@ TEST_FUNCTION(IoTHubTransport_Destroy_success)
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(TEST_TRANSPORT_LL_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
@@ -528,7 +581,13 @@ TEST_FUNCTION(IoTHubTransport_Destroy_worker_thread_success)
     STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(TEST_TRANSPORT_LL_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_front(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
@@ -553,7 +612,13 @@ TEST_FUNCTION(IoTHubTransport_Destroy_fails)
     STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(TEST_TRANSPORT_LL_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_front(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
@@ -607,6 +672,7 @@ TEST_FUNCTION(IoTHubTransport_StartWorkerThread_success)
     STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, handle));
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
     STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
@@ -656,6 +722,7 @@ TEST_FUNCTION(IoTHubTransport_StartWorkerThread_client_call_new_client_success)
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_CORE_HANDLE2));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
     STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
@@ -711,6 +778,7 @@ TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_success)
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
@@ -737,6 +805,7 @@ TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_2_clients_success)
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_CORE_HANDLE1));
     STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
@@ -790,11 +859,16 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
     TRANSPORT_HANDLE handle = NULL;
     handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
     (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    THREAD_START_FUNC workerThreadFunc = threadFunc;
     g_transport_handle = handle;
     umock_c_reset_all_calls();
 
     g_how_many_dowork_calls = 2;
 
+    for (size_t index = 0; index < 4; index++)
+    {
+        STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, handle));
+    }
     for (size_t index = 0; index < g_how_many_dowork_calls+1; index++)
     {
         STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
@@ -805,29 +879,51 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
             STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
             STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
             STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+            STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
             STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
             STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
         }
         STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
-        if (index != g_how_many_dowork_calls)
+        // the clients snapshot is only refreshed when a client was added or removed
+        if (index == 0)
         {
+            STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
             STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+            // wakes a parked dispatch thread, the client stays queued until one runs it
+            STRICT_EXPECTED_CALL(Condition_Post(IGNORED_PTR_ARG));
+        }
+        else if (index == g_how_many_dowork_calls)
+        {
+            STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
         }
         STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
     }
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    // every parked dispatch thread is woken up to see the stop
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    for (size_t index = 0; index < 4; index++)
+    {
+        STRICT_EXPECTED_CALL(Condition_Post(IGNORED_PTR_ARG));
+    }
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    for (size_t index = 0; index < 4; index++)
+    {
+        STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    }
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(ThreadAPI_Exit(IGNORED_NUM_ARG));
 
     //act
-    threadFunc(threadFuncArg);
+    workerThreadFunc(threadFuncArg);
 
     //assert
-    //ASSERT_IS_FALSE(result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    // the client work runs on the dispatch threads, not on the worker thread
+    ASSERT_ARE_EQUAL(size_t, 0, clientDoWork_calls);
 
     //cleanup
     (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
@@ -835,6 +931,111 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
     IoTHubTransport_Destroy(handle);
 }
 
+TEST_FUNCTION(IoTHubTransport_worker_thread_runs_clients_without_dispatch_threads)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    THREAD_START_FUNC workerThreadFunc = threadFunc;
+    g_transport_handle = handle;
+    umock_c_reset_all_calls();
+
+    g_how_many_dowork_calls = 2;
+
+    for (size_t index = 0; index < 4; index++)
+    {
+        STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, handle)).SetReturn(THREADAPI_ERROR);
+    }
+    for (size_t index = 0; index < g_how_many_dowork_calls+1; index++)
+    {
+        STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        if (index == g_how_many_dowork_calls)
+        {
+            STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+            STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+        }
+        STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+        if (index == 0)
+        {
+            STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+            STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        }
+        else if (index == g_how_many_dowork_calls)
+        {
+            STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+        }
+        if (index != g_how_many_dowork_calls)
+        {
+            STRICT_EXPECTED_CALL(Condition_Post(IGNORED_PTR_ARG));
+        }
+        STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+        if (index != g_how_many_dowork_calls)
+        {
+            // the queued client runs on the worker thread
+            STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+        }
+        STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
+    }
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Exit(IGNORED_NUM_ARG));
+
+    //act
+    workerThreadFunc(threadFuncArg);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, g_how_many_dowork_calls, clientDoWork_calls);
+
+    //cleanup
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+    IoTHubTransport_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_from_the_clients_own_work_does_not_wait_for_itself)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork_ending_itself);
+    THREAD_START_FUNC workerThreadFunc = threadFunc;
+    g_ending_transport_handle = handle;
+    umock_c_reset_all_calls();
+
+    // no dispatch thread, the client's work (and its destroy) runs on the worker thread
+    for (size_t index = 0; index < 4; index++)
+    {
+        STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, handle)).SetReturn(THREADAPI_ERROR);
+    }
+
+    //act
+    workerThreadFunc(threadFuncArg);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, clientDoWork_calls);
+    // the worker thread cannot join itself, IoTHubTransport_Destroy joins it
+    ASSERT_IS_FALSE(g_ending_ok_to_join);
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
 TEST_FUNCTION(IoTHubTransport_JoinWorkerThread_handle_NULL_fail)
 {
     //arrange
@@ -902,4 +1103,116 @@ TEST_FUNCTION(IoTHubTransport_JoinWorkerThread_success)
     IoTHubTransport_Destroy(handle);
 }
 
+#ifdef USE_CLIENT_METRICS
+TEST_FUNCTION(IoTHubTransport_GetMetrics_NULL_handle_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+
+    //act
+    int result = IoTHubTransport_GetMetrics(NULL, &metrics);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(IoTHubTransport_GetMetrics_NULL_metrics_fails)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    //act
+    int result = IoTHubTransport_GetMetrics(handle, NULL);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransport_GetMetrics_adds_up_the_clients)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE2, clientDoWork);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_GetMetrics(TEST_IOTHUB_CLIENT_CORE_HANDLE1, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_GetMetrics(TEST_IOTHUB_CLIENT_CORE_HANDLE2, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    int result = IoTHubTransport_GetMetrics(handle, &metrics);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(uint64_t, 3, metrics.counters[IOTHUB_CLIENT_METRIC_EVENTS_SENT]);
+    ASSERT_ARE_EQUAL(uint64_t, 0, metrics.counters[IOTHUB_CLIENT_METRIC_EVENTS_FAILED]);
+    ASSERT_ARE_EQUAL(size_t, 7, metrics.queue_depths[IOTHUB_CLIENT_QUEUE_WAITING_TO_SEND]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransport_GetMetrics_Lock_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .SetReturn(LOCK_ERROR);
+
+    //act
+    int result = IoTHubTransport_GetMetrics(handle, &metrics);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransport_GetMetrics_client_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_METRICS metrics;
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE2, clientDoWork);
+    umock_c_reset_all_calls();
+    g_get_metrics_result = IOTHUB_CLIENT_ERROR;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_GetMetrics(TEST_IOTHUB_CLIENT_CORE_HANDLE1, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    int result = IoTHubTransport_GetMetrics(handle, &metrics);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+#endif /*USE_CLIENT_METRICS*/
+
 END_TEST_SUITE(iothubtransport_ut)
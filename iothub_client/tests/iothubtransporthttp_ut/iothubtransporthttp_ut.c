@@ -12,6 +12,7 @@
 #endif
 
 #include <stdbool.h>
+#include <setjmp.h>
 
 #include "testrunnerswitcher.h"
 #include "umock_c.h"
@@ -25,6 +26,11 @@ static void* my_gballoc_malloc(size_t size)
     return malloc(size);
 }
 
+static void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
 static void my_gballoc_free(void* ptr)
 {
     free(ptr);
@@ -44,6 +50,9 @@ static void my_gballoc_free(void* ptr)
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/vector_types_internal.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/agenttime.h"
 
 #include "iothub_client_options.h"
@@ -133,6 +142,11 @@ IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_CLIENT_CONFIRMATION_RESULT, IOTHUB_CLIENT_CON
 #define TEST_PROPERTY_A_VALUE "value_of_a"
 
 #define TEST_HTTPAPIEX_HANDLE (HTTPAPIEX_HANDLE)0x343
+#define TEST_LOCK_HANDLE (LOCK_HANDLE)0x344
+#define TEST_TICK_COUNTER_HANDLE (TICK_COUNTER_HANDLE)0x345
+#define TEST_THREAD_HANDLE (THREAD_HANDLE)0x346
+#define TEST_TICK_STEP_MS 400
+#define TEST_MAX_SERVED_REQUESTS 32
 
 //static const bool thisIsTrue = true;
 //static const bool thisIsFalse = false;
@@ -580,17 +594,164 @@ static HTTPAPIEX_RESULT my_HTTPAPIEX_ExecuteRequest(HTTPAPIEX_HANDLE handle, HTT
     return HTTPAPIEX_OK;
 }
 
+/*the threads of the connection pool run on the test thread: a thread starts inside ThreadAPI_Create, runs again at every
+Condition_Post of its condition and hands the test thread back when it waits on it. A pass is therefore served by the pooled
+threads before the calling thread serves any device.*/
+#define TEST_MAX_POOLED_THREADS 16
+static bool is_in_worker_thread;
+static jmp_buf worker_wait_point;
+static COND_HANDLE last_Condition_Init_handle;
+static COND_HANDLE pooled_thread_conditions[TEST_MAX_POOLED_THREADS];
+static THREAD_START_FUNC pooled_thread_funcs[TEST_MAX_POOLED_THREADS];
+static void* pooled_thread_args[TEST_MAX_POOLED_THREADS];
+static size_t ThreadAPI_Create_count;
+static THREADAPI_RESULT ThreadAPI_Create_result;
+static size_t ThreadAPI_Join_count;
+static size_t SendComplete_count;
+static size_t SendComplete_from_worker_count;
+static unsigned int HTTPAPIEX_SAS_ExecuteRequest_statusCode;
+static const char* served_relativePaths[TEST_MAX_SERVED_REQUESTS];
+static time_t served_times[TEST_MAX_SERVED_REQUESTS];
+static size_t served_count;
+static size_t served_from_worker_count;
+static tickcounter_ms_t current_ms;
+static time_t current_time;
+
+static void run_pooled_thread(size_t index)
+{
+    is_in_worker_thread = true;
+    if (setjmp(worker_wait_point) == 0)
+    {
+        (void)pooled_thread_funcs[index](pooled_thread_args[index]);
+    }
+    is_in_worker_thread = false;
+}
+
+static COND_HANDLE my_Condition_Init(void)
+{
+    last_Condition_Init_handle = (COND_HANDLE)my_gballoc_malloc(1);
+    return last_Condition_Init_handle;
+}
+
+static void my_Condition_Deinit(COND_HANDLE handle)
+{
+    size_t i;
+    for (i = 0; i < TEST_MAX_POOLED_THREADS; i++)
+    {
+        if (pooled_thread_conditions[i] == handle)
+        {
+            pooled_thread_conditions[i] = NULL;
+        }
+    }
+    my_gballoc_free(handle);
+}
+
+static COND_RESULT my_Condition_Post(COND_HANDLE handle)
+{
+    size_t i;
+    for (i = 0; i < TEST_MAX_POOLED_THREADS; i++)
+    {
+        if ((handle != NULL) && (pooled_thread_conditions[i] == handle))
+        {
+            run_pooled_thread(i);
+        }
+    }
+    return COND_OK;
+}
+
+static COND_RESULT my_Condition_Wait(COND_HANDLE handle, LOCK_HANDLE lock, int timeout_milliseconds)
+{
+    (void)handle;
+    (void)lock;
+    (void)timeout_milliseconds;
+    if (is_in_worker_thread)
+    {
+        longjmp(worker_wait_point, 1);
+    }
+    return COND_OK;
+}
+
+/*the condition initialized last is the one of the thread being created*/
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    ThreadAPI_Create_count++;
+    if (ThreadAPI_Create_result == THREADAPI_OK)
+    {
+        size_t i;
+        for (i = 0; (i < TEST_MAX_POOLED_THREADS) && (pooled_thread_conditions[i] != NULL); i++)
+        {
+        }
+        if (i < TEST_MAX_POOLED_THREADS)
+        {
+            pooled_thread_conditions[i] = last_Condition_Init_handle;
+            pooled_thread_funcs[i] = func;
+            pooled_thread_args[i] = arg;
+            run_pooled_thread(i);
+        }
+        *threadHandle = TEST_THREAD_HANDLE;
+    }
+    return ThreadAPI_Create_result;
+}
+
+static THREADAPI_RESULT my_ThreadAPI_Join(THREAD_HANDLE threadHandle, int* res)
+{
+    (void)threadHandle;
+    *res = 0;
+    ThreadAPI_Join_count++;
+    return THREADAPI_OK;
+}
+
+static void my_IoTHubClientCore_LL_SendComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, PDLIST_ENTRY completed, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    (void)handle;
+    (void)completed;
+    (void)result;
+    SendComplete_count++;
+    if (is_in_worker_thread)
+    {
+        SendComplete_from_worker_count++;
+    }
+}
+
+static int my_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t* current_ms_value)
+{
+    (void)tick_counter;
+    *current_ms_value = current_ms;
+    current_ms += TEST_TICK_STEP_MS;
+    return 0;
+}
+
+static time_t my_get_time(time_t* currentTime)
+{
+    (void)currentTime;
+    return current_time;
+}
+
+static double my_get_difftime(time_t stopTime, time_t startTime)
+{
+    return (double)(stopTime - startTime);
+}
+
 static HTTPAPIEX_RESULT my_HTTPAPIEX_SAS_ExecuteRequest(HTTPAPIEX_SAS_HANDLE sasHandle, HTTPAPIEX_HANDLE handle, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath, HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode, HTTP_HEADERS_HANDLE responseHeadersHandle, BUFFER_HANDLE responseContent)
 {
     (void)sasHandle;
     (void)handle;
     (void)requestType;
-    (void)relativePath;
     (void)requestHttpHeadersHandle;
     (void)responseHeadersHandle;
     (void)requestContent;
     (void)responseContent;
-    *statusCode = 204;
+    if (served_count < TEST_MAX_SERVED_REQUESTS)
+    {
+        served_relativePaths[served_count] = relativePath;
+        served_times[served_count] = current_time;
+    }
+    served_count++;
+    if (is_in_worker_thread)
+    {
+        served_from_worker_count++;
+    }
+    *statusCode = HTTPAPIEX_SAS_ExecuteRequest_statusCode;
     if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
     {
         real_BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
@@ -888,12 +1049,18 @@ static void setupCreateHappyPathPerDeviceList(bool deallocateCreated)
     }
 }
 
+static void setupCreateHappyPathRandomSeed(void)
+{
+    STRICT_EXPECTED_CALL(get_time(NULL));
+}
+
 static void setupCreateHappyPath(bool deallocateCreated)
 {
     setupCreateHappyPathAlloc(deallocateCreated);
     setupCreateHappyPathHostname(deallocateCreated);
     setupCreateHappyPathApiExHandle(deallocateCreated);
     setupCreateHappyPathPerDeviceList(deallocateCreated);
+    setupCreateHappyPathRandomSeed();
 }
 
 static void setupUnregisterOneDevice()
@@ -1103,6 +1270,27 @@ static void setupDoWorkLoopForNextDevice(size_t next)
     STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, next));
 }
 
+static TRANSPORT_LL_HANDLE createTransportWithConnectionPoolAnd2Devices(void)
+{
+    unsigned int poolSize = 2;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+    return handle;
+}
+
+static void doWorkEverySecondUntilServed(TRANSPORT_LL_HANDLE handle, size_t servedCount)
+{
+    time_t stopTime = current_time + 60 * 60;
+    while ((served_count < servedCount) && (current_time < stopTime))
+    {
+        IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+        umock_c_reset_all_calls();
+        current_time++;
+    }
+}
+
 BEGIN_TEST_SUITE(iothubtransporthttp_ut)
 
 TEST_SUITE_INITIALIZE(suite_init)
@@ -1129,6 +1317,14 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(VECTOR_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(HTTPAPIEX_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(time_t, uint64_t);
     REGISTER_UMOCK_ALIAS_TYPE(PREDICATE_FUNCTION, void*);
     REGISTER_UMOCK_ALIAS_TYPE(HTTP_HEADERS_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CORE_LL_HANDLE, void*);
@@ -1147,6 +1343,23 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_realloc, NULL);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, TEST_TICK_COUNTER_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, my_tickcounter_get_current_ms);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Join, my_ThreadAPI_Join);
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Init, my_Condition_Init);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Deinit, my_Condition_Deinit);
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Post, my_Condition_Post);
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Wait, my_Condition_Wait);
+    REGISTER_GLOBAL_MOCK_HOOK(get_time, my_get_time);
+    REGISTER_GLOBAL_MOCK_HOOK(get_difftime, my_get_difftime);
 
     REGISTER_GLOBAL_MOCK_HOOK(BUFFER_new, real_BUFFER_new);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_new, NULL);
@@ -1226,6 +1439,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClientCore_LL_GetOption, IOTHUB_CLIENT_ERROR);
 
     REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_MessageCallback, my_IoTHubClientCore_LL_MessageCallback);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_SendComplete, my_IoTHubClientCore_LL_SendComplete);
 
     REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_SAS_Create, my_HTTPAPIEX_SAS_Create);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPAPIEX_SAS_Create, NULL);
@@ -1304,6 +1518,19 @@ static void reset_test_data()
 {
     last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
     my_IoTHubClientCore_LL_MessageCallback_messageData = NULL;
+    is_in_worker_thread = false;
+    ThreadAPI_Create_count = 0;
+    ThreadAPI_Create_result = THREADAPI_OK;
+    ThreadAPI_Join_count = 0;
+    SendComplete_count = 0;
+    SendComplete_from_worker_count = 0;
+    last_Condition_Init_handle = NULL;
+    memset(pooled_thread_conditions, 0, sizeof(pooled_thread_conditions));
+    HTTPAPIEX_SAS_ExecuteRequest_statusCode = 204;
+    served_count = 0;
+    served_from_worker_count = 0;
+    current_ms = 0;
+    current_time = 0;
 }
 
 TEST_FUNCTION_INITIALIZE(method_init)
@@ -1441,6 +1668,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Create_with_NULL_iothub_suffix_fails)
 //Tests_SRS_TRANSPORTMULTITHTTP_17_009: [ IoTHubTransportHttp_Create shall call VECTOR_create to create a list of registered devices. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_130: [ IoTHubTransportHttp_Create shall allocate memory for the handle. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_011: [ Otherwise, IoTHubTransportHttp_Create shall succeed and return a non-NULL value. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_42_005: [ IoTHubTransportHttp_Create shall seed the random number generator used for the polling jitter once, from get_time. ]
 TEST_FUNCTION(IoTHubTransportHttp_Create_happy_path)
 {
     //arrange
@@ -1469,6 +1697,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Create_happy_path_with_gwhostname)
     setupCreateHappyPathGWHostname(false);
     setupCreateHappyPathApiExHandle(false);
     setupCreateHappyPathPerDeviceList(false);
+    setupCreateHappyPathRandomSeed();
 
     //act
     TRANSPORT_LL_HANDLE result = IoTHubTransportHttp_Create(&TEST_GW_CONFIG);
@@ -14285,6 +14514,412 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetContentEncoding_succeeds)
     IoTHubTransportHttp_Destroy(handle);
 }
 
+//Tests_SRS_TRANSPORTMULTITHTTP_42_006: [ "MaximumPollingTime" ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_maximum_polling_time_succeeds)
+{
+    //arrange
+    unsigned int thisIs20Minutes = 20 * 60;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_MAX_POLLING_TIME, &thisIs20Minutes);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_42_002: [ Otherwise, a GET that returns a message shall reset the polling interval of the device to "MinimumPollingTime". ]
+//Tests_SRS_TRANSPORTMULTITHTTP_42_003: [ Otherwise, a GET that returns no message shall double the polling interval of the device, up to "MaximumPollingTime". ]
+//Tests_SRS_TRANSPORTMULTITHTTP_42_004: [ The time until the next GET of a device shall be its polling interval plus a random jitter of up to 1/4 of the polling interval. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_maximum_polling_time_doubles_the_polling_interval_up_to_the_maximum)
+{
+    //arrange
+    unsigned int minimumPollingTime = 10;
+    unsigned int maximumPollingTime = 80;
+    const unsigned int expectedIntervals[] = { 10, 20, 40, 80, 80 };
+    const size_t expectedIntervalCount = sizeof(expectedIntervals) / sizeof(expectedIntervals[0]);
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_MIN_POLLING_TIME, &minimumPollingTime);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_MAX_POLLING_TIME, &maximumPollingTime);
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    umock_c_reset_all_calls();
+
+    //act
+    doWorkEverySecondUntilServed(handle, expectedIntervalCount + 1);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, expectedIntervalCount + 1, served_count);
+    for (size_t index = 0; index < expectedIntervalCount; index++)
+    {
+        /*a GET is allowed once more than the polling delay has elapsed, DoWork runs every second*/
+        unsigned int gap = (unsigned int)(served_times[index + 1] - served_times[index]);
+        ASSERT_IS_TRUE(gap >= expectedIntervals[index] + 1);
+        ASSERT_IS_TRUE(gap <= expectedIntervals[index] + expectedIntervals[index] / 4 + 1);
+    }
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_42_001: [ When "MaximumPollingTime" is not larger than "MinimumPollingTime", the polling interval of a device shall be "MinimumPollingTime". ]
+//Tests_SRS_TRANSPORTMULTITHTTP_42_004: [ The time until the next GET of a device shall be its polling interval plus a random jitter of up to 1/4 of the polling interval. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_without_maximum_polling_time_adds_jitter_to_the_minimum_polling_time)
+{
+    //arrange
+    unsigned int minimumPollingTime = 40;
+    size_t pollCount = 20;
+    bool wasJitterAdded = false;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_MIN_POLLING_TIME, &minimumPollingTime);
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    umock_c_reset_all_calls();
+
+    //act
+    doWorkEverySecondUntilServed(handle, pollCount);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, pollCount, served_count);
+    for (size_t index = 0; index + 1 < pollCount; index++)
+    {
+        unsigned int gap = (unsigned int)(served_times[index + 1] - served_times[index]);
+        ASSERT_IS_TRUE(gap >= minimumPollingTime + 1);
+        ASSERT_IS_TRUE(gap <= minimumPollingTime + minimumPollingTime / 4 + 1);
+        if (gap > minimumPollingTime + 1)
+        {
+            wasJitterAdded = true;
+        }
+    }
+    ASSERT_IS_TRUE(wasJitterAdded);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_connection_pool_size_creates_the_connections)
+{
+    //arrange
+    unsigned int poolSize = 3;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, 2 * sizeof(void*)));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    for (size_t i = 0; i < 2; i++)
+    {
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Condition_Init());
+        STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        // the new thread waits for the first pass
+        STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 0));
+    }
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_connection_pool_size_0_fails)
+{
+    //arrange
+    unsigned int poolSize = 0;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_connection_pool_size_fails_after_a_connection_option)
+{
+    //arrange
+    unsigned int poolSize = 2;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_passes_connection_options_to_every_pooled_connection)
+{
+    //arrange
+    unsigned int poolSize = 2;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SetOption(IGNORED_PTR_ARG, "someOption", (void*)42));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_device_deadline_creates_the_tick_counter)
+{
+    //arrange
+    unsigned int deadlineMs = 500;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_create());
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DEVICE_DEADLINE_MS, &deadlineMs);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+//Tests_SRS_TRANSPORTMULTITHTTP_41_001: [ If OPTION_HTTP_CONNECTION_POOL_SIZE is greater than 1 and more than one device has work to do, IoTHubTransportHttp_DoWork shall serve those devices on the calling thread and on the threads of the pooled connections, and wait for those threads to be done with them before IoTHubTransportHttp_DoWork returns. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_connection_pool_serves_the_devices_on_the_pooled_connections)
+{
+    //arrange
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend2), &(message2.entry));
+    TRANSPORT_LL_HANDLE handle = createTransportWithConnectionPoolAnd2Devices();
+    ThreadAPI_Create_count = 0;
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 0, ThreadAPI_Create_count);
+    ASSERT_ARE_EQUAL(size_t, 0, ThreadAPI_Join_count);
+    ASSERT_ARE_EQUAL(size_t, 2, served_count);
+    ASSERT_ARE_EQUAL(size_t, 2, served_from_worker_count);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_41_006: [ Every pooled connection shall be served by its own thread, created by ThreadAPI_Create with the connection and joined by ThreadAPI_Join when the connection is destroyed. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_connection_pool_reuses_the_pooled_threads_for_every_pass)
+{
+    //arrange
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend2), &(message2.entry));
+    TRANSPORT_LL_HANDLE handle = createTransportWithConnectionPoolAnd2Devices();
+    HTTPAPIEX_SAS_ExecuteRequest_statusCode = 404; /*the events stay in waitingToSend*/
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, ThreadAPI_Create_count);
+    ASSERT_ARE_EQUAL(size_t, 0, ThreadAPI_Join_count);
+    ASSERT_ARE_EQUAL(size_t, 4, served_count);
+    ASSERT_ARE_EQUAL(size_t, 4, served_from_worker_count);
+
+    //act
+    IoTHubTransportHttp_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, ThreadAPI_Join_count);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_41_006: [ Every pooled connection shall be served by its own thread, created by ThreadAPI_Create with the connection and joined by ThreadAPI_Join when the connection is destroyed. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_smaller_connection_pool_size_joins_the_threads_of_the_removed_connections)
+{
+    //arrange
+    unsigned int poolSize = 3;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+    poolSize = 2;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Post(IGNORED_PTR_ARG));
+    // the thread sees it has to stop
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 1, ThreadAPI_Join_count);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_41_001: [ If OPTION_HTTP_CONNECTION_POOL_SIZE is greater than 1 and more than one device has work to do, IoTHubTransportHttp_DoWork shall serve those devices on the calling thread and on the threads of the pooled connections, and wait for those threads to be done with them before IoTHubTransportHttp_DoWork returns. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_connection_pool_and_1_device_with_work_serves_it_on_the_calling_thread)
+{
+    //arrange
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    TRANSPORT_LL_HANDLE handle = createTransportWithConnectionPoolAnd2Devices();
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 0, served_from_worker_count);
+    ASSERT_ARE_EQUAL(size_t, 1, served_count);
+    ASSERT_ARE_EQUAL(size_t, 1, SendComplete_count);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_41_001: [ If OPTION_HTTP_CONNECTION_POOL_SIZE is greater than 1 and more than one device has work to do, IoTHubTransportHttp_DoWork shall serve those devices on the calling thread and on the threads of the pooled connections, and wait for those threads to be done with them before IoTHubTransportHttp_DoWork returns. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_connection_pool_serves_the_devices_on_the_calling_thread_when_ThreadAPI_Create_fails)
+{
+    //arrange
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend2), &(message2.entry));
+    ThreadAPI_Create_result = THREADAPI_ERROR;
+    TRANSPORT_LL_HANDLE handle = createTransportWithConnectionPoolAnd2Devices();
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 0, ThreadAPI_Join_count);
+    ASSERT_ARE_EQUAL(size_t, 2, served_count);
+    ASSERT_ARE_EQUAL(size_t, 0, served_from_worker_count);
+    ASSERT_ARE_EQUAL(size_t, 2, SendComplete_count);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_41_002: [ While the devices are served concurrently, the workers shall not call IoTHubClientCore_LL_SendComplete nor IoTHubClientCore_LL_MessageCallback. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_41_003: [ Once the pooled threads are done with the pass, IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete and IoTHubClientCore_LL_MessageCallback for what they completed, on the calling thread. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_connection_pool_completes_the_events_on_the_calling_thread)
+{
+    //arrange
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend2), &(message2.entry));
+    TRANSPORT_LL_HANDLE handle = createTransportWithConnectionPoolAnd2Devices();
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 2, served_from_worker_count);
+    ASSERT_ARE_EQUAL(size_t, 2, SendComplete_count);
+    ASSERT_ARE_EQUAL(size_t, 0, SendComplete_from_worker_count);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_41_004: [ Every pass shall start one device further in the device list than the previous pass. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_connection_pool_starts_every_pass_with_the_next_device)
+{
+    //arrange
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend2), &(message2.entry));
+    TRANSPORT_LL_HANDLE handle = createTransportWithConnectionPoolAnd2Devices();
+    HTTPAPIEX_SAS_ExecuteRequest_statusCode = 404; /*the events stay in waitingToSend*/
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 6, served_count);
+    ASSERT_ARE_EQUAL(char_ptr, "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION, served_relativePaths[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "/devices/" TEST_DEVICE_ID2 EVENT_ENDPOINT API_VERSION, served_relativePaths[1]);
+    ASSERT_ARE_EQUAL(char_ptr, "/devices/" TEST_DEVICE_ID2 EVENT_ENDPOINT API_VERSION, served_relativePaths[2]);
+    ASSERT_ARE_EQUAL(char_ptr, "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION, served_relativePaths[3]);
+    ASSERT_ARE_EQUAL(char_ptr, "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION, served_relativePaths[4]);
+    ASSERT_ARE_EQUAL(char_ptr, "/devices/" TEST_DEVICE_ID2 EVENT_ENDPOINT API_VERSION, served_relativePaths[5]);
+    ASSERT_ARE_EQUAL(size_t, 0, SendComplete_count);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_41_005: [ If OPTION_HTTP_DEVICE_DEADLINE_MS is not 0, the devices not started within it since the start of the pass shall be left to the next call to IoTHubTransportHttp_DoWork, which shall start with the first of them. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_connection_pool_leaves_the_devices_past_the_deadline_to_the_next_pass)
+{
+    //arrange
+    unsigned int deadlineMs = TEST_TICK_STEP_MS + TEST_TICK_STEP_MS / 2; /*the tick counter moves TEST_TICK_STEP_MS at every read, only the first device is started in time*/
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend2), &(message2.entry));
+    TRANSPORT_LL_HANDLE handle = createTransportWithConnectionPoolAnd2Devices();
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DEVICE_DEADLINE_MS, &deadlineMs);
+    HTTPAPIEX_SAS_ExecuteRequest_statusCode = 404; /*the events stay in waitingToSend*/
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, served_count);
+    ASSERT_ARE_EQUAL(char_ptr, "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION, served_relativePaths[0]);
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 2, served_count);
+    ASSERT_ARE_EQUAL(char_ptr, "/devices/" TEST_DEVICE_ID2 EVENT_ENDPOINT API_VERSION, served_relativePaths[1]);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
 /*Tests_SRS_TRANSPORTMULTITHTTP_02_001: [ If handle is NULL then IoTHubTransportHttp_GetHostname shall fail and return NULL. ]*/
 TEST_FUNCTION(IoTHubTransportHttp_GetHostname_with_NULL_handle_fails)
 {
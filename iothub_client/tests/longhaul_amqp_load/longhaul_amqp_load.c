@@ -0,0 +1,55 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "iothub_client.h"
+#include "iothubtransportamqp.h"
+#include "iothub_account.h"
+#include "../common_longhaul/iothub_client_common_longhaul.h"
+
+// Every setting can be overridden through an environment variable of the same name, e.g. LONGHAUL_LOAD_DEVICES=500.
+static double get_load_setting(const char* name, double default_value)
+{
+    const char* value = getenv(name);
+    return (value == NULL || *value == '\0') ? default_value : atof(value);
+}
+
+int main(void)
+{
+    int result;
+    IOTHUB_LONGHAUL_RESOURCES_HANDLE iotHubLonghaulRsrcsHandle;
+    size_t test_duration_in_seconds = (size_t)get_load_setting("LONGHAUL_LOAD_DURATION_SECS", 60 * 60);
+    LONGHAUL_LOAD_PROFILE profile;
+
+    profile.number_of_devices = (size_t)get_load_setting("LONGHAUL_LOAD_DEVICES", 100);
+    profile.number_of_multiplexed_devices = (size_t)get_load_setting("LONGHAUL_LOAD_MULTIPLEXED_DEVICES", 80);
+    profile.devices_per_transport = (size_t)get_load_setting("LONGHAUL_LOAD_DEVICES_PER_TRANSPORT", 20);
+    profile.multiplexed_protocol = AMQP_Protocol;
+    profile.dedicated_protocol = AMQP_Protocol;
+    profile.telemetry_per_second = get_load_setting("LONGHAUL_LOAD_TELEMETRY_PER_SEC", 50);
+    profile.c2d_per_second = get_load_setting("LONGHAUL_LOAD_C2D_PER_SEC", 5);
+    profile.device_methods_per_second = get_load_setting("LONGHAUL_LOAD_DEVICE_METHODS_PER_SEC", 2);
+    profile.twin_desired_per_second = get_load_setting("LONGHAUL_LOAD_TWIN_DESIRED_PER_SEC", 1);
+    profile.twin_reported_per_second = get_load_setting("LONGHAUL_LOAD_TWIN_REPORTED_PER_SEC", 1);
+    profile.service_threads = (size_t)get_load_setting("LONGHAUL_LOAD_SERVICE_THREADS", 8);
+
+    if ((iotHubLonghaulRsrcsHandle = longhaul_load_tests_init(profile.number_of_devices)) == NULL)
+    {
+        LogError("Test failed");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = longhaul_run_load_tests(iotHubLonghaulRsrcsHandle, &profile, test_duration_in_seconds);
+
+        longhaul_tests_deinit(iotHubLonghaulRsrcsHandle);
+    }
+
+    return result;
+}
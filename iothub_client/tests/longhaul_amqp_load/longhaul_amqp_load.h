@@ -0,0 +1,17 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef LONGHAUL_AMQP_LOAD_H
+#define LONGHAUL_AMQP_LOAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	void longhaul_amqp_load_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LONGHAUL_AMQP_LOAD_H */
@@ -0,0 +1,496 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "azure_c_shared_utility/tickcounter.h"
+
+#include "azure_uamqp_c/connection.h"
+#include "azure_uamqp_c/session.h"
+#include "azure_uamqp_c/link.h"
+#include "azure_uamqp_c/message.h"
+#include "azure_uamqp_c/message_sender.h"
+#include "azure_uamqp_c/message_receiver.h"
+#include "azure_uamqp_c/amqpvalue.h"
+
+#include "amqp_standin.h"
+
+#define MAX_OUTSTANDING             16384   /* messages waiting for their settlement or their feedback record */
+#define MAX_ID_LENGTH               64
+#define FEEDBACK_RECORD_MAX_LENGTH  256
+
+static const char* DEVICE_PATH_PREFIX = "/devices/";
+
+typedef struct DELIVERY_TAG
+{
+    ON_MESSAGE_SEND_COMPLETE on_send_complete;
+    void* context;
+    size_t due_cycle;
+    char device_id[MAX_ID_LENGTH];
+    char message_id[MAX_ID_LENGTH];
+} DELIVERY;
+
+typedef struct DELIVERY_QUEUE_TAG
+{
+    DELIVERY items[MAX_OUTSTANDING];
+    size_t head;
+    size_t count;
+} DELIVERY_QUEUE;
+
+typedef struct STANDIN_TAG
+{
+    size_t settle_latency_cycles;
+    size_t feedback_latency_cycles;
+    size_t feedback_batch_size;
+    size_t handshake_cycles;
+    size_t attach_cycles;
+    size_t cycle;
+
+    /* cycle the current connection is up at and the cycles the pending links report OPEN at */
+    size_t connection_ready_cycle;
+    bool sender_opening;
+    size_t sender_open_cycle;
+    bool receiver_opening;
+    size_t receiver_open_cycle;
+
+    ON_MESSAGE_SENDER_STATE_CHANGED on_sender_state_changed;
+    void* sender_context;
+    ON_MESSAGE_RECEIVER_STATE_CHANGED on_receiver_state_changed;
+    const void* receiver_state_context;
+    ON_MESSAGE_RECEIVED on_message_received;
+    const void* receiver_context;
+
+    DELIVERY_QUEUE unsettled;
+    DELIVERY_QUEUE awaiting_feedback;
+    AMQP_STANDIN_STATS stats;
+} STANDIN;
+
+static STANDIN g_standin;
+static char g_feedback_body[FEEDBACK_RECORD_MAX_LENGTH * 1024];
+
+/* the handles returned to the client only need to be distinct and non-NULL */
+static int g_connection;
+static int g_session;
+static int g_sender_link;
+static int g_receiver_link;
+static int g_sender;
+static int g_receiver;
+
+void amqp_standin_reset(size_t settle_latency_cycles, size_t feedback_latency_cycles, size_t feedback_batch_size)
+{
+    memset(&g_standin, 0, sizeof(g_standin));
+    g_standin.settle_latency_cycles = settle_latency_cycles;
+    g_standin.feedback_latency_cycles = feedback_latency_cycles;
+    g_standin.feedback_batch_size = (feedback_batch_size == 0 || feedback_batch_size > 1024) ? 1024 : feedback_batch_size;
+}
+
+void amqp_standin_set_open_latency(size_t handshake_cycles, size_t attach_cycles)
+{
+    g_standin.handshake_cycles = handshake_cycles;
+    g_standin.attach_cycles = attach_cycles;
+}
+
+size_t amqp_standin_get_cycle(void)
+{
+    return g_standin.cycle;
+}
+
+void amqp_standin_get_stats(AMQP_STANDIN_STATS* stats)
+{
+    *stats = g_standin.stats;
+}
+
+static DELIVERY* delivery_queue_push(DELIVERY_QUEUE* queue)
+{
+    DELIVERY* result;
+    if (queue->count == MAX_OUTSTANDING)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = &queue->items[(queue->head + queue->count) % MAX_OUTSTANDING];
+        queue->count++;
+    }
+    return result;
+}
+
+static DELIVERY* delivery_queue_peek_due(DELIVERY_QUEUE* queue, size_t cycle)
+{
+    DELIVERY* result;
+    if (queue->count == 0 || queue->items[queue->head].due_cycle > cycle)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = &queue->items[queue->head];
+    }
+    return result;
+}
+
+static void delivery_queue_pop(DELIVERY_QUEUE* queue)
+{
+    queue->head = (queue->head + 1) % MAX_OUTSTANDING;
+    queue->count--;
+}
+
+static void copy_amqp_string(AMQP_VALUE value, char* destination)
+{
+    const char* string_value;
+    destination[0] = '\0';
+    if (value != NULL && amqpvalue_get_string(value, &string_value) == 0)
+    {
+        (void)snprintf(destination, MAX_ID_LENGTH, "%s", string_value);
+    }
+}
+
+/* reads the message-id and the device id of the TO address (/devices/<id>/messages/deviceBound) of a C2D message */
+static void read_message_addressing(MESSAGE_HANDLE message, DELIVERY* delivery)
+{
+    PROPERTIES_HANDLE properties = NULL;
+
+    delivery->message_id[0] = '\0';
+    delivery->device_id[0] = '\0';
+    if (message_get_properties(message, &properties) == 0 && properties != NULL)
+    {
+        AMQP_VALUE message_id = NULL;
+        AMQP_VALUE to = NULL;
+        char address[MAX_ID_LENGTH * 2];
+
+        if (properties_get_message_id(properties, &message_id) == 0)
+        {
+            copy_amqp_string(message_id, delivery->message_id);
+        }
+        if (properties_get_to(properties, &to) == 0)
+        {
+            const char* to_string;
+            if (to != NULL && amqpvalue_get_string(to, &to_string) == 0 &&
+                strncmp(to_string, DEVICE_PATH_PREFIX, strlen(DEVICE_PATH_PREFIX)) == 0)
+            {
+                char* device_end;
+                (void)snprintf(address, sizeof(address), "%s", to_string + strlen(DEVICE_PATH_PREFIX));
+                if ((device_end = strchr(address, '/')) != NULL)
+                {
+                    *device_end = '\0';
+                }
+                (void)snprintf(delivery->device_id, MAX_ID_LENGTH, "%s", address);
+            }
+        }
+        properties_destroy(properties);
+    }
+}
+
+static void settle_due_messages(void)
+{
+    DELIVERY* delivery;
+    while ((delivery = delivery_queue_peek_due(&g_standin.unsettled, g_standin.cycle)) != NULL)
+    {
+        DELIVERY* feedback = delivery_queue_push(&g_standin.awaiting_feedback);
+        if (feedback != NULL)
+        {
+            *feedback = *delivery;
+            feedback->due_cycle = g_standin.cycle + g_standin.feedback_latency_cycles;
+        }
+        g_standin.stats.messages_settled++;
+
+        /* the completion may send more messages, so the queue entry is released first */
+        {
+            ON_MESSAGE_SEND_COMPLETE on_send_complete = delivery->on_send_complete;
+            void* context = delivery->context;
+            delivery_queue_pop(&g_standin.unsettled);
+            on_send_complete(context, MESSAGE_SEND_OK);
+        }
+    }
+}
+
+static bool open_is_immediate(void)
+{
+    return g_standin.handshake_cycles == 0 && g_standin.attach_cycles == 0;
+}
+
+static size_t link_open_cycle(void)
+{
+    size_t start = (g_standin.connection_ready_cycle > g_standin.cycle) ? g_standin.connection_ready_cycle : g_standin.cycle;
+    return start + g_standin.attach_cycles;
+}
+
+static void open_due_links(void)
+{
+    if (g_standin.sender_opening && g_standin.sender_open_cycle <= g_standin.cycle)
+    {
+        g_standin.sender_opening = false;
+        if (g_standin.on_sender_state_changed != NULL)
+        {
+            g_standin.on_sender_state_changed(g_standin.sender_context, MESSAGE_SENDER_STATE_OPEN, MESSAGE_SENDER_STATE_OPENING);
+        }
+    }
+    if (g_standin.receiver_opening && g_standin.receiver_open_cycle <= g_standin.cycle)
+    {
+        g_standin.receiver_opening = false;
+        if (g_standin.on_receiver_state_changed != NULL)
+        {
+            g_standin.on_receiver_state_changed(g_standin.receiver_state_context, MESSAGE_RECEIVER_STATE_OPEN, MESSAGE_RECEIVER_STATE_OPENING);
+        }
+    }
+}
+
+static void send_feedback_message(size_t record_count, size_t body_length)
+{
+    MESSAGE_HANDLE message = message_create();
+    if (message == NULL)
+    {
+        (void)printf("ERROR: message_create failed for a feedback message\r\n");
+    }
+    else
+    {
+        BINARY_DATA body;
+        /* the client hands the body to the JSON parser as a string, the terminator is part of the data */
+        body.bytes = (const unsigned char*)g_feedback_body;
+        body.length = body_length + 1;
+        if (message_add_body_amqp_data(message, body) != 0)
+        {
+            (void)printf("ERROR: message_add_body_amqp_data failed for a feedback message\r\n");
+        }
+        else
+        {
+            AMQP_VALUE disposition = g_standin.on_message_received(g_standin.receiver_context, message);
+            if (disposition != NULL)
+            {
+                amqpvalue_destroy(disposition);
+            }
+            g_standin.stats.feedback_records += record_count;
+            g_standin.stats.feedback_messages++;
+        }
+        message_destroy(message);
+    }
+}
+
+static void send_due_feedback(void)
+{
+    while (g_standin.on_message_received != NULL &&
+        delivery_queue_peek_due(&g_standin.awaiting_feedback, g_standin.cycle) != NULL)
+    {
+        size_t record_count = 0;
+        size_t length = 0;
+        DELIVERY* record;
+
+        g_feedback_body[length++] = '[';
+        while (record_count < g_standin.feedback_batch_size &&
+            (record = delivery_queue_peek_due(&g_standin.awaiting_feedback, g_standin.cycle)) != NULL)
+        {
+            int written = snprintf(g_feedback_body + length, FEEDBACK_RECORD_MAX_LENGTH,
+                "%s{\"originalMessageId\":\"%s\",\"description\":\"Success\",\"deviceGenerationId\":\"636000000000000000\",\"deviceId\":\"%s\",\"enqueuedTimeUtc\":\"2017-01-01T00:00:00.0000000Z\"}",
+                (record_count == 0) ? "" : ",", record->message_id, record->device_id);
+            length += (size_t)written;
+            record_count++;
+            delivery_queue_pop(&g_standin.awaiting_feedback);
+        }
+        g_feedback_body[length++] = ']';
+        g_feedback_body[length] = '\0';
+
+        send_feedback_message(record_count, length);
+    }
+}
+
+CONNECTION_HANDLE connection_create(XIO_HANDLE io, const char* hostname, const char* container_id, ON_NEW_ENDPOINT on_new_endpoint, void* callback_context)
+{
+    (void)io;
+    (void)hostname;
+    (void)container_id;
+    (void)on_new_endpoint;
+    (void)callback_context;
+    g_standin.connection_ready_cycle = g_standin.cycle + g_standin.handshake_cycles;
+    g_standin.stats.connections++;
+    return (CONNECTION_HANDLE)&g_connection;
+}
+
+void connection_destroy(CONNECTION_HANDLE connection)
+{
+    (void)connection;
+}
+
+void connection_dowork(CONNECTION_HANDLE connection)
+{
+    (void)connection;
+    g_standin.cycle++;
+    open_due_links();
+    settle_due_messages();
+    send_due_feedback();
+}
+
+SESSION_HANDLE session_create(CONNECTION_HANDLE connection, ON_LINK_ATTACHED on_link_attached, void* callback_context)
+{
+    (void)connection;
+    (void)on_link_attached;
+    (void)callback_context;
+    return (SESSION_HANDLE)&g_session;
+}
+
+void session_destroy(SESSION_HANDLE session)
+{
+    (void)session;
+}
+
+int session_set_incoming_window(SESSION_HANDLE session, uint32_t incoming_window)
+{
+    (void)session;
+    (void)incoming_window;
+    return 0;
+}
+
+int session_set_outgoing_window(SESSION_HANDLE session, uint32_t outgoing_window)
+{
+    (void)session;
+    (void)outgoing_window;
+    return 0;
+}
+
+LINK_HANDLE link_create(SESSION_HANDLE session, const char* name, role role, AMQP_VALUE source, AMQP_VALUE target)
+{
+    (void)session;
+    (void)name;
+    (void)source;
+    (void)target;
+    return (role == role_sender) ? (LINK_HANDLE)&g_sender_link : (LINK_HANDLE)&g_receiver_link;
+}
+
+void link_destroy(LINK_HANDLE link)
+{
+    (void)link;
+}
+
+int link_set_snd_settle_mode(LINK_HANDLE link, sender_settle_mode snd_settle_mode)
+{
+    (void)link;
+    (void)snd_settle_mode;
+    return 0;
+}
+
+int link_set_rcv_settle_mode(LINK_HANDLE link, receiver_settle_mode rcv_settle_mode)
+{
+    (void)link;
+    (void)rcv_settle_mode;
+    return 0;
+}
+
+int link_set_attach_properties(LINK_HANDLE link, fields attach_properties)
+{
+    (void)link;
+    (void)attach_properties;
+    return 0;
+}
+
+MESSAGE_SENDER_HANDLE messagesender_create(LINK_HANDLE link, ON_MESSAGE_SENDER_STATE_CHANGED on_message_sender_state_changed, void* context)
+{
+    (void)link;
+    g_standin.on_sender_state_changed = on_message_sender_state_changed;
+    g_standin.sender_context = context;
+    return (MESSAGE_SENDER_HANDLE)&g_sender;
+}
+
+void messagesender_destroy(MESSAGE_SENDER_HANDLE message_sender)
+{
+    (void)message_sender;
+    g_standin.on_sender_state_changed = NULL;
+    g_standin.sender_opening = false;
+}
+
+int messagesender_open(MESSAGE_SENDER_HANDLE message_sender)
+{
+    (void)message_sender;
+    g_standin.stats.link_attaches++;
+    if (open_is_immediate())
+    {
+        if (g_standin.on_sender_state_changed != NULL)
+        {
+            g_standin.on_sender_state_changed(g_standin.sender_context, MESSAGE_SENDER_STATE_OPEN, MESSAGE_SENDER_STATE_IDLE);
+        }
+    }
+    else
+    {
+        g_standin.sender_opening = true;
+        g_standin.sender_open_cycle = link_open_cycle();
+        if (g_standin.on_sender_state_changed != NULL)
+        {
+            g_standin.on_sender_state_changed(g_standin.sender_context, MESSAGE_SENDER_STATE_OPENING, MESSAGE_SENDER_STATE_IDLE);
+        }
+    }
+    return 0;
+}
+
+ASYNC_OPERATION_HANDLE messagesender_send_async(MESSAGE_SENDER_HANDLE message_sender, MESSAGE_HANDLE message, ON_MESSAGE_SEND_COMPLETE on_message_send_complete, void* callback_context, tickcounter_ms_t timeout)
+{
+    ASYNC_OPERATION_HANDLE result;
+    DELIVERY* delivery;
+
+    (void)message_sender;
+    (void)timeout;
+
+    /* both queues are bounded, a message is only accepted if its feedback record will fit as well */
+    if (g_standin.unsettled.count + g_standin.awaiting_feedback.count >= MAX_OUTSTANDING ||
+        (delivery = delivery_queue_push(&g_standin.unsettled)) == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        delivery->on_send_complete = on_message_send_complete;
+        delivery->context = callback_context;
+        /* a message sent before the sender link is open is held until it opens */
+        delivery->due_cycle = (g_standin.sender_opening ? g_standin.sender_open_cycle : g_standin.cycle) + g_standin.settle_latency_cycles;
+        read_message_addressing(message, delivery);
+
+        g_standin.stats.messages_sent++;
+        if (g_standin.unsettled.count > g_standin.stats.max_unsettled)
+        {
+            g_standin.stats.max_unsettled = g_standin.unsettled.count;
+        }
+        result = (ASYNC_OPERATION_HANDLE)delivery;
+    }
+    return result;
+}
+
+MESSAGE_RECEIVER_HANDLE messagereceiver_create(LINK_HANDLE link, ON_MESSAGE_RECEIVER_STATE_CHANGED on_message_receiver_state_changed, const void* context)
+{
+    (void)link;
+    g_standin.on_receiver_state_changed = on_message_receiver_state_changed;
+    g_standin.receiver_state_context = context;
+    return (MESSAGE_RECEIVER_HANDLE)&g_receiver;
+}
+
+void messagereceiver_destroy(MESSAGE_RECEIVER_HANDLE message_receiver)
+{
+    (void)message_receiver;
+    g_standin.on_receiver_state_changed = NULL;
+    g_standin.on_message_received = NULL;
+    g_standin.receiver_opening = false;
+}
+
+int messagereceiver_open(MESSAGE_RECEIVER_HANDLE message_receiver, ON_MESSAGE_RECEIVED on_message_received, const void* callback_context)
+{
+    (void)message_receiver;
+    g_standin.on_message_received = on_message_received;
+    g_standin.receiver_context = callback_context;
+    g_standin.stats.link_attaches++;
+    if (open_is_immediate())
+    {
+        if (g_standin.on_receiver_state_changed != NULL)
+        {
+            g_standin.on_receiver_state_changed(g_standin.receiver_state_context, MESSAGE_RECEIVER_STATE_OPEN, MESSAGE_RECEIVER_STATE_IDLE);
+        }
+    }
+    else
+    {
+        g_standin.receiver_opening = true;
+        g_standin.receiver_open_cycle = link_open_cycle();
+        if (g_standin.on_receiver_state_changed != NULL)
+        {
+            g_standin.on_receiver_state_changed(g_standin.receiver_state_context, MESSAGE_RECEIVER_STATE_OPENING, MESSAGE_RECEIVER_STATE_IDLE);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef AMQP_STANDIN_H
+#define AMQP_STANDIN_H
+
+#include <stddef.h>
+
+/* In-process stand-in for the IoT Hub end of the messaging AMQP connection. It replaces the uAMQP
+connection, session, link, message sender and message receiver, so IoTHubMessaging_LL runs unchanged
+while no socket is ever opened. Every message handed to messagesender_send_async is settled
+settle_latency_cycles connection_dowork calls later and a delivery feedback record for it is sent on
+the feedback link feedback_latency_cycles calls after that, batched feedback_batch_size records per
+AMQP message like the hub does.
+
+By default the connection and the links open as soon as they are asked to. After
+amqp_standin_set_open_latency the connection only comes up handshake_cycles connection_dowork calls
+after connection_create (TLS, SASL and AMQP open round trips) and a link reports OPEN attach_cycles calls
+after it was opened on a connection that is up. Messages sent before the sender link is open are held
+until it opens, like the uAMQP message sender does. */
+
+typedef struct AMQP_STANDIN_STATS_TAG
+{
+    size_t messages_sent;           /* calls to messagesender_send_async */
+    size_t messages_settled;
+    size_t feedback_records;
+    size_t feedback_messages;
+    size_t max_unsettled;           /* most messages waiting for their settlement at the same time */
+    size_t connections;             /* calls to connection_create, each one a full handshake */
+    size_t link_attaches;           /* calls to messagesender_open and messagereceiver_open */
+} AMQP_STANDIN_STATS;
+
+extern void amqp_standin_reset(size_t settle_latency_cycles, size_t feedback_latency_cycles, size_t feedback_batch_size);
+extern void amqp_standin_set_open_latency(size_t handshake_cycles, size_t attach_cycles);
+extern size_t amqp_standin_get_cycle(void);
+extern void amqp_standin_get_stats(AMQP_STANDIN_STATS* stats);
+
+#endif /* AMQP_STANDIN_H */
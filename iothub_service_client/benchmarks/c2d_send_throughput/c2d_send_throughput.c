@@ -0,0 +1,355 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Measures cloud-to-device send throughput of IoTHubMessaging_LL, including the correlation of the
+delivery feedback with the messages that were sent. The client runs against amqp_standin.c, an
+in-process stand-in for the hub end of the AMQP connection, which settles every message
+SETTLE_LATENCY_CYCLES DoWork cycles after it was sent and returns its feedback record
+FEEDBACK_LATENCY_CYCLES later, FEEDBACK_BATCH_SIZE records per feedback message.
+
+The same command (with PROPERTY_COUNT application properties) is delivered ROUND_COUNT times to each of
+DEVICE_COUNT devices:
+ - with IoTHubMessaging_LL_Send, one message per device. The application keeps the message ids it is
+   waiting for and looks every record of the feedback batches up in that list, which is what the
+   feedback batch callback leaves it to do;
+ - with IoTHubMessaging_LL_SendBatch, one message per DELIVERIES_PER_CYCLE devices, the feedback
+   records being matched to the devices by the client.
+Throughput is reported both in DoWork cycles and in wall clock time. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/singlylinkedlist.h"
+#include "azure_c_shared_utility/map.h"
+
+#include "iothub_message.h"
+#include "iothub_service_client_auth.h"
+#include "iothub_messaging_ll.h"
+
+#include "amqp_standin.h"
+
+#define DEVICE_COUNT                1000    /* devices the command is sent to */
+#define ROUND_COUNT                 20      /* times the command is sent to every device */
+#define DELIVERIES_PER_CYCLE        500     /* device deliveries started between two DoWork calls */
+#define PROPERTY_COUNT              8       /* application properties of the command */
+#define SETTLE_LATENCY_CYCLES       4       /* DoWork cycles between a send and its settlement */
+#define FEEDBACK_LATENCY_CYCLES     10      /* DoWork cycles between the settlement and the feedback record */
+#define FEEDBACK_BATCH_SIZE         64      /* feedback records per feedback message */
+#define MAX_CYCLES                  10000   /* gives up if the deliveries are not all confirmed by then */
+
+#define DELIVERY_COUNT              (DEVICE_COUNT * ROUND_COUNT)
+#define MESSAGE_ID_LENGTH           32
+
+static const char* CONNECTION_STRING = "HostName=benchmark.azure-devices.net;SharedAccessKeyName=iothubowner;SharedAccessKey=ZmFrZWtleWZvcmJlbmNobWFya3M=";
+static const char* COMMAND_PAYLOAD = "{\"command\":\"setInterval\",\"seconds\":30}";
+
+typedef struct SENT_MESSAGE_TAG
+{
+    char message_id[MESSAGE_ID_LENGTH];
+    const char* device_id;
+    bool confirmed;
+} SENT_MESSAGE;
+
+static char g_device_ids[DEVICE_COUNT][MESSAGE_ID_LENGTH];
+static const char* g_device_id_list[DEVICE_COUNT];
+
+/* IoTHubMessaging_LL_Send scenario: the messages whose feedback the application is waiting for */
+static SENT_MESSAGE g_sent[DELIVERY_COUNT];
+static size_t g_sent_count;
+static size_t g_first_unconfirmed;
+
+static size_t g_send_completed;
+static size_t g_send_failed;
+static size_t g_feedback_matched;
+
+static void send_complete_callback(void* context, IOTHUB_MESSAGING_RESULT messagingResult)
+{
+    (void)context;
+    if (messagingResult == IOTHUB_MESSAGING_OK)
+    {
+        g_send_completed++;
+    }
+    else
+    {
+        g_send_failed++;
+    }
+}
+
+static void feedback_batch_callback(void* context, IOTHUB_SERVICE_FEEDBACK_BATCH* feedbackBatch)
+{
+    LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(feedbackBatch->feedbackRecordList);
+    (void)context;
+
+    while (item != NULL)
+    {
+        const IOTHUB_SERVICE_FEEDBACK_RECORD* record = (const IOTHUB_SERVICE_FEEDBACK_RECORD*)singlylinkedlist_item_get_value(item);
+        size_t i;
+
+        if (record->originalMessageId != NULL && record->deviceId != NULL)
+        {
+            for (i = g_first_unconfirmed; i < g_sent_count; i++)
+            {
+                if (!g_sent[i].confirmed &&
+                    strcmp(g_sent[i].message_id, record->originalMessageId) == 0 &&
+                    strcmp(g_sent[i].device_id, record->deviceId) == 0)
+                {
+                    g_sent[i].confirmed = true;
+                    g_feedback_matched++;
+                    break;
+                }
+            }
+            while (g_first_unconfirmed < g_sent_count && g_sent[g_first_unconfirmed].confirmed)
+            {
+                g_first_unconfirmed++;
+            }
+        }
+        item = singlylinkedlist_get_next_item(item);
+    }
+}
+
+static void batch_send_complete_callback(void* context, const char* deviceId, IOTHUB_MESSAGING_RESULT messagingResult)
+{
+    (void)context;
+    (void)deviceId;
+    send_complete_callback(NULL, messagingResult);
+}
+
+static void message_feedback_callback(void* context, const IOTHUB_SERVICE_FEEDBACK_RECORD* feedbackRecord)
+{
+    (void)context;
+    if (feedbackRecord->statusCode == IOTHUB_FEEDBACK_STATUS_CODE_SUCCESS)
+    {
+        g_feedback_matched++;
+    }
+}
+
+static IOTHUB_MESSAGE_HANDLE create_command(const char* message_id)
+{
+    IOTHUB_MESSAGE_HANDLE result;
+
+    if ((result = IoTHubMessage_CreateFromByteArray((const unsigned char*)COMMAND_PAYLOAD, strlen(COMMAND_PAYLOAD))) == NULL)
+    {
+        (void)printf("ERROR: IoTHubMessage_CreateFromByteArray failed\r\n");
+    }
+    else if (IoTHubMessage_SetMessageId(result, message_id) != IOTHUB_MESSAGE_OK)
+    {
+        (void)printf("ERROR: IoTHubMessage_SetMessageId failed\r\n");
+        IoTHubMessage_Destroy(result);
+        result = NULL;
+    }
+    else
+    {
+        MAP_HANDLE properties = IoTHubMessage_Properties(result);
+        char key[16];
+        char value[16];
+        size_t i;
+
+        for (i = 0; i < PROPERTY_COUNT; i++)
+        {
+            (void)sprintf(key, "property%lu", (unsigned long)i);
+            (void)sprintf(value, "value%lu", (unsigned long)i);
+            if (Map_AddOrUpdate(properties, key, value) != MAP_OK)
+            {
+                (void)printf("ERROR: Map_AddOrUpdate failed\r\n");
+                IoTHubMessage_Destroy(result);
+                result = NULL;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+static int send_one_per_device(IOTHUB_MESSAGING_HANDLE messaging, size_t* next_delivery)
+{
+    int result = 0;
+    size_t i;
+
+    for (i = 0; result == 0 && i < DELIVERIES_PER_CYCLE && *next_delivery < DELIVERY_COUNT; i++)
+    {
+        SENT_MESSAGE* sent = &g_sent[g_sent_count];
+        IOTHUB_MESSAGE_HANDLE message;
+
+        (void)sprintf(sent->message_id, "msg-%lu", (unsigned long)*next_delivery);
+        sent->device_id = g_device_id_list[*next_delivery % DEVICE_COUNT];
+        sent->confirmed = false;
+
+        if ((message = create_command(sent->message_id)) == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            if (IoTHubMessaging_LL_Send(messaging, sent->device_id, message, send_complete_callback, NULL) != IOTHUB_MESSAGING_OK)
+            {
+                (void)printf("ERROR: IoTHubMessaging_LL_Send failed\r\n");
+                result = __LINE__;
+            }
+            IoTHubMessage_Destroy(message);
+        }
+        g_sent_count++;
+        (*next_delivery)++;
+    }
+    return result;
+}
+
+static int send_batch(IOTHUB_MESSAGING_HANDLE messaging, size_t* next_delivery)
+{
+    int result;
+    IOTHUB_MESSAGE_HANDLE message;
+    char message_id[MESSAGE_ID_LENGTH];
+    size_t first_device = *next_delivery % DEVICE_COUNT;
+    size_t device_count = DELIVERIES_PER_CYCLE;
+
+    if (device_count > DEVICE_COUNT - first_device)
+    {
+        device_count = DEVICE_COUNT - first_device;
+    }
+    if (device_count > DELIVERY_COUNT - *next_delivery)
+    {
+        device_count = DELIVERY_COUNT - *next_delivery;
+    }
+
+    (void)sprintf(message_id, "batch-%lu", (unsigned long)*next_delivery);
+    if ((message = create_command(message_id)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        if (IoTHubMessaging_LL_SendBatch(messaging, &g_device_id_list[first_device], device_count, message, batch_send_complete_callback, message_feedback_callback, NULL) != IOTHUB_MESSAGING_OK)
+        {
+            (void)printf("ERROR: IoTHubMessaging_LL_SendBatch failed\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+        IoTHubMessage_Destroy(message);
+    }
+    *next_delivery += device_count;
+    return result;
+}
+
+static int run_scenario(const char* name, bool batched, IOTHUB_SERVICE_CLIENT_AUTH_HANDLE service_client, TICK_COUNTER_HANDLE tick_counter)
+{
+    int result;
+    IOTHUB_MESSAGING_HANDLE messaging;
+
+    amqp_standin_reset(SETTLE_LATENCY_CYCLES, FEEDBACK_LATENCY_CYCLES, FEEDBACK_BATCH_SIZE);
+    g_sent_count = 0;
+    g_first_unconfirmed = 0;
+    g_send_completed = 0;
+    g_send_failed = 0;
+    g_feedback_matched = 0;
+
+    if ((messaging = IoTHubMessaging_LL_Create(service_client)) == NULL)
+    {
+        (void)printf("ERROR: IoTHubMessaging_LL_Create failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        if (IoTHubMessaging_LL_SetFeedbackMessageCallback(messaging, batched ? NULL : feedback_batch_callback, NULL) != IOTHUB_MESSAGING_OK ||
+            IoTHubMessaging_LL_Open(messaging, NULL, NULL) != IOTHUB_MESSAGING_OK)
+        {
+            (void)printf("ERROR: IoTHubMessaging_LL_Open failed\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            tickcounter_ms_t start_ms = 0;
+            tickcounter_ms_t end_ms = 0;
+            size_t next_delivery = 0;
+            AMQP_STANDIN_STATS stats;
+
+            result = 0;
+            (void)tickcounter_get_current_ms(tick_counter, &start_ms);
+
+            while (result == 0 && g_feedback_matched + g_send_failed < DELIVERY_COUNT && amqp_standin_get_cycle() < MAX_CYCLES)
+            {
+                if (next_delivery < DELIVERY_COUNT)
+                {
+                    result = batched ? send_batch(messaging, &next_delivery) : send_one_per_device(messaging, &next_delivery);
+                }
+                IoTHubMessaging_LL_DoWork(messaging);
+            }
+            (void)tickcounter_get_current_ms(tick_counter, &end_ms);
+
+            if (result == 0 && g_feedback_matched < DELIVERY_COUNT)
+            {
+                (void)printf("ERROR: only %lu of %d deliveries were confirmed\r\n", (unsigned long)g_feedback_matched, DELIVERY_COUNT);
+                result = __LINE__;
+            }
+
+            amqp_standin_get_stats(&stats);
+            (void)printf("%s:\r\n  deliveries=%lu amqp messages=%lu settled=%lu failed=%lu feedback records=%lu matched=%lu max unsettled=%lu cycles=%lu wall=%lu ms",
+                name, (unsigned long)DELIVERY_COUNT, (unsigned long)stats.messages_sent, (unsigned long)g_send_completed, (unsigned long)g_send_failed,
+                (unsigned long)stats.feedback_records, (unsigned long)g_feedback_matched, (unsigned long)stats.max_unsettled,
+                (unsigned long)amqp_standin_get_cycle(), (unsigned long)(end_ms - start_ms));
+            if (end_ms > start_ms)
+            {
+                (void)printf(" deliveries/s=%.0f", (double)g_feedback_matched * 1000 / (end_ms - start_ms));
+            }
+            (void)printf("\r\n");
+
+            IoTHubMessaging_LL_Close(messaging);
+        }
+        IoTHubMessaging_LL_Destroy(messaging);
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    TICK_COUNTER_HANDLE tick_counter;
+    IOTHUB_SERVICE_CLIENT_AUTH_HANDLE service_client;
+    size_t i;
+
+    for (i = 0; i < DEVICE_COUNT; i++)
+    {
+        (void)sprintf(g_device_ids[i], "benchmark-device-%04lu", (unsigned long)i);
+        g_device_id_list[i] = g_device_ids[i];
+    }
+
+    if (platform_init() != 0)
+    {
+        (void)printf("ERROR: platform_init failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        if ((tick_counter = tickcounter_create()) == NULL)
+        {
+            (void)printf("ERROR: tickcounter_create failed\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            if ((service_client = IoTHubServiceClientAuth_CreateFromConnectionString(CONNECTION_STRING)) == NULL)
+            {
+                (void)printf("ERROR: IoTHubServiceClientAuth_CreateFromConnectionString failed\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                (void)printf("devices: %d, rounds: %d, %d deliveries per cycle, settlement after %d cycles, feedback after %d more in batches of %d\r\n",
+                    DEVICE_COUNT, ROUND_COUNT, DELIVERIES_PER_CYCLE, SETTLE_LATENCY_CYCLES, FEEDBACK_LATENCY_CYCLES, FEEDBACK_BATCH_SIZE);
+
+                if ((result = run_scenario("IoTHubMessaging_LL_Send", false, service_client, tick_counter)) == 0)
+                {
+                    result = run_scenario("IoTHubMessaging_LL_SendBatch", true, service_client, tick_counter);
+                }
+                IoTHubServiceClientAuth_Destroy(service_client);
+            }
+            tickcounter_destroy(tick_counter);
+        }
+        platform_deinit();
+    }
+    return result;
+}
@@ -0,0 +1,250 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Measures how long a cloud-to-device message takes to be settled when the messaging client is opened
+just to send it, which is what an application that opens messaging on demand pays on every burst. The
+client runs against amqp_standin.c, which brings the AMQP connection up HANDSHAKE_CYCLES DoWork cycles
+after it is created (TCP, TLS, SASL and AMQP open round trips), reports a link open ATTACH_CYCLES
+cycles after it was attached and settles a message SETTLE_LATENCY_CYCLES cycles after it was sent.
+
+The messaging client is opened, sends one message and is closed OPEN_COUNT times:
+ - created with IoTHubMessaging_LL_Create, every Open creates a new AMQP connection and attaches both
+   the sender and the feedback receiver; the application waits for the open complete callback before
+   sending, like the samples do;
+ - created with IoTHubMessaging_LL_CreateWithConnection, the AMQP connection of the shared connection
+   is created by the first Open only and every Open attaches the sender link alone; the message is sent
+   right after Open returns.
+The latency from the call to Open to the settlement of the message is reported in DoWork cycles. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#include "iothub_message.h"
+#include "iothub_service_client_auth.h"
+#include "iothub_sc_connection.h"
+#include "iothub_messaging_ll.h"
+
+#include "amqp_standin.h"
+
+#define OPEN_COUNT                  200     /* Open, Send, Close sequences */
+#define HANDSHAKE_CYCLES            6       /* DoWork cycles the AMQP connection takes to come up */
+#define ATTACH_CYCLES               1       /* DoWork cycles between a link attach and its OPEN */
+#define SETTLE_LATENCY_CYCLES       1       /* DoWork cycles between a send and its settlement */
+#define MAX_CYCLES_PER_SEND         100     /* gives up on a send that is not settled by then */
+
+static const char* CONNECTION_STRING = "HostName=benchmark.azure-devices.net;SharedAccessKeyName=iothubowner;SharedAccessKey=ZmFrZWtleWZvcmJlbmNobWFya3M=";
+static const char* DEVICE_ID = "benchmark-device";
+static const char* COMMAND_PAYLOAD = "{\"command\":\"setInterval\",\"seconds\":30}";
+
+static bool g_opened;
+static bool g_send_done;
+static IOTHUB_MESSAGING_RESULT g_send_result;
+
+static void open_complete_callback(void* context)
+{
+    (void)context;
+    g_opened = true;
+}
+
+static void send_complete_callback(void* context, IOTHUB_MESSAGING_RESULT messagingResult)
+{
+    (void)context;
+    g_send_done = true;
+    g_send_result = messagingResult;
+}
+
+static int send_one(IOTHUB_MESSAGING_HANDLE messaging, IOTHUB_MESSAGE_HANDLE message, bool wait_for_open, size_t* latency_cycles)
+{
+    int result;
+    size_t start_cycle = amqp_standin_get_cycle();
+
+    g_opened = false;
+    g_send_done = false;
+
+    if (IoTHubMessaging_LL_Open(messaging, open_complete_callback, NULL) != IOTHUB_MESSAGING_OK)
+    {
+        (void)printf("ERROR: IoTHubMessaging_LL_Open failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        while (wait_for_open && !g_opened && amqp_standin_get_cycle() - start_cycle < MAX_CYCLES_PER_SEND)
+        {
+            IoTHubMessaging_LL_DoWork(messaging);
+        }
+
+        if (IoTHubMessaging_LL_Send(messaging, DEVICE_ID, message, send_complete_callback, NULL) != IOTHUB_MESSAGING_OK)
+        {
+            (void)printf("ERROR: IoTHubMessaging_LL_Send failed\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            while (!g_send_done && amqp_standin_get_cycle() - start_cycle < MAX_CYCLES_PER_SEND)
+            {
+                IoTHubMessaging_LL_DoWork(messaging);
+            }
+
+            if (!g_send_done || g_send_result != IOTHUB_MESSAGING_OK)
+            {
+                (void)printf("ERROR: the message was not settled\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                *latency_cycles = amqp_standin_get_cycle() - start_cycle;
+                result = 0;
+            }
+        }
+        IoTHubMessaging_LL_Close(messaging);
+    }
+    return result;
+}
+
+static int run_scenario(const char* name, IOTHUB_MESSAGING_HANDLE messaging, bool wait_for_open, TICK_COUNTER_HANDLE tick_counter)
+{
+    int result;
+    IOTHUB_MESSAGE_HANDLE message;
+
+    amqp_standin_reset(SETTLE_LATENCY_CYCLES, 0, 0);
+    amqp_standin_set_open_latency(HANDSHAKE_CYCLES, ATTACH_CYCLES);
+
+    if ((message = IoTHubMessage_CreateFromByteArray((const unsigned char*)COMMAND_PAYLOAD, strlen(COMMAND_PAYLOAD))) == NULL)
+    {
+        (void)printf("ERROR: IoTHubMessage_CreateFromByteArray failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        tickcounter_ms_t start_ms = 0;
+        tickcounter_ms_t end_ms = 0;
+        size_t total_cycles = 0;
+        size_t first_cycles = 0;
+        size_t max_cycles = 0;
+        size_t i;
+        AMQP_STANDIN_STATS stats;
+
+        result = 0;
+        (void)tickcounter_get_current_ms(tick_counter, &start_ms);
+        for (i = 0; result == 0 && i < OPEN_COUNT; i++)
+        {
+            size_t latency_cycles = 0;
+            if ((result = send_one(messaging, message, wait_for_open, &latency_cycles)) == 0)
+            {
+                if (i == 0)
+                {
+                    first_cycles = latency_cycles;
+                }
+                if (latency_cycles > max_cycles)
+                {
+                    max_cycles = latency_cycles;
+                }
+                total_cycles += latency_cycles;
+            }
+        }
+        (void)tickcounter_get_current_ms(tick_counter, &end_ms);
+
+        if (result == 0)
+        {
+            amqp_standin_get_stats(&stats);
+            (void)printf("%s:\r\n  opens=%d connections=%lu link attaches=%lu first=%lu cycles mean=%.2f cycles max=%lu cycles wall=%lu ms\r\n",
+                name, OPEN_COUNT, (unsigned long)stats.connections, (unsigned long)stats.link_attaches, (unsigned long)first_cycles,
+                (double)total_cycles / OPEN_COUNT, (unsigned long)max_cycles, (unsigned long)(end_ms - start_ms));
+        }
+        IoTHubMessage_Destroy(message);
+    }
+    return result;
+}
+
+static int run_dedicated(IOTHUB_SERVICE_CLIENT_AUTH_HANDLE service_client, TICK_COUNTER_HANDLE tick_counter)
+{
+    int result;
+    IOTHUB_MESSAGING_HANDLE messaging;
+
+    if ((messaging = IoTHubMessaging_LL_Create(service_client)) == NULL)
+    {
+        (void)printf("ERROR: IoTHubMessaging_LL_Create failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        result = run_scenario("IoTHubMessaging_LL_Create, wait for open", messaging, true, tick_counter);
+        IoTHubMessaging_LL_Destroy(messaging);
+    }
+    return result;
+}
+
+static int run_shared(IOTHUB_SERVICE_CLIENT_AUTH_HANDLE service_client, TICK_COUNTER_HANDLE tick_counter)
+{
+    int result;
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connection;
+    IOTHUB_MESSAGING_HANDLE messaging;
+
+    if ((connection = IoTHubServiceClientConnection_Create(service_client)) == NULL)
+    {
+        (void)printf("ERROR: IoTHubServiceClientConnection_Create failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        if ((messaging = IoTHubMessaging_LL_CreateWithConnection(connection)) == NULL)
+        {
+            (void)printf("ERROR: IoTHubMessaging_LL_CreateWithConnection failed\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            result = run_scenario("IoTHubMessaging_LL_CreateWithConnection, send on open", messaging, false, tick_counter);
+            IoTHubMessaging_LL_Destroy(messaging);
+        }
+        IoTHubServiceClientConnection_Destroy(connection);
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    TICK_COUNTER_HANDLE tick_counter;
+    IOTHUB_SERVICE_CLIENT_AUTH_HANDLE service_client;
+
+    if (platform_init() != 0)
+    {
+        (void)printf("ERROR: platform_init failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        if ((tick_counter = tickcounter_create()) == NULL)
+        {
+            (void)printf("ERROR: tickcounter_create failed\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            if ((service_client = IoTHubServiceClientAuth_CreateFromConnectionString(CONNECTION_STRING)) == NULL)
+            {
+                (void)printf("ERROR: IoTHubServiceClientAuth_CreateFromConnectionString failed\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                (void)printf("opens: %d, handshake after %d cycles, link open after %d cycles, settlement after %d cycles\r\n",
+                    OPEN_COUNT, HANDSHAKE_CYCLES, ATTACH_CYCLES, SETTLE_LATENCY_CYCLES);
+
+                if ((result = run_dedicated(service_client, tick_counter)) == 0)
+                {
+                    result = run_shared(service_client, tick_counter);
+                }
+                IoTHubServiceClientAuth_Destroy(service_client);
+            }
+            tickcounter_destroy(tick_counter);
+        }
+        platform_deinit();
+    }
+    return result;
+}
@@ -0,0 +1,49 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_sc_connection_private.h
+*   @brief Functions of the shared connection used by the service clients attached to it.
+*          They are not part of the public API.
+*/
+
+#ifndef IOTHUB_SC_CONNECTION_PRIVATE_H
+#define IOTHUB_SC_CONNECTION_PRIVATE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#else
+#include <stdbool.h>
+#endif
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_uamqp_c/session.h"
+#include "iothub_service_client_auth.h"
+#include "iothub_sc_http_pipeline.h"
+#include "iothub_sc_connection.h"
+
+/** @brief  Returns the authentication information the connection was created with.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_SERVICE_CLIENT_AUTH_HANDLE, IoTHubServiceClientConnection_GetAuth, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, connectionHandle);
+
+/** @brief  Returns the shared HTTP pipeline, creating it on first use, or NULL on failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_HTTP_PIPELINE_HANDLE, IoTHubServiceClientConnection_GetHttpPipeline, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, connectionHandle);
+
+/** @brief  Returns the shared AMQP session, creating the AMQP connection and session on first use,
+*           or NULL on failure. Only one messaging client can be attached at a time; the session has
+*           to be released with IoTHubServiceClientConnection_DetachAmqpSession.
+*/
+MOCKABLE_FUNCTION(, SESSION_HANDLE, IoTHubServiceClientConnection_AttachAmqpSession, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, connectionHandle);
+
+/** @brief  Releases the AMQP session attached by IoTHubServiceClientConnection_AttachAmqpSession. The
+*           AMQP connection stays open for the next attach unless closeConnection is true, which the
+*           messaging client uses after its links failed.
+*/
+MOCKABLE_FUNCTION(, void, IoTHubServiceClientConnection_DetachAmqpSession, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, connectionHandle, bool, closeConnection);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_SC_CONNECTION_PRIVATE_H
@@ -0,0 +1,133 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_devicefanout.h
+*   @brief Runs the same twin update or method invocation against many devices.
+*
+*   @details A fan-out handle carries one operation (a twin patch or a method call) and a queue of
+*            device ids. IoTHubDeviceFanout_DoWork keeps up to max_concurrent_operations of them in
+*            flight over the persistent connections of a single IoTHubDeviceTwin or IoTHubDeviceMethod
+*            handle and reports every device's outcome through the callback as soon as it completes.
+*            The queue of devices is bounded by max_queued_devices: IoTHubDeviceFanout_AddDevices
+*            accepts what fits and returns IOTHUB_DEVICE_FANOUT_BUSY for the rest, so the caller can
+*            feed a large device list as the fan-out drains it.
+*/
+
+#ifndef IOTHUB_DEVICEFANOUT_H
+#define IOTHUB_DEVICEFANOUT_H
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#endif
+
+#include "iothub_service_client_auth.h"
+#include "iothub_devicetwin.h"
+#include "iothub_devicemethod.h"
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#define IOTHUB_DEVICE_FANOUT_RESULT_VALUES     \
+    IOTHUB_DEVICE_FANOUT_OK,                   \
+    IOTHUB_DEVICE_FANOUT_INVALID_ARG,          \
+    IOTHUB_DEVICE_FANOUT_ERROR,                \
+    IOTHUB_DEVICE_FANOUT_BUSY                  \
+
+DEFINE_ENUM(IOTHUB_DEVICE_FANOUT_RESULT, IOTHUB_DEVICE_FANOUT_RESULT_VALUES);
+
+#define IOTHUB_DEVICE_FANOUT_DEFAULT_MAX_CONCURRENT     16
+#define IOTHUB_DEVICE_FANOUT_DEFAULT_MAX_QUEUED         1024
+
+/* size_t*, number of devices the operation runs against at the same time; it is also the number of connections
+   used, since a method invocation holds its connection for up to the method timeout. Can only be set before the
+   first DoWork */
+static const char* const IOTHUB_DEVICE_FANOUT_OPTION_MAX_CONCURRENT = "max_concurrent_operations";
+/* size_t*, number of device ids IoTHubDeviceFanout_AddDevices accepts ahead of the ones in flight */
+static const char* const IOTHUB_DEVICE_FANOUT_OPTION_MAX_QUEUED = "max_queued_devices";
+
+/** @brief Handle to hide struct and use it in consequent APIs
+*/
+typedef struct IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_TAG* IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE;
+
+/** @brief  Outcome of the twin update of one device. deviceTwinJson is NULL on failure; deviceId and
+*           deviceTwinJson are only valid for the duration of the callback.
+*/
+typedef void(*IOTHUB_DEVICE_FANOUT_TWIN_CALLBACK)(const char* deviceId, IOTHUB_DEVICE_TWIN_RESULT result, const char* deviceTwinJson, void* userContext);
+
+/** @brief  Outcome of the method invocation on one device. responsePayload is NULL on failure; deviceId and
+*           responsePayload are only valid for the duration of the callback.
+*/
+typedef void(*IOTHUB_DEVICE_FANOUT_METHOD_CALLBACK)(const char* deviceId, IOTHUB_DEVICE_METHOD_RESULT result, int responseStatus, const unsigned char* responsePayload, size_t responsePayloadSize, void* userContext);
+
+/** @brief	Creates a fan-out that applies the same twin patch to every device added to it.
+*
+* @param	serviceClientHandle	Service client handle.
+* @param    deviceTwinJson      The twin patch, copied once for all the devices.
+* @param    callback            Invoked once per device with the outcome of its update.
+* @param    userContext         User context passed to callback.
+*
+* @return	A non-NULL @c IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE on success and @c NULL on failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE, IoTHubDeviceFanout_CreateTwinUpdate, IOTHUB_SERVICE_CLIENT_AUTH_HANDLE, serviceClientHandle, const char*, deviceTwinJson, IOTHUB_DEVICE_FANOUT_TWIN_CALLBACK, callback, void*, userContext);
+
+/** @brief	Creates a fan-out that invokes the same method on every device added to it.
+*
+* @param	serviceClientHandle	Service client handle.
+* @param    methodName          The method name to call.
+* @param    methodPayload       The method payload, copied once for all the devices.
+* @param    timeout             The method timeout in seconds.
+* @param    callback            Invoked once per device with the device's response.
+* @param    userContext         User context passed to callback.
+*
+* @return	A non-NULL @c IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE on success and @c NULL on failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE, IoTHubDeviceFanout_CreateMethodInvoke, IOTHUB_SERVICE_CLIENT_AUTH_HANDLE, serviceClientHandle, const char*, methodName, const char*, methodPayload, unsigned int, timeout, IOTHUB_DEVICE_FANOUT_METHOD_CALLBACK, callback, void*, userContext);
+
+/** @brief	Disposes of the fan-out. The callback is invoked for every device that has not completed, with
+*           IOTHUB_DEVICE_TWIN_HTTPAPI_ERROR (or IOTHUB_DEVICE_METHOD_HTTPAPI_ERROR) for the ones in flight and
+*           IOTHUB_DEVICE_TWIN_ERROR (or IOTHUB_DEVICE_METHOD_ERROR) for the ones still queued.
+*
+* @param	fanoutHandle	The handle created by a call to one of the create functions.
+*/
+MOCKABLE_FUNCTION(, void, IoTHubDeviceFanout_Destroy, IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE, fanoutHandle);
+
+/** @brief	Queues devices for the operation. The device ids are copied.
+*
+* @param	fanoutHandle	The handle created by a call to one of the create functions.
+* @param    deviceIds       The device ids to add.
+* @param    deviceCount     Number of entries in deviceIds.
+* @param    devicesAdded    Receives the number of leading entries of deviceIds that were queued.
+*
+* @return	IOTHUB_DEVICE_FANOUT_OK if all the devices were queued, IOTHUB_DEVICE_FANOUT_BUSY if the queue filled
+*           up first (the caller should add the remaining ones after a few DoWork calls) or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_DEVICE_FANOUT_RESULT, IoTHubDeviceFanout_AddDevices, IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE, fanoutHandle, const char* const*, deviceIds, size_t, deviceCount, size_t*, devicesAdded);
+
+/** @brief	Starts the operation on queued devices while fewer than max_concurrent_operations are in flight,
+*           drives the connections and invokes the callbacks of the devices that completed.
+*
+* @param	fanoutHandle	The handle created by a call to one of the create functions.
+*/
+MOCKABLE_FUNCTION(, void, IoTHubDeviceFanout_DoWork, IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE, fanoutHandle);
+
+/** @brief	Returns the number of devices that have been added and have not completed yet.
+*
+* @param	fanoutHandle	The handle created by a call to one of the create functions.
+*/
+MOCKABLE_FUNCTION(, size_t, IoTHubDeviceFanout_GetPendingCount, IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE, fanoutHandle);
+
+/** @brief	Sets IOTHUB_DEVICE_FANOUT_OPTION_MAX_CONCURRENT or IOTHUB_DEVICE_FANOUT_OPTION_MAX_QUEUED; any other
+*           option is passed to the SetOption of the underlying IoTHubDeviceTwin or IoTHubDeviceMethod handle.
+*
+* @return	IOTHUB_DEVICE_FANOUT_OK upon success or an error code upon failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_DEVICE_FANOUT_RESULT, IoTHubDeviceFanout_SetOption, IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE, fanoutHandle, const char*, optionName, const void*, value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_DEVICEFANOUT_H
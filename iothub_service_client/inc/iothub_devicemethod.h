@@ -13,6 +13,7 @@ extern "C"
 #endif
 
 #include "iothub_service_client_auth.h"
+#include "iothub_sc_connection.h"
 
 #include "azure_c_shared_utility/umock_c_prod.h"
 
@@ -28,6 +29,11 @@ DEFINE_ENUM(IOTHUB_DEVICE_METHOD_RESULT, IOTHUB_DEVICE_METHOD_RESULT_VALUES);
 */
 typedef struct IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_TAG* IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE;
 
+/** @brief  Completion of an asynchronous method invocation. responsePayload is NULL on failure and is only
+*           valid for the duration of the callback.
+*/
+typedef void(*IOTHUB_DEVICE_METHOD_ASYNC_CALLBACK)(IOTHUB_DEVICE_METHOD_RESULT result, int responseStatus, const unsigned char* responsePayload, size_t responsePayloadSize, void* userContext);
+
 /** @brief	Creates a IoT Hub Service Client DeviceMethod handle for use it in consequent APIs.
 *
 * @param	serviceClientHandle	Service client handle.
@@ -37,6 +43,15 @@ typedef struct IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_TAG* IOTHUB_SERVICE_CLIENT_DE
 */
 MOCKABLE_FUNCTION(, IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE, IoTHubDeviceMethod_Create, IOTHUB_SERVICE_CLIENT_AUTH_HANDLE, serviceClientHandle);
 
+/** @brief	Creates a DeviceMethod handle whose asynchronous invocations share the HTTP pipeline of the
+*           given connection with the other clients attached to it. The connection must outlive the handle.
+*
+* @param	connectionHandle	Shared connection handle.
+*
+* @return	A non-NULL @c IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE value and @c NULL on failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE, IoTHubDeviceMethod_CreateWithConnection, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, connectionHandle);
+
 /** @brief	Disposes of resources allocated by the IoT Hub IoTHubDeviceMethod_Create.
 *
 * @param	serviceClientDeviceMethodHandle	The handle created by a call to the create function.
@@ -55,6 +70,33 @@ MOCKABLE_FUNCTION(, void,  IoTHubDeviceMethod_Destroy, IOTHUB_SERVICE_CLIENT_DEV
 */
 MOCKABLE_FUNCTION(, IOTHUB_DEVICE_METHOD_RESULT,  IoTHubDeviceMethod_Invoke, IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE, serviceClientDeviceMethodHandle, const char*, deviceId, const char*, methodName, const char*, methodPayload, unsigned int, timeout, int*, responseStatus, unsigned char**, responsePayload, size_t*, responsePayloadSize);
 
+/** @brief	Queues the invocation of a method on a device. The request is carried by a persistent
+*           connection of the handle's HTTP pipeline during subsequent IoTHubDeviceMethod_DoWork calls.
+*
+* @param	serviceClientDeviceMethodHandle	The handle created by a call to the create function.
+* @param    deviceId                        The device name (id) to call a method on.
+* @param    methodName                      The method name to call.
+* @param    methodPayload                   The message payload to send.
+* @param    timeout                         The method timeout in seconds.
+* @param    callback                        Invoked with the device's response when the request completes.
+* @param    userContext                     User context passed to callback.
+*
+* @return	IOTHUB_DEVICE_METHOD_OK if the request was queued or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_DEVICE_METHOD_RESULT, IoTHubDeviceMethod_InvokeAsync, IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE, serviceClientDeviceMethodHandle, const char*, deviceId, const char*, methodName, const char*, methodPayload, unsigned int, timeout, IOTHUB_DEVICE_METHOD_ASYNC_CALLBACK, callback, void*, userContext);
+
+/** @brief	Sends the queued asynchronous invocations and invokes the callbacks of the completed ones.
+*
+* @param	serviceClientDeviceMethodHandle	The handle created by a call to the create function.
+*/
+MOCKABLE_FUNCTION(, void, IoTHubDeviceMethod_DoWork, IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE, serviceClientDeviceMethodHandle);
+
+/** @brief	Sets one of the IOTHUB_HTTP_PIPELINE_OPTION_* options of the asynchronous invocations.
+*
+* @return	IOTHUB_DEVICE_METHOD_OK upon success or an error code upon failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_DEVICE_METHOD_RESULT, IoTHubDeviceMethod_SetOption, IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE, serviceClientDeviceMethodHandle, const char*, optionName, const void*, value);
+
 #ifdef __cplusplus
 }
 #endif
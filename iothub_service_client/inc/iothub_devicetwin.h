@@ -17,6 +17,7 @@ extern "C"
 #include "azure_c_shared_utility/map.h"
 #include <time.h>
 #include "iothub_service_client_auth.h"
+#include "iothub_sc_connection.h"
 
 #include "azure_c_shared_utility/umock_c_prod.h"
 
@@ -32,6 +33,11 @@ DEFINE_ENUM(IOTHUB_DEVICE_TWIN_RESULT, IOTHUB_DEVICE_TWIN_RESULT_VALUES);
 */
 typedef struct IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_TAG* IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE;
 
+/** @brief  Completion of an asynchronous twin request. deviceTwinJson is NULL on failure and is only
+*           valid for the duration of the callback.
+*/
+typedef void(*IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK)(IOTHUB_DEVICE_TWIN_RESULT result, const char* deviceTwinJson, void* userContext);
+
 
 /** @brief	Creates a IoT Hub Service Client DeviceTwin handle for use it in consequent APIs.
 *
@@ -42,6 +48,15 @@ typedef struct IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_TAG* IOTHUB_SERVICE_CLIENT_DEVI
 */
 MOCKABLE_FUNCTION(, IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE, IoTHubDeviceTwin_Create, IOTHUB_SERVICE_CLIENT_AUTH_HANDLE, serviceClientHandle);
 
+/** @brief	Creates a DeviceTwin handle whose asynchronous requests share the HTTP pipeline of the given
+*           connection with the other clients attached to it. The connection must outlive the handle.
+*
+* @param	connectionHandle	Shared connection handle.
+*
+* @return	A non-NULL @c IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE value and @c NULL on failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE, IoTHubDeviceTwin_CreateWithConnection, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, connectionHandle);
+
 /** @brief	Disposes of resources allocated by the IoT Hub IoTHubDeviceTwin_Create.
 *
 * @param	serviceClientDeviceTwinHandle	The handle created by a call to the create function.
@@ -69,6 +84,36 @@ MOCKABLE_FUNCTION(, char*,  IoTHubDeviceTwin_GetTwin, IOTHUB_SERVICE_CLIENT_DEVI
 */
 MOCKABLE_FUNCTION(, char*,  IoTHubDeviceTwin_UpdateTwin, IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE, serviceClientDeviceTwinHandle, const char*, deviceId, const char*, deviceTwinJson);
 
+/** @brief	Queues the retrieval of the given device's twin info. The request is carried by a persistent
+*           connection of the handle's HTTP pipeline during subsequent IoTHubDeviceTwin_DoWork calls.
+*
+* @param	serviceClientDeviceTwinHandle	The handle created by a call to the create function.
+* @param    deviceId                        The device name (id) to retrieve twin info for.
+* @param    callback                        Invoked with the twin info when the request completes.
+* @param    userContext                     User context passed to callback.
+*
+* @return	IOTHUB_DEVICE_TWIN_OK if the request was queued or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_DEVICE_TWIN_RESULT, IoTHubDeviceTwin_GetTwinAsync, IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE, serviceClientDeviceTwinHandle, const char*, deviceId, IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK, callback, void*, userContext);
+
+/** @brief	Queues a partial update of the given device's twin info, see IoTHubDeviceTwin_UpdateTwin.
+*
+* @return	IOTHUB_DEVICE_TWIN_OK if the request was queued or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_DEVICE_TWIN_RESULT, IoTHubDeviceTwin_UpdateTwinAsync, IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE, serviceClientDeviceTwinHandle, const char*, deviceId, const char*, deviceTwinJson, IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK, callback, void*, userContext);
+
+/** @brief	Sends the queued asynchronous requests and invokes the callbacks of the completed ones.
+*
+* @param	serviceClientDeviceTwinHandle	The handle created by a call to the create function.
+*/
+MOCKABLE_FUNCTION(, void, IoTHubDeviceTwin_DoWork, IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE, serviceClientDeviceTwinHandle);
+
+/** @brief	Sets one of the IOTHUB_HTTP_PIPELINE_OPTION_* options of the asynchronous requests.
+*
+* @return	IOTHUB_DEVICE_TWIN_OK upon success or an error code upon failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_DEVICE_TWIN_RESULT, IoTHubDeviceTwin_SetOption, IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE, serviceClientDeviceTwinHandle, const char*, optionName, const void*, value);
+
 #ifdef __cplusplus
 }
 #endif
@@ -73,6 +73,24 @@ MOCKABLE_FUNCTION(, void, IoTHubMessaging_Close, IOTHUB_MESSAGING_CLIENT_HANDLE,
 */
 MOCKABLE_FUNCTION(, IOTHUB_MESSAGING_RESULT, IoTHubMessaging_SendAsync, IOTHUB_MESSAGING_CLIENT_HANDLE, messagingClientHandle, const char*, deviceId, IOTHUB_MESSAGE_HANDLE, message, IOTHUB_SEND_COMPLETE_CALLBACK, sendCompleteCallback, void*, userContextCallback);
 
+/**
+* @brief	Asynchronous call to send the same message to several devices, see IoTHubMessaging_LL_SendBatch.
+*
+* @param	messagingClientHandle		The handle created by a call to the create function.
+* @param	deviceIds					The ids of the devices to send the message to.
+* @param	deviceCount					Number of entries in deviceIds.
+* @param	message						The message to send.
+* @param	sendCompleteCallback		Called once per device when its send completes. This can be @c NULL.
+* @param	feedbackCallback			Called once per device when its feedback record is received. This can be @c NULL.
+* @param	userContextCallback			User specified context that will be provided to the callbacks. This can be @c NULL.
+*
+*			@b NOTE: The application behavior is undefined if the user calls
+*			the ::IoTHubMessaging_Destroy or IoTHubMessaging_Close function from within any callback.
+*
+* @return	IOTHUB_MESSAGING_OK if the message was queued for all the devices or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGING_RESULT, IoTHubMessaging_SendBatchAsync, IOTHUB_MESSAGING_CLIENT_HANDLE, messagingClientHandle, const char* const*, deviceIds, size_t, deviceCount, IOTHUB_MESSAGE_HANDLE, message, IOTHUB_SEND_BATCH_COMPLETE_CALLBACK, sendCompleteCallback, IOTHUB_MESSAGE_FEEDBACK_CALLBACK, feedbackCallback, void*, userContextCallback);
+
 /**
 * @brief	This API specifies a callback to be used when the device receives the message.
 *
@@ -11,6 +11,7 @@
 #include "azure_c_shared_utility/map.h"
 #include "iothub_message.h"
 #include "iothub_service_client_auth.h"
+#include "iothub_sc_connection.h"
 #include "azure_c_shared_utility/umock_c_prod.h"
 
 #ifdef __cplusplus
@@ -70,6 +71,8 @@ typedef struct IOTHUB_MESSAGING_TAG* IOTHUB_MESSAGING_HANDLE;
 typedef void(*IOTHUB_OPEN_COMPLETE_CALLBACK)(void* context);
 typedef void(*IOTHUB_SEND_COMPLETE_CALLBACK)(void* context, IOTHUB_MESSAGING_RESULT messagingResult);
 typedef void(*IOTHUB_FEEDBACK_MESSAGE_RECEIVED_CALLBACK)(void* context, IOTHUB_SERVICE_FEEDBACK_BATCH* feedbackBatch);
+typedef void(*IOTHUB_SEND_BATCH_COMPLETE_CALLBACK)(void* context, const char* deviceId, IOTHUB_MESSAGING_RESULT messagingResult);
+typedef void(*IOTHUB_MESSAGE_FEEDBACK_CALLBACK)(void* context, const IOTHUB_SERVICE_FEEDBACK_RECORD* feedbackRecord);
 
 /** @brief	Creates a IoT Hub Service Client Messaging handle for use it in consequent APIs.
 *
@@ -80,6 +83,17 @@ typedef void(*IOTHUB_FEEDBACK_MESSAGE_RECEIVED_CALLBACK)(void* context, IOTHUB_S
 */
 MOCKABLE_FUNCTION(, IOTHUB_MESSAGING_HANDLE, IoTHubMessaging_LL_Create, IOTHUB_SERVICE_CLIENT_AUTH_HANDLE, iotHubMessagingServiceClientHandle);
 
+/** @brief	Creates a Messaging handle that attaches its links to the AMQP connection of the given shared
+*           connection. IoTHubMessaging_LL_Open then returns without waiting for the links to open and
+*           messages can be sent right away; the AMQP connection stays open across Close and Open.
+*           Only one messaging handle can be opened on a connection at a time.
+*
+* @param	connectionHandle	Shared connection handle, which must outlive the messaging handle.
+*
+* @return	A non-NULL @c IOTHUB_MESSAGING_HANDLE value and @c NULL on failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGING_HANDLE, IoTHubMessaging_LL_CreateWithConnection, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, connectionHandle);
+
 /** @brief	Disposes of resources allocated by the IoT Hub Service Client Messaging.
 *
 * @param	messagingClientHandle	The handle created by a call to the create function.
@@ -126,6 +140,35 @@ MOCKABLE_FUNCTION(, void, IoTHubMessaging_LL_Close, IOTHUB_MESSAGING_HANDLE, mes
 */
 MOCKABLE_FUNCTION(, IOTHUB_MESSAGING_RESULT, IoTHubMessaging_LL_Send, IOTHUB_MESSAGING_HANDLE, messagingHandle, const char*, deviceId, IOTHUB_MESSAGE_HANDLE, message, IOTHUB_SEND_COMPLETE_CALLBACK, sendCompleteCallback, void*, userContextCallback);
 
+/**
+* @brief	Sends the same message to several devices without waiting for the previous sends to complete.
+*
+*			The uAMQP message (body, message-id, correlation-id and application properties) is built once
+*			for the whole batch; only the TO property changes from one device to the next. Every device gets
+*			its own completion: sendCompleteCallback is called once per device, with IOTHUB_MESSAGING_ERROR
+*			right away for the devices the message could not be queued for.
+*
+*			If feedbackCallback is not NULL and the message has a message-id, each device stays tracked after
+*			its send completes until the feedback record with that originalMessageId and deviceId arrives;
+*			feedbackCallback is then called with the record. Feedback is only generated by the service for
+*			messages that request it through the "iothub-ack" property. Devices still waiting for their
+*			feedback are dropped by IoTHubMessaging_LL_Close.
+*
+* @param	messagingHandle				The handle created by a call to the create function.
+* @param	deviceIds					The ids of the devices to send the message to.
+* @param	deviceCount					Number of entries in deviceIds.
+* @param	message						The message to send, it is not referenced after the call.
+* @param	sendCompleteCallback		Called once per device when its send completes. This can be @c NULL.
+* @param	feedbackCallback			Called once per device when its feedback record is received. This can be @c NULL.
+* @param	userContextCallback			User specified context that will be provided to the callbacks. This can be @c NULL.
+*
+*			@b NOTE: The application behavior is undefined if the user calls
+*			the ::IoTHubMessaging_Destroy or IoTHubMessaging_Close function from within any callback.
+*
+* @return	IOTHUB_MESSAGING_OK if the message was queued for all the devices or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGING_RESULT, IoTHubMessaging_LL_SendBatch, IOTHUB_MESSAGING_HANDLE, messagingHandle, const char* const*, deviceIds, size_t, deviceCount, IOTHUB_MESSAGE_HANDLE, message, IOTHUB_SEND_BATCH_COMPLETE_CALLBACK, sendCompleteCallback, IOTHUB_MESSAGE_FEEDBACK_CALLBACK, feedbackCallback, void*, userContextCallback);
+
 /**
 * @brief	This API specifies a callback to be used when the device receives the message.
 *
@@ -17,6 +17,7 @@ extern "C"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/map.h"
 #include "iothub_service_client_auth.h"
+#include "iothub_sc_connection.h"
 
 #define IOTHUB_REGISTRYMANAGER_RESULT_VALUES        \
     IOTHUB_REGISTRYMANAGER_OK,                      \
@@ -95,12 +96,33 @@ typedef struct IOTHUB_REGISTRYMANAGER_TAG
     char* iothubSuffix;
     char* sharedAccessKey;
     char* keyName;
+    struct IOTHUB_HTTP_PIPELINE_TAG* httpPipeline;
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connection;
 } IOTHUB_REGISTRYMANAGER;
 
 /** @brief Handle to hide struct and use it in consequent APIs
 */
 typedef struct IOTHUB_REGISTRYMANAGER_TAG* IOTHUB_REGISTRYMANAGER_HANDLE;
 
+/** @brief  Completion of an asynchronous get device request. device is NULL on failure and is only
+*           valid for the duration of the callback.
+*/
+typedef void(*IOTHUB_REGISTRYMANAGER_GET_DEVICE_CALLBACK)(IOTHUB_REGISTRYMANAGER_RESULT result, const IOTHUB_DEVICE* device, void* userContext);
+
+/** @brief  Completion of an asynchronous registry request that carries no result data.
+*/
+typedef void(*IOTHUB_REGISTRYMANAGER_RESULT_CALLBACK)(IOTHUB_REGISTRYMANAGER_RESULT result, void* userContext);
+
+/** @brief Handle of a paged enumeration of the devices of the registry
+*/
+typedef struct IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_TAG* IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE;
+
+/** @brief  Receives one device of a page. device and its members are only valid for the duration of the callback.
+*/
+typedef void(*IOTHUB_REGISTRYMANAGER_DEVICE_CALLBACK)(const IOTHUB_DEVICE* device, void* userContext);
+
+#define IOTHUB_REGISTRYMANAGER_DEFAULT_PAGE_SIZE    100
+
 
 /**
 * @brief	Creates a IoT Hub Registry Manager handle for use it
@@ -113,6 +135,17 @@ typedef struct IOTHUB_REGISTRYMANAGER_TAG* IOTHUB_REGISTRYMANAGER_HANDLE;
 */
 extern IOTHUB_REGISTRYMANAGER_HANDLE IoTHubRegistryManager_Create(IOTHUB_SERVICE_CLIENT_AUTH_HANDLE serviceClientHandle);
 
+/**
+* @brief	Creates a IoT Hub Registry Manager handle whose asynchronous requests share the HTTP
+*           pipeline of the given connection with the other clients attached to it. The
+*           connection must outlive the handle.
+*
+* @param	connectionHandle	Shared connection handle.
+*
+* @return	A non-NULL @c IOTHUB_REGISTRYMANAGER_HANDLE value and @c NULL on failure.
+*/
+extern IOTHUB_REGISTRYMANAGER_HANDLE IoTHubRegistryManager_CreateWithConnection(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle);
+
 /**
 * @brief	Disposes of resources allocated by the IoT Hub Registry Manager.
 *
@@ -189,6 +222,76 @@ extern IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_GetDeviceList(IOTHUB_
 */
 extern IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_GetStatistics(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle, IOTHUB_REGISTRY_STATISTICS* registryStatistics);
 
+/**
+* @brief	Starts a paged enumeration of the devices of the registry. The pages are requested one at a time
+*           through the device query API, following the continuation token returned with each page, so only
+*           one page is held in memory however large the registry is. The results are device twins, which
+*           carry the device status and connection state but not its keys.
+*
+* @param	registryManagerHandle   The handle created by a call to the create function.
+* @param    query                   The device query, e.g. "SELECT * FROM devices WHERE status = 'enabled'",
+*                                   or NULL for all the devices.
+* @param    pageSize                Maximum number of devices per page, between 1 and 1000.
+*
+* @return	A non-NULL @c IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE on success and @c NULL on failure.
+*/
+extern IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE IoTHubRegistryManager_CreateDeviceIterator(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle, const char* query, size_t pageSize);
+
+/**
+* @brief	Requests the next page and hands its devices to callback one at a time. If the request or the
+*           parsing of the page fails the iterator stays on that page, so calling again retries it (and may
+*           deliver again the devices of the page handled before the failure).
+*
+* @param	iteratorHandle  The handle created by IoTHubRegistryManager_CreateDeviceIterator.
+* @param    callback        Invoked for every device of the page.
+* @param    userContext     User context passed to callback.
+* @param    hasMorePages    Set to false once the last page has been delivered.
+*
+* @return	IOTHUB_REGISTRYMANAGER_OK upon success or an error code upon failure.
+*/
+extern IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_GetNextDevicePage(IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE iteratorHandle, IOTHUB_REGISTRYMANAGER_DEVICE_CALLBACK callback, void* userContext, bool* hasMorePages);
+
+/**
+* @brief	Disposes of the iterator and of its connection.
+*
+* @param	iteratorHandle  The handle created by IoTHubRegistryManager_CreateDeviceIterator.
+*/
+extern void IoTHubRegistryManager_DestroyDeviceIterator(IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE iteratorHandle);
+
+/**
+* @brief	Queues the retrieval of the device info of a given device. The request is carried by a persistent
+*           connection of the handle's HTTP pipeline during subsequent IoTHubRegistryManager_DoWork calls.
+*
+* @param	registryManagerHandle   The handle created by a call to the create function.
+* @param	deviceId    The Id of the requested device.
+* @param    callback    Invoked with the device info when the request completes.
+* @param    userContext User context passed to callback.
+*
+* @return	IOTHUB_REGISTRYMANAGER_OK if the request was queued or an error code otherwise.
+*/
+extern IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_GetDeviceAsync(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle, const char* deviceId, IOTHUB_REGISTRYMANAGER_GET_DEVICE_CALLBACK callback, void* userContext);
+
+/**
+* @brief	Queues the deletion of a given device, see IoTHubRegistryManager_GetDeviceAsync.
+*
+* @return	IOTHUB_REGISTRYMANAGER_OK if the request was queued or an error code otherwise.
+*/
+extern IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_DeleteDeviceAsync(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle, const char* deviceId, IOTHUB_REGISTRYMANAGER_RESULT_CALLBACK callback, void* userContext);
+
+/**
+* @brief	Sends the queued asynchronous requests and invokes the callbacks of the completed ones.
+*
+* @param	registryManagerHandle   The handle created by a call to the create function.
+*/
+extern void IoTHubRegistryManager_DoWork(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle);
+
+/**
+* @brief	Sets one of the IOTHUB_HTTP_PIPELINE_OPTION_* options of the asynchronous requests.
+*
+* @return	IOTHUB_REGISTRYMANAGER_OK upon success or an error code upon failure.
+*/
+extern IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_SetOption(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle, const char* optionName, const void* value);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,73 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_sc_connection.h
+*   @brief Connection to the IoT Hub shared by several service clients.
+*
+*   @details A shared connection is created from the service client auth
+*            and opens nothing by itself. The device twin, device method and
+*            registry manager clients created with *_CreateWithConnection
+*            queue their asynchronous requests on a single keep-alive HTTP
+*            pipeline owned by the connection, and a messaging client created
+*            with IoTHubMessaging_LL_CreateWithConnection attaches its links
+*            to an AMQP connection and session owned by the connection. The
+*            AMQP connection is established on first use and outlives the
+*            Close/Open cycles of the messaging client, which then only has to
+*            attach its links again.
+*
+*            The connection must be destroyed after all the clients attached
+*            to it. It is not thread safe; the attached clients and the
+*            connection must be used from the same thread.
+*/
+
+#ifndef IOTHUB_SC_CONNECTION_H
+#define IOTHUB_SC_CONNECTION_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "iothub_service_client_auth.h"
+#include "iothub_sc_http_pipeline.h"
+
+#define IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT_VALUES      \
+    IOTHUB_SERVICE_CLIENT_CONNECTION_OK,                    \
+    IOTHUB_SERVICE_CLIENT_CONNECTION_INVALID_ARG,           \
+    IOTHUB_SERVICE_CLIENT_CONNECTION_ERROR                  \
+
+DEFINE_ENUM(IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT, IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT_VALUES);
+
+typedef struct IOTHUB_SERVICE_CLIENT_CONNECTION_TAG* IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE;
+
+/** @brief  Creates a shared connection for the IoT Hub described by serviceClientHandle. The
+*           authentication information is copied and no connection is opened.
+*
+* @param    serviceClientHandle Service client handle.
+*
+* @return   A non-NULL @c IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE on success and @c NULL on failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, IoTHubServiceClientConnection_Create, IOTHUB_SERVICE_CLIENT_AUTH_HANDLE, serviceClientHandle);
+
+/** @brief  Destroys the HTTP pipeline and closes the AMQP connection. Must be called after the
+*           clients attached to the connection have been destroyed.
+*/
+MOCKABLE_FUNCTION(, void, IoTHubServiceClientConnection_Destroy, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, connectionHandle);
+
+/** @brief  Sets one of the IOTHUB_HTTP_PIPELINE_OPTION_* options of the shared HTTP pipeline. The
+*           TrustedCerts option also applies to the AMQP connection opened after it is set.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT, IoTHubServiceClientConnection_SetOption, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, connectionHandle, const char*, optionName, const void*, value);
+
+/** @brief  Drives the shared HTTP pipeline and the AMQP connection, when they exist. Calling the
+*           DoWork of any attached client does the same.
+*/
+MOCKABLE_FUNCTION(, void, IoTHubServiceClientConnection_DoWork, IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, connectionHandle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_SC_CONNECTION_H
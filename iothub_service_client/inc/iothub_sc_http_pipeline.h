@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_sc_http_pipeline.h
+*   @brief Asynchronous HTTP request pipeline shared by the service client
+*          device twin, device method and registry manager modules.
+*
+*   @details The pipeline keeps up to max_connections persistent (keep-alive)
+*            connections to the IoT Hub and queues any number of requests.
+*            Every connection carries one request at a time; requests are
+*            dispatched, in the order they were queued, to the next idle
+*            connection by IoTHubHttpPipeline_DoWork, which also drives the
+*            connections and invokes the completion callbacks. The SAS token
+*            is cached until it gets close to its expiry and the static
+*            request headers are built once.
+*/
+
+#ifndef IOTHUB_SC_HTTP_PIPELINE_H
+#define IOTHUB_SC_HTTP_PIPELINE_H
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_uhttp_c/uhttp.h"
+
+#define IOTHUB_HTTP_PIPELINE_RESULT_VALUES      \
+    IOTHUB_HTTP_PIPELINE_OK,                    \
+    IOTHUB_HTTP_PIPELINE_INVALID_ARG,           \
+    IOTHUB_HTTP_PIPELINE_ERROR,                 \
+    IOTHUB_HTTP_PIPELINE_CANCELLED              \
+
+DEFINE_ENUM(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_RESULT_VALUES);
+
+#define IOTHUB_HTTP_PIPELINE_DEFAULT_MAX_CONNECTIONS    4
+#define IOTHUB_HTTP_PIPELINE_DEFAULT_PORT               443
+
+/* size_t*, number of persistent connections used to carry requests; can only be set before the first request is queued */
+static const char* const IOTHUB_HTTP_PIPELINE_OPTION_MAX_CONNECTIONS = "max_connections";
+/* int*, port of the service, defaults to 443 */
+static const char* const IOTHUB_HTTP_PIPELINE_OPTION_PORT = "port";
+/* bool*, when false the connections are made without TLS, for a local HTTP stand-in of the service; defaults to true */
+static const char* const IOTHUB_HTTP_PIPELINE_OPTION_USE_TLS = "use_tls";
+/* size_t*, lifetime in seconds of the cached SAS token, defaults to 3600 */
+static const char* const IOTHUB_HTTP_PIPELINE_OPTION_SAS_TOKEN_LIFETIME = "sas_token_lifetime";
+/* const char*, trusted certificates used by the TLS connections */
+static const char* const IOTHUB_HTTP_PIPELINE_OPTION_TRUSTED_CERT = "TrustedCerts";
+
+typedef struct IOTHUB_HTTP_PIPELINE_TAG* IOTHUB_HTTP_PIPELINE_HANDLE;
+
+/** @brief  Completion of a request. content is only valid for the duration of the callback.
+*           result is IOTHUB_HTTP_PIPELINE_OK when a response was received, whatever its status code,
+*           IOTHUB_HTTP_PIPELINE_ERROR when the request could not be carried and
+*           IOTHUB_HTTP_PIPELINE_CANCELLED when the pipeline was destroyed before the request completed.
+*/
+typedef void(*IOTHUB_HTTP_PIPELINE_RESPONSE_CALLBACK)(IOTHUB_HTTP_PIPELINE_RESULT result, unsigned int statusCode, const unsigned char* content, size_t contentLength, void* context);
+
+/** @brief  Creates a pipeline for the given IoT Hub. No connection is opened until a request is queued.
+*
+* @param    hostname        IoT Hub host name.
+* @param    sharedAccessKey Shared access key used to sign the SAS token.
+* @param    keyName         Name of the shared access policy.
+*
+* @return   A non-NULL @c IOTHUB_HTTP_PIPELINE_HANDLE on success and @c NULL on failure.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_HTTP_PIPELINE_HANDLE, IoTHubHttpPipeline_Create, const char*, hostname, const char*, sharedAccessKey, const char*, keyName);
+
+/** @brief  Closes the connections and frees the pipeline. The callbacks of the requests that did not
+*           complete are invoked with IOTHUB_HTTP_PIPELINE_CANCELLED. Must not be called from a callback.
+*/
+MOCKABLE_FUNCTION(, void, IoTHubHttpPipeline_Destroy, IOTHUB_HTTP_PIPELINE_HANDLE, handle);
+
+/** @brief  Sets one of the IOTHUB_HTTP_PIPELINE_OPTION_* options.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_HTTP_PIPELINE_RESULT, IoTHubHttpPipeline_SetOption, IOTHUB_HTTP_PIPELINE_HANDLE, handle, const char*, optionName, const void*, value);
+
+/** @brief  Queues a request. The relative path and the content are copied. The request is sent by a
+*           subsequent call to IoTHubHttpPipeline_DoWork and completes through callback.
+*
+* @param    handle          The pipeline handle.
+* @param    requestType     HTTP verb.
+* @param    relativePath    Path and query of the request.
+* @param    ifMatch         Value of the If-Match header, or NULL to omit the header.
+* @param    content         Request body, may be NULL.
+* @param    contentLength   Length of the request body.
+* @param    callback        Invoked when the request completes.
+* @param    context         User context passed to callback.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_HTTP_PIPELINE_RESULT, IoTHubHttpPipeline_ExecuteRequest, IOTHUB_HTTP_PIPELINE_HANDLE, handle, HTTP_CLIENT_REQUEST_TYPE, requestType, const char*, relativePath, const char*, ifMatch, const unsigned char*, content, size_t, contentLength, IOTHUB_HTTP_PIPELINE_RESPONSE_CALLBACK, callback, void*, context);
+
+/** @brief  Opens connections as needed, sends queued requests on idle connections, drives the
+*           connections and invokes the completion callbacks.
+*/
+MOCKABLE_FUNCTION(, void, IoTHubHttpPipeline_DoWork, IOTHUB_HTTP_PIPELINE_HANDLE, handle);
+
+/** @brief  Returns the number of requests that have been queued and have not completed yet.
+*/
+MOCKABLE_FUNCTION(, size_t, IoTHubHttpPipeline_GetPendingCount, IOTHUB_HTTP_PIPELINE_HANDLE, handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_SC_HTTP_PIPELINE_H
@@ -0,0 +1,405 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "iothub_devicefanout.h"
+#include "iothub_sc_http_pipeline.h"
+
+typedef struct FANOUT_DEVICE_TAG
+{
+    DLIST_ENTRY entry;
+    struct IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_TAG* fanout;
+    char* deviceId;
+} FANOUT_DEVICE;
+
+typedef struct IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_TAG
+{
+    IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE twinHandle;
+    IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE methodHandle;
+    char* deviceTwinJson;
+    char* methodName;
+    char* methodPayload;
+    unsigned int timeout;
+    IOTHUB_DEVICE_FANOUT_TWIN_CALLBACK twinCallback;
+    IOTHUB_DEVICE_FANOUT_METHOD_CALLBACK methodCallback;
+    void* userContext;
+
+    DLIST_ENTRY waitingDevices;
+    size_t waitingCount;
+    size_t inFlightCount;
+    size_t maxConcurrent;
+    size_t maxQueued;
+    bool started;
+    bool maxConnectionsSet;
+} IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT;
+
+static IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT* create_fanout(void* userContext)
+{
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT* result = malloc(sizeof(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT));
+    if (result == NULL)
+    {
+        LogError("Malloc failed for IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT");
+    }
+    else
+    {
+        memset(result, 0, sizeof(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT));
+        result->userContext = userContext;
+        result->maxConcurrent = IOTHUB_DEVICE_FANOUT_DEFAULT_MAX_CONCURRENT;
+        result->maxQueued = IOTHUB_DEVICE_FANOUT_DEFAULT_MAX_QUEUED;
+        DList_InitializeListHead(&result->waitingDevices);
+    }
+    return result;
+}
+
+static void free_fanout(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT* fanout)
+{
+    free(fanout->deviceTwinJson);
+    free(fanout->methodName);
+    free(fanout->methodPayload);
+    free(fanout);
+}
+
+static void free_device(FANOUT_DEVICE* device)
+{
+    free(device->deviceId);
+    free(device);
+}
+
+static void on_twin_complete(IOTHUB_DEVICE_TWIN_RESULT result, const char* deviceTwinJson, void* userContext)
+{
+    FANOUT_DEVICE* device = (FANOUT_DEVICE*)userContext;
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT* fanout = device->fanout;
+
+    /*Codes_SRS_IOTHUBDEVICEFANOUT_38_015: [ When the update of a device completes, its slot shall be released and the twin callback shall be invoked with the device id and the result and json of IoTHubDeviceTwin_UpdateTwinAsync. ]*/
+    fanout->inFlightCount--;
+    fanout->twinCallback(device->deviceId, result, deviceTwinJson, fanout->userContext);
+    free_device(device);
+}
+
+static void on_method_complete(IOTHUB_DEVICE_METHOD_RESULT result, int responseStatus, const unsigned char* responsePayload, size_t responsePayloadSize, void* userContext)
+{
+    FANOUT_DEVICE* device = (FANOUT_DEVICE*)userContext;
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT* fanout = device->fanout;
+
+    /*Codes_SRS_IOTHUBDEVICEFANOUT_38_016: [ When the invocation on a device completes, its slot shall be released and the method callback shall be invoked with the device id and the result, status and payload of IoTHubDeviceMethod_InvokeAsync. ]*/
+    fanout->inFlightCount--;
+    fanout->methodCallback(device->deviceId, result, responseStatus, responsePayload, responsePayloadSize, fanout->userContext);
+    free_device(device);
+}
+
+static void start_device(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT* fanout, FANOUT_DEVICE* device)
+{
+    if (fanout->twinHandle != NULL)
+    {
+        IOTHUB_DEVICE_TWIN_RESULT result = IoTHubDeviceTwin_UpdateTwinAsync(fanout->twinHandle, device->deviceId, fanout->deviceTwinJson, on_twin_complete, device);
+        if (result != IOTHUB_DEVICE_TWIN_OK)
+        {
+            /*Codes_SRS_IOTHUBDEVICEFANOUT_38_014: [ If the request of a device cannot be queued, the callback shall be invoked right away with the device id and the error returned. ]*/
+            LogError("Failure queuing the twin update of %s", device->deviceId);
+            fanout->twinCallback(device->deviceId, result, NULL, fanout->userContext);
+            free_device(device);
+        }
+        else
+        {
+            fanout->inFlightCount++;
+        }
+    }
+    else
+    {
+        IOTHUB_DEVICE_METHOD_RESULT result = IoTHubDeviceMethod_InvokeAsync(fanout->methodHandle, device->deviceId, fanout->methodName, fanout->methodPayload, fanout->timeout, on_method_complete, device);
+        if (result != IOTHUB_DEVICE_METHOD_OK)
+        {
+            LogError("Failure queuing the method invocation on %s", device->deviceId);
+            fanout->methodCallback(device->deviceId, result, 0, NULL, 0, fanout->userContext);
+            free_device(device);
+        }
+        else
+        {
+            fanout->inFlightCount++;
+        }
+    }
+}
+
+static IOTHUB_DEVICE_FANOUT_RESULT set_operation_option(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT* fanout, const char* optionName, const void* value)
+{
+    IOTHUB_DEVICE_FANOUT_RESULT result;
+    if (fanout->twinHandle != NULL)
+    {
+        IOTHUB_DEVICE_TWIN_RESULT twinResult = IoTHubDeviceTwin_SetOption(fanout->twinHandle, optionName, value);
+        result = (twinResult == IOTHUB_DEVICE_TWIN_OK) ? IOTHUB_DEVICE_FANOUT_OK : ((twinResult == IOTHUB_DEVICE_TWIN_INVALID_ARG) ? IOTHUB_DEVICE_FANOUT_INVALID_ARG : IOTHUB_DEVICE_FANOUT_ERROR);
+    }
+    else
+    {
+        IOTHUB_DEVICE_METHOD_RESULT methodResult = IoTHubDeviceMethod_SetOption(fanout->methodHandle, optionName, value);
+        result = (methodResult == IOTHUB_DEVICE_METHOD_OK) ? IOTHUB_DEVICE_FANOUT_OK : ((methodResult == IOTHUB_DEVICE_METHOD_INVALID_ARG) ? IOTHUB_DEVICE_FANOUT_INVALID_ARG : IOTHUB_DEVICE_FANOUT_ERROR);
+    }
+    return result;
+}
+
+IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE IoTHubDeviceFanout_CreateTwinUpdate(IOTHUB_SERVICE_CLIENT_AUTH_HANDLE serviceClientHandle, const char* deviceTwinJson, IOTHUB_DEVICE_FANOUT_TWIN_CALLBACK callback, void* userContext)
+{
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT* result;
+
+    /*Codes_SRS_IOTHUBDEVICEFANOUT_38_001: [ If serviceClientHandle, deviceTwinJson or callback is NULL, IoTHubDeviceFanout_CreateTwinUpdate shall return NULL. ]*/
+    if (serviceClientHandle == NULL || deviceTwinJson == NULL || callback == NULL)
+    {
+        LogError("Invalid parameter serviceClientHandle: %p, deviceTwinJson: %p, callback: %p", serviceClientHandle, deviceTwinJson, callback);
+        result = NULL;
+    }
+    else if ((result = create_fanout(userContext)) == NULL)
+    {
+        LogError("Failure creating the fan-out");
+    }
+    /*Codes_SRS_IOTHUBDEVICEFANOUT_38_002: [ IoTHubDeviceFanout_CreateTwinUpdate shall copy deviceTwinJson and create the IoTHubDeviceTwin handle that carries the updates. ]*/
+    else if (mallocAndStrcpy_s(&result->deviceTwinJson, deviceTwinJson) != 0)
+    {
+        /*Codes_SRS_IOTHUBDEVICEFANOUT_38_003: [ If any allocation fails, IoTHubDeviceFanout_CreateTwinUpdate and IoTHubDeviceFanout_CreateMethodInvoke shall clean up and return NULL. ]*/
+        LogError("mallocAndStrcpy_s failed for deviceTwinJson");
+        free_fanout(result);
+        result = NULL;
+    }
+    else if ((result->twinHandle = IoTHubDeviceTwin_Create(serviceClientHandle)) == NULL)
+    {
+        LogError("Failure creating the device twin handle");
+        free_fanout(result);
+        result = NULL;
+    }
+    else
+    {
+        result->twinCallback = callback;
+    }
+    return result;
+}
+
+IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE IoTHubDeviceFanout_CreateMethodInvoke(IOTHUB_SERVICE_CLIENT_AUTH_HANDLE serviceClientHandle, const char* methodName, const char* methodPayload, unsigned int timeout, IOTHUB_DEVICE_FANOUT_METHOD_CALLBACK callback, void* userContext)
+{
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT* result;
+
+    /*Codes_SRS_IOTHUBDEVICEFANOUT_38_004: [ If serviceClientHandle, methodName, methodPayload or callback is NULL, IoTHubDeviceFanout_CreateMethodInvoke shall return NULL. ]*/
+    if (serviceClientHandle == NULL || methodName == NULL || methodPayload == NULL || callback == NULL)
+    {
+        LogError("Invalid parameter serviceClientHandle: %p, methodName: %p, methodPayload: %p, callback: %p", serviceClientHandle, methodName, methodPayload, callback);
+        result = NULL;
+    }
+    else if ((result = create_fanout(userContext)) == NULL)
+    {
+        LogError("Failure creating the fan-out");
+    }
+    /*Codes_SRS_IOTHUBDEVICEFANOUT_38_005: [ IoTHubDeviceFanout_CreateMethodInvoke shall copy methodName and methodPayload and create the IoTHubDeviceMethod handle that carries the invocations. ]*/
+    else if (mallocAndStrcpy_s(&result->methodName, methodName) != 0)
+    {
+        LogError("mallocAndStrcpy_s failed for methodName");
+        free_fanout(result);
+        result = NULL;
+    }
+    else if (mallocAndStrcpy_s(&result->methodPayload, methodPayload) != 0)
+    {
+        LogError("mallocAndStrcpy_s failed for methodPayload");
+        free_fanout(result);
+        result = NULL;
+    }
+    else if ((result->methodHandle = IoTHubDeviceMethod_Create(serviceClientHandle)) == NULL)
+    {
+        LogError("Failure creating the device method handle");
+        free_fanout(result);
+        result = NULL;
+    }
+    else
+    {
+        result->timeout = timeout;
+        result->methodCallback = callback;
+    }
+    return result;
+}
+
+void IoTHubDeviceFanout_Destroy(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE fanoutHandle)
+{
+    if (fanoutHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBDEVICEFANOUT_38_006: [ IoTHubDeviceFanout_Destroy shall destroy the IoTHubDeviceTwin or IoTHubDeviceMethod handle, which completes the devices in flight with an HTTPAPI_ERROR result. ]*/
+        if (fanoutHandle->twinHandle != NULL)
+        {
+            IoTHubDeviceTwin_Destroy(fanoutHandle->twinHandle);
+        }
+        else
+        {
+            IoTHubDeviceMethod_Destroy(fanoutHandle->methodHandle);
+        }
+
+        /*Codes_SRS_IOTHUBDEVICEFANOUT_38_007: [ IoTHubDeviceFanout_Destroy shall invoke the callback of every queued device with IOTHUB_DEVICE_TWIN_ERROR or IOTHUB_DEVICE_METHOD_ERROR and free the fan-out. ]*/
+        while (!DList_IsListEmpty(&fanoutHandle->waitingDevices))
+        {
+            FANOUT_DEVICE* device = containingRecord(DList_RemoveHeadList(&fanoutHandle->waitingDevices), FANOUT_DEVICE, entry);
+            if (fanoutHandle->twinCallback != NULL)
+            {
+                fanoutHandle->twinCallback(device->deviceId, IOTHUB_DEVICE_TWIN_ERROR, NULL, fanoutHandle->userContext);
+            }
+            else
+            {
+                fanoutHandle->methodCallback(device->deviceId, IOTHUB_DEVICE_METHOD_ERROR, 0, NULL, 0, fanoutHandle->userContext);
+            }
+            free_device(device);
+        }
+        free_fanout(fanoutHandle);
+    }
+}
+
+IOTHUB_DEVICE_FANOUT_RESULT IoTHubDeviceFanout_AddDevices(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE fanoutHandle, const char* const* deviceIds, size_t deviceCount, size_t* devicesAdded)
+{
+    IOTHUB_DEVICE_FANOUT_RESULT result;
+
+    /*Codes_SRS_IOTHUBDEVICEFANOUT_38_008: [ If fanoutHandle, deviceIds or devicesAdded is NULL, IoTHubDeviceFanout_AddDevices shall return IOTHUB_DEVICE_FANOUT_INVALID_ARG. ]*/
+    if (fanoutHandle == NULL || deviceIds == NULL || devicesAdded == NULL)
+    {
+        LogError("Invalid parameter fanoutHandle: %p, deviceIds: %p, devicesAdded: %p", fanoutHandle, deviceIds, devicesAdded);
+        result = IOTHUB_DEVICE_FANOUT_INVALID_ARG;
+    }
+    else
+    {
+        size_t index;
+
+        result = IOTHUB_DEVICE_FANOUT_OK;
+        for (index = 0; index < deviceCount; index++)
+        {
+            FANOUT_DEVICE* device;
+
+            if (deviceIds[index] == NULL)
+            {
+                /*Codes_SRS_IOTHUBDEVICEFANOUT_38_009: [ If a device id is NULL, IoTHubDeviceFanout_AddDevices shall stop at it and return IOTHUB_DEVICE_FANOUT_INVALID_ARG. ]*/
+                LogError("Device id at index %lu is NULL", (unsigned long)index);
+                result = IOTHUB_DEVICE_FANOUT_INVALID_ARG;
+                break;
+            }
+            else if (fanoutHandle->waitingCount >= fanoutHandle->maxQueued)
+            {
+                /*Codes_SRS_IOTHUBDEVICEFANOUT_38_010: [ Once max_queued_devices devices are queued, IoTHubDeviceFanout_AddDevices shall stop and return IOTHUB_DEVICE_FANOUT_BUSY. ]*/
+                result = IOTHUB_DEVICE_FANOUT_BUSY;
+                break;
+            }
+            else if ((device = malloc(sizeof(FANOUT_DEVICE))) == NULL)
+            {
+                LogError("Malloc failed for FANOUT_DEVICE");
+                result = IOTHUB_DEVICE_FANOUT_ERROR;
+                break;
+            }
+            else if (mallocAndStrcpy_s(&device->deviceId, deviceIds[index]) != 0)
+            {
+                LogError("mallocAndStrcpy_s failed for deviceId");
+                free(device);
+                result = IOTHUB_DEVICE_FANOUT_ERROR;
+                break;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBDEVICEFANOUT_38_011: [ IoTHubDeviceFanout_AddDevices shall copy every device id to the tail of the queue and set devicesAdded to the number of devices queued. ]*/
+                device->fanout = fanoutHandle;
+                DList_InsertTailList(&fanoutHandle->waitingDevices, &device->entry);
+                fanoutHandle->waitingCount++;
+            }
+        }
+        *devicesAdded = index;
+    }
+    return result;
+}
+
+void IoTHubDeviceFanout_DoWork(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE fanoutHandle)
+{
+    /*Codes_SRS_IOTHUBDEVICEFANOUT_38_012: [ If fanoutHandle is NULL, IoTHubDeviceFanout_DoWork shall do nothing. ]*/
+    if (fanoutHandle != NULL)
+    {
+        if (!fanoutHandle->started && !DList_IsListEmpty(&fanoutHandle->waitingDevices))
+        {
+            /*Codes_SRS_IOTHUBDEVICEFANOUT_38_013: [ Before starting the first device, IoTHubDeviceFanout_DoWork shall set the max_connections option of the underlying handle to max_concurrent_operations, unless max_connections was set through IoTHubDeviceFanout_SetOption. ]*/
+            if (!fanoutHandle->maxConnectionsSet &&
+                set_operation_option(fanoutHandle, IOTHUB_HTTP_PIPELINE_OPTION_MAX_CONNECTIONS, &fanoutHandle->maxConcurrent) != IOTHUB_DEVICE_FANOUT_OK)
+            {
+                LogError("Failure setting max_connections, the operations will share fewer connections");
+            }
+            fanoutHandle->started = true;
+        }
+
+        /*Codes_SRS_IOTHUBDEVICEFANOUT_38_017: [ IoTHubDeviceFanout_DoWork shall start the queued devices in order while fewer than max_concurrent_operations are in flight. ]*/
+        while (fanoutHandle->inFlightCount < fanoutHandle->maxConcurrent && !DList_IsListEmpty(&fanoutHandle->waitingDevices))
+        {
+            FANOUT_DEVICE* device = containingRecord(DList_RemoveHeadList(&fanoutHandle->waitingDevices), FANOUT_DEVICE, entry);
+            fanoutHandle->waitingCount--;
+            start_device(fanoutHandle, device);
+        }
+
+        /*Codes_SRS_IOTHUBDEVICEFANOUT_38_018: [ IoTHubDeviceFanout_DoWork shall call IoTHubDeviceTwin_DoWork or IoTHubDeviceMethod_DoWork. ]*/
+        if (fanoutHandle->twinHandle != NULL)
+        {
+            IoTHubDeviceTwin_DoWork(fanoutHandle->twinHandle);
+        }
+        else
+        {
+            IoTHubDeviceMethod_DoWork(fanoutHandle->methodHandle);
+        }
+    }
+}
+
+size_t IoTHubDeviceFanout_GetPendingCount(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE fanoutHandle)
+{
+    /*Codes_SRS_IOTHUBDEVICEFANOUT_38_019: [ IoTHubDeviceFanout_GetPendingCount shall return the number of queued and in flight devices, or 0 if fanoutHandle is NULL. ]*/
+    return (fanoutHandle == NULL) ? 0 : fanoutHandle->waitingCount + fanoutHandle->inFlightCount;
+}
+
+IOTHUB_DEVICE_FANOUT_RESULT IoTHubDeviceFanout_SetOption(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE fanoutHandle, const char* optionName, const void* value)
+{
+    IOTHUB_DEVICE_FANOUT_RESULT result;
+
+    /*Codes_SRS_IOTHUBDEVICEFANOUT_38_020: [ If any parameter is NULL, IoTHubDeviceFanout_SetOption shall return IOTHUB_DEVICE_FANOUT_INVALID_ARG. ]*/
+    if (fanoutHandle == NULL || optionName == NULL || value == NULL)
+    {
+        LogError("Invalid parameter fanoutHandle: %p, optionName: %p, value: %p", fanoutHandle, optionName, value);
+        result = IOTHUB_DEVICE_FANOUT_INVALID_ARG;
+    }
+    else if (strcmp(optionName, IOTHUB_DEVICE_FANOUT_OPTION_MAX_CONCURRENT) == 0)
+    {
+        /*Codes_SRS_IOTHUBDEVICEFANOUT_38_021: [ max_concurrent_operations shall be rejected with IOTHUB_DEVICE_FANOUT_ERROR if it is 0 or once the first device has been started. ]*/
+        size_t maxConcurrent = *(const size_t*)value;
+        if (maxConcurrent == 0 || fanoutHandle->started)
+        {
+            LogError("max_concurrent_operations cannot be 0 or changed after the first device started");
+            result = IOTHUB_DEVICE_FANOUT_ERROR;
+        }
+        else
+        {
+            fanoutHandle->maxConcurrent = maxConcurrent;
+            result = IOTHUB_DEVICE_FANOUT_OK;
+        }
+    }
+    else if (strcmp(optionName, IOTHUB_DEVICE_FANOUT_OPTION_MAX_QUEUED) == 0)
+    {
+        /*Codes_SRS_IOTHUBDEVICEFANOUT_38_022: [ max_queued_devices shall be rejected with IOTHUB_DEVICE_FANOUT_ERROR if it is 0. ]*/
+        size_t maxQueued = *(const size_t*)value;
+        if (maxQueued == 0)
+        {
+            LogError("max_queued_devices cannot be 0");
+            result = IOTHUB_DEVICE_FANOUT_ERROR;
+        }
+        else
+        {
+            fanoutHandle->maxQueued = maxQueued;
+            result = IOTHUB_DEVICE_FANOUT_OK;
+        }
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBDEVICEFANOUT_38_023: [ Any other option shall be passed to IoTHubDeviceTwin_SetOption or IoTHubDeviceMethod_SetOption and its result mapped. ]*/
+        result = set_operation_option(fanoutHandle, optionName, value);
+        if (result == IOTHUB_DEVICE_FANOUT_OK && strcmp(optionName, IOTHUB_HTTP_PIPELINE_OPTION_MAX_CONNECTIONS) == 0)
+        {
+            fanoutHandle->maxConnectionsSet = true;
+        }
+    }
+    return result;
+}
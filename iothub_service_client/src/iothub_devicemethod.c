@@ -17,6 +17,8 @@
 
 #include "parson.h"
 #include "iothub_devicemethod.h"
+#include "iothub_sc_http_pipeline.h"
+#include "internal/iothub_sc_connection_private.h"
 #include "iothub_sc_version.h"
 
 DEFINE_ENUM_STRINGS(IOTHUB_DEVICE_METHOD_RESULT, IOTHUB_DEVICE_METHOD_RESULT_VALUES);
@@ -49,8 +51,16 @@ typedef struct IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_TAG
     char* hostname;
     char* sharedAccessKey;
     char* keyName;
+    IOTHUB_HTTP_PIPELINE_HANDLE httpPipeline;
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connection;
 } IOTHUB_SERVICE_CLIENT_DEVICE_METHOD;
 
+typedef struct DEVICE_METHOD_ASYNC_CONTEXT_TAG
+{
+    IOTHUB_DEVICE_METHOD_ASYNC_CALLBACK callback;
+    void* userContext;
+} DEVICE_METHOD_ASYNC_CONTEXT;
+
 static IOTHUB_DEVICE_METHOD_RESULT parseResponseJson(BUFFER_HANDLE responseJson, int* responseStatus, unsigned char** responsePayload, size_t* responsePayloadSize)
 {
     IOTHUB_DEVICE_METHOD_RESULT result;
@@ -428,12 +438,39 @@ IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE IoTHubDeviceMethod_Create(IOTHUB_SERV
                     free(result);
                     result = NULL;
                 }
+                else
+                {
+                    result->httpPipeline = NULL;
+                    result->connection = NULL;
+                }
             }
         }
     }
     return result;
 }
 
+IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE IoTHubDeviceMethod_CreateWithConnection(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle)
+{
+    IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE result;
+
+    /*Codes_SRS_IOTHUBDEVICEMETHOD_41_001: [ If connectionHandle is NULL IoTHubDeviceMethod_CreateWithConnection shall return NULL. ]*/
+    if (connectionHandle == NULL)
+    {
+        LogError("connectionHandle input parameter cannot be NULL");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBDEVICEMETHOD_41_002: [ IoTHubDeviceMethod_CreateWithConnection shall create the client like IoTHubDeviceMethod_Create from the authentication information of the connection and remember the connection. ]*/
+    else if ((result = IoTHubDeviceMethod_Create(IoTHubServiceClientConnection_GetAuth(connectionHandle))) == NULL)
+    {
+        LogError("IoTHubDeviceMethod_Create failed");
+    }
+    else
+    {
+        result->connection = connectionHandle;
+    }
+    return result;
+}
+
 void IoTHubDeviceMethod_Destroy(IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE serviceClientDeviceMethodHandle)
 {
     /*Codes_SRS_IOTHUBDEVICEMETHOD_12_016: [ If the serviceClientDeviceMethodHandle input parameter is NULL IoTHubDeviceMethod_Destroy shall return ]*/
@@ -442,6 +479,12 @@ void IoTHubDeviceMethod_Destroy(IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE servi
         /*Codes_SRS_IOTHUBDEVICEMETHOD_12_017: [ If the serviceClientDeviceMethodHandle input parameter is not NULL IoTHubDeviceMethod_Destroy shall free the memory of it and return ]*/
         IOTHUB_SERVICE_CLIENT_DEVICE_METHOD* serviceClientDeviceMethod = (IOTHUB_SERVICE_CLIENT_DEVICE_METHOD*)serviceClientDeviceMethodHandle;
 
+        /*Codes_SRS_IOTHUBDEVICEMETHOD_37_005: [ IoTHubDeviceMethod_Destroy shall destroy the HTTP pipeline, completing the pending asynchronous invocations with IOTHUB_DEVICE_METHOD_HTTPAPI_ERROR. ]*/
+        /*Codes_SRS_IOTHUBDEVICEMETHOD_41_005: [ IoTHubDeviceMethod_Destroy shall not destroy the HTTP pipeline of a shared connection. ]*/
+        if (serviceClientDeviceMethod->httpPipeline != NULL)
+        {
+            IoTHubHttpPipeline_Destroy(serviceClientDeviceMethod->httpPipeline);
+        }
         free(serviceClientDeviceMethod->hostname);
         free(serviceClientDeviceMethod->sharedAccessKey);
         free(serviceClientDeviceMethod->keyName);
@@ -514,3 +557,166 @@ IOTHUB_DEVICE_METHOD_RESULT  IoTHubDeviceMethod_Invoke(IOTHUB_SERVICE_CLIENT_DEV
     }
     return result;
 }
+
+static void on_method_response(IOTHUB_HTTP_PIPELINE_RESULT pipelineResult, unsigned int statusCode, const unsigned char* content, size_t contentLength, void* context)
+{
+    DEVICE_METHOD_ASYNC_CONTEXT* asyncContext = (DEVICE_METHOD_ASYNC_CONTEXT*)context;
+    BUFFER_HANDLE responseBuffer;
+    int responseStatus;
+    unsigned char* responsePayload;
+    size_t responsePayloadSize;
+
+    if (pipelineResult != IOTHUB_HTTP_PIPELINE_OK)
+    {
+        /*Codes_SRS_IOTHUBDEVICEMETHOD_37_003: [ If the request could not be carried the callback shall be invoked with IOTHUB_DEVICE_METHOD_HTTPAPI_ERROR, if the status code is not 200 or the response cannot be parsed it shall be invoked with IOTHUB_DEVICE_METHOD_ERROR. ]*/
+        LogError("Device method request failed %s", ENUM_TO_STRING(IOTHUB_HTTP_PIPELINE_RESULT, pipelineResult));
+        asyncContext->callback(IOTHUB_DEVICE_METHOD_HTTPAPI_ERROR, 0, NULL, 0, asyncContext->userContext);
+    }
+    else if (statusCode != 200)
+    {
+        LogError("Http Failure status code %d.", statusCode);
+        asyncContext->callback(IOTHUB_DEVICE_METHOD_ERROR, 0, NULL, 0, asyncContext->userContext);
+    }
+    else if ((responseBuffer = BUFFER_create(content, contentLength)) == NULL)
+    {
+        LogError("BUFFER_create failed for responseBuffer");
+        asyncContext->callback(IOTHUB_DEVICE_METHOD_ERROR, 0, NULL, 0, asyncContext->userContext);
+    }
+    else
+    {
+        if (parseResponseJson(responseBuffer, &responseStatus, &responsePayload, &responsePayloadSize) != IOTHUB_DEVICE_METHOD_OK)
+        {
+            LogError("Failure parsing response");
+            asyncContext->callback(IOTHUB_DEVICE_METHOD_ERROR, 0, NULL, 0, asyncContext->userContext);
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBDEVICEMETHOD_37_004: [ Otherwise the callback shall be invoked with IOTHUB_DEVICE_METHOD_OK, the status and the payload returned by the device, the payload being only valid for the duration of the callback. ]*/
+            asyncContext->callback(IOTHUB_DEVICE_METHOD_OK, responseStatus, responsePayload, responsePayloadSize, asyncContext->userContext);
+            free(responsePayload);
+        }
+        BUFFER_delete(responseBuffer);
+    }
+    free(asyncContext);
+}
+
+static IOTHUB_HTTP_PIPELINE_HANDLE getHttpPipeline(IOTHUB_SERVICE_CLIENT_DEVICE_METHOD* serviceClientDeviceMethod)
+{
+    IOTHUB_HTTP_PIPELINE_HANDLE result;
+
+    if (serviceClientDeviceMethod->connection != NULL)
+    {
+        /*Codes_SRS_IOTHUBDEVICEMETHOD_41_003: [ A client created with IoTHubDeviceMethod_CreateWithConnection shall queue its asynchronous invocations on the HTTP pipeline of the connection. ]*/
+        result = IoTHubServiceClientConnection_GetHttpPipeline(serviceClientDeviceMethod->connection);
+    }
+    else
+    {
+        if (serviceClientDeviceMethod->httpPipeline == NULL)
+        {
+            serviceClientDeviceMethod->httpPipeline = IoTHubHttpPipeline_Create(serviceClientDeviceMethod->hostname, serviceClientDeviceMethod->sharedAccessKey, serviceClientDeviceMethod->keyName);
+        }
+        result = serviceClientDeviceMethod->httpPipeline;
+    }
+    return result;
+}
+
+IOTHUB_DEVICE_METHOD_RESULT IoTHubDeviceMethod_InvokeAsync(IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE serviceClientDeviceMethodHandle, const char* deviceId, const char* methodName, const char* methodPayload, unsigned int timeout, IOTHUB_DEVICE_METHOD_ASYNC_CALLBACK callback, void* userContext)
+{
+    IOTHUB_DEVICE_METHOD_RESULT result;
+
+    /*Codes_SRS_IOTHUBDEVICEMETHOD_37_001: [ If any pointer parameter is NULL, IoTHubDeviceMethod_InvokeAsync shall return IOTHUB_DEVICE_METHOD_INVALID_ARG. ]*/
+    if ((serviceClientDeviceMethodHandle == NULL) || (deviceId == NULL) || (methodName == NULL) || (methodPayload == NULL) || (callback == NULL))
+    {
+        LogError("Input parameter cannot be NULL");
+        result = IOTHUB_DEVICE_METHOD_INVALID_ARG;
+    }
+    else
+    {
+        BUFFER_HANDLE httpPayloadBuffer;
+        STRING_HANDLE relativePath;
+        DEVICE_METHOD_ASYNC_CONTEXT* asyncContext;
+        IOTHUB_HTTP_PIPELINE_HANDLE httpPipeline;
+
+        if ((httpPipeline = getHttpPipeline(serviceClientDeviceMethodHandle)) == NULL)
+        {
+            /*Codes_SRS_IOTHUBDEVICEMETHOD_37_002: [ IoTHubDeviceMethod_InvokeAsync shall queue an HTTP POST request on the client's HTTP pipeline, creating the pipeline on first use, and return IOTHUB_DEVICE_METHOD_ERROR if that fails. ]*/
+            LogError("Failure creating the HTTP pipeline");
+            result = IOTHUB_DEVICE_METHOD_ERROR;
+        }
+        else if ((httpPayloadBuffer = createMethodPayloadJson(methodName, timeout, methodPayload)) == NULL)
+        {
+            LogError("BUFFER creation failed for httpPayloadBuffer");
+            result = IOTHUB_DEVICE_METHOD_ERROR;
+        }
+        else if ((relativePath = createRelativePath(IOTHUB_DEVICEMETHOD_REQUEST_INVOKE, deviceId)) == NULL)
+        {
+            LogError("Failure creating relative path");
+            BUFFER_delete(httpPayloadBuffer);
+            result = IOTHUB_DEVICE_METHOD_ERROR;
+        }
+        else if ((asyncContext = malloc(sizeof(DEVICE_METHOD_ASYNC_CONTEXT))) == NULL)
+        {
+            LogError("Malloc failed for DEVICE_METHOD_ASYNC_CONTEXT");
+            STRING_delete(relativePath);
+            BUFFER_delete(httpPayloadBuffer);
+            result = IOTHUB_DEVICE_METHOD_ERROR;
+        }
+        else
+        {
+            asyncContext->callback = callback;
+            asyncContext->userContext = userContext;
+            if (IoTHubHttpPipeline_ExecuteRequest(httpPipeline, HTTP_CLIENT_REQUEST_POST, STRING_c_str(relativePath), NULL, BUFFER_u_char(httpPayloadBuffer), BUFFER_length(httpPayloadBuffer), on_method_response, asyncContext) != IOTHUB_HTTP_PIPELINE_OK)
+            {
+                LogError("IoTHubHttpPipeline_ExecuteRequest failed");
+                free(asyncContext);
+                result = IOTHUB_DEVICE_METHOD_ERROR;
+            }
+            else
+            {
+                result = IOTHUB_DEVICE_METHOD_OK;
+            }
+            STRING_delete(relativePath);
+            BUFFER_delete(httpPayloadBuffer);
+        }
+    }
+    return result;
+}
+
+void IoTHubDeviceMethod_DoWork(IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE serviceClientDeviceMethodHandle)
+{
+    /*Codes_SRS_IOTHUBDEVICEMETHOD_37_006: [ IoTHubDeviceMethod_DoWork shall call IoTHubHttpPipeline_DoWork when the pipeline exists and do nothing otherwise. ]*/
+    if ((serviceClientDeviceMethodHandle != NULL) && (serviceClientDeviceMethodHandle->httpPipeline != NULL))
+    {
+        IoTHubHttpPipeline_DoWork(serviceClientDeviceMethodHandle->httpPipeline);
+    }
+    /*Codes_SRS_IOTHUBDEVICEMETHOD_41_004: [ IoTHubDeviceMethod_DoWork shall call IoTHubServiceClientConnection_DoWork when the client was created with a connection. ]*/
+    else if ((serviceClientDeviceMethodHandle != NULL) && (serviceClientDeviceMethodHandle->connection != NULL))
+    {
+        IoTHubServiceClientConnection_DoWork(serviceClientDeviceMethodHandle->connection);
+    }
+}
+
+IOTHUB_DEVICE_METHOD_RESULT IoTHubDeviceMethod_SetOption(IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE serviceClientDeviceMethodHandle, const char* optionName, const void* value)
+{
+    IOTHUB_DEVICE_METHOD_RESULT result;
+    IOTHUB_HTTP_PIPELINE_HANDLE httpPipeline;
+
+    /*Codes_SRS_IOTHUBDEVICEMETHOD_37_007: [ If any parameter is NULL, IoTHubDeviceMethod_SetOption shall return IOTHUB_DEVICE_METHOD_INVALID_ARG. ]*/
+    if ((serviceClientDeviceMethodHandle == NULL) || (optionName == NULL) || (value == NULL))
+    {
+        LogError("Input parameter cannot be NULL");
+        result = IOTHUB_DEVICE_METHOD_INVALID_ARG;
+    }
+    else if ((httpPipeline = getHttpPipeline(serviceClientDeviceMethodHandle)) == NULL)
+    {
+        LogError("Failure creating the HTTP pipeline");
+        result = IOTHUB_DEVICE_METHOD_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBDEVICEMETHOD_37_008: [ IoTHubDeviceMethod_SetOption shall pass the option to IoTHubHttpPipeline_SetOption and map its result. ]*/
+        IOTHUB_HTTP_PIPELINE_RESULT pipelineResult = IoTHubHttpPipeline_SetOption(httpPipeline, optionName, value);
+        result = (pipelineResult == IOTHUB_HTTP_PIPELINE_OK) ? IOTHUB_DEVICE_METHOD_OK : ((pipelineResult == IOTHUB_HTTP_PIPELINE_INVALID_ARG) ? IOTHUB_DEVICE_METHOD_INVALID_ARG : IOTHUB_DEVICE_METHOD_ERROR);
+    }
+    return result;
+}
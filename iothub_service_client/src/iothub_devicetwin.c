@@ -18,6 +18,8 @@
 
 #include "parson.h"
 #include "iothub_devicetwin.h"
+#include "iothub_sc_http_pipeline.h"
+#include "internal/iothub_sc_connection_private.h"
 #include "iothub_sc_version.h"
 
 #define IOTHUB_TWIN_REQUEST_MODE_VALUES    \
@@ -55,8 +57,16 @@ typedef struct IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_TAG
     char* hostname;
     char* sharedAccessKey;
     char* keyName;
+    IOTHUB_HTTP_PIPELINE_HANDLE httpPipeline;
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connection;
 } IOTHUB_SERVICE_CLIENT_DEVICE_TWIN;
 
+typedef struct DEVICE_TWIN_ASYNC_CONTEXT_TAG
+{
+    IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK callback;
+    void* userContext;
+} DEVICE_TWIN_ASYNC_CONTEXT;
+
 static const char* generateGuid(void)
 {
     char* result;
@@ -370,12 +380,39 @@ IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE IoTHubDeviceTwin_Create(IOTHUB_SERVICE_
                     free(result);
                     result = NULL;
                 }
+                else
+                {
+                    result->httpPipeline = NULL;
+                    result->connection = NULL;
+                }
             }
         }
     }
     return result;
 }
 
+IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE IoTHubDeviceTwin_CreateWithConnection(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle)
+{
+    IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE result;
+
+    /*Codes_SRS_IOTHUBDEVICETWIN_41_001: [ If connectionHandle is NULL IoTHubDeviceTwin_CreateWithConnection shall return NULL. ]*/
+    if (connectionHandle == NULL)
+    {
+        LogError("connectionHandle input parameter cannot be NULL");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBDEVICETWIN_41_002: [ IoTHubDeviceTwin_CreateWithConnection shall create the client like IoTHubDeviceTwin_Create from the authentication information of the connection and remember the connection. ]*/
+    else if ((result = IoTHubDeviceTwin_Create(IoTHubServiceClientConnection_GetAuth(connectionHandle))) == NULL)
+    {
+        LogError("IoTHubDeviceTwin_Create failed");
+    }
+    else
+    {
+        result->connection = connectionHandle;
+    }
+    return result;
+}
+
 void IoTHubDeviceTwin_Destroy(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE serviceClientDeviceTwinHandle)
 {
     /*Codes_SRS_IOTHUBDEVICETWIN_12_016: [ If the serviceClientDeviceTwinHandle input parameter is NULL IoTHubDeviceTwin_Destroy shall return ]*/
@@ -384,6 +421,12 @@ void IoTHubDeviceTwin_Destroy(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE serviceCl
         /*Codes_SRS_IOTHUBDEVICETWIN_12_017: [ If the serviceClientDeviceTwinHandle input parameter is not NULL IoTHubDeviceTwin_Destroy shall free the memory of it and return ]*/
         IOTHUB_SERVICE_CLIENT_DEVICE_TWIN* serviceClientDeviceTwin = (IOTHUB_SERVICE_CLIENT_DEVICE_TWIN*)serviceClientDeviceTwinHandle;
 
+        /*Codes_SRS_IOTHUBDEVICETWIN_37_008: [ IoTHubDeviceTwin_Destroy shall destroy the HTTP pipeline, completing the pending asynchronous requests with IOTHUB_DEVICE_TWIN_HTTPAPI_ERROR. ]*/
+        /*Codes_SRS_IOTHUBDEVICETWIN_41_005: [ IoTHubDeviceTwin_Destroy shall not destroy the HTTP pipeline of a shared connection. ]*/
+        if (serviceClientDeviceTwin->httpPipeline != NULL)
+        {
+            IoTHubHttpPipeline_Destroy(serviceClientDeviceTwin->httpPipeline);
+        }
         free(serviceClientDeviceTwin->hostname);
         free(serviceClientDeviceTwin->sharedAccessKey);
         free(serviceClientDeviceTwin->keyName);
@@ -525,3 +568,185 @@ char* IoTHubDeviceTwin_UpdateTwin(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE servi
     }
     return result;
 }
+
+static IOTHUB_HTTP_PIPELINE_HANDLE getHttpPipeline(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN* serviceClientDeviceTwin)
+{
+    IOTHUB_HTTP_PIPELINE_HANDLE result;
+
+    if (serviceClientDeviceTwin->connection != NULL)
+    {
+        /*Codes_SRS_IOTHUBDEVICETWIN_41_003: [ A client created with IoTHubDeviceTwin_CreateWithConnection shall queue its asynchronous requests on the HTTP pipeline of the connection. ]*/
+        result = IoTHubServiceClientConnection_GetHttpPipeline(serviceClientDeviceTwin->connection);
+    }
+    else
+    {
+        if (serviceClientDeviceTwin->httpPipeline == NULL)
+        {
+            serviceClientDeviceTwin->httpPipeline = IoTHubHttpPipeline_Create(serviceClientDeviceTwin->hostname, serviceClientDeviceTwin->sharedAccessKey, serviceClientDeviceTwin->keyName);
+        }
+        result = serviceClientDeviceTwin->httpPipeline;
+    }
+    return result;
+}
+
+static void on_twin_response(IOTHUB_HTTP_PIPELINE_RESULT pipelineResult, unsigned int statusCode, const unsigned char* content, size_t contentLength, void* context)
+{
+    DEVICE_TWIN_ASYNC_CONTEXT* asyncContext = (DEVICE_TWIN_ASYNC_CONTEXT*)context;
+
+    if (pipelineResult != IOTHUB_HTTP_PIPELINE_OK)
+    {
+        /*Codes_SRS_IOTHUBDEVICETWIN_37_005: [ If the request could not be carried the callback shall be invoked with IOTHUB_DEVICE_TWIN_HTTPAPI_ERROR and a NULL json. ]*/
+        LogError("Twin request failed %s", ENUM_TO_STRING(IOTHUB_HTTP_PIPELINE_RESULT, pipelineResult));
+        asyncContext->callback(IOTHUB_DEVICE_TWIN_HTTPAPI_ERROR, NULL, asyncContext->userContext);
+    }
+    else if (statusCode != 200)
+    {
+        /*Codes_SRS_IOTHUBDEVICETWIN_37_006: [ If the status code is not 200 the callback shall be invoked with IOTHUB_DEVICE_TWIN_ERROR and a NULL json. ]*/
+        LogError("Http Failure status code %d.", statusCode);
+        asyncContext->callback(IOTHUB_DEVICE_TWIN_ERROR, NULL, asyncContext->userContext);
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBDEVICETWIN_37_007: [ Otherwise the callback shall be invoked with IOTHUB_DEVICE_TWIN_OK and the received twin as a null terminated string that is only valid for the duration of the callback. ]*/
+        char* deviceTwinJson = malloc(contentLength + 1);
+        if (deviceTwinJson == NULL)
+        {
+            LogError("failed to malloc");
+            asyncContext->callback(IOTHUB_DEVICE_TWIN_ERROR, NULL, asyncContext->userContext);
+        }
+        else
+        {
+            if (contentLength > 0)
+            {
+                (void)memcpy(deviceTwinJson, content, contentLength);
+            }
+            deviceTwinJson[contentLength] = '\0';
+            asyncContext->callback(IOTHUB_DEVICE_TWIN_OK, deviceTwinJson, asyncContext->userContext);
+            free(deviceTwinJson);
+        }
+    }
+    free(asyncContext);
+}
+
+static IOTHUB_DEVICE_TWIN_RESULT sendAsyncRequestTwin(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE serviceClientDeviceTwinHandle, IOTHUB_TWIN_REQUEST_MODE iotHubTwinRequestMode, const char* deviceId, const char* deviceTwinJson, IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK callback, void* userContext)
+{
+    IOTHUB_DEVICE_TWIN_RESULT result;
+    IOTHUB_HTTP_PIPELINE_HANDLE httpPipeline;
+    DEVICE_TWIN_ASYNC_CONTEXT* asyncContext;
+    STRING_HANDLE relativePath;
+
+    if ((httpPipeline = getHttpPipeline(serviceClientDeviceTwinHandle)) == NULL)
+    {
+        LogError("Failure creating the HTTP pipeline");
+        result = IOTHUB_DEVICE_TWIN_ERROR;
+    }
+    else if ((relativePath = createRelativePath(iotHubTwinRequestMode, deviceId)) == NULL)
+    {
+        LogError("Failure creating relative path");
+        result = IOTHUB_DEVICE_TWIN_ERROR;
+    }
+    else
+    {
+        if ((asyncContext = malloc(sizeof(DEVICE_TWIN_ASYNC_CONTEXT))) == NULL)
+        {
+            LogError("Malloc failed for DEVICE_TWIN_ASYNC_CONTEXT");
+            result = IOTHUB_DEVICE_TWIN_ERROR;
+        }
+        else
+        {
+            HTTP_CLIENT_REQUEST_TYPE requestType = (iotHubTwinRequestMode == IOTHUB_TWIN_REQUEST_GET) ? HTTP_CLIENT_REQUEST_GET : HTTP_CLIENT_REQUEST_PATCH;
+            const char* ifMatch = (iotHubTwinRequestMode == IOTHUB_TWIN_REQUEST_GET) ? NULL : HTTP_HEADER_VAL_IFMATCH;
+            size_t contentLength = (deviceTwinJson == NULL) ? 0 : strlen(deviceTwinJson);
+
+            asyncContext->callback = callback;
+            asyncContext->userContext = userContext;
+            if (IoTHubHttpPipeline_ExecuteRequest(httpPipeline, requestType, STRING_c_str(relativePath), ifMatch, (const unsigned char*)deviceTwinJson, contentLength, on_twin_response, asyncContext) != IOTHUB_HTTP_PIPELINE_OK)
+            {
+                LogError("IoTHubHttpPipeline_ExecuteRequest failed");
+                free(asyncContext);
+                result = IOTHUB_DEVICE_TWIN_ERROR;
+            }
+            else
+            {
+                result = IOTHUB_DEVICE_TWIN_OK;
+            }
+        }
+        STRING_delete(relativePath);
+    }
+    return result;
+}
+
+IOTHUB_DEVICE_TWIN_RESULT IoTHubDeviceTwin_GetTwinAsync(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE serviceClientDeviceTwinHandle, const char* deviceId, IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK callback, void* userContext)
+{
+    IOTHUB_DEVICE_TWIN_RESULT result;
+
+    /*Codes_SRS_IOTHUBDEVICETWIN_37_001: [ If serviceClientDeviceTwinHandle, deviceId or callback is NULL, IoTHubDeviceTwin_GetTwinAsync shall return IOTHUB_DEVICE_TWIN_INVALID_ARG. ]*/
+    if ((serviceClientDeviceTwinHandle == NULL) || (deviceId == NULL) || (callback == NULL))
+    {
+        LogError("Input parameter cannot be NULL");
+        result = IOTHUB_DEVICE_TWIN_INVALID_ARG;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBDEVICETWIN_37_002: [ IoTHubDeviceTwin_GetTwinAsync shall queue an HTTP GET request on the client's HTTP pipeline, creating the pipeline on first use, and return IOTHUB_DEVICE_TWIN_ERROR if that fails. ]*/
+        result = sendAsyncRequestTwin(serviceClientDeviceTwinHandle, IOTHUB_TWIN_REQUEST_GET, deviceId, NULL, callback, userContext);
+    }
+    return result;
+}
+
+IOTHUB_DEVICE_TWIN_RESULT IoTHubDeviceTwin_UpdateTwinAsync(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE serviceClientDeviceTwinHandle, const char* deviceId, const char* deviceTwinJson, IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK callback, void* userContext)
+{
+    IOTHUB_DEVICE_TWIN_RESULT result;
+
+    /*Codes_SRS_IOTHUBDEVICETWIN_37_003: [ If serviceClientDeviceTwinHandle, deviceId, deviceTwinJson or callback is NULL, IoTHubDeviceTwin_UpdateTwinAsync shall return IOTHUB_DEVICE_TWIN_INVALID_ARG. ]*/
+    if ((serviceClientDeviceTwinHandle == NULL) || (deviceId == NULL) || (deviceTwinJson == NULL) || (callback == NULL))
+    {
+        LogError("Input parameter cannot be NULL");
+        result = IOTHUB_DEVICE_TWIN_INVALID_ARG;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBDEVICETWIN_37_004: [ IoTHubDeviceTwin_UpdateTwinAsync shall queue an HTTP PATCH request carrying deviceTwinJson on the client's HTTP pipeline and return IOTHUB_DEVICE_TWIN_ERROR if that fails. ]*/
+        result = sendAsyncRequestTwin(serviceClientDeviceTwinHandle, IOTHUB_TWIN_REQUEST_UPDATE, deviceId, deviceTwinJson, callback, userContext);
+    }
+    return result;
+}
+
+void IoTHubDeviceTwin_DoWork(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE serviceClientDeviceTwinHandle)
+{
+    /*Codes_SRS_IOTHUBDEVICETWIN_37_009: [ IoTHubDeviceTwin_DoWork shall call IoTHubHttpPipeline_DoWork when the pipeline exists and do nothing otherwise. ]*/
+    if ((serviceClientDeviceTwinHandle != NULL) && (serviceClientDeviceTwinHandle->httpPipeline != NULL))
+    {
+        IoTHubHttpPipeline_DoWork(serviceClientDeviceTwinHandle->httpPipeline);
+    }
+    /*Codes_SRS_IOTHUBDEVICETWIN_41_004: [ IoTHubDeviceTwin_DoWork shall call IoTHubServiceClientConnection_DoWork when the client was created with a connection. ]*/
+    else if ((serviceClientDeviceTwinHandle != NULL) && (serviceClientDeviceTwinHandle->connection != NULL))
+    {
+        IoTHubServiceClientConnection_DoWork(serviceClientDeviceTwinHandle->connection);
+    }
+}
+
+IOTHUB_DEVICE_TWIN_RESULT IoTHubDeviceTwin_SetOption(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE serviceClientDeviceTwinHandle, const char* optionName, const void* value)
+{
+    IOTHUB_DEVICE_TWIN_RESULT result;
+    IOTHUB_HTTP_PIPELINE_HANDLE httpPipeline;
+
+    /*Codes_SRS_IOTHUBDEVICETWIN_37_010: [ If any parameter is NULL, IoTHubDeviceTwin_SetOption shall return IOTHUB_DEVICE_TWIN_INVALID_ARG. ]*/
+    if ((serviceClientDeviceTwinHandle == NULL) || (optionName == NULL) || (value == NULL))
+    {
+        LogError("Input parameter cannot be NULL");
+        result = IOTHUB_DEVICE_TWIN_INVALID_ARG;
+    }
+    else if ((httpPipeline = getHttpPipeline(serviceClientDeviceTwinHandle)) == NULL)
+    {
+        LogError("Failure creating the HTTP pipeline");
+        result = IOTHUB_DEVICE_TWIN_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBDEVICETWIN_37_011: [ IoTHubDeviceTwin_SetOption shall pass the option to IoTHubHttpPipeline_SetOption and map its result. ]*/
+        IOTHUB_HTTP_PIPELINE_RESULT pipelineResult = IoTHubHttpPipeline_SetOption(httpPipeline, optionName, value);
+        result = (pipelineResult == IOTHUB_HTTP_PIPELINE_OK) ? IOTHUB_DEVICE_TWIN_OK : ((pipelineResult == IOTHUB_HTTP_PIPELINE_INVALID_ARG) ? IOTHUB_DEVICE_TWIN_INVALID_ARG : IOTHUB_DEVICE_TWIN_ERROR);
+    }
+    return result;
+}
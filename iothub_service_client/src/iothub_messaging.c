@@ -323,3 +323,43 @@ IOTHUB_MESSAGING_RESULT IoTHubMessaging_SendAsync(IOTHUB_MESSAGING_CLIENT_HANDLE
     return result;
 }
 
+IOTHUB_MESSAGING_RESULT IoTHubMessaging_SendBatchAsync(IOTHUB_MESSAGING_CLIENT_HANDLE messagingClientHandle, const char* const* deviceIds, size_t deviceCount, IOTHUB_MESSAGE_HANDLE message, IOTHUB_SEND_BATCH_COMPLETE_CALLBACK sendCompleteCallback, IOTHUB_MESSAGE_FEEDBACK_CALLBACK feedbackCallback, void* userContextCallback)
+{
+    IOTHUB_MESSAGING_RESULT result;
+
+    if (messagingClientHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBMESSAGING_40_012: [ If messagingClientHandle is NULL, IoTHubMessaging_SendBatchAsync shall return IOTHUB_MESSAGING_INVALID_ARG. ]*/
+        LogError("NULL messagingClientHandle");
+        result = IOTHUB_MESSAGING_INVALID_ARG;
+    }
+    else
+    {
+        IOTHUB_MESSAGING_CLIENT_INSTANCE* iotHubMessagingClientInstance = (IOTHUB_MESSAGING_CLIENT_INSTANCE*)messagingClientHandle;
+
+        /*Codes_SRS_IOTHUBMESSAGING_40_013: [ IoTHubMessaging_SendBatchAsync shall be made thread-safe by using the lock created in IoTHubMessaging_Create and return IOTHUB_MESSAGING_ERROR if acquiring it fails. ]*/
+        if (Lock(iotHubMessagingClientInstance->LockHandle) != LOCK_OK)
+        {
+            LogError("Could not acquire lock");
+            result = IOTHUB_MESSAGING_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBMESSAGING_40_014: [ IoTHubMessaging_SendBatchAsync shall start the worker thread if it was not previously started and return IOTHUB_MESSAGING_ERROR if that fails. ]*/
+            if (StartWorkerThreadIfNeeded(iotHubMessagingClientInstance) != IOTHUB_MESSAGING_OK)
+            {
+                LogError("Could not start worker thread");
+                result = IOTHUB_MESSAGING_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBMESSAGING_40_015: [ IoTHubMessaging_SendBatchAsync shall call IoTHubMessaging_LL_SendBatch with its parameters and return its result. ]*/
+                result = IoTHubMessaging_LL_SendBatch(iotHubMessagingClientInstance->IoTHubMessagingHandle, deviceIds, deviceCount, message, sendCompleteCallback, feedbackCallback, userContextCallback);
+            }
+
+            (void)Unlock(iotHubMessagingClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
@@ -23,6 +23,7 @@
 #include "parson.h"
 
 #include "iothub_messaging_ll.h"
+#include "internal/iothub_sc_connection_private.h"
 #include "iothub_sc_version.h"
 
 DEFINE_ENUM_STRINGS(IOTHUB_FEEDBACK_STATUS_CODE, IOTHUB_FEEDBACK_STATUS_CODE_VALUES);
@@ -39,6 +40,21 @@ typedef struct CALLBACK_DATA_TAG
     void* feedbackUserContext;
 } CALLBACK_DATA;
 
+#define OUTSTANDING_MESSAGE_INDEX_INITIAL_SIZE 16 /*power of two, the index doubles when it gets over 3/4 full*/
+
+typedef struct OUTSTANDING_MESSAGE_TAG
+{
+    struct IOTHUB_MESSAGING_TAG* messaging;
+    IOTHUB_SEND_BATCH_COMPLETE_CALLBACK sendCompleteCallback;
+    IOTHUB_MESSAGE_FEEDBACK_CALLBACK feedbackCallback;
+    void* userContext;
+    const char* deviceId; /*deviceId and messageId are stored right after the struct, in the same allocation*/
+    const char* messageId;
+    size_t hash;
+    int isSendPending;
+    struct OUTSTANDING_MESSAGE_TAG* next_in_index;
+} OUTSTANDING_MESSAGE;
+
 typedef struct IOTHUB_MESSAGING_TAG
 {
     int isOpened;
@@ -63,6 +79,12 @@ typedef struct IOTHUB_MESSAGING_TAG
     MESSAGE_RECEIVER_STATE message_receiver_state;
 
     CALLBACK_DATA* callback_data;
+
+    OUTSTANDING_MESSAGE** outstanding_index; /*messages sent by IoTHubMessaging_LL_SendBatch, hashed by message-id and device-id*/
+    size_t outstanding_index_size;
+    size_t outstanding_count;
+
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE sharedConnection; /*set by IoTHubMessaging_LL_CreateWithConnection, owns connection and session*/
 } IOTHUB_MESSAGING;
 
 
@@ -577,16 +599,207 @@ static char* createDeviceDestinationString(const char* deviceId)
     return result;
 }
 
+static size_t hashOutstandingMessage(const char* deviceId, const char* messageId)
+{
+    size_t hash = 5381;
+
+    /*the message-id is usually shared by the whole batch, so the device-id has to be part of the hash*/
+    while (*deviceId != '\0')
+    {
+        hash = ((hash << 5) + hash) ^ (unsigned char)(*deviceId);
+        deviceId++;
+    }
+    hash = ((hash << 5) + hash); /*keeps "ab"+"c" and "a"+"bc" apart*/
+    if (messageId != NULL)
+    {
+        while (*messageId != '\0')
+        {
+            hash = ((hash << 5) + hash) ^ (unsigned char)(*messageId);
+            messageId++;
+        }
+    }
+    return hash;
+}
+
+static int growOutstandingIndex(IOTHUB_MESSAGING* messagingData)
+{
+    int result;
+    size_t newSize = (messagingData->outstanding_index_size == 0) ? OUTSTANDING_MESSAGE_INDEX_INITIAL_SIZE : messagingData->outstanding_index_size * 2;
+    OUTSTANDING_MESSAGE** newIndex;
+
+    if ((newSize < messagingData->outstanding_index_size) || ((newSize * sizeof(OUTSTANDING_MESSAGE*)) / sizeof(OUTSTANDING_MESSAGE*) != newSize))
+    {
+        LogError("Outstanding message index cannot grow any further");
+        result = __FAILURE__;
+    }
+    else if ((newIndex = (OUTSTANDING_MESSAGE**)malloc(newSize * sizeof(OUTSTANDING_MESSAGE*))) == NULL)
+    {
+        LogError("Malloc failed for outstanding message index");
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t i;
+
+        for (i = 0; i < newSize; i++)
+        {
+            newIndex[i] = NULL;
+        }
+        for (i = 0; i < messagingData->outstanding_index_size; i++)
+        {
+            while (messagingData->outstanding_index[i] != NULL)
+            {
+                OUTSTANDING_MESSAGE* outstanding = messagingData->outstanding_index[i];
+                size_t bucket = outstanding->hash & (newSize - 1);
+
+                messagingData->outstanding_index[i] = outstanding->next_in_index;
+                outstanding->next_in_index = newIndex[bucket];
+                newIndex[bucket] = outstanding;
+            }
+        }
+        free(messagingData->outstanding_index);
+        messagingData->outstanding_index = newIndex;
+        messagingData->outstanding_index_size = newSize;
+        result = 0;
+    }
+    return result;
+}
+
+static OUTSTANDING_MESSAGE* addOutstandingMessage(IOTHUB_MESSAGING* messagingData, const char* deviceId, const char* messageId, IOTHUB_SEND_BATCH_COMPLETE_CALLBACK sendCompleteCallback, IOTHUB_MESSAGE_FEEDBACK_CALLBACK feedbackCallback, void* userContext)
+{
+    OUTSTANDING_MESSAGE* result;
+    size_t deviceIdSize = strlen(deviceId) + 1;
+    size_t messageIdSize = (messageId == NULL) ? 0 : strlen(messageId) + 1;
+
+    if ((messagingData->outstanding_count + 1 > messagingData->outstanding_index_size - (messagingData->outstanding_index_size / 4)) &&
+        (growOutstandingIndex(messagingData) != 0))
+    {
+        LogError("Failed growing the outstanding message index");
+        result = NULL;
+    }
+    else if ((result = (OUTSTANDING_MESSAGE*)malloc(sizeof(OUTSTANDING_MESSAGE) + deviceIdSize + messageIdSize)) == NULL)
+    {
+        LogError("Malloc failed for outstanding message");
+    }
+    else
+    {
+        char* strings = (char*)(result + 1);
+
+        (void)memcpy(strings, deviceId, deviceIdSize);
+        result->deviceId = strings;
+        if (messageId == NULL)
+        {
+            result->messageId = NULL;
+        }
+        else
+        {
+            (void)memcpy(strings + deviceIdSize, messageId, messageIdSize);
+            result->messageId = strings + deviceIdSize;
+        }
+        result->messaging = messagingData;
+        result->sendCompleteCallback = sendCompleteCallback;
+        result->feedbackCallback = feedbackCallback;
+        result->userContext = userContext;
+        result->isSendPending = true;
+        result->hash = hashOutstandingMessage(deviceId, messageId);
+        result->next_in_index = messagingData->outstanding_index[result->hash & (messagingData->outstanding_index_size - 1)];
+        messagingData->outstanding_index[result->hash & (messagingData->outstanding_index_size - 1)] = result;
+        messagingData->outstanding_count++;
+    }
+    return result;
+}
+
+static void removeOutstandingMessage(IOTHUB_MESSAGING* messagingData, OUTSTANDING_MESSAGE* outstanding)
+{
+    OUTSTANDING_MESSAGE** link = &(messagingData->outstanding_index[outstanding->hash & (messagingData->outstanding_index_size - 1)]);
+
+    while (*link != NULL && *link != outstanding)
+    {
+        link = &((*link)->next_in_index);
+    }
+
+    if (*link != NULL)
+    {
+        *link = outstanding->next_in_index;
+        messagingData->outstanding_count--;
+    }
+    free(outstanding);
+}
+
+static void removeAllOutstandingMessages(IOTHUB_MESSAGING* messagingData)
+{
+    size_t i;
+
+    for (i = 0; i < messagingData->outstanding_index_size; i++)
+    {
+        while (messagingData->outstanding_index[i] != NULL)
+        {
+            OUTSTANDING_MESSAGE* outstanding = messagingData->outstanding_index[i];
+            messagingData->outstanding_index[i] = outstanding->next_in_index;
+            free(outstanding);
+        }
+    }
+    free(messagingData->outstanding_index);
+    messagingData->outstanding_index = NULL;
+    messagingData->outstanding_index_size = 0;
+    messagingData->outstanding_count = 0;
+}
+
+static void matchFeedbackRecord(IOTHUB_MESSAGING* messagingData, const IOTHUB_SERVICE_FEEDBACK_RECORD* feedbackRecord)
+{
+    if (feedbackRecord->originalMessageId != NULL && feedbackRecord->deviceId != NULL)
+    {
+        size_t hash = hashOutstandingMessage(feedbackRecord->deviceId, feedbackRecord->originalMessageId);
+        OUTSTANDING_MESSAGE* outstanding = messagingData->outstanding_index[hash & (messagingData->outstanding_index_size - 1)];
+
+        while (outstanding != NULL &&
+            (outstanding->hash != hash ||
+            outstanding->feedbackCallback == NULL ||
+            outstanding->messageId == NULL ||
+            strcmp(outstanding->messageId, feedbackRecord->originalMessageId) != 0 ||
+            strcmp(outstanding->deviceId, feedbackRecord->deviceId) != 0))
+        {
+            outstanding = outstanding->next_in_index;
+        }
+
+        if (outstanding != NULL)
+        {
+            outstanding->feedbackCallback(outstanding->userContext, feedbackRecord);
+            if (outstanding->isSendPending)
+            {
+                /*the send completion is still to come, it releases the message*/
+                outstanding->feedbackCallback = NULL;
+            }
+            else
+            {
+                removeOutstandingMessage(messagingData, outstanding);
+            }
+        }
+    }
+}
+
 static void IoTHubMessaging_LL_SenderStateChanged(void* context, MESSAGE_SENDER_STATE new_state, MESSAGE_SENDER_STATE previous_state)
 {
-    (void)previous_state;
     if (context != NULL)
     {
         /*Codes_SRS_IOTHUBMESSAGING_12_049: [ IoTHubMessaging_LL_SenderStateChanged shall save the new_state to local variable ] */
         IOTHUB_MESSAGING* messagingData = (IOTHUB_MESSAGING*)context;
         messagingData->message_sender_state = new_state;
 
-        if ((messagingData->message_sender_state == MESSAGE_SENDER_STATE_OPEN) && (messagingData->message_receiver_state == MESSAGE_RECEIVER_STATE_OPEN))
+        if (messagingData->sharedConnection != NULL)
+        {
+            /*Codes_SRS_IOTHUBMESSAGING_41_007: [ On a shared connection IoTHubMessaging_LL_SenderStateChanged shall call the open complete callback when the sender link opens, and clear isOpened only when the sender link fails. ] */
+            if (new_state == MESSAGE_SENDER_STATE_ERROR)
+            {
+                LogError("The sender link failed - call IoTHubMessaging_LL_Close and IoTHubMessaging_LL_Open to reattach it");
+                messagingData->isOpened = false;
+            }
+            else if ((new_state == MESSAGE_SENDER_STATE_OPEN) && (previous_state != MESSAGE_SENDER_STATE_OPEN) && (messagingData->callback_data->openCompleteCompleteCallback != NULL))
+            {
+                (messagingData->callback_data->openCompleteCompleteCallback)(messagingData->callback_data->openUserContext);
+            }
+        }
+        else if ((messagingData->message_sender_state == MESSAGE_SENDER_STATE_OPEN) && (messagingData->message_receiver_state == MESSAGE_RECEIVER_STATE_OPEN))
         {
             /*Codes_SRS_IOTHUBMESSAGING_12_050: [ If both sender and receiver state is open IoTHubMessaging_LL_SenderStateChanged shall set the isOpened local variable to true ] */
             messagingData->isOpened = true;
@@ -612,7 +825,15 @@ static void IoTHubMessaging_LL_ReceiverStateChanged(const void* context, MESSAGE
         IOTHUB_MESSAGING* messagingData = (IOTHUB_MESSAGING*)context;
         messagingData->message_receiver_state = new_state;
 
-        if ((messagingData->message_sender_state == MESSAGE_SENDER_STATE_OPEN) && (messagingData->message_receiver_state == MESSAGE_RECEIVER_STATE_OPEN))
+        if (messagingData->sharedConnection != NULL)
+        {
+            /*Codes_SRS_IOTHUBMESSAGING_41_008: [ On a shared connection the state of the feedback receiver shall not change isOpened. ] */
+            if (new_state == MESSAGE_RECEIVER_STATE_ERROR)
+            {
+                LogError("The feedback receiver link failed");
+            }
+        }
+        else if ((messagingData->message_sender_state == MESSAGE_SENDER_STATE_OPEN) && (messagingData->message_receiver_state == MESSAGE_RECEIVER_STATE_OPEN))
         {
             /*Codes_SRS_IOTHUBMESSAGING_12_053: [ If both sender and receiver state is open IoTHubMessaging_LL_ReceiverStateChanged shall set the isOpened local variable to true ] */
             messagingData->isOpened = true;
@@ -643,6 +864,31 @@ static void IoTHubMessaging_LL_SendMessageComplete(void* context, IOTHUB_MESSAGI
     }
 }
 
+static void IoTHubMessaging_LL_BatchSendComplete(void* context, MESSAGE_SEND_RESULT send_result)
+{
+    if (context != NULL)
+    {
+        OUTSTANDING_MESSAGE* outstanding = (OUTSTANDING_MESSAGE*)context;
+        IOTHUB_MESSAGING_RESULT messagingResult = (send_result == MESSAGE_SEND_OK) ? IOTHUB_MESSAGING_OK : IOTHUB_MESSAGING_ERROR;
+
+        /*Codes_SRS_IOTHUBMESSAGING_40_006: [ When the send to a device completes, sendCompleteCallback shall be called with the user context, the device id and IOTHUB_MESSAGING_OK or IOTHUB_MESSAGING_ERROR. ] */
+        if (outstanding->sendCompleteCallback != NULL)
+        {
+            outstanding->sendCompleteCallback(outstanding->userContext, outstanding->deviceId, messagingResult);
+        }
+
+        /*Codes_SRS_IOTHUBMESSAGING_40_007: [ If the send succeeded, feedbackCallback is not NULL and the message has a message-id, the device shall stay in the outstanding message index until its feedback record arrives; otherwise it shall be released. ] */
+        if (messagingResult == IOTHUB_MESSAGING_OK && outstanding->feedbackCallback != NULL && outstanding->messageId != NULL)
+        {
+            outstanding->isSendPending = false;
+        }
+        else
+        {
+            removeOutstandingMessage(outstanding->messaging, outstanding);
+        }
+    }
+}
+
 static AMQP_VALUE IoTHubMessaging_LL_FeedbackMessageReceived(const void* context, MESSAGE_HANDLE message)
 {
     AMQP_VALUE result;
@@ -776,6 +1022,12 @@ static AMQP_VALUE IoTHubMessaging_LL_FeedbackMessageReceived(const void* context
                                     }
                                 }
                                 singlylinkedlist_add(feedbackBatch->feedbackRecordList, feedbackRecord);
+
+                                /*Codes_SRS_IOTHUBMESSAGING_40_008: [ IoTHubMessaging_LL_FeedbackMessageReceived shall look each record up in the outstanding message index by originalMessageId and deviceId and, if a device is waiting for it, call its feedbackCallback with the record and release it. ] */
+                                if (messagingData->outstanding_count != 0)
+                                {
+                                    matchFeedbackRecord(messagingData, feedbackRecord);
+                                }
                             }
                         }
                     }
@@ -941,6 +1193,11 @@ IOTHUB_MESSAGING_HANDLE IoTHubMessaging_LL_Create(IOTHUB_SERVICE_CLIENT_AUTH_HAN
 
                 result->callback_data = callback_data;
                 result->isOpened = false;
+
+                result->outstanding_index = NULL;
+                result->outstanding_index_size = 0;
+                result->outstanding_count = 0;
+                result->sharedConnection = NULL;
             }
         }
     }
@@ -955,6 +1212,10 @@ void IoTHubMessaging_LL_Destroy(IOTHUB_MESSAGING_HANDLE messagingHandle)
         /*Codes_SRS_IOTHUBMESSAGING_12_006: [ If the messagingHandle input parameter is not NULL IoTHubMessaging_LL_Destroy shall free all resources (memory) allocated by IoTHubMessaging_LL_Create ] */
         IOTHUB_MESSAGING* messHandle = (IOTHUB_MESSAGING*)messagingHandle;
 
+        if (messHandle->outstanding_index != NULL)
+        {
+            removeAllOutstandingMessages(messHandle);
+        }
         free(messHandle->callback_data);
         free(messHandle->hostname);
         free(messHandle->iothubName);
@@ -965,6 +1226,35 @@ void IoTHubMessaging_LL_Destroy(IOTHUB_MESSAGING_HANDLE messagingHandle)
     }
 }
 
+IOTHUB_MESSAGING_HANDLE IoTHubMessaging_LL_CreateWithConnection(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle)
+{
+    IOTHUB_MESSAGING_HANDLE result;
+
+    /*Codes_SRS_IOTHUBMESSAGING_41_001: [ If connectionHandle is NULL IoTHubMessaging_LL_CreateWithConnection shall return NULL ] */
+    if (connectionHandle == NULL)
+    {
+        LogError("connectionHandle input parameter cannot be NULL");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBMESSAGING_41_002: [ IoTHubMessaging_LL_CreateWithConnection shall create the messaging instance like IoTHubMessaging_LL_Create from the authentication information of the connection and remember the connection ] */
+    else if ((result = IoTHubMessaging_LL_Create(IoTHubServiceClientConnection_GetAuth(connectionHandle))) == NULL)
+    {
+        LogError("IoTHubMessaging_LL_Create failed");
+    }
+    else
+    {
+        result->sharedConnection = connectionHandle;
+        result->session = NULL;
+        result->message_sender = NULL;
+        result->message_receiver = NULL;
+        result->sender_link = NULL;
+        result->receiver_link = NULL;
+        result->message_sender_state = MESSAGE_SENDER_STATE_IDLE;
+        result->message_receiver_state = MESSAGE_RECEIVER_STATE_IDLE;
+    }
+    return result;
+}
+
 static int attachServiceClientTypeToLink(LINK_HANDLE link)
 {
     fields attach_properties;
@@ -1017,6 +1307,168 @@ static int attachServiceClientTypeToLink(LINK_HANDLE link)
     return result;
 }
 
+static void closeSharedLinks(IOTHUB_MESSAGING* messagingData)
+{
+    messagesender_destroy(messagingData->message_sender);
+    messagereceiver_destroy(messagingData->message_receiver);
+    link_destroy(messagingData->sender_link);
+    link_destroy(messagingData->receiver_link);
+
+    messagingData->message_sender = NULL;
+    messagingData->message_receiver = NULL;
+    messagingData->sender_link = NULL;
+    messagingData->receiver_link = NULL;
+}
+
+static IOTHUB_MESSAGING_RESULT openSharedSender(IOTHUB_MESSAGING* messagingData, IOTHUB_OPEN_COMPLETE_CALLBACK openCompleteCallback, void* userContextCallback)
+{
+    IOTHUB_MESSAGING_RESULT result;
+    char* send_target_address;
+    AMQP_VALUE sendSource = NULL;
+    AMQP_VALUE sendTarget = NULL;
+
+    if ((send_target_address = createSendTargetAddress(messagingData)) == NULL)
+    {
+        LogError("Could not create sendTargetAddress");
+        result = IOTHUB_MESSAGING_ERROR;
+    }
+    /*Codes_SRS_IOTHUBMESSAGING_41_003: [ On a shared connection IoTHubMessaging_LL_Open shall attach to the AMQP session of the connection, which creates the AMQP connection on first use only ] */
+    else if ((messagingData->session = IoTHubServiceClientConnection_AttachAmqpSession(messagingData->sharedConnection)) == NULL)
+    {
+        LogError("Could not attach to the AMQP session of the shared connection");
+        result = IOTHUB_MESSAGING_ERROR;
+    }
+    else
+    {
+        messagingData->callback_data->openCompleteCompleteCallback = openCompleteCallback;
+        messagingData->callback_data->openUserContext = userContextCallback;
+
+        /*Codes_SRS_IOTHUBMESSAGING_41_004: [ On a shared connection IoTHubMessaging_LL_Open shall only create and open the sender link; the feedback receiver link is created by IoTHubMessaging_LL_DoWork once it is needed ] */
+        if ((sendSource = messaging_create_source("ingress")) == NULL)
+        {
+            LogError("Could not create source for link.");
+            result = IOTHUB_MESSAGING_ERROR;
+        }
+        else if ((sendTarget = messaging_create_target(send_target_address)) == NULL)
+        {
+            LogError("Could not create target for link.");
+            result = IOTHUB_MESSAGING_ERROR;
+        }
+        else if ((messagingData->sender_link = link_create(messagingData->session, "sender-link", role_sender, sendSource, sendTarget)) == NULL)
+        {
+            LogError("Could not create link.");
+            result = IOTHUB_MESSAGING_ERROR;
+        }
+        else if (attachServiceClientTypeToLink(messagingData->sender_link) != 0)
+        {
+            LogError("Could not set the sender attach properties.");
+            result = IOTHUB_MESSAGING_ERROR;
+        }
+        else if (link_set_snd_settle_mode(messagingData->sender_link, sender_settle_mode_unsettled) != 0)
+        {
+            LogError("Could not set the sender settle mode.");
+            result = IOTHUB_MESSAGING_ERROR;
+        }
+        else if ((messagingData->message_sender = messagesender_create(messagingData->sender_link, IoTHubMessaging_LL_SenderStateChanged, messagingData)) == NULL)
+        {
+            LogError("Could not create message sender.");
+            result = IOTHUB_MESSAGING_ERROR;
+        }
+        else if (messagesender_open(messagingData->message_sender) != 0)
+        {
+            LogError("Could not open the message sender.");
+            result = IOTHUB_MESSAGING_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBMESSAGING_41_005: [ On a shared connection IoTHubMessaging_LL_Open shall return IOTHUB_MESSAGING_OK without waiting for the links to open, and messages sent before the sender link is open shall be queued by the sender ] */
+            messagingData->isOpened = true;
+            result = IOTHUB_MESSAGING_OK;
+        }
+
+        if (result != IOTHUB_MESSAGING_OK)
+        {
+            closeSharedLinks(messagingData);
+            IoTHubServiceClientConnection_DetachAmqpSession(messagingData->sharedConnection, false);
+            messagingData->session = NULL;
+        }
+    }
+
+    amqpvalue_destroy(sendSource);
+    amqpvalue_destroy(sendTarget);
+    free(send_target_address);
+    return result;
+}
+
+static int openSharedReceiver(IOTHUB_MESSAGING* messagingData)
+{
+    int result;
+    char* receive_target_address;
+    AMQP_VALUE receiveSource = NULL;
+    AMQP_VALUE receiveTarget = NULL;
+
+    if ((receive_target_address = createReceiveTargetAddress(messagingData)) == NULL)
+    {
+        LogError("Could not create receiveTargetAddress");
+        result = __FAILURE__;
+    }
+    else
+    {
+        if ((receiveSource = messaging_create_source(receive_target_address)) == NULL)
+        {
+            LogError("Could not create source for link.");
+            result = __FAILURE__;
+        }
+        else if ((receiveTarget = messaging_create_target("receiver_001")) == NULL)
+        {
+            LogError("Could not create target for link.");
+            result = __FAILURE__;
+        }
+        else if ((messagingData->receiver_link = link_create(messagingData->session, "receiver-link", role_receiver, receiveSource, receiveTarget)) == NULL)
+        {
+            LogError("Could not create link.");
+            result = __FAILURE__;
+        }
+        else if (attachServiceClientTypeToLink(messagingData->receiver_link) != 0)
+        {
+            LogError("Could not set the receiver attach properties.");
+            result = __FAILURE__;
+        }
+        else if (link_set_rcv_settle_mode(messagingData->receiver_link, receiver_settle_mode_first) != 0)
+        {
+            LogError("Could not set the receiver settle mode.");
+            result = __FAILURE__;
+        }
+        else if ((messagingData->message_receiver = messagereceiver_create(messagingData->receiver_link, IoTHubMessaging_LL_ReceiverStateChanged, messagingData)) == NULL)
+        {
+            LogError("Could not create message receiver.");
+            result = __FAILURE__;
+        }
+        else if (messagereceiver_open(messagingData->message_receiver, IoTHubMessaging_LL_FeedbackMessageReceived, messagingData) != 0)
+        {
+            LogError("Could not open the message receiver.");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+
+        if (result != 0)
+        {
+            messagereceiver_destroy(messagingData->message_receiver);
+            link_destroy(messagingData->receiver_link);
+            messagingData->message_receiver = NULL;
+            messagingData->receiver_link = NULL;
+        }
+
+        amqpvalue_destroy(receiveSource);
+        amqpvalue_destroy(receiveTarget);
+        free(receive_target_address);
+    }
+    return result;
+}
+
 IOTHUB_MESSAGING_RESULT IoTHubMessaging_LL_Open(IOTHUB_MESSAGING_HANDLE messagingHandle, IOTHUB_OPEN_COMPLETE_CALLBACK openCompleteCallback, void* userContextCallback)
 {
     IOTHUB_MESSAGING_RESULT result;
@@ -1039,6 +1491,18 @@ IOTHUB_MESSAGING_RESULT IoTHubMessaging_LL_Open(IOTHUB_MESSAGING_HANDLE messagin
         LogError("Input parameter cannot be NULL");
         result = IOTHUB_MESSAGING_INVALID_ARG;
     }
+    else if (messagingHandle->sharedConnection != NULL)
+    {
+        if (messagingHandle->isOpened != 0)
+        {
+            LogError("Messaging is already opened");
+            result = IOTHUB_MESSAGING_OK;
+        }
+        else
+        {
+            result = openSharedSender(messagingHandle, openCompleteCallback, userContextCallback);
+        }
+    }
     else
     {
         messagingHandle->message_sender = NULL;
@@ -1357,6 +1821,24 @@ void IoTHubMessaging_LL_Close(IOTHUB_MESSAGING_HANDLE messagingHandle)
     {
         LogError("Input parameter cannot be NULL");
     }
+    else if (messagingHandle->sharedConnection != NULL)
+    {
+        /*Codes_SRS_IOTHUBMESSAGING_41_009: [ On a shared connection IoTHubMessaging_LL_Close shall destroy the links and detach from the session, keeping the AMQP connection open unless one of the links failed ] */
+        bool linkFailed = (messagingHandle->message_sender_state == MESSAGE_SENDER_STATE_ERROR) || (messagingHandle->message_receiver_state == MESSAGE_RECEIVER_STATE_ERROR);
+
+        closeSharedLinks(messagingHandle);
+        if (messagingHandle->session != NULL)
+        {
+            IoTHubServiceClientConnection_DetachAmqpSession(messagingHandle->sharedConnection, linkFailed);
+            messagingHandle->session = NULL;
+        }
+        messagingHandle->message_sender_state = MESSAGE_SENDER_STATE_IDLE;
+        messagingHandle->message_receiver_state = MESSAGE_RECEIVER_STATE_IDLE;
+
+        /*Codes_SRS_IOTHUBMESSAGING_40_009: [ IoTHubMessaging_LL_Close shall release the devices still waiting for their feedback without calling feedbackCallback. ] */
+        removeAllOutstandingMessages(messagingHandle);
+        messagingHandle->isOpened = false;
+    }
     /*Codes_SRS_IOTHUBMESSAGING_12_033: [ IoTHubMessaging_LL_Close destroy the AMQP transportconnection by calling link_destroy, session_destroy, connection_destroy, xio_destroy, saslmechanism_destroy ] */
     else
     {
@@ -1384,6 +1866,9 @@ void IoTHubMessaging_LL_Close(IOTHUB_MESSAGING_HANDLE messagingHandle)
         {
             free((char*)messagingHandle->sasl_plain_config.authzid);
         }
+
+        /*Codes_SRS_IOTHUBMESSAGING_40_009: [ IoTHubMessaging_LL_Close shall release the devices still waiting for their feedback without calling feedbackCallback. ] */
+        removeAllOutstandingMessages(messagingHandle);
         messagingHandle->isOpened = false;
     }
 }
@@ -1494,14 +1979,12 @@ IOTHUB_MESSAGING_RESULT IoTHubMessaging_LL_Send(IOTHUB_MESSAGING_HANDLE messagin
                 else if (addPropertiesToAMQPMessage(message, amqpMessage, to_amqp_value) != 0)
                 {
                     /*Codes_SRS_IOTHUBMESSAGING_12_040: [ If any of the uAMQP call fails IoTHubMessaging_LL_SendMessage shall return IOTHUB_MESSAGING_ERROR ] */
-                    message_destroy(amqpMessage);
                     LogError("Failed setting properties of the uAMQP message.");
                     result = IOTHUB_MESSAGING_ERROR;
                 }
                 else if (addApplicationPropertiesToAMQPMessage(message, amqpMessage) != 0)
                 {
                     /*Codes_SRS_IOTHUBMESSAGING_12_040: [ If any of the uAMQP call fails IoTHubMessaging_LL_SendMessage shall return IOTHUB_MESSAGING_ERROR ] */
-                    message_destroy(amqpMessage);
                     LogError("Failed setting application properties of the uAMQP message.");
                     result = IOTHUB_MESSAGING_ERROR;
                 }
@@ -1515,7 +1998,6 @@ IOTHUB_MESSAGING_RESULT IoTHubMessaging_LL_Send(IOTHUB_MESSAGING_HANDLE messagin
                     {
                         /*Codes_SRS_IOTHUBMESSAGING_12_040: [ If any of the uAMQP call fails IoTHubMessaging_LL_SendMessage shall return IOTHUB_MESSAGING_ERROR ] */
                         LogError("Could not set outgoing window.");
-                        message_destroy(amqpMessage);
                         result = IOTHUB_MESSAGING_ERROR;
                     }
                     else
@@ -1533,6 +2015,205 @@ IOTHUB_MESSAGING_RESULT IoTHubMessaging_LL_Send(IOTHUB_MESSAGING_HANDLE messagin
     return result;
 }
 
+static int setMessageTo(MESSAGE_HANDLE uamqp_message, const char* deviceId)
+{
+    int result;
+    char* deviceDestinationString;
+
+    if ((deviceDestinationString = createDeviceDestinationString(deviceId)) == NULL)
+    {
+        LogError("Could not create the destination of device %s", deviceId);
+        result = __FAILURE__;
+    }
+    else
+    {
+        AMQP_VALUE to_amqp_value;
+        PROPERTIES_HANDLE uamqp_message_properties = NULL;
+
+        if ((to_amqp_value = amqpvalue_create_string(deviceDestinationString)) == NULL)
+        {
+            LogError("Could not create the TO property - amqpvalue_create_string");
+            result = __FAILURE__;
+        }
+        else
+        {
+            if (message_get_properties(uamqp_message, &uamqp_message_properties) != 0 || uamqp_message_properties == NULL)
+            {
+                LogError("Failed to get properties map from uAMQP message.");
+                result = __FAILURE__;
+            }
+            else
+            {
+                if (properties_set_to(uamqp_message_properties, to_amqp_value) != 0)
+                {
+                    LogError("Could not set the TO property - properties_set_to failed");
+                    result = __FAILURE__;
+                }
+                else if (message_set_properties(uamqp_message, uamqp_message_properties) != 0)
+                {
+                    LogError("Failed to set properties map on uAMQP message.");
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    result = 0;
+                }
+                properties_destroy(uamqp_message_properties);
+            }
+            amqpvalue_destroy(to_amqp_value);
+        }
+        free(deviceDestinationString);
+    }
+    return result;
+}
+
+static MESSAGE_HANDLE createBatchMessage(IOTHUB_MESSAGE_HANDLE message, const char* firstDeviceId)
+{
+    MESSAGE_HANDLE result;
+    char* deviceDestinationString;
+    unsigned const char* messageContent;
+    size_t messageContentSize;
+
+    if (getMessageContentAndSize(message, &messageContent, &messageContentSize) != 0)
+    {
+        LogError("Failed getting the message content and message size from IOTHUB_MESSAGE_HANDLE instance.");
+        result = NULL;
+    }
+    else if ((deviceDestinationString = createDeviceDestinationString(firstDeviceId)) == NULL)
+    {
+        LogError("Could not create the destination of device %s", firstDeviceId);
+        result = NULL;
+    }
+    else
+    {
+        AMQP_VALUE to_amqp_value;
+
+        if ((result = message_create()) == NULL)
+        {
+            LogError("Could not create a message.");
+        }
+        else if ((to_amqp_value = amqpvalue_create_string(deviceDestinationString)) == NULL)
+        {
+            LogError("Could not create properties for message - amqpvalue_create_string");
+            message_destroy(result);
+            result = NULL;
+        }
+        else
+        {
+            BINARY_DATA binary_data;
+
+            binary_data.bytes = messageContent;
+            binary_data.length = messageContentSize;
+
+            if (message_add_body_amqp_data(result, binary_data) != 0)
+            {
+                LogError("Failed setting the body of the uAMQP message.");
+                message_destroy(result);
+                result = NULL;
+            }
+            else if (addPropertiesToAMQPMessage(message, result, to_amqp_value) != 0)
+            {
+                LogError("Failed setting properties of the uAMQP message.");
+                message_destroy(result);
+                result = NULL;
+            }
+            else if (addApplicationPropertiesToAMQPMessage(message, result) != 0)
+            {
+                LogError("Failed setting application properties of the uAMQP message.");
+                message_destroy(result);
+                result = NULL;
+            }
+            amqpvalue_destroy(to_amqp_value);
+        }
+        free(deviceDestinationString);
+    }
+    return result;
+}
+
+IOTHUB_MESSAGING_RESULT IoTHubMessaging_LL_SendBatch(IOTHUB_MESSAGING_HANDLE messagingHandle, const char* const* deviceIds, size_t deviceCount, IOTHUB_MESSAGE_HANDLE message, IOTHUB_SEND_BATCH_COMPLETE_CALLBACK sendCompleteCallback, IOTHUB_MESSAGE_FEEDBACK_CALLBACK feedbackCallback, void* userContextCallback)
+{
+    IOTHUB_MESSAGING_RESULT result;
+    size_t i;
+
+    /*Codes_SRS_IOTHUBMESSAGING_40_001: [ If messagingHandle, deviceIds, any of the device ids or message is NULL, or deviceCount is 0, IoTHubMessaging_LL_SendBatch shall return IOTHUB_MESSAGING_INVALID_ARG. ] */
+    if (messagingHandle == NULL || deviceIds == NULL || deviceCount == 0 || message == NULL)
+    {
+        LogError("Invalid argument (messagingHandle=%p, deviceIds=%p, deviceCount=%lu, message=%p)", messagingHandle, deviceIds, (unsigned long)deviceCount, message);
+        result = IOTHUB_MESSAGING_INVALID_ARG;
+    }
+    else
+    {
+        for (i = 0; i < deviceCount && deviceIds[i] != NULL; i++)
+        {
+        }
+
+        if (i != deviceCount)
+        {
+            LogError("Device id %lu cannot be NULL", (unsigned long)i);
+            result = IOTHUB_MESSAGING_INVALID_ARG;
+        }
+        /*Codes_SRS_IOTHUBMESSAGING_40_002: [ If the messaging has not been opened, IoTHubMessaging_LL_SendBatch shall return IOTHUB_MESSAGING_ERROR. ] */
+        else if (messagingHandle->isOpened == 0)
+        {
+            LogError("Messaging is not opened - call IoTHubMessaging_LL_Open to open");
+            result = IOTHUB_MESSAGING_ERROR;
+        }
+        else
+        {
+            MESSAGE_HANDLE amqpMessage;
+
+            /*Codes_SRS_IOTHUBMESSAGING_40_003: [ IoTHubMessaging_LL_SendBatch shall build the uAMQP message, its body, properties and application properties, once for all the devices. ] */
+            if ((amqpMessage = createBatchMessage(message, deviceIds[0])) == NULL)
+            {
+                /*Codes_SRS_IOTHUBMESSAGING_40_004: [ If the uAMQP message cannot be built, IoTHubMessaging_LL_SendBatch shall return IOTHUB_MESSAGING_ERROR without calling sendCompleteCallback. ] */
+                LogError("Could not create the batch message.");
+                result = IOTHUB_MESSAGING_ERROR;
+            }
+            else
+            {
+                const char* messageId = IoTHubMessage_GetMessageId(message);
+                size_t queued = 0;
+
+                for (i = 0; i < deviceCount; i++)
+                {
+                    OUTSTANDING_MESSAGE* outstanding;
+
+                    /*Codes_SRS_IOTHUBMESSAGING_40_005: [ For every device IoTHubMessaging_LL_SendBatch shall set the TO property, add the device to the outstanding message index and call messagesender_send_async without waiting for the previous sends to complete. ] */
+                    if (i != 0 && setMessageTo(amqpMessage, deviceIds[i]) != 0)
+                    {
+                        outstanding = NULL;
+                    }
+                    else if ((outstanding = addOutstandingMessage(messagingHandle, deviceIds[i], messageId, sendCompleteCallback, feedbackCallback, userContextCallback)) == NULL)
+                    {
+                        LogError("Could not track the message for device %s", deviceIds[i]);
+                    }
+                    else if (messagesender_send_async(messagingHandle->message_sender, amqpMessage, IoTHubMessaging_LL_BatchSendComplete, outstanding, 0) == NULL)
+                    {
+                        LogError("messagesender_send_async failed for device %s", deviceIds[i]);
+                        removeOutstandingMessage(messagingHandle, outstanding);
+                        outstanding = NULL;
+                    }
+                    else
+                    {
+                        queued++;
+                    }
+
+                    /*Codes_SRS_IOTHUBMESSAGING_40_010: [ If the message cannot be queued for a device, IoTHubMessaging_LL_SendBatch shall call sendCompleteCallback for that device with IOTHUB_MESSAGING_ERROR and continue with the next one. ] */
+                    if (outstanding == NULL && sendCompleteCallback != NULL)
+                    {
+                        sendCompleteCallback(userContextCallback, deviceIds[i], IOTHUB_MESSAGING_ERROR);
+                    }
+                }
+
+                /*Codes_SRS_IOTHUBMESSAGING_40_011: [ IoTHubMessaging_LL_SendBatch shall return IOTHUB_MESSAGING_OK if the message was queued for all the devices and IOTHUB_MESSAGING_ERROR otherwise. ] */
+                result = (queued == deviceCount) ? IOTHUB_MESSAGING_OK : IOTHUB_MESSAGING_ERROR;
+                message_destroy(amqpMessage);
+            }
+        }
+    }
+    return result;
+}
+
 void IoTHubMessaging_LL_DoWork(IOTHUB_MESSAGING_HANDLE messagingHandle)
 {
     /*Codes_SRS_IOTHUBMESSAGING_12_045: [ IoTHubMessaging_LL_DoWork shall verify if uAMQP transport has been initialized and if it is not then return immediately ] */
@@ -1541,7 +2222,22 @@ void IoTHubMessaging_LL_DoWork(IOTHUB_MESSAGING_HANDLE messagingHandle)
         /*Codes_SRS_IOTHUBMESSAGING_12_046: [ IoTHubMessaging_LL_DoWork shall call uAMQP connection_dowork ] */
         /*Codes_SRS_IOTHUBMESSAGING_12_047: [ IoTHubMessaging_LL_SendMessageComplete callback given to messagesender_send will be called with MESSAGE_SEND_RESULT ] */
         /*Codes_SRS_IOTHUBMESSAGING_12_048: [ If message has been received the IoTHubMessaging_LL_FeedbackMessageReceived callback given to messagesender_receive will be called with the received MESSAGE_HANDLE ] */
-        connection_dowork(messagingHandle->connection);
+        if (messagingHandle->sharedConnection != NULL)
+        {
+            /*Codes_SRS_IOTHUBMESSAGING_41_006: [ On a shared connection IoTHubMessaging_LL_DoWork shall create the feedback receiver link once a feedback callback is set or a device is waiting for its feedback, then call IoTHubServiceClientConnection_DoWork ] */
+            if ((messagingHandle->isOpened != 0) &&
+                (messagingHandle->message_receiver == NULL) &&
+                ((messagingHandle->callback_data->feedbackMessageCallback != NULL) || (messagingHandle->outstanding_count != 0)) &&
+                (openSharedReceiver(messagingHandle) != 0))
+            {
+                LogError("Could not open the feedback receiver");
+            }
+            IoTHubServiceClientConnection_DoWork(messagingHandle->sharedConnection);
+        }
+        else
+        {
+            connection_dowork(messagingHandle->connection);
+        }
     }
 }
 
@@ -15,6 +15,8 @@
 
 #include "parson.h"
 #include "iothub_registrymanager.h"
+#include "iothub_sc_http_pipeline.h"
+#include "internal/iothub_sc_connection_private.h"
 #include "iothub_sc_version.h"
 
 #define IOTHUB_REQUEST_MODE_VALUES    \
@@ -23,7 +25,8 @@
     IOTHUB_REQUEST_UPDATE,            \
     IOTHUB_REQUEST_DELETE,            \
     IOTHUB_REQUEST_GET_DEVICE_LIST,   \
-    IOTHUB_REQUEST_GET_STATISTICS     \
+    IOTHUB_REQUEST_GET_STATISTICS,    \
+    IOTHUB_REQUEST_QUERY_DEVICES      \
 
 DEFINE_ENUM(IOTHUB_REQUEST_MODE, IOTHUB_REQUEST_MODE_VALUES);
 
@@ -42,6 +45,8 @@ DEFINE_ENUM_STRINGS(IOTHUB_REGISTRYMANAGER_AUTH_METHOD, IOTHUB_REGISTRYMANAGER_A
 #define  HTTP_HEADER_VAL_CONTENT_TYPE  "application/json; charset=utf-8"
 #define  HTTP_HEADER_KEY_IFMATCH  "If-Match"
 #define  HTTP_HEADER_VAL_IFMATCH  "*"
+#define  HTTP_HEADER_KEY_MAX_ITEM_COUNT  "x-ms-max-item-count"
+#define  HTTP_HEADER_KEY_CONTINUATION  "x-ms-continuation"
 
 #define USING_CERT_BASED_AUTH(authMethod)  (((authMethod) == IOTHUB_REGISTRYMANAGER_AUTH_X509_THUMBPRINT) || ((authMethod) == IOTHUB_REGISTRYMANAGER_AUTH_X509_CERTIFICATE_AUTHORITY))
 
@@ -79,6 +84,9 @@ static const char* DEVICE_JSON_KEY_TOTAL_DEVICECOUNT = "totalDeviceCount";
 static const char* DEVICE_JSON_KEY_ENABLED_DEVICECCOUNT = "enabledDeviceCount";
 static const char* DEVICE_JSON_KEY_DISABLED_DEVICECOUNT = "disabledDeviceCount";
 
+static const char* DEVICE_QUERY_JSON_KEY_QUERY = "query";
+static const char* DEVICE_QUERY_ALL_DEVICES = "SELECT * FROM devices";
+
 static const char* DEVICE_JSON_DEFAULT_VALUE_ENABLED = "enabled";
 static const char* DEVICE_JSON_DEFAULT_VALUE_DISABLED = "disabled";
 static const char* DEVICE_JSON_DEFAULT_VALUE_CONNECTED = "Connected";
@@ -89,6 +97,7 @@ static const char* URL_API_VERSION = "api-version=2017-06-30";
 static const char* RELATIVE_PATH_FMT_CRUD = "/devices/%s?%s";
 static const char* RELATIVE_PATH_FMT_LIST = "/devices/?top=%s&%s";
 static const char* RELATIVE_PATH_FMT_STAT = "/statistics/devices?%s";
+static const char* RELATIVE_PATH_FMT_QUERY = "/devices/query?%s";
 
 static int strHasNoWhitespace(const char* s)
 {
@@ -1127,12 +1136,39 @@ IOTHUB_REGISTRYMANAGER_HANDLE IoTHubRegistryManager_Create(IOTHUB_SERVICE_CLIENT
                     free(result);
                     result = NULL;
                 }
+                else
+                {
+                    result->httpPipeline = NULL;
+                    result->connection = NULL;
+                }
             }
         }
     }
     return result;
 }
 
+IOTHUB_REGISTRYMANAGER_HANDLE IoTHubRegistryManager_CreateWithConnection(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle)
+{
+    IOTHUB_REGISTRYMANAGER_HANDLE result;
+
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_41_001: [ If connectionHandle is NULL IoTHubRegistryManager_CreateWithConnection shall return NULL. ] */
+    if (connectionHandle == NULL)
+    {
+        LogError("connectionHandle input parameter cannot be NULL");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_41_002: [ IoTHubRegistryManager_CreateWithConnection shall create the handle like IoTHubRegistryManager_Create from the authentication information of the connection and remember the connection. ] */
+    else if ((result = IoTHubRegistryManager_Create(IoTHubServiceClientConnection_GetAuth(connectionHandle))) == NULL)
+    {
+        LogError("IoTHubRegistryManager_Create failed");
+    }
+    else
+    {
+        result->connection = connectionHandle;
+    }
+    return result;
+}
+
 void IoTHubRegistryManager_Destroy(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle)
 {
     /*Codes_SRS_IOTHUBREGISTRYMANAGER_12_005: [ If the registryManagerHandle input parameter is NULL IoTHubRegistryManager_Destroy shall return ] */
@@ -1141,6 +1177,12 @@ void IoTHubRegistryManager_Destroy(IOTHUB_REGISTRYMANAGER_HANDLE registryManager
         /*Codes_SRS_IOTHUBREGISTRYMANAGER_12_006 : [ If the registryManagerHandle input parameter is not NULL IoTHubRegistryManager_Destroy shall free the memory of it and return ] */
         IOTHUB_REGISTRYMANAGER* regManHandle = (IOTHUB_REGISTRYMANAGER*)registryManagerHandle;
 
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_37_006: [ IoTHubRegistryManager_Destroy shall destroy the HTTP pipeline, completing the pending asynchronous requests with IOTHUB_REGISTRYMANAGER_HTTPAPI_ERROR. ] */
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_41_005: [ IoTHubRegistryManager_Destroy shall not destroy the HTTP pipeline of a shared connection. ] */
+        if (regManHandle->httpPipeline != NULL)
+        {
+            IoTHubHttpPipeline_Destroy(regManHandle->httpPipeline);
+        }
         free(regManHandle->hostname);
         free(regManHandle->iothubName);
         free(regManHandle->iothubSuffix);
@@ -1536,3 +1578,548 @@ IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_GetStatistics(IOTHUB_REGISTR
     }
     return result;
 }
+
+typedef struct IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_TAG
+{
+    HTTPAPIEX_SAS_HANDLE httpExApiSasHandle;
+    HTTPAPIEX_HANDLE httpExApiHandle;
+    BUFFER_HANDLE queryBody;
+    char pageSize[21];
+    char* continuationToken;
+    bool isComplete;
+} IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR;
+
+static BUFFER_HANDLE constructDeviceQueryJson(const char* query)
+{
+    BUFFER_HANDLE result;
+    JSON_Value* root_value;
+    JSON_Object* root_object;
+    char* serialized_string;
+
+    if ((root_value = json_value_init_object()) == NULL)
+    {
+        LogError("json_value_init_object failed");
+        result = NULL;
+    }
+    else
+    {
+        if ((root_object = json_value_get_object(root_value)) == NULL)
+        {
+            LogError("json_value_get_object failed");
+            result = NULL;
+        }
+        else if (json_object_set_string(root_object, DEVICE_QUERY_JSON_KEY_QUERY, query) != JSONSuccess)
+        {
+            LogError("json_object_set_string failed for query");
+            result = NULL;
+        }
+        else if ((serialized_string = json_serialize_to_string(root_value)) == NULL)
+        {
+            LogError("json_serialize_to_string failed");
+            result = NULL;
+        }
+        else
+        {
+            if ((result = BUFFER_create((const unsigned char*)serialized_string, strlen(serialized_string))) == NULL)
+            {
+                LogError("BUFFER_create failed");
+            }
+            json_free_serialized_string(serialized_string);
+        }
+        json_value_free(root_value);
+    }
+    return result;
+}
+
+static IOTHUB_REGISTRYMANAGER_RESULT parseDevicePageJson(BUFFER_HANDLE jsonBuffer, IOTHUB_REGISTRYMANAGER_DEVICE_CALLBACK callback, void* userContext)
+{
+    IOTHUB_REGISTRYMANAGER_RESULT result;
+    STRING_HANDLE jsonString;
+    JSON_Value* root_value;
+    JSON_Array* device_array;
+
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_011: [ IoTHubRegistryManager_GetNextDevicePage shall parse the page and, for every device in it, fill an IOTHUB_DEVICE, pass it to callback and free its members before moving to the next device. ]*/
+    if ((jsonString = STRING_from_byte_array(BUFFER_u_char(jsonBuffer), BUFFER_length(jsonBuffer))) == NULL)
+    {
+        LogError("STRING_from_byte_array failed for the device page");
+        result = IOTHUB_REGISTRYMANAGER_ERROR;
+    }
+    else
+    {
+        if ((root_value = json_parse_string(STRING_c_str(jsonString))) == NULL)
+        {
+            /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_012: [ If the page cannot be parsed, IoTHubRegistryManager_GetNextDevicePage shall return IOTHUB_REGISTRYMANAGER_JSON_ERROR. ]*/
+            LogError("json_parse_string failed");
+            result = IOTHUB_REGISTRYMANAGER_JSON_ERROR;
+        }
+        else
+        {
+            if ((device_array = json_value_get_array(root_value)) == NULL)
+            {
+                LogError("json_value_get_array failed");
+                result = IOTHUB_REGISTRYMANAGER_JSON_ERROR;
+            }
+            else
+            {
+                size_t array_count = json_array_get_count(device_array);
+                size_t i;
+
+                result = IOTHUB_REGISTRYMANAGER_OK;
+                for (i = 0; i < array_count && result == IOTHUB_REGISTRYMANAGER_OK; i++)
+                {
+                    JSON_Object* device_object;
+                    IOTHUB_DEVICE device;
+
+                    if ((device_object = json_array_get_object(device_array, i)) == NULL)
+                    {
+                        LogError("json_array_get_object failed");
+                        result = IOTHUB_REGISTRYMANAGER_JSON_ERROR;
+                    }
+                    else
+                    {
+                        initializeDeviceInfoMembers(&device);
+                        if ((result = parseDeviceJsonObject(device_object, &device)) == IOTHUB_REGISTRYMANAGER_OK)
+                        {
+                            callback(&device, userContext);
+                        }
+                        freeDeviceInfoMembers(&device);
+                    }
+                }
+            }
+            json_value_free(root_value);
+        }
+        STRING_delete(jsonString);
+    }
+    return result;
+}
+
+static HTTP_HEADERS_HANDLE createDeviceQueryHttpHeader(IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR* iterator)
+{
+    HTTP_HEADERS_HANDLE httpHeader;
+
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_008: [ IoTHubRegistryManager_GetNextDevicePage shall POST the query to url/devices/query?api-version with the registry request headers, x-ms-max-item-count set to pageSize and, after the first page, x-ms-continuation set to the token returned with the previous page. ]*/
+    if ((httpHeader = createHttpHeader(IOTHUB_REQUEST_QUERY_DEVICES)) == NULL)
+    {
+        LogError("HttpHeader creation failed");
+    }
+    else if (HTTPHeaders_AddHeaderNameValuePair(httpHeader, HTTP_HEADER_KEY_MAX_ITEM_COUNT, iterator->pageSize) != HTTP_HEADERS_OK)
+    {
+        LogError("HTTPHeaders_AddHeaderNameValuePair failed for x-ms-max-item-count header");
+        HTTPHeaders_Free(httpHeader);
+        httpHeader = NULL;
+    }
+    else if ((iterator->continuationToken != NULL) && (HTTPHeaders_AddHeaderNameValuePair(httpHeader, HTTP_HEADER_KEY_CONTINUATION, iterator->continuationToken) != HTTP_HEADERS_OK))
+    {
+        LogError("HTTPHeaders_AddHeaderNameValuePair failed for x-ms-continuation header");
+        HTTPHeaders_Free(httpHeader);
+        httpHeader = NULL;
+    }
+    return httpHeader;
+}
+
+IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE IoTHubRegistryManager_CreateDeviceIterator(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle, const char* query, size_t pageSize)
+{
+    IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR* result;
+
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_001: [ If registryManagerHandle is NULL or pageSize is not between 1 and 1000, IoTHubRegistryManager_CreateDeviceIterator shall return NULL. ]*/
+    if (registryManagerHandle == NULL)
+    {
+        LogError("Input parameter cannot be NULL");
+        result = NULL;
+    }
+    else if ((pageSize == 0) || (pageSize > IOTHUB_DEVICES_MAX_REQUEST))
+    {
+        LogError("pageSize has to be between 1 and 1000");
+        result = NULL;
+    }
+    else if ((result = malloc(sizeof(IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_004: [ If any of the calls fails, IoTHubRegistryManager_CreateDeviceIterator shall clean up and return NULL. ]*/
+        LogError("Malloc failed for IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR");
+    }
+    else
+    {
+        STRING_HANDLE uriResouce = NULL;
+        STRING_HANDLE accessKey = NULL;
+        STRING_HANDLE keyName = NULL;
+
+        memset(result, 0, sizeof(IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR));
+        (void)snprintf(result->pageSize, sizeof(result->pageSize), "%lu", (unsigned long)pageSize);
+
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_002: [ IoTHubRegistryManager_CreateDeviceIterator shall serialize { "query": query } once for all the pages, using "SELECT * FROM devices" if query is NULL. ]*/
+        if ((result->queryBody = constructDeviceQueryJson((query == NULL) ? DEVICE_QUERY_ALL_DEVICES : query)) == NULL)
+        {
+            LogError("Failure creating the device query JSON");
+        }
+        else if ((uriResouce = STRING_construct(registryManagerHandle->hostname)) == NULL)
+        {
+            LogError("STRING_construct failed for uriResource");
+        }
+        else if ((accessKey = STRING_construct(registryManagerHandle->sharedAccessKey)) == NULL)
+        {
+            LogError("STRING_construct failed for accessKey");
+        }
+        else if ((keyName = STRING_construct(registryManagerHandle->keyName)) == NULL)
+        {
+            LogError("STRING_construct failed for keyName");
+        }
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_003: [ IoTHubRegistryManager_CreateDeviceIterator shall create the HTTPAPIEX_SAS_HANDLE and HTTPAPIEX_HANDLE used by all the pages, so that the pages share one connection. ]*/
+        else if ((result->httpExApiSasHandle = HTTPAPIEX_SAS_Create(accessKey, uriResouce, keyName)) == NULL)
+        {
+            LogError("HTTPAPIEX_SAS_Create failed");
+        }
+        else if ((result->httpExApiHandle = HTTPAPIEX_Create(registryManagerHandle->hostname)) == NULL)
+        {
+            LogError("HTTPAPIEX_Create failed");
+        }
+
+        STRING_delete(keyName);
+        STRING_delete(accessKey);
+        STRING_delete(uriResouce);
+
+        if (result->httpExApiHandle == NULL)
+        {
+            IoTHubRegistryManager_DestroyDeviceIterator(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_GetNextDevicePage(IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE iteratorHandle, IOTHUB_REGISTRYMANAGER_DEVICE_CALLBACK callback, void* userContext, bool* hasMorePages)
+{
+    IOTHUB_REGISTRYMANAGER_RESULT result;
+
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_006: [ If iteratorHandle, callback or hasMorePages is NULL, IoTHubRegistryManager_GetNextDevicePage shall return IOTHUB_REGISTRYMANAGER_INVALID_ARG. ]*/
+    if ((iteratorHandle == NULL) || (callback == NULL) || (hasMorePages == NULL))
+    {
+        LogError("Input parameter cannot be NULL");
+        result = IOTHUB_REGISTRYMANAGER_INVALID_ARG;
+    }
+    else if (iteratorHandle->isComplete)
+    {
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_007: [ Once the last page has been delivered, IoTHubRegistryManager_GetNextDevicePage shall set hasMorePages to false and return IOTHUB_REGISTRYMANAGER_OK without sending a request. ]*/
+        *hasMorePages = false;
+        result = IOTHUB_REGISTRYMANAGER_OK;
+    }
+    else
+    {
+        HTTP_HEADERS_HANDLE requestHeaders = NULL;
+        HTTP_HEADERS_HANDLE responseHeaders = NULL;
+        BUFFER_HANDLE responseBuffer = NULL;
+        char relativePath[256];
+        unsigned int statusCode;
+
+        if ((requestHeaders = createDeviceQueryHttpHeader(iteratorHandle)) == NULL)
+        {
+            result = IOTHUB_REGISTRYMANAGER_HTTPAPI_ERROR;
+        }
+        else if ((responseHeaders = HTTPHeaders_Alloc()) == NULL)
+        {
+            LogError("HTTPHeaders_Alloc failed for the response headers");
+            result = IOTHUB_REGISTRYMANAGER_HTTPAPI_ERROR;
+        }
+        else if ((responseBuffer = BUFFER_new()) == NULL)
+        {
+            LogError("BUFFER_new failed for responseBuffer");
+            result = IOTHUB_REGISTRYMANAGER_ERROR;
+        }
+        else if (snprintf(relativePath, sizeof(relativePath), RELATIVE_PATH_FMT_QUERY, URL_API_VERSION) <= 0)
+        {
+            LogError("Failure creating relative path");
+            result = IOTHUB_REGISTRYMANAGER_ERROR;
+        }
+        else if (HTTPAPIEX_SAS_ExecuteRequest(iteratorHandle->httpExApiSasHandle, iteratorHandle->httpExApiHandle, HTTPAPI_REQUEST_POST, relativePath, requestHeaders, iteratorHandle->queryBody, &statusCode, responseHeaders, responseBuffer) != HTTPAPIEX_OK)
+        {
+            /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_009: [ If the request fails, IoTHubRegistryManager_GetNextDevicePage shall return IOTHUB_REGISTRYMANAGER_HTTPAPI_ERROR and stay on the same page. ]*/
+            LogError("HTTPAPIEX_SAS_ExecuteRequest failed");
+            result = IOTHUB_REGISTRYMANAGER_HTTPAPI_ERROR;
+        }
+        else if (statusCode > 300)
+        {
+            /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_010: [ If the status code is greater than 300, IoTHubRegistryManager_GetNextDevicePage shall return IOTHUB_REGISTRYMANAGER_HTTP_STATUS_ERROR and stay on the same page. ]*/
+            LogError("Http Failure status code %d.", statusCode);
+            result = IOTHUB_REGISTRYMANAGER_HTTP_STATUS_ERROR;
+        }
+        else if ((result = parseDevicePageJson(responseBuffer, callback, userContext)) != IOTHUB_REGISTRYMANAGER_OK)
+        {
+            LogError("Failure parsing the device page");
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_013: [ IoTHubRegistryManager_GetNextDevicePage shall keep the x-ms-continuation response header for the next page; if there is none it shall mark the enumeration complete. ]*/
+            const char* continuationToken = HTTPHeaders_FindHeaderValue(responseHeaders, HTTP_HEADER_KEY_CONTINUATION);
+            char* nextToken = NULL;
+
+            if ((continuationToken != NULL) && (continuationToken[0] != '\0') && (mallocAndStrcpy_s(&nextToken, continuationToken) != 0))
+            {
+                LogError("mallocAndStrcpy_s failed for the continuation token");
+                result = IOTHUB_REGISTRYMANAGER_ERROR;
+            }
+            else
+            {
+                free(iteratorHandle->continuationToken);
+                iteratorHandle->continuationToken = nextToken;
+                iteratorHandle->isComplete = (nextToken == NULL);
+            }
+        }
+
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_014: [ IoTHubRegistryManager_GetNextDevicePage shall set hasMorePages to true while the enumeration is not complete. ]*/
+        *hasMorePages = !iteratorHandle->isComplete;
+
+        BUFFER_delete(responseBuffer);
+        HTTPHeaders_Free(responseHeaders);
+        HTTPHeaders_Free(requestHeaders);
+    }
+    return result;
+}
+
+void IoTHubRegistryManager_DestroyDeviceIterator(IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE iteratorHandle)
+{
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_39_005: [ IoTHubRegistryManager_DestroyDeviceIterator shall do nothing if iteratorHandle is NULL, otherwise it shall release the HTTPAPIEX handles, the query and the continuation token. ]*/
+    if (iteratorHandle != NULL)
+    {
+        HTTPAPIEX_Destroy(iteratorHandle->httpExApiHandle);
+        HTTPAPIEX_SAS_Destroy(iteratorHandle->httpExApiSasHandle);
+        BUFFER_delete(iteratorHandle->queryBody);
+        free(iteratorHandle->continuationToken);
+        free(iteratorHandle);
+    }
+}
+
+typedef struct REGISTRYMANAGER_ASYNC_CONTEXT_TAG
+{
+    IOTHUB_REQUEST_MODE iotHubRequestMode;
+    IOTHUB_REGISTRYMANAGER_GET_DEVICE_CALLBACK getDeviceCallback;
+    IOTHUB_REGISTRYMANAGER_RESULT_CALLBACK resultCallback;
+    void* userContext;
+} REGISTRYMANAGER_ASYNC_CONTEXT;
+
+static IOTHUB_REGISTRYMANAGER_RESULT getAsyncResult(IOTHUB_REQUEST_MODE iotHubRequestMode, IOTHUB_HTTP_PIPELINE_RESULT pipelineResult, unsigned int statusCode)
+{
+    IOTHUB_REGISTRYMANAGER_RESULT result;
+
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_37_003: [ The asynchronous requests shall map the outcome as the synchronous ones do: IOTHUB_REGISTRYMANAGER_HTTPAPI_ERROR if the request could not be carried, IOTHUB_REGISTRYMANAGER_DEVICE_NOT_EXIST for a 404 on get, IOTHUB_REGISTRYMANAGER_HTTP_STATUS_ERROR for any other status code greater than 300. ] */
+    if (pipelineResult != IOTHUB_HTTP_PIPELINE_OK)
+    {
+        LogError("Registry request failed %s", ENUM_TO_STRING(IOTHUB_HTTP_PIPELINE_RESULT, pipelineResult));
+        result = IOTHUB_REGISTRYMANAGER_HTTPAPI_ERROR;
+    }
+    else if (statusCode > 300)
+    {
+        if ((iotHubRequestMode == IOTHUB_REQUEST_GET) && (statusCode == 404))
+        {
+            result = IOTHUB_REGISTRYMANAGER_DEVICE_NOT_EXIST;
+        }
+        else
+        {
+            LogError("Http Failure status code %d.", statusCode);
+            result = IOTHUB_REGISTRYMANAGER_HTTP_STATUS_ERROR;
+        }
+    }
+    else
+    {
+        result = IOTHUB_REGISTRYMANAGER_OK;
+    }
+    return result;
+}
+
+static void on_registry_response(IOTHUB_HTTP_PIPELINE_RESULT pipelineResult, unsigned int statusCode, const unsigned char* content, size_t contentLength, void* context)
+{
+    REGISTRYMANAGER_ASYNC_CONTEXT* asyncContext = (REGISTRYMANAGER_ASYNC_CONTEXT*)context;
+    IOTHUB_REGISTRYMANAGER_RESULT result = getAsyncResult(asyncContext->iotHubRequestMode, pipelineResult, statusCode);
+
+    if (asyncContext->iotHubRequestMode == IOTHUB_REQUEST_GET)
+    {
+        BUFFER_HANDLE responseBuffer;
+        IOTHUB_DEVICE deviceInfo;
+
+        initializeDeviceInfoMembers(&deviceInfo);
+        if (result != IOTHUB_REGISTRYMANAGER_OK)
+        {
+            asyncContext->getDeviceCallback(result, NULL, asyncContext->userContext);
+        }
+        else if ((responseBuffer = BUFFER_create(content, contentLength)) == NULL)
+        {
+            LogError("BUFFER_create failed for responseBuffer");
+            asyncContext->getDeviceCallback(IOTHUB_REGISTRYMANAGER_ERROR, NULL, asyncContext->userContext);
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBREGISTRYMANAGER_37_004: [ On success the get device callback shall receive the parsed device info, which is freed when the callback returns; an empty device shall be reported as IOTHUB_REGISTRYMANAGER_DEVICE_NOT_EXIST. ] */
+            if ((result = parseDeviceJson(responseBuffer, &deviceInfo)) != IOTHUB_REGISTRYMANAGER_OK)
+            {
+                asyncContext->getDeviceCallback(result, NULL, asyncContext->userContext);
+            }
+            else if (deviceInfo.deviceId == NULL)
+            {
+                asyncContext->getDeviceCallback(IOTHUB_REGISTRYMANAGER_DEVICE_NOT_EXIST, NULL, asyncContext->userContext);
+            }
+            else
+            {
+                asyncContext->getDeviceCallback(IOTHUB_REGISTRYMANAGER_OK, &deviceInfo, asyncContext->userContext);
+            }
+            freeDeviceInfoMembers(&deviceInfo);
+            BUFFER_delete(responseBuffer);
+        }
+    }
+    else
+    {
+        asyncContext->resultCallback(result, asyncContext->userContext);
+    }
+    free(asyncContext);
+}
+
+static IOTHUB_HTTP_PIPELINE_HANDLE getHttpPipeline(IOTHUB_REGISTRYMANAGER* registryManager)
+{
+    IOTHUB_HTTP_PIPELINE_HANDLE result;
+
+    if (registryManager->connection != NULL)
+    {
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_41_003: [ A handle created with IoTHubRegistryManager_CreateWithConnection shall queue its asynchronous requests on the HTTP pipeline of the connection. ] */
+        result = IoTHubServiceClientConnection_GetHttpPipeline(registryManager->connection);
+    }
+    else
+    {
+        if (registryManager->httpPipeline == NULL)
+        {
+            registryManager->httpPipeline = IoTHubHttpPipeline_Create(registryManager->hostname, registryManager->sharedAccessKey, registryManager->keyName);
+        }
+        result = registryManager->httpPipeline;
+    }
+    return result;
+}
+
+static IOTHUB_REGISTRYMANAGER_RESULT sendAsyncRequestCRUD(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle, IOTHUB_REQUEST_MODE iotHubRequestMode, const char* deviceId, REGISTRYMANAGER_ASYNC_CONTEXT* asyncContext)
+{
+    IOTHUB_REGISTRYMANAGER_RESULT result;
+    IOTHUB_HTTP_PIPELINE_HANDLE httpPipeline;
+    char relativePath[256];
+
+    if ((httpPipeline = getHttpPipeline(registryManagerHandle)) == NULL)
+    {
+        LogError("Failure creating the HTTP pipeline");
+        result = IOTHUB_REGISTRYMANAGER_ERROR;
+    }
+    else if (createRelativePath(iotHubRequestMode, deviceId, 0, relativePath) != IOTHUB_REGISTRYMANAGER_OK)
+    {
+        LogError("Failure creating relative path");
+        result = IOTHUB_REGISTRYMANAGER_ERROR;
+    }
+    else
+    {
+        HTTP_CLIENT_REQUEST_TYPE requestType = (iotHubRequestMode == IOTHUB_REQUEST_DELETE) ? HTTP_CLIENT_REQUEST_DELETE : HTTP_CLIENT_REQUEST_GET;
+        const char* ifMatch = (iotHubRequestMode == IOTHUB_REQUEST_DELETE) ? HTTP_HEADER_VAL_IFMATCH : NULL;
+
+        asyncContext->iotHubRequestMode = iotHubRequestMode;
+        if (IoTHubHttpPipeline_ExecuteRequest(httpPipeline, requestType, relativePath, ifMatch, NULL, 0, on_registry_response, asyncContext) != IOTHUB_HTTP_PIPELINE_OK)
+        {
+            LogError("IoTHubHttpPipeline_ExecuteRequest failed");
+            result = IOTHUB_REGISTRYMANAGER_ERROR;
+        }
+        else
+        {
+            result = IOTHUB_REGISTRYMANAGER_OK;
+        }
+    }
+    return result;
+}
+
+IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_GetDeviceAsync(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle, const char* deviceId, IOTHUB_REGISTRYMANAGER_GET_DEVICE_CALLBACK callback, void* userContext)
+{
+    IOTHUB_REGISTRYMANAGER_RESULT result;
+    REGISTRYMANAGER_ASYNC_CONTEXT* asyncContext;
+
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_37_001: [ If registryManagerHandle, deviceId or callback is NULL, IoTHubRegistryManager_GetDeviceAsync and IoTHubRegistryManager_DeleteDeviceAsync shall return IOTHUB_REGISTRYMANAGER_INVALID_ARG. ] */
+    if ((registryManagerHandle == NULL) || (deviceId == NULL) || (callback == NULL))
+    {
+        LogError("Input parameter cannot be NULL");
+        result = IOTHUB_REGISTRYMANAGER_INVALID_ARG;
+    }
+    else if ((asyncContext = malloc(sizeof(REGISTRYMANAGER_ASYNC_CONTEXT))) == NULL)
+    {
+        LogError("Malloc failed for REGISTRYMANAGER_ASYNC_CONTEXT");
+        result = IOTHUB_REGISTRYMANAGER_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_37_002: [ IoTHubRegistryManager_GetDeviceAsync and IoTHubRegistryManager_DeleteDeviceAsync shall queue the HTTP GET or DELETE request on the handle's HTTP pipeline, creating the pipeline on first use, and return IOTHUB_REGISTRYMANAGER_ERROR if that fails. ] */
+        asyncContext->getDeviceCallback = callback;
+        asyncContext->resultCallback = NULL;
+        asyncContext->userContext = userContext;
+        if ((result = sendAsyncRequestCRUD(registryManagerHandle, IOTHUB_REQUEST_GET, deviceId, asyncContext)) != IOTHUB_REGISTRYMANAGER_OK)
+        {
+            free(asyncContext);
+        }
+    }
+    return result;
+}
+
+IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_DeleteDeviceAsync(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle, const char* deviceId, IOTHUB_REGISTRYMANAGER_RESULT_CALLBACK callback, void* userContext)
+{
+    IOTHUB_REGISTRYMANAGER_RESULT result;
+    REGISTRYMANAGER_ASYNC_CONTEXT* asyncContext;
+
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_37_001: [ If registryManagerHandle, deviceId or callback is NULL, IoTHubRegistryManager_GetDeviceAsync and IoTHubRegistryManager_DeleteDeviceAsync shall return IOTHUB_REGISTRYMANAGER_INVALID_ARG. ] */
+    if ((registryManagerHandle == NULL) || (deviceId == NULL) || (callback == NULL))
+    {
+        LogError("Input parameter cannot be NULL");
+        result = IOTHUB_REGISTRYMANAGER_INVALID_ARG;
+    }
+    else if ((asyncContext = malloc(sizeof(REGISTRYMANAGER_ASYNC_CONTEXT))) == NULL)
+    {
+        LogError("Malloc failed for REGISTRYMANAGER_ASYNC_CONTEXT");
+        result = IOTHUB_REGISTRYMANAGER_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_37_002: [ IoTHubRegistryManager_GetDeviceAsync and IoTHubRegistryManager_DeleteDeviceAsync shall queue the HTTP GET or DELETE request on the handle's HTTP pipeline, creating the pipeline on first use, and return IOTHUB_REGISTRYMANAGER_ERROR if that fails. ] */
+        asyncContext->getDeviceCallback = NULL;
+        asyncContext->resultCallback = callback;
+        asyncContext->userContext = userContext;
+        if ((result = sendAsyncRequestCRUD(registryManagerHandle, IOTHUB_REQUEST_DELETE, deviceId, asyncContext)) != IOTHUB_REGISTRYMANAGER_OK)
+        {
+            free(asyncContext);
+        }
+    }
+    return result;
+}
+
+void IoTHubRegistryManager_DoWork(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle)
+{
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_37_005: [ IoTHubRegistryManager_DoWork shall call IoTHubHttpPipeline_DoWork when the pipeline exists and do nothing otherwise. ] */
+    if ((registryManagerHandle != NULL) && (registryManagerHandle->httpPipeline != NULL))
+    {
+        IoTHubHttpPipeline_DoWork(registryManagerHandle->httpPipeline);
+    }
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_41_004: [ IoTHubRegistryManager_DoWork shall call IoTHubServiceClientConnection_DoWork when the handle was created with a connection. ] */
+    else if ((registryManagerHandle != NULL) && (registryManagerHandle->connection != NULL))
+    {
+        IoTHubServiceClientConnection_DoWork(registryManagerHandle->connection);
+    }
+}
+
+IOTHUB_REGISTRYMANAGER_RESULT IoTHubRegistryManager_SetOption(IOTHUB_REGISTRYMANAGER_HANDLE registryManagerHandle, const char* optionName, const void* value)
+{
+    IOTHUB_REGISTRYMANAGER_RESULT result;
+    IOTHUB_HTTP_PIPELINE_HANDLE httpPipeline;
+
+    /*Codes_SRS_IOTHUBREGISTRYMANAGER_37_007: [ If any parameter is NULL, IoTHubRegistryManager_SetOption shall return IOTHUB_REGISTRYMANAGER_INVALID_ARG. ] */
+    if ((registryManagerHandle == NULL) || (optionName == NULL) || (value == NULL))
+    {
+        LogError("Input parameter cannot be NULL");
+        result = IOTHUB_REGISTRYMANAGER_INVALID_ARG;
+    }
+    else if ((httpPipeline = getHttpPipeline(registryManagerHandle)) == NULL)
+    {
+        LogError("Failure creating the HTTP pipeline");
+        result = IOTHUB_REGISTRYMANAGER_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBREGISTRYMANAGER_37_008: [ IoTHubRegistryManager_SetOption shall pass the option to IoTHubHttpPipeline_SetOption and map its result. ] */
+        IOTHUB_HTTP_PIPELINE_RESULT pipelineResult = IoTHubHttpPipeline_SetOption(httpPipeline, optionName, value);
+        result = (pipelineResult == IOTHUB_HTTP_PIPELINE_OK) ? IOTHUB_REGISTRYMANAGER_OK : ((pipelineResult == IOTHUB_HTTP_PIPELINE_INVALID_ARG) ? IOTHUB_REGISTRYMANAGER_INVALID_ARG : IOTHUB_REGISTRYMANAGER_ERROR);
+    }
+    return result;
+}
@@ -0,0 +1,422 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/sastoken.h"
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/tlsio.h"
+
+#include "azure_uamqp_c/connection.h"
+#include "azure_uamqp_c/session.h"
+#include "azure_uamqp_c/sasl_mechanism.h"
+#include "azure_uamqp_c/saslclientio.h"
+#include "azure_uamqp_c/sasl_plain.h"
+
+#include "iothub_sc_connection.h"
+#include "internal/iothub_sc_connection_private.h"
+
+DEFINE_ENUM_STRINGS(IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT, IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT_VALUES);
+
+#define AMQP_PORT                   5671
+#define AMQP_SAS_TOKEN_LIFETIME     (365 * 24 * 60 * 60)
+#define AMQP_INCOMING_WINDOW        2147483647
+#define AMQP_OUTGOING_WINDOW        (255 * 1024)
+static const char* AMQP_AUTHCID_FMT = "%s@sas.root.%s";
+static const char* TRUSTED_CERT_OPTION = "TrustedCerts";
+
+typedef struct IOTHUB_SERVICE_CLIENT_CONNECTION_TAG
+{
+    IOTHUB_SERVICE_CLIENT_AUTH auth;
+    char* trustedCert;
+
+    IOTHUB_HTTP_PIPELINE_HANDLE httpPipeline;
+
+    SASL_PLAIN_CONFIG sasl_plain_config;
+    SASL_MECHANISM_HANDLE sasl_mechanism_handle;
+    XIO_HANDLE tls_io;
+    XIO_HANDLE sasl_io;
+    CONNECTION_HANDLE connection;
+    SESSION_HANDLE session;
+    bool isSessionAttached;
+} IOTHUB_SERVICE_CLIENT_CONNECTION;
+
+static void freeAuth(IOTHUB_SERVICE_CLIENT_AUTH* auth)
+{
+    free(auth->hostname);
+    free(auth->iothubName);
+    free(auth->iothubSuffix);
+    free(auth->sharedAccessKey);
+    free(auth->keyName);
+}
+
+static char* createAuthCid(IOTHUB_SERVICE_CLIENT_CONNECTION* connection)
+{
+    char* result;
+    size_t authCidLen = strlen(AMQP_AUTHCID_FMT) + strlen(connection->auth.keyName) + strlen(connection->auth.iothubName);
+
+    if ((result = (char*)malloc(authCidLen + 1)) == NULL)
+    {
+        LogError("Malloc failed for authCid.");
+    }
+    else if (snprintf(result, authCidLen + 1, AMQP_AUTHCID_FMT, connection->auth.keyName, connection->auth.iothubName) < 0)
+    {
+        LogError("snprintf failed for authCid.");
+        free(result);
+        result = NULL;
+    }
+    return result;
+}
+
+static char* createSasToken(IOTHUB_SERVICE_CLIENT_CONNECTION* connection)
+{
+    char* result;
+    size_t expiry = (size_t)(time(NULL) + AMQP_SAS_TOKEN_LIFETIME);
+    STRING_HANDLE sasToken;
+
+    if ((sasToken = SASToken_CreateString(connection->auth.sharedAccessKey, connection->auth.hostname, connection->auth.keyName, expiry)) == NULL)
+    {
+        LogError("SASToken_CreateString failed");
+        result = NULL;
+    }
+    else
+    {
+        if (mallocAndStrcpy_s(&result, STRING_c_str(sasToken)) != 0)
+        {
+            LogError("mallocAndStrcpy_s failed for the SAS token");
+            result = NULL;
+        }
+        STRING_delete(sasToken);
+    }
+    return result;
+}
+
+static void closeAmqpConnection(IOTHUB_SERVICE_CLIENT_CONNECTION* connection)
+{
+    session_destroy(connection->session);
+    connection_destroy(connection->connection);
+    xio_destroy(connection->sasl_io);
+    xio_destroy(connection->tls_io);
+    saslmechanism_destroy(connection->sasl_mechanism_handle);
+    free((char*)connection->sasl_plain_config.authcid);
+    free((char*)connection->sasl_plain_config.passwd);
+
+    connection->session = NULL;
+    connection->connection = NULL;
+    connection->sasl_io = NULL;
+    connection->tls_io = NULL;
+    connection->sasl_mechanism_handle = NULL;
+    connection->sasl_plain_config.authcid = NULL;
+    connection->sasl_plain_config.passwd = NULL;
+}
+
+static int openAmqpConnection(IOTHUB_SERVICE_CLIENT_CONNECTION* connection)
+{
+    int result;
+    const SASL_MECHANISM_INTERFACE_DESCRIPTION* sasl_mechanism_interface;
+    const IO_INTERFACE_DESCRIPTION* tlsio_interface;
+    const IO_INTERFACE_DESCRIPTION* saslclientio_interface;
+    TLSIO_CONFIG tls_io_config;
+    SASLCLIENTIO_CONFIG sasl_io_config;
+
+    memset(&tls_io_config, 0, sizeof(TLSIO_CONFIG));
+    tls_io_config.hostname = connection->auth.hostname;
+    tls_io_config.port = AMQP_PORT;
+
+    /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_010: [ On the first attach IoTHubServiceClientConnection_AttachAmqpSession shall create a SASL PLAIN mechanism authenticated with the shared access policy, a TLS IO on port 5671, a SASL client IO, the AMQP connection and the AMQP session, without waiting for any of them to open. ]*/
+    if ((connection->sasl_plain_config.authcid = createAuthCid(connection)) == NULL)
+    {
+        LogError("Could not create authCid");
+        result = __FAILURE__;
+    }
+    else if ((connection->sasl_plain_config.passwd = createSasToken(connection)) == NULL)
+    {
+        LogError("Could not create sasToken");
+        result = __FAILURE__;
+    }
+    else if ((sasl_mechanism_interface = saslplain_get_interface()) == NULL)
+    {
+        LogError("Could not get SASL plain mechanism interface.");
+        result = __FAILURE__;
+    }
+    else if ((connection->sasl_mechanism_handle = saslmechanism_create(sasl_mechanism_interface, &connection->sasl_plain_config)) == NULL)
+    {
+        LogError("Could not create SASL plain mechanism.");
+        result = __FAILURE__;
+    }
+    else if ((tlsio_interface = platform_get_default_tlsio()) == NULL)
+    {
+        LogError("Could not get default TLS IO interface.");
+        result = __FAILURE__;
+    }
+    else if ((connection->tls_io = xio_create(tlsio_interface, &tls_io_config)) == NULL)
+    {
+        LogError("Could not create TLS IO.");
+        result = __FAILURE__;
+    }
+    else if ((connection->trustedCert != NULL) && (xio_setoption(connection->tls_io, TRUSTED_CERT_OPTION, connection->trustedCert) != 0))
+    {
+        LogError("Could not set the trusted certificates on the TLS IO.");
+        result = __FAILURE__;
+    }
+    else if ((saslclientio_interface = saslclientio_get_interface_description()) == NULL)
+    {
+        LogError("Could not get SASL IO interface description.");
+        result = __FAILURE__;
+    }
+    else
+    {
+        sasl_io_config.sasl_mechanism = connection->sasl_mechanism_handle;
+        sasl_io_config.underlying_io = connection->tls_io;
+
+        if ((connection->sasl_io = xio_create(saslclientio_interface, &sasl_io_config)) == NULL)
+        {
+            LogError("Could not create SASL IO.");
+            result = __FAILURE__;
+        }
+        else if ((connection->connection = connection_create(connection->sasl_io, connection->auth.hostname, "some", NULL, NULL)) == NULL)
+        {
+            LogError("Could not create connection.");
+            result = __FAILURE__;
+        }
+        else if ((connection->session = session_create(connection->connection, NULL, NULL)) == NULL)
+        {
+            LogError("Could not create session.");
+            result = __FAILURE__;
+        }
+        else if (session_set_incoming_window(connection->session, AMQP_INCOMING_WINDOW) != 0)
+        {
+            LogError("Could not set incoming window.");
+            result = __FAILURE__;
+        }
+        else if (session_set_outgoing_window(connection->session, AMQP_OUTGOING_WINDOW) != 0)
+        {
+            LogError("Could not set outgoing window.");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    if (result != 0)
+    {
+        /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_011: [ If any of the AMQP objects cannot be created IoTHubServiceClientConnection_AttachAmqpSession shall destroy the ones already created and return NULL. ]*/
+        closeAmqpConnection(connection);
+    }
+    return result;
+}
+
+IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE IoTHubServiceClientConnection_Create(IOTHUB_SERVICE_CLIENT_AUTH_HANDLE serviceClientHandle)
+{
+    IOTHUB_SERVICE_CLIENT_CONNECTION* result;
+
+    /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_001: [ If serviceClientHandle or any of its members is NULL, IoTHubServiceClientConnection_Create shall return NULL. ]*/
+    if ((serviceClientHandle == NULL) ||
+        (serviceClientHandle->hostname == NULL) ||
+        (serviceClientHandle->iothubName == NULL) ||
+        (serviceClientHandle->iothubSuffix == NULL) ||
+        (serviceClientHandle->sharedAccessKey == NULL) ||
+        (serviceClientHandle->keyName == NULL))
+    {
+        LogError("Invalid service client auth");
+        result = NULL;
+    }
+    else if ((result = (IOTHUB_SERVICE_CLIENT_CONNECTION*)malloc(sizeof(IOTHUB_SERVICE_CLIENT_CONNECTION))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_003: [ If any allocation fails, IoTHubServiceClientConnection_Create shall free what it allocated and return NULL. ]*/
+        LogError("Malloc failed for IOTHUB_SERVICE_CLIENT_CONNECTION");
+    }
+    else
+    {
+        memset(result, 0, sizeof(IOTHUB_SERVICE_CLIENT_CONNECTION));
+
+        /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_002: [ IoTHubServiceClientConnection_Create shall copy the authentication information and shall not open any connection. ]*/
+        if ((mallocAndStrcpy_s(&result->auth.hostname, serviceClientHandle->hostname) != 0) ||
+            (mallocAndStrcpy_s(&result->auth.iothubName, serviceClientHandle->iothubName) != 0) ||
+            (mallocAndStrcpy_s(&result->auth.iothubSuffix, serviceClientHandle->iothubSuffix) != 0) ||
+            (mallocAndStrcpy_s(&result->auth.sharedAccessKey, serviceClientHandle->sharedAccessKey) != 0) ||
+            (mallocAndStrcpy_s(&result->auth.keyName, serviceClientHandle->keyName) != 0))
+        {
+            /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_003: [ If any allocation fails, IoTHubServiceClientConnection_Create shall free what it allocated and return NULL. ]*/
+            LogError("mallocAndStrcpy_s failed for the service client auth");
+            freeAuth(&result->auth);
+            free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+void IoTHubServiceClientConnection_Destroy(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle)
+{
+    /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_004: [ If connectionHandle is NULL, IoTHubServiceClientConnection_Destroy shall return. ]*/
+    if (connectionHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_005: [ IoTHubServiceClientConnection_Destroy shall destroy the HTTP pipeline and the AMQP session and connection when they exist and free the connection. ]*/
+        if (connectionHandle->httpPipeline != NULL)
+        {
+            IoTHubHttpPipeline_Destroy(connectionHandle->httpPipeline);
+        }
+        if (connectionHandle->isSessionAttached)
+        {
+            LogError("Destroying a connection with an attached messaging client");
+        }
+        closeAmqpConnection(connectionHandle);
+        freeAuth(&connectionHandle->auth);
+        free(connectionHandle->trustedCert);
+        free(connectionHandle);
+    }
+}
+
+IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT IoTHubServiceClientConnection_SetOption(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle, const char* optionName, const void* value)
+{
+    IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT result;
+    IOTHUB_HTTP_PIPELINE_HANDLE httpPipeline;
+
+    /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_006: [ If any parameter is NULL, IoTHubServiceClientConnection_SetOption shall return IOTHUB_SERVICE_CLIENT_CONNECTION_INVALID_ARG. ]*/
+    if ((connectionHandle == NULL) || (optionName == NULL) || (value == NULL))
+    {
+        LogError("Input parameter cannot be NULL");
+        result = IOTHUB_SERVICE_CLIENT_CONNECTION_INVALID_ARG;
+    }
+    else if ((httpPipeline = IoTHubServiceClientConnection_GetHttpPipeline(connectionHandle)) == NULL)
+    {
+        LogError("Failure creating the HTTP pipeline");
+        result = IOTHUB_SERVICE_CLIENT_CONNECTION_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_007: [ IoTHubServiceClientConnection_SetOption shall pass the option to IoTHubHttpPipeline_SetOption and map its result. ]*/
+        IOTHUB_HTTP_PIPELINE_RESULT pipelineResult = IoTHubHttpPipeline_SetOption(httpPipeline, optionName, value);
+        if (pipelineResult != IOTHUB_HTTP_PIPELINE_OK)
+        {
+            LogError("IoTHubHttpPipeline_SetOption failed for %s", optionName);
+            result = (pipelineResult == IOTHUB_HTTP_PIPELINE_INVALID_ARG) ? IOTHUB_SERVICE_CLIENT_CONNECTION_INVALID_ARG : IOTHUB_SERVICE_CLIENT_CONNECTION_ERROR;
+        }
+        else if (strcmp(optionName, TRUSTED_CERT_OPTION) == 0)
+        {
+            /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_008: [ The TrustedCerts option shall also be copied and set on the TLS IO of the AMQP connection opened afterwards. ]*/
+            char* trustedCert;
+            if (mallocAndStrcpy_s(&trustedCert, (const char*)value) != 0)
+            {
+                LogError("mallocAndStrcpy_s failed for the trusted certificates");
+                result = IOTHUB_SERVICE_CLIENT_CONNECTION_ERROR;
+            }
+            else
+            {
+                free(connectionHandle->trustedCert);
+                connectionHandle->trustedCert = trustedCert;
+                result = IOTHUB_SERVICE_CLIENT_CONNECTION_OK;
+            }
+        }
+        else
+        {
+            result = IOTHUB_SERVICE_CLIENT_CONNECTION_OK;
+        }
+    }
+    return result;
+}
+
+void IoTHubServiceClientConnection_DoWork(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle)
+{
+    /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_009: [ IoTHubServiceClientConnection_DoWork shall call IoTHubHttpPipeline_DoWork and connection_dowork for the pipeline and the AMQP connection that exist and do nothing otherwise. ]*/
+    if (connectionHandle != NULL)
+    {
+        if (connectionHandle->httpPipeline != NULL)
+        {
+            IoTHubHttpPipeline_DoWork(connectionHandle->httpPipeline);
+        }
+        if (connectionHandle->connection != NULL)
+        {
+            connection_dowork(connectionHandle->connection);
+        }
+    }
+}
+
+IOTHUB_SERVICE_CLIENT_AUTH_HANDLE IoTHubServiceClientConnection_GetAuth(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle)
+{
+    IOTHUB_SERVICE_CLIENT_AUTH_HANDLE result;
+
+    if (connectionHandle == NULL)
+    {
+        LogError("Input parameter cannot be NULL");
+        result = NULL;
+    }
+    else
+    {
+        result = &connectionHandle->auth;
+    }
+    return result;
+}
+
+IOTHUB_HTTP_PIPELINE_HANDLE IoTHubServiceClientConnection_GetHttpPipeline(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle)
+{
+    IOTHUB_HTTP_PIPELINE_HANDLE result;
+
+    if (connectionHandle == NULL)
+    {
+        LogError("Input parameter cannot be NULL");
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_012: [ IoTHubServiceClientConnection_GetHttpPipeline shall create the HTTP pipeline on first use and return the same pipeline to every caller afterwards. ]*/
+        if (connectionHandle->httpPipeline == NULL)
+        {
+            connectionHandle->httpPipeline = IoTHubHttpPipeline_Create(connectionHandle->auth.hostname, connectionHandle->auth.sharedAccessKey, connectionHandle->auth.keyName);
+        }
+        result = connectionHandle->httpPipeline;
+    }
+    return result;
+}
+
+SESSION_HANDLE IoTHubServiceClientConnection_AttachAmqpSession(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle)
+{
+    SESSION_HANDLE result;
+
+    if (connectionHandle == NULL)
+    {
+        LogError("Input parameter cannot be NULL");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_013: [ If a messaging client is already attached, IoTHubServiceClientConnection_AttachAmqpSession shall return NULL. ]*/
+    else if (connectionHandle->isSessionAttached)
+    {
+        LogError("A messaging client is already attached to the connection");
+        result = NULL;
+    }
+    else if ((connectionHandle->session == NULL) && (openAmqpConnection(connectionHandle) != 0))
+    {
+        LogError("Could not open the AMQP connection");
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_014: [ Once the AMQP connection exists IoTHubServiceClientConnection_AttachAmqpSession shall return its session without creating anything. ]*/
+        connectionHandle->isSessionAttached = true;
+        result = connectionHandle->session;
+    }
+    return result;
+}
+
+void IoTHubServiceClientConnection_DetachAmqpSession(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE connectionHandle, bool closeConnection)
+{
+    if (connectionHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBSERVICECLIENTCONNECTION_41_015: [ IoTHubServiceClientConnection_DetachAmqpSession shall release the session and keep the AMQP connection open, unless closeConnection is true in which case it shall be destroyed and recreated by the next attach. ]*/
+        connectionHandle->isSessionAttached = false;
+        if (closeConnection)
+        {
+            closeAmqpConnection(connectionHandle);
+        }
+    }
+}
@@ -0,0 +1,659 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/httpheaders.h"
+#include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/sastoken.h"
+#include "azure_c_shared_utility/uniqueid.h"
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/tlsio.h"
+#include "azure_c_shared_utility/socketio.h"
+
+#include "iothub_sc_http_pipeline.h"
+#include "iothub_sc_version.h"
+
+DEFINE_ENUM_STRINGS(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_RESULT_VALUES);
+
+#define  HTTP_HEADER_KEY_AUTHORIZATION  "Authorization"
+#define  HTTP_HEADER_KEY_REQUEST_ID  "Request-Id"
+#define  HTTP_HEADER_KEY_USER_AGENT  "User-Agent"
+#define  HTTP_HEADER_VAL_USER_AGENT  IOTHUB_SERVICE_CLIENT_TYPE_PREFIX IOTHUB_SERVICE_CLIENT_BACKSLASH IOTHUB_SERVICE_CLIENT_VERSION
+#define  HTTP_HEADER_KEY_ACCEPT  "Accept"
+#define  HTTP_HEADER_VAL_ACCEPT  "application/json"
+#define  HTTP_HEADER_KEY_CONTENT_TYPE  "Content-Type"
+#define  HTTP_HEADER_VAL_CONTENT_TYPE  "application/json; charset=utf-8"
+#define  HTTP_HEADER_KEY_IFMATCH  "If-Match"
+#define UID_LENGTH 37
+#define REQUEST_ID_LENGTH (UID_LENGTH + 21)
+
+#define SAS_TOKEN_DEFAULT_LIFETIME  3600
+/* the cached token is renewed once less than a quarter of its lifetime is left */
+#define SAS_TOKEN_RENEWAL_DIVIDER   4
+#define EPOCH_TIME_T_VALUE          (time_t)0
+
+#define HTTP_CONNECTION_STATE_VALUES    \
+    HTTP_CONNECTION_CLOSED,             \
+    HTTP_CONNECTION_OPENING,            \
+    HTTP_CONNECTION_IDLE,               \
+    HTTP_CONNECTION_BUSY,               \
+    HTTP_CONNECTION_ERROR
+
+DEFINE_ENUM(HTTP_CONNECTION_STATE, HTTP_CONNECTION_STATE_VALUES);
+
+typedef struct HTTP_PIPELINE_REQUEST_TAG
+{
+    DLIST_ENTRY entry;
+    HTTP_CLIENT_REQUEST_TYPE requestType;
+    char* relativePath;
+    char* ifMatch;
+    unsigned char* content;
+    size_t contentLength;
+    IOTHUB_HTTP_PIPELINE_RESPONSE_CALLBACK callback;
+    void* context;
+} HTTP_PIPELINE_REQUEST;
+
+typedef struct HTTP_PIPELINE_CONNECTION_TAG
+{
+    struct IOTHUB_HTTP_PIPELINE_TAG* pipeline;
+    HTTP_CLIENT_HANDLE httpClient;
+    HTTP_CONNECTION_STATE state;
+    HTTP_PIPELINE_REQUEST* request;
+} HTTP_PIPELINE_CONNECTION;
+
+typedef struct IOTHUB_HTTP_PIPELINE_TAG
+{
+    char* hostname;
+    char* sharedAccessKey;
+    char* keyName;
+    char* trustedCert;
+    int port;
+    bool useTls;
+
+    size_t maxConnections;
+    HTTP_PIPELINE_CONNECTION* connections;
+
+    DLIST_ENTRY waitingRequests;
+    size_t waitingCount;
+    size_t pendingCount;
+
+    HTTP_HEADERS_HANDLE headersTemplate;
+    STRING_HANDLE sasToken;
+    size_t sasTokenExpiry;
+    size_t sasTokenLifetime;
+
+    char requestIdPrefix[UID_LENGTH];
+    unsigned long requestCount;
+} IOTHUB_HTTP_PIPELINE;
+
+static size_t get_seconds_since_epoch(void)
+{
+    return (size_t)difftime(get_time(NULL), EPOCH_TIME_T_VALUE);
+}
+
+static void free_request(HTTP_PIPELINE_REQUEST* request)
+{
+    free(request->relativePath);
+    free(request->ifMatch);
+    free(request->content);
+    free(request);
+}
+
+static void complete_request(IOTHUB_HTTP_PIPELINE* pipeline, HTTP_PIPELINE_REQUEST* request, IOTHUB_HTTP_PIPELINE_RESULT result, unsigned int statusCode, const unsigned char* content, size_t contentLength)
+{
+    pipeline->pendingCount--;
+    request->callback(result, statusCode, content, contentLength, request->context);
+    free_request(request);
+}
+
+static HTTP_PIPELINE_REQUEST* remove_waiting_request(IOTHUB_HTTP_PIPELINE* pipeline)
+{
+    pipeline->waitingCount--;
+    return containingRecord(DList_RemoveHeadList(&pipeline->waitingRequests), HTTP_PIPELINE_REQUEST, entry);
+}
+
+static HTTP_HEADERS_HANDLE createHeadersTemplate(void)
+{
+    HTTP_HEADERS_HANDLE result;
+
+    if ((result = HTTPHeaders_Alloc()) == NULL)
+    {
+        LogError("HTTPHeaders_Alloc failed");
+    }
+    else if ((HTTPHeaders_AddHeaderNameValuePair(result, HTTP_HEADER_KEY_USER_AGENT, HTTP_HEADER_VAL_USER_AGENT) != HTTP_HEADERS_OK) ||
+        (HTTPHeaders_AddHeaderNameValuePair(result, HTTP_HEADER_KEY_ACCEPT, HTTP_HEADER_VAL_ACCEPT) != HTTP_HEADERS_OK) ||
+        (HTTPHeaders_AddHeaderNameValuePair(result, HTTP_HEADER_KEY_CONTENT_TYPE, HTTP_HEADER_VAL_CONTENT_TYPE) != HTTP_HEADERS_OK))
+    {
+        LogError("HTTPHeaders_AddHeaderNameValuePair failed for the headers template");
+        HTTPHeaders_Free(result);
+        result = NULL;
+    }
+    return result;
+}
+
+static const char* getSasToken(IOTHUB_HTTP_PIPELINE* pipeline)
+{
+    const char* result;
+    size_t now = get_seconds_since_epoch();
+
+    /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_011: [ The SAS token shall be created once and reused until less than a quarter of sas_token_lifetime is left before its expiry. ]*/
+    if (pipeline->sasToken == NULL || now + pipeline->sasTokenLifetime / SAS_TOKEN_RENEWAL_DIVIDER >= pipeline->sasTokenExpiry)
+    {
+        size_t expiry = now + pipeline->sasTokenLifetime;
+        STRING_HANDLE sasToken = SASToken_CreateString(pipeline->sharedAccessKey, pipeline->hostname, pipeline->keyName, expiry);
+        if (sasToken == NULL)
+        {
+            LogError("SASToken_CreateString failed");
+        }
+        else
+        {
+            STRING_delete(pipeline->sasToken);
+            pipeline->sasToken = sasToken;
+            pipeline->sasTokenExpiry = expiry;
+        }
+    }
+
+    if (pipeline->sasToken == NULL || now >= pipeline->sasTokenExpiry)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = STRING_c_str(pipeline->sasToken);
+    }
+    return result;
+}
+
+static HTTP_HEADERS_HANDLE createRequestHeaders(IOTHUB_HTTP_PIPELINE* pipeline, const HTTP_PIPELINE_REQUEST* request)
+{
+    /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_012: [ The request headers shall be cloned from the headers template built at creation and completed with the cached SAS token, a Request-Id made of a per pipeline GUID and a request counter, and the If-Match header when requested. ]*/
+    HTTP_HEADERS_HANDLE result;
+    const char* sasToken;
+    char requestId[REQUEST_ID_LENGTH];
+
+    (void)snprintf(requestId, sizeof(requestId), "%s-%lu", pipeline->requestIdPrefix, ++pipeline->requestCount);
+
+    if ((sasToken = getSasToken(pipeline)) == NULL)
+    {
+        LogError("no valid SAS token");
+        result = NULL;
+    }
+    else if ((result = HTTPHeaders_Clone(pipeline->headersTemplate)) == NULL)
+    {
+        LogError("HTTPHeaders_Clone failed");
+    }
+    else if ((HTTPHeaders_AddHeaderNameValuePair(result, HTTP_HEADER_KEY_AUTHORIZATION, sasToken) != HTTP_HEADERS_OK) ||
+        (HTTPHeaders_AddHeaderNameValuePair(result, HTTP_HEADER_KEY_REQUEST_ID, requestId) != HTTP_HEADERS_OK) ||
+        ((request->ifMatch != NULL) && (HTTPHeaders_AddHeaderNameValuePair(result, HTTP_HEADER_KEY_IFMATCH, request->ifMatch) != HTTP_HEADERS_OK)))
+    {
+        LogError("HTTPHeaders_AddHeaderNameValuePair failed");
+        HTTPHeaders_Free(result);
+        result = NULL;
+    }
+    return result;
+}
+
+static void on_http_open_complete(void* callback_ctx, HTTP_CALLBACK_REASON open_result)
+{
+    HTTP_PIPELINE_CONNECTION* connection = (HTTP_PIPELINE_CONNECTION*)callback_ctx;
+    if (open_result == HTTP_CALLBACK_REASON_OK)
+    {
+        connection->state = HTTP_CONNECTION_IDLE;
+    }
+    else
+    {
+        LogError("Failure opening connection %d", open_result);
+        connection->state = HTTP_CONNECTION_ERROR;
+    }
+}
+
+static void on_http_error(void* callback_ctx, HTTP_CALLBACK_REASON error_result)
+{
+    HTTP_PIPELINE_CONNECTION* connection = (HTTP_PIPELINE_CONNECTION*)callback_ctx;
+    LogError("Failure encountered on connection %d", error_result);
+    connection->state = HTTP_CONNECTION_ERROR;
+}
+
+static void on_http_request_complete(void* callback_ctx, HTTP_CALLBACK_REASON request_result, const unsigned char* content, size_t content_length, unsigned int status_code, HTTP_HEADERS_HANDLE response_headers)
+{
+    HTTP_PIPELINE_CONNECTION* connection = (HTTP_PIPELINE_CONNECTION*)callback_ctx;
+    HTTP_PIPELINE_REQUEST* request = connection->request;
+    (void)response_headers;
+
+    connection->request = NULL;
+    if (request_result == HTTP_CALLBACK_REASON_OK)
+    {
+        /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_013: [ When a response is received the connection shall be kept open for the next request and the callback shall be invoked with IOTHUB_HTTP_PIPELINE_OK, the status code and the content. ]*/
+        connection->state = HTTP_CONNECTION_IDLE;
+        if (request != NULL)
+        {
+            complete_request(connection->pipeline, request, IOTHUB_HTTP_PIPELINE_OK, status_code, content, content_length);
+        }
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_014: [ If the request fails the callback shall be invoked with IOTHUB_HTTP_PIPELINE_ERROR and the connection shall be closed and reopened for the next request. ]*/
+        LogError("Failure executing request %d", request_result);
+        connection->state = HTTP_CONNECTION_ERROR;
+        if (request != NULL)
+        {
+            complete_request(connection->pipeline, request, IOTHUB_HTTP_PIPELINE_ERROR, 0, NULL, 0);
+        }
+    }
+}
+
+static void close_connection(HTTP_PIPELINE_CONNECTION* connection, IOTHUB_HTTP_PIPELINE_RESULT inFlightResult)
+{
+    if (connection->request != NULL)
+    {
+        HTTP_PIPELINE_REQUEST* request = connection->request;
+        connection->request = NULL;
+        complete_request(connection->pipeline, request, inFlightResult, 0, NULL, 0);
+    }
+    if (connection->httpClient != NULL)
+    {
+        uhttp_client_close(connection->httpClient, NULL, NULL);
+        uhttp_client_destroy(connection->httpClient);
+        connection->httpClient = NULL;
+    }
+    connection->state = HTTP_CONNECTION_CLOSED;
+}
+
+static int open_connection(IOTHUB_HTTP_PIPELINE* pipeline, HTTP_PIPELINE_CONNECTION* connection)
+{
+    int result;
+    const IO_INTERFACE_DESCRIPTION* interfaceDescription;
+    TLSIO_CONFIG tlsIoConfig;
+    SOCKETIO_CONFIG socketIoConfig;
+    const void* ioConfig;
+
+    if (pipeline->useTls)
+    {
+        memset(&tlsIoConfig, 0, sizeof(TLSIO_CONFIG));
+        tlsIoConfig.hostname = pipeline->hostname;
+        tlsIoConfig.port = pipeline->port;
+        interfaceDescription = platform_get_default_tlsio();
+        ioConfig = &tlsIoConfig;
+    }
+    else
+    {
+        memset(&socketIoConfig, 0, sizeof(SOCKETIO_CONFIG));
+        socketIoConfig.hostname = pipeline->hostname;
+        socketIoConfig.port = pipeline->port;
+        interfaceDescription = socketio_get_interface_description();
+        ioConfig = &socketIoConfig;
+    }
+
+    if (interfaceDescription == NULL)
+    {
+        LogError("no io interface available");
+        result = __FAILURE__;
+    }
+    else if ((connection->httpClient = uhttp_client_create(interfaceDescription, ioConfig, on_http_error, connection)) == NULL)
+    {
+        LogError("uhttp_client_create failed");
+        result = __FAILURE__;
+    }
+    else if (pipeline->trustedCert != NULL && uhttp_client_set_trusted_cert(connection->httpClient, pipeline->trustedCert) != HTTP_CLIENT_OK)
+    {
+        LogError("uhttp_client_set_trusted_cert failed");
+        uhttp_client_destroy(connection->httpClient);
+        connection->httpClient = NULL;
+        result = __FAILURE__;
+    }
+    else if (uhttp_client_open(connection->httpClient, pipeline->hostname, pipeline->port, on_http_open_complete, connection) != HTTP_CLIENT_OK)
+    {
+        LogError("uhttp_client_open failed for %s", pipeline->hostname);
+        uhttp_client_destroy(connection->httpClient);
+        connection->httpClient = NULL;
+        result = __FAILURE__;
+    }
+    else
+    {
+        connection->state = HTTP_CONNECTION_OPENING;
+        result = 0;
+    }
+    return result;
+}
+
+static size_t count_connections(IOTHUB_HTTP_PIPELINE* pipeline, HTTP_CONNECTION_STATE state)
+{
+    size_t result = 0;
+    size_t index;
+    for (index = 0; index < pipeline->maxConnections; index++)
+    {
+        if (pipeline->connections[index].state == state)
+        {
+            result++;
+        }
+    }
+    return result;
+}
+
+static void send_request(IOTHUB_HTTP_PIPELINE* pipeline, HTTP_PIPELINE_CONNECTION* connection)
+{
+    HTTP_PIPELINE_REQUEST* request = remove_waiting_request(pipeline);
+    HTTP_HEADERS_HANDLE requestHeaders;
+
+    if ((requestHeaders = createRequestHeaders(pipeline, request)) == NULL)
+    {
+        LogError("Failure creating request headers");
+        complete_request(pipeline, request, IOTHUB_HTTP_PIPELINE_ERROR, 0, NULL, 0);
+    }
+    else
+    {
+        connection->request = request;
+        connection->state = HTTP_CONNECTION_BUSY;
+        if (uhttp_client_execute_request(connection->httpClient, request->requestType, request->relativePath, requestHeaders, request->content, request->contentLength, on_http_request_complete, connection) != HTTP_CLIENT_OK)
+        {
+            LogError("uhttp_client_execute_request failed");
+            close_connection(connection, IOTHUB_HTTP_PIPELINE_ERROR);
+        }
+        HTTPHeaders_Free(requestHeaders);
+    }
+}
+
+IOTHUB_HTTP_PIPELINE_HANDLE IoTHubHttpPipeline_Create(const char* hostname, const char* sharedAccessKey, const char* keyName)
+{
+    IOTHUB_HTTP_PIPELINE* result;
+
+    /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_001: [ If hostname, sharedAccessKey or keyName is NULL, IoTHubHttpPipeline_Create shall return NULL. ]*/
+    if (hostname == NULL || sharedAccessKey == NULL || keyName == NULL)
+    {
+        LogError("Invalid parameter hostname: %p, sharedAccessKey: %p, keyName: %p", hostname, sharedAccessKey, keyName);
+        result = NULL;
+    }
+    else if ((result = (IOTHUB_HTTP_PIPELINE*)malloc(sizeof(IOTHUB_HTTP_PIPELINE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_003: [ If any error is encountered, IoTHubHttpPipeline_Create shall return NULL. ]*/
+        LogError("Malloc failed for IOTHUB_HTTP_PIPELINE");
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_002: [ IoTHubHttpPipeline_Create shall copy the credentials, build the headers template and a Request-Id prefix and shall not open any connection. ]*/
+        memset(result, 0, sizeof(IOTHUB_HTTP_PIPELINE));
+        result->port = IOTHUB_HTTP_PIPELINE_DEFAULT_PORT;
+        result->useTls = true;
+        result->maxConnections = IOTHUB_HTTP_PIPELINE_DEFAULT_MAX_CONNECTIONS;
+        result->sasTokenLifetime = SAS_TOKEN_DEFAULT_LIFETIME;
+        DList_InitializeListHead(&result->waitingRequests);
+
+        if ((mallocAndStrcpy_s(&result->hostname, hostname) != 0) ||
+            (mallocAndStrcpy_s(&result->sharedAccessKey, sharedAccessKey) != 0) ||
+            (mallocAndStrcpy_s(&result->keyName, keyName) != 0))
+        {
+            LogError("mallocAndStrcpy_s failed");
+            IoTHubHttpPipeline_Destroy(result);
+            result = NULL;
+        }
+        else if ((result->headersTemplate = createHeadersTemplate()) == NULL)
+        {
+            LogError("Failure creating headers template");
+            IoTHubHttpPipeline_Destroy(result);
+            result = NULL;
+        }
+        else if (UniqueId_Generate(result->requestIdPrefix, UID_LENGTH) != UNIQUEID_OK)
+        {
+            LogError("UniqueId_Generate failed");
+            IoTHubHttpPipeline_Destroy(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+void IoTHubHttpPipeline_Destroy(IOTHUB_HTTP_PIPELINE_HANDLE handle)
+{
+    /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_004: [ If handle is NULL, IoTHubHttpPipeline_Destroy shall do nothing. ]*/
+    if (handle != NULL)
+    {
+        /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_005: [ IoTHubHttpPipeline_Destroy shall close every connection and invoke the callback of every request that did not complete with IOTHUB_HTTP_PIPELINE_CANCELLED. ]*/
+        if (handle->connections != NULL)
+        {
+            size_t index;
+            for (index = 0; index < handle->maxConnections; index++)
+            {
+                close_connection(&handle->connections[index], IOTHUB_HTTP_PIPELINE_CANCELLED);
+            }
+            free(handle->connections);
+        }
+        while (!DList_IsListEmpty(&handle->waitingRequests))
+        {
+            HTTP_PIPELINE_REQUEST* request = remove_waiting_request(handle);
+            complete_request(handle, request, IOTHUB_HTTP_PIPELINE_CANCELLED, 0, NULL, 0);
+        }
+
+        if (handle->headersTemplate != NULL)
+        {
+            HTTPHeaders_Free(handle->headersTemplate);
+        }
+        STRING_delete(handle->sasToken);
+        free(handle->trustedCert);
+        free(handle->hostname);
+        free(handle->sharedAccessKey);
+        free(handle->keyName);
+        free(handle);
+    }
+}
+
+IOTHUB_HTTP_PIPELINE_RESULT IoTHubHttpPipeline_SetOption(IOTHUB_HTTP_PIPELINE_HANDLE handle, const char* optionName, const void* value)
+{
+    IOTHUB_HTTP_PIPELINE_RESULT result;
+
+    /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_006: [ If handle, optionName or value is NULL, IoTHubHttpPipeline_SetOption shall return IOTHUB_HTTP_PIPELINE_INVALID_ARG. ]*/
+    if (handle == NULL || optionName == NULL || value == NULL)
+    {
+        LogError("Invalid parameter handle: %p, optionName: %p, value: %p", handle, optionName, value);
+        result = IOTHUB_HTTP_PIPELINE_INVALID_ARG;
+    }
+    else if (strcmp(optionName, IOTHUB_HTTP_PIPELINE_OPTION_MAX_CONNECTIONS) == 0)
+    {
+        /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_007: [ max_connections shall be rejected with IOTHUB_HTTP_PIPELINE_ERROR if it is 0 or once connections have been allocated. ]*/
+        size_t maxConnections = *(const size_t*)value;
+        if (maxConnections == 0 || handle->connections != NULL)
+        {
+            LogError("max_connections cannot be 0 or changed after the first request");
+            result = IOTHUB_HTTP_PIPELINE_ERROR;
+        }
+        else
+        {
+            handle->maxConnections = maxConnections;
+            result = IOTHUB_HTTP_PIPELINE_OK;
+        }
+    }
+    else if (strcmp(optionName, IOTHUB_HTTP_PIPELINE_OPTION_PORT) == 0)
+    {
+        handle->port = *(const int*)value;
+        result = IOTHUB_HTTP_PIPELINE_OK;
+    }
+    else if (strcmp(optionName, IOTHUB_HTTP_PIPELINE_OPTION_USE_TLS) == 0)
+    {
+        handle->useTls = *(const bool*)value;
+        result = IOTHUB_HTTP_PIPELINE_OK;
+    }
+    else if (strcmp(optionName, IOTHUB_HTTP_PIPELINE_OPTION_SAS_TOKEN_LIFETIME) == 0)
+    {
+        size_t lifetime = *(const size_t*)value;
+        if (lifetime == 0)
+        {
+            LogError("sas_token_lifetime cannot be 0");
+            result = IOTHUB_HTTP_PIPELINE_ERROR;
+        }
+        else
+        {
+            handle->sasTokenLifetime = lifetime;
+            STRING_delete(handle->sasToken);
+            handle->sasToken = NULL;
+            result = IOTHUB_HTTP_PIPELINE_OK;
+        }
+    }
+    else if (strcmp(optionName, IOTHUB_HTTP_PIPELINE_OPTION_TRUSTED_CERT) == 0)
+    {
+        char* trustedCert;
+        if (mallocAndStrcpy_s(&trustedCert, (const char*)value) != 0)
+        {
+            LogError("mallocAndStrcpy_s failed for the trusted certificates");
+            result = IOTHUB_HTTP_PIPELINE_ERROR;
+        }
+        else
+        {
+            free(handle->trustedCert);
+            handle->trustedCert = trustedCert;
+            result = IOTHUB_HTTP_PIPELINE_OK;
+        }
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_008: [ If optionName is not supported, IoTHubHttpPipeline_SetOption shall return IOTHUB_HTTP_PIPELINE_INVALID_ARG. ]*/
+        LogError("Option %s is not supported", optionName);
+        result = IOTHUB_HTTP_PIPELINE_INVALID_ARG;
+    }
+    return result;
+}
+
+IOTHUB_HTTP_PIPELINE_RESULT IoTHubHttpPipeline_ExecuteRequest(IOTHUB_HTTP_PIPELINE_HANDLE handle, HTTP_CLIENT_REQUEST_TYPE requestType, const char* relativePath, const char* ifMatch, const unsigned char* content, size_t contentLength, IOTHUB_HTTP_PIPELINE_RESPONSE_CALLBACK callback, void* context)
+{
+    IOTHUB_HTTP_PIPELINE_RESULT result;
+    HTTP_PIPELINE_REQUEST* request;
+
+    /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_009: [ If handle, relativePath or callback is NULL, or content is NULL while contentLength is not 0, IoTHubHttpPipeline_ExecuteRequest shall return IOTHUB_HTTP_PIPELINE_INVALID_ARG. ]*/
+    if (handle == NULL || relativePath == NULL || callback == NULL || (content == NULL && contentLength != 0))
+    {
+        LogError("Invalid parameter handle: %p, relativePath: %p, callback: %p, content: %p", handle, relativePath, callback, content);
+        result = IOTHUB_HTTP_PIPELINE_INVALID_ARG;
+    }
+    else if (handle->connections == NULL &&
+        (handle->connections = (HTTP_PIPELINE_CONNECTION*)calloc(handle->maxConnections, sizeof(HTTP_PIPELINE_CONNECTION))) == NULL)
+    {
+        LogError("Failure allocating connections");
+        result = IOTHUB_HTTP_PIPELINE_ERROR;
+    }
+    else if ((request = (HTTP_PIPELINE_REQUEST*)malloc(sizeof(HTTP_PIPELINE_REQUEST))) == NULL)
+    {
+        LogError("Malloc failed for HTTP_PIPELINE_REQUEST");
+        result = IOTHUB_HTTP_PIPELINE_ERROR;
+    }
+    else
+    {
+        size_t index;
+        for (index = 0; index < handle->maxConnections; index++)
+        {
+            handle->connections[index].pipeline = handle;
+        }
+
+        memset(request, 0, sizeof(HTTP_PIPELINE_REQUEST));
+        request->requestType = requestType;
+        request->contentLength = contentLength;
+        request->callback = callback;
+        request->context = context;
+
+        if ((mallocAndStrcpy_s(&request->relativePath, relativePath) != 0) ||
+            ((ifMatch != NULL) && (mallocAndStrcpy_s(&request->ifMatch, ifMatch) != 0)) ||
+            ((contentLength != 0) && ((request->content = (unsigned char*)malloc(contentLength)) == NULL)))
+        {
+            /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_010: [ IoTHubHttpPipeline_ExecuteRequest shall copy the request and queue it, returning IOTHUB_HTTP_PIPELINE_ERROR if any error is encountered. ]*/
+            LogError("Failure copying the request");
+            free_request(request);
+            result = IOTHUB_HTTP_PIPELINE_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_010: [ IoTHubHttpPipeline_ExecuteRequest shall copy the request and queue it, returning IOTHUB_HTTP_PIPELINE_ERROR if any error is encountered. ]*/
+            if (contentLength != 0)
+            {
+                (void)memcpy(request->content, content, contentLength);
+            }
+            DList_InsertTailList(&handle->waitingRequests, &request->entry);
+            handle->waitingCount++;
+            handle->pendingCount++;
+            result = IOTHUB_HTTP_PIPELINE_OK;
+        }
+    }
+    return result;
+}
+
+void IoTHubHttpPipeline_DoWork(IOTHUB_HTTP_PIPELINE_HANDLE handle)
+{
+    /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_015: [ If handle is NULL, IoTHubHttpPipeline_DoWork shall do nothing. ]*/
+    if (handle != NULL && handle->connections != NULL)
+    {
+        size_t opening;
+        size_t index;
+
+        /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_016: [ IoTHubHttpPipeline_DoWork shall close the connections that failed and hand the oldest waiting request to every idle connection. ]*/
+        for (index = 0; index < handle->maxConnections; index++)
+        {
+            HTTP_PIPELINE_CONNECTION* connection = &handle->connections[index];
+
+            if (connection->state == HTTP_CONNECTION_ERROR)
+            {
+                close_connection(connection, IOTHUB_HTTP_PIPELINE_ERROR);
+            }
+            else if (connection->state == HTTP_CONNECTION_IDLE && handle->waitingCount > 0)
+            {
+                send_request(handle, connection);
+            }
+        }
+
+        /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_017: [ IoTHubHttpPipeline_DoWork shall open closed connections only while there are more waiting requests than connections being opened. ]*/
+        opening = count_connections(handle, HTTP_CONNECTION_OPENING);
+        for (index = 0; index < handle->maxConnections && handle->waitingCount > opening; index++)
+        {
+            HTTP_PIPELINE_CONNECTION* connection = &handle->connections[index];
+
+            if (connection->state == HTTP_CONNECTION_CLOSED)
+            {
+                if (open_connection(handle, connection) == 0)
+                {
+                    opening++;
+                }
+                else if (count_connections(handle, HTTP_CONNECTION_CLOSED) == handle->maxConnections)
+                {
+                    /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_018: [ If no connection is open and none can be opened, the oldest waiting request shall be completed with IOTHUB_HTTP_PIPELINE_ERROR. ]*/
+                    HTTP_PIPELINE_REQUEST* request = remove_waiting_request(handle);
+                    LogError("Failure opening connection");
+                    complete_request(handle, request, IOTHUB_HTTP_PIPELINE_ERROR, 0, NULL, 0);
+                    break;
+                }
+                else
+                {
+                    LogError("Failure opening connection");
+                }
+            }
+        }
+
+        /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_019: [ IoTHubHttpPipeline_DoWork shall call uhttp_client_dowork on every open connection. ]*/
+        for (index = 0; index < handle->maxConnections; index++)
+        {
+            if (handle->connections[index].httpClient != NULL)
+            {
+                uhttp_client_dowork(handle->connections[index].httpClient);
+            }
+        }
+    }
+}
+
+size_t IoTHubHttpPipeline_GetPendingCount(IOTHUB_HTTP_PIPELINE_HANDLE handle)
+{
+    size_t result;
+    /*Codes_SRS_IOTHUB_HTTP_PIPELINE_37_020: [ IoTHubHttpPipeline_GetPendingCount shall return the number of queued and in flight requests, or 0 if handle is NULL. ]*/
+    if (handle == NULL)
+    {
+        LogError("Invalid parameter handle: NULL");
+        result = 0;
+    }
+    else
+    {
+        result = handle->pendingCount;
+    }
+    return result;
+}
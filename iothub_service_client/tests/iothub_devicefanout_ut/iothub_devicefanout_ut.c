@@ -0,0 +1,567 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+
+#include "iothub_devicetwin.h"
+#include "iothub_devicemethod.h"
+#undef ENABLE_MOCKS
+
+#include "iothub_devicefanout.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    extern void real_DList_InitializeListHead(PDLIST_ENTRY listHead);
+    extern int real_DList_IsListEmpty(const PDLIST_ENTRY listHead);
+    extern void real_DList_InsertTailList(PDLIST_ENTRY listHead, PDLIST_ENTRY listEntry);
+    extern void real_DList_InsertHeadList(PDLIST_ENTRY listHead, PDLIST_ENTRY listEntry);
+    extern void real_DList_AppendTailList(PDLIST_ENTRY listHead, PDLIST_ENTRY ListToAppend);
+    extern int real_DList_RemoveEntryList(PDLIST_ENTRY listEntry);
+    extern PDLIST_ENTRY real_DList_RemoveHeadList(PDLIST_ENTRY listHead);
+    extern int real_mallocAndStrcpy_s(char** destination, const char* source);
+#ifdef __cplusplus
+}
+#endif
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+TEST_DEFINE_ENUM_TYPE(IOTHUB_DEVICE_FANOUT_RESULT, IOTHUB_DEVICE_FANOUT_RESULT_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_DEVICE_FANOUT_RESULT, IOTHUB_DEVICE_FANOUT_RESULT_VALUES);
+TEST_DEFINE_ENUM_TYPE(IOTHUB_DEVICE_TWIN_RESULT, IOTHUB_DEVICE_TWIN_RESULT_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_DEVICE_TWIN_RESULT, IOTHUB_DEVICE_TWIN_RESULT_VALUES);
+TEST_DEFINE_ENUM_TYPE(IOTHUB_DEVICE_METHOD_RESULT, IOTHUB_DEVICE_METHOD_RESULT_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_DEVICE_METHOD_RESULT, IOTHUB_DEVICE_METHOD_RESULT_VALUES);
+
+static IOTHUB_SERVICE_CLIENT_AUTH_HANDLE TEST_SERVICE_CLIENT_HANDLE = (IOTHUB_SERVICE_CLIENT_AUTH_HANDLE)0x4141;
+static IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE TEST_TWIN_HANDLE = (IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE)0x4242;
+static IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE TEST_METHOD_HANDLE = (IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE)0x4343;
+static void* TEST_USER_CONTEXT = (void*)0x4444;
+static const char* TEST_TWIN_JSON = "{\"properties\":{\"desired\":{\"firmware\":\"2.0\"}}}";
+static const char* TEST_METHOD_NAME = "firmwareUpdate";
+static const char* TEST_METHOD_PAYLOAD = "{\"version\":\"2.0\"}";
+static const unsigned int TEST_METHOD_TIMEOUT = 30;
+static const unsigned char TEST_METHOD_RESPONSE[] = { '{', '}' };
+static const char* TEST_DEVICE_IDS[] = { "device0", "device1", "device2" };
+
+#define TEST_MAX_REQUESTS 8
+
+/* requests queued on the mocked twin and method handles; they complete when the test calls complete_request */
+static size_t g_request_count;
+static IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK g_twin_callback[TEST_MAX_REQUESTS];
+static IOTHUB_DEVICE_METHOD_ASYNC_CALLBACK g_method_callback[TEST_MAX_REQUESTS];
+static void* g_request_context[TEST_MAX_REQUESTS];
+static size_t g_max_connections;
+
+static size_t g_callback_count;
+static char g_callback_device_id[32];
+static int g_callback_result;
+static int g_callback_status;
+static size_t g_callback_payload_size;
+
+static IOTHUB_DEVICE_TWIN_RESULT my_IoTHubDeviceTwin_UpdateTwinAsync(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE serviceClientDeviceTwinHandle, const char* deviceId, const char* deviceTwinJson, IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK callback, void* userContext)
+{
+    (void)serviceClientDeviceTwinHandle;
+    (void)deviceId;
+    (void)deviceTwinJson;
+    g_twin_callback[g_request_count] = callback;
+    g_request_context[g_request_count] = userContext;
+    g_request_count++;
+    return IOTHUB_DEVICE_TWIN_OK;
+}
+
+static IOTHUB_DEVICE_METHOD_RESULT my_IoTHubDeviceMethod_InvokeAsync(IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE serviceClientDeviceMethodHandle, const char* deviceId, const char* methodName, const char* methodPayload, unsigned int timeout, IOTHUB_DEVICE_METHOD_ASYNC_CALLBACK callback, void* userContext)
+{
+    (void)serviceClientDeviceMethodHandle;
+    (void)deviceId;
+    (void)methodName;
+    (void)methodPayload;
+    (void)timeout;
+    g_method_callback[g_request_count] = callback;
+    g_request_context[g_request_count] = userContext;
+    g_request_count++;
+    return IOTHUB_DEVICE_METHOD_OK;
+}
+
+static IOTHUB_DEVICE_TWIN_RESULT my_IoTHubDeviceTwin_SetOption(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE serviceClientDeviceTwinHandle, const char* optionName, const void* value)
+{
+    (void)serviceClientDeviceTwinHandle;
+    if (strcmp(optionName, "max_connections") == 0)
+    {
+        g_max_connections = *(const size_t*)value;
+    }
+    return IOTHUB_DEVICE_TWIN_OK;
+}
+
+/* the twin handle completes the requests in flight when it is destroyed, as the HTTP pipeline does */
+static void my_IoTHubDeviceTwin_Destroy(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE serviceClientDeviceTwinHandle)
+{
+    size_t index;
+    (void)serviceClientDeviceTwinHandle;
+    for (index = 0; index < g_request_count; index++)
+    {
+        if (g_twin_callback[index] != NULL)
+        {
+            IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK callback = g_twin_callback[index];
+            g_twin_callback[index] = NULL;
+            callback(IOTHUB_DEVICE_TWIN_HTTPAPI_ERROR, NULL, g_request_context[index]);
+        }
+    }
+}
+
+static void complete_twin_request(size_t index, IOTHUB_DEVICE_TWIN_RESULT result, const char* json)
+{
+    IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK callback = g_twin_callback[index];
+    g_twin_callback[index] = NULL;
+    callback(result, json, g_request_context[index]);
+}
+
+static void on_twin_result(const char* deviceId, IOTHUB_DEVICE_TWIN_RESULT result, const char* deviceTwinJson, void* userContext)
+{
+    (void)deviceTwinJson;
+    ASSERT_ARE_EQUAL(void_ptr, TEST_USER_CONTEXT, userContext);
+    g_callback_count++;
+    (void)strncpy(g_callback_device_id, deviceId, sizeof(g_callback_device_id) - 1);
+    g_callback_result = (int)result;
+}
+
+static void on_method_result(const char* deviceId, IOTHUB_DEVICE_METHOD_RESULT result, int responseStatus, const unsigned char* responsePayload, size_t responsePayloadSize, void* userContext)
+{
+    (void)responsePayload;
+    ASSERT_ARE_EQUAL(void_ptr, TEST_USER_CONTEXT, userContext);
+    g_callback_count++;
+    (void)strncpy(g_callback_device_id, deviceId, sizeof(g_callback_device_id) - 1);
+    g_callback_result = (int)result;
+    g_callback_status = responseStatus;
+    g_callback_payload_size = responsePayloadSize;
+}
+
+static IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE create_twin_fanout(size_t maxConcurrent)
+{
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE result = IoTHubDeviceFanout_CreateTwinUpdate(TEST_SERVICE_CLIENT_HANDLE, TEST_TWIN_JSON, on_twin_result, TEST_USER_CONTEXT);
+    (void)IoTHubDeviceFanout_SetOption(result, IOTHUB_DEVICE_FANOUT_OPTION_MAX_CONCURRENT, &maxConcurrent);
+    return result;
+}
+
+static void add_test_devices(IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle)
+{
+    size_t added;
+    (void)IoTHubDeviceFanout_AddDevices(handle, TEST_DEVICE_IDS, sizeof(TEST_DEVICE_IDS) / sizeof(TEST_DEVICE_IDS[0]), &added);
+}
+
+BEGIN_TEST_SUITE(iothub_devicefanout_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_TYPE(IOTHUB_DEVICE_TWIN_RESULT, IOTHUB_DEVICE_TWIN_RESULT);
+    REGISTER_TYPE(IOTHUB_DEVICE_METHOD_RESULT, IOTHUB_DEVICE_METHOD_RESULT);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_SERVICE_CLIENT_AUTH_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_DEVICE_TWIN_ASYNC_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_DEVICE_METHOD_ASYNC_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(PDLIST_ENTRY, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(const PDLIST_ENTRY, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, real_mallocAndStrcpy_s);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(mallocAndStrcpy_s, __LINE__);
+
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InitializeListHead, real_DList_InitializeListHead);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_IsListEmpty, real_DList_IsListEmpty);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InsertTailList, real_DList_InsertTailList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InsertHeadList, real_DList_InsertHeadList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_AppendTailList, real_DList_AppendTailList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_RemoveEntryList, real_DList_RemoveEntryList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_RemoveHeadList, real_DList_RemoveHeadList);
+
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubDeviceTwin_Create, TEST_TWIN_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubDeviceTwin_Create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubDeviceTwin_Destroy, my_IoTHubDeviceTwin_Destroy);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubDeviceTwin_UpdateTwinAsync, my_IoTHubDeviceTwin_UpdateTwinAsync);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubDeviceTwin_UpdateTwinAsync, IOTHUB_DEVICE_TWIN_ERROR);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubDeviceTwin_SetOption, my_IoTHubDeviceTwin_SetOption);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubDeviceTwin_SetOption, IOTHUB_DEVICE_TWIN_ERROR);
+
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubDeviceMethod_Create, TEST_METHOD_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubDeviceMethod_Create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubDeviceMethod_InvokeAsync, my_IoTHubDeviceMethod_InvokeAsync);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubDeviceMethod_InvokeAsync, IOTHUB_DEVICE_METHOD_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubDeviceMethod_SetOption, IOTHUB_DEVICE_METHOD_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubDeviceMethod_SetOption, IOTHUB_DEVICE_METHOD_ERROR);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("Could not acquire test serialization mutex.");
+    }
+
+    umock_c_reset_all_calls();
+
+    g_request_count = 0;
+    memset(g_twin_callback, 0, sizeof(g_twin_callback));
+    memset(g_method_callback, 0, sizeof(g_method_callback));
+    g_max_connections = 0;
+    g_callback_count = 0;
+    memset(g_callback_device_id, 0, sizeof(g_callback_device_id));
+    g_callback_result = -1;
+    g_callback_status = 0;
+    g_callback_payload_size = 0;
+}
+
+TEST_FUNCTION_CLEANUP(method_cleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_001: [ If serviceClientHandle, deviceTwinJson or callback is NULL, IoTHubDeviceFanout_CreateTwinUpdate shall return NULL. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_CreateTwinUpdate_json_NULL_fail)
+{
+    //arrange
+
+    //act
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = IoTHubDeviceFanout_CreateTwinUpdate(TEST_SERVICE_CLIENT_HANDLE, NULL, on_twin_result, TEST_USER_CONTEXT);
+
+    //assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_002: [ IoTHubDeviceFanout_CreateTwinUpdate shall copy deviceTwinJson and create the IoTHubDeviceTwin handle that carries the updates. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_CreateTwinUpdate_succeed)
+{
+    //arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_TWIN_JSON));
+    STRICT_EXPECTED_CALL(IoTHubDeviceTwin_Create(TEST_SERVICE_CLIENT_HANDLE));
+
+    //act
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = IoTHubDeviceFanout_CreateTwinUpdate(TEST_SERVICE_CLIENT_HANDLE, TEST_TWIN_JSON, on_twin_result, TEST_USER_CONTEXT);
+
+    //assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubDeviceFanout_GetPendingCount(handle));
+
+    //cleanup
+    IoTHubDeviceFanout_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_003: [ If any allocation fails, IoTHubDeviceFanout_CreateTwinUpdate and IoTHubDeviceFanout_CreateMethodInvoke shall clean up and return NULL. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_CreateMethodInvoke_method_create_fail)
+{
+    //arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_METHOD_NAME));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_METHOD_PAYLOAD));
+    STRICT_EXPECTED_CALL(IoTHubDeviceMethod_Create(TEST_SERVICE_CLIENT_HANDLE))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = IoTHubDeviceFanout_CreateMethodInvoke(TEST_SERVICE_CLIENT_HANDLE, TEST_METHOD_NAME, TEST_METHOD_PAYLOAD, TEST_METHOD_TIMEOUT, on_method_result, TEST_USER_CONTEXT);
+
+    //assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_010: [ Once max_queued_devices devices are queued, IoTHubDeviceFanout_AddDevices shall stop and return IOTHUB_DEVICE_FANOUT_BUSY. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_AddDevices_queue_full_busy)
+{
+    //arrange
+    size_t maxQueued = 2;
+    size_t added = 0;
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = create_twin_fanout(1);
+    (void)IoTHubDeviceFanout_SetOption(handle, IOTHUB_DEVICE_FANOUT_OPTION_MAX_QUEUED, &maxQueued);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_DEVICE_FANOUT_RESULT result = IoTHubDeviceFanout_AddDevices(handle, TEST_DEVICE_IDS, 3, &added);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_DEVICE_FANOUT_RESULT, IOTHUB_DEVICE_FANOUT_BUSY, result);
+    ASSERT_ARE_EQUAL(size_t, 2, added);
+    ASSERT_ARE_EQUAL(size_t, 2, IoTHubDeviceFanout_GetPendingCount(handle));
+
+    //cleanup
+    IoTHubDeviceFanout_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_009: [ If a device id is NULL, IoTHubDeviceFanout_AddDevices shall stop at it and return IOTHUB_DEVICE_FANOUT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_AddDevices_device_id_NULL_fail)
+{
+    //arrange
+    const char* deviceIds[] = { "device0", NULL };
+    size_t added = 0;
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = create_twin_fanout(1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_DEVICE_FANOUT_RESULT result = IoTHubDeviceFanout_AddDevices(handle, deviceIds, 2, &added);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_DEVICE_FANOUT_RESULT, IOTHUB_DEVICE_FANOUT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(size_t, 1, added);
+
+    //cleanup
+    IoTHubDeviceFanout_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_013: [ Before starting the first device, IoTHubDeviceFanout_DoWork shall set the max_connections option of the underlying handle to max_concurrent_operations, unless max_connections was set through IoTHubDeviceFanout_SetOption. ]*/
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_017: [ IoTHubDeviceFanout_DoWork shall start the queued devices in order while fewer than max_concurrent_operations are in flight. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_DoWork_starts_up_to_max_concurrent)
+{
+    //arrange
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = create_twin_fanout(2);
+    add_test_devices(handle);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubDeviceTwin_SetOption(TEST_TWIN_HANDLE, "max_connections", IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubDeviceTwin_UpdateTwinAsync(TEST_TWIN_HANDLE, "device0", TEST_TWIN_JSON, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubDeviceTwin_UpdateTwinAsync(TEST_TWIN_HANDLE, "device1", TEST_TWIN_JSON, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubDeviceTwin_DoWork(TEST_TWIN_HANDLE));
+
+    //act
+    IoTHubDeviceFanout_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 2, g_request_count);
+    ASSERT_ARE_EQUAL(size_t, 2, g_max_connections);
+    ASSERT_ARE_EQUAL(size_t, 3, IoTHubDeviceFanout_GetPendingCount(handle));
+
+    //cleanup
+    IoTHubDeviceFanout_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_015: [ When the update of a device completes, its slot shall be released and the twin callback shall be invoked with the device id and the result and json of IoTHubDeviceTwin_UpdateTwinAsync. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_DoWork_completion_frees_slot_for_next_device)
+{
+    //arrange
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = create_twin_fanout(1);
+    add_test_devices(handle);
+    IoTHubDeviceFanout_DoWork(handle);
+    complete_twin_request(0, IOTHUB_DEVICE_TWIN_OK, TEST_TWIN_JSON);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubDeviceFanout_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, g_callback_count);
+    ASSERT_ARE_EQUAL(char_ptr, "device0", g_callback_device_id);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_DEVICE_TWIN_OK, g_callback_result);
+    ASSERT_ARE_EQUAL(size_t, 2, g_request_count);
+    ASSERT_ARE_EQUAL(size_t, 2, IoTHubDeviceFanout_GetPendingCount(handle));
+
+    //cleanup
+    IoTHubDeviceFanout_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_014: [ If the request of a device cannot be queued, the callback shall be invoked right away with the device id and the error returned. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_DoWork_start_fail_reports_device)
+{
+    //arrange
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = create_twin_fanout(1);
+    size_t added;
+    (void)IoTHubDeviceFanout_AddDevices(handle, TEST_DEVICE_IDS, 1, &added);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubDeviceTwin_SetOption(TEST_TWIN_HANDLE, "max_connections", IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubDeviceTwin_UpdateTwinAsync(TEST_TWIN_HANDLE, "device0", TEST_TWIN_JSON, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(IOTHUB_DEVICE_TWIN_HTTPAPI_ERROR);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubDeviceTwin_DoWork(TEST_TWIN_HANDLE));
+
+    //act
+    IoTHubDeviceFanout_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 1, g_callback_count);
+    ASSERT_ARE_EQUAL(char_ptr, "device0", g_callback_device_id);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_DEVICE_TWIN_HTTPAPI_ERROR, g_callback_result);
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubDeviceFanout_GetPendingCount(handle));
+
+    //cleanup
+    IoTHubDeviceFanout_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_016: [ When the invocation on a device completes, its slot shall be released and the method callback shall be invoked with the device id and the result, status and payload of IoTHubDeviceMethod_InvokeAsync. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_method_completion_reports_response)
+{
+    //arrange
+    size_t added;
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = IoTHubDeviceFanout_CreateMethodInvoke(TEST_SERVICE_CLIENT_HANDLE, TEST_METHOD_NAME, TEST_METHOD_PAYLOAD, TEST_METHOD_TIMEOUT, on_method_result, TEST_USER_CONTEXT);
+    (void)IoTHubDeviceFanout_AddDevices(handle, TEST_DEVICE_IDS + 1, 1, &added);
+    IoTHubDeviceFanout_DoWork(handle);
+    umock_c_reset_all_calls();
+
+    //act
+    g_method_callback[0](IOTHUB_DEVICE_METHOD_OK, 200, TEST_METHOD_RESPONSE, sizeof(TEST_METHOD_RESPONSE), g_request_context[0]);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, g_callback_count);
+    ASSERT_ARE_EQUAL(char_ptr, "device1", g_callback_device_id);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_DEVICE_METHOD_OK, g_callback_result);
+    ASSERT_ARE_EQUAL(int, 200, g_callback_status);
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_METHOD_RESPONSE), g_callback_payload_size);
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubDeviceFanout_GetPendingCount(handle));
+
+    //cleanup
+    IoTHubDeviceFanout_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_006: [ IoTHubDeviceFanout_Destroy shall destroy the IoTHubDeviceTwin or IoTHubDeviceMethod handle, which completes the devices in flight with an HTTPAPI_ERROR result. ]*/
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_007: [ IoTHubDeviceFanout_Destroy shall invoke the callback of every queued device with IOTHUB_DEVICE_TWIN_ERROR or IOTHUB_DEVICE_METHOD_ERROR and free the fan-out. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_Destroy_reports_pending_devices)
+{
+    //arrange
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = create_twin_fanout(1);
+    add_test_devices(handle);
+    IoTHubDeviceFanout_DoWork(handle);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubDeviceFanout_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 3, g_callback_count);
+    ASSERT_ARE_EQUAL(char_ptr, "device2", g_callback_device_id);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_DEVICE_TWIN_ERROR, g_callback_result);
+
+    //cleanup
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_021: [ max_concurrent_operations shall be rejected with IOTHUB_DEVICE_FANOUT_ERROR if it is 0 or once the first device has been started. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_SetOption_max_concurrent_after_start_fail)
+{
+    //arrange
+    size_t maxConcurrent = 4;
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = create_twin_fanout(1);
+    add_test_devices(handle);
+    IoTHubDeviceFanout_DoWork(handle);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_DEVICE_FANOUT_RESULT result = IoTHubDeviceFanout_SetOption(handle, IOTHUB_DEVICE_FANOUT_OPTION_MAX_CONCURRENT, &maxConcurrent);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_DEVICE_FANOUT_RESULT, IOTHUB_DEVICE_FANOUT_ERROR, result);
+
+    //cleanup
+    IoTHubDeviceFanout_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBDEVICEFANOUT_38_023: [ Any other option shall be passed to IoTHubDeviceTwin_SetOption or IoTHubDeviceMethod_SetOption and its result mapped. ]*/
+TEST_FUNCTION(IoTHubDeviceFanout_SetOption_max_connections_is_kept)
+{
+    //arrange
+    size_t maxConnections = 3;
+    IOTHUB_SERVICE_CLIENT_DEVICE_FANOUT_HANDLE handle = create_twin_fanout(8);
+    add_test_devices(handle);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_DEVICE_FANOUT_RESULT result = IoTHubDeviceFanout_SetOption(handle, "max_connections", &maxConnections);
+    IoTHubDeviceFanout_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_DEVICE_FANOUT_RESULT, IOTHUB_DEVICE_FANOUT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 3, g_max_connections);
+    ASSERT_ARE_EQUAL(size_t, 3, g_request_count);
+
+    //cleanup
+    IoTHubDeviceFanout_Destroy(handle);
+}
+
+END_TEST_SUITE(iothub_devicefanout_ut)
@@ -54,6 +54,9 @@ static int my_mallocAndStrcpy_s(char** destination, const char* source)
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
 #include "azure_c_shared_utility/uniqueid.h"
+#include "iothub_sc_http_pipeline.h"
+#include "iothub_sc_connection.h"
+#include "internal/iothub_sc_connection_private.h"
 #include "parson.h"
 
 MOCKABLE_FUNCTION(, JSON_Value*, json_parse_string, const char *, string);
@@ -410,6 +413,19 @@ TEST_FUNCTION(IoTHubDeviceMethod_Create_return_null_if_input_parameter_serviceCl
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+/*Tests_SRS_IOTHUBDEVICEMETHOD_41_001: [ If connectionHandle is NULL IoTHubDeviceMethod_CreateWithConnection shall return NULL. ]*/
+TEST_FUNCTION(IoTHubDeviceMethod_CreateWithConnection_return_null_if_input_parameter_connectionHandle_is_NULL)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_SERVICE_CLIENT_DEVICE_METHOD_HANDLE result = IoTHubDeviceMethod_CreateWithConnection(NULL);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /*Tests_SRS_IOTHUBDEVICEMETHOD_12_002: [ If any member of the serviceClientHandle input parameter is NULL IoTHubDeviceMethod_Create shall return NULL ]*/
 TEST_FUNCTION(IoTHubDeviceMethod_Create_return_null_if_input_parameter_serviceClientHandle_hostName_is_NULL)
 {
@@ -55,6 +55,9 @@ static int my_mallocAndStrcpy_s(char** destination, const char* source)
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
 #include "azure_c_shared_utility/uniqueid.h"
+#include "iothub_sc_http_pipeline.h"
+#include "iothub_sc_connection.h"
+#include "internal/iothub_sc_connection_private.h"
 
 #undef ENABLE_MOCKS
 
@@ -325,6 +328,19 @@ TEST_FUNCTION(IoTHubDeviceTwin_Create_return_null_if_input_parameter_serviceClie
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+/*Tests_SRS_IOTHUBDEVICETWIN_41_001: [ If connectionHandle is NULL IoTHubDeviceTwin_CreateWithConnection shall return NULL. ]*/
+TEST_FUNCTION(IoTHubDeviceTwin_CreateWithConnection_return_null_if_input_parameter_connectionHandle_is_NULL)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_SERVICE_CLIENT_DEVICE_TWIN_HANDLE result = IoTHubDeviceTwin_CreateWithConnection(NULL);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /*Tests_SRS_IOTHUBDEVICETWIN_12_002: [ If any member of the serviceClientHandle input parameter is NULL IoTHubDeviceTwin_Create shall return NULL ]*/
 TEST_FUNCTION(IoTHubDeviceTwin_Create_return_null_if_input_parameter_serviceClientHandle_hostName_is_NULL)
 {
@@ -4,9 +4,13 @@
 #ifdef __cplusplus
 #include <cstdlib>
 #include <cstddef>
+#include <cstdio>
+#include <cstring>
 #else
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 #endif
 
 #include "testrunnerswitcher.h"
@@ -14,6 +18,7 @@
 #include "umocktypes_charptr.h"
 #include "umock_c_negative_tests.h"
 #include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
 
 #define ENABLE_MOCKS
 #include "azure_c_shared_utility/strings.h"
@@ -39,6 +44,8 @@
 
 #include "parson.h"
 #include "iothub_message.h"
+#include "iothub_sc_connection.h"
+#include "internal/iothub_sc_connection_private.h"
 
 MOCKABLE_FUNCTION(, JSON_Array*, json_array_get_array, const JSON_Array*, array, size_t, index);
 MOCKABLE_FUNCTION(, JSON_Value*, json_parse_string, const char *, string);
@@ -296,16 +303,46 @@ void my_messagereceiver_destroy(MESSAGE_RECEIVER_HANDLE message_receiver)
 }
 
 static ON_MESSAGE_SEND_COMPLETE onMessageSendCompleteCallback;
+#define TEST_MAX_SEND_COMPLETE_CONTEXTS 64
+static void* onMessageSendCompleteContext[TEST_MAX_SEND_COMPLETE_CONTEXTS];
+static size_t onMessageSendCompleteCount;
 static ASYNC_OPERATION_HANDLE my_messagesender_send_async(MESSAGE_SENDER_HANDLE message_sender, MESSAGE_HANDLE message, ON_MESSAGE_SEND_COMPLETE on_message_send_complete, void* callback_context, tickcounter_ms_t timeout)
 {
     (void)timeout;
     (void)message;
     (void)message_sender;
-    (void)callback_context;
     onMessageSendCompleteCallback = on_message_send_complete;
+    if (onMessageSendCompleteCount < TEST_MAX_SEND_COMPLETE_CONTEXTS)
+    {
+        onMessageSendCompleteContext[onMessageSendCompleteCount] = callback_context;
+    }
+    onMessageSendCompleteCount++;
     return TEST_ASYNC_HANDLE;
 }
 
+static const char* batchCompleteDeviceId[2];
+static IOTHUB_MESSAGING_RESULT batchCompleteResult[2];
+static size_t batchCompleteCount;
+static void test_batch_send_complete(void* context, const char* deviceId, IOTHUB_MESSAGING_RESULT messagingResult)
+{
+    (void)context;
+    if (batchCompleteCount < 2)
+    {
+        batchCompleteDeviceId[batchCompleteCount] = deviceId;
+        batchCompleteResult[batchCompleteCount] = messagingResult;
+    }
+    batchCompleteCount++;
+}
+
+static IOTHUB_FEEDBACK_STATUS_CODE messageFeedbackStatusCode;
+static size_t messageFeedbackCount;
+static void test_message_feedback(void* context, const IOTHUB_SERVICE_FEEDBACK_RECORD* feedbackRecord)
+{
+    (void)context;
+    messageFeedbackStatusCode = feedbackRecord->statusCode;
+    messageFeedbackCount++;
+}
+
 static ON_MESSAGE_RECEIVED onMessageReceivedCallback;
 static int my_messagereceiver_open(MESSAGE_RECEIVER_HANDLE message_receiver, ON_MESSAGE_RECEIVED on_message_received, void* callback_context)
 {
@@ -412,6 +449,11 @@ typedef struct TEST_IOTHUB_MESSAGING_TAG
     MESSAGE_RECEIVER_STATE message_receiver_state;
 
     TEST_CALLBACK* callback_data;
+
+    void** outstanding_index;
+    size_t outstanding_index_size;
+    size_t outstanding_count;
+    void* sharedConnection;
 } TEST_IOTHUB_MESSAGING;
 
 static void* TEST_VOID_PTR = (void*)0x5454;
@@ -428,6 +470,7 @@ static const IO_INTERFACE_DESCRIPTION* TEST_IO_INTERFACE_DESCRIPTION = (const IO
 static XIO_HANDLE TEST_XIO_HANDLE = (XIO_HANDLE)0x4545;
 static CONNECTION_HANDLE TEST_CONNECTION_HANDLE = (CONNECTION_HANDLE)0x4646;
 static SESSION_HANDLE TEST_SESSION_HANDLE = (SESSION_HANDLE)0x4747;
+static IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE TEST_SHARED_CONNECTION_HANDLE = (IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE)0x4848;
 static AMQP_VALUE TEST_AMQP_VALUE = (AMQP_VALUE)0x4848;
 static AMQP_VALUE TEST_AMQP_VALUE_NULL = (AMQP_VALUE)NULL;
 static LINK_HANDLE TEST_LINK_HANDLE = (LINK_HANDLE)0x4949;
@@ -471,6 +514,8 @@ BEGIN_TEST_SUITE(iothub_messaging_ll_ut)
         ASSERT_ARE_EQUAL(int, 0, result);
         result = umocktypes_stdint_register_types();
         ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_bool_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
 
         REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
         REGISTER_UMOCK_ALIAS_TYPE(AMQP_VALUE, void*);
@@ -504,6 +549,8 @@ BEGIN_TEST_SUITE(iothub_messaging_ll_ut)
         REGISTER_UMOCK_ALIAS_TYPE(MAP_RESULT, int);
         REGISTER_UMOCK_ALIAS_TYPE(MAP_HANDLE, void*);
         REGISTER_UMOCK_ALIAS_TYPE(receiver_settle_mode, uint8_t);
+        REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_SERVICE_CLIENT_AUTH_HANDLE, void*);
         type_size = sizeof(time_t);
         if (type_size == sizeof(uint64_t))
         {
@@ -692,6 +739,10 @@ BEGIN_TEST_SUITE(iothub_messaging_ll_ut)
         
         REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetCorrelationId, TEST_CONST_CHAR_PTR);
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_GetCorrelationId, NULL);
+
+        REGISTER_GLOBAL_MOCK_RETURN(IoTHubServiceClientConnection_GetAuth, TEST_IOTHUB_SERVICE_CLIENT_AUTH_HANDLE);
+        REGISTER_GLOBAL_MOCK_RETURN(IoTHubServiceClientConnection_AttachAmqpSession, TEST_SESSION_HANDLE);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubServiceClientConnection_AttachAmqpSession, NULL);
 }
 
     TEST_SUITE_CLEANUP(TestClassCleanup)
@@ -726,6 +777,10 @@ BEGIN_TEST_SUITE(iothub_messaging_ll_ut)
         onMessageSenderStateChangedCallback = NULL;
         onMessageReceiverStateChangedCallback = NULL;
         onMessageSendCompleteCallback = NULL;
+        memset(onMessageSendCompleteContext, 0, sizeof(onMessageSendCompleteContext));
+        onMessageSendCompleteCount = 0;
+        batchCompleteCount = 0;
+        messageFeedbackCount = 0;
         onMessageReceivedCallback = NULL;
         messagereceiver_create_return = NULL;
         messagesender_create_return = NULL;
@@ -1715,6 +1770,473 @@ BEGIN_TEST_SUITE(iothub_messaging_ll_ut)
         umock_c_negative_tests_deinit();
     }
 
+    /*Tests_SRS_IOTHUBMESSAGING_40_001: [ If messagingHandle, deviceIds, any of the device ids or message is NULL, or deviceCount is 0, IoTHubMessaging_LL_SendBatch shall return IOTHUB_MESSAGING_INVALID_ARG. ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_SendBatch_return_IOTHUB_MESSAGING_INVALID_ARG_if_input_parameter_messagingHandle_is_NULL)
+    {
+        ///arrange
+        const char* deviceIds[] = { TEST_DEVICE_ID };
+
+        ///act
+        IOTHUB_MESSAGING_RESULT result = IoTHubMessaging_LL_SendBatch(NULL, deviceIds, 1, TEST_IOTHUB_MESSAGE_HANDLE, test_batch_send_complete, NULL, NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_40_001: [ If messagingHandle, deviceIds, any of the device ids or message is NULL, or deviceCount is 0, IoTHubMessaging_LL_SendBatch shall return IOTHUB_MESSAGING_INVALID_ARG. ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_SendBatch_return_IOTHUB_MESSAGING_INVALID_ARG_if_input_parameter_deviceCount_is_zero)
+    {
+        ///arrange
+        const char* deviceIds[] = { TEST_DEVICE_ID };
+
+        ///act
+        IOTHUB_MESSAGING_RESULT result = IoTHubMessaging_LL_SendBatch(TEST_IOTHUB_MESSAGING_HANDLE, deviceIds, 0, TEST_IOTHUB_MESSAGE_HANDLE, test_batch_send_complete, NULL, NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_40_001: [ If messagingHandle, deviceIds, any of the device ids or message is NULL, or deviceCount is 0, IoTHubMessaging_LL_SendBatch shall return IOTHUB_MESSAGING_INVALID_ARG. ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_SendBatch_return_IOTHUB_MESSAGING_INVALID_ARG_if_a_device_id_is_NULL)
+    {
+        ///arrange
+        const char* deviceIds[] = { TEST_DEVICE_ID, NULL };
+        TEST_IOTHUB_MESSAGING_DATA.isOpened = true;
+
+        ///act
+        IOTHUB_MESSAGING_RESULT result = IoTHubMessaging_LL_SendBatch(TEST_IOTHUB_MESSAGING_HANDLE, deviceIds, 2, TEST_IOTHUB_MESSAGE_HANDLE, test_batch_send_complete, NULL, NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(size_t, 0, batchCompleteCount);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_40_002: [ If the messaging has not been opened, IoTHubMessaging_LL_SendBatch shall return IOTHUB_MESSAGING_ERROR. ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_SendBatch_return_IOTHUB_MESSAGING_ERROR_if_messaging_is_not_opened)
+    {
+        ///arrange
+        const char* deviceIds[] = { TEST_DEVICE_ID };
+        TEST_IOTHUB_MESSAGING_DATA.isOpened = false;
+
+        ///act
+        IOTHUB_MESSAGING_RESULT result = IoTHubMessaging_LL_SendBatch(TEST_IOTHUB_MESSAGING_HANDLE, deviceIds, 1, TEST_IOTHUB_MESSAGE_HANDLE, test_batch_send_complete, NULL, NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_ERROR, result);
+        ASSERT_ARE_EQUAL(size_t, 0, batchCompleteCount);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_40_003: [ IoTHubMessaging_LL_SendBatch shall build the uAMQP message, its body, properties and application properties, once for all the devices. ] */
+    /*Tests_SRS_IOTHUBMESSAGING_40_005: [ For every device IoTHubMessaging_LL_SendBatch shall set the TO property, add the device to the outstanding message index and call messagesender_send_async without waiting for the previous sends to complete. ] */
+    /*Tests_SRS_IOTHUBMESSAGING_40_006: [ When the send to a device completes, sendCompleteCallback shall be called with the user context, the device id and IOTHUB_MESSAGING_OK or IOTHUB_MESSAGING_ERROR. ] */
+    /*Tests_SRS_IOTHUBMESSAGING_40_011: [ IoTHubMessaging_LL_SendBatch shall return IOTHUB_MESSAGING_OK if the message was queued for all the devices and IOTHUB_MESSAGING_ERROR otherwise. ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_SendBatch_builds_the_message_once_and_completes_each_device)
+    {
+        ///arrange
+        const char* deviceIds[] = { "device1", "device2" };
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_Create(TEST_IOTHUB_SERVICE_CLIENT_AUTH_HANDLE);
+        (void)IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+        ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->isOpened = true;
+        umock_c_reset_all_calls();
+
+        EXPECTED_CALL(message_get_properties(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_properties(&TEST_PROPERTIES_HANDLE, sizeof(TEST_PROPERTIES_HANDLE));
+        EXPECTED_CALL(message_get_properties(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_properties(&TEST_PROPERTIES_HANDLE, sizeof(TEST_PROPERTIES_HANDLE));
+
+        ///act
+        IOTHUB_MESSAGING_RESULT result = IoTHubMessaging_LL_SendBatch(iothub_messaging_handle, deviceIds, 2, TEST_IOTHUB_MESSAGE_HANDLE, test_batch_send_complete, NULL, NULL);
+        onMessageSendCompleteCallback(onMessageSendCompleteContext[1], MESSAGE_SEND_OK);
+        onMessageSendCompleteCallback(onMessageSendCompleteContext[0], MESSAGE_SEND_ERROR);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_OK, result);
+        ASSERT_ARE_EQUAL(size_t, 2, onMessageSendCompleteCount);
+        ASSERT_ARE_EQUAL(size_t, 2, batchCompleteCount);
+        ASSERT_ARE_EQUAL(char_ptr, "device2", batchCompleteDeviceId[0]);
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_OK, batchCompleteResult[0]);
+        ASSERT_ARE_EQUAL(char_ptr, "device1", batchCompleteDeviceId[1]);
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_ERROR, batchCompleteResult[1]);
+        ASSERT_ARE_EQUAL(size_t, 0, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->outstanding_count);
+
+        ///cleanup
+        IoTHubMessaging_LL_Close(iothub_messaging_handle);
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_40_010: [ If the message cannot be queued for a device, IoTHubMessaging_LL_SendBatch shall call sendCompleteCallback for that device with IOTHUB_MESSAGING_ERROR and continue with the next one. ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_SendBatch_reports_the_devices_that_could_not_be_queued)
+    {
+        ///arrange
+        const char* deviceIds[] = { TEST_DEVICE_ID };
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_Create(TEST_IOTHUB_SERVICE_CLIENT_AUTH_HANDLE);
+        (void)IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+        ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->isOpened = true;
+        umock_c_reset_all_calls();
+
+        EXPECTED_CALL(messagesender_send_async(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .SetReturn(NULL);
+
+        ///act
+        IOTHUB_MESSAGING_RESULT result = IoTHubMessaging_LL_SendBatch(iothub_messaging_handle, deviceIds, 1, TEST_IOTHUB_MESSAGE_HANDLE, test_batch_send_complete, NULL, NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_ERROR, result);
+        ASSERT_ARE_EQUAL(size_t, 1, batchCompleteCount);
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_ERROR, batchCompleteResult[0]);
+        ASSERT_ARE_EQUAL(size_t, 0, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->outstanding_count);
+
+        ///cleanup
+        IoTHubMessaging_LL_Close(iothub_messaging_handle);
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_40_007: [ If the send succeeded, feedbackCallback is not NULL and the message has a message-id, the device shall stay in the outstanding message index until its feedback record arrives; otherwise it shall be released. ] */
+    /*Tests_SRS_IOTHUBMESSAGING_40_008: [ IoTHubMessaging_LL_FeedbackMessageReceived shall look each record up in the outstanding message index by originalMessageId and deviceId and, if a device is waiting for it, call its feedbackCallback with the record and release it. ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_SendBatch_feedback_is_matched_by_message_id_and_device_id)
+    {
+        ///arrange
+        char description[] = "Expired";
+        const char* deviceIds[] = { TEST_CONST_CHAR_PTR };
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_Create(TEST_IOTHUB_SERVICE_CLIENT_AUTH_HANDLE);
+        (void)IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+        ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->isOpened = true;
+        (void)IoTHubMessaging_LL_SendBatch(iothub_messaging_handle, deviceIds, 1, TEST_IOTHUB_MESSAGE_HANDLE, test_batch_send_complete, test_message_feedback, NULL);
+        onMessageSendCompleteCallback(onMessageSendCompleteContext[0], MESSAGE_SEND_OK);
+        umock_c_reset_all_calls();
+
+        /*json_object_get_string returns TEST_CONST_CHAR_PTR for the deviceId and the originalMessageId, the message id of the batch*/
+        EXPECTED_CALL(json_array_get_count(IGNORED_PTR_ARG))
+            .SetReturn(1);
+        EXPECTED_CALL(json_array_get_count(IGNORED_PTR_ARG))
+            .SetReturn(1);
+        EXPECTED_CALL(json_object_get_string(IGNORED_PTR_ARG, TEST_FEEDBACK_RECORD_KEY_DESCRIPTION))
+            .SetReturn(description);
+
+        ///act
+        ASSERT_ARE_EQUAL(size_t, 1, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->outstanding_count);
+        (void)onMessageReceivedCallback(iothub_messaging_handle, TEST_MESSAGE_HANDLE);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 1, batchCompleteCount);
+        ASSERT_ARE_EQUAL(size_t, 1, messageFeedbackCount);
+        ASSERT_ARE_EQUAL(int, IOTHUB_FEEDBACK_STATUS_CODE_EXPIRED, messageFeedbackStatusCode);
+        ASSERT_ARE_EQUAL(size_t, 0, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->outstanding_count);
+
+        ///cleanup
+        IoTHubMessaging_LL_Close(iothub_messaging_handle);
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_40_008: [ IoTHubMessaging_LL_FeedbackMessageReceived shall look each record up in the outstanding message index by originalMessageId and deviceId and, if a device is waiting for it, call its feedbackCallback with the record and release it. ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_SendBatch_outstanding_index_grows_and_matches_the_device)
+    {
+        ///arrange
+        char description[] = "Expired";
+        char deviceIdStrings[40][16];
+        const char* deviceIds[40];
+        size_t i;
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_Create(TEST_IOTHUB_SERVICE_CLIENT_AUTH_HANDLE);
+        (void)IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+        ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->isOpened = true;
+        for (i = 0; i < 40; i++)
+        {
+            (void)sprintf(deviceIdStrings[i], "device%u", (unsigned int)i);
+            deviceIds[i] = deviceIdStrings[i];
+        }
+        /*json_object_get_string returns TEST_CONST_CHAR_PTR for the deviceId and the originalMessageId, only this device waits for it*/
+        deviceIds[17] = TEST_CONST_CHAR_PTR;
+        (void)IoTHubMessaging_LL_SendBatch(iothub_messaging_handle, deviceIds, 40, TEST_IOTHUB_MESSAGE_HANDLE, test_batch_send_complete, test_message_feedback, NULL);
+        for (i = 0; i < 40; i++)
+        {
+            onMessageSendCompleteCallback(onMessageSendCompleteContext[i], MESSAGE_SEND_OK);
+        }
+        umock_c_reset_all_calls();
+
+        EXPECTED_CALL(json_array_get_count(IGNORED_PTR_ARG))
+            .SetReturn(1);
+        EXPECTED_CALL(json_array_get_count(IGNORED_PTR_ARG))
+            .SetReturn(1);
+        EXPECTED_CALL(json_object_get_string(IGNORED_PTR_ARG, TEST_FEEDBACK_RECORD_KEY_DESCRIPTION))
+            .SetReturn(description);
+
+        ///act
+        ASSERT_ARE_EQUAL(size_t, 40, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->outstanding_count);
+        ASSERT_ARE_EQUAL(size_t, 64, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->outstanding_index_size);
+        (void)onMessageReceivedCallback(iothub_messaging_handle, TEST_MESSAGE_HANDLE);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 40, batchCompleteCount);
+        ASSERT_ARE_EQUAL(size_t, 1, messageFeedbackCount);
+        ASSERT_ARE_EQUAL(size_t, 39, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->outstanding_count);
+
+        ///cleanup
+        IoTHubMessaging_LL_Close(iothub_messaging_handle);
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_40_009: [ IoTHubMessaging_LL_Close shall release the devices still waiting for their feedback without calling feedbackCallback. ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_Close_releases_the_devices_waiting_for_feedback)
+    {
+        ///arrange
+        const char* deviceIds[] = { TEST_DEVICE_ID };
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_Create(TEST_IOTHUB_SERVICE_CLIENT_AUTH_HANDLE);
+        (void)IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+        ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->isOpened = true;
+        (void)IoTHubMessaging_LL_SendBatch(iothub_messaging_handle, deviceIds, 1, TEST_IOTHUB_MESSAGE_HANDLE, test_batch_send_complete, test_message_feedback, NULL);
+        onMessageSendCompleteCallback(onMessageSendCompleteContext[0], MESSAGE_SEND_OK);
+
+        ///act
+        IoTHubMessaging_LL_Close(iothub_messaging_handle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 0, messageFeedbackCount);
+        ASSERT_ARE_EQUAL(size_t, 0, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->outstanding_count);
+
+        ///cleanup
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
+    static void callsForSharedOpen(void)
+    {
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(IoTHubServiceClientConnection_AttachAmqpSession(TEST_SHARED_CONNECTION_HANDLE));
+        STRICT_EXPECTED_CALL(messaging_create_source(IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(messaging_create_target(IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(link_create(TEST_SESSION_HANDLE, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3)
+            .IgnoreArgument(4)
+            .IgnoreArgument(5);
+        addSetLinkCalls();
+        STRICT_EXPECTED_CALL(link_set_snd_settle_mode(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(messagesender_create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(messagesender_open(IGNORED_NUM_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(amqpvalue_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(amqpvalue_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_41_001: [ If connectionHandle is NULL IoTHubMessaging_LL_CreateWithConnection shall return NULL ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_CreateWithConnection_return_null_if_input_parameter_connectionHandle_is_NULL)
+    {
+        ///arrange
+
+        ///act
+        IOTHUB_MESSAGING_HANDLE result = IoTHubMessaging_LL_CreateWithConnection(NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_41_002: [ IoTHubMessaging_LL_CreateWithConnection shall create the messaging instance like IoTHubMessaging_LL_Create from the authentication information of the connection and remember the connection ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_CreateWithConnection_happy_path)
+    {
+        ///arrange
+
+        ///act
+        IOTHUB_MESSAGING_HANDLE result = IoTHubMessaging_LL_CreateWithConnection(TEST_SHARED_CONNECTION_HANDLE);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(void_ptr, TEST_SHARED_CONNECTION_HANDLE, ((TEST_IOTHUB_MESSAGING*)result)->sharedConnection);
+        ASSERT_ARE_EQUAL(int, false, ((TEST_IOTHUB_MESSAGING*)result)->isOpened);
+
+        ///cleanup
+        IoTHubMessaging_LL_Destroy(result);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_41_003: [ On a shared connection IoTHubMessaging_LL_Open shall attach to the AMQP session of the connection, which creates the AMQP connection on first use only ] */
+    /*Tests_SRS_IOTHUBMESSAGING_41_004: [ On a shared connection IoTHubMessaging_LL_Open shall only create and open the sender link; the feedback receiver link is created by IoTHubMessaging_LL_DoWork once it is needed ] */
+    /*Tests_SRS_IOTHUBMESSAGING_41_005: [ On a shared connection IoTHubMessaging_LL_Open shall return IOTHUB_MESSAGING_OK without waiting for the links to open, and messages sent before the sender link is open shall be queued by the sender ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_Open_on_a_shared_connection_attaches_the_sender_link_only)
+    {
+        ///arrange
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_CreateWithConnection(TEST_SHARED_CONNECTION_HANDLE);
+        umock_c_reset_all_calls();
+
+        callsForSharedOpen();
+
+        ///act
+        IOTHUB_MESSAGING_RESULT result = IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_OK, result);
+        ASSERT_ARE_EQUAL(int, true, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->isOpened);
+
+        ///cleanup
+        IoTHubMessaging_LL_Close(iothub_messaging_handle);
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_41_003: [ On a shared connection IoTHubMessaging_LL_Open shall attach to the AMQP session of the connection, which creates the AMQP connection on first use only ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_Open_on_a_shared_connection_fails_if_the_session_cannot_be_attached)
+    {
+        ///arrange
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_CreateWithConnection(TEST_SHARED_CONNECTION_HANDLE);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(IoTHubServiceClientConnection_AttachAmqpSession(TEST_SHARED_CONNECTION_HANDLE))
+            .SetReturn(NULL);
+        STRICT_EXPECTED_CALL(amqpvalue_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(amqpvalue_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        IOTHUB_MESSAGING_RESULT result = IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGING_ERROR, result);
+        ASSERT_ARE_EQUAL(int, false, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->isOpened);
+
+        ///cleanup
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_41_009: [ On a shared connection IoTHubMessaging_LL_Close shall destroy the links and detach from the session, keeping the AMQP connection open unless one of the links failed ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_Close_on_a_shared_connection_keeps_the_amqp_connection)
+    {
+        ///arrange
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_CreateWithConnection(TEST_SHARED_CONNECTION_HANDLE);
+        (void)IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(messagesender_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(messagereceiver_destroy(NULL));
+        STRICT_EXPECTED_CALL(link_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(link_destroy(NULL));
+        STRICT_EXPECTED_CALL(IoTHubServiceClientConnection_DetachAmqpSession(TEST_SHARED_CONNECTION_HANDLE, false));
+
+        ///act
+        IoTHubMessaging_LL_Close(iothub_messaging_handle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(int, false, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->isOpened);
+
+        ///cleanup
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_41_009: [ On a shared connection IoTHubMessaging_LL_Close shall destroy the links and detach from the session, keeping the AMQP connection open unless one of the links failed ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_Close_on_a_shared_connection_closes_the_amqp_connection_after_a_link_failure)
+    {
+        ///arrange
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_CreateWithConnection(TEST_SHARED_CONNECTION_HANDLE);
+        (void)IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+        onMessageSenderStateChangedCallback(iothub_messaging_handle, MESSAGE_SENDER_STATE_ERROR, MESSAGE_SENDER_STATE_OPEN);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(messagesender_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(messagereceiver_destroy(NULL));
+        STRICT_EXPECTED_CALL(link_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(link_destroy(NULL));
+        STRICT_EXPECTED_CALL(IoTHubServiceClientConnection_DetachAmqpSession(TEST_SHARED_CONNECTION_HANDLE, true));
+
+        ///act
+        IoTHubMessaging_LL_Close(iothub_messaging_handle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_41_007: [ On a shared connection IoTHubMessaging_LL_SenderStateChanged shall call the open complete callback when the sender link opens, and clear isOpened only when the sender link fails. ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_SenderStateChanged_on_a_shared_connection_calls_open_complete_without_the_receiver)
+    {
+        ///arrange
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_CreateWithConnection(TEST_SHARED_CONNECTION_HANDLE);
+        (void)IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+        onMessageSenderStateChangedCallback(iothub_messaging_handle, MESSAGE_SENDER_STATE_OPENING, MESSAGE_SENDER_STATE_IDLE);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK((void*)1));
+
+        ///act
+        onMessageSenderStateChangedCallback(iothub_messaging_handle, MESSAGE_SENDER_STATE_OPEN, MESSAGE_SENDER_STATE_OPENING);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(int, true, ((TEST_IOTHUB_MESSAGING*)iothub_messaging_handle)->isOpened);
+
+        ///cleanup
+        IoTHubMessaging_LL_Close(iothub_messaging_handle);
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGING_41_006: [ On a shared connection IoTHubMessaging_LL_DoWork shall create the feedback receiver link once a feedback callback is set or a device is waiting for its feedback, then call IoTHubServiceClientConnection_DoWork ] */
+    TEST_FUNCTION(IoTHubMessaging_LL_DoWork_on_a_shared_connection_opens_the_feedback_receiver_once_needed)
+    {
+        ///arrange
+        IOTHUB_MESSAGING_HANDLE iothub_messaging_handle = IoTHubMessaging_LL_CreateWithConnection(TEST_SHARED_CONNECTION_HANDLE);
+        (void)IoTHubMessaging_LL_Open(iothub_messaging_handle, TEST_FUNC_IOTHUB_OPEN_COMPLETE_CALLBACK, (void*)1);
+        IoTHubMessaging_LL_DoWork(iothub_messaging_handle);
+        (void)IoTHubMessaging_LL_SetFeedbackMessageCallback(iothub_messaging_handle, TEST_FUNC_IOTHUB_FEEDBACK_MESSAGE_RECEIVED_CALLBACK, NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(messaging_create_source(IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(messaging_create_target(IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(link_create(TEST_SESSION_HANDLE, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3)
+            .IgnoreArgument(4)
+            .IgnoreArgument(5);
+        addSetLinkCalls();
+        STRICT_EXPECTED_CALL(link_set_rcv_settle_mode(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(messagereceiver_create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(messagereceiver_open(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(amqpvalue_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(amqpvalue_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(IoTHubServiceClientConnection_DoWork(TEST_SHARED_CONNECTION_HANDLE));
+
+        ///act
+        IoTHubMessaging_LL_DoWork(iothub_messaging_handle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        IoTHubMessaging_LL_Close(iothub_messaging_handle);
+        IoTHubMessaging_LL_Destroy(iothub_messaging_handle);
+    }
+
     /*Tests_SRS_IOTHUBMESSAGING_12_042: [ IoTHubMessaging_LL_SetCallbacks shall verify the messagingHandle input parameter and if it is NULL then return NULL ] */
     TEST_FUNCTION(IoTHubMessaging_LL_SetFeedbackMessageCallback_return_IOTHUB_MESSAGING_INVALID_ARG_if_input_parameter_messagingHandle_is_NULL)
     {
@@ -21,6 +21,9 @@
 #include "azure_c_shared_utility/httpapiexsas.h"
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
+#include "iothub_sc_http_pipeline.h"
+#include "iothub_sc_connection.h"
+#include "internal/iothub_sc_connection_private.h"
 #include "parson.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 
@@ -473,6 +476,12 @@ static const char* TEST_HTTP_HEADER_VAL_IFMATCH = "*";
 
 DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
 
+static void TEST_DEVICE_CALLBACK(const IOTHUB_DEVICE* device, void* userContext)
+{
+    (void)device;
+    (void)userContext;
+}
+
 static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 {
     char temp_str[256];
@@ -915,6 +924,19 @@ BEGIN_TEST_SUITE(iothub_registrymanager_ut)
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
     }
 
+    /*Tests_SRS_IOTHUBREGISTRYMANAGER_41_001: [ If connectionHandle is NULL IoTHubRegistryManager_CreateWithConnection shall return NULL. ]*/
+    TEST_FUNCTION(IoTHubRegistryManager_CreateWithConnection_return_null_if_input_parameter_connectionHandle_is_NULL)
+    {
+        ///arrange
+
+        ///act
+        IOTHUB_REGISTRYMANAGER_HANDLE result = IoTHubRegistryManager_CreateWithConnection(NULL);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
     /* Tests_SRS_IOTHUBREGISTRYMANAGER_12_084: [ If any member of the serviceClientHandle input parameter is NULL IoTHubRegistryManager_Create shall return NULL ] */
     TEST_FUNCTION(IoTHubRegistryManager_Create_return_null_if_input_parameter_serviceClientHandle_hostName_is_NULL)
     {
@@ -2439,6 +2461,81 @@ BEGIN_TEST_SUITE(iothub_registrymanager_ut)
         ///cleanup
     }
 
+    /* Tests_SRS_IOTHUBREGISTRYMANAGER_39_001: [ If registryManagerHandle is NULL or pageSize is not between 1 and 1000, IoTHubRegistryManager_CreateDeviceIterator shall return NULL. ]*/
+    TEST_FUNCTION(IoTHubRegistryManager_CreateDeviceIterator_return_NULL_if_input_parameter_registryManagerHandle_is_NULL)
+    {
+        ///arrange
+
+        ///act
+        IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE result = IoTHubRegistryManager_CreateDeviceIterator(NULL, NULL, IOTHUB_REGISTRYMANAGER_DEFAULT_PAGE_SIZE);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+    }
+
+    /* Tests_SRS_IOTHUBREGISTRYMANAGER_39_001: [ If registryManagerHandle is NULL or pageSize is not between 1 and 1000, IoTHubRegistryManager_CreateDeviceIterator shall return NULL. ]*/
+    TEST_FUNCTION(IoTHubRegistryManager_CreateDeviceIterator_return_NULL_if_input_parameter_pageSize_is_zero)
+    {
+        ///arrange
+
+        ///act
+        IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE result = IoTHubRegistryManager_CreateDeviceIterator(TEST_IOTHUB_REGISTRYMANAGER_HANDLE, NULL, 0);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+    }
+
+    /* Tests_SRS_IOTHUBREGISTRYMANAGER_39_001: [ If registryManagerHandle is NULL or pageSize is not between 1 and 1000, IoTHubRegistryManager_CreateDeviceIterator shall return NULL. ]*/
+    TEST_FUNCTION(IoTHubRegistryManager_CreateDeviceIterator_return_NULL_if_input_parameter_pageSize_is_1001)
+    {
+        ///arrange
+
+        ///act
+        IOTHUB_REGISTRYMANAGER_DEVICE_ITERATOR_HANDLE result = IoTHubRegistryManager_CreateDeviceIterator(TEST_IOTHUB_REGISTRYMANAGER_HANDLE, NULL, 1001);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+    }
+
+    /* Tests_SRS_IOTHUBREGISTRYMANAGER_39_006: [ If iteratorHandle, callback or hasMorePages is NULL, IoTHubRegistryManager_GetNextDevicePage shall return IOTHUB_REGISTRYMANAGER_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubRegistryManager_GetNextDevicePage_return_IOTHUB_REGISTRYMANAGER_INVALID_ARG_if_input_parameter_iteratorHandle_is_NULL)
+    {
+        ///arrange
+        bool hasMorePages = true;
+
+        ///act
+        IOTHUB_REGISTRYMANAGER_RESULT result = IoTHubRegistryManager_GetNextDevicePage(NULL, TEST_DEVICE_CALLBACK, NULL, &hasMorePages);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, IOTHUB_REGISTRYMANAGER_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+    }
+
+    /* Tests_SRS_IOTHUBREGISTRYMANAGER_39_005: [ IoTHubRegistryManager_DestroyDeviceIterator shall do nothing if iteratorHandle is NULL, otherwise it shall release the HTTPAPIEX handles, the query and the continuation token. ]*/
+    TEST_FUNCTION(IoTHubRegistryManager_DestroyDeviceIterator_does_nothing_if_iteratorHandle_is_NULL)
+    {
+        ///arrange
+
+        ///act
+        IoTHubRegistryManager_DestroyDeviceIterator(NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+    }
+
 #define AAA
 #ifdef AAA
     /* Tests_SRS_IOTHUBREGISTRYMANAGER_12_074: [ IoTHubRegistryManager_GetStatistics shall verify the input parameters and if any of them are NULL then return IOTHUB_REGISTRYMANAGER_INVALID_ARG ]*/
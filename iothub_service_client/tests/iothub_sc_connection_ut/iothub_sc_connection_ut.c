@@ -0,0 +1,599 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/sastoken.h"
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/xio.h"
+#include "azure_c_shared_utility/tlsio.h"
+
+#include "azure_uamqp_c/connection.h"
+#include "azure_uamqp_c/session.h"
+#include "azure_uamqp_c/sasl_mechanism.h"
+#include "azure_uamqp_c/saslclientio.h"
+#include "azure_uamqp_c/sasl_plain.h"
+
+#include "iothub_sc_http_pipeline.h"
+#undef ENABLE_MOCKS
+
+#include "iothub_sc_connection.h"
+#include "internal/iothub_sc_connection_private.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    extern int real_mallocAndStrcpy_s(char** destination, const char* source);
+#ifdef __cplusplus
+}
+#endif
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+TEST_DEFINE_ENUM_TYPE(IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT, IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT, IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_RESULT_VALUES);
+
+static char* TEST_HOSTNAME = "theHub.azure-devices.net";
+static char* TEST_IOTHUBNAME = "theHub";
+static char* TEST_IOTHUBSUFFIX = "azure-devices.net";
+static char* TEST_SHAREDACCESSKEY = "c2hhcmVkIGFjY2VzcyBrZXk=";
+static char* TEST_SHAREDACCESSKEYNAME = "iothubowner";
+static const char* TEST_SAS_TOKEN = "SharedAccessSignature sr=theHub";
+static const char* TEST_TRUSTED_CERT = "-----BEGIN CERTIFICATE-----";
+
+static IOTHUB_HTTP_PIPELINE_HANDLE TEST_HTTP_PIPELINE_HANDLE = (IOTHUB_HTTP_PIPELINE_HANDLE)0x4141;
+static STRING_HANDLE TEST_SAS_STRING_HANDLE = (STRING_HANDLE)0x4242;
+static const SASL_MECHANISM_INTERFACE_DESCRIPTION* TEST_SASL_INTERFACE = (const SASL_MECHANISM_INTERFACE_DESCRIPTION*)0x4343;
+static SASL_MECHANISM_HANDLE TEST_SASL_MECHANISM_HANDLE = (SASL_MECHANISM_HANDLE)0x4444;
+static const IO_INTERFACE_DESCRIPTION* TEST_IO_INTERFACE = (const IO_INTERFACE_DESCRIPTION*)0x4545;
+static XIO_HANDLE TEST_XIO_HANDLE = (XIO_HANDLE)0x4646;
+static CONNECTION_HANDLE TEST_CONNECTION_HANDLE = (CONNECTION_HANDLE)0x4747;
+static SESSION_HANDLE TEST_SESSION_HANDLE = (SESSION_HANDLE)0x4848;
+
+static IOTHUB_SERVICE_CLIENT_AUTH TEST_IOTHUB_SERVICE_CLIENT_AUTH;
+
+BEGIN_TEST_SUITE(iothub_sc_connection_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_bool_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_TYPE(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_RESULT);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_HTTP_PIPELINE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(SASL_MECHANISM_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(XIO_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(CONNECTION_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(SESSION_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_ENDPOINT_FRAME_RECEIVED, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_CONNECTION_STATE_CHANGED, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_LINK_ATTACHED, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, real_mallocAndStrcpy_s);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(mallocAndStrcpy_s, __LINE__);
+
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubHttpPipeline_Create, TEST_HTTP_PIPELINE_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubHttpPipeline_Create, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubHttpPipeline_SetOption, IOTHUB_HTTP_PIPELINE_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubHttpPipeline_SetOption, IOTHUB_HTTP_PIPELINE_ERROR);
+
+    REGISTER_GLOBAL_MOCK_RETURN(SASToken_CreateString, TEST_SAS_STRING_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(SASToken_CreateString, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(STRING_c_str, TEST_SAS_TOKEN);
+
+    REGISTER_GLOBAL_MOCK_RETURN(saslplain_get_interface, TEST_SASL_INTERFACE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(saslplain_get_interface, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(saslmechanism_create, TEST_SASL_MECHANISM_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(saslmechanism_create, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(platform_get_default_tlsio, TEST_IO_INTERFACE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(platform_get_default_tlsio, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(saslclientio_get_interface_description, TEST_IO_INTERFACE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(saslclientio_get_interface_description, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(xio_create, TEST_XIO_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(xio_create, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(xio_setoption, 0);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(xio_setoption, 1);
+    REGISTER_GLOBAL_MOCK_RETURN(connection_create, TEST_CONNECTION_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(connection_create, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(session_create, TEST_SESSION_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(session_create, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(session_set_incoming_window, 0);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(session_set_incoming_window, 1);
+    REGISTER_GLOBAL_MOCK_RETURN(session_set_outgoing_window, 0);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(session_set_outgoing_window, 1);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("Could not acquire test serialization mutex.");
+    }
+
+    umock_c_reset_all_calls();
+
+    TEST_IOTHUB_SERVICE_CLIENT_AUTH.hostname = TEST_HOSTNAME;
+    TEST_IOTHUB_SERVICE_CLIENT_AUTH.iothubName = TEST_IOTHUBNAME;
+    TEST_IOTHUB_SERVICE_CLIENT_AUTH.iothubSuffix = TEST_IOTHUBSUFFIX;
+    TEST_IOTHUB_SERVICE_CLIENT_AUTH.sharedAccessKey = TEST_SHAREDACCESSKEY;
+    TEST_IOTHUB_SERVICE_CLIENT_AUTH.keyName = TEST_SHAREDACCESSKEYNAME;
+}
+
+TEST_FUNCTION_CLEANUP(method_cleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+static void setupAmqpOpenCalls(bool withTrustedCert)
+{
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(SASToken_CreateString(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(STRING_c_str(TEST_SAS_STRING_HANDLE));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_SAS_TOKEN));
+    STRICT_EXPECTED_CALL(STRING_delete(TEST_SAS_STRING_HANDLE));
+    STRICT_EXPECTED_CALL(saslplain_get_interface());
+    STRICT_EXPECTED_CALL(saslmechanism_create(TEST_SASL_INTERFACE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(platform_get_default_tlsio());
+    STRICT_EXPECTED_CALL(xio_create(TEST_IO_INTERFACE, IGNORED_PTR_ARG));
+    if (withTrustedCert)
+    {
+        STRICT_EXPECTED_CALL(xio_setoption(TEST_XIO_HANDLE, IOTHUB_HTTP_PIPELINE_OPTION_TRUSTED_CERT, IGNORED_PTR_ARG));
+    }
+    STRICT_EXPECTED_CALL(saslclientio_get_interface_description());
+    STRICT_EXPECTED_CALL(xio_create(TEST_IO_INTERFACE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(connection_create(TEST_XIO_HANDLE, TEST_HOSTNAME, IGNORED_PTR_ARG, NULL, NULL));
+    STRICT_EXPECTED_CALL(session_create(TEST_CONNECTION_HANDLE, NULL, NULL));
+    STRICT_EXPECTED_CALL(session_set_incoming_window(TEST_SESSION_HANDLE, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(session_set_outgoing_window(TEST_SESSION_HANDLE, IGNORED_NUM_ARG));
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_001: [ If serviceClientHandle or any of its members is NULL, IoTHubServiceClientConnection_Create shall return NULL. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_Create_return_null_if_input_parameter_serviceClientHandle_is_NULL)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE result = IoTHubServiceClientConnection_Create(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(result);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_001: [ If serviceClientHandle or any of its members is NULL, IoTHubServiceClientConnection_Create shall return NULL. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_Create_return_null_if_input_parameter_keyName_is_NULL)
+{
+    ///arrange
+    TEST_IOTHUB_SERVICE_CLIENT_AUTH.keyName = NULL;
+
+    ///act
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE result = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(result);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_002: [ IoTHubServiceClientConnection_Create shall copy the authentication information and shall not open any connection. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_Create_happy_path)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_HOSTNAME));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_IOTHUBNAME));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_IOTHUBSUFFIX));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_SHAREDACCESSKEY));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_SHAREDACCESSKEYNAME));
+
+    ///act
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE result = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_HOSTNAME, IoTHubServiceClientConnection_GetAuth(result)->hostname);
+    ASSERT_ARE_NOT_EQUAL(void_ptr, TEST_HOSTNAME, IoTHubServiceClientConnection_GetAuth(result)->hostname);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_SHAREDACCESSKEYNAME, IoTHubServiceClientConnection_GetAuth(result)->keyName);
+
+    ///cleanup
+    IoTHubServiceClientConnection_Destroy(result);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_003: [ If any allocation fails, IoTHubServiceClientConnection_Create shall free what it allocated and return NULL. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_Create_non_happy_path)
+{
+    ///arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_HOSTNAME));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_IOTHUBNAME));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_IOTHUBSUFFIX));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_SHAREDACCESSKEY));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_SHAREDACCESSKEYNAME));
+    umock_c_negative_tests_snapshot();
+
+    for (size_t i = 0; i < umock_c_negative_tests_call_count(); i++)
+    {
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(i);
+
+        ///act
+        IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE result = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    ///cleanup
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_004: [ If connectionHandle is NULL, IoTHubServiceClientConnection_Destroy shall return. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_Destroy_do_nothing_if_input_parameter_is_NULL)
+{
+    ///arrange
+
+    ///act
+    IoTHubServiceClientConnection_Destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_005: [ IoTHubServiceClientConnection_Destroy shall destroy the HTTP pipeline and the AMQP session and connection when they exist and free the connection. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_Destroy_destroys_the_pipeline_and_the_amqp_connection)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    (void)IoTHubServiceClientConnection_GetHttpPipeline(handle);
+    (void)IoTHubServiceClientConnection_AttachAmqpSession(handle);
+    IoTHubServiceClientConnection_DetachAmqpSession(handle, false);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubHttpPipeline_Destroy(TEST_HTTP_PIPELINE_HANDLE));
+    STRICT_EXPECTED_CALL(session_destroy(TEST_SESSION_HANDLE));
+    STRICT_EXPECTED_CALL(connection_destroy(TEST_CONNECTION_HANDLE));
+    STRICT_EXPECTED_CALL(xio_destroy(TEST_XIO_HANDLE));
+    STRICT_EXPECTED_CALL(xio_destroy(TEST_XIO_HANDLE));
+    STRICT_EXPECTED_CALL(saslmechanism_destroy(TEST_SASL_MECHANISM_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(NULL));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    ///act
+    IoTHubServiceClientConnection_Destroy(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_006: [ If any parameter is NULL, IoTHubServiceClientConnection_SetOption shall return IOTHUB_SERVICE_CLIENT_CONNECTION_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_SetOption_return_IOTHUB_SERVICE_CLIENT_CONNECTION_INVALID_ARG_if_input_parameter_value_is_NULL)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT result = IoTHubServiceClientConnection_SetOption(handle, IOTHUB_HTTP_PIPELINE_OPTION_TRUSTED_CERT, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT, IOTHUB_SERVICE_CLIENT_CONNECTION_INVALID_ARG, result);
+
+    ///cleanup
+    IoTHubServiceClientConnection_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_007: [ IoTHubServiceClientConnection_SetOption shall pass the option to IoTHubHttpPipeline_SetOption and map its result. ]*/
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_008: [ The TrustedCerts option shall also be copied and set on the TLS IO of the AMQP connection opened afterwards. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_SetOption_trusted_certs_apply_to_the_pipeline_and_the_amqp_connection)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubHttpPipeline_Create(TEST_HOSTNAME, TEST_SHAREDACCESSKEY, TEST_SHAREDACCESSKEYNAME));
+    STRICT_EXPECTED_CALL(IoTHubHttpPipeline_SetOption(TEST_HTTP_PIPELINE_HANDLE, IOTHUB_HTTP_PIPELINE_OPTION_TRUSTED_CERT, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_TRUSTED_CERT));
+
+    ///act
+    IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT result = IoTHubServiceClientConnection_SetOption(handle, IOTHUB_HTTP_PIPELINE_OPTION_TRUSTED_CERT, TEST_TRUSTED_CERT);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_SERVICE_CLIENT_CONNECTION_RESULT, IOTHUB_SERVICE_CLIENT_CONNECTION_OK, result);
+
+    ///arrange
+    umock_c_reset_all_calls();
+    setupAmqpOpenCalls(true);
+
+    ///act
+    SESSION_HANDLE session = IoTHubServiceClientConnection_AttachAmqpSession(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, TEST_SESSION_HANDLE, session);
+
+    ///cleanup
+    IoTHubServiceClientConnection_DetachAmqpSession(handle, false);
+    IoTHubServiceClientConnection_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_009: [ IoTHubServiceClientConnection_DoWork shall call IoTHubHttpPipeline_DoWork and connection_dowork for the pipeline and the AMQP connection that exist and do nothing otherwise. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_DoWork_does_nothing_before_first_use)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    umock_c_reset_all_calls();
+
+    ///act
+    IoTHubServiceClientConnection_DoWork(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubServiceClientConnection_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_009: [ IoTHubServiceClientConnection_DoWork shall call IoTHubHttpPipeline_DoWork and connection_dowork for the pipeline and the AMQP connection that exist and do nothing otherwise. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_DoWork_drives_the_pipeline_and_the_amqp_connection)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    (void)IoTHubServiceClientConnection_GetHttpPipeline(handle);
+    (void)IoTHubServiceClientConnection_AttachAmqpSession(handle);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubHttpPipeline_DoWork(TEST_HTTP_PIPELINE_HANDLE));
+    STRICT_EXPECTED_CALL(connection_dowork(TEST_CONNECTION_HANDLE));
+
+    ///act
+    IoTHubServiceClientConnection_DoWork(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubServiceClientConnection_DetachAmqpSession(handle, false);
+    IoTHubServiceClientConnection_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_012: [ IoTHubServiceClientConnection_GetHttpPipeline shall create the HTTP pipeline on first use and return the same pipeline to every caller afterwards. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_GetHttpPipeline_creates_the_pipeline_once)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubHttpPipeline_Create(TEST_HOSTNAME, TEST_SHAREDACCESSKEY, TEST_SHAREDACCESSKEYNAME));
+
+    ///act
+    IOTHUB_HTTP_PIPELINE_HANDLE first = IoTHubServiceClientConnection_GetHttpPipeline(handle);
+    IOTHUB_HTTP_PIPELINE_HANDLE second = IoTHubServiceClientConnection_GetHttpPipeline(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, TEST_HTTP_PIPELINE_HANDLE, first);
+    ASSERT_ARE_EQUAL(void_ptr, first, second);
+
+    ///cleanup
+    IoTHubServiceClientConnection_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_010: [ On the first attach IoTHubServiceClientConnection_AttachAmqpSession shall create a SASL PLAIN mechanism authenticated with the shared access policy, a TLS IO on port 5671, a SASL client IO, the AMQP connection and the AMQP session, without waiting for any of them to open. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_AttachAmqpSession_creates_the_amqp_connection_on_first_use)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    umock_c_reset_all_calls();
+
+    setupAmqpOpenCalls(false);
+
+    ///act
+    SESSION_HANDLE result = IoTHubServiceClientConnection_AttachAmqpSession(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, TEST_SESSION_HANDLE, result);
+
+    ///cleanup
+    IoTHubServiceClientConnection_DetachAmqpSession(handle, false);
+    IoTHubServiceClientConnection_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_011: [ If any of the AMQP objects cannot be created IoTHubServiceClientConnection_AttachAmqpSession shall destroy the ones already created and return NULL. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_AttachAmqpSession_non_happy_path)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    umock_c_reset_all_calls();
+
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    setupAmqpOpenCalls(false);
+    umock_c_negative_tests_snapshot();
+
+    for (size_t i = 0; i < umock_c_negative_tests_call_count(); i++)
+    {
+        /* STRING_c_str and STRING_delete cannot fail */
+        if ((i == 2) || (i == 4))
+        {
+            continue;
+        }
+
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(i);
+
+        ///act
+        SESSION_HANDLE result = IoTHubServiceClientConnection_AttachAmqpSession(handle);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    ///cleanup
+    umock_c_negative_tests_deinit();
+    IoTHubServiceClientConnection_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_013: [ If a messaging client is already attached, IoTHubServiceClientConnection_AttachAmqpSession shall return NULL. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_AttachAmqpSession_fails_if_a_client_is_already_attached)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    (void)IoTHubServiceClientConnection_AttachAmqpSession(handle);
+    umock_c_reset_all_calls();
+
+    ///act
+    SESSION_HANDLE result = IoTHubServiceClientConnection_AttachAmqpSession(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(result);
+
+    ///cleanup
+    IoTHubServiceClientConnection_DetachAmqpSession(handle, false);
+    IoTHubServiceClientConnection_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_014: [ Once the AMQP connection exists IoTHubServiceClientConnection_AttachAmqpSession shall return its session without creating anything. ]*/
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_015: [ IoTHubServiceClientConnection_DetachAmqpSession shall release the session and keep the AMQP connection open, unless closeConnection is true in which case it shall be destroyed and recreated by the next attach. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_DetachAmqpSession_keeps_the_amqp_connection_for_the_next_attach)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    (void)IoTHubServiceClientConnection_AttachAmqpSession(handle);
+    umock_c_reset_all_calls();
+
+    ///act
+    IoTHubServiceClientConnection_DetachAmqpSession(handle, false);
+    SESSION_HANDLE result = IoTHubServiceClientConnection_AttachAmqpSession(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, TEST_SESSION_HANDLE, result);
+
+    ///cleanup
+    IoTHubServiceClientConnection_DetachAmqpSession(handle, false);
+    IoTHubServiceClientConnection_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBSERVICECLIENTCONNECTION_41_015: [ IoTHubServiceClientConnection_DetachAmqpSession shall release the session and keep the AMQP connection open, unless closeConnection is true in which case it shall be destroyed and recreated by the next attach. ]*/
+TEST_FUNCTION(IoTHubServiceClientConnection_DetachAmqpSession_closes_the_amqp_connection_on_request)
+{
+    ///arrange
+    IOTHUB_SERVICE_CLIENT_CONNECTION_HANDLE handle = IoTHubServiceClientConnection_Create(&TEST_IOTHUB_SERVICE_CLIENT_AUTH);
+    (void)IoTHubServiceClientConnection_AttachAmqpSession(handle);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(session_destroy(TEST_SESSION_HANDLE));
+    STRICT_EXPECTED_CALL(connection_destroy(TEST_CONNECTION_HANDLE));
+    STRICT_EXPECTED_CALL(xio_destroy(TEST_XIO_HANDLE));
+    STRICT_EXPECTED_CALL(xio_destroy(TEST_XIO_HANDLE));
+    STRICT_EXPECTED_CALL(saslmechanism_destroy(TEST_SASL_MECHANISM_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    ///act
+    IoTHubServiceClientConnection_DetachAmqpSession(handle, true);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///arrange
+    umock_c_reset_all_calls();
+    setupAmqpOpenCalls(false);
+
+    ///act
+    SESSION_HANDLE result = IoTHubServiceClientConnection_AttachAmqpSession(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, TEST_SESSION_HANDLE, result);
+
+    ///cleanup
+    IoTHubServiceClientConnection_DetachAmqpSession(handle, false);
+    IoTHubServiceClientConnection_Destroy(handle);
+}
+
+END_TEST_SUITE(iothub_sc_connection_ut)
@@ -0,0 +1,610 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void* my_gballoc_calloc(size_t nmemb, size_t size)
+{
+    return calloc(nmemb, size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/httpheaders.h"
+#include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/sastoken.h"
+#include "azure_c_shared_utility/uniqueid.h"
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/tlsio.h"
+#include "azure_c_shared_utility/socketio.h"
+
+#include "azure_uhttp_c/uhttp.h"
+#undef ENABLE_MOCKS
+
+#include "iothub_sc_http_pipeline.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    extern void real_DList_InitializeListHead(PDLIST_ENTRY listHead);
+    extern int real_DList_IsListEmpty(const PDLIST_ENTRY listHead);
+    extern void real_DList_InsertTailList(PDLIST_ENTRY listHead, PDLIST_ENTRY listEntry);
+    extern void real_DList_InsertHeadList(PDLIST_ENTRY listHead, PDLIST_ENTRY listEntry);
+    extern void real_DList_AppendTailList(PDLIST_ENTRY listHead, PDLIST_ENTRY ListToAppend);
+    extern int real_DList_RemoveEntryList(PDLIST_ENTRY listEntry);
+    extern PDLIST_ENTRY real_DList_RemoveHeadList(PDLIST_ENTRY listHead);
+    extern int real_mallocAndStrcpy_s(char** destination, const char* source);
+#ifdef __cplusplus
+}
+#endif
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+TEST_DEFINE_ENUM_TYPE(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_RESULT_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_RESULT_VALUES);
+
+static const char* TEST_HOSTNAME = "theHub.azure-devices.net";
+static const char* TEST_SHARED_ACCESS_KEY = "c2hhcmVkIGFjY2VzcyBrZXk=";
+static const char* TEST_KEY_NAME = "iothubowner";
+static const char* TEST_RELATIVE_PATH = "/twins/theDevice?api-version=2017-06-30";
+static const char* TEST_IF_MATCH = "*";
+static const unsigned char TEST_CONTENT[] = { '{', '}' };
+static const char* TEST_SAS_TOKEN = "SharedAccessSignature sr=theHub";
+static const unsigned char TEST_RESPONSE[] = { '{', '"', 'a', '"', ':', '1', '}' };
+static HTTP_HEADERS_HANDLE TEST_HTTP_HEADERS_HANDLE = (HTTP_HEADERS_HANDLE)0x4242;
+static STRING_HANDLE TEST_SAS_STRING_HANDLE = (STRING_HANDLE)0x4343;
+static const IO_INTERFACE_DESCRIPTION* TEST_INTERFACE_DESC = (const IO_INTERFACE_DESCRIPTION*)0x4444;
+static void* TEST_USER_CONTEXT = (void*)0x4545;
+
+#define TEST_MAX_CLIENTS 8
+
+/* fake uhttp clients: opening completes on the next uhttp_client_dowork and a request is answered
+   on the uhttp_client_dowork that follows its execution with g_reply_reason and g_reply_status */
+static size_t g_client_count;
+static ON_HTTP_OPEN_COMPLETE_CALLBACK g_on_open[TEST_MAX_CLIENTS];
+static void* g_on_open_ctx[TEST_MAX_CLIENTS];
+static ON_HTTP_REQUEST_CALLBACK g_on_request[TEST_MAX_CLIENTS];
+static void* g_on_request_ctx[TEST_MAX_CLIENTS];
+static HTTP_CALLBACK_REASON g_reply_reason;
+static unsigned int g_reply_status;
+
+static size_t g_callback_count;
+static IOTHUB_HTTP_PIPELINE_RESULT g_callback_result;
+static unsigned int g_callback_status;
+static size_t g_callback_content_length;
+
+static size_t client_index(HTTP_CLIENT_HANDLE handle)
+{
+    return (size_t)handle - 1;
+}
+
+static HTTP_CLIENT_HANDLE my_uhttp_client_create(const IO_INTERFACE_DESCRIPTION* io_interface_desc, const void* xio_param, ON_HTTP_ERROR_CALLBACK on_http_error, void* callback_ctx)
+{
+    (void)io_interface_desc;
+    (void)xio_param;
+    (void)on_http_error;
+    (void)callback_ctx;
+    g_client_count++;
+    return (HTTP_CLIENT_HANDLE)g_client_count;
+}
+
+static HTTP_CLIENT_RESULT my_uhttp_client_open(HTTP_CLIENT_HANDLE handle, const char* host, int port_num, ON_HTTP_OPEN_COMPLETE_CALLBACK on_connect, void* callback_ctx)
+{
+    (void)host;
+    (void)port_num;
+    g_on_open[client_index(handle)] = on_connect;
+    g_on_open_ctx[client_index(handle)] = callback_ctx;
+    return HTTP_CLIENT_OK;
+}
+
+static HTTP_CLIENT_RESULT my_uhttp_client_execute_request(HTTP_CLIENT_HANDLE handle, HTTP_CLIENT_REQUEST_TYPE request_type, const char* relative_path,
+    HTTP_HEADERS_HANDLE http_header_handle, const unsigned char* content, size_t content_length, ON_HTTP_REQUEST_CALLBACK on_request_callback, void* callback_ctx)
+{
+    (void)request_type;
+    (void)relative_path;
+    (void)http_header_handle;
+    (void)content;
+    (void)content_length;
+    g_on_request[client_index(handle)] = on_request_callback;
+    g_on_request_ctx[client_index(handle)] = callback_ctx;
+    return HTTP_CLIENT_OK;
+}
+
+static void my_uhttp_client_dowork(HTTP_CLIENT_HANDLE handle)
+{
+    size_t index = client_index(handle);
+    if (g_on_open[index] != NULL)
+    {
+        ON_HTTP_OPEN_COMPLETE_CALLBACK on_open = g_on_open[index];
+        g_on_open[index] = NULL;
+        on_open(g_on_open_ctx[index], HTTP_CALLBACK_REASON_OK);
+    }
+    else if (g_on_request[index] != NULL)
+    {
+        ON_HTTP_REQUEST_CALLBACK on_request = g_on_request[index];
+        g_on_request[index] = NULL;
+        on_request(g_on_request_ctx[index], g_reply_reason, TEST_RESPONSE, sizeof(TEST_RESPONSE), g_reply_status, NULL);
+    }
+}
+
+static STRING_HANDLE my_SASToken_CreateString(const char* key, const char* scope, const char* keyName, size_t expiry)
+{
+    (void)key;
+    (void)scope;
+    (void)keyName;
+    (void)expiry;
+    return TEST_SAS_STRING_HANDLE;
+}
+
+static UNIQUEID_RESULT my_UniqueId_Generate(char* uid, size_t bufferSize)
+{
+    (void)strncpy(uid, "00000000-0000-0000-0000-000000000000", bufferSize);
+    return UNIQUEID_OK;
+}
+
+static void on_response(IOTHUB_HTTP_PIPELINE_RESULT result, unsigned int statusCode, const unsigned char* content, size_t contentLength, void* context)
+{
+    (void)content;
+    ASSERT_ARE_EQUAL(void_ptr, TEST_USER_CONTEXT, context);
+    g_callback_count++;
+    g_callback_result = result;
+    g_callback_status = statusCode;
+    g_callback_content_length = contentLength;
+}
+
+static IOTHUB_HTTP_PIPELINE_HANDLE create_pipeline(size_t maxConnections)
+{
+    IOTHUB_HTTP_PIPELINE_HANDLE result = IoTHubHttpPipeline_Create(TEST_HOSTNAME, TEST_SHARED_ACCESS_KEY, TEST_KEY_NAME);
+    (void)IoTHubHttpPipeline_SetOption(result, IOTHUB_HTTP_PIPELINE_OPTION_MAX_CONNECTIONS, &maxConnections);
+    return result;
+}
+
+BEGIN_TEST_SUITE(iothub_sc_http_pipeline_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_bool_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(HTTP_HEADERS_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(HTTP_HEADERS_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(UNIQUEID_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(time_t, uint64_t);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_HTTP_ERROR_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_HTTP_OPEN_COMPLETE_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_HTTP_REQUEST_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_HTTP_CLOSED_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(HTTP_CLIENT_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(HTTP_CLIENT_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(HTTP_CLIENT_REQUEST_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(PDLIST_ENTRY, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(const PDLIST_ENTRY, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_calloc, my_gballoc_calloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_calloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, real_mallocAndStrcpy_s);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(mallocAndStrcpy_s, __LINE__);
+
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InitializeListHead, real_DList_InitializeListHead);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_IsListEmpty, real_DList_IsListEmpty);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InsertTailList, real_DList_InsertTailList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InsertHeadList, real_DList_InsertHeadList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_AppendTailList, real_DList_AppendTailList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_RemoveEntryList, real_DList_RemoveEntryList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_RemoveHeadList, real_DList_RemoveHeadList);
+
+    REGISTER_GLOBAL_MOCK_RETURN(HTTPHeaders_Alloc, TEST_HTTP_HEADERS_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPHeaders_Alloc, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(HTTPHeaders_Clone, TEST_HTTP_HEADERS_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPHeaders_Clone, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(HTTPHeaders_AddHeaderNameValuePair, HTTP_HEADERS_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPHeaders_AddHeaderNameValuePair, HTTP_HEADERS_ERROR);
+
+    REGISTER_GLOBAL_MOCK_RETURN(get_time, (time_t)1000);
+    REGISTER_GLOBAL_MOCK_HOOK(SASToken_CreateString, my_SASToken_CreateString);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(SASToken_CreateString, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(STRING_c_str, TEST_SAS_TOKEN);
+    REGISTER_GLOBAL_MOCK_HOOK(UniqueId_Generate, my_UniqueId_Generate);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(UniqueId_Generate, UNIQUEID_ERROR);
+
+    REGISTER_GLOBAL_MOCK_RETURN(platform_get_default_tlsio, TEST_INTERFACE_DESC);
+    REGISTER_GLOBAL_MOCK_RETURN(socketio_get_interface_description, TEST_INTERFACE_DESC);
+
+    REGISTER_GLOBAL_MOCK_HOOK(uhttp_client_create, my_uhttp_client_create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(uhttp_client_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(uhttp_client_open, my_uhttp_client_open);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(uhttp_client_open, HTTP_CLIENT_ERROR);
+    REGISTER_GLOBAL_MOCK_HOOK(uhttp_client_execute_request, my_uhttp_client_execute_request);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(uhttp_client_execute_request, HTTP_CLIENT_ERROR);
+    REGISTER_GLOBAL_MOCK_HOOK(uhttp_client_dowork, my_uhttp_client_dowork);
+    REGISTER_GLOBAL_MOCK_RETURN(uhttp_client_set_trusted_cert, HTTP_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(uhttp_client_set_trusted_cert, HTTP_CLIENT_ERROR);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("Could not acquire test serialization mutex.");
+    }
+
+    umock_c_reset_all_calls();
+
+    g_client_count = 0;
+    memset(g_on_open, 0, sizeof(g_on_open));
+    memset(g_on_request, 0, sizeof(g_on_request));
+    g_reply_reason = HTTP_CALLBACK_REASON_OK;
+    g_reply_status = 200;
+    g_callback_count = 0;
+    g_callback_result = IOTHUB_HTTP_PIPELINE_INVALID_ARG;
+    g_callback_status = 0;
+    g_callback_content_length = 0;
+}
+
+TEST_FUNCTION_CLEANUP(method_cleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_001: [ If hostname, sharedAccessKey or keyName is NULL, IoTHubHttpPipeline_Create shall return NULL. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_Create_hostname_NULL_fail)
+{
+    //arrange
+
+    //act
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = IoTHubHttpPipeline_Create(NULL, TEST_SHARED_ACCESS_KEY, TEST_KEY_NAME);
+
+    //assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_002: [ IoTHubHttpPipeline_Create shall copy the credentials, build the headers template and a Request-Id prefix and shall not open any connection. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_Create_succeed)
+{
+    //arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_HOSTNAME));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_SHARED_ACCESS_KEY));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_KEY_NAME));
+    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(TEST_HTTP_HEADERS_HANDLE, "User-Agent", IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(TEST_HTTP_HEADERS_HANDLE, "Accept", "application/json"));
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(TEST_HTTP_HEADERS_HANDLE, "Content-Type", "application/json; charset=utf-8"));
+    STRICT_EXPECTED_CALL(UniqueId_Generate(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+
+    //act
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = IoTHubHttpPipeline_Create(TEST_HOSTNAME, TEST_SHARED_ACCESS_KEY, TEST_KEY_NAME);
+
+    //assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubHttpPipeline_GetPendingCount(handle));
+
+    //cleanup
+    IoTHubHttpPipeline_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_003: [ If any error is encountered, IoTHubHttpPipeline_Create shall return NULL. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_Create_headers_template_fail)
+{
+    //arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_HOSTNAME));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_SHARED_ACCESS_KEY));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_KEY_NAME));
+    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc()).SetReturn(NULL);
+
+    //act
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = IoTHubHttpPipeline_Create(TEST_HOSTNAME, TEST_SHARED_ACCESS_KEY, TEST_KEY_NAME);
+
+    //assert
+    ASSERT_IS_NULL(handle);
+
+    //cleanup
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_007: [ max_connections shall be rejected with IOTHUB_HTTP_PIPELINE_ERROR if it is 0 or once connections have been allocated. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_SetOption_max_connections_after_first_request_fail)
+{
+    //arrange
+    size_t maxConnections = 8;
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = create_pipeline(2);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_GET, TEST_RELATIVE_PATH, NULL, NULL, 0, on_response, TEST_USER_CONTEXT);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_HTTP_PIPELINE_RESULT result = IoTHubHttpPipeline_SetOption(handle, IOTHUB_HTTP_PIPELINE_OPTION_MAX_CONNECTIONS, &maxConnections);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_ERROR, result);
+
+    //cleanup
+    IoTHubHttpPipeline_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_008: [ If optionName is not supported, IoTHubHttpPipeline_SetOption shall return IOTHUB_HTTP_PIPELINE_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_SetOption_unknown_option_fail)
+{
+    //arrange
+    int value = 1;
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = create_pipeline(1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_HTTP_PIPELINE_RESULT result = IoTHubHttpPipeline_SetOption(handle, "unknown_option", &value);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_INVALID_ARG, result);
+
+    //cleanup
+    IoTHubHttpPipeline_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_009: [ If handle, relativePath or callback is NULL, or content is NULL while contentLength is not 0, IoTHubHttpPipeline_ExecuteRequest shall return IOTHUB_HTTP_PIPELINE_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_ExecuteRequest_relative_path_NULL_fail)
+{
+    //arrange
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = create_pipeline(1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_HTTP_PIPELINE_RESULT result = IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_GET, NULL, NULL, NULL, 0, on_response, TEST_USER_CONTEXT);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubHttpPipeline_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_010: [ IoTHubHttpPipeline_ExecuteRequest shall copy the request and queue it, returning IOTHUB_HTTP_PIPELINE_ERROR if any error is encountered. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_ExecuteRequest_queues_without_connecting)
+{
+    //arrange
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = create_pipeline(1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_calloc(1, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_RELATIVE_PATH));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_IF_MATCH));
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(TEST_CONTENT)));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_HTTP_PIPELINE_RESULT result = IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_PATCH, TEST_RELATIVE_PATH, TEST_IF_MATCH, TEST_CONTENT, sizeof(TEST_CONTENT), on_response, TEST_USER_CONTEXT);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 1, IoTHubHttpPipeline_GetPendingCount(handle));
+    ASSERT_ARE_EQUAL(size_t, 0, g_client_count);
+
+    //cleanup
+    IoTHubHttpPipeline_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_017: [ IoTHubHttpPipeline_DoWork shall open closed connections only while there are more waiting requests than connections being opened. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_DoWork_opens_one_connection_per_waiting_request)
+{
+    //arrange
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = create_pipeline(4);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_GET, TEST_RELATIVE_PATH, NULL, NULL, 0, on_response, TEST_USER_CONTEXT);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_GET, TEST_RELATIVE_PATH, NULL, NULL, 0, on_response, TEST_USER_CONTEXT);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubHttpPipeline_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 2, g_client_count);
+    ASSERT_ARE_EQUAL(size_t, 0, g_callback_count);
+
+    //cleanup
+    IoTHubHttpPipeline_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_011: [ The SAS token shall be created once and reused until less than a quarter of sas_token_lifetime is left before its expiry. ]*/
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_012: [ The request headers shall be cloned from the headers template built at creation and completed with the cached SAS token, a Request-Id made of a per pipeline GUID and a request counter, and the If-Match header when requested. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_DoWork_sends_request_with_cached_sas_token)
+{
+    //arrange
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = create_pipeline(1);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_GET, TEST_RELATIVE_PATH, NULL, NULL, 0, on_response, TEST_USER_CONTEXT);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_PATCH, TEST_RELATIVE_PATH, TEST_IF_MATCH, TEST_CONTENT, sizeof(TEST_CONTENT), on_response, TEST_USER_CONTEXT);
+    IoTHubHttpPipeline_DoWork(handle); // connection opened
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubHttpPipeline_DoWork(handle); // first request sent and answered
+    IoTHubHttpPipeline_DoWork(handle); // second request sent and answered
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, g_client_count);
+    ASSERT_ARE_EQUAL(size_t, 2, g_callback_count);
+    ASSERT_ARE_EQUAL(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_OK, g_callback_result);
+    ASSERT_ARE_EQUAL(int, 200, (int)g_callback_status);
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_RESPONSE), g_callback_content_length);
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubHttpPipeline_GetPendingCount(handle));
+
+    //cleanup
+    IoTHubHttpPipeline_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_012: [ The request headers shall be cloned from the headers template built at creation and completed with the cached SAS token, a Request-Id made of a per pipeline GUID and a request counter, and the If-Match header when requested. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_DoWork_request_headers_calls)
+{
+    //arrange
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = create_pipeline(1);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_PATCH, TEST_RELATIVE_PATH, TEST_IF_MATCH, TEST_CONTENT, sizeof(TEST_CONTENT), on_response, TEST_USER_CONTEXT);
+    IoTHubHttpPipeline_DoWork(handle);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(SASToken_CreateString(TEST_SHARED_ACCESS_KEY, TEST_HOSTNAME, TEST_KEY_NAME, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(STRING_delete(NULL));
+    STRICT_EXPECTED_CALL(STRING_c_str(TEST_SAS_STRING_HANDLE));
+    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(TEST_HTTP_HEADERS_HANDLE));
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(TEST_HTTP_HEADERS_HANDLE, "Authorization", TEST_SAS_TOKEN));
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(TEST_HTTP_HEADERS_HANDLE, "Request-Id", "00000000-0000-0000-0000-000000000000-1"));
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(TEST_HTTP_HEADERS_HANDLE, "If-Match", TEST_IF_MATCH));
+    STRICT_EXPECTED_CALL(uhttp_client_execute_request(IGNORED_PTR_ARG, HTTP_CLIENT_REQUEST_PATCH, TEST_RELATIVE_PATH, TEST_HTTP_HEADERS_HANDLE, IGNORED_PTR_ARG, sizeof(TEST_CONTENT), IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_Free(TEST_HTTP_HEADERS_HANDLE));
+    STRICT_EXPECTED_CALL(uhttp_client_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubHttpPipeline_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 1, g_callback_count);
+
+    //cleanup
+    IoTHubHttpPipeline_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_014: [ If the request fails the callback shall be invoked with IOTHUB_HTTP_PIPELINE_ERROR and the connection shall be closed and reopened for the next request. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_DoWork_request_failure_reopens_connection)
+{
+    //arrange
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = create_pipeline(1);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_GET, TEST_RELATIVE_PATH, NULL, NULL, 0, on_response, TEST_USER_CONTEXT);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_GET, TEST_RELATIVE_PATH, NULL, NULL, 0, on_response, TEST_USER_CONTEXT);
+    IoTHubHttpPipeline_DoWork(handle);
+    g_reply_reason = HTTP_CALLBACK_REASON_DISCONNECTED;
+
+    //act
+    IoTHubHttpPipeline_DoWork(handle);
+    g_reply_reason = HTTP_CALLBACK_REASON_OK;
+    IoTHubHttpPipeline_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, g_callback_count);
+    ASSERT_ARE_EQUAL(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_ERROR, g_callback_result);
+    ASSERT_ARE_EQUAL(size_t, 2, g_client_count);
+    ASSERT_ARE_EQUAL(size_t, 1, IoTHubHttpPipeline_GetPendingCount(handle));
+
+    //cleanup
+    IoTHubHttpPipeline_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_018: [ If no connection is open and none can be opened, the oldest waiting request shall be completed with IOTHUB_HTTP_PIPELINE_ERROR. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_DoWork_open_fail_completes_request)
+{
+    //arrange
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = create_pipeline(1);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_GET, TEST_RELATIVE_PATH, NULL, NULL, 0, on_response, TEST_USER_CONTEXT);
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(uhttp_client_create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(NULL);
+
+    //act
+    IoTHubHttpPipeline_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, g_callback_count);
+    ASSERT_ARE_EQUAL(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_ERROR, g_callback_result);
+    ASSERT_ARE_EQUAL(size_t, 0, IoTHubHttpPipeline_GetPendingCount(handle));
+
+    //cleanup
+    IoTHubHttpPipeline_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUB_HTTP_PIPELINE_37_005: [ IoTHubHttpPipeline_Destroy shall close every connection and invoke the callback of every request that did not complete with IOTHUB_HTTP_PIPELINE_CANCELLED. ]*/
+TEST_FUNCTION(IoTHubHttpPipeline_Destroy_cancels_pending_requests)
+{
+    //arrange
+    IOTHUB_HTTP_PIPELINE_HANDLE handle = create_pipeline(1);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_GET, TEST_RELATIVE_PATH, NULL, NULL, 0, on_response, TEST_USER_CONTEXT);
+    (void)IoTHubHttpPipeline_ExecuteRequest(handle, HTTP_CLIENT_REQUEST_GET, TEST_RELATIVE_PATH, NULL, NULL, 0, on_response, TEST_USER_CONTEXT);
+    IoTHubHttpPipeline_DoWork(handle);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubHttpPipeline_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 2, g_callback_count);
+    ASSERT_ARE_EQUAL(IOTHUB_HTTP_PIPELINE_RESULT, IOTHUB_HTTP_PIPELINE_CANCELLED, g_callback_result);
+
+    //cleanup
+}
+
+END_TEST_SUITE(iothub_sc_http_pipeline_ut)
@@ -48,3 +48,15 @@ do
     make --jobs=$MAKE_CORES
 done
 popd
+
+# The metrics counters change the expected calls of the transport unit tests, only the suites covering them run with use_client_metrics
+rm -r -f $build_folder
+mkdir -p $build_folder
+pushd $build_folder
+
+echo "-Duse_client_metrics=ON -Drun_unittests=ON"
+cmake $build_root -Duse_client_metrics=ON -Drun_unittests=ON
+
+make --jobs=$MAKE_CORES
+ctest -R "iothubclientcore_ll_ut|iothubtransport_ut" -C "Debug" --output-on-failure
+popd
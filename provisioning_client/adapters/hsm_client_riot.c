@@ -146,6 +146,14 @@ typedef struct HSM_CLIENT_X509_INFO_TAG
 
 } HSM_CLIENT_X509_INFO;
 
+// Process wide copy of the keys and certificates derived by the first successful
+// hsm_client_riot_create. It is only reused while the CDI and firmware id it was
+// derived from are unchanged, and is cleared by hsm_client_x509_deinit.
+static int g_riot_cache_valid = 0;
+static uint8_t g_riot_cache_cdi[DICE_DIGEST_LENGTH];
+static unsigned char g_riot_cache_fwid[RIOT_DIGEST_LENGTH];
+static HSM_CLIENT_X509_INFO g_riot_cache;
+
 static const HSM_CLIENT_X509_INTERFACE x509_interface =
 {
     hsm_client_riot_create,
@@ -495,6 +503,43 @@ static int process_riot_key_info(HSM_CLIENT_X509_INFO* riot_info)
     return result;
 }
 
+static int load_cached_riot_info(HSM_CLIENT_X509_INFO* riot_info)
+{
+    int result;
+
+    if (g_riot_cache_valid == 0 ||
+        memcmp(g_riot_cache_cdi, g_CDI, DICE_DIGEST_LENGTH) != 0 ||
+        memcmp(g_riot_cache_fwid, firmware_id, RIOT_DIGEST_LENGTH) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        memcpy(riot_info, &g_riot_cache, sizeof(HSM_CLIENT_X509_INFO));
+        if (mallocAndStrcpy_s(&riot_info->certificate_common_name, g_riot_cache.certificate_common_name) != 0)
+        {
+            LogError("Failure: attempting to get common name");
+            memset(riot_info, 0, sizeof(HSM_CLIENT_X509_INFO));
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void store_cached_riot_info(const HSM_CLIENT_X509_INFO* riot_info)
+{
+    memcpy(&g_riot_cache, riot_info, sizeof(HSM_CLIENT_X509_INFO));
+    // The cache does not own the common name of the instance
+    g_riot_cache.certificate_common_name = (char*)X509_ALIAS_TBS_DATA.SubjectCommon;
+    memcpy(g_riot_cache_cdi, g_CDI, DICE_DIGEST_LENGTH);
+    memcpy(g_riot_cache_fwid, firmware_id, RIOT_DIGEST_LENGTH);
+    g_riot_cache_valid = 1;
+}
+
 int hsm_client_x509_init(void)
 {
     // Only initialize one time
@@ -512,6 +557,9 @@ int hsm_client_x509_init(void)
 
 void hsm_client_x509_deinit(void)
 {
+    // Don't leave the cached private keys behind
+    memset(&g_riot_cache, 0, sizeof(HSM_CLIENT_X509_INFO));
+    g_riot_cache_valid = 0;
 }
 
 const HSM_CLIENT_X509_INTERFACE* hsm_client_x509_interface(void)
@@ -532,11 +580,20 @@ HSM_CLIENT_HANDLE hsm_client_riot_create(void)
     else
     {
         memset(result, 0, sizeof(HSM_CLIENT_X509_INFO));
-        if (process_riot_key_info(result) != 0)
+        /* Codes_SRS_HSM_CLIENT_RIOT_44_001: [ If the keys and certificates derived from the current CDI and firmware id are cached, hsm_client_riot_create shall copy them instead of calling into the RIoT code. ] */
+        if (load_cached_riot_info(result) != 0)
         {
-            /* Codes_SRS_HSM_CLIENT_RIOT_07_006: [ If any failure is encountered hsm_client_riot_create shall return NULL ] */
-            free(result);
-            result = NULL;
+            if (process_riot_key_info(result) != 0)
+            {
+                /* Codes_SRS_HSM_CLIENT_RIOT_07_006: [ If any failure is encountered hsm_client_riot_create shall return NULL ] */
+                free(result);
+                result = NULL;
+            }
+            else
+            {
+                /* Codes_SRS_HSM_CLIENT_RIOT_44_002: [ Otherwise hsm_client_riot_create shall cache the derived keys and certificates for the next instances. ] */
+                store_cached_riot_info(result);
+            }
         }
     }
     return result;
@@ -752,15 +809,51 @@ char* hsm_client_riot_get_common_name(HSM_CLIENT_HANDLE handle)
     return result;
 }
 
-char* hsm_client_riot_create_leaf_cert(HSM_CLIENT_HANDLE handle, const char* common_name)
+static int produce_leaf_cert_der(HSM_CLIENT_X509_INFO* riot_info, const char* common_name, DERBuilderContext* leaf_ctx, uint8_t* leaf_buffer)
 {
-    char* result;
+    int result;
+    RIOT_STATUS status;
+    RIOT_ECC_PUBLIC     leaf_id_pub;
+    RIOT_ECC_SIGNATURE tbs_sig = { 0 };
 
     // The static data fields that make up the DeviceID Cert "to be signed" region
     RIOT_X509_TBS_DATA LEAF_CERT_TBS_DATA = {
         { 0x5E, 0x4D, 0x3C, 0x2B, 0x1A }, RIOT_CA_CERT_NAME, "MSR_TEST", "US",
         "170101000000Z", "370101000000Z", "", "MSR_TEST", "US" };
 
+    LEAF_CERT_TBS_DATA.SubjectCommon = common_name;
+
+    DERInitContext(leaf_ctx, leaf_buffer, DER_MAX_TBS);
+    if (X509GetDeviceCertTBS(leaf_ctx, &LEAF_CERT_TBS_DATA, &leaf_id_pub) != 0)
+    {
+        LogError("Failure: X509GetDeviceCertTBS");
+        result = __FAILURE__;
+    }
+    else
+    {
+        status = RiotCrypt_Sign(&tbs_sig, leaf_ctx->Buffer, leaf_ctx->Position, &riot_info->ca_root_priv);
+        if (status != RIOT_SUCCESS)
+        {
+            LogError("Failure: RiotCrypt_Sign returned invalid status %d.", status);
+            result = __FAILURE__;
+        }
+        else if (X509MakeDeviceCert(leaf_ctx, &tbs_sig) != 0)
+        {
+            LogError("Failure: X509MakeDeviceCert");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+char* hsm_client_riot_create_leaf_cert(HSM_CLIENT_HANDLE handle, const char* common_name)
+{
+    char* result;
+
     if (handle == NULL || common_name == NULL)
     {
         /* Codes_SRS_HSM_CLIENT_RIOT_07_030: [ If handle or common_name is NULL, hsm_client_riot_create_leaf_cert shall return NULL. ] */
@@ -769,33 +862,14 @@ char* hsm_client_riot_create_leaf_cert(HSM_CLIENT_HANDLE handle, const char* com
     }
     else
     {
-        RIOT_STATUS status;
         uint8_t leaf_buffer[DER_MAX_TBS] = { 0 };
         DERBuilderContext leaf_ctx = { 0 };
-        RIOT_ECC_PUBLIC     leaf_id_pub;
-        RIOT_ECC_SIGNATURE tbs_sig = { 0 };
 
         HSM_CLIENT_X509_INFO* riot_info = (HSM_CLIENT_X509_INFO*)handle;
 
-        LEAF_CERT_TBS_DATA.SubjectCommon = common_name;
-
-        DERInitContext(&leaf_ctx, leaf_buffer, DER_MAX_TBS);
-        if (X509GetDeviceCertTBS(&leaf_ctx, &LEAF_CERT_TBS_DATA, &leaf_id_pub) != 0)
-        {
-            /* Codes_SRS_HSM_CLIENT_RIOT_07_032: [ If hsm_client_riot_create_leaf_cert encounters an error it shall return NULL. ] */
-            LogError("Failure: X509GetDeviceCertTBS");
-            result = NULL;
-        }
-        else if ((status = RiotCrypt_Sign(&tbs_sig, leaf_ctx.Buffer, leaf_ctx.Position, &riot_info->ca_root_priv)) != RIOT_SUCCESS)
+        if (produce_leaf_cert_der(riot_info, common_name, &leaf_ctx, leaf_buffer) != 0)
         {
             /* Codes_SRS_HSM_CLIENT_RIOT_07_032: [ If hsm_client_riot_create_leaf_cert encounters an error it shall return NULL. ] */
-            LogError("Failure: RiotCrypt_Sign returned invalid status %d.", status);
-            result = NULL;
-        }
-        else if (X509MakeDeviceCert(&leaf_ctx, &tbs_sig) != 0)
-        {
-            /* Codes_SRS_HSM_CLIENT_RIOT_07_032: [ If hsm_client_riot_create_leaf_cert encounters an error it shall return NULL. ] */
-            LogError("Failure: X509MakeDeviceCert");
             result = NULL;
         }
         else if ((result = (char*)malloc(DER_MAX_PEM + 1)) == NULL)
@@ -819,3 +893,68 @@ char* hsm_client_riot_create_leaf_cert(HSM_CLIENT_HANDLE handle, const char* com
     }
     return result;
 }
+
+char* hsm_client_riot_create_leaf_cert_bundle(HSM_CLIENT_HANDLE handle, const char** common_names, size_t count)
+{
+    char* result;
+    size_t index;
+
+    if (handle == NULL || common_names == NULL || count == 0)
+    {
+        /* Codes_SRS_HSM_CLIENT_RIOT_45_001: [ If handle or common_names is NULL, count is 0 or one of the common names is NULL, hsm_client_riot_create_leaf_cert_bundle shall return NULL. ] */
+        LogError("invalid parameter specified.");
+        result = NULL;
+    }
+    else
+    {
+        index = 0;
+        while (index < count && common_names[index] != NULL)
+        {
+            index++;
+        }
+
+        if (index < count)
+        {
+            /* Codes_SRS_HSM_CLIENT_RIOT_45_001: [ If handle or common_names is NULL, count is 0 or one of the common names is NULL, hsm_client_riot_create_leaf_cert_bundle shall return NULL. ] */
+            LogError("invalid common name at index %lu.", (unsigned long)index);
+            result = NULL;
+        }
+        else if ((result = (char*)malloc((count * DER_MAX_PEM) + 1)) == NULL)
+        {
+            /* Codes_SRS_HSM_CLIENT_RIOT_45_005: [ If any certificate cannot be produced, hsm_client_riot_create_leaf_cert_bundle shall return NULL. ] */
+            LogError("Failure allocating leaf cert bundle");
+        }
+        else
+        {
+            HSM_CLIENT_X509_INFO* riot_info = (HSM_CLIENT_X509_INFO*)handle;
+            uint8_t leaf_buffer[DER_MAX_TBS];
+            DERBuilderContext leaf_ctx;
+            size_t offset = 0;
+
+            /* Codes_SRS_HSM_CLIENT_RIOT_45_002: [ hsm_client_riot_create_leaf_cert_bundle shall produce the certificates one after the other on the calling thread, reusing a single DER context. ] */
+            for (index = 0; index < count && result != NULL; index++)
+            {
+                uint32_t leaf_len = DER_MAX_PEM;
+                if (produce_leaf_cert_der(riot_info, common_names[index], &leaf_ctx, leaf_buffer) != 0 ||
+                    DERtoPEM(&leaf_ctx, CERT_TYPE, result + offset, &leaf_len) != 0)
+                {
+                    /* Codes_SRS_HSM_CLIENT_RIOT_45_005: [ If any certificate cannot be produced, hsm_client_riot_create_leaf_cert_bundle shall return NULL. ] */
+                    LogError("Failure: producing leaf cert %lu.", (unsigned long)index);
+                    free(result);
+                    result = NULL;
+                }
+                else
+                {
+                    offset += leaf_len;
+                }
+            }
+
+            if (result != NULL)
+            {
+                /* Codes_SRS_HSM_CLIENT_RIOT_45_004: [ On success hsm_client_riot_create_leaf_cert_bundle shall return the PEM certificates concatenated in the order of common_names. ] */
+                result[offset] = '\0';
+            }
+        }
+    }
+    return result;
+}
@@ -30,6 +30,10 @@ MOCKABLE_FUNCTION(, char*, hsm_client_riot_get_common_name, HSM_CLIENT_HANDLE, h
 
 MOCKABLE_FUNCTION(, char*, hsm_client_riot_create_leaf_cert, HSM_CLIENT_HANDLE, handle, const char*, common_name);
 
+// Produces one leaf certificate per entry of common_names and returns them as a single PEM bundle,
+// in the order of common_names.
+MOCKABLE_FUNCTION(, char*, hsm_client_riot_create_leaf_cert_bundle, HSM_CLIENT_HANDLE, handle, const char**, common_names, size_t, count);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
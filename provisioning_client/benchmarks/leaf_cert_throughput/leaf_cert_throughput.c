@@ -0,0 +1,136 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Measures how fast a gateway can issue leaf certificates for its downstream devices at boot with the
+RIoT HSM. LEAF_COUNT certificates with distinct common names are produced:
+ - one hsm_client_riot_create_leaf_cert call per device;
+ - one hsm_client_riot_create_leaf_cert_bundle call for all the devices.
+The bundle reuses one DER context and writes every certificate into a single allocation. Each
+scenario reports certificates per second. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#include "hsm_client_data.h"
+#include "hsm_client_riot.h"
+
+#define LEAF_COUNT              256
+#define COMMON_NAME_LENGTH      32
+
+static void report(const char* name, tickcounter_ms_t elapsed_ms)
+{
+    (void)printf("%s:\r\n  certs=%d wall=%lu ms rate=%.1f certs/s\r\n", name, LEAF_COUNT, (unsigned long)elapsed_ms, elapsed_ms == 0 ? 0.0 : (LEAF_COUNT * 1000.0) / elapsed_ms);
+}
+
+static int run_single(HSM_CLIENT_HANDLE hsm_handle, const char** common_names, TICK_COUNTER_HANDLE tick_counter)
+{
+    int result = 0;
+    tickcounter_ms_t start_ms = 0;
+    tickcounter_ms_t end_ms = 0;
+    size_t i;
+
+    (void)tickcounter_get_current_ms(tick_counter, &start_ms);
+    for (i = 0; result == 0 && i < LEAF_COUNT; i++)
+    {
+        char* leaf_cert;
+        if ((leaf_cert = hsm_client_riot_create_leaf_cert(hsm_handle, common_names[i])) == NULL)
+        {
+            (void)printf("ERROR: hsm_client_riot_create_leaf_cert failed\r\n");
+            result = __LINE__;
+        }
+        free(leaf_cert);
+    }
+    (void)tickcounter_get_current_ms(tick_counter, &end_ms);
+
+    if (result == 0)
+    {
+        report("hsm_client_riot_create_leaf_cert", end_ms - start_ms);
+    }
+    return result;
+}
+
+static int run_bundle(HSM_CLIENT_HANDLE hsm_handle, const char** common_names, TICK_COUNTER_HANDLE tick_counter)
+{
+    int result;
+    tickcounter_ms_t start_ms = 0;
+    tickcounter_ms_t end_ms = 0;
+    char* bundle;
+
+    (void)tickcounter_get_current_ms(tick_counter, &start_ms);
+    bundle = hsm_client_riot_create_leaf_cert_bundle(hsm_handle, common_names, LEAF_COUNT);
+    (void)tickcounter_get_current_ms(tick_counter, &end_ms);
+
+    if (bundle == NULL)
+    {
+        (void)printf("ERROR: hsm_client_riot_create_leaf_cert_bundle failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        report("hsm_client_riot_create_leaf_cert_bundle", end_ms - start_ms);
+        free(bundle);
+        result = 0;
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    TICK_COUNTER_HANDLE tick_counter;
+    HSM_CLIENT_HANDLE hsm_handle;
+    char common_name_values[LEAF_COUNT][COMMON_NAME_LENGTH];
+    const char* common_names[LEAF_COUNT];
+    size_t i;
+
+    for (i = 0; i < LEAF_COUNT; i++)
+    {
+        (void)snprintf(common_name_values[i], COMMON_NAME_LENGTH, "leaf-device-%lu", (unsigned long)i);
+        common_names[i] = common_name_values[i];
+    }
+
+    if (platform_init() != 0)
+    {
+        (void)printf("ERROR: platform_init failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        if ((tick_counter = tickcounter_create()) == NULL)
+        {
+            (void)printf("ERROR: tickcounter_create failed\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            if (hsm_client_x509_init() != 0)
+            {
+                (void)printf("ERROR: hsm_client_x509_init failed\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                if ((hsm_handle = hsm_client_riot_create()) == NULL)
+                {
+                    (void)printf("ERROR: hsm_client_riot_create failed\r\n");
+                    result = __LINE__;
+                }
+                else
+                {
+                    if ((result = run_single(hsm_handle, common_names, tick_counter)) == 0)
+                    {
+                        result = run_bundle(hsm_handle, common_names, tick_counter);
+                    }
+                    hsm_client_riot_destroy(hsm_handle);
+                }
+                hsm_client_x509_deinit();
+            }
+            tickcounter_destroy(tick_counter);
+        }
+        platform_deinit();
+    }
+    return result;
+}
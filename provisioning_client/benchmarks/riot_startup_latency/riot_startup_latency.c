@@ -0,0 +1,122 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Measures what a device using the RIoT HSM pays on every (re)connect before it can send a TLS client
+certificate: hsm_client_riot_create, then reading the certificate chain and the alias key like the
+x509 security client does.
+
+ - cold: the RIoT chain cache is cleared with hsm_client_x509_deinit before each create, so the keys
+   are derived and the certificates signed and PEM encoded every time, which is what every create
+   cost before the chain was cached;
+ - warm: every create after the first one of the process, which copies the cached chain.
+Each scenario is timed over its whole loop and reported as a mean per create, in milliseconds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#include "hsm_client_data.h"
+#include "hsm_client_riot.h"
+
+#define COLD_COUNT          20      /* creates with an empty cache */
+#define WARM_COUNT          2000    /* creates with a cached chain */
+
+static int create_and_read(void)
+{
+    int result;
+    HSM_CLIENT_HANDLE hsm_handle;
+
+    if ((hsm_handle = hsm_client_riot_create()) == NULL)
+    {
+        (void)printf("ERROR: hsm_client_riot_create failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        char* certificate = hsm_client_riot_get_certificate(hsm_handle);
+        char* alias_key = hsm_client_riot_get_alias_key(hsm_handle);
+
+        if (certificate == NULL || alias_key == NULL)
+        {
+            (void)printf("ERROR: reading the certificate chain failed\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+        free(certificate);
+        free(alias_key);
+        hsm_client_riot_destroy(hsm_handle);
+    }
+    return result;
+}
+
+static int run_scenario(const char* name, size_t count, bool clear_cache, TICK_COUNTER_HANDLE tick_counter)
+{
+    int result = 0;
+    tickcounter_ms_t start_ms = 0;
+    tickcounter_ms_t end_ms = 0;
+    size_t i;
+
+    (void)tickcounter_get_current_ms(tick_counter, &start_ms);
+    for (i = 0; result == 0 && i < count; i++)
+    {
+        if (clear_cache)
+        {
+            hsm_client_x509_deinit();
+        }
+        result = create_and_read();
+    }
+    (void)tickcounter_get_current_ms(tick_counter, &end_ms);
+
+    if (result == 0)
+    {
+        (void)printf("%s:\r\n  creates=%lu mean=%.3f ms wall=%lu ms\r\n", name, (unsigned long)count,
+            (double)(end_ms - start_ms) / count, (unsigned long)(end_ms - start_ms));
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    TICK_COUNTER_HANDLE tick_counter;
+
+    if (platform_init() != 0)
+    {
+        (void)printf("ERROR: platform_init failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        if ((tick_counter = tickcounter_create()) == NULL)
+        {
+            (void)printf("ERROR: tickcounter_create failed\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            if (hsm_client_x509_init() != 0)
+            {
+                (void)printf("ERROR: hsm_client_x509_init failed\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                if ((result = run_scenario("cold, chain derived on every create", COLD_COUNT, true, tick_counter)) == 0)
+                {
+                    // The last cold create left the chain in the cache
+                    result = run_scenario("warm, cached chain", WARM_COUNT, false, tick_counter);
+                }
+                hsm_client_x509_deinit();
+            }
+            tickcounter_destroy(tick_counter);
+        }
+        platform_deinit();
+    }
+    return result;
+}
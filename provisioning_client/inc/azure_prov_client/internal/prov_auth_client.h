@@ -16,6 +16,7 @@ extern "C" {
 #include "azure_c_shared_utility/umock_c_prod.h"
 #include "azure_c_shared_utility/macro_utils.h"
 #include "azure_c_shared_utility/buffer_.h"
+#include "hsm_client_data.h"
 
 typedef struct PROV_AUTH_INFO_TAG* PROV_AUTH_HANDLE;
 
@@ -36,6 +37,8 @@ DEFINE_ENUM(PROV_AUTH_RESULT, PROV_AUTH_RESULT_VALUES);
 DEFINE_ENUM(PROV_AUTH_TYPE, PROV_AUTH_TYPE_VALUES);
 
 MOCKABLE_FUNCTION(, PROV_AUTH_HANDLE, prov_auth_create);
+MOCKABLE_FUNCTION(, PROV_AUTH_HANDLE, prov_auth_create_x509, const char*, certificate, const char*, private_key);
+MOCKABLE_FUNCTION(, PROV_AUTH_HANDLE, prov_auth_create_tpm, const HSM_CLIENT_TPM_INTERFACE*, tpm_interface, HSM_CLIENT_HANDLE, hsm_handle);
 MOCKABLE_FUNCTION(, void, prov_auth_destroy, PROV_AUTH_HANDLE, handle);
 MOCKABLE_FUNCTION(, PROV_AUTH_TYPE, prov_auth_get_type, PROV_AUTH_HANDLE, handle);
 MOCKABLE_FUNCTION(, char*, prov_auth_get_registration_id, PROV_AUTH_HANDLE, handle);
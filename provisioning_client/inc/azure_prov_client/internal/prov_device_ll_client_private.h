@@ -0,0 +1,24 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef PROV_DEVICE_LL_CLIENT_PRIVATE_H
+#define PROV_DEVICE_LL_CLIENT_PRIVATE_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_prov_client/prov_device_ll_client.h"
+#include "azure_prov_client/internal/prov_auth_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+    /* Creates a provisioning client that authenticates with prov_auth_handle instead of the process wide hsm.
+       The client takes ownership of prov_auth_handle, also when it fails. */
+    MOCKABLE_FUNCTION(, PROV_DEVICE_LL_HANDLE, Prov_Device_LL_Create_With_Auth, const char*, uri, const char*, id_scope, PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION, protocol, PROV_AUTH_HANDLE, prov_auth_handle);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // PROV_DEVICE_LL_CLIENT_PRIVATE_H
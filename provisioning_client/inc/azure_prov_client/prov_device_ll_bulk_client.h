@@ -0,0 +1,115 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef PROV_DEVICE_LL_BULK_CLIENT_H
+#define PROV_DEVICE_LL_BULK_CLIENT_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_prov_client/prov_device_ll_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct PROV_BULK_INSTANCE_INFO_TAG* PROV_DEVICE_LL_BULK_HANDLE;
+
+#define PROV_BULK_DEFAULT_MAX_CONCURRENT    16
+
+/* size_t*, maximum number of registrations talking to the provisioning service at the same time */
+static const char* const PROV_BULK_OPTION_MAX_CONCURRENT = "max_concurrent_registrations";
+
+#define PROV_BULK_CREDENTIAL_TYPE_VALUES \
+    PROV_BULK_CREDENTIAL_X509,           \
+    PROV_BULK_CREDENTIAL_TPM
+
+DEFINE_ENUM(PROV_BULK_CREDENTIAL_TYPE, PROV_BULK_CREDENTIAL_TYPE_VALUES);
+
+/* the credentials a single device registers with, in place of the process wide hsm */
+typedef struct PROV_BULK_DEVICE_CREDENTIAL_TAG
+{
+    PROV_BULK_CREDENTIAL_TYPE type;
+
+    /* PROV_BULK_CREDENTIAL_X509: PEM certificate and private key of the device, copied by Prov_Device_LL_Bulk_Add_Device */
+    const char* x509_certificate;
+    const char* x509_private_key;
+
+    /* PROV_BULK_CREDENTIAL_TPM: the TPM of the device (see hsm_client_data.h), which supplies the endorsement key and signs
+       the challenge of the service. The caller keeps tpm_handle alive until the registration completes. */
+    const struct HSM_CLIENT_TPM_INTERFACE_TAG* tpm_interface;
+    void* tpm_handle;
+} PROV_BULK_DEVICE_CREDENTIAL;
+
+typedef void(*PROV_DEVICE_BULK_REGISTER_DEVICE_CALLBACK)(const char* registration_id, PROV_DEVICE_RESULT register_result, const char* iothub_uri, const char* device_id, void* user_context);
+
+/**
+* @brief    Creates a client that registers many devices with the Device Provisioning Service. Every registration
+*           runs its own PROV_DEVICE_LL_HANDLE, since the service authenticates each registration on its own
+*           connection, and the bulk client bounds how many of them are active at the same time.
+*
+* @param    uri         The URI of the Device Provisioning Service (a local stand-in can be used for testing)
+* @param    scope_id    The customer specific Id Scope
+* @param    protocol    Function pointer for protocol implementation
+*
+* @return   A non-NULL PROV_DEVICE_LL_BULK_HANDLE value that is used when invoking other functions
+*           and NULL on Failure
+*/
+MOCKABLE_FUNCTION(, PROV_DEVICE_LL_BULK_HANDLE, Prov_Device_LL_Bulk_Create, const char*, uri, const char*, scope_id, PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION, protocol);
+
+/**
+* @brief    Disposes of resources allocated by the bulk provisioning client. The callback of every registration
+*           that has not completed is invoked with PROV_DEVICE_RESULT_ERROR.
+*
+* @param    handle  The handle created by a call to the create function
+*
+*/
+MOCKABLE_FUNCTION(, void, Prov_Device_LL_Bulk_Destroy, PROV_DEVICE_LL_BULK_HANDLE, handle);
+
+/**
+* @brief    Queues the registration of a device. The registration starts on a subsequent DoWork call, once
+*           fewer than max_concurrent_registrations registrations are active.
+*
+* @param    handle              The handle created by a call to the create function.
+* @param    registration_id     The registration id of the device
+* @param    credential          The credentials of this device, or NULL to register with the process wide hsm
+* @param    register_callback   The callback that gets called when the registration of this device completes or fails
+* @param    user_context        User specified context that will be provided to the callback
+*
+* @return PROV_DEVICE_RESULT_OK upon success or an error code upon failure
+*/
+MOCKABLE_FUNCTION(, PROV_DEVICE_RESULT, Prov_Device_LL_Bulk_Add_Device, PROV_DEVICE_LL_BULK_HANDLE, handle, const char*, registration_id, const PROV_BULK_DEVICE_CREDENTIAL*, credential, PROV_DEVICE_BULK_REGISTER_DEVICE_CALLBACK, register_callback, void*, user_context);
+
+/**
+* @brief    Api to be called by user when work (starting and driving registrations) can be done
+*
+* @param    handle  The handle created by a call to the create function.
+*
+*/
+MOCKABLE_FUNCTION(, void, Prov_Device_LL_Bulk_DoWork, PROV_DEVICE_LL_BULK_HANDLE, handle);
+
+/**
+* @brief    Returns the number of registrations that have been added and have not completed yet.
+*
+* @param    handle  The handle created by a call to the create function.
+*
+*/
+MOCKABLE_FUNCTION(, size_t, Prov_Device_LL_Bulk_Get_Pending_Count, PROV_DEVICE_LL_BULK_HANDLE, handle);
+
+/**
+* @brief    API sets a runtime option identified by parameter optionName to a value pointed to by value.
+*           Besides PROV_BULK_OPTION_MAX_CONCURRENT, OPTION_TRUSTED_CERT, OPTION_HTTP_PROXY and PROV_OPTION_LOG_TRACE
+*           are accepted and applied to every registration started afterwards.
+*
+* @param    handle          The handle created by a call to the create function.
+* @param    optionName      The name of the option to be set
+* @param    value           A pointer to the value of the option to be set
+*
+* @return PROV_DEVICE_RESULT_OK upon success or an error code upon failure
+*/
+MOCKABLE_FUNCTION(, PROV_DEVICE_RESULT, Prov_Device_LL_Bulk_SetOption, PROV_DEVICE_LL_BULK_HANDLE, handle, const char*, optionName, const void*, value);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // PROV_DEVICE_LL_BULK_CLIENT_H
@@ -39,6 +39,56 @@ typedef struct PROV_AUTH_INFO_TAG
     HSM_CLIENT_GET_COMMON_NAME hsm_client_get_common_name;
 } PROV_AUTH_INFO;
 
+/*x509 credentials handed in by the caller instead of read from the hsm*/
+typedef struct X509_CREDENTIAL_INFO_TAG
+{
+    char* certificate;
+    char* private_key;
+} X509_CREDENTIAL_INFO;
+
+static char* x509_credential_get_cert(HSM_CLIENT_HANDLE handle)
+{
+    char* result;
+    if (mallocAndStrcpy_s(&result, ((X509_CREDENTIAL_INFO*)handle)->certificate) != 0)
+    {
+        LogError("Failed allocating certificate");
+        result = NULL;
+    }
+    return result;
+}
+
+static char* x509_credential_get_key(HSM_CLIENT_HANDLE handle)
+{
+    char* result;
+    if (mallocAndStrcpy_s(&result, ((X509_CREDENTIAL_INFO*)handle)->private_key) != 0)
+    {
+        LogError("Failed allocating private key");
+        result = NULL;
+    }
+    return result;
+}
+
+static char* x509_credential_get_common_name(HSM_CLIENT_HANDLE handle)
+{
+    (void)handle;
+    LogError("The registration id has to be set for x509 credentials");
+    return NULL;
+}
+
+static void x509_credential_destroy(HSM_CLIENT_HANDLE handle)
+{
+    X509_CREDENTIAL_INFO* credential = (X509_CREDENTIAL_INFO*)handle;
+    free(credential->certificate);
+    free(credential->private_key);
+    free(credential);
+}
+
+/*the caller owns an hsm handle handed to prov_auth_create_tpm*/
+static void caller_owned_hsm_destroy(HSM_CLIENT_HANDLE handle)
+{
+    (void)handle;
+}
+
 static char* encode_value(const uint8_t* msg_digest, size_t digest_len)
 {
     char* result;
@@ -207,6 +257,86 @@ PROV_AUTH_HANDLE prov_auth_create()
     return result;
 }
 
+PROV_AUTH_HANDLE prov_auth_create_x509(const char* certificate, const char* private_key)
+{
+    PROV_AUTH_INFO* result;
+    X509_CREDENTIAL_INFO* credential;
+    /* Codes_SRS_PROV_AUTH_CLIENT_36_001: [ If certificate or private_key is NULL, prov_auth_create_x509 shall return NULL. ] */
+    if (certificate == NULL || private_key == NULL)
+    {
+        LogError("Invalid parameter certificate: %p, private_key: %p", certificate, private_key);
+        result = NULL;
+    }
+    else if ((result = (PROV_AUTH_INFO*)malloc(sizeof(PROV_AUTH_INFO))) == NULL)
+    {
+        /* Codes_SRS_PROV_AUTH_CLIENT_36_003: [ If any failure is encountered prov_auth_create_x509 shall return NULL. ] */
+        LogError("Failed allocating PROV_AUTH_INFO.");
+    }
+    else if ((credential = (X509_CREDENTIAL_INFO*)malloc(sizeof(X509_CREDENTIAL_INFO))) == NULL)
+    {
+        /* Codes_SRS_PROV_AUTH_CLIENT_36_003: [ If any failure is encountered prov_auth_create_x509 shall return NULL. ] */
+        LogError("Failed allocating x509 credential.");
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        memset(result, 0, sizeof(PROV_AUTH_INFO));
+        memset(credential, 0, sizeof(X509_CREDENTIAL_INFO));
+        if (mallocAndStrcpy_s(&credential->certificate, certificate) != 0 || mallocAndStrcpy_s(&credential->private_key, private_key) != 0)
+        {
+            /* Codes_SRS_PROV_AUTH_CLIENT_36_003: [ If any failure is encountered prov_auth_create_x509 shall return NULL. ] */
+            LogError("Failed copying x509 credential.");
+            x509_credential_destroy(credential);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            /* Codes_SRS_PROV_AUTH_CLIENT_36_002: [ prov_auth_create_x509 shall copy certificate and private_key and hand them out in place of the ones of the hsm, without creating the hsm. ] */
+            result->sec_type = PROV_AUTH_TYPE_X509;
+            result->hsm_client_handle = credential;
+            result->hsm_client_destroy = x509_credential_destroy;
+            result->hsm_client_get_cert = x509_credential_get_cert;
+            result->hsm_client_get_alias_key = x509_credential_get_key;
+            result->hsm_client_get_common_name = x509_credential_get_common_name;
+        }
+    }
+    return result;
+}
+
+PROV_AUTH_HANDLE prov_auth_create_tpm(const HSM_CLIENT_TPM_INTERFACE* tpm_interface, HSM_CLIENT_HANDLE hsm_handle)
+{
+    PROV_AUTH_INFO* result;
+    /* Codes_SRS_PROV_AUTH_CLIENT_36_004: [ If tpm_interface or hsm_handle is NULL, or tpm_interface misses a function used by the provisioning client, prov_auth_create_tpm shall return NULL. ] */
+    if (tpm_interface == NULL || hsm_handle == NULL ||
+        tpm_interface->hsm_client_activate_identity_key == NULL ||
+        tpm_interface->hsm_client_get_ek == NULL ||
+        tpm_interface->hsm_client_get_srk == NULL ||
+        tpm_interface->hsm_client_sign_with_identity == NULL)
+    {
+        LogError("Invalid parameter tpm_interface: %p, hsm_handle: %p", tpm_interface, hsm_handle);
+        result = NULL;
+    }
+    else if ((result = (PROV_AUTH_INFO*)malloc(sizeof(PROV_AUTH_INFO))) == NULL)
+    {
+        LogError("Failed allocating PROV_AUTH_INFO.");
+    }
+    else
+    {
+        /* Codes_SRS_PROV_AUTH_CLIENT_36_005: [ prov_auth_create_tpm shall use hsm_handle through tpm_interface and shall not destroy it. ] */
+        memset(result, 0, sizeof(PROV_AUTH_INFO));
+        result->sec_type = PROV_AUTH_TYPE_TPM;
+        result->hsm_client_handle = hsm_handle;
+        result->hsm_client_destroy = caller_owned_hsm_destroy;
+        result->hsm_client_import_key = tpm_interface->hsm_client_activate_identity_key;
+        result->hsm_client_get_endorsement_key = tpm_interface->hsm_client_get_ek;
+        result->hsm_client_get_srk = tpm_interface->hsm_client_get_srk;
+        result->hsm_client_sign_data = tpm_interface->hsm_client_sign_with_identity;
+    }
+    return result;
+}
+
 void prov_auth_destroy(PROV_AUTH_HANDLE handle)
 {
     /* Codes_SRS_PROV_AUTH_CLIENT_07_005: [ if handle is NULL, prov_auth_destroy shall do nothing. ] */
@@ -0,0 +1,480 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/shared_util_options.h"
+
+#include "azure_prov_client/prov_device_ll_client.h"
+#include "azure_prov_client/prov_device_ll_bulk_client.h"
+#include "azure_prov_client/internal/prov_auth_client.h"
+#include "azure_prov_client/internal/prov_device_ll_client_private.h"
+
+typedef struct PROV_BULK_REGISTRATION_TAG
+{
+    DLIST_ENTRY entry;
+    struct PROV_BULK_INSTANCE_INFO_TAG* bulk_info;
+    char* registration_id;
+    PROV_DEVICE_BULK_REGISTER_DEVICE_CALLBACK register_callback;
+    void* user_context;
+    PROV_DEVICE_LL_HANDLE prov_handle;
+    bool complete;
+
+    bool has_credential;
+    PROV_BULK_CREDENTIAL_TYPE credential_type;
+    char* x509_certificate;
+    char* x509_private_key;
+    const HSM_CLIENT_TPM_INTERFACE* tpm_interface;
+    HSM_CLIENT_HANDLE tpm_handle;
+} PROV_BULK_REGISTRATION;
+
+typedef struct PROV_BULK_INSTANCE_INFO_TAG
+{
+    char* uri;
+    char* scope_id;
+    PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol;
+
+    DLIST_ENTRY waiting_list;
+    DLIST_ENTRY active_list;
+    size_t active_count;
+    size_t pending_count;
+    size_t max_concurrent;
+
+    char* trusted_cert;
+    bool log_trace;
+    bool proxy_set;
+    HTTP_PROXY_OPTIONS proxy_options;
+} PROV_BULK_INSTANCE_INFO;
+
+static void free_proxy_options(PROV_BULK_INSTANCE_INFO* bulk_info)
+{
+    free((char*)bulk_info->proxy_options.host_address);
+    free((char*)bulk_info->proxy_options.username);
+    free((char*)bulk_info->proxy_options.password);
+    memset(&bulk_info->proxy_options, 0, sizeof(HTTP_PROXY_OPTIONS));
+    bulk_info->proxy_set = false;
+}
+
+static void complete_registration(PROV_BULK_REGISTRATION* registration, PROV_DEVICE_RESULT register_result, const char* iothub_uri, const char* device_id)
+{
+    if (!registration->complete)
+    {
+        registration->complete = true;
+        registration->bulk_info->pending_count--;
+        registration->register_callback(registration->registration_id, register_result, iothub_uri, device_id, registration->user_context);
+    }
+}
+
+static void destroy_registration(PROV_BULK_REGISTRATION* registration)
+{
+    if (registration->prov_handle != NULL)
+    {
+        Prov_Device_LL_Destroy(registration->prov_handle);
+    }
+    free(registration->x509_certificate);
+    free(registration->x509_private_key);
+    free(registration->registration_id);
+    free(registration);
+}
+
+static void on_registration_complete(PROV_DEVICE_RESULT register_result, const char* iothub_uri, const char* device_id, void* user_context)
+{
+    /* Codes_SRS_PROV_DEVICE_LL_BULK_36_011: [ When the registration of a device completes, the register_callback given to Prov_Device_LL_Bulk_Add_Device shall be invoked with its registration_id and the result of the registration. ] */
+    complete_registration((PROV_BULK_REGISTRATION*)user_context, register_result, iothub_uri, device_id);
+}
+
+static int apply_options(PROV_BULK_INSTANCE_INFO* bulk_info, PROV_DEVICE_LL_HANDLE prov_handle)
+{
+    int result;
+    if (bulk_info->trusted_cert != NULL && Prov_Device_LL_SetOption(prov_handle, OPTION_TRUSTED_CERT, bulk_info->trusted_cert) != PROV_DEVICE_RESULT_OK)
+    {
+        LogError("Failure setting trusted certificate");
+        result = __FAILURE__;
+    }
+    else if (bulk_info->log_trace && Prov_Device_LL_SetOption(prov_handle, PROV_OPTION_LOG_TRACE, &bulk_info->log_trace) != PROV_DEVICE_RESULT_OK)
+    {
+        LogError("Failure setting log trace");
+        result = __FAILURE__;
+    }
+    else if (bulk_info->proxy_set && Prov_Device_LL_SetOption(prov_handle, OPTION_HTTP_PROXY, &bulk_info->proxy_options) != PROV_DEVICE_RESULT_OK)
+    {
+        LogError("Failure setting proxy options");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static PROV_DEVICE_LL_HANDLE create_prov_handle(PROV_BULK_INSTANCE_INFO* bulk_info, PROV_BULK_REGISTRATION* registration)
+{
+    PROV_DEVICE_LL_HANDLE result;
+    if (!registration->has_credential)
+    {
+        result = Prov_Device_LL_Create(bulk_info->uri, bulk_info->scope_id, bulk_info->protocol);
+    }
+    else
+    {
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_021: [ A registration added with a credential shall authenticate with that credential instead of the process wide hsm. ] */
+        PROV_AUTH_HANDLE prov_auth_handle;
+        if (registration->credential_type == PROV_BULK_CREDENTIAL_X509)
+        {
+            prov_auth_handle = prov_auth_create_x509(registration->x509_certificate, registration->x509_private_key);
+        }
+        else
+        {
+            prov_auth_handle = prov_auth_create_tpm(registration->tpm_interface, registration->tpm_handle);
+        }
+
+        if (prov_auth_handle == NULL)
+        {
+            LogError("Failure creating the credential of %s", registration->registration_id);
+            result = NULL;
+        }
+        else
+        {
+            result = Prov_Device_LL_Create_With_Auth(bulk_info->uri, bulk_info->scope_id, bulk_info->protocol, prov_auth_handle);
+        }
+    }
+    return result;
+}
+
+static int copy_credential(PROV_BULK_REGISTRATION* registration, const PROV_BULK_DEVICE_CREDENTIAL* credential)
+{
+    int result;
+    registration->has_credential = true;
+    registration->credential_type = credential->type;
+    if (credential->type == PROV_BULK_CREDENTIAL_X509)
+    {
+        if (mallocAndStrcpy_s(&registration->x509_certificate, credential->x509_certificate) != 0 ||
+            mallocAndStrcpy_s(&registration->x509_private_key, credential->x509_private_key) != 0)
+        {
+            LogError("failure copying x509 credential");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    else
+    {
+        registration->tpm_interface = credential->tpm_interface;
+        registration->tpm_handle = credential->tpm_handle;
+        result = 0;
+    }
+    return result;
+}
+
+static bool is_credential_valid(const PROV_BULK_DEVICE_CREDENTIAL* credential)
+{
+    bool result;
+    if (credential->type == PROV_BULK_CREDENTIAL_X509)
+    {
+        result = credential->x509_certificate != NULL && credential->x509_private_key != NULL;
+    }
+    else if (credential->type == PROV_BULK_CREDENTIAL_TPM)
+    {
+        result = credential->tpm_interface != NULL && credential->tpm_handle != NULL;
+    }
+    else
+    {
+        result = false;
+    }
+    return result;
+}
+
+static int start_registration(PROV_BULK_INSTANCE_INFO* bulk_info, PROV_BULK_REGISTRATION* registration)
+{
+    int result;
+    if ((registration->prov_handle = create_prov_handle(bulk_info, registration)) == NULL)
+    {
+        LogError("Failure creating provisioning client for %s", registration->registration_id);
+        result = __FAILURE__;
+    }
+    else if (apply_options(bulk_info, registration->prov_handle) != 0)
+    {
+        LogError("Failure applying options for %s", registration->registration_id);
+        result = __FAILURE__;
+    }
+    else if (Prov_Device_LL_SetOption(registration->prov_handle, PROV_REGISTRATION_ID, registration->registration_id) != PROV_DEVICE_RESULT_OK)
+    {
+        LogError("Failure setting registration id %s", registration->registration_id);
+        result = __FAILURE__;
+    }
+    else if (Prov_Device_LL_Register_Device(registration->prov_handle, on_registration_complete, registration, NULL, NULL) != PROV_DEVICE_RESULT_OK)
+    {
+        LogError("Failure registering device %s", registration->registration_id);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+PROV_DEVICE_LL_BULK_HANDLE Prov_Device_LL_Bulk_Create(const char* uri, const char* scope_id, PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol)
+{
+    PROV_BULK_INSTANCE_INFO* result;
+    /* Codes_SRS_PROV_DEVICE_LL_BULK_36_001: [ If uri, scope_id or protocol is NULL, Prov_Device_LL_Bulk_Create shall return NULL. ] */
+    if (uri == NULL || scope_id == NULL || protocol == NULL)
+    {
+        LogError("Invalid parameter specified uri: %p, scope_id: %p, protocol: %p", uri, scope_id, protocol);
+        result = NULL;
+    }
+    /* Codes_SRS_PROV_DEVICE_LL_BULK_36_002: [ Prov_Device_LL_Bulk_Create shall allocate a PROV_DEVICE_LL_BULK_HANDLE, copy uri and scope_id and set max_concurrent_registrations to PROV_BULK_DEFAULT_MAX_CONCURRENT. ] */
+    else if ((result = (PROV_BULK_INSTANCE_INFO*)malloc(sizeof(PROV_BULK_INSTANCE_INFO))) == NULL)
+    {
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_003: [ If any error is encountered, Prov_Device_LL_Bulk_Create shall return NULL. ] */
+        LogError("unable to allocate bulk instance info");
+    }
+    else
+    {
+        memset(result, 0, sizeof(PROV_BULK_INSTANCE_INFO));
+        if (mallocAndStrcpy_s(&result->uri, uri) != 0 || mallocAndStrcpy_s(&result->scope_id, scope_id) != 0)
+        {
+            /* Codes_SRS_PROV_DEVICE_LL_BULK_36_003: [ If any error is encountered, Prov_Device_LL_Bulk_Create shall return NULL. ] */
+            LogError("failure copying uri or scope id");
+            free(result->uri);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->protocol = protocol;
+            result->max_concurrent = PROV_BULK_DEFAULT_MAX_CONCURRENT;
+            DList_InitializeListHead(&result->waiting_list);
+            DList_InitializeListHead(&result->active_list);
+        }
+    }
+    return result;
+}
+
+void Prov_Device_LL_Bulk_Destroy(PROV_DEVICE_LL_BULK_HANDLE handle)
+{
+    /* Codes_SRS_PROV_DEVICE_LL_BULK_36_004: [ If handle is NULL, Prov_Device_LL_Bulk_Destroy shall do nothing. ] */
+    if (handle != NULL)
+    {
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_005: [ Prov_Device_LL_Bulk_Destroy shall invoke the callback of every registration that has not completed with PROV_DEVICE_RESULT_ERROR, destroy the provisioning clients of the active registrations and free all resources. ] */
+        PDLIST_ENTRY lists[2];
+        size_t index;
+        lists[0] = &handle->active_list;
+        lists[1] = &handle->waiting_list;
+        for (index = 0; index < 2; index++)
+        {
+            while (!DList_IsListEmpty(lists[index]))
+            {
+                PDLIST_ENTRY entry = DList_RemoveHeadList(lists[index]);
+                PROV_BULK_REGISTRATION* registration = containingRecord(entry, PROV_BULK_REGISTRATION, entry);
+                complete_registration(registration, PROV_DEVICE_RESULT_ERROR, NULL, NULL);
+                destroy_registration(registration);
+            }
+        }
+        free_proxy_options(handle);
+        free(handle->trusted_cert);
+        free(handle->uri);
+        free(handle->scope_id);
+        free(handle);
+    }
+}
+
+PROV_DEVICE_RESULT Prov_Device_LL_Bulk_Add_Device(PROV_DEVICE_LL_BULK_HANDLE handle, const char* registration_id, const PROV_BULK_DEVICE_CREDENTIAL* credential, PROV_DEVICE_BULK_REGISTER_DEVICE_CALLBACK register_callback, void* user_context)
+{
+    PROV_DEVICE_RESULT result;
+    PROV_BULK_REGISTRATION* registration;
+    /* Codes_SRS_PROV_DEVICE_LL_BULK_36_006: [ If handle, registration_id or register_callback is NULL, Prov_Device_LL_Bulk_Add_Device shall return PROV_DEVICE_RESULT_INVALID_ARG. ] */
+    if (handle == NULL || registration_id == NULL || register_callback == NULL)
+    {
+        LogError("Invalid parameter specified handle: %p, registration_id: %p, register_callback: %p", handle, registration_id, register_callback);
+        result = PROV_DEVICE_RESULT_INVALID_ARG;
+    }
+    /* Codes_SRS_PROV_DEVICE_LL_BULK_36_020: [ If credential is not NULL and misses the certificate or private key of an x509 credential, or the interface or handle of a TPM credential, Prov_Device_LL_Bulk_Add_Device shall return PROV_DEVICE_RESULT_INVALID_ARG. ] */
+    else if (credential != NULL && !is_credential_valid(credential))
+    {
+        LogError("Invalid credential specified for %s", registration_id);
+        result = PROV_DEVICE_RESULT_INVALID_ARG;
+    }
+    else if ((registration = (PROV_BULK_REGISTRATION*)malloc(sizeof(PROV_BULK_REGISTRATION))) == NULL)
+    {
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_008: [ If any error is encountered, Prov_Device_LL_Bulk_Add_Device shall return PROV_DEVICE_RESULT_MEMORY. ] */
+        LogError("unable to allocate registration");
+        result = PROV_DEVICE_RESULT_MEMORY;
+    }
+    else
+    {
+        memset(registration, 0, sizeof(PROV_BULK_REGISTRATION));
+        if (mallocAndStrcpy_s(&registration->registration_id, registration_id) != 0 ||
+            (credential != NULL && copy_credential(registration, credential) != 0))
+        {
+            /* Codes_SRS_PROV_DEVICE_LL_BULK_36_008: [ If any error is encountered, Prov_Device_LL_Bulk_Add_Device shall return PROV_DEVICE_RESULT_MEMORY. ] */
+            LogError("failure copying registration id or credential");
+            destroy_registration(registration);
+            result = PROV_DEVICE_RESULT_MEMORY;
+        }
+        else
+        {
+            /* Codes_SRS_PROV_DEVICE_LL_BULK_36_007: [ Prov_Device_LL_Bulk_Add_Device shall copy registration_id and credential and queue the registration without opening any connection. ] */
+            registration->bulk_info = handle;
+            registration->register_callback = register_callback;
+            registration->user_context = user_context;
+            DList_InsertTailList(&handle->waiting_list, &registration->entry);
+            handle->pending_count++;
+            result = PROV_DEVICE_RESULT_OK;
+        }
+    }
+    return result;
+}
+
+void Prov_Device_LL_Bulk_DoWork(PROV_DEVICE_LL_BULK_HANDLE handle)
+{
+    /* Codes_SRS_PROV_DEVICE_LL_BULK_36_009: [ If handle is NULL, Prov_Device_LL_Bulk_DoWork shall do nothing. ] */
+    if (handle != NULL)
+    {
+        PDLIST_ENTRY entry;
+
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_010: [ Prov_Device_LL_Bulk_DoWork shall start queued registrations, in the order they were added, while fewer than max_concurrent_registrations registrations are active, by creating a PROV_DEVICE_LL_HANDLE, applying the stored options and the registration id and calling Prov_Device_LL_Register_Device. ] */
+        while (handle->active_count < handle->max_concurrent && !DList_IsListEmpty(&handle->waiting_list))
+        {
+            PROV_BULK_REGISTRATION* registration = containingRecord(DList_RemoveHeadList(&handle->waiting_list), PROV_BULK_REGISTRATION, entry);
+            if (start_registration(handle, registration) != 0)
+            {
+                /* Codes_SRS_PROV_DEVICE_LL_BULK_36_012: [ If a registration cannot be started, its callback shall be invoked with PROV_DEVICE_RESULT_ERROR and the registration shall be discarded. ] */
+                complete_registration(registration, PROV_DEVICE_RESULT_ERROR, NULL, NULL);
+                destroy_registration(registration);
+            }
+            else
+            {
+                DList_InsertTailList(&handle->active_list, &registration->entry);
+                handle->active_count++;
+            }
+        }
+
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_013: [ Prov_Device_LL_Bulk_DoWork shall call Prov_Device_LL_DoWork on every active registration and destroy the PROV_DEVICE_LL_HANDLE of the registrations that completed. ] */
+        entry = handle->active_list.Flink;
+        while (entry != &handle->active_list)
+        {
+            PROV_BULK_REGISTRATION* registration = containingRecord(entry, PROV_BULK_REGISTRATION, entry);
+            entry = entry->Flink;
+
+            Prov_Device_LL_DoWork(registration->prov_handle);
+            if (registration->complete)
+            {
+                (void)DList_RemoveEntryList(&registration->entry);
+                handle->active_count--;
+                destroy_registration(registration);
+            }
+        }
+    }
+}
+
+size_t Prov_Device_LL_Bulk_Get_Pending_Count(PROV_DEVICE_LL_BULK_HANDLE handle)
+{
+    size_t result;
+    if (handle == NULL)
+    {
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_014: [ If handle is NULL, Prov_Device_LL_Bulk_Get_Pending_Count shall return 0. ] */
+        LogError("Invalid parameter specified handle: %p", handle);
+        result = 0;
+    }
+    else
+    {
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_015: [ Prov_Device_LL_Bulk_Get_Pending_Count shall return the number of queued and active registrations whose callback has not been invoked. ] */
+        result = handle->pending_count;
+    }
+    return result;
+}
+
+PROV_DEVICE_RESULT Prov_Device_LL_Bulk_SetOption(PROV_DEVICE_LL_BULK_HANDLE handle, const char* optionName, const void* value)
+{
+    PROV_DEVICE_RESULT result;
+    /* Codes_SRS_PROV_DEVICE_LL_BULK_36_016: [ If handle, optionName or value is NULL, Prov_Device_LL_Bulk_SetOption shall return PROV_DEVICE_RESULT_INVALID_ARG. ] */
+    if (handle == NULL || optionName == NULL || value == NULL)
+    {
+        LogError("Invalid parameter specified handle: %p, optionName: %p, value: %p", handle, optionName, value);
+        result = PROV_DEVICE_RESULT_INVALID_ARG;
+    }
+    else if (strcmp(optionName, PROV_BULK_OPTION_MAX_CONCURRENT) == 0)
+    {
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_017: [ If optionName is PROV_BULK_OPTION_MAX_CONCURRENT, value shall be used as a size_t* and a value of 0 shall be rejected with PROV_DEVICE_RESULT_INVALID_ARG. ] */
+        size_t max_concurrent = *(const size_t*)value;
+        if (max_concurrent == 0)
+        {
+            LogError("max_concurrent_registrations cannot be 0");
+            result = PROV_DEVICE_RESULT_INVALID_ARG;
+        }
+        else
+        {
+            handle->max_concurrent = max_concurrent;
+            result = PROV_DEVICE_RESULT_OK;
+        }
+    }
+    else if (strcmp(optionName, OPTION_TRUSTED_CERT) == 0)
+    {
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_018: [ OPTION_TRUSTED_CERT, PROV_OPTION_LOG_TRACE and OPTION_HTTP_PROXY shall be copied and applied to every registration started afterwards. ] */
+        char* trusted_cert;
+        if (mallocAndStrcpy_s(&trusted_cert, (const char*)value) != 0)
+        {
+            LogError("failure copying trusted certificate");
+            result = PROV_DEVICE_RESULT_MEMORY;
+        }
+        else
+        {
+            free(handle->trusted_cert);
+            handle->trusted_cert = trusted_cert;
+            result = PROV_DEVICE_RESULT_OK;
+        }
+    }
+    else if (strcmp(optionName, PROV_OPTION_LOG_TRACE) == 0)
+    {
+        handle->log_trace = *(const bool*)value;
+        result = PROV_DEVICE_RESULT_OK;
+    }
+    else if (strcmp(optionName, OPTION_HTTP_PROXY) == 0)
+    {
+        const HTTP_PROXY_OPTIONS* proxy_options = (const HTTP_PROXY_OPTIONS*)value;
+        char* host_address = NULL;
+        char* username = NULL;
+        char* password = NULL;
+
+        if (proxy_options->host_address == NULL)
+        {
+            LogError("NULL host_address in proxy options");
+            result = PROV_DEVICE_RESULT_INVALID_ARG;
+        }
+        else if (mallocAndStrcpy_s(&host_address, proxy_options->host_address) != 0 ||
+            (proxy_options->username != NULL && mallocAndStrcpy_s(&username, proxy_options->username) != 0) ||
+            (proxy_options->password != NULL && mallocAndStrcpy_s(&password, proxy_options->password) != 0))
+        {
+            LogError("failure copying proxy options");
+            free(host_address);
+            free(username);
+            result = PROV_DEVICE_RESULT_MEMORY;
+        }
+        else
+        {
+            free_proxy_options(handle);
+            handle->proxy_options.host_address = host_address;
+            handle->proxy_options.port = proxy_options->port;
+            handle->proxy_options.username = username;
+            handle->proxy_options.password = password;
+            handle->proxy_set = true;
+            result = PROV_DEVICE_RESULT_OK;
+        }
+    }
+    else
+    {
+        /* Codes_SRS_PROV_DEVICE_LL_BULK_36_019: [ If optionName is not supported, Prov_Device_LL_Bulk_SetOption shall return PROV_DEVICE_RESULT_ERROR. ] */
+        LogError("Option %s is not supported by the bulk client", optionName);
+        result = PROV_DEVICE_RESULT_ERROR;
+    }
+    return result;
+}
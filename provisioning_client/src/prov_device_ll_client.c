@@ -20,6 +20,7 @@
 
 #include "azure_prov_client/internal/prov_auth_client.h"
 #include "azure_prov_client/internal/prov_transport_private.h"
+#include "azure_prov_client/internal/prov_device_ll_client_private.h"
 #include "azure_prov_client/prov_device_ll_client.h"
 #include "azure_prov_client/prov_client_const.h"
 
@@ -523,13 +524,18 @@ static void destroy_instance(PROV_INSTANCE_INFO* prov_info)
     free(prov_info);
 }
 
-PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create(const char* uri, const char* id_scope, PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol)
+/*a NULL prov_auth_handle creates the auth module of the process wide hsm, otherwise the instance owns the given one*/
+static PROV_INSTANCE_INFO* create_instance(const char* uri, const char* id_scope, PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol, PROV_AUTH_HANDLE prov_auth_handle)
 {
     PROV_INSTANCE_INFO* result;
     /* Codes_SRS_PROV_CLIENT_07_001: [If uri is NULL Prov_Device_LL_CreateFromUri shall return NULL.] */
     if (uri == NULL || id_scope == NULL || protocol == NULL)
     {
         LogError("Invalid parameter specified uri: %p, id_scope: %p, protocol: %p", uri, id_scope, protocol);
+        if (prov_auth_handle != NULL)
+        {
+            prov_auth_destroy(prov_auth_handle);
+        }
         result = NULL;
     }
     else
@@ -539,10 +545,15 @@ PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create(const char* uri, const char* id_scop
         if (result == NULL)
         {
             LogError("unable to allocate Instance Info");
+            if (prov_auth_handle != NULL)
+            {
+                prov_auth_destroy(prov_auth_handle);
+            }
         }
         else
         {
             memset(result, 0, sizeof(PROV_INSTANCE_INFO) );
+            result->prov_auth_handle = prov_auth_handle;
 
             /* Codes_SRS_PROV_CLIENT_07_028: [ CLIENT_STATE_READY is the initial state after the object is created which will send a uhttp_client_open call to the http endpoint. ] */
             result->prov_state = CLIENT_STATE_READY;
@@ -553,10 +564,14 @@ PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create(const char* uri, const char* id_scop
             {
                 /* Codes_SRS_PROV_CLIENT_07_003: [ If any error is encountered, Prov_Device_LL_CreateFromUri shall return NULL. ] */
                 LogError("failed to construct id_scope");
+                if (prov_auth_handle != NULL)
+                {
+                    prov_auth_destroy(prov_auth_handle);
+                }
                 free(result);
                 result = NULL;
             }
-            else if ((result->prov_auth_handle = prov_auth_create()) == NULL)
+            else if (result->prov_auth_handle == NULL && (result->prov_auth_handle = prov_auth_create()) == NULL)
             {
                 /* Codes_SRS_PROV_CLIENT_07_003: [ If any error is encountered, Prov_Device_LL_CreateFromUri shall return NULL. ] */
                 LogError("failed calling prov_auth_create\r\n");
@@ -591,7 +606,29 @@ PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create(const char* uri, const char* id_scop
             }
         }
     }
-    return (PROV_DEVICE_LL_HANDLE)result;
+    return result;
+}
+
+PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create(const char* uri, const char* id_scope, PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol)
+{
+    return (PROV_DEVICE_LL_HANDLE)create_instance(uri, id_scope, protocol, NULL);
+}
+
+PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create_With_Auth(const char* uri, const char* id_scope, PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol, PROV_AUTH_HANDLE prov_auth_handle)
+{
+    PROV_DEVICE_LL_HANDLE result;
+    /* Codes_SRS_PROV_CLIENT_36_001: [ If prov_auth_handle is NULL, Prov_Device_LL_Create_With_Auth shall return NULL. ] */
+    if (prov_auth_handle == NULL)
+    {
+        LogError("Invalid parameter specified prov_auth_handle: %p", prov_auth_handle);
+        result = NULL;
+    }
+    else
+    {
+        /* Codes_SRS_PROV_CLIENT_36_002: [ Prov_Device_LL_Create_With_Auth shall create the client like Prov_Device_LL_Create, authenticating with prov_auth_handle instead of the process wide hsm, and shall destroy prov_auth_handle if it fails. ] */
+        result = (PROV_DEVICE_LL_HANDLE)create_instance(uri, id_scope, protocol, prov_auth_handle);
+    }
+    return result;
 }
 
 void Prov_Device_LL_Destroy(PROV_DEVICE_LL_HANDLE handle)
@@ -68,6 +68,7 @@ MOCKABLE_FUNCTION(, int, X509GetDERCsr, DERBuilderContext*, Context, RIOT_ECC_SI
 static const char* TEST_STRING_VALUE = "Test_String_Value";
 static const char* TEST_CERTIFICATE_VALUE = "Test_String_ValueTest_String_Value";
 static const char* TEST_CN_VALUE = "riot-device-cert";
+static const char* TEST_LEAF_CN_VALUES[] = { "leaf-device-1", "leaf-device-2" };
 
 static int umocktypes_copy_RIOT_ECC_PRIVATE(RIOT_ECC_PRIVATE* dest, const RIOT_ECC_PRIVATE* src)
 {
@@ -319,6 +320,7 @@ BEGIN_TEST_SUITE(hsm_client_riot_ut)
         REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
         REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, my_mallocAndStrcpy_s);
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(mallocAndStrcpy_s, __LINE__);
+
     }
 
     TEST_SUITE_CLEANUP(suite_cleanup)
@@ -335,6 +337,8 @@ BEGIN_TEST_SUITE(hsm_client_riot_ut)
         {
             ASSERT_FAIL("Could not acquire test serialization mutex.");
         }
+        // Every test starts without a cached RIoT chain
+        hsm_client_x509_deinit();
         umock_c_reset_all_calls();
     }
 
@@ -500,6 +504,58 @@ BEGIN_TEST_SUITE(hsm_client_riot_ut)
         umock_c_negative_tests_deinit();
     }
 
+    /* Tests_SRS_HSM_CLIENT_RIOT_44_001: [ If the keys and certificates derived from the current CDI and firmware id are cached, hsm_client_riot_create shall copy them instead of calling into the RIoT code. ] */
+    /* Tests_SRS_HSM_CLIENT_RIOT_44_002: [ Otherwise hsm_client_riot_create shall cache the derived keys and certificates for the next instances. ] */
+    TEST_FUNCTION(hsm_client_riot_create_cached_succeed)
+    {
+        hsm_client_x509_init();
+        HSM_CLIENT_HANDLE first_handle = hsm_client_riot_create();
+        char* first_cert = hsm_client_riot_get_certificate(first_handle);
+        umock_c_reset_all_calls();
+
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_CN_VALUE));
+
+        //act
+        HSM_CLIENT_HANDLE sec_handle = hsm_client_riot_create();
+
+        //assert
+        ASSERT_IS_NOT_NULL(sec_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        char* cert = hsm_client_riot_get_certificate(sec_handle);
+        ASSERT_ARE_EQUAL(char_ptr, first_cert, cert);
+
+        //cleanup
+        my_gballoc_free(cert);
+        my_gballoc_free(first_cert);
+        hsm_client_riot_destroy(sec_handle);
+        hsm_client_riot_destroy(first_handle);
+    }
+
+    /* Tests_SRS_HSM_CLIENT_RIOT_44_003: [ hsm_client_x509_deinit shall clear the cached keys and certificates. ] */
+    TEST_FUNCTION(hsm_client_riot_create_after_deinit_succeed)
+    {
+        hsm_client_x509_init();
+        HSM_CLIENT_HANDLE first_handle = hsm_client_riot_create();
+        hsm_client_x509_deinit();
+        umock_c_reset_all_calls();
+
+        //arrange
+        hsm_client_riot_create_mock(false);
+
+        //act
+        HSM_CLIENT_HANDLE sec_handle = hsm_client_riot_create();
+
+        //assert
+        ASSERT_IS_NOT_NULL(sec_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        hsm_client_riot_destroy(sec_handle);
+        hsm_client_riot_destroy(first_handle);
+    }
+
     /* Tests_SRS_SECURE_DEVICE_RIOT_07_008: [ hsm_client_riot_destroy shall free the HSM_CLIENT_HANDLE instance. ] */
     /* Tests_SRS_SECURE_DEVICE_RIOT_07_009: [ hsm_client_riot_destroy shall free all resources allocated in this module. ] */
     TEST_FUNCTION(hsm_client_riot_destroy_succeed)
@@ -916,6 +972,98 @@ BEGIN_TEST_SUITE(hsm_client_riot_ut)
         umock_c_negative_tests_deinit();
     }
 
+    /* Tests_SRS_HSM_CLIENT_RIOT_45_001: [ If handle or common_names is NULL, count is 0 or one of the common names is NULL, hsm_client_riot_create_leaf_cert_bundle shall return NULL. ] */
+    TEST_FUNCTION(hsm_client_riot_create_leaf_cert_bundle_handle_NULL_fail)
+    {
+        //arrange
+
+        //act
+        char* value = hsm_client_riot_create_leaf_cert_bundle(NULL, TEST_LEAF_CN_VALUES, 2);
+
+        //assert
+        ASSERT_IS_NULL(value);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    /* Tests_SRS_HSM_CLIENT_RIOT_45_001: [ If handle or common_names is NULL, count is 0 or one of the common names is NULL, hsm_client_riot_create_leaf_cert_bundle shall return NULL. ] */
+    TEST_FUNCTION(hsm_client_riot_create_leaf_cert_bundle_invalid_common_names_fail)
+    {
+        //arrange
+        const char* common_names[] = { "leaf-device-1", NULL };
+        hsm_client_x509_init();
+        HSM_CLIENT_HANDLE sec_handle = hsm_client_riot_create();
+        umock_c_reset_all_calls();
+
+        //act
+        char* value_names_NULL = hsm_client_riot_create_leaf_cert_bundle(sec_handle, NULL, 2);
+        char* value_count_0 = hsm_client_riot_create_leaf_cert_bundle(sec_handle, TEST_LEAF_CN_VALUES, 0);
+        char* value_name_NULL = hsm_client_riot_create_leaf_cert_bundle(sec_handle, common_names, 2);
+
+        //assert
+        ASSERT_IS_NULL(value_names_NULL);
+        ASSERT_IS_NULL(value_count_0);
+        ASSERT_IS_NULL(value_name_NULL);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        hsm_client_riot_destroy(sec_handle);
+    }
+
+    /* Tests_SRS_HSM_CLIENT_RIOT_45_002: [ hsm_client_riot_create_leaf_cert_bundle shall produce the certificates one after the other on the calling thread, reusing a single DER context. ] */
+    /* Tests_SRS_HSM_CLIENT_RIOT_45_004: [ On success hsm_client_riot_create_leaf_cert_bundle shall return the PEM certificates concatenated in the order of common_names. ] */
+    TEST_FUNCTION(hsm_client_riot_create_leaf_cert_bundle_succeed)
+    {
+        //arrange
+        hsm_client_x509_init();
+        HSM_CLIENT_HANDLE sec_handle = hsm_client_riot_create();
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        for (size_t index = 0; index < 2; index++)
+        {
+            STRICT_EXPECTED_CALL(DERInitContext(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+            STRICT_EXPECTED_CALL(X509GetDeviceCertTBS(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+            STRICT_EXPECTED_CALL(RiotCrypt_Sign(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(X509MakeDeviceCert(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(DERtoPEM(IGNORED_PTR_ARG, CERT_TYPE, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        }
+
+        //act
+        char* value = hsm_client_riot_create_leaf_cert_bundle(sec_handle, TEST_LEAF_CN_VALUES, 2);
+
+        //assert
+        ASSERT_IS_NOT_NULL(value);
+        ASSERT_ARE_EQUAL(char_ptr, TEST_CERTIFICATE_VALUE, value);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        my_gballoc_free(value);
+        hsm_client_riot_destroy(sec_handle);
+    }
+
+    /* Tests_SRS_HSM_CLIENT_RIOT_45_005: [ If any certificate cannot be produced, hsm_client_riot_create_leaf_cert_bundle shall return NULL. ] */
+    TEST_FUNCTION(hsm_client_riot_create_leaf_cert_bundle_sign_fail)
+    {
+        //arrange
+        hsm_client_x509_init();
+        HSM_CLIENT_HANDLE sec_handle = hsm_client_riot_create();
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(RiotCrypt_Sign(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+            .SetReturn(RIOT_FAILURE);
+
+        //act
+        char* value = hsm_client_riot_create_leaf_cert_bundle(sec_handle, TEST_LEAF_CN_VALUES, 2);
+
+        //assert
+        ASSERT_IS_NULL(value);
+
+        //cleanup
+        hsm_client_riot_destroy(sec_handle);
+    }
+
     /* Tests_SRS_SECURE_DEVICE_RIOT_07_029: [ hsm_client_riot_interface shall return the SEC_RIOT_INTERFACE structure. ] */
     TEST_FUNCTION(hsm_client_riot_interface_succeed)
     {
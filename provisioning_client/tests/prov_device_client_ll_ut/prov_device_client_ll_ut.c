@@ -46,6 +46,7 @@ static void my_gballoc_free(void* ptr)
 #undef ENABLE_MOCKS
 
 #include "azure_prov_client/prov_device_ll_client.h"
+#include "azure_prov_client/internal/prov_device_ll_client_private.h"
 
 #define ENABLE_MOCKS
 #include "azure_c_shared_utility/umock_c_prod.h"
@@ -731,6 +732,61 @@ BEGIN_TEST_SUITE(prov_device_client_ll_ut)
         umock_c_negative_tests_deinit();
     }
 
+    /* Tests_SRS_PROV_CLIENT_36_001: [ If prov_auth_handle is NULL, Prov_Device_LL_Create_With_Auth shall return NULL. ] */
+    TEST_FUNCTION(Prov_Device_LL_Create_With_Auth_prov_auth_handle_NULL_fail)
+    {
+        //arrange
+
+        //act
+        PROV_DEVICE_LL_HANDLE result = Prov_Device_LL_Create_With_Auth(TEST_PROV_URI, TEST_SCOPE_ID, trans_provider, NULL);
+
+        //assert
+        ASSERT_IS_NULL(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    /* Tests_SRS_PROV_CLIENT_36_002: [ Prov_Device_LL_Create_With_Auth shall create the client like Prov_Device_LL_Create, authenticating with prov_auth_handle instead of the process wide hsm, and shall destroy prov_auth_handle if it fails. ] */
+    TEST_FUNCTION(Prov_Device_LL_Create_With_Auth_succeed)
+    {
+        //arrange
+        PROV_AUTH_HANDLE prov_auth_handle = my_prov_auth_create();
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tickcounter_create());
+        STRICT_EXPECTED_CALL(prov_auth_get_type(prov_auth_handle)).SetReturn(PROV_AUTH_TYPE_X509);
+        STRICT_EXPECTED_CALL(prov_transport_create(IGNORED_PTR_ARG, TRANSPORT_HSM_TYPE_X509, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        PROV_DEVICE_LL_HANDLE result = Prov_Device_LL_Create_With_Auth(TEST_PROV_URI, TEST_SCOPE_ID, trans_provider, prov_auth_handle);
+
+        //assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        Prov_Device_LL_Destroy(result);
+    }
+
+    /* Tests_SRS_PROV_CLIENT_36_002: [ Prov_Device_LL_Create_With_Auth shall create the client like Prov_Device_LL_Create, authenticating with prov_auth_handle instead of the process wide hsm, and shall destroy prov_auth_handle if it fails. ] */
+    TEST_FUNCTION(Prov_Device_LL_Create_With_Auth_fail_destroys_prov_auth_handle)
+    {
+        //arrange
+        PROV_AUTH_HANDLE prov_auth_handle = my_prov_auth_create();
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).SetReturn(NULL);
+        STRICT_EXPECTED_CALL(prov_auth_destroy(prov_auth_handle));
+
+        //act
+        PROV_DEVICE_LL_HANDLE result = Prov_Device_LL_Create_With_Auth(TEST_PROV_URI, TEST_SCOPE_ID, trans_provider, prov_auth_handle);
+
+        //assert
+        ASSERT_IS_NULL(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
     /* Tests_SRS_PROV_CLIENT_CLIENT_07_005: [ If handle is NULL Prov_Device_LL_Destroy shall do nothing. ] */
     TEST_FUNCTION(Prov_Device_LL_Destroy_handle_NULL)
     {
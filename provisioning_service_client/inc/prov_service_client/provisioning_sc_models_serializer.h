@@ -87,6 +87,19 @@ MOCKABLE_FUNCTION(, char*, querySpecification_serializeToJson, const PROVISIONIN
 */
 MOCKABLE_FUNCTION(, PROVISIONING_QUERY_RESPONSE*, queryResponse_deserializeFromJson, const char*, json_string, PROVISIONING_QUERY_TYPE, type);
 
+/** @brief  Deserializes the next record of a JSON String representation of a Query Response page, without
+*           parsing the rest of the page.
+*
+* @param    json_page       A JSON String representing a page of Query Response results. It is modified
+*                           while a record is parsed, and restored before returning.
+* @param    offset_ptr      A pointer to the position in json_page where the previous call stopped, 0 for the first record.
+* @param    type            The type of the records in the page.
+* @param    record_ptr      A pointer to a handle to be filled with the next record, or NULL once the page is exhausted.
+*
+* @return   0 upon success, a non-zero number upon failure.
+*/
+MOCKABLE_FUNCTION(, int, queryResponse_deserializeNextFromJson, char*, json_page, size_t*, offset_ptr, PROVISIONING_QUERY_TYPE, type, void**, record_ptr);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -46,6 +46,16 @@ typedef struct PROVISIONING_QUERY_RESPONSE_TAG
     PROVISIONING_QUERY_TYPE response_arr_type;
 } PROVISIONING_QUERY_RESPONSE;
 
+typedef struct PROVISIONING_QUERY_RECORD_TAG
+{
+    union {
+        INDIVIDUAL_ENROLLMENT_HANDLE ie;
+        ENROLLMENT_GROUP_HANDLE eg;
+        DEVICE_REGISTRATION_STATE_HANDLE drs;
+    } handle;
+    PROVISIONING_QUERY_TYPE type;
+} PROVISIONING_QUERY_RECORD;
+
 MOCKABLE_FUNCTION(, void, queryResponse_free, PROVISIONING_QUERY_RESPONSE*, query_resp);
 
 /*---INTERNAL USAGE ONLY---*/
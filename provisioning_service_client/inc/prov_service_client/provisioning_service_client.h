@@ -25,6 +25,17 @@ DEFINE_ENUM(TRACING_STATUS, TRACING_STATUS_VALUES);
 */
 typedef struct PROVISIONING_SERVICE_CLIENT_TAG* PROVISIONING_SERVICE_CLIENT_HANDLE;
 
+/** @brief  Handle to a query iterator, reading the results of a query one record at a time
+*/
+typedef struct PROVISIONING_QUERY_ITERATOR_TAG* PROVISIONING_QUERY_ITERATOR_HANDLE;
+
+/** @brief  Handle to a bulk importer, running bulk operations over an enrollment stream of any length
+*/
+typedef struct PROVISIONING_BULK_IMPORTER_TAG* PROVISIONING_BULK_IMPORTER_HANDLE;
+
+#define PROVISIONING_BULK_IMPORTER_DEFAULT_CHUNK_SIZE       10
+#define PROVISIONING_BULK_IMPORTER_DEFAULT_CHUNKS_IN_FLIGHT 4
+
 /** @brief  Creates a Provisioning Service Client handle for use in consequent APIs.
 *
 * @param    conn_string     A connection string used to establish connection with the Provisioning Service.
@@ -212,6 +223,83 @@ MOCKABLE_FUNCTION(, int, prov_sc_get_device_registration_state, PROVISIONING_SER
 */
 MOCKABLE_FUNCTION(, int, prov_sc_query_device_registration_state, PROVISIONING_SERVICE_CLIENT_HANDLE, prov_client, PROVISIONING_QUERY_SPECIFICATION*, query_spec, char**, cont_token_ptr, PROVISIONING_QUERY_RESPONSE**, query_resp_ptr);
 
+/** @brief  Creates an iterator over all the records matching a query on the Provisioning Service. The
+*           iterator keeps its own connection open across pages and requests the next page while the
+*           records of the current one are read. The query is not sent until the first call to
+*           prov_sc_query_iterator_next.
+*
+* @param    prov_client     The handle used for connecting to the Provisioning Service.
+* @param    query_type      The type of the records to query.
+* @param    query_spec      The query specification with query details and settings. Its content is copied.
+*
+* @return   A non-NULL handle to the query iterator upon success, and NULL on failure.
+*/
+MOCKABLE_FUNCTION(, PROVISIONING_QUERY_ITERATOR_HANDLE, prov_sc_query_iterator_create, PROVISIONING_SERVICE_CLIENT_HANDLE, prov_client, PROVISIONING_QUERY_TYPE, query_type, const PROVISIONING_QUERY_SPECIFICATION*, query_spec);
+
+/** @brief  Retrieves the next record of a query. Only this record is parsed from the current page,
+*           and the call blocks only when the whole page has been read and the next one has not
+*           arrived yet.
+*
+* @param    iterator        The handle of the query iterator.
+* @param    record_ptr      A pointer to be filled with the next record, or NULL when all the records
+*                           have been read. The record belongs to the iterator and is valid until the
+*                           next call to prov_sc_query_iterator_next or prov_sc_query_iterator_destroy.
+*
+* @return   0 upon success, a non-zero number upon failure
+*/
+MOCKABLE_FUNCTION(, int, prov_sc_query_iterator_next, PROVISIONING_QUERY_ITERATOR_HANDLE, iterator, PROVISIONING_QUERY_RECORD**, record_ptr);
+
+/** @brief  Destroys a query iterator, its connection and the last record it returned.
+*
+* @param    iterator        The handle of the query iterator.
+*/
+MOCKABLE_FUNCTION(, void, prov_sc_query_iterator_destroy, PROVISIONING_QUERY_ITERATOR_HANDLE, iterator);
+
+/** @brief  Creates a bulk importer, which splits the individual enrollments added to it into bulk
+*           operations of chunk_size enrollments and sends up to max_chunks_in_flight of them at once,
+*           each on its own connection to the Provisioning Service. The connections are opened when
+*           first needed and kept open for the next chunks.
+*
+* @param    prov_client             The handle used for connecting to the Provisioning Service.
+* @param    mode                    The mode of the bulk operations.
+* @param    chunk_size              The number of enrollments per bulk operation, or 0 for
+*                                   PROVISIONING_BULK_IMPORTER_DEFAULT_CHUNK_SIZE.
+* @param    max_chunks_in_flight    The number of bulk operations sent at once, or 0 for
+*                                   PROVISIONING_BULK_IMPORTER_DEFAULT_CHUNKS_IN_FLIGHT.
+*
+* @return   A non-NULL handle to the bulk importer upon success, and NULL on failure.
+*/
+MOCKABLE_FUNCTION(, PROVISIONING_BULK_IMPORTER_HANDLE, prov_sc_bulk_importer_create, PROVISIONING_SERVICE_CLIENT_HANDLE, prov_client, PROVISIONING_BULK_OPERATION_MODE, mode, size_t, chunk_size, size_t, max_chunks_in_flight);
+
+/** @brief  Adds an individual enrollment to the bulk importer, which takes ownership of it on success.
+*           A full chunk is sent right away; the call blocks only when all the chunks in flight are
+*           waiting for their result. The enrollments of a chunk that cannot be sent are reported as
+*           errors by prov_sc_bulk_importer_finish.
+*
+* @param    importer        The handle of the bulk importer.
+* @param    enrollment      The individual enrollment to add.
+*
+* @return   0 upon success, a non-zero number upon failure
+*/
+MOCKABLE_FUNCTION(, int, prov_sc_bulk_importer_add_individual_enrollment, PROVISIONING_BULK_IMPORTER_HANDLE, importer, INDIVIDUAL_ENROLLMENT_HANDLE, enrollment);
+
+/** @brief  Sends the last partial chunk, waits for all the chunks in flight and reports the errors of
+*           all of them. The importer can be used again afterwards for a new report.
+*
+* @param    importer        The handle of the bulk importer.
+* @param    bulk_res_ptr    A pointer to a bulk operation result, to be filled with the merged report.
+*                           It must be freed with bulkOperationResult_free.
+*
+* @return   0 upon success, a non-zero number upon failure
+*/
+MOCKABLE_FUNCTION(, int, prov_sc_bulk_importer_finish, PROVISIONING_BULK_IMPORTER_HANDLE, importer, PROVISIONING_BULK_OPERATION_RESULT**, bulk_res_ptr);
+
+/** @brief  Destroys a bulk importer, its connections and the enrollments it has not sent yet.
+*
+* @param    importer        The handle of the bulk importer.
+*/
+MOCKABLE_FUNCTION(, void, prov_sc_bulk_importer_destroy, PROVISIONING_BULK_IMPORTER_HANDLE, importer);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
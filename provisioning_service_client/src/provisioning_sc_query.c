@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stdbool.h>
 
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/gballoc.h"
@@ -241,6 +242,183 @@ PROVISIONING_QUERY_RESPONSE* queryResponse_deserializeFromJson(const char* json_
      return new_result;
 }
 
+static FROM_JSON_FUNCTION queryType_getFromJson(PROVISIONING_QUERY_TYPE type)
+{
+    FROM_JSON_FUNCTION result;
+
+    if (type == QUERY_TYPE_INDIVIDUAL_ENROLLMENT)
+    {
+        result = (FROM_JSON_FUNCTION)individualEnrollment_fromJson;
+    }
+    else if (type == QUERY_TYPE_ENROLLMENT_GROUP)
+    {
+        result = (FROM_JSON_FUNCTION)enrollmentGroup_fromJson;
+    }
+    else if (type == QUERY_TYPE_DEVICE_REGISTRATION_STATE)
+    {
+        result = (FROM_JSON_FUNCTION)deviceRegistrationState_fromJson;
+    }
+    else
+    {
+        result = NULL;
+    }
+
+    return result;
+}
+
+static char* skip_whitespace(char* pos)
+{
+    while (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n')
+    {
+        pos++;
+    }
+    return pos;
+}
+
+//returns the character following the JSON object starting at obj_start, or NULL if the object is not terminated
+static char* find_object_end(char* obj_start)
+{
+    char* result = NULL;
+    char* pos = obj_start;
+    size_t depth = 0;
+    bool in_string = false;
+
+    while (*pos != '\0' && result == NULL)
+    {
+        if (in_string)
+        {
+            if (*pos == '\\' && *(pos + 1) != '\0')
+            {
+                pos++;
+            }
+            else if (*pos == '"')
+            {
+                in_string = false;
+            }
+        }
+        else if (*pos == '"')
+        {
+            in_string = true;
+        }
+        else if (*pos == '{' || *pos == '[')
+        {
+            depth++;
+        }
+        else if (*pos == '}' || *pos == ']')
+        {
+            if (--depth == 0)
+            {
+                result = pos + 1;
+            }
+        }
+        pos++;
+    }
+
+    return result;
+}
+
+int queryResponse_deserializeNextFromJson(char* json_page, size_t* offset_ptr, PROVISIONING_QUERY_TYPE type, void** record_ptr)
+{
+    int result;
+    FROM_JSON_FUNCTION fromJson;
+
+    if (json_page == NULL || offset_ptr == NULL || record_ptr == NULL)
+    {
+        LogError("Invalid parameter json_page: %p, offset_ptr: %p, record_ptr: %p", json_page, offset_ptr, record_ptr);
+        result = __FAILURE__;
+    }
+    else if ((fromJson = queryType_getFromJson(type)) == NULL)
+    {
+        LogError("Invalid query type");
+        result = __FAILURE__;
+    }
+    else
+    {
+        char* pos = skip_whitespace(json_page + *offset_ptr);
+        *record_ptr = NULL;
+        result = 0;
+
+        //find the start of the next element: the page opens with '[' and elements are separated by ','
+        if (*offset_ptr == 0)
+        {
+            if (*pos == '[')
+            {
+                pos = skip_whitespace(pos + 1);
+            }
+            else if (*pos != '\0')
+            {
+                LogError("Query Response is not a JSON array");
+                result = __FAILURE__;
+            }
+        }
+        else if (*pos == ',')
+        {
+            pos = skip_whitespace(pos + 1);
+        }
+        else if (*pos != ']')
+        {
+            LogError("Malformed Query Response");
+            result = __FAILURE__;
+        }
+
+        if (result != 0)
+        {
+            //error already logged
+        }
+        else if (*pos == ']' || *pos == '\0')
+        {
+            //end of the page, stay on it so that further calls keep reporting the end
+            *offset_ptr = pos - json_page;
+        }
+        else
+        {
+            char* obj_end;
+            if (*pos != '{' || (obj_end = find_object_end(pos)) == NULL)
+            {
+                LogError("Malformed Query Response element");
+                result = __FAILURE__;
+            }
+            else
+            {
+                //parse this element alone by terminating it in place
+                char saved_char = *obj_end;
+                JSON_Value* root_value;
+                JSON_Object* root_object;
+
+                *obj_end = '\0';
+                root_value = json_parse_string(pos);
+                *obj_end = saved_char;
+
+                if (root_value == NULL)
+                {
+                    LogError("Parsing Query Response element failed");
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    if ((root_object = json_value_get_object(root_value)) == NULL)
+                    {
+                        LogError("Creating JSON object failed");
+                        result = __FAILURE__;
+                    }
+                    else if ((*record_ptr = fromJson(root_object)) == NULL)
+                    {
+                        LogError("Failed to deserialize Query Response element");
+                        result = __FAILURE__;
+                    }
+                    else
+                    {
+                        *offset_ptr = obj_end - json_page;
+                    }
+                    json_value_free(root_value);
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
 PROVISIONING_QUERY_TYPE queryType_stringToEnum(const char* string)
 {
     PROVISIONING_QUERY_TYPE result;
@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stdbool.h>
 
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
@@ -14,6 +15,8 @@
 #include "azure_c_shared_utility/connection_string_parser.h"
 #include "azure_c_shared_utility/tlsio.h"
 #include "azure_c_shared_utility/http_proxy_io.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 #include "azure_uhttp_c/uhttp.h"
 
@@ -32,6 +35,9 @@ typedef enum HTTP_CONNECTION_STATE_TAG
     HTTP_STATE_ERROR
 } HTTP_CONNECTION_STATE;
 
+#define PROV_SC_DOWORK_SLEEP_MS         10
+#define PROV_SC_RESPONSE_TIMEOUT_MS     (60 * 1000)
+
 //consider substructure representing SharedAccessSignature?
 typedef struct PROVISIONING_SERVICE_CLIENT_TAG
 {
@@ -67,6 +73,79 @@ typedef struct HANDLE_FUNCTION_VECTOR_TAG
     VECTOR_DESTROY destroy;
 } HANDLE_FUNCTION_VECTOR;
 
+typedef struct PROVISIONING_QUERY_ITERATOR_TAG
+{
+    PROV_SERVICE_CLIENT* prov_client;
+    PROVISIONING_QUERY_TYPE query_type;
+
+    //Query details, sent again with every page request
+    STRING_HANDLE registration_path;
+    char* content;
+    size_t page_size;
+    char* cont_token;
+
+    //Connection data, kept open across pages
+    HTTP_CLIENT_HANDLE http_client;
+    HTTP_CONNECTION_STATE http_state;
+    bool request_pending;
+    bool more_pages;
+    char* response;
+    char* response_cont_token;
+    PROVISIONING_QUERY_TYPE response_type;
+
+    //Page being read and page prefetched while it is read
+    char* page;
+    size_t page_offset;
+    PROVISIONING_QUERY_TYPE page_type;
+    char* next_page;
+    PROVISIONING_QUERY_TYPE next_page_type;
+
+    //Bounds the wait for a page
+    TICK_COUNTER_HANDLE tick_counter;
+
+    PROVISIONING_QUERY_RECORD record;
+} PROV_SC_QUERY_ITERATOR;
+
+typedef struct BULK_IMPORT_CONNECTION_TAG
+{
+    HTTP_CLIENT_HANDLE http_client;
+    HTTP_CONNECTION_STATE http_state;
+
+    //Chunk sent on this connection
+    char* content;
+    char** registration_ids;
+    size_t num_registration_ids;
+    tickcounter_ms_t dispatch_time;
+
+    //Reply to the chunk
+    char* response;
+    unsigned int status_code;
+} BULK_IMPORT_CONNECTION;
+
+typedef struct PROVISIONING_BULK_IMPORTER_TAG
+{
+    PROV_SERVICE_CLIENT* prov_client;
+    PROVISIONING_BULK_OPERATION_MODE mode;
+    STRING_HANDLE registration_path;
+
+    //Chunk being filled
+    INDIVIDUAL_ENROLLMENT_HANDLE* chunk;
+    size_t chunk_size;
+    size_t chunk_count;
+
+    //Chunks in flight, one per connection
+    BULK_IMPORT_CONNECTION* connections;
+    size_t num_connections;
+    TICK_COUNTER_HANDLE tick_counter;
+
+    //Merged report
+    bool is_successful;
+    bool report_failed;
+    PROVISIONING_BULK_OPERATION_ERROR** errors;
+    size_t num_errors;
+    size_t errors_capacity;
+} PROV_SC_BULK_IMPORTER;
+
 static const char* const IOTHUBHOSTNAME =                       "HostName";
 static const char* const IOTHUBSHAREDACESSKEYNAME =             "SharedAccessKeyName";
 static const char* const IOTHUBSHAREDACESSKEY =                 "SharedAccessKey";
@@ -90,6 +169,7 @@ static const char* const HEADER_KEY_ITEM_TYPE =                 "x-ms-item-type"
 static const char* const HEADER_VALUE_USER_AGENT =              "iothub_dps_prov_client/1.0";
 static const char* const HEADER_VALUE_ACCEPT =                  "application/json";
 static const char* const HEADER_VALUE_CONTENT_TYPE =            "application/json; charset=utf-8";
+static const char* const BULK_IMPORT_REQUEST_FAILED =           "Bulk operation request failed";
 
 #define DEFAULT_HTTPS_PORT          443
 #define UID_LENGTH                  37
@@ -359,7 +439,7 @@ static int get_response_headers(PROV_SERVICE_CLIENT* prov_client, char** cont_to
     return result;
 }
 
-static HTTP_CLIENT_HANDLE connect_to_service(PROV_SERVICE_CLIENT* prov_client)
+static HTTP_CLIENT_HANDLE connect_to_service(PROV_SERVICE_CLIENT* prov_client, ON_HTTP_ERROR_CALLBACK on_error, ON_HTTP_OPEN_COMPLETE_CALLBACK on_connected, void* callback_ctx)
 {
     HTTP_CLIENT_HANDLE result;
 
@@ -391,7 +471,7 @@ static HTTP_CLIENT_HANDLE connect_to_service(PROV_SERVICE_CLIENT* prov_client)
         LogError("platform default tlsio is NULL");
         result = NULL;
     }
-    else if ((result = uhttp_client_create(interface_desc, &tls_io_config, on_http_error, prov_client)) == NULL)
+    else if ((result = uhttp_client_create(interface_desc, &tls_io_config, on_error, callback_ctx)) == NULL)
     {
         LogError("Failed creating http object");
     }
@@ -407,7 +487,7 @@ static HTTP_CLIENT_HANDLE connect_to_service(PROV_SERVICE_CLIENT* prov_client)
         uhttp_client_destroy(result);
         result = NULL;
     }
-    else if (uhttp_client_open(result, prov_client->provisioning_service_uri, DEFAULT_HTTPS_PORT, on_http_connected, prov_client) != HTTP_CLIENT_OK)
+    else if (uhttp_client_open(result, prov_client->provisioning_service_uri, DEFAULT_HTTPS_PORT, on_connected, callback_ctx) != HTTP_CLIENT_OK)
     {
         LogError("Failed opening http url %s", prov_client->provisioning_service_uri);
         uhttp_client_destroy(result);
@@ -431,7 +511,7 @@ static int rest_call(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, HTTP_CLIENT
         content_len = strlen(content);
     }
 
-    http_client = connect_to_service(prov_client);
+    http_client = connect_to_service(prov_client, on_http_error, on_http_connected, prov_client);
     if (http_client == NULL)
     {
         LogError("Failed connecting to service");
@@ -838,218 +918,831 @@ static int prov_sc_query_records(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client,
     return result;
 }
 
-//Exposed functions below
+static const char* get_query_path_format(PROVISIONING_QUERY_TYPE type)
+{
+    const char* result;
 
-void prov_sc_destroy(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client)
+    if (type == QUERY_TYPE_INDIVIDUAL_ENROLLMENT)
+    {
+        result = INDV_ENROLL_QUERY_PATH_FMT;
+    }
+    else if (type == QUERY_TYPE_ENROLLMENT_GROUP)
+    {
+        result = ENROLL_GROUP_QUERY_PATH_FMT;
+    }
+    else if (type == QUERY_TYPE_DEVICE_REGISTRATION_STATE)
+    {
+        result = REG_STATE_QUERY_PATH_FMT;
+    }
+    else
+    {
+        result = NULL;
+    }
+
+    return result;
+}
+
+static void query_record_set(PROVISIONING_QUERY_RECORD* record, PROVISIONING_QUERY_TYPE type, void* handle)
 {
-    if (prov_client != NULL)
+    record->type = type;
+    if (type == QUERY_TYPE_INDIVIDUAL_ENROLLMENT)
     {
-        free(prov_client->provisioning_service_uri);
-        free(prov_client->key_name);
-        free(prov_client->access_key);
-        free(prov_client->response);
-        HTTPHeaders_Free(prov_client->response_headers);
-        free(prov_client->certificate);
-        free(prov_client);
+        record->handle.ie = (INDIVIDUAL_ENROLLMENT_HANDLE)handle;
+    }
+    else if (type == QUERY_TYPE_ENROLLMENT_GROUP)
+    {
+        record->handle.eg = (ENROLLMENT_GROUP_HANDLE)handle;
+    }
+    else
+    {
+        record->handle.drs = (DEVICE_REGISTRATION_STATE_HANDLE)handle;
     }
 }
 
-PROVISIONING_SERVICE_CLIENT_HANDLE prov_sc_create_from_connection_string(const char* conn_string)
+static void query_record_clear(PROVISIONING_QUERY_RECORD* record)
 {
-    PROV_SERVICE_CLIENT* result;
+    if (record->type == QUERY_TYPE_INDIVIDUAL_ENROLLMENT)
+    {
+        individualEnrollment_destroy(record->handle.ie);
+    }
+    else if (record->type == QUERY_TYPE_ENROLLMENT_GROUP)
+    {
+        enrollmentGroup_destroy(record->handle.eg);
+    }
+    else if (record->type == QUERY_TYPE_DEVICE_REGISTRATION_STATE)
+    {
+        deviceRegistrationState_destroy(record->handle.drs);
+    }
+    memset(record, 0, sizeof(PROVISIONING_QUERY_RECORD));
+}
 
-    if (conn_string == NULL)
+static void on_query_http_connected(void* callback_ctx, HTTP_CALLBACK_REASON connect_result)
+{
+    if (callback_ctx != NULL)
     {
-        LogError("Input parameter is NULL: conn_string");
-        result = NULL;
+        PROV_SC_QUERY_ITERATOR* iterator = (PROV_SC_QUERY_ITERATOR*)callback_ctx;
+        if (connect_result == HTTP_CALLBACK_REASON_OK)
+        {
+            iterator->http_state = HTTP_STATE_CONNECTED;
+        }
+        else
+        {
+            iterator->http_state = HTTP_STATE_ERROR;
+        }
+    }
+}
+
+static void on_query_http_error(void* callback_ctx, HTTP_CALLBACK_REASON error_result)
+{
+    LogError("Failure encountered in http %d", error_result);
+    if (callback_ctx != NULL)
+    {
+        PROV_SC_QUERY_ITERATOR* iterator = (PROV_SC_QUERY_ITERATOR*)callback_ctx;
+        iterator->http_state = HTTP_STATE_ERROR;
+    }
+}
+
+static void on_query_reply_recv(void* callback_ctx, HTTP_CALLBACK_REASON request_result, const unsigned char* content, size_t content_len, unsigned int status_code, HTTP_HEADERS_HANDLE responseHeadersHandle)
+{
+    if (callback_ctx == NULL)
+    {
+        LogError("Invalid callback context");
     }
     else
     {
-        STRING_HANDLE cs_string;
-        if ((cs_string = STRING_construct(conn_string)) == NULL)
+        PROV_SC_QUERY_ITERATOR* iterator = (PROV_SC_QUERY_ITERATOR*)callback_ctx;
+
+        if (request_result != HTTP_CALLBACK_REASON_OK || status_code < 200 || status_code > 299)
         {
-            LogError("STRING_construct failed");
-            result = NULL;
+            LogError("Query request failed, reason: %d, status code: %u", request_result, status_code);
+            iterator->http_state = HTTP_STATE_ERROR;
+        }
+        else if (responseHeadersHandle == NULL)
+        {
+            LogError("Unable to retrieve headers");
+            iterator->http_state = HTTP_STATE_ERROR;
         }
         else
         {
-            MAP_HANDLE connection_string_values_map;
-            if ((connection_string_values_map = connectionstringparser_parse(cs_string)) == NULL)
+            const char* cont_token = HTTPHeaders_FindHeaderValue(responseHeadersHandle, HEADER_KEY_CONTINUATION);
+            const char* resp_type = HTTPHeaders_FindHeaderValue(responseHeadersHandle, HEADER_KEY_ITEM_TYPE);
+
+            //the page is kept as received; its records are parsed one at a time by prov_sc_query_iterator_next
+            if ((iterator->response_type = queryType_stringToEnum(resp_type)) == QUERY_TYPE_INVALID)
             {
-                LogError("Tokenizing conn_string failed");
-                result = NULL;
+                LogError("Failure to parse response type");
+                iterator->http_state = HTTP_STATE_ERROR;
+            }
+            else if ((iterator->response = malloc(content_len + 1)) == NULL)
+            {
+                LogError("Allocating response failed");
+                iterator->http_state = HTTP_STATE_ERROR;
             }
             else
             {
-                const char* hostname = NULL;
-                const char* key_name = NULL;
-                const char* key = NULL;
-
-                if ((hostname = Map_GetValueFromKey(connection_string_values_map, IOTHUBHOSTNAME)) == NULL)
-                {
-                    LogError("Couldn't find %s in conn_string", IOTHUBHOSTNAME);
-                    result = NULL;
-                }
-                else if ((key_name = Map_GetValueFromKey(connection_string_values_map, IOTHUBSHAREDACESSKEYNAME)) == NULL)
-                {
-                    LogError("Couldn't find %s in conn_string", IOTHUBSHAREDACESSKEYNAME);
-                    result = NULL;
-                }
-                else if ((key = Map_GetValueFromKey(connection_string_values_map, IOTHUBSHAREDACESSKEY)) == NULL)
-                {
-                    LogError("Couldn't find %s in conn_string", IOTHUBSHAREDACESSKEY);
-                    result = NULL;
-                }
-                if (hostname == NULL || key_name == NULL || key == NULL)
+                if (content != NULL && content_len > 0)
                 {
-                    LogError("invalid parameter hostname: %p, key_name: %p, key: %p", hostname, key_name, key);
-                    result = NULL;
+                    memcpy(iterator->response, content, content_len);
                 }
-                else if ((result = malloc(sizeof(PROV_SERVICE_CLIENT))) == NULL)
+                iterator->response[content_len] = '\0';
+
+                if (cont_token != NULL && mallocAndStrcpy_s(&iterator->response_cont_token, cont_token) != 0)
                 {
-                    LogError("Allocation of provisioning service client failed");
-                    result = NULL;
+                    LogError("Failed to copy continuation token");
+                    free(iterator->response);
+                    iterator->response = NULL;
+                    iterator->http_state = HTTP_STATE_ERROR;
                 }
                 else
                 {
-                    memset(result, 0, sizeof(PROV_SERVICE_CLIENT));
-                    if (mallocAndStrcpy_s(&result->provisioning_service_uri, hostname) != 0)
-                    {
-                        LogError("Failure allocating of provisioning service uri");
-                        prov_sc_destroy(result);
-                        result = NULL;
-                    }
-                    else if (mallocAndStrcpy_s(&result->key_name, key_name) != 0)
-                    {
-                        LogError("Failure allocating of keyname");
-                        prov_sc_destroy(result);
-                        result = NULL;
-                    }
-                    else if (mallocAndStrcpy_s(&result->access_key, key) != 0)
-                    {
-                        LogError("Failure allocating of access key");
-                        prov_sc_destroy(result);
-                        result = NULL;
-                    }
-                    else
-                    {
-                        result->tracing = TRACING_STATUS_OFF;
-                    }
+                    iterator->http_state = HTTP_STATE_REQUEST_RECV;
                 }
-                Map_Destroy(connection_string_values_map);
             }
         }
-        STRING_delete(cs_string);
-    }
-    return result;
-}
-
-void prov_sc_set_trace(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, TRACING_STATUS status)
-{
-    if (prov_client != NULL)
-    {
-        prov_client->tracing = status;
-    }
-}
-
-int prov_sc_set_certificate(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, const char* certificate)
-{
-    int result = 0;
-
-    if (prov_client == NULL)
-    {
-        LogError("Invalid prov_client");
-        result = __FAILURE__;
-    }
-    else if (certificate == NULL)
-    {
-        free(prov_client->certificate);
-        prov_client->certificate = NULL;
-    }
-    else if (mallocAndStrcpy_overwrite(&prov_client->certificate, (char*)certificate) != 0)
-    {
-        LogError("Failed allocating memory for certificate");
-        result = __FAILURE__;
     }
-
-    return result;
 }
 
-int prov_sc_set_proxy(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, HTTP_PROXY_OPTIONS* proxy_options)
+static int query_iterator_send_request(PROV_SC_QUERY_ITERATOR* iterator)
 {
-    int result = 0;
+    int result;
+    HTTP_HEADERS_HANDLE request_headers;
 
-    if (prov_client == NULL)
-    {
-        LogError("Invalid prov_client");
-        result = __FAILURE__;
-    }
-    else if (proxy_options == NULL)
+    if ((request_headers = construct_http_headers(iterator->prov_client, NULL, HTTP_CLIENT_REQUEST_POST)) == NULL)
     {
-        LogError("Invalid proxy options");
+        LogError("Failure constructing http headers");
         result = __FAILURE__;
     }
     else
     {
-        if (proxy_options->host_address == NULL)
+        size_t content_len = (iterator->content == NULL) ? 0 : strlen(iterator->content);
+
+        if (add_query_headers(request_headers, iterator->page_size, iterator->cont_token) != 0)
         {
-            LogError("Null host address in proxy options");
+            LogError("Failure adding query headers");
             result = __FAILURE__;
         }
-        else if (((proxy_options->username == NULL) || (proxy_options->password == NULL))
-            && (proxy_options->username != proxy_options->password))
+        else if (uhttp_client_execute_request(iterator->http_client, HTTP_CLIENT_REQUEST_POST, STRING_c_str(iterator->registration_path), request_headers, (unsigned char*)iterator->content, content_len, on_query_reply_recv, iterator) != HTTP_CLIENT_OK)
         {
-            LogError("Only one of username and password for proxy settings was NULL");
+            LogError("Failure executing http request");
             result = __FAILURE__;
         }
         else
         {
-            prov_client->proxy_options = proxy_options;
+            result = 0;
         }
+        HTTPHeaders_Free(request_headers);
     }
 
     return result;
 }
 
-int prov_sc_create_or_update_individual_enrollment(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, INDIVIDUAL_ENROLLMENT_HANDLE* enrollment_ptr)
+static void query_iterator_promote_page(PROV_SC_QUERY_ITERATOR* iterator)
 {
-    return prov_sc_create_or_update_record(prov_client,(void**)enrollment_ptr, getVector_individualEnrollment(), INDV_ENROLL_PROVISION_PATH_FMT);
-}
+    if (iterator->page == NULL && iterator->next_page != NULL)
+    {
+        iterator->page = iterator->next_page;
+        iterator->page_type = iterator->next_page_type;
+        iterator->page_offset = 0;
+        iterator->next_page = NULL;
 
-int prov_sc_delete_individual_enrollment(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, INDIVIDUAL_ENROLLMENT_HANDLE enrollment)
-{
-    return prov_sc_delete_record_by_param(prov_client, individualEnrollment_getRegistrationId(enrollment), individualEnrollment_getEtag(enrollment), INDV_ENROLL_PROVISION_PATH_FMT);
+        //the prefetch slot is free again, so the following page can be requested right away
+        iterator->request_pending = iterator->more_pages;
+    }
 }
 
-int prov_sc_delete_individual_enrollment_by_param(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, const char* reg_id, const char* etag)
+static void query_iterator_dowork(PROV_SC_QUERY_ITERATOR* iterator)
 {
-    return prov_sc_delete_record_by_param(prov_client, reg_id, etag, INDV_ENROLL_PROVISION_PATH_FMT);
-}
+    uhttp_client_dowork(iterator->http_client);
 
-int prov_sc_get_individual_enrollment(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, const char* reg_id, INDIVIDUAL_ENROLLMENT_HANDLE* enrollment_ptr)
-{
-    return prov_sc_get_record(prov_client, reg_id, (void**)enrollment_ptr, getVector_individualEnrollment(), INDV_ENROLL_PROVISION_PATH_FMT);
+    if (iterator->http_state == HTTP_STATE_REQUEST_RECV)
+    {
+        free(iterator->cont_token);
+        iterator->cont_token = iterator->response_cont_token;
+        iterator->response_cont_token = NULL;
+        iterator->more_pages = (iterator->cont_token != NULL);
+
+        iterator->next_page = iterator->response;
+        iterator->next_page_type = iterator->response_type;
+        iterator->response = NULL;
+
+        //the connection is kept alive for the next page
+        iterator->http_state = HTTP_STATE_CONNECTED;
+        query_iterator_promote_page(iterator);
+    }
+
+    if (iterator->http_state == HTTP_STATE_CONNECTED && iterator->request_pending)
+    {
+        iterator->request_pending = false;
+        if (query_iterator_send_request(iterator) != 0)
+        {
+            iterator->http_state = HTTP_STATE_ERROR;
+        }
+        else
+        {
+            iterator->http_state = HTTP_STATE_REQUEST_SENT;
+        }
+    }
 }
 
-int prov_sc_query_individual_enrollment(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, PROVISIONING_QUERY_SPECIFICATION* query_spec, char** cont_token_ptr, PROVISIONING_QUERY_RESPONSE** query_resp_ptr)
+static void bulk_import_error_free(PROVISIONING_BULK_OPERATION_ERROR* error)
 {
-    return prov_sc_query_records(prov_client, query_spec, cont_token_ptr, query_resp_ptr, INDV_ENROLL_QUERY_PATH_FMT);
+    if (error != NULL)
+    {
+        free(error->registration_id);
+        free(error->error_status);
+        free(error);
+    }
 }
 
-int prov_sc_run_individual_enrollment_bulk_operation(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, PROVISIONING_BULK_OPERATION* bulk_op, PROVISIONING_BULK_OPERATION_RESULT** bulk_res_ptr)
+static void bulk_importer_append_error(PROV_SC_BULK_IMPORTER* importer, PROVISIONING_BULK_OPERATION_ERROR* error)
 {
-    return prov_sc_run_bulk_operation(prov_client, bulk_op, bulk_res_ptr, INDV_ENROLL_BULK_PATH_FMT);
+    importer->is_successful = false;
+
+    if (importer->num_errors == importer->errors_capacity)
+    {
+        size_t new_capacity = (importer->errors_capacity == 0) ? importer->chunk_size : importer->errors_capacity * 2;
+        PROVISIONING_BULK_OPERATION_ERROR** new_errors = realloc(importer->errors, new_capacity * sizeof(PROVISIONING_BULK_OPERATION_ERROR*));
+        if (new_errors == NULL)
+        {
+            LogError("Failed to grow the bulk operation report");
+        }
+        else
+        {
+            importer->errors = new_errors;
+            importer->errors_capacity = new_capacity;
+        }
+    }
+
+    if (importer->num_errors < importer->errors_capacity)
+    {
+        importer->errors[importer->num_errors++] = error;
+    }
+    else
+    {
+        bulk_import_error_free(error);
+        importer->report_failed = true;
+    }
 }
 
-int prov_sc_delete_device_registration_state(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, DEVICE_REGISTRATION_STATE_HANDLE reg_state)
+static void bulk_import_connection_clear_chunk(BULK_IMPORT_CONNECTION* connection)
 {
-    return prov_sc_delete_record_by_param(prov_client, deviceRegistrationState_getRegistrationId(reg_state), deviceRegistrationState_getEtag(reg_state), REG_STATE_PROVISION_PATH_FMT);
+    size_t i;
+
+    for (i = 0; i < connection->num_registration_ids; i++)
+    {
+        free(connection->registration_ids[i]);
+    }
+    free(connection->registration_ids);
+    connection->registration_ids = NULL;
+    connection->num_registration_ids = 0;
+    free(connection->content);
+    connection->content = NULL;
+    free(connection->response);
+    connection->response = NULL;
+    connection->status_code = 0;
 }
 
-int prov_sc_delete_device_registration_state_by_param(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, const char* reg_id, const char* etag)
+//reports every enrollment of the chunk held by connection as failed, with the status code of the request (0 if it was not answered)
+static void bulk_importer_merge_chunk_failure(PROV_SC_BULK_IMPORTER* importer, BULK_IMPORT_CONNECTION* connection)
 {
-    return prov_sc_delete_record_by_param(prov_client, reg_id, etag, REG_STATE_PROVISION_PATH_FMT);
-}
+    size_t i;
+
+    importer->is_successful = false;
+    for (i = 0; i < connection->num_registration_ids; i++)
+    {
+        PROVISIONING_BULK_OPERATION_ERROR* error;
+        if ((error = malloc(sizeof(PROVISIONING_BULK_OPERATION_ERROR))) == NULL)
+        {
+            LogError("Allocation of Bulk Operation Error failed");
+            importer->report_failed = true;
+        }
+        else
+        {
+            memset(error, 0, sizeof(PROVISIONING_BULK_OPERATION_ERROR));
+            error->error_code = (int32_t)connection->status_code;
+            error->registration_id = connection->registration_ids[i];
+            connection->registration_ids[i] = NULL;
+
+            if (mallocAndStrcpy_s(&error->error_status, (connection->response != NULL && connection->response[0] != '\0') ? connection->response : BULK_IMPORT_REQUEST_FAILED) != 0)
+            {
+                LogError("Failed to copy error status");
+                bulk_import_error_free(error);
+                importer->report_failed = true;
+            }
+            else
+            {
+                bulk_importer_append_error(importer, error);
+            }
+        }
+    }
+}
+
+static void bulk_importer_merge_response(PROV_SC_BULK_IMPORTER* importer, BULK_IMPORT_CONNECTION* connection)
+{
+    if (connection->status_code < 200 || connection->status_code > 299)
+    {
+        LogError("Bulk operation request failed with status code %u", connection->status_code);
+        bulk_importer_merge_chunk_failure(importer, connection);
+    }
+    else
+    {
+        PROVISIONING_BULK_OPERATION_RESULT* bulk_res;
+        if ((bulk_res = bulkOperationResult_deserializeFromJson(connection->response)) == NULL)
+        {
+            LogError("Failure deserializing bulk operation result");
+            bulk_importer_merge_chunk_failure(importer, connection);
+        }
+        else
+        {
+            size_t i;
+
+            if (!bulk_res->is_successful)
+            {
+                importer->is_successful = false;
+            }
+
+            //the errors move to the merged report
+            for (i = 0; i < bulk_res->num_errors; i++)
+            {
+                bulk_importer_append_error(importer, bulk_res->errors[i]);
+            }
+            free(bulk_res->errors);
+            bulk_res->errors = NULL;
+            bulk_res->num_errors = 0;
+            bulkOperationResult_free(bulk_res);
+        }
+    }
+}
+
+static void on_bulk_import_http_connected(void* callback_ctx, HTTP_CALLBACK_REASON connect_result)
+{
+    if (callback_ctx != NULL)
+    {
+        BULK_IMPORT_CONNECTION* connection = (BULK_IMPORT_CONNECTION*)callback_ctx;
+        if (connect_result == HTTP_CALLBACK_REASON_OK)
+        {
+            connection->http_state = HTTP_STATE_CONNECTED;
+        }
+        else
+        {
+            connection->http_state = HTTP_STATE_ERROR;
+        }
+    }
+}
+
+static void on_bulk_import_http_error(void* callback_ctx, HTTP_CALLBACK_REASON error_result)
+{
+    LogError("Failure encountered in http %d", error_result);
+    if (callback_ctx != NULL)
+    {
+        BULK_IMPORT_CONNECTION* connection = (BULK_IMPORT_CONNECTION*)callback_ctx;
+        connection->http_state = HTTP_STATE_ERROR;
+    }
+}
+
+static void on_bulk_import_reply_recv(void* callback_ctx, HTTP_CALLBACK_REASON request_result, const unsigned char* content, size_t content_len, unsigned int status_code, HTTP_HEADERS_HANDLE responseHeadersHandle)
+{
+    (void)responseHeadersHandle;
+    if (callback_ctx == NULL)
+    {
+        LogError("Invalid callback context");
+    }
+    else
+    {
+        BULK_IMPORT_CONNECTION* connection = (BULK_IMPORT_CONNECTION*)callback_ctx;
+
+        if (request_result != HTTP_CALLBACK_REASON_OK)
+        {
+            LogError("Bulk operation request failed, reason: %d", request_result);
+            connection->http_state = HTTP_STATE_ERROR;
+        }
+        else if ((connection->response = malloc(content_len + 1)) == NULL)
+        {
+            LogError("Allocating response failed");
+            connection->http_state = HTTP_STATE_ERROR;
+        }
+        else
+        {
+            if (content != NULL && content_len > 0)
+            {
+                memcpy(connection->response, content, content_len);
+            }
+            connection->response[content_len] = '\0';
+            connection->status_code = status_code;
+            connection->http_state = HTTP_STATE_REQUEST_RECV;
+        }
+    }
+}
+
+static int bulk_import_connection_send_chunk(PROV_SC_BULK_IMPORTER* importer, BULK_IMPORT_CONNECTION* connection)
+{
+    int result;
+    HTTP_HEADERS_HANDLE request_headers;
+
+    if ((request_headers = construct_http_headers(importer->prov_client, NULL, HTTP_CLIENT_REQUEST_POST)) == NULL)
+    {
+        LogError("Failure constructing http headers");
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (uhttp_client_execute_request(connection->http_client, HTTP_CLIENT_REQUEST_POST, STRING_c_str(importer->registration_path), request_headers, (unsigned char*)connection->content, strlen(connection->content), on_bulk_import_reply_recv, connection) != HTTP_CLIENT_OK)
+        {
+            LogError("Failure executing http request");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+        HTTPHeaders_Free(request_headers);
+    }
+
+    return result;
+}
+
+static void bulk_import_connection_dowork(PROV_SC_BULK_IMPORTER* importer, BULK_IMPORT_CONNECTION* connection, bool check_deadline, tickcounter_ms_t now)
+{
+    if (connection->http_client != NULL)
+    {
+        uhttp_client_dowork(connection->http_client);
+
+        if (connection->http_state == HTTP_STATE_CONNECTED && connection->content != NULL)
+        {
+            if (bulk_import_connection_send_chunk(importer, connection) != 0)
+            {
+                connection->http_state = HTTP_STATE_ERROR;
+            }
+            else
+            {
+                connection->http_state = HTTP_STATE_REQUEST_SENT;
+            }
+        }
+        else if (connection->http_state == HTTP_STATE_REQUEST_RECV)
+        {
+            bulk_importer_merge_response(importer, connection);
+            bulk_import_connection_clear_chunk(connection);
+
+            //the connection is kept open for the next chunk
+            connection->http_state = HTTP_STATE_CONNECTED;
+        }
+
+        if (check_deadline && connection->content != NULL && connection->http_state != HTTP_STATE_ERROR &&
+            now - connection->dispatch_time >= PROV_SC_RESPONSE_TIMEOUT_MS)
+        {
+            LogError("Timed out waiting for the reply to a bulk operation chunk");
+            connection->http_state = HTTP_STATE_ERROR;
+        }
+
+        if (connection->http_state == HTTP_STATE_ERROR)
+        {
+            if (connection->content != NULL)
+            {
+                bulk_importer_merge_chunk_failure(importer, connection);
+                bulk_import_connection_clear_chunk(connection);
+            }
+
+            //a new connection is opened for the next chunk
+            uhttp_client_close(connection->http_client, NULL, NULL);
+            uhttp_client_destroy(connection->http_client);
+            connection->http_client = NULL;
+            connection->http_state = HTTP_STATE_DISCONNECTED;
+        }
+    }
+}
+
+static void bulk_importer_dowork(PROV_SC_BULK_IMPORTER* importer)
+{
+    size_t i;
+    tickcounter_ms_t now = 0;
+    bool check_deadline = true;
+
+    if (tickcounter_get_current_ms(importer->tick_counter, &now) != 0)
+    {
+        LogError("Failure getting the current time, chunk deadlines are not checked");
+        check_deadline = false;
+    }
+    for (i = 0; i < importer->num_connections; i++)
+    {
+        bulk_import_connection_dowork(importer, &importer->connections[i], check_deadline, now);
+    }
+}
+
+static BULK_IMPORT_CONNECTION* bulk_importer_get_idle_connection(PROV_SC_BULK_IMPORTER* importer)
+{
+    BULK_IMPORT_CONNECTION* result = NULL;
+    size_t i;
+
+    for (i = 0; i < importer->num_connections && result == NULL; i++)
+    {
+        if (importer->connections[i].content == NULL)
+        {
+            result = &importer->connections[i];
+        }
+    }
+    return result;
+}
+
+static bool bulk_importer_is_busy(PROV_SC_BULK_IMPORTER* importer)
+{
+    return importer->num_connections > 0 && bulk_importer_get_idle_connection(importer) == NULL;
+}
+
+static bool bulk_importer_has_chunks_in_flight(PROV_SC_BULK_IMPORTER* importer)
+{
+    bool result = false;
+    size_t i;
+
+    for (i = 0; i < importer->num_connections && !result; i++)
+    {
+        result = (importer->connections[i].content != NULL);
+    }
+    return result;
+}
+
+//serializes the chunk being filled and hands it to an idle connection, waiting for one if they are all busy
+static void bulk_importer_dispatch_chunk(PROV_SC_BULK_IMPORTER* importer)
+{
+    BULK_IMPORT_CONNECTION* connection;
+    PROVISIONING_BULK_OPERATION bulk_op;
+    size_t i;
+
+    while (bulk_importer_is_busy(importer))
+    {
+        ThreadAPI_Sleep(PROV_SC_DOWORK_SLEEP_MS);
+        bulk_importer_dowork(importer);
+    }
+    connection = bulk_importer_get_idle_connection(importer);
+
+    if ((connection->registration_ids = malloc(importer->chunk_count * sizeof(char*))) == NULL)
+    {
+        LogError("Allocation of registration ids failed");
+        importer->report_failed = true;
+    }
+    else
+    {
+        connection->num_registration_ids = importer->chunk_count;
+        for (i = 0; i < importer->chunk_count; i++)
+        {
+            if (mallocAndStrcpy_s(&connection->registration_ids[i], individualEnrollment_getRegistrationId(importer->chunk[i])) != 0)
+            {
+                LogError("Failed to copy registration id");
+                connection->registration_ids[i] = NULL;
+                importer->report_failed = true;
+            }
+        }
+    }
+
+    memset(&bulk_op, 0, sizeof(PROVISIONING_BULK_OPERATION));
+    bulk_op.version = PROVISIONING_BULK_OPERATION_VERSION_1;
+    bulk_op.mode = importer->mode;
+    bulk_op.type = BULK_OP_INDIVIDUAL_ENROLLMENT;
+    bulk_op.enrollments.ie = importer->chunk;
+    bulk_op.num_enrollments = importer->chunk_count;
+
+    if ((connection->content = bulkOperation_serializeToJson(&bulk_op)) == NULL)
+    {
+        LogError("Failure serializing bulk operation");
+        bulk_importer_merge_chunk_failure(importer, connection);
+        bulk_import_connection_clear_chunk(connection);
+    }
+    else if (tickcounter_get_current_ms(importer->tick_counter, &connection->dispatch_time) != 0)
+    {
+        LogError("Failure getting the current time");
+        bulk_importer_merge_chunk_failure(importer, connection);
+        bulk_import_connection_clear_chunk(connection);
+    }
+    else if (connection->http_client == NULL && (connection->http_client = connect_to_service(importer->prov_client, on_bulk_import_http_error, on_bulk_import_http_connected, connection)) == NULL)
+    {
+        LogError("Failed connecting to service");
+        bulk_importer_merge_chunk_failure(importer, connection);
+        bulk_import_connection_clear_chunk(connection);
+    }
+    else if (connection->http_state == HTTP_STATE_DISCONNECTED)
+    {
+        connection->http_state = HTTP_STATE_CONNECTING;
+    }
+
+    //the enrollments are not needed anymore once serialized
+    for (i = 0; i < importer->chunk_count; i++)
+    {
+        individualEnrollment_destroy(importer->chunk[i]);
+    }
+    importer->chunk_count = 0;
+}
+
+//Exposed functions below
+
+void prov_sc_destroy(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client)
+{
+    if (prov_client != NULL)
+    {
+        free(prov_client->provisioning_service_uri);
+        free(prov_client->key_name);
+        free(prov_client->access_key);
+        free(prov_client->response);
+        HTTPHeaders_Free(prov_client->response_headers);
+        free(prov_client->certificate);
+        free(prov_client);
+    }
+}
+
+PROVISIONING_SERVICE_CLIENT_HANDLE prov_sc_create_from_connection_string(const char* conn_string)
+{
+    PROV_SERVICE_CLIENT* result;
+
+    if (conn_string == NULL)
+    {
+        LogError("Input parameter is NULL: conn_string");
+        result = NULL;
+    }
+    else
+    {
+        STRING_HANDLE cs_string;
+        if ((cs_string = STRING_construct(conn_string)) == NULL)
+        {
+            LogError("STRING_construct failed");
+            result = NULL;
+        }
+        else
+        {
+            MAP_HANDLE connection_string_values_map;
+            if ((connection_string_values_map = connectionstringparser_parse(cs_string)) == NULL)
+            {
+                LogError("Tokenizing conn_string failed");
+                result = NULL;
+            }
+            else
+            {
+                const char* hostname = NULL;
+                const char* key_name = NULL;
+                const char* key = NULL;
+
+                if ((hostname = Map_GetValueFromKey(connection_string_values_map, IOTHUBHOSTNAME)) == NULL)
+                {
+                    LogError("Couldn't find %s in conn_string", IOTHUBHOSTNAME);
+                    result = NULL;
+                }
+                else if ((key_name = Map_GetValueFromKey(connection_string_values_map, IOTHUBSHAREDACESSKEYNAME)) == NULL)
+                {
+                    LogError("Couldn't find %s in conn_string", IOTHUBSHAREDACESSKEYNAME);
+                    result = NULL;
+                }
+                else if ((key = Map_GetValueFromKey(connection_string_values_map, IOTHUBSHAREDACESSKEY)) == NULL)
+                {
+                    LogError("Couldn't find %s in conn_string", IOTHUBSHAREDACESSKEY);
+                    result = NULL;
+                }
+                if (hostname == NULL || key_name == NULL || key == NULL)
+                {
+                    LogError("invalid parameter hostname: %p, key_name: %p, key: %p", hostname, key_name, key);
+                    result = NULL;
+                }
+                else if ((result = malloc(sizeof(PROV_SERVICE_CLIENT))) == NULL)
+                {
+                    LogError("Allocation of provisioning service client failed");
+                    result = NULL;
+                }
+                else
+                {
+                    memset(result, 0, sizeof(PROV_SERVICE_CLIENT));
+                    if (mallocAndStrcpy_s(&result->provisioning_service_uri, hostname) != 0)
+                    {
+                        LogError("Failure allocating of provisioning service uri");
+                        prov_sc_destroy(result);
+                        result = NULL;
+                    }
+                    else if (mallocAndStrcpy_s(&result->key_name, key_name) != 0)
+                    {
+                        LogError("Failure allocating of keyname");
+                        prov_sc_destroy(result);
+                        result = NULL;
+                    }
+                    else if (mallocAndStrcpy_s(&result->access_key, key) != 0)
+                    {
+                        LogError("Failure allocating of access key");
+                        prov_sc_destroy(result);
+                        result = NULL;
+                    }
+                    else
+                    {
+                        result->tracing = TRACING_STATUS_OFF;
+                    }
+                }
+                Map_Destroy(connection_string_values_map);
+            }
+        }
+        STRING_delete(cs_string);
+    }
+    return result;
+}
+
+void prov_sc_set_trace(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, TRACING_STATUS status)
+{
+    if (prov_client != NULL)
+    {
+        prov_client->tracing = status;
+    }
+}
+
+int prov_sc_set_certificate(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, const char* certificate)
+{
+    int result = 0;
+
+    if (prov_client == NULL)
+    {
+        LogError("Invalid prov_client");
+        result = __FAILURE__;
+    }
+    else if (certificate == NULL)
+    {
+        free(prov_client->certificate);
+        prov_client->certificate = NULL;
+    }
+    else if (mallocAndStrcpy_overwrite(&prov_client->certificate, (char*)certificate) != 0)
+    {
+        LogError("Failed allocating memory for certificate");
+        result = __FAILURE__;
+    }
+
+    return result;
+}
+
+int prov_sc_set_proxy(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, HTTP_PROXY_OPTIONS* proxy_options)
+{
+    int result = 0;
+
+    if (prov_client == NULL)
+    {
+        LogError("Invalid prov_client");
+        result = __FAILURE__;
+    }
+    else if (proxy_options == NULL)
+    {
+        LogError("Invalid proxy options");
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (proxy_options->host_address == NULL)
+        {
+            LogError("Null host address in proxy options");
+            result = __FAILURE__;
+        }
+        else if (((proxy_options->username == NULL) || (proxy_options->password == NULL))
+            && (proxy_options->username != proxy_options->password))
+        {
+            LogError("Only one of username and password for proxy settings was NULL");
+            result = __FAILURE__;
+        }
+        else
+        {
+            prov_client->proxy_options = proxy_options;
+        }
+    }
+
+    return result;
+}
+
+int prov_sc_create_or_update_individual_enrollment(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, INDIVIDUAL_ENROLLMENT_HANDLE* enrollment_ptr)
+{
+    return prov_sc_create_or_update_record(prov_client,(void**)enrollment_ptr, getVector_individualEnrollment(), INDV_ENROLL_PROVISION_PATH_FMT);
+}
+
+int prov_sc_delete_individual_enrollment(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, INDIVIDUAL_ENROLLMENT_HANDLE enrollment)
+{
+    return prov_sc_delete_record_by_param(prov_client, individualEnrollment_getRegistrationId(enrollment), individualEnrollment_getEtag(enrollment), INDV_ENROLL_PROVISION_PATH_FMT);
+}
+
+int prov_sc_delete_individual_enrollment_by_param(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, const char* reg_id, const char* etag)
+{
+    return prov_sc_delete_record_by_param(prov_client, reg_id, etag, INDV_ENROLL_PROVISION_PATH_FMT);
+}
+
+int prov_sc_get_individual_enrollment(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, const char* reg_id, INDIVIDUAL_ENROLLMENT_HANDLE* enrollment_ptr)
+{
+    return prov_sc_get_record(prov_client, reg_id, (void**)enrollment_ptr, getVector_individualEnrollment(), INDV_ENROLL_PROVISION_PATH_FMT);
+}
+
+int prov_sc_query_individual_enrollment(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, PROVISIONING_QUERY_SPECIFICATION* query_spec, char** cont_token_ptr, PROVISIONING_QUERY_RESPONSE** query_resp_ptr)
+{
+    return prov_sc_query_records(prov_client, query_spec, cont_token_ptr, query_resp_ptr, INDV_ENROLL_QUERY_PATH_FMT);
+}
+
+int prov_sc_run_individual_enrollment_bulk_operation(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, PROVISIONING_BULK_OPERATION* bulk_op, PROVISIONING_BULK_OPERATION_RESULT** bulk_res_ptr)
+{
+    return prov_sc_run_bulk_operation(prov_client, bulk_op, bulk_res_ptr, INDV_ENROLL_BULK_PATH_FMT);
+}
+
+int prov_sc_delete_device_registration_state(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, DEVICE_REGISTRATION_STATE_HANDLE reg_state)
+{
+    return prov_sc_delete_record_by_param(prov_client, deviceRegistrationState_getRegistrationId(reg_state), deviceRegistrationState_getEtag(reg_state), REG_STATE_PROVISION_PATH_FMT);
+}
+
+int prov_sc_delete_device_registration_state_by_param(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, const char* reg_id, const char* etag)
+{
+    return prov_sc_delete_record_by_param(prov_client, reg_id, etag, REG_STATE_PROVISION_PATH_FMT);
+}
 
 int prov_sc_get_device_registration_state(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, const char* reg_id, DEVICE_REGISTRATION_STATE_HANDLE* reg_state_ptr)
 {
@@ -1084,4 +1777,388 @@ int prov_sc_get_enrollment_group(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client,
 int prov_sc_query_enrollment_group(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, PROVISIONING_QUERY_SPECIFICATION* query_spec, char** cont_token_ptr, PROVISIONING_QUERY_RESPONSE** query_resp_ptr)
 {
     return prov_sc_query_records(prov_client, query_spec, cont_token_ptr, query_resp_ptr, ENROLL_GROUP_QUERY_PATH_FMT);
-}
\ No newline at end of file
+}
+
+PROVISIONING_QUERY_ITERATOR_HANDLE prov_sc_query_iterator_create(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, PROVISIONING_QUERY_TYPE query_type, const PROVISIONING_QUERY_SPECIFICATION* query_spec)
+{
+    PROV_SC_QUERY_ITERATOR* result;
+    const char* path_format;
+
+    if (prov_client == NULL)
+    {
+        LogError("Invalid Provisioning Client Handle");
+        result = NULL;
+    }
+    else if (query_spec == NULL || query_spec->version != PROVISIONING_QUERY_SPECIFICATION_VERSION_1)
+    {
+        LogError("Invalid Query details");
+        result = NULL;
+    }
+    else if ((path_format = get_query_path_format(query_type)) == NULL)
+    {
+        LogError("Invalid query type");
+        result = NULL;
+    }
+    else if (query_type == QUERY_TYPE_DEVICE_REGISTRATION_STATE && query_spec->registration_id == NULL)
+    {
+        LogError("Device registration state queries require a registration id");
+        result = NULL;
+    }
+    else if ((result = malloc(sizeof(PROV_SC_QUERY_ITERATOR))) == NULL)
+    {
+        LogError("Allocation of query iterator failed");
+    }
+    else
+    {
+        memset(result, 0, sizeof(PROV_SC_QUERY_ITERATOR));
+        result->prov_client = prov_client;
+        result->query_type = query_type;
+        result->page_size = query_spec->page_size;
+        result->http_state = HTTP_STATE_CONNECTING;
+        result->request_pending = true;
+        result->more_pages = true;
+
+        if ((result->tick_counter = tickcounter_create()) == NULL)
+        {
+            LogError("Failure creating tick counter");
+            prov_sc_query_iterator_destroy(result);
+            result = NULL;
+        }
+        //do not serialize the query specification if there is no query_string (i.e. DRS query)
+        else if ((query_spec->query_string != NULL) && ((result->content = querySpecification_serializeToJson(query_spec)) == NULL))
+        {
+            LogError("Failure serializing query specification");
+            prov_sc_query_iterator_destroy(result);
+            result = NULL;
+        }
+        else if ((result->registration_path = create_registration_path(path_format, (query_type == QUERY_TYPE_DEVICE_REGISTRATION_STATE) ? query_spec->registration_id : NULL)) == NULL)
+        {
+            LogError("Failed to construct a registration path");
+            prov_sc_query_iterator_destroy(result);
+            result = NULL;
+        }
+        else if ((result->http_client = connect_to_service(prov_client, on_query_http_error, on_query_http_connected, result)) == NULL)
+        {
+            LogError("Failed connecting to service");
+            prov_sc_query_iterator_destroy(result);
+            result = NULL;
+        }
+    }
+
+    return result;
+}
+
+int prov_sc_query_iterator_next(PROVISIONING_QUERY_ITERATOR_HANDLE iterator, PROVISIONING_QUERY_RECORD** record_ptr)
+{
+    int result;
+
+    if (iterator == NULL)
+    {
+        LogError("Invalid query iterator");
+        result = __FAILURE__;
+    }
+    else if (record_ptr == NULL)
+    {
+        LogError("Invalid record pointer");
+        result = __FAILURE__;
+    }
+    else
+    {
+        bool done = false;
+        bool is_waiting = false;
+        tickcounter_ms_t wait_start = 0;
+
+        //the record returned by the previous call is not valid anymore
+        query_record_clear(&iterator->record);
+        *record_ptr = NULL;
+        result = 0;
+
+        //pump the connection once so that the prefetch makes progress while the current page is read
+        query_iterator_dowork(iterator);
+
+        while (!done)
+        {
+            if (iterator->page != NULL)
+            {
+                void* handle;
+                if (queryResponse_deserializeNextFromJson(iterator->page, &iterator->page_offset, iterator->page_type, &handle) != 0)
+                {
+                    LogError("Failure deserializing query record");
+                    result = __FAILURE__;
+                    done = true;
+                }
+                else if (handle != NULL)
+                {
+                    query_record_set(&iterator->record, iterator->page_type, handle);
+                    *record_ptr = &iterator->record;
+                    done = true;
+                }
+                else
+                {
+                    free(iterator->page);
+                    iterator->page = NULL;
+                    query_iterator_promote_page(iterator);
+                }
+            }
+            else if (iterator->next_page == NULL && !iterator->more_pages)
+            {
+                //end of the query
+                done = true;
+            }
+            else if (iterator->http_state == HTTP_STATE_ERROR)
+            {
+                LogError("HTTP error");
+                result = __FAILURE__;
+                done = true;
+            }
+            else
+            {
+                //the current page is exhausted, wait for the next one
+                tickcounter_ms_t now;
+                if (tickcounter_get_current_ms(iterator->tick_counter, &now) != 0)
+                {
+                    LogError("Failure getting the current time");
+                    result = __FAILURE__;
+                    done = true;
+                }
+                else if (!is_waiting)
+                {
+                    is_waiting = true;
+                    wait_start = now;
+                }
+                else if (now - wait_start >= PROV_SC_RESPONSE_TIMEOUT_MS)
+                {
+                    LogError("Timed out waiting for the next page of the query");
+                    iterator->http_state = HTTP_STATE_ERROR;
+                    result = __FAILURE__;
+                    done = true;
+                }
+                else
+                {
+                    ThreadAPI_Sleep(PROV_SC_DOWORK_SLEEP_MS);
+                    query_iterator_dowork(iterator);
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+void prov_sc_query_iterator_destroy(PROVISIONING_QUERY_ITERATOR_HANDLE iterator)
+{
+    if (iterator != NULL)
+    {
+        query_record_clear(&iterator->record);
+        if (iterator->http_client != NULL)
+        {
+            uhttp_client_close(iterator->http_client, NULL, NULL);
+            uhttp_client_destroy(iterator->http_client);
+        }
+        STRING_delete(iterator->registration_path);
+        free(iterator->content);
+        free(iterator->cont_token);
+        free(iterator->response);
+        free(iterator->response_cont_token);
+        free(iterator->page);
+        free(iterator->next_page);
+        if (iterator->tick_counter != NULL)
+        {
+            tickcounter_destroy(iterator->tick_counter);
+        }
+        free(iterator);
+    }
+}
+
+PROVISIONING_BULK_IMPORTER_HANDLE prov_sc_bulk_importer_create(PROVISIONING_SERVICE_CLIENT_HANDLE prov_client, PROVISIONING_BULK_OPERATION_MODE mode, size_t chunk_size, size_t max_chunks_in_flight)
+{
+    PROV_SC_BULK_IMPORTER* result;
+
+    if (prov_client == NULL)
+    {
+        LogError("Invalid Provisioning Client Handle");
+        result = NULL;
+    }
+    else if (mode != BULK_OP_CREATE && mode != BULK_OP_UPDATE && mode != BULK_OP_UPDATE_IF_MATCH_ETAG && mode != BULK_OP_DELETE)
+    {
+        LogError("Invalid Bulk Op mode");
+        result = NULL;
+    }
+    else if ((result = malloc(sizeof(PROV_SC_BULK_IMPORTER))) == NULL)
+    {
+        LogError("Allocation of bulk importer failed");
+    }
+    else
+    {
+        memset(result, 0, sizeof(PROV_SC_BULK_IMPORTER));
+        result->prov_client = prov_client;
+        result->mode = mode;
+        result->chunk_size = (chunk_size == 0) ? PROVISIONING_BULK_IMPORTER_DEFAULT_CHUNK_SIZE : chunk_size;
+        result->is_successful = true;
+
+        if (max_chunks_in_flight == 0)
+        {
+            max_chunks_in_flight = PROVISIONING_BULK_IMPORTER_DEFAULT_CHUNKS_IN_FLIGHT;
+        }
+
+        if ((result->tick_counter = tickcounter_create()) == NULL)
+        {
+            LogError("Failure creating tick counter");
+            prov_sc_bulk_importer_destroy(result);
+            result = NULL;
+        }
+        else if ((result->registration_path = create_registration_path(INDV_ENROLL_BULK_PATH_FMT, NULL)) == NULL)
+        {
+            LogError("Failed to construct a registration path");
+            prov_sc_bulk_importer_destroy(result);
+            result = NULL;
+        }
+        else if ((result->chunk = malloc(result->chunk_size * sizeof(INDIVIDUAL_ENROLLMENT_HANDLE))) == NULL)
+        {
+            LogError("Allocation of enrollment chunk failed");
+            prov_sc_bulk_importer_destroy(result);
+            result = NULL;
+        }
+        else if ((result->connections = malloc(max_chunks_in_flight * sizeof(BULK_IMPORT_CONNECTION))) == NULL)
+        {
+            LogError("Allocation of connections failed");
+            prov_sc_bulk_importer_destroy(result);
+            result = NULL;
+        }
+        else
+        {
+            //connections are opened when their first chunk is dispatched
+            memset(result->connections, 0, max_chunks_in_flight * sizeof(BULK_IMPORT_CONNECTION));
+            result->num_connections = max_chunks_in_flight;
+        }
+    }
+
+    return result;
+}
+
+int prov_sc_bulk_importer_add_individual_enrollment(PROVISIONING_BULK_IMPORTER_HANDLE importer, INDIVIDUAL_ENROLLMENT_HANDLE enrollment)
+{
+    int result;
+
+    if (importer == NULL)
+    {
+        LogError("Invalid bulk importer");
+        result = __FAILURE__;
+    }
+    else if (enrollment == NULL)
+    {
+        LogError("Invalid enrollment");
+        result = __FAILURE__;
+    }
+    else if (individualEnrollment_getRegistrationId(enrollment) == NULL)
+    {
+        LogError("Given model does not have a valid ID");
+        result = __FAILURE__;
+    }
+    else
+    {
+        importer->chunk[importer->chunk_count++] = enrollment;
+        if (importer->chunk_count == importer->chunk_size)
+        {
+            bulk_importer_dispatch_chunk(importer);
+        }
+        else
+        {
+            //keep the chunks in flight moving while the next one is filled
+            bulk_importer_dowork(importer);
+        }
+        result = 0;
+    }
+
+    return result;
+}
+
+int prov_sc_bulk_importer_finish(PROVISIONING_BULK_IMPORTER_HANDLE importer, PROVISIONING_BULK_OPERATION_RESULT** bulk_res_ptr)
+{
+    int result;
+
+    if (importer == NULL)
+    {
+        LogError("Invalid bulk importer");
+        result = __FAILURE__;
+    }
+    else if (bulk_res_ptr == NULL)
+    {
+        LogError("Invalid Bulk Op Result pointer");
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (importer->chunk_count > 0)
+        {
+            bulk_importer_dispatch_chunk(importer);
+        }
+        //every chunk is answered or failed within PROV_SC_RESPONSE_TIMEOUT_MS of its dispatch
+        while (bulk_importer_has_chunks_in_flight(importer))
+        {
+            ThreadAPI_Sleep(PROV_SC_DOWORK_SLEEP_MS);
+            bulk_importer_dowork(importer);
+        }
+
+        if (importer->report_failed)
+        {
+            LogError("Some results of the bulk operations could not be reported");
+            result = __FAILURE__;
+        }
+        else if ((*bulk_res_ptr = malloc(sizeof(PROVISIONING_BULK_OPERATION_RESULT))) == NULL)
+        {
+            LogError("Allocation of Bulk Operation Result failed");
+            result = __FAILURE__;
+        }
+        else
+        {
+            //the report moves to the caller and the importer starts a new one
+            (*bulk_res_ptr)->is_successful = importer->is_successful;
+            (*bulk_res_ptr)->errors = importer->errors;
+            (*bulk_res_ptr)->num_errors = importer->num_errors;
+            importer->is_successful = true;
+            importer->errors = NULL;
+            importer->num_errors = 0;
+            importer->errors_capacity = 0;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+void prov_sc_bulk_importer_destroy(PROVISIONING_BULK_IMPORTER_HANDLE importer)
+{
+    if (importer != NULL)
+    {
+        size_t i;
+
+        for (i = 0; i < importer->num_connections; i++)
+        {
+            BULK_IMPORT_CONNECTION* connection = &importer->connections[i];
+            if (connection->http_client != NULL)
+            {
+                uhttp_client_close(connection->http_client, NULL, NULL);
+                uhttp_client_destroy(connection->http_client);
+            }
+            bulk_import_connection_clear_chunk(connection);
+        }
+        for (i = 0; i < importer->chunk_count; i++)
+        {
+            individualEnrollment_destroy(importer->chunk[i]);
+        }
+        for (i = 0; i < importer->num_errors; i++)
+        {
+            bulk_import_error_free(importer->errors[i]);
+        }
+        free(importer->errors);
+        free(importer->connections);
+        free(importer->chunk);
+        STRING_delete(importer->registration_path);
+        if (importer->tick_counter != NULL)
+        {
+            tickcounter_destroy(importer->tick_counter);
+        }
+        free(importer);
+    }
+}
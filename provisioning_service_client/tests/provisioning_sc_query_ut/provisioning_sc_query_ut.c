@@ -91,6 +91,11 @@ static int QUERY_RESP_SIZE = 5;
 #define TEST_JSON_VALUE (JSON_Value*)0x11111111
 #define TEST_JSON_OBJECT (JSON_Object*)0x11111112
 #define TEST_JSON_ARRAY (JSON_Array*)0x11111113
+#define TEST_INDIVIDUAL_ENROLLMENT_HANDLE (INDIVIDUAL_ENROLLMENT_HANDLE)0x11111114
+
+static const char* TEST_QUERY_PAGE = "[ {\"registrationId\":\"id-1\"},\r\n {\"registrationId\":\"id-}2\\\"\", \"tags\":{\"a\":[1,2]}} ]";
+static const char* TEST_QUERY_PAGE_ELEMENT_1 = "{\"registrationId\":\"id-1\"}";
+static const char* TEST_QUERY_PAGE_ELEMENT_2 = "{\"registrationId\":\"id-}2\\\"\", \"tags\":{\"a\":[1,2]}}";
 
 static int my_mallocAndStrcpy_s(char** destination, const char* source)
 {
@@ -168,6 +173,9 @@ static void register_global_mocks()
     REGISTER_GLOBAL_MOCK_HOOK(individualEnrollment_destroy, my_individualEnrollment_destroy);
     REGISTER_GLOBAL_MOCK_HOOK(enrollmentGroup_destroy, my_enrollmentGroup_destroy);
 
+    REGISTER_GLOBAL_MOCK_RETURN(individualEnrollment_fromJson, TEST_INDIVIDUAL_ENROLLMENT_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(individualEnrollment_fromJson, NULL);
+
     //drs
     REGISTER_GLOBAL_MOCK_HOOK(deviceRegistrationState_destroy, my_deviceRegistrationState_destroy);
 
@@ -962,4 +970,260 @@ TEST_FUNCTION(queryResponse_free_drs_no_results)
     //cleanup
 }
 
+/*Tests_PROV_QUERY_42_001: [ If json_page, offset_ptr or record_ptr are NULL, queryResponse_deserializeNextFromJson shall fail and return a non-zero value ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_null_json_page)
+{
+    //arrange
+    size_t offset = 0;
+    void* record = NULL;
+
+    //act
+    int res = queryResponse_deserializeNextFromJson(NULL, &offset, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+}
+
+/*Tests_PROV_QUERY_42_001: [ If json_page, offset_ptr or record_ptr are NULL, queryResponse_deserializeNextFromJson shall fail and return a non-zero value ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_null_offset_ptr)
+{
+    //arrange
+    char page[] = "[]";
+    void* record = NULL;
+
+    //act
+    int res = queryResponse_deserializeNextFromJson(page, NULL, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+}
+
+/*Tests_PROV_QUERY_42_001: [ If json_page, offset_ptr or record_ptr are NULL, queryResponse_deserializeNextFromJson shall fail and return a non-zero value ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_null_record_ptr)
+{
+    //arrange
+    char page[] = "[]";
+    size_t offset = 0;
+
+    //act
+    int res = queryResponse_deserializeNextFromJson(page, &offset, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+
+    //cleanup
+}
+
+/*Tests_PROV_QUERY_42_002: [ If type is not a valid query type, queryResponse_deserializeNextFromJson shall fail and return a non-zero value ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_invalid_query_type)
+{
+    //arrange
+    char page[] = "[]";
+    size_t offset = 0;
+    void* record = NULL;
+
+    //act
+    int res = queryResponse_deserializeNextFromJson(page, &offset, QUERY_TYPE_INVALID, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+}
+
+/*Tests_PROV_QUERY_42_003: [ queryResponse_deserializeNextFromJson shall parse only the next element of the JSON array in json_page, starting at the position pointed to by offset_ptr ]*/
+/*Tests_PROV_QUERY_42_004: [ The element shall be deserialized into a new record of the given type, which shall populate record_ptr ]*/
+/*Tests_PROV_QUERY_42_005: [ offset_ptr shall be updated to the position following the element, and json_page shall be left unchanged ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_golden_first_element)
+{
+    //arrange
+    char page[256];
+    size_t offset = 0;
+    void* record = NULL;
+    (void)strcpy(page, TEST_QUERY_PAGE);
+
+    STRICT_EXPECTED_CALL(json_parse_string(TEST_QUERY_PAGE_ELEMENT_1));
+    STRICT_EXPECTED_CALL(json_value_get_object(TEST_JSON_VALUE));
+    STRICT_EXPECTED_CALL(individualEnrollment_fromJson(TEST_JSON_OBJECT));
+    STRICT_EXPECTED_CALL(json_value_free(TEST_JSON_VALUE));
+
+    //act
+    int res = queryResponse_deserializeNextFromJson(page, &offset, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, res);
+    ASSERT_IS_TRUE(record == TEST_INDIVIDUAL_ENROLLMENT_HANDLE);
+    ASSERT_ARE_EQUAL(size_t, 2 + strlen(TEST_QUERY_PAGE_ELEMENT_1), offset);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_QUERY_PAGE, page);
+
+    //cleanup
+}
+
+/*Tests_PROV_QUERY_42_003: [ queryResponse_deserializeNextFromJson shall parse only the next element of the JSON array in json_page, starting at the position pointed to by offset_ptr ]*/
+/*Tests_PROV_QUERY_42_005: [ offset_ptr shall be updated to the position following the element, and json_page shall be left unchanged ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_golden_nested_element)
+{
+    //arrange
+    char page[256];
+    size_t offset = 2 + strlen(TEST_QUERY_PAGE_ELEMENT_1);
+    void* record = NULL;
+    (void)strcpy(page, TEST_QUERY_PAGE);
+
+    STRICT_EXPECTED_CALL(json_parse_string(TEST_QUERY_PAGE_ELEMENT_2));
+    STRICT_EXPECTED_CALL(json_value_get_object(TEST_JSON_VALUE));
+    STRICT_EXPECTED_CALL(individualEnrollment_fromJson(TEST_JSON_OBJECT));
+    STRICT_EXPECTED_CALL(json_value_free(TEST_JSON_VALUE));
+
+    //act
+    int res = queryResponse_deserializeNextFromJson(page, &offset, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, res);
+    ASSERT_IS_TRUE(record == TEST_INDIVIDUAL_ENROLLMENT_HANDLE);
+    ASSERT_ARE_EQUAL(size_t, strlen(TEST_QUERY_PAGE) - 2, offset);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_QUERY_PAGE, page);
+
+    //cleanup
+}
+
+/*Tests_PROV_QUERY_42_006: [ Once all the elements of json_page have been read, queryResponse_deserializeNextFromJson shall set record_ptr to NULL and return 0 ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_end_of_page)
+{
+    //arrange
+    char page[256];
+    size_t offset = strlen(TEST_QUERY_PAGE) - 2;
+    void* record = TEST_INDIVIDUAL_ENROLLMENT_HANDLE;
+    (void)strcpy(page, TEST_QUERY_PAGE);
+
+    //act
+    int res = queryResponse_deserializeNextFromJson(page, &offset, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+}
+
+/*Tests_PROV_QUERY_42_006: [ Once all the elements of json_page have been read, queryResponse_deserializeNextFromJson shall set record_ptr to NULL and return 0 ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_empty_array)
+{
+    //arrange
+    char page[] = " [ ] ";
+    size_t offset = 0;
+    void* record = TEST_INDIVIDUAL_ENROLLMENT_HANDLE;
+
+    //act
+    int res = queryResponse_deserializeNextFromJson(page, &offset, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+}
+
+/*Tests_PROV_QUERY_42_007: [ If json_page is not a JSON array of objects, queryResponse_deserializeNextFromJson shall fail and return a non-zero value ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_not_an_array)
+{
+    //arrange
+    char page[] = "{\"registrationId\":\"id-1\"}";
+    size_t offset = 0;
+    void* record = NULL;
+
+    //act
+    int res = queryResponse_deserializeNextFromJson(page, &offset, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+}
+
+/*Tests_PROV_QUERY_42_007: [ If json_page is not a JSON array of objects, queryResponse_deserializeNextFromJson shall fail and return a non-zero value ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_unterminated_element)
+{
+    //arrange
+    char page[] = "[{\"registrationId\":\"id-1\"";
+    size_t offset = 0;
+    void* record = NULL;
+
+    //act
+    int res = queryResponse_deserializeNextFromJson(page, &offset, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+}
+
+/*Tests_PROV_QUERY_42_008: [ If the element cannot be deserialized, queryResponse_deserializeNextFromJson shall fail and return a non-zero value ]*/
+TEST_FUNCTION(queryResponse_deserializeNextFromJson_error)
+{
+    //arrange
+    char page[256];
+    (void)strcpy(page, TEST_QUERY_PAGE);
+
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(json_parse_string(TEST_QUERY_PAGE_ELEMENT_1));
+    STRICT_EXPECTED_CALL(json_value_get_object(TEST_JSON_VALUE));
+    STRICT_EXPECTED_CALL(individualEnrollment_fromJson(TEST_JSON_OBJECT));
+    STRICT_EXPECTED_CALL(json_value_free(TEST_JSON_VALUE)); //cannot fail
+    umock_c_negative_tests_snapshot();
+
+    size_t calls_cannot_fail[] = { 3 };
+    size_t num_cannot_fail = sizeof(calls_cannot_fail) / sizeof(calls_cannot_fail[0]);
+    size_t count = umock_c_negative_tests_call_count();
+    size_t test_num = 0;
+    size_t test_max = count - num_cannot_fail;
+
+    for (size_t index = 0; index < count; index++)
+    {
+        if (should_skip_index(index, calls_cannot_fail, num_cannot_fail) != 0)
+            continue;
+        test_num++;
+
+        char tmp_msg[128];
+        sprintf(tmp_msg, "queryResponse_deserializeNextFromJson_error failure in test %zu/%zu", test_num, test_max);
+
+        size_t offset = 0;
+        void* record = NULL;
+
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+
+        //act
+        int res = queryResponse_deserializeNextFromJson(page, &offset, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &record);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL_WITH_MSG(int, 0, res, tmp_msg);
+        ASSERT_ARE_EQUAL_WITH_MSG(size_t, 0, offset, tmp_msg);
+        ASSERT_ARE_EQUAL_WITH_MSG(char_ptr, TEST_QUERY_PAGE, page, tmp_msg);
+    }
+
+    //cleanup
+    umock_c_negative_tests_deinit();
+}
+
 END_TEST_SUITE(provisioning_sc_query_ut);
@@ -37,6 +37,8 @@ static void real_free(void* ptr)
 #include "azure_c_shared_utility/connection_string_parser.h"
 #include "azure_c_shared_utility/tlsio.h"
 #include "azure_c_shared_utility/http_proxy_io.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 #include "azure_uhttp_c/uhttp.h"
 
@@ -58,6 +60,9 @@ static TEST_MUTEX_HANDLE g_testByTest;
 static TEST_MUTEX_HANDLE g_dllByDll;
 
 static int g_uhttp_client_dowork_call_count;
+static tickcounter_ms_t g_current_ms;
+static tickcounter_ms_t g_tick_increment_ms;
+static int g_thread_sleep_call_count;
 static ON_HTTP_OPEN_COMPLETE_CALLBACK g_on_http_open;
 static void* g_http_open_ctx;
 static ON_HTTP_REQUEST_CALLBACK g_on_http_reply_recv;
@@ -121,6 +126,7 @@ static STRING_HANDLE TEST_STRING_HANDLE = (STRING_HANDLE)0x11111119;
 static DEVICE_REGISTRATION_STATE_HANDLE TEST_DEVICE_REGISTRATION_STATE_HANDLE = (DEVICE_REGISTRATION_STATE_HANDLE)0x11111120;
 #define TEST_INDIVIDUAL_ENROLLMENT_HANDLE2 (INDIVIDUAL_ENROLLMENT_HANDLE)0x11111121
 #define TEST_HTTP_HEADERS_HANDLE (HTTP_HEADERS_HANDLE)0x11111122
+static TICK_COUNTER_HANDLE TEST_TICK_COUNTER_HANDLE = (TICK_COUNTER_HANDLE)0x11111123;
 static const unsigned char* TEST_REPLY_JSON = (const unsigned char*)"{my-json-reply}";
 static const char* TEST_ENROLLMENT_JSON = "{my-json-serialized-enrollment}";
 static const char* TEST_CONNECTION_STRING = "my-connection-string";
@@ -226,6 +232,20 @@ static void my_uhttp_client_dowork(HTTP_CLIENT_HANDLE handle)
     g_uhttp_client_dowork_call_count++;
 }
 
+static int my_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t* current_ms)
+{
+    (void)tick_counter;
+    *current_ms = g_current_ms;
+    g_current_ms += g_tick_increment_ms;
+    return 0;
+}
+
+static void my_ThreadAPI_Sleep(unsigned int milliseconds)
+{
+    (void)milliseconds;
+    g_thread_sleep_call_count++;
+}
+
 static const char* my_Map_GetValueFromKey(MAP_HANDLE handle, const char* key)
 {
     char* result = NULL;
@@ -349,7 +369,12 @@ static PROVISIONING_BULK_OPERATION_RESULT* my_bulkOperationResult_deserializeFro
 {
     PROVISIONING_BULK_OPERATION_RESULT* result;
     if (json_string != NULL)
-        result = (PROVISIONING_BULK_OPERATION_RESULT*)real_malloc(1);
+    {
+        result = (PROVISIONING_BULK_OPERATION_RESULT*)real_malloc(sizeof(PROVISIONING_BULK_OPERATION_RESULT));
+        result->is_successful = true;
+        result->errors = NULL;
+        result->num_errors = 0;
+    }
     else
         result = NULL;
     return result;
@@ -366,6 +391,24 @@ static PROVISIONING_QUERY_RESPONSE* my_queryResponse_deserializeFromJson(const c
     return result;
 }
 
+static int my_queryResponse_deserializeNextFromJson(char* json_page, size_t* offset_ptr, PROVISIONING_QUERY_TYPE type, void** record_ptr)
+{
+    (void)json_page;
+    (void)type;
+
+    //the page holds a single record
+    if (*offset_ptr == 0)
+    {
+        *record_ptr = real_malloc(1);
+        *offset_ptr = 1;
+    }
+    else
+    {
+        *record_ptr = NULL;
+    }
+    return 0;
+}
+
 static void my_individualEnrollment_destroy(INDIVIDUAL_ENROLLMENT_HANDLE handle)
 {
     real_free(handle);
@@ -550,6 +593,11 @@ static void register_global_mock_hooks()
 
     REGISTER_GLOBAL_MOCK_HOOK(uhttp_client_dowork, my_uhttp_client_dowork);
 
+    REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, my_tickcounter_get_current_ms);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_get_current_ms, __FAILURE__);
+
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Sleep, my_ThreadAPI_Sleep);
+
     REGISTER_GLOBAL_MOCK_HOOK(uhttp_client_create, my_uhttp_client_create);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(uhttp_client_create, NULL);
 
@@ -630,6 +678,9 @@ static void register_global_mock_hooks()
     REGISTER_GLOBAL_MOCK_HOOK(queryResponse_deserializeFromJson, my_queryResponse_deserializeFromJson);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(queryResponse_deserializeFromJson, NULL);
 
+    REGISTER_GLOBAL_MOCK_HOOK(queryResponse_deserializeNextFromJson, my_queryResponse_deserializeNextFromJson);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(queryResponse_deserializeNextFromJson, __FAILURE__);
+
     REGISTER_GLOBAL_MOCK_HOOK(queryResponse_free, my_queryResponse_free);
 
     REGISTER_GLOBAL_MOCK_HOOK(queryType_stringToEnum, my_queryType_stringToEnum);
@@ -659,6 +710,9 @@ static void register_global_mock_returns()
     REGISTER_GLOBAL_MOCK_RETURN(STRING_c_str, TEST_STRING);
 
     REGISTER_GLOBAL_MOCK_RETURN(http_proxy_io_get_interface_description, TEST_IO_INTERFACE_DESC);
+
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, TEST_TICK_COUNTER_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_create, NULL);
 }
 
 static void register_global_mock_alias_types()
@@ -679,8 +733,12 @@ static void register_global_mock_alias_types()
     REGISTER_UMOCK_ALIAS_TYPE(ON_HTTP_REQUEST_CALLBACK, void*);
     REGISTER_UMOCK_ALIAS_TYPE(ON_HTTP_CLOSED_CALLBACK, void*);
     REGISTER_UMOCK_ALIAS_TYPE(HTTP_CLIENT_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(tickcounter_ms_t*, void*);
     REGISTER_UMOCK_ALIAS_TYPE(HTTP_CLIENT_REQUEST_TYPE, int);
     REGISTER_UMOCK_ALIAS_TYPE(PROVISIONING_QUERY_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(size_t*, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(void**, void*);
 }
 
 BEGIN_TEST_SUITE(provisioning_service_client_ut)
@@ -720,6 +778,9 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     g_on_http_reply_recv = NULL;
     g_http_reply_recv_ctx = NULL;
     g_uhttp_client_dowork_call_count = 0;
+    g_current_ms = 0;
+    g_tick_increment_ms = 1;
+    g_thread_sleep_call_count = 0;
     g_response_content_status = RESPONSE_ON;
 
     g_cert = NO_CERT;
@@ -4699,4 +4760,783 @@ TEST_FUNCTION(prov_sc_query_device_registration_state_success_paging_given_token
     prov_sc_destroy(sc);
 }
 
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_001: [ If prov_client is NULL, prov_sc_query_iterator_create shall fail and return NULL ]*/
+TEST_FUNCTION(prov_sc_query_iterator_create_NULL_prov_client)
+{
+    //arrange
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.query_string = TEST_QUERY_STRING;
+    qs.version = PROVISIONING_QUERY_SPECIFICATION_VERSION_1;
+    umock_c_reset_all_calls();
+
+    //act
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(NULL, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &qs);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(iterator);
+
+    //cleanup
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_002: [ If query_spec is NULL or has invalid values, prov_sc_query_iterator_create shall fail and return NULL ]*/
+TEST_FUNCTION(prov_sc_query_iterator_create_NULL_query_spec)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    umock_c_reset_all_calls();
+
+    //act
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(iterator);
+
+    //cleanup
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_002: [ If query_spec is NULL or has invalid values, prov_sc_query_iterator_create shall fail and return NULL ]*/
+TEST_FUNCTION(prov_sc_query_iterator_create_invalid_version)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.query_string = TEST_QUERY_STRING;
+    qs.version = 47474;
+    umock_c_reset_all_calls();
+
+    //act
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &qs);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(iterator);
+
+    //cleanup
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_003: [ If query_type is not a valid query type, prov_sc_query_iterator_create shall fail and return NULL ]*/
+TEST_FUNCTION(prov_sc_query_iterator_create_invalid_query_type)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.query_string = TEST_QUERY_STRING;
+    qs.version = PROVISIONING_QUERY_SPECIFICATION_VERSION_1;
+    umock_c_reset_all_calls();
+
+    //act
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_INVALID, &qs);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(iterator);
+
+    //cleanup
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_004: [ If query_type is QUERY_TYPE_DEVICE_REGISTRATION_STATE and query_spec has no registration_id, prov_sc_query_iterator_create shall fail and return NULL ]*/
+TEST_FUNCTION(prov_sc_query_iterator_create_drs_no_registration_id)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.version = PROVISIONING_QUERY_SPECIFICATION_VERSION_1;
+    umock_c_reset_all_calls();
+
+    //act
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_DEVICE_REGISTRATION_STATE, &qs);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(iterator);
+
+    //cleanup
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_005: [ prov_sc_query_iterator_create shall serialize query_spec and open a connection to the Provisioning Service, without sending the query ]*/
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_006: [ Upon success, prov_sc_query_iterator_create shall return a handle to the new query iterator ]*/
+TEST_FUNCTION(prov_sc_query_iterator_create_success)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.query_string = TEST_QUERY_STRING;
+    qs.version = PROVISIONING_QUERY_SPECIFICATION_VERSION_1;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    STRICT_EXPECTED_CALL(querySpecification_serializeToJson(&qs));
+    expected_calls_construct_registration_path(false);
+    expected_calls_connect_to_service();
+
+    //act
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &qs);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(iterator);
+
+    //cleanup
+    prov_sc_query_iterator_destroy(iterator);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_007: [ If any part of the creation fails, prov_sc_query_iterator_create shall free all allocated memory and return NULL ]*/
+TEST_FUNCTION(prov_sc_query_iterator_create_fail)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.query_string = TEST_QUERY_STRING;
+    qs.version = PROVISIONING_QUERY_SPECIFICATION_VERSION_1;
+    umock_c_reset_all_calls();
+
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    STRICT_EXPECTED_CALL(querySpecification_serializeToJson(&qs));
+    expected_calls_construct_registration_path(false);
+    expected_calls_connect_to_service();
+    umock_c_negative_tests_snapshot();
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        char tmp_msg[128];
+        sprintf(tmp_msg, "prov_sc_query_iterator_create failure in test %zu/%zu", index, count);
+
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+
+        //act
+        PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &qs);
+
+        //assert
+        ASSERT_IS_NULL_WITH_MSG(iterator, tmp_msg);
+    }
+
+    //cleanup
+    umock_c_negative_tests_deinit();
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_008: [ If iterator or record_ptr are NULL, prov_sc_query_iterator_next shall fail and return a non-zero value ]*/
+TEST_FUNCTION(prov_sc_query_iterator_next_NULL_iterator)
+{
+    //arrange
+    PROVISIONING_QUERY_RECORD* record = NULL;
+
+    //act
+    int res = prov_sc_query_iterator_next(NULL, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_008: [ If iterator or record_ptr are NULL, prov_sc_query_iterator_next shall fail and return a non-zero value ]*/
+TEST_FUNCTION(prov_sc_query_iterator_next_NULL_record_ptr)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.query_string = TEST_QUERY_STRING;
+    qs.version = PROVISIONING_QUERY_SPECIFICATION_VERSION_1;
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &qs);
+    umock_c_reset_all_calls();
+
+    //act
+    int res = prov_sc_query_iterator_next(iterator, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+
+    //cleanup
+    prov_sc_query_iterator_destroy(iterator);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_009: [ prov_sc_query_iterator_next shall send the query with a 'POST' REST call once connected, and keep the connection open for the following pages ]*/
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_010: [ prov_sc_query_iterator_next shall deserialize only the next record of the current page and populate record_ptr with it ]*/
+TEST_FUNCTION(prov_sc_query_iterator_next_first_record)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.query_string = TEST_QUERY_STRING;
+    qs.version = PROVISIONING_QUERY_SPECIFICATION_VERSION_1;
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &qs);
+    PROVISIONING_QUERY_RECORD* record = NULL;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(uhttp_client_dowork(IGNORED_PTR_ARG)); //connected
+    expected_calls_construct_http_headers(NO_ETAG, HTTP_CLIENT_REQUEST_POST);
+    expected_calls_add_query_headers(false, false);
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)); //cannot fail
+    STRICT_EXPECTED_CALL(uhttp_client_execute_request(IGNORED_PTR_ARG, HTTP_CLIENT_REQUEST_POST, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_Free(IGNORED_PTR_ARG)); //cannot fail
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG)); //start waiting
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Sleep(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(uhttp_client_dowork(IGNORED_PTR_ARG)); //page received
+    STRICT_EXPECTED_CALL(HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(NULL); //cannot fail
+    STRICT_EXPECTED_CALL(HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(QUERY_RESPONSE_HEADER_ITEM_TYPE_VALUE_INDIVIDUAL_ENROLLMENT);
+    STRICT_EXPECTED_CALL(queryType_stringToEnum(QUERY_RESPONSE_HEADER_ITEM_TYPE_VALUE_INDIVIDUAL_ENROLLMENT));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)); //no previous continuation token
+    STRICT_EXPECTED_CALL(queryResponse_deserializeNextFromJson(IGNORED_PTR_ARG, IGNORED_PTR_ARG, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, IGNORED_PTR_ARG));
+
+    //act
+    int res = prov_sc_query_iterator_next(iterator, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, res);
+    ASSERT_IS_NOT_NULL(record);
+    ASSERT_IS_TRUE(record->type == QUERY_TYPE_INDIVIDUAL_ENROLLMENT);
+    ASSERT_IS_NOT_NULL(record->handle.ie);
+
+    //cleanup
+    prov_sc_query_iterator_destroy(iterator);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_011: [ The record returned by the previous call shall be destroyed ]*/
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_014: [ Once the last page has been read, prov_sc_query_iterator_next shall set record_ptr to NULL and return 0 ]*/
+TEST_FUNCTION(prov_sc_query_iterator_next_end_of_query)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.query_string = TEST_QUERY_STRING;
+    qs.version = PROVISIONING_QUERY_SPECIFICATION_VERSION_1;
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &qs);
+    PROVISIONING_QUERY_RECORD* record = NULL;
+    STRICT_EXPECTED_CALL(HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(NULL);
+    STRICT_EXPECTED_CALL(HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(QUERY_RESPONSE_HEADER_ITEM_TYPE_VALUE_INDIVIDUAL_ENROLLMENT);
+    (void)prov_sc_query_iterator_next(iterator, &record);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(individualEnrollment_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(uhttp_client_dowork(IGNORED_PTR_ARG)); //does not fail
+    STRICT_EXPECTED_CALL(queryResponse_deserializeNextFromJson(IGNORED_PTR_ARG, IGNORED_PTR_ARG, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)); //the page is exhausted
+
+    //act
+    int res = prov_sc_query_iterator_next(iterator, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+    prov_sc_query_iterator_destroy(iterator);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_017: [ While it blocks, prov_sc_query_iterator_next shall sleep between calls to uhttp_client_dowork, and if the next page is not received within 60 seconds it shall fail and return a non-zero value, as will the following calls ]*/
+TEST_FUNCTION(prov_sc_query_iterator_next_page_timeout)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.query_string = TEST_QUERY_STRING;
+    qs.version = PROVISIONING_QUERY_SPECIFICATION_VERSION_1;
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &qs);
+    PROVISIONING_QUERY_RECORD* record = NULL;
+    umock_c_reset_all_calls();
+
+    //the connection never opens
+    g_uhttp_client_dowork_call_count = 2;
+    g_tick_increment_ms = 30 * 1000;
+
+    STRICT_EXPECTED_CALL(uhttp_client_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG)); //start waiting
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG)); //30 seconds
+    STRICT_EXPECTED_CALL(ThreadAPI_Sleep(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(uhttp_client_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG)); //60 seconds
+    STRICT_EXPECTED_CALL(uhttp_client_dowork(IGNORED_PTR_ARG)); //the following call fails right away
+
+    //act
+    int res = prov_sc_query_iterator_next(iterator, &record);
+    int res2 = prov_sc_query_iterator_next(iterator, &record);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+    ASSERT_ARE_NOT_EQUAL(int, 0, res2);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+    prov_sc_query_iterator_destroy(iterator);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_015: [ If the query request fails, prov_sc_query_iterator_next shall fail and return a non-zero value ]*/
+TEST_FUNCTION(prov_sc_query_iterator_next_invalid_item_type)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_QUERY_SPECIFICATION qs = { 0 };
+    qs.page_size = NO_MAX_PAGE_SIZE;
+    qs.query_string = TEST_QUERY_STRING;
+    qs.version = PROVISIONING_QUERY_SPECIFICATION_VERSION_1;
+    PROVISIONING_QUERY_ITERATOR_HANDLE iterator = prov_sc_query_iterator_create(sc, QUERY_TYPE_INDIVIDUAL_ENROLLMENT, &qs);
+    PROVISIONING_QUERY_RECORD* record = NULL;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(NULL);
+    STRICT_EXPECTED_CALL(HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(NULL);
+
+    //act
+    int res = prov_sc_query_iterator_next(iterator, &record);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(record);
+
+    //cleanup
+    prov_sc_query_iterator_destroy(iterator);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_42_016: [ prov_sc_query_iterator_destroy shall close the connection and free all the memory of the iterator, including its last record ]*/
+TEST_FUNCTION(prov_sc_query_iterator_destroy_NULL)
+{
+    //arrange
+
+    //act
+    prov_sc_query_iterator_destroy(NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_001: [ If prov_client is NULL or mode is not a valid bulk operation mode, prov_sc_bulk_importer_create shall fail and return NULL ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_create_NULL_prov_client)
+{
+    //arrange
+
+    //act
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(NULL, BULK_OP_CREATE, 0, 0);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(importer);
+
+    //cleanup
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_001: [ If prov_client is NULL or mode is not a valid bulk operation mode, prov_sc_bulk_importer_create shall fail and return NULL ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_create_invalid_mode)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    umock_c_reset_all_calls();
+
+    //act
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, (PROVISIONING_BULK_OPERATION_MODE)(BULK_OP_DELETE + 1), 0, 0);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(importer);
+
+    //cleanup
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_002: [ If chunk_size or max_chunks_in_flight are 0, prov_sc_bulk_importer_create shall use PROVISIONING_BULK_IMPORTER_DEFAULT_CHUNK_SIZE and PROVISIONING_BULK_IMPORTER_DEFAULT_CHUNKS_IN_FLIGHT instead ]*/
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_003: [ prov_sc_bulk_importer_create shall allocate the importer, the chunk and the connection slots without opening any connection, and return a handle to the new importer ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_create_success)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    expected_calls_construct_registration_path(false);
+    STRICT_EXPECTED_CALL(gballoc_malloc(PROVISIONING_BULK_IMPORTER_DEFAULT_CHUNK_SIZE * sizeof(INDIVIDUAL_ENROLLMENT_HANDLE)));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    //act
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 0, 0);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(importer);
+
+    //cleanup
+    prov_sc_bulk_importer_destroy(importer);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_004: [ If any part of the creation fails, prov_sc_bulk_importer_create shall free all allocated memory and return NULL ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_create_fail)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    umock_c_reset_all_calls();
+
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    expected_calls_construct_registration_path(false);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    umock_c_negative_tests_snapshot();
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+
+        char tmp_msg[128];
+        sprintf(tmp_msg, "prov_sc_bulk_importer_create failure in test %zu/%zu", index, count);
+
+        //act
+        PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 0, 0);
+
+        //assert
+        ASSERT_IS_NULL_WITH_MSG(importer, tmp_msg);
+    }
+
+    //cleanup
+    prov_sc_destroy(sc);
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_005: [ If importer or enrollment are NULL, or enrollment has no registration id, prov_sc_bulk_importer_add_individual_enrollment shall fail and return a non-zero value ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_add_individual_enrollment_NULL_importer)
+{
+    //arrange
+    INDIVIDUAL_ENROLLMENT_HANDLE ie = individualEnrollment_create(TEST_REGID, TEST_ATT_MECH_HANDLE);
+    umock_c_reset_all_calls();
+
+    //act
+    int res = prov_sc_bulk_importer_add_individual_enrollment(NULL, ie);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+
+    //cleanup
+    individualEnrollment_destroy(ie);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_005: [ If importer or enrollment are NULL, or enrollment has no registration id, prov_sc_bulk_importer_add_individual_enrollment shall fail and return a non-zero value ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_add_individual_enrollment_NULL_enrollment)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 0, 0);
+    umock_c_reset_all_calls();
+
+    //act
+    int res = prov_sc_bulk_importer_add_individual_enrollment(importer, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+
+    //cleanup
+    prov_sc_bulk_importer_destroy(importer);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_006: [ prov_sc_bulk_importer_add_individual_enrollment shall take ownership of enrollment and add it to the chunk being filled, which is dispatched once it holds chunk_size enrollments ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_add_individual_enrollment_partial_chunk)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 2, 1);
+    INDIVIDUAL_ENROLLMENT_HANDLE ie = individualEnrollment_create(TEST_REGID, TEST_ATT_MECH_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(individualEnrollment_getRegistrationId(ie));
+
+    //act
+    int res = prov_sc_bulk_importer_add_individual_enrollment(importer, ie);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, res);
+
+    //cleanup
+    prov_sc_bulk_importer_destroy(importer);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_006: [ prov_sc_bulk_importer_add_individual_enrollment shall take ownership of enrollment and add it to the chunk being filled, which is dispatched once it holds chunk_size enrollments ]*/
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_007: [ A dispatched chunk shall be serialized as a single bulk operation, its registration ids kept for the report and its enrollments destroyed, and it shall be sent on an idle connection, which is opened if needed ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_add_individual_enrollment_full_chunk)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 1, 1);
+    INDIVIDUAL_ENROLLMENT_HANDLE ie = individualEnrollment_create(TEST_REGID, TEST_ATT_MECH_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(individualEnrollment_getRegistrationId(ie));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(individualEnrollment_getRegistrationId(ie));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_REGID));
+    STRICT_EXPECTED_CALL(bulkOperation_serializeToJson(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    expected_calls_connect_to_service();
+    STRICT_EXPECTED_CALL(individualEnrollment_destroy(ie));
+
+    //act
+    int res = prov_sc_bulk_importer_add_individual_enrollment(importer, ie);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, res);
+
+    //cleanup
+    prov_sc_bulk_importer_destroy(importer);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_011: [ If importer or bulk_res_ptr are NULL, prov_sc_bulk_importer_finish shall fail and return a non-zero value ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_finish_NULL_importer)
+{
+    //arrange
+    PROVISIONING_BULK_OPERATION_RESULT* bulk_res = NULL;
+
+    //act
+    int res = prov_sc_bulk_importer_finish(NULL, &bulk_res);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+    ASSERT_IS_NULL(bulk_res);
+
+    //cleanup
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_011: [ If importer or bulk_res_ptr are NULL, prov_sc_bulk_importer_finish shall fail and return a non-zero value ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_finish_NULL_bulk_res_ptr)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 0, 0);
+    umock_c_reset_all_calls();
+
+    //act
+    int res = prov_sc_bulk_importer_finish(importer, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, res);
+
+    //cleanup
+    prov_sc_bulk_importer_destroy(importer);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_013: [ prov_sc_bulk_importer_finish shall populate bulk_res_ptr with the merged report, which is successful only if no chunk failed or reported errors, and the importer shall start a new report ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_finish_empty)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 0, 0);
+    PROVISIONING_BULK_OPERATION_RESULT* bulk_res = NULL;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    //act
+    int res = prov_sc_bulk_importer_finish(importer, &bulk_res);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, res);
+    ASSERT_IS_NOT_NULL(bulk_res);
+    ASSERT_IS_TRUE(bulk_res->is_successful);
+    ASSERT_ARE_EQUAL(size_t, 0, bulk_res->num_errors);
+
+    //cleanup
+    real_free(bulk_res);
+    prov_sc_bulk_importer_destroy(importer);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_008: [ The connection of a chunk shall be kept open for the next chunks once its reply has been received ]*/
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_009: [ The errors of the bulk operation result of a successful reply shall be merged into the report of the importer ]*/
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_012: [ prov_sc_bulk_importer_finish shall dispatch the partial chunk being filled and drive the connections until all the chunks in flight have been answered ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_finish_success)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 0, 0);
+    INDIVIDUAL_ENROLLMENT_HANDLE ie = individualEnrollment_create(TEST_REGID, TEST_ATT_MECH_HANDLE);
+    PROVISIONING_BULK_OPERATION_RESULT* bulk_res = NULL;
+    (void)prov_sc_bulk_importer_add_individual_enrollment(importer, ie);
+    umock_c_reset_all_calls();
+
+    //act
+    int res = prov_sc_bulk_importer_finish(importer, &bulk_res);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, 0, res);
+    ASSERT_IS_NOT_NULL(bulk_res);
+    ASSERT_IS_TRUE(bulk_res->is_successful);
+    ASSERT_ARE_EQUAL(size_t, 0, bulk_res->num_errors);
+    ASSERT_ARE_EQUAL(int, 2, g_uhttp_client_dowork_call_count);
+
+    //cleanup
+    real_free(bulk_res);
+    prov_sc_bulk_importer_destroy(importer);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_010: [ When a chunk fails to be serialized or sent, or its reply has a failure status code, one error per registration id of the chunk shall be added to the report, with the status code of the reply (0 when there is none), and a connection that failed shall be closed and opened again for the next chunk ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_finish_request_fail)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 0, 0);
+    INDIVIDUAL_ENROLLMENT_HANDLE ie = individualEnrollment_create(TEST_REGID, TEST_ATT_MECH_HANDLE);
+    PROVISIONING_BULK_OPERATION_RESULT* bulk_res = NULL;
+    (void)prov_sc_bulk_importer_add_individual_enrollment(importer, ie);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(uhttp_client_execute_request(IGNORED_PTR_ARG, HTTP_CLIENT_REQUEST_POST, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(HTTP_CLIENT_ERROR);
+
+    //act
+    int res = prov_sc_bulk_importer_finish(importer, &bulk_res);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, 0, res);
+    ASSERT_IS_NOT_NULL(bulk_res);
+    ASSERT_IS_FALSE(bulk_res->is_successful);
+    ASSERT_ARE_EQUAL(size_t, 1, bulk_res->num_errors);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_REGID, bulk_res->errors[0]->registration_id);
+    ASSERT_ARE_EQUAL(int, 0, bulk_res->errors[0]->error_code);
+
+    //cleanup
+    real_free(bulk_res->errors[0]->registration_id);
+    real_free(bulk_res->errors[0]->error_status);
+    real_free(bulk_res->errors[0]);
+    real_free(bulk_res->errors);
+    real_free(bulk_res);
+    prov_sc_bulk_importer_destroy(importer);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_016: [ A chunk that has not been answered within 60 seconds of its dispatch shall fail as above and its connection shall be closed ]*/
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_017: [ While waiting for an idle connection or for the chunks in flight, the importer shall sleep between calls to uhttp_client_dowork ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_finish_chunk_timeout)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 0, 0);
+    INDIVIDUAL_ENROLLMENT_HANDLE ie = individualEnrollment_create(TEST_REGID, TEST_ATT_MECH_HANDLE);
+    PROVISIONING_BULK_OPERATION_RESULT* bulk_res = NULL;
+    (void)prov_sc_bulk_importer_add_individual_enrollment(importer, ie);
+    umock_c_reset_all_calls();
+
+    //the connection never opens
+    g_uhttp_client_dowork_call_count = 2;
+    g_tick_increment_ms = 30 * 1000;
+
+    //act
+    int res = prov_sc_bulk_importer_finish(importer, &bulk_res);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, 0, res);
+    ASSERT_IS_NOT_NULL(bulk_res);
+    ASSERT_IS_FALSE(bulk_res->is_successful);
+    ASSERT_ARE_EQUAL(size_t, 1, bulk_res->num_errors);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_REGID, bulk_res->errors[0]->registration_id);
+    ASSERT_ARE_EQUAL(int, 0, bulk_res->errors[0]->error_code);
+    ASSERT_ARE_EQUAL(int, 2, g_thread_sleep_call_count); //dispatched at 0, still waiting at 30 seconds, failed at 60 seconds
+
+    //cleanup
+    real_free(bulk_res->errors[0]->registration_id);
+    real_free(bulk_res->errors[0]->error_status);
+    real_free(bulk_res->errors[0]);
+    real_free(bulk_res->errors);
+    real_free(bulk_res);
+    prov_sc_bulk_importer_destroy(importer);
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_015: [ prov_sc_bulk_importer_destroy shall close the connections, destroy the enrollments that were not sent and free all the memory of the importer ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_destroy_pending_enrollment)
+{
+    //arrange
+    PROVISIONING_SERVICE_CLIENT_HANDLE sc = prov_sc_create_from_connection_string(TEST_CONNECTION_STRING);
+    PROVISIONING_BULK_IMPORTER_HANDLE importer = prov_sc_bulk_importer_create(sc, BULK_OP_CREATE, 0, 1);
+    INDIVIDUAL_ENROLLMENT_HANDLE ie = individualEnrollment_create(TEST_REGID, TEST_ATT_MECH_HANDLE);
+    (void)prov_sc_bulk_importer_add_individual_enrollment(importer, ie);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(NULL)); //no chunk in flight
+    STRICT_EXPECTED_CALL(gballoc_free(NULL));
+    STRICT_EXPECTED_CALL(gballoc_free(NULL));
+    STRICT_EXPECTED_CALL(individualEnrollment_destroy(ie));
+    STRICT_EXPECTED_CALL(gballoc_free(NULL)); //no errors
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    prov_sc_bulk_importer_destroy(importer);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    prov_sc_destroy(sc);
+}
+
+/*Tests_PROVISIONING_SERVICE_CLIENT_43_015: [ prov_sc_bulk_importer_destroy shall close the connections, destroy the enrollments that were not sent and free all the memory of the importer ]*/
+TEST_FUNCTION(prov_sc_bulk_importer_destroy_NULL)
+{
+    //arrange
+
+    //act
+    prov_sc_bulk_importer_destroy(NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
 END_TEST_SUITE(provisioning_service_client_ut);
\ No newline at end of file
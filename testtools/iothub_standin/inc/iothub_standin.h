@@ -0,0 +1,104 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* IoT Hub stand-in: a local server that plays the part of an IoT Hub on loopback so that the e2e and
+longhaul suites and the benchmarks can run without the cloud.
+
+Devices connect over MQTT (port 8883), HTTPS (port 443) or AMQP (port 5671, when built with AMQP), all
+over TLS, and authenticate with the SAS tokens the SDK generates from their keys. AMQP devices only get
+telemetry and cloud to device messages, their twin and method links are refused. The HTTPS listener
+also serves the service REST API used by the service client and the test tools (registry manager,
+device twin, direct methods) and the stand-in endpoints that replace the Event Hub in iothubtest (see
+readme.md).
+
+The stand-in delays everything it sends by latency_ms plus a uniform jitter and drops loss_percent of
+the requests devices send to it, without answering them, so that retry and timeout paths can be
+exercised and measured. */
+
+#ifndef IOTHUB_STANDIN_H
+#define IOTHUB_STANDIN_H
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+#define IOTHUB_STANDIN_DEFAULT_HOST_NAME    "127.0.0.1"
+#define IOTHUB_STANDIN_DEFAULT_POLICY_NAME  "iothubowner"
+#define IOTHUB_STANDIN_DEFAULT_MQTT_PORT    8883
+#define IOTHUB_STANDIN_DEFAULT_HTTPS_PORT   443
+#define IOTHUB_STANDIN_DEFAULT_AMQP_PORT    5671
+#define IOTHUB_STANDIN_PORT_DISABLED        -1
+
+typedef struct IOTHUB_STANDIN_TAG* IOTHUB_STANDIN_HANDLE;
+
+typedef struct IOTHUB_STANDIN_CONFIG_TAG
+{
+    const char* host_name;          /* HostName of the connection strings, IOTHUB_STANDIN_DEFAULT_HOST_NAME when NULL */
+    const char* policy_name;        /* shared access policy of the service clients, IOTHUB_STANDIN_DEFAULT_POLICY_NAME when NULL */
+    const char* policy_key;         /* base64 key of the shared access policy */
+    int mqtt_port;                  /* default port when 0, IOTHUB_STANDIN_PORT_DISABLED to disable */
+    int https_port;                 /* default port when 0, IOTHUB_STANDIN_PORT_DISABLED to disable */
+    int amqp_port;                  /* default port when 0, IOTHUB_STANDIN_PORT_DISABLED to disable, ignored without AMQP */
+    const char* certificate_file;   /* PEM server certificate, a self-signed certificate for host_name is generated when NULL */
+    const char* private_key_file;   /* PEM private key of certificate_file */
+    unsigned int latency_ms;        /* delay added to everything the stand-in sends */
+    unsigned int jitter_ms;         /* upper bound of a uniform random delay added to latency_ms */
+    unsigned int loss_percent;      /* share of the device requests dropped without an answer */
+    unsigned int seed;              /* seed of the jitter and loss model */
+} IOTHUB_STANDIN_CONFIG;
+
+typedef struct IOTHUB_STANDIN_STATS_TAG
+{
+    size_t connections;             /* TLS connections accepted */
+    size_t auth_failures;           /* connections and requests refused because of their SAS token */
+    size_t events_received;         /* device to cloud messages acknowledged */
+    size_t requests_dropped;        /* device requests dropped by the loss model */
+    size_t c2d_delivered;           /* cloud to device messages completed by the devices */
+    size_t twin_requests;           /* twin GET and reported properties PATCH from the devices */
+    size_t method_calls;            /* direct methods invoked through the service API */
+} IOTHUB_STANDIN_STATS;
+
+typedef void(*IOTHUB_STANDIN_EVENT_CALLBACK)(void* context, const char* deviceId, const unsigned char* data, size_t size);
+
+/** @brief  Creates the stand-in and starts listening, on the loopback interface for MQTT and HTTPS and on all
+*           the interfaces for AMQP. */
+extern IOTHUB_STANDIN_HANDLE IoTHubStandIn_Create(const IOTHUB_STANDIN_CONFIG* config);
+
+/** @brief  Stops the worker thread if it runs, closes all the connections and frees the stand-in. */
+extern void IoTHubStandIn_Destroy(IOTHUB_STANDIN_HANDLE handle);
+
+/** @brief  Registers a device authenticated with a symmetric key. */
+extern int IoTHubStandIn_AddDevice(IOTHUB_STANDIN_HANDLE handle, const char* deviceId, const char* primaryKey);
+
+/** @brief  Returns the PEM certificate the stand-in presents, to be trusted by the clients. */
+extern const char* IoTHubStandIn_GetCertificate(IOTHUB_STANDIN_HANDLE handle);
+
+/** @brief  Accepts connections, serves requests and sends what is due for up to timeoutMs milliseconds.
+*           Must not be called while the worker thread runs. */
+extern void IoTHubStandIn_DoWork(IOTHUB_STANDIN_HANDLE handle, unsigned int timeoutMs);
+
+/** @brief  Starts a thread that calls IoTHubStandIn_DoWork until IoTHubStandIn_Stop is called. */
+extern int IoTHubStandIn_Start(IOTHUB_STANDIN_HANDLE handle);
+extern void IoTHubStandIn_Stop(IOTHUB_STANDIN_HANDLE handle);
+
+/** @brief  Queues a cloud to device message for deviceId. */
+extern int IoTHubStandIn_SendCloudToDevice(IOTHUB_STANDIN_HANDLE handle, const char* deviceId, const unsigned char* data, size_t size);
+
+/** @brief  Merges the JSON patch into the desired properties of deviceId and notifies the device. */
+extern int IoTHubStandIn_UpdateDesired(IOTHUB_STANDIN_HANDLE handle, const char* deviceId, const char* patch);
+
+/** @brief  Sets the callback called from IoTHubStandIn_DoWork for every device to cloud message acknowledged. */
+extern void IoTHubStandIn_SetEventCallback(IOTHUB_STANDIN_HANDLE handle, IOTHUB_STANDIN_EVENT_CALLBACK callback, void* context);
+
+extern void IoTHubStandIn_GetStats(IOTHUB_STANDIN_HANDLE handle, IOTHUB_STANDIN_STATS* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_STANDIN_H
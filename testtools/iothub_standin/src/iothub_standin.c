@@ -0,0 +1,1378 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <openssl/rand.h>
+
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/base64.h"
+
+#include "standin_private.h"
+
+#define LISTEN_BACKLOG          64
+#define RECEIVE_CHUNK_SIZE      4096
+#define GENERATED_KEY_SIZE      32
+#define WORKER_POLL_MS          100
+#define DEFAULT_RANDOM_SEED     0x2545F491
+
+static const char DEVICES_PATH[] = "/devices/";
+
+uint64_t standin_now_ms(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static uint64_t wall_clock_ms(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/* xorshift32, good enough for a reproducible jitter and loss model */
+static uint32_t next_random(IOTHUB_STANDIN* standin)
+{
+    uint32_t value = standin->random_state;
+    value ^= value << 13;
+    value ^= value >> 17;
+    value ^= value << 5;
+    standin->random_state = value;
+    return value;
+}
+
+static void wake_up_worker(IOTHUB_STANDIN* standin)
+{
+    const char signal = 0;
+    // A full pipe already wakes the worker up
+    (void)write(standin->wakeup[1], &signal, 1);
+}
+
+uint64_t standin_release_time(IOTHUB_STANDIN* standin, uint64_t* lastReleaseMs)
+{
+    uint64_t result = standin_now_ms() + standin->latency_ms;
+    if (standin->jitter_ms > 0)
+    {
+        result += next_random(standin) % (standin->jitter_ms + 1);
+    }
+
+    // The jitter must not reorder what is sent on a connection
+    if (result < *lastReleaseMs)
+    {
+        result = *lastReleaseMs;
+    }
+    *lastReleaseMs = result;
+    return result;
+}
+
+int standin_send(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, const unsigned char* data, size_t size, bool close_after)
+{
+    int result;
+    STANDIN_OUTBOUND* outbound;
+
+    if ((outbound = (STANDIN_OUTBOUND*)malloc(sizeof(STANDIN_OUTBOUND))) == NULL)
+    {
+        LogError("Failure allocating the outbound data");
+        result = __FAILURE__;
+    }
+    else if ((outbound->data = (unsigned char*)malloc(size == 0 ? 1 : size)) == NULL)
+    {
+        LogError("Failure allocating the outbound data");
+        free(outbound);
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (size > 0)
+        {
+            (void)memcpy(outbound->data, data, size);
+        }
+        outbound->size = size;
+        outbound->offset = 0;
+        outbound->release_ms = standin_release_time(standin, &connection->last_release_ms);
+        outbound->close_after = close_after;
+        outbound->next = NULL;
+
+        if (connection->outbound_tail == NULL)
+        {
+            connection->outbound_head = outbound;
+        }
+        else
+        {
+            connection->outbound_tail->next = outbound;
+        }
+        connection->outbound_tail = outbound;
+
+        wake_up_worker(standin);
+        result = 0;
+    }
+    return result;
+}
+
+bool standin_drop_request(IOTHUB_STANDIN* standin)
+{
+    bool result;
+
+    if (standin->loss_percent > 0 && (next_random(standin) % 100) < standin->loss_percent)
+    {
+        standin->stats.requests_dropped++;
+        result = true;
+    }
+    else
+    {
+        result = false;
+    }
+    return result;
+}
+
+char* standin_percent_decode(const char* value, size_t length)
+{
+    char* result;
+
+    if ((result = (char*)malloc(length + 1)) == NULL)
+    {
+        LogError("Failure allocating the decoded value");
+    }
+    else
+    {
+        size_t read_index = 0;
+        size_t write_index = 0;
+
+        while (read_index < length)
+        {
+            if (value[read_index] == '%' && read_index + 2 < length &&
+                isxdigit((unsigned char)value[read_index + 1]) && isxdigit((unsigned char)value[read_index + 2]))
+            {
+                char hex[3] = { value[read_index + 1], value[read_index + 2], '\0' };
+                result[write_index++] = (char)strtol(hex, NULL, 16);
+                read_index += 3;
+            }
+            else
+            {
+                result[write_index++] = value[read_index++];
+            }
+        }
+        result[write_index] = '\0';
+    }
+    return result;
+}
+
+static char* generate_key(void)
+{
+    char* result;
+    unsigned char key[GENERATED_KEY_SIZE];
+    STRING_HANDLE encoded;
+
+    if (RAND_bytes(key, sizeof(key)) != 1 || (encoded = Base64_Encode_Bytes(key, sizeof(key))) == NULL)
+    {
+        LogError("Failure generating a key");
+        result = NULL;
+    }
+    else
+    {
+        if (mallocAndStrcpy_s(&result, STRING_c_str(encoded)) != 0)
+        {
+            LogError("Failure copying the generated key");
+            result = NULL;
+        }
+        STRING_delete(encoded);
+    }
+    return result;
+}
+
+static int copy_key(char** destination, const char* key, bool generate)
+{
+    int result;
+
+    if (key != NULL && key[0] != '\0')
+    {
+        result = mallocAndStrcpy_s(destination, key);
+    }
+    else if (generate)
+    {
+        result = ((*destination = generate_key()) == NULL) ? __FAILURE__ : 0;
+    }
+    else
+    {
+        *destination = NULL;
+        result = 0;
+    }
+    return result;
+}
+
+STANDIN_DEVICE* standin_find_device(IOTHUB_STANDIN* standin, const char* deviceId)
+{
+    STANDIN_DEVICE* result = standin->devices;
+
+    while (result != NULL && strcmp(result->device_id, deviceId) != 0)
+    {
+        result = result->next;
+    }
+    return result;
+}
+
+static void destroy_device(STANDIN_DEVICE* device)
+{
+    while (device->c2d_head != NULL)
+    {
+        standin_remove_c2d(device, device->c2d_head);
+    }
+    json_value_free(device->desired);
+    json_value_free(device->reported);
+    free(device->device_id);
+    free(device->primary_key);
+    free(device->secondary_key);
+    free(device->thumbprint);
+    free(device);
+}
+
+STANDIN_DEVICE* standin_create_device(IOTHUB_STANDIN* standin, const char* deviceId, const char* primaryKey, const char* secondaryKey, const char* thumbprint)
+{
+    STANDIN_DEVICE* result;
+
+    if ((result = (STANDIN_DEVICE*)malloc(sizeof(STANDIN_DEVICE))) == NULL)
+    {
+        LogError("Failure allocating the device");
+    }
+    else
+    {
+        bool use_keys = (thumbprint == NULL || thumbprint[0] == '\0');
+
+        memset(result, 0, sizeof(STANDIN_DEVICE));
+        result->desired = json_value_init_object();
+        result->reported = json_value_init_object();
+        result->desired_version = 1;
+        result->reported_version = 1;
+        result->generation = ++standin->next_sequence;
+
+        // Like the IoT Hub, keys that are not given are generated
+        if (result->desired == NULL || result->reported == NULL ||
+            mallocAndStrcpy_s(&result->device_id, deviceId) != 0 ||
+            copy_key(&result->primary_key, primaryKey, use_keys) != 0 ||
+            copy_key(&result->secondary_key, secondaryKey, use_keys) != 0 ||
+            (!use_keys && mallocAndStrcpy_s(&result->thumbprint, thumbprint) != 0))
+        {
+            LogError("Failure initializing the device %s", deviceId);
+            destroy_device(result);
+            result = NULL;
+        }
+        else
+        {
+            result->next = standin->devices;
+            standin->devices = result;
+        }
+    }
+    return result;
+}
+
+void standin_delete_device(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device)
+{
+    STANDIN_DEVICE** link = &standin->devices;
+    STANDIN_METHOD_CALL* call = standin->method_calls;
+
+    while (*link != device)
+    {
+        link = &(*link)->next;
+    }
+    *link = device->next;
+
+    while (call != NULL)
+    {
+        STANDIN_METHOD_CALL* next = call->next;
+        if (call->device == device)
+        {
+            standin_http_complete_method(standin, call, 404, NULL, 0);
+        }
+        call = next;
+    }
+
+    if (device->mqtt_connection != NULL)
+    {
+        device->mqtt_connection->device = NULL;
+        device->mqtt_connection->closing = true;
+    }
+#ifdef USE_AMQP
+    standin_amqp_on_delete_device(standin, device);
+#endif
+    destroy_device(device);
+}
+
+int standin_authenticate_device(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const char* sasToken, STANDIN_CONNECTION* connection)
+{
+    int result;
+
+    if (device->thumbprint != NULL)
+    {
+        // Without a connection (a put-token on the AMQP $cbs node) there is no certificate to check
+        char* thumbprint = (connection == NULL) ? NULL : standin_tls_get_peer_thumbprint(connection->ssl);
+        result = (thumbprint != NULL && strcasecmp(thumbprint, device->thumbprint) == 0) ? 0 : __FAILURE__;
+        free(thumbprint);
+    }
+    else
+    {
+        STRING_HANDLE resource = STRING_construct_sprintf("%s%s%s", standin->host_name, DEVICES_PATH, device->device_id);
+        if (resource == NULL)
+        {
+            LogError("Failure building the resource of %s", device->device_id);
+            result = __FAILURE__;
+        }
+        else
+        {
+            if (standin_sas_validate(sasToken, device->primary_key, STRING_c_str(resource), NULL) == 0 ||
+                standin_sas_validate(sasToken, device->secondary_key, STRING_c_str(resource), NULL) == 0)
+            {
+                result = 0;
+            }
+            else
+            {
+                result = __FAILURE__;
+            }
+            STRING_delete(resource);
+        }
+    }
+
+    if (result != 0)
+    {
+        standin->stats.auth_failures++;
+    }
+    return result;
+}
+
+int standin_authenticate_service(IOTHUB_STANDIN* standin, const char* sasToken)
+{
+    int result = standin_sas_validate(sasToken, standin->policy_key, standin->host_name, standin->policy_name);
+    if (result != 0)
+    {
+        standin->stats.auth_failures++;
+    }
+    return result;
+}
+
+void standin_record_event(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const unsigned char* data, size_t size)
+{
+    STANDIN_EVENT* event;
+    size_t index = (standin->event_head + standin->event_count) % STANDIN_EVENT_CAPACITY;
+
+    // The oldest event is overwritten once the buffer is full
+    if (standin->event_count == STANDIN_EVENT_CAPACITY)
+    {
+        standin->event_head = (standin->event_head + 1) % STANDIN_EVENT_CAPACITY;
+    }
+    else
+    {
+        standin->event_count++;
+    }
+
+    event = &standin->events[index];
+    free(event->device_id);
+    free(event->data);
+    event->sequence = ++standin->next_sequence;
+    event->enqueued_ms = wall_clock_ms();
+    event->size = size;
+    if (mallocAndStrcpy_s(&event->device_id, device->device_id) != 0 || (event->data = (unsigned char*)malloc(size == 0 ? 1 : size)) == NULL)
+    {
+        LogError("Failure keeping the event of %s", device->device_id);
+        free(event->device_id);
+        event->device_id = NULL;
+        event->data = NULL;
+        event->size = 0;
+    }
+    else
+    {
+        (void)memcpy(event->data, data, size);
+    }
+
+    standin->stats.events_received++;
+    if (standin->event_callback != NULL)
+    {
+        standin->event_callback(standin->event_callback_context, device->device_id, data, size);
+    }
+}
+
+int standin_enqueue_c2d(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const unsigned char* data, size_t size)
+{
+    int result;
+    STANDIN_C2D_MESSAGE* message;
+
+    if ((message = (STANDIN_C2D_MESSAGE*)malloc(sizeof(STANDIN_C2D_MESSAGE))) == NULL)
+    {
+        LogError("Failure allocating the cloud to device message");
+        result = __FAILURE__;
+    }
+    else if ((message->data = (unsigned char*)malloc(size == 0 ? 1 : size)) == NULL)
+    {
+        LogError("Failure allocating the cloud to device message");
+        free(message);
+        result = __FAILURE__;
+    }
+    else
+    {
+        STANDIN_C2D_MESSAGE** link = &device->c2d_head;
+
+        (void)memcpy(message->data, data, size);
+        message->size = size;
+        message->sequence = ++standin->next_sequence;
+        message->state = STANDIN_C2D_QUEUED;
+        message->packet_id = 0;
+        message->next = NULL;
+
+        while (*link != NULL)
+        {
+            link = &(*link)->next;
+        }
+        *link = message;
+
+        standin_mqtt_deliver_c2d(standin, device);
+#ifdef USE_AMQP
+        standin_amqp_deliver_c2d(standin, device);
+#endif
+        result = 0;
+    }
+    return result;
+}
+
+void standin_remove_c2d(STANDIN_DEVICE* device, STANDIN_C2D_MESSAGE* message)
+{
+    STANDIN_C2D_MESSAGE** link = &device->c2d_head;
+
+    while (*link != message)
+    {
+        link = &(*link)->next;
+    }
+    *link = message->next;
+    free(message->data);
+    free(message);
+}
+
+/* JSON merge patch of the twin: null removes a property, objects are merged and '$' properties are read only */
+static int merge_patch(JSON_Object* target, const JSON_Object* patch)
+{
+    int result = 0;
+    size_t count = json_object_get_count(patch);
+    size_t index;
+
+    for (index = 0; result == 0 && index < count; index++)
+    {
+        const char* name = json_object_get_name(patch, index);
+        JSON_Value* value = json_object_get_value_at(patch, index);
+
+        if (name[0] == '$')
+        {
+            continue;
+        }
+
+        switch (json_value_get_type(value))
+        {
+        case JSONNull:
+            (void)json_object_remove(target, name);
+            break;
+
+        case JSONObject:
+            if (json_object_get_object(target, name) == NULL && json_object_set_value(target, name, json_value_init_object()) != JSONSuccess)
+            {
+                result = __FAILURE__;
+            }
+            else
+            {
+                result = merge_patch(json_object_get_object(target, name), json_value_get_object(value));
+            }
+            break;
+
+        default:
+        {
+            JSON_Value* copy = json_value_deep_copy(value);
+            if (copy == NULL || json_object_set_value(target, name, copy) != JSONSuccess)
+            {
+                json_value_free(copy);
+                result = __FAILURE__;
+            }
+            break;
+        }
+        }
+    }
+    return result;
+}
+
+static JSON_Value* copy_with_version(JSON_Value* properties, unsigned long version)
+{
+    JSON_Value* result;
+
+    if ((result = json_value_deep_copy(properties)) == NULL ||
+        json_object_set_number(json_value_get_object(result), "$version", (double)version) != JSONSuccess)
+    {
+        LogError("Failure copying the twin properties");
+        json_value_free(result);
+        result = NULL;
+    }
+    return result;
+}
+
+char* standin_get_twin_properties(STANDIN_DEVICE* device)
+{
+    char* result = NULL;
+    JSON_Value* twin;
+
+    if ((twin = json_value_init_object()) == NULL)
+    {
+        LogError("Failure allocating the twin");
+    }
+    else
+    {
+        JSON_Value* desired = copy_with_version(device->desired, device->desired_version);
+        JSON_Value* reported = copy_with_version(device->reported, device->reported_version);
+
+        if (desired == NULL || json_object_set_value(json_value_get_object(twin), "desired", desired) != JSONSuccess)
+        {
+            json_value_free(desired);
+            json_value_free(reported);
+        }
+        else if (reported == NULL || json_object_set_value(json_value_get_object(twin), "reported", reported) != JSONSuccess)
+        {
+            json_value_free(reported);
+        }
+        else
+        {
+            result = json_serialize_to_string(twin);
+        }
+        json_value_free(twin);
+    }
+    return result;
+}
+
+int standin_update_reported(STANDIN_DEVICE* device, const char* patch)
+{
+    int result;
+    JSON_Value* value;
+
+    if ((value = json_parse_string(patch)) == NULL || json_value_get_type(value) != JSONObject)
+    {
+        LogError("Invalid reported properties patch from %s", device->device_id);
+        result = __FAILURE__;
+    }
+    else if (merge_patch(json_value_get_object(device->reported), json_value_get_object(value)) != 0)
+    {
+        LogError("Failure merging the reported properties of %s", device->device_id);
+        result = __FAILURE__;
+    }
+    else
+    {
+        device->reported_version++;
+        result = 0;
+    }
+    json_value_free(value);
+    return result;
+}
+
+int standin_update_desired(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, JSON_Value* patch)
+{
+    int result;
+
+    if (json_value_get_type(patch) != JSONObject || merge_patch(json_value_get_object(device->desired), json_value_get_object(patch)) != 0)
+    {
+        LogError("Failure merging the desired properties of %s", device->device_id);
+        result = __FAILURE__;
+    }
+    else
+    {
+        JSON_Value* notification;
+        char* serialized;
+
+        device->desired_version++;
+        result = 0;
+
+        // The device gets the patch itself, with the new version
+        if (device->mqtt_connection != NULL && (device->mqtt_connection->subscriptions & STANDIN_SUBSCRIPTION_TWIN_DESIRED) != 0)
+        {
+            if ((notification = copy_with_version(patch, device->desired_version)) == NULL)
+            {
+                result = __FAILURE__;
+            }
+            else
+            {
+                if ((serialized = json_serialize_to_string(notification)) == NULL ||
+                    standin_mqtt_send_desired(standin, device, serialized) != 0)
+                {
+                    LogError("Failure notifying %s of the desired properties", device->device_id);
+                    result = __FAILURE__;
+                }
+                json_free_serialized_string(serialized);
+                json_value_free(notification);
+            }
+        }
+    }
+    return result;
+}
+
+STANDIN_METHOD_CALL* standin_find_method_call(IOTHUB_STANDIN* standin, unsigned long requestId)
+{
+    STANDIN_METHOD_CALL* result = standin->method_calls;
+
+    while (result != NULL && result->request_id != requestId)
+    {
+        result = result->next;
+    }
+    return result;
+}
+
+void standin_remove_method_call(IOTHUB_STANDIN* standin, STANDIN_METHOD_CALL* call)
+{
+    STANDIN_METHOD_CALL** link = &standin->method_calls;
+
+    while (*link != call)
+    {
+        link = &(*link)->next;
+    }
+    *link = call->next;
+    free(call);
+}
+
+int standin_set_non_blocking(int socket)
+{
+    int flags = fcntl(socket, F_GETFL, 0);
+    return (flags == -1 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) == -1) ? __FAILURE__ : 0;
+}
+
+static int create_listener(IOTHUB_STANDIN* standin, int port, STANDIN_PROTOCOL protocol)
+{
+    int result;
+    int listener;
+
+    if ((listener = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+    {
+        LogError("Failure creating the socket for port %d", port);
+        result = __FAILURE__;
+    }
+    else
+    {
+        struct sockaddr_in address;
+        int reuse = 1;
+
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+            bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(listener, LISTEN_BACKLOG) != 0 ||
+            standin_set_non_blocking(listener) != 0)
+        {
+            LogError("Failure listening on 127.0.0.1:%d (errno %d)", port, errno);
+            (void)close(listener);
+            result = __FAILURE__;
+        }
+        else
+        {
+            standin->listeners[standin->listener_count] = listener;
+            standin->listener_protocols[standin->listener_count] = protocol;
+            standin->listener_count++;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void accept_connections(IOTHUB_STANDIN* standin, int listener, STANDIN_PROTOCOL protocol)
+{
+    int socket;
+
+    while ((socket = accept(listener, NULL, NULL)) != -1)
+    {
+        STANDIN_CONNECTION* connection;
+        int no_delay = 1;
+
+        (void)setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        if (standin_set_non_blocking(socket) != 0)
+        {
+            LogError("Failure configuring the socket");
+            (void)close(socket);
+        }
+        else if ((connection = (STANDIN_CONNECTION*)malloc(sizeof(STANDIN_CONNECTION))) == NULL)
+        {
+            LogError("Failure allocating the connection");
+            (void)close(socket);
+        }
+        else
+        {
+            memset(connection, 0, sizeof(STANDIN_CONNECTION));
+            connection->socket = socket;
+            connection->protocol = protocol;
+            connection->next_packet_id = 1;
+
+            if ((connection->ssl = SSL_new(standin->ssl_ctx)) == NULL || SSL_set_fd(connection->ssl, socket) != 1)
+            {
+                LogError("Failure creating the TLS session");
+                SSL_free(connection->ssl);
+                (void)close(socket);
+                free(connection);
+            }
+            else
+            {
+                connection->next = standin->connections;
+                standin->connections = connection;
+                standin->stats.connections++;
+            }
+        }
+    }
+}
+
+static void read_connection(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection)
+{
+    int read_result;
+
+    if (!connection->handshake_done)
+    {
+        int accept_result = SSL_accept(connection->ssl);
+        if (accept_result == 1)
+        {
+            connection->handshake_done = true;
+            connection->want_write = false;
+        }
+        else
+        {
+            int error = SSL_get_error(connection->ssl, accept_result);
+            connection->want_write = (error == SSL_ERROR_WANT_WRITE);
+            if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+            {
+                LogError("TLS handshake failed");
+                connection->closing = true;
+            }
+        }
+    }
+
+    while (connection->handshake_done && !connection->closing)
+    {
+        if (connection->received_capacity - connection->received_size < RECEIVE_CHUNK_SIZE)
+        {
+            size_t capacity = connection->received_capacity + RECEIVE_CHUNK_SIZE;
+            unsigned char* received;
+
+            if (capacity > 2 * STANDIN_MAX_PACKET_SIZE || (received = (unsigned char*)realloc(connection->received, capacity)) == NULL)
+            {
+                LogError("The peer sent more than the stand-in accepts");
+                connection->closing = true;
+                break;
+            }
+            connection->received = received;
+            connection->received_capacity = capacity;
+        }
+
+        read_result = SSL_read(connection->ssl, connection->received + connection->received_size, (int)(connection->received_capacity - connection->received_size));
+        if (read_result > 0)
+        {
+            connection->received_size += (size_t)read_result;
+        }
+        else
+        {
+            int error = SSL_get_error(connection->ssl, read_result);
+            connection->want_write = (error == SSL_ERROR_WANT_WRITE);
+            if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+            {
+                // The peer closed the connection or it failed
+                connection->closing = true;
+            }
+            break;
+        }
+    }
+}
+
+static void process_connection(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection)
+{
+    if (!connection->closing && connection->received_size > 0)
+    {
+        int process_result = (connection->protocol == STANDIN_PROTOCOL_MQTT) ?
+            standin_mqtt_process(standin, connection) :
+            standin_http_process(standin, connection);
+        if (process_result != 0)
+        {
+            connection->closing = true;
+        }
+    }
+}
+
+static void flush_connection(STANDIN_CONNECTION* connection, uint64_t now)
+{
+    while (connection->handshake_done && !connection->closing && connection->outbound_head != NULL && connection->outbound_head->release_ms <= now)
+    {
+        STANDIN_OUTBOUND* outbound = connection->outbound_head;
+        // An empty entry only marks where the connection is closed
+        int write_result = (outbound->size == 0) ? 0 : SSL_write(connection->ssl, outbound->data + outbound->offset, (int)(outbound->size - outbound->offset));
+
+        if (write_result > 0 || outbound->size == 0)
+        {
+            outbound->offset += (size_t)write_result;
+            if (outbound->offset == outbound->size)
+            {
+                connection->outbound_head = outbound->next;
+                if (connection->outbound_head == NULL)
+                {
+                    connection->outbound_tail = NULL;
+                }
+                connection->closing = outbound->close_after;
+                free(outbound->data);
+                free(outbound);
+            }
+        }
+        else
+        {
+            int error = SSL_get_error(connection->ssl, write_result);
+            connection->want_write = (error == SSL_ERROR_WANT_WRITE);
+            if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+            {
+                connection->closing = true;
+            }
+            break;
+        }
+    }
+}
+
+static void destroy_connection(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection)
+{
+    STANDIN_METHOD_CALL* call = standin->method_calls;
+
+    if (connection->protocol == STANDIN_PROTOCOL_MQTT)
+    {
+        standin_mqtt_on_close(standin, connection);
+    }
+
+    while (call != NULL)
+    {
+        STANDIN_METHOD_CALL* next = call->next;
+        if (call->http_connection == connection)
+        {
+            standin_remove_method_call(standin, call);
+        }
+        call = next;
+    }
+
+    while (connection->outbound_head != NULL)
+    {
+        STANDIN_OUTBOUND* outbound = connection->outbound_head;
+        connection->outbound_head = outbound->next;
+        free(outbound->data);
+        free(outbound);
+    }
+
+    SSL_free(connection->ssl);
+    (void)close(connection->socket);
+    free(connection->received);
+    free(connection);
+}
+
+static void expire_method_calls(IOTHUB_STANDIN* standin, uint64_t now)
+{
+    STANDIN_METHOD_CALL* call = standin->method_calls;
+
+    while (call != NULL)
+    {
+        STANDIN_METHOD_CALL* next = call->next;
+        if (call->deadline_ms <= now)
+        {
+            // The IoT Hub answers 504 when the device does not answer in time
+            standin_http_complete_method(standin, call, 504, NULL, 0);
+        }
+        call = next;
+    }
+}
+
+static int get_poll_timeout(IOTHUB_STANDIN* standin, unsigned int timeoutMs, uint64_t now)
+{
+    uint64_t deadline = now + timeoutMs;
+    STANDIN_CONNECTION* connection;
+    STANDIN_METHOD_CALL* call;
+
+    for (connection = standin->connections; connection != NULL; connection = connection->next)
+    {
+        if (connection->closing || (connection->handshake_done && connection->received_size > 0 && !connection->waiting_for_method))
+        {
+            deadline = now;
+        }
+        else if (connection->outbound_head != NULL && connection->outbound_head->release_ms < deadline)
+        {
+            deadline = connection->outbound_head->release_ms;
+        }
+    }
+
+    for (call = standin->method_calls; call != NULL; call = call->next)
+    {
+        if (call->deadline_ms < deadline)
+        {
+            deadline = call->deadline_ms;
+        }
+    }
+
+#ifdef USE_AMQP
+    if (standin->amqp != NULL)
+    {
+        uint64_t amqp_deadline = standin_amqp_get_deadline(standin, now);
+        if (amqp_deadline < deadline)
+        {
+            deadline = amqp_deadline;
+        }
+    }
+#endif
+
+    return (deadline <= now) ? 0 : (int)(deadline - now);
+}
+
+void IoTHubStandIn_DoWork(IOTHUB_STANDIN_HANDLE handle, unsigned int timeoutMs)
+{
+    if (handle == NULL)
+    {
+        LogError("Invalid argument (handle=NULL)");
+    }
+    else
+    {
+        IOTHUB_STANDIN* standin = (IOTHUB_STANDIN*)handle;
+        STANDIN_CONNECTION* connection;
+        STANDIN_CONNECTION** link;
+        struct pollfd* poll_fds;
+        STANDIN_CONNECTION** polled;
+        size_t connection_count = 0;
+        size_t poll_count;
+        size_t index;
+        int timeout;
+        uint64_t now;
+
+        (void)Lock(standin->lock);
+        for (connection = standin->connections; connection != NULL; connection = connection->next)
+        {
+            connection_count++;
+        }
+
+        poll_fds = (struct pollfd*)malloc((standin->listener_count + 1 + connection_count) * sizeof(struct pollfd));
+        polled = (STANDIN_CONNECTION**)malloc((connection_count + 1) * sizeof(STANDIN_CONNECTION*));
+        if (poll_fds == NULL || polled == NULL)
+        {
+            LogError("Failure allocating the poll descriptors");
+            (void)Unlock(standin->lock);
+        }
+        else
+        {
+            now = standin_now_ms();
+            timeout = get_poll_timeout(standin, timeoutMs, now);
+
+            poll_count = 0;
+            for (index = 0; index < standin->listener_count; index++)
+            {
+                poll_fds[poll_count].fd = standin->listeners[index];
+                poll_fds[poll_count].events = POLLIN;
+                poll_count++;
+            }
+            poll_fds[poll_count].fd = standin->wakeup[0];
+            poll_fds[poll_count].events = POLLIN;
+            poll_count++;
+
+            for (connection = standin->connections, index = 0; connection != NULL; connection = connection->next, index++)
+            {
+                bool has_due_data = connection->handshake_done && connection->outbound_head != NULL && connection->outbound_head->release_ms <= now;
+                polled[index] = connection;
+                poll_fds[poll_count].fd = connection->socket;
+                poll_fds[poll_count].events = (short)(POLLIN | ((connection->want_write || has_due_data) ? POLLOUT : 0));
+                poll_count++;
+            }
+            (void)Unlock(standin->lock);
+
+            // Only this thread adds or removes connections, polled stays valid while the lock is released
+            if (poll(poll_fds, (nfds_t)poll_count, timeout) < 0 && errno != EINTR)
+            {
+                LogError("poll failed (errno %d)", errno);
+            }
+
+            (void)Lock(standin->lock);
+            if ((poll_fds[standin->listener_count].revents & POLLIN) != 0)
+            {
+                char drain[64];
+                while (read(standin->wakeup[0], drain, sizeof(drain)) > 0)
+                {
+                }
+            }
+
+            for (index = 0; index < connection_count; index++)
+            {
+                short revents = poll_fds[standin->listener_count + 1 + index].revents;
+                connection = polled[index];
+                if ((revents & (POLLIN | POLLOUT | POLLERR | POLLHUP)) != 0 || SSL_pending(connection->ssl) > 0)
+                {
+                    read_connection(standin, connection);
+                }
+            }
+
+            now = standin_now_ms();
+            for (connection = standin->connections; connection != NULL; connection = connection->next)
+            {
+                process_connection(standin, connection);
+            }
+            expire_method_calls(standin, now);
+            for (connection = standin->connections; connection != NULL; connection = connection->next)
+            {
+                flush_connection(connection, now);
+            }
+#ifdef USE_AMQP
+            if (standin->amqp != NULL)
+            {
+                standin_amqp_dowork(standin);
+            }
+#endif
+
+            // New connections are accepted last so that they are not in polled
+            for (index = 0; index < standin->listener_count; index++)
+            {
+                if ((poll_fds[index].revents & POLLIN) != 0)
+                {
+                    accept_connections(standin, standin->listeners[index], standin->listener_protocols[index]);
+                }
+            }
+
+            link = &standin->connections;
+            while (*link != NULL)
+            {
+                connection = *link;
+                if (connection->closing)
+                {
+                    *link = connection->next;
+                    destroy_connection(standin, connection);
+                }
+                else
+                {
+                    link = &connection->next;
+                }
+            }
+            (void)Unlock(standin->lock);
+        }
+
+        free(polled);
+        free(poll_fds);
+    }
+}
+
+static int worker_thread(void* context)
+{
+    IOTHUB_STANDIN* standin = (IOTHUB_STANDIN*)context;
+
+    while (standin->keep_running)
+    {
+        IoTHubStandIn_DoWork(standin, WORKER_POLL_MS);
+    }
+    return 0;
+}
+
+static void close_listeners(IOTHUB_STANDIN* standin)
+{
+    size_t index;
+    for (index = 0; index < standin->listener_count; index++)
+    {
+        (void)close(standin->listeners[index]);
+    }
+    standin->listener_count = 0;
+}
+
+IOTHUB_STANDIN_HANDLE IoTHubStandIn_Create(const IOTHUB_STANDIN_CONFIG* config)
+{
+    IOTHUB_STANDIN* result;
+
+    if (config == NULL || config->policy_key == NULL || config->loss_percent > 100 ||
+        (config->certificate_file == NULL) != (config->private_key_file == NULL))
+    {
+        LogError("Invalid argument (config=%p)", config);
+        result = NULL;
+    }
+    else if ((result = (IOTHUB_STANDIN*)malloc(sizeof(IOTHUB_STANDIN))) == NULL)
+    {
+        LogError("Failure allocating the stand-in");
+    }
+    else
+    {
+        int mqtt_port = (config->mqtt_port == 0) ? IOTHUB_STANDIN_DEFAULT_MQTT_PORT : config->mqtt_port;
+        int https_port = (config->https_port == 0) ? IOTHUB_STANDIN_DEFAULT_HTTPS_PORT : config->https_port;
+#ifdef USE_AMQP
+        int amqp_port = (config->amqp_port == 0) ? IOTHUB_STANDIN_DEFAULT_AMQP_PORT : config->amqp_port;
+#endif
+
+        memset(result, 0, sizeof(IOTHUB_STANDIN));
+        result->wakeup[0] = -1;
+        result->wakeup[1] = -1;
+        result->latency_ms = config->latency_ms;
+        result->jitter_ms = config->jitter_ms;
+        result->loss_percent = config->loss_percent;
+        result->random_state = (config->seed == 0) ? DEFAULT_RANDOM_SEED : config->seed;
+
+        if (mallocAndStrcpy_s(&result->host_name, config->host_name != NULL ? config->host_name : IOTHUB_STANDIN_DEFAULT_HOST_NAME) != 0 ||
+            mallocAndStrcpy_s(&result->policy_name, config->policy_name != NULL ? config->policy_name : IOTHUB_STANDIN_DEFAULT_POLICY_NAME) != 0 ||
+            mallocAndStrcpy_s(&result->policy_key, config->policy_key) != 0)
+        {
+            LogError("Failure copying the configuration");
+            IoTHubStandIn_Destroy(result);
+            result = NULL;
+        }
+        else if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("Failure creating the lock");
+            IoTHubStandIn_Destroy(result);
+            result = NULL;
+        }
+        else if (pipe(result->wakeup) != 0 || standin_set_non_blocking(result->wakeup[0]) != 0 || standin_set_non_blocking(result->wakeup[1]) != 0)
+        {
+            LogError("Failure creating the wake up pipe");
+            IoTHubStandIn_Destroy(result);
+            result = NULL;
+        }
+        else if ((result->ssl_ctx = standin_tls_create_context(config->certificate_file, config->private_key_file, result->host_name, &result->certificate)) == NULL)
+        {
+            IoTHubStandIn_Destroy(result);
+            result = NULL;
+        }
+        else if ((mqtt_port != IOTHUB_STANDIN_PORT_DISABLED && create_listener(result, mqtt_port, STANDIN_PROTOCOL_MQTT) != 0) ||
+            (https_port != IOTHUB_STANDIN_PORT_DISABLED && create_listener(result, https_port, STANDIN_PROTOCOL_HTTP) != 0))
+        {
+            IoTHubStandIn_Destroy(result);
+            result = NULL;
+        }
+#ifdef USE_AMQP
+        else if (amqp_port != IOTHUB_STANDIN_PORT_DISABLED && standin_amqp_create(result, amqp_port) != 0)
+        {
+            IoTHubStandIn_Destroy(result);
+            result = NULL;
+        }
+#endif
+    }
+    return result;
+}
+
+void IoTHubStandIn_Destroy(IOTHUB_STANDIN_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        IOTHUB_STANDIN* standin = (IOTHUB_STANDIN*)handle;
+        size_t index;
+
+        IoTHubStandIn_Stop(standin);
+
+        while (standin->connections != NULL)
+        {
+            STANDIN_CONNECTION* connection = standin->connections;
+            standin->connections = connection->next;
+            destroy_connection(standin, connection);
+        }
+#ifdef USE_AMQP
+        if (standin->amqp != NULL)
+        {
+            standin_amqp_destroy(standin);
+        }
+#endif
+        while (standin->method_calls != NULL)
+        {
+            standin_remove_method_call(standin, standin->method_calls);
+        }
+        while (standin->devices != NULL)
+        {
+            standin_delete_device(standin, standin->devices);
+        }
+        for (index = 0; index < STANDIN_EVENT_CAPACITY; index++)
+        {
+            free(standin->events[index].device_id);
+            free(standin->events[index].data);
+        }
+
+        close_listeners(standin);
+        if (standin->wakeup[0] != -1)
+        {
+            (void)close(standin->wakeup[0]);
+            (void)close(standin->wakeup[1]);
+        }
+        if (standin->ssl_ctx != NULL)
+        {
+            SSL_CTX_free(standin->ssl_ctx);
+        }
+        if (standin->lock != NULL)
+        {
+            (void)Lock_Deinit(standin->lock);
+        }
+        free(standin->certificate);
+        free(standin->host_name);
+        free(standin->policy_name);
+        free(standin->policy_key);
+        free(standin);
+    }
+}
+
+int IoTHubStandIn_AddDevice(IOTHUB_STANDIN_HANDLE handle, const char* deviceId, const char* primaryKey)
+{
+    int result;
+
+    if (handle == NULL || deviceId == NULL || primaryKey == NULL)
+    {
+        LogError("Invalid argument (handle=%p, deviceId=%p, primaryKey=%p)", handle, deviceId, primaryKey);
+        result = __FAILURE__;
+    }
+    else
+    {
+        IOTHUB_STANDIN* standin = (IOTHUB_STANDIN*)handle;
+
+        (void)Lock(standin->lock);
+        if (standin_find_device(standin, deviceId) != NULL)
+        {
+            LogError("The device %s already exists", deviceId);
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = (standin_create_device(standin, deviceId, primaryKey, NULL, NULL) == NULL) ? __FAILURE__ : 0;
+        }
+        (void)Unlock(standin->lock);
+    }
+    return result;
+}
+
+const char* IoTHubStandIn_GetCertificate(IOTHUB_STANDIN_HANDLE handle)
+{
+    return (handle == NULL) ? NULL : ((IOTHUB_STANDIN*)handle)->certificate;
+}
+
+int IoTHubStandIn_Start(IOTHUB_STANDIN_HANDLE handle)
+{
+    int result;
+
+    if (handle == NULL)
+    {
+        LogError("Invalid argument (handle=NULL)");
+        result = __FAILURE__;
+    }
+    else if (handle->worker != NULL)
+    {
+        LogError("The stand-in is already running");
+        result = __FAILURE__;
+    }
+    else
+    {
+        handle->keep_running = true;
+        if (ThreadAPI_Create(&handle->worker, worker_thread, handle) != THREADAPI_OK)
+        {
+            LogError("Failure starting the worker thread");
+            handle->keep_running = false;
+            handle->worker = NULL;
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+void IoTHubStandIn_Stop(IOTHUB_STANDIN_HANDLE handle)
+{
+    if (handle != NULL && handle->worker != NULL)
+    {
+        int thread_result;
+
+        handle->keep_running = false;
+        wake_up_worker(handle);
+        (void)ThreadAPI_Join(handle->worker, &thread_result);
+        handle->worker = NULL;
+    }
+}
+
+int IoTHubStandIn_SendCloudToDevice(IOTHUB_STANDIN_HANDLE handle, const char* deviceId, const unsigned char* data, size_t size)
+{
+    int result;
+
+    if (handle == NULL || deviceId == NULL || (data == NULL && size > 0))
+    {
+        LogError("Invalid argument (handle=%p, deviceId=%p, data=%p)", handle, deviceId, data);
+        result = __FAILURE__;
+    }
+    else
+    {
+        STANDIN_DEVICE* device;
+
+        (void)Lock(handle->lock);
+        if ((device = standin_find_device(handle, deviceId)) == NULL)
+        {
+            LogError("Unknown device %s", deviceId);
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = standin_enqueue_c2d(handle, device, data, size);
+        }
+        (void)Unlock(handle->lock);
+    }
+    return result;
+}
+
+int IoTHubStandIn_UpdateDesired(IOTHUB_STANDIN_HANDLE handle, const char* deviceId, const char* patch)
+{
+    int result;
+
+    if (handle == NULL || deviceId == NULL || patch == NULL)
+    {
+        LogError("Invalid argument (handle=%p, deviceId=%p, patch=%p)", handle, deviceId, patch);
+        result = __FAILURE__;
+    }
+    else
+    {
+        STANDIN_DEVICE* device;
+        JSON_Value* value;
+
+        (void)Lock(handle->lock);
+        if ((device = standin_find_device(handle, deviceId)) == NULL)
+        {
+            LogError("Unknown device %s", deviceId);
+            result = __FAILURE__;
+        }
+        else if ((value = json_parse_string(patch)) == NULL)
+        {
+            LogError("Invalid desired properties patch");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = standin_update_desired(handle, device, value);
+            json_value_free(value);
+        }
+        (void)Unlock(handle->lock);
+    }
+    return result;
+}
+
+void IoTHubStandIn_SetEventCallback(IOTHUB_STANDIN_HANDLE handle, IOTHUB_STANDIN_EVENT_CALLBACK callback, void* context)
+{
+    if (handle != NULL)
+    {
+        (void)Lock(handle->lock);
+        handle->event_callback = callback;
+        handle->event_callback_context = context;
+        (void)Unlock(handle->lock);
+    }
+}
+
+void IoTHubStandIn_GetStats(IOTHUB_STANDIN_HANDLE handle, IOTHUB_STANDIN_STATS* stats)
+{
+    if (handle != NULL && stats != NULL)
+    {
+        (void)Lock(handle->lock);
+        *stats = handle->stats;
+        (void)Unlock(handle->lock);
+    }
+}
@@ -0,0 +1,209 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Runs the IoT Hub stand-in until it is interrupted, see readme.md for the options */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "azure_c_shared_utility/platform.h"
+
+#include "iothub_standin.h"
+
+#define MAX_DEVICES     256
+
+static volatile sig_atomic_t g_keep_running = 1;
+
+static void on_signal(int signal_number)
+{
+    (void)signal_number;
+    g_keep_running = 0;
+}
+
+static void print_usage(const char* program)
+{
+    (void)printf("Usage: %s --policy-key <base64 key> [options]\r\n", program);
+    (void)printf("  --host-name <name>        HostName of the connection strings (%s)\r\n", IOTHUB_STANDIN_DEFAULT_HOST_NAME);
+    (void)printf("  --policy-name <name>      shared access policy of the service clients (%s)\r\n", IOTHUB_STANDIN_DEFAULT_POLICY_NAME);
+    (void)printf("  --mqtt-port <port>        MQTT port, -1 to disable (%d)\r\n", IOTHUB_STANDIN_DEFAULT_MQTT_PORT);
+    (void)printf("  --https-port <port>       HTTPS port, -1 to disable (%d)\r\n", IOTHUB_STANDIN_DEFAULT_HTTPS_PORT);
+#ifdef USE_AMQP
+    (void)printf("  --amqp-port <port>        AMQP port, -1 to disable (%d)\r\n", IOTHUB_STANDIN_DEFAULT_AMQP_PORT);
+#endif
+    (void)printf("  --cert <file> --key <file> PEM server certificate and key, generated when not set\r\n");
+    (void)printf("  --cert-out <file>         writes the server certificate the clients have to trust\r\n");
+    (void)printf("  --latency-ms <ms>         delay added to everything the stand-in sends\r\n");
+    (void)printf("  --jitter-ms <ms>          upper bound of a random delay added to the latency\r\n");
+    (void)printf("  --loss-percent <percent>  share of the device requests dropped\r\n");
+    (void)printf("  --seed <seed>             seed of the jitter and loss model\r\n");
+    (void)printf("  --device <id>:<key>       registers a device, can be repeated\r\n");
+}
+
+static int write_certificate(const char* path, const char* certificate)
+{
+    int result;
+    FILE* file = fopen(path, "w");
+
+    if (file == NULL)
+    {
+        (void)printf("Failed to open %s\r\n", path);
+        result = __LINE__;
+    }
+    else
+    {
+        result = (fputs(certificate, file) < 0) ? __LINE__ : 0;
+        (void)fclose(file);
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    int result = 0;
+    IOTHUB_STANDIN_CONFIG config;
+    const char* certificate_out = NULL;
+    char* devices[MAX_DEVICES];
+    size_t device_count = 0;
+    int index;
+
+    memset(&config, 0, sizeof(config));
+
+    for (index = 1; result == 0 && index < argc; index++)
+    {
+        const char* value = (index + 1 < argc) ? argv[index + 1] : NULL;
+
+        if (value == NULL)
+        {
+            result = __LINE__;
+        }
+        else if (strcmp(argv[index], "--host-name") == 0)
+        {
+            config.host_name = value;
+        }
+        else if (strcmp(argv[index], "--policy-name") == 0)
+        {
+            config.policy_name = value;
+        }
+        else if (strcmp(argv[index], "--policy-key") == 0)
+        {
+            config.policy_key = value;
+        }
+        else if (strcmp(argv[index], "--mqtt-port") == 0)
+        {
+            config.mqtt_port = atoi(value);
+        }
+        else if (strcmp(argv[index], "--https-port") == 0)
+        {
+            config.https_port = atoi(value);
+        }
+#ifdef USE_AMQP
+        else if (strcmp(argv[index], "--amqp-port") == 0)
+        {
+            config.amqp_port = atoi(value);
+        }
+#endif
+        else if (strcmp(argv[index], "--cert") == 0)
+        {
+            config.certificate_file = value;
+        }
+        else if (strcmp(argv[index], "--key") == 0)
+        {
+            config.private_key_file = value;
+        }
+        else if (strcmp(argv[index], "--cert-out") == 0)
+        {
+            certificate_out = value;
+        }
+        else if (strcmp(argv[index], "--latency-ms") == 0)
+        {
+            config.latency_ms = (unsigned int)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(argv[index], "--jitter-ms") == 0)
+        {
+            config.jitter_ms = (unsigned int)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(argv[index], "--loss-percent") == 0)
+        {
+            config.loss_percent = (unsigned int)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(argv[index], "--seed") == 0)
+        {
+            config.seed = (unsigned int)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(argv[index], "--device") == 0 && device_count < MAX_DEVICES && strchr(value, ':') != NULL)
+        {
+            devices[device_count++] = argv[index + 1];
+        }
+        else
+        {
+            result = __LINE__;
+        }
+        index++;
+    }
+
+    if (result != 0 || config.policy_key == NULL)
+    {
+        print_usage(argv[0]);
+        result = __LINE__;
+    }
+    else if (platform_init() != 0)
+    {
+        (void)printf("Failed to initialize the platform\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        IOTHUB_STANDIN_HANDLE standin;
+
+        if ((standin = IoTHubStandIn_Create(&config)) == NULL)
+        {
+            (void)printf("Failed to start the stand-in\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            size_t device_index;
+
+            for (device_index = 0; result == 0 && device_index < device_count; device_index++)
+            {
+                char* separator = strchr(devices[device_index], ':');
+                *separator = '\0';
+                if (IoTHubStandIn_AddDevice(standin, devices[device_index], separator + 1) != 0)
+                {
+                    (void)printf("Failed to add the device %s\r\n", devices[device_index]);
+                    result = __LINE__;
+                }
+            }
+
+            if (result == 0 && certificate_out != NULL)
+            {
+                result = write_certificate(certificate_out, IoTHubStandIn_GetCertificate(standin));
+            }
+
+            if (result == 0)
+            {
+                IOTHUB_STANDIN_STATS stats;
+
+                (void)signal(SIGINT, on_signal);
+                (void)signal(SIGTERM, on_signal);
+                (void)printf("IoT Hub stand-in running for %s, press Ctrl+C to stop\r\n", (config.host_name == NULL) ? IOTHUB_STANDIN_DEFAULT_HOST_NAME : config.host_name);
+
+                while (g_keep_running)
+                {
+                    IoTHubStandIn_DoWork(standin, 100);
+                }
+
+                IoTHubStandIn_GetStats(standin, &stats);
+                (void)printf("connections: %lu, auth failures: %lu, events: %lu, dropped: %lu, c2d delivered: %lu, twin requests: %lu, method calls: %lu\r\n",
+                    (unsigned long)stats.connections, (unsigned long)stats.auth_failures, (unsigned long)stats.events_received,
+                    (unsigned long)stats.requests_dropped, (unsigned long)stats.c2d_delivered, (unsigned long)stats.twin_requests,
+                    (unsigned long)stats.method_calls);
+            }
+            IoTHubStandIn_Destroy(standin);
+        }
+        platform_deinit();
+    }
+    return result;
+}
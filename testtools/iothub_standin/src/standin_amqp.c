@@ -0,0 +1,1144 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* AMQP devices, served with the server side of uAMQP: the socket listener accepts them, standin_amqp_io.c
+terminates TLS and SASL and the uAMQP connection, sessions and links do the rest. A device authenticates
+with a put-token on $cbs, or with its certificate when it skips SASL. Only the telemetry and the cloud to
+device links are served, the twin and direct method links are refused. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/xio.h"
+#include "azure_c_shared_utility/socketio.h"
+
+#include "azure_uamqp_c/socket_listener.h"
+#include "azure_uamqp_c/header_detect_io.h"
+#include "azure_uamqp_c/connection.h"
+#include "azure_uamqp_c/session.h"
+#include "azure_uamqp_c/link.h"
+#include "azure_uamqp_c/message.h"
+#include "azure_uamqp_c/message_receiver.h"
+#include "azure_uamqp_c/message_sender.h"
+#include "azure_uamqp_c/messaging.h"
+#include "azure_uamqp_c/amqpvalue.h"
+#include "azure_uamqp_c/amqp_definitions.h"
+
+#include "standin_private.h"
+
+#define AMQP_CONTAINER_ID       "iothub_standin"
+#define AMQP_INCOMING_WINDOW    65536
+#define AMQP_BATCHING_FORMAT    0x80013700
+#define AMQP_DATA_DESCRIPTOR    0x75
+#define AMQP_BUSY_POLL_MS       1       /* the AMQP sockets are not in the poll set of the stand-in */
+#define AMQP_IDLE_POLL_MS       10
+
+static const char CBS_NODE[] = "$cbs";
+static const char DEVICES_SEGMENT[] = "/devices/";
+static const char EVENTS_SUFFIX[] = "/messages/events";
+static const char C2D_SUFFIX[] = "/messages/devicebound";
+static const char PUT_TOKEN_OPERATION[] = "put-token";
+
+typedef enum STANDIN_AMQP_LINK_TYPE_TAG
+{
+    STANDIN_AMQP_LINK_CBS_REQUESTS,
+    STANDIN_AMQP_LINK_CBS_RESPONSES,
+    STANDIN_AMQP_LINK_EVENTS,
+    STANDIN_AMQP_LINK_C2D
+} STANDIN_AMQP_LINK_TYPE;
+
+struct STANDIN_AMQP_CONNECTION_TAG;
+
+typedef struct STANDIN_AMQP_LINK_TAG
+{
+    struct STANDIN_AMQP_CONNECTION_TAG* connection;
+    STANDIN_AMQP_LINK_TYPE type;
+    char* device_id;                /* NULL for the $cbs links */
+    LINK_HANDLE link;
+    MESSAGE_RECEIVER_HANDLE receiver;
+    MESSAGE_SENDER_HANDLE sender;
+    bool sender_open;
+    struct STANDIN_AMQP_LINK_TAG* next;
+} STANDIN_AMQP_LINK;
+
+typedef struct STANDIN_AMQP_SESSION_TAG
+{
+    struct STANDIN_AMQP_CONNECTION_TAG* connection;
+    SESSION_HANDLE session;
+    struct STANDIN_AMQP_SESSION_TAG* next;
+} STANDIN_AMQP_SESSION;
+
+typedef struct STANDIN_AMQP_AUTHORIZATION_TAG
+{
+    char* device_id;
+    struct STANDIN_AMQP_AUTHORIZATION_TAG* next;
+} STANDIN_AMQP_AUTHORIZATION;
+
+typedef struct STANDIN_AMQP_CONNECTION_TAG
+{
+    IOTHUB_STANDIN* standin;
+    XIO_HANDLE socket_io;
+    XIO_HANDLE transport_io;
+    XIO_HANDLE header_detect_io;
+    CONNECTION_HANDLE connection;
+    char* peer_thumbprint;
+    STANDIN_AMQP_SESSION* sessions;
+    STANDIN_AMQP_LINK* links;
+    STANDIN_AMQP_AUTHORIZATION* authorizations;     /* devices that put a valid token on $cbs */
+    bool closing;
+    struct STANDIN_AMQP_CONNECTION_TAG* next;
+} STANDIN_AMQP_CONNECTION;
+
+typedef struct STANDIN_AMQP_DELIVERY_TAG
+{
+    STANDIN_AMQP_LINK* link;
+    unsigned long sequence;
+} STANDIN_AMQP_DELIVERY;
+
+typedef struct STANDIN_AMQP_EVENT_DECODING_TAG
+{
+    IOTHUB_STANDIN* standin;
+    STANDIN_DEVICE* device;
+} STANDIN_AMQP_EVENT_DECODING;
+
+typedef struct STANDIN_AMQP_TAG
+{
+    IOTHUB_STANDIN* standin;
+    SOCKET_LISTENER_HANDLE listener;
+    STANDIN_AMQP_CONNECTION* connections;
+} STANDIN_AMQP;
+
+static char* get_node_address(role peer_role, AMQP_VALUE source, AMQP_VALUE target)
+{
+    char* result = NULL;
+    AMQP_VALUE address;
+    const char* address_string;
+
+    // The node of the stand-in is the target of what the peer sends and the source of what it receives
+    if (peer_role == role_sender)
+    {
+        TARGET_HANDLE target_handle;
+        if (target != NULL && amqpvalue_get_target(target, &target_handle) == 0)
+        {
+            if (target_get_address(target_handle, &address) == 0 && amqpvalue_get_string(address, &address_string) == 0 &&
+                mallocAndStrcpy_s(&result, address_string) != 0)
+            {
+                result = NULL;
+            }
+            target_destroy(target_handle);
+        }
+    }
+    else
+    {
+        SOURCE_HANDLE source_handle;
+        if (source != NULL && amqpvalue_get_source(source, &source_handle) == 0)
+        {
+            if (source_get_address(source_handle, &address) == 0 && amqpvalue_get_string(address, &address_string) == 0 &&
+                mallocAndStrcpy_s(&result, address_string) != 0)
+            {
+                result = NULL;
+            }
+            source_destroy(source_handle);
+        }
+    }
+    return result;
+}
+
+// Returns the device id of "...devices/<id><suffix>", NULL when address does not have that form
+static char* get_device_id(const char* address, const char* suffix)
+{
+    char* result = NULL;
+    const char* device_id = strstr(address, DEVICES_SEGMENT);
+
+    if (device_id != NULL)
+    {
+        size_t length;
+
+        device_id += sizeof(DEVICES_SEGMENT) - 1;
+        length = strcspn(device_id, "/");
+        if (length > 0 && strcmp(device_id + length, suffix) == 0 && (result = (char*)malloc(length + 1)) != NULL)
+        {
+            (void)memcpy(result, device_id, length);
+            result[length] = '\0';
+        }
+    }
+    return result;
+}
+
+static char* get_application_property(MESSAGE_HANDLE message, const char* name)
+{
+    char* result = NULL;
+    AMQP_VALUE application_properties;
+
+    if (message_get_application_properties(message, &application_properties) == 0 && application_properties != NULL)
+    {
+        AMQP_VALUE map = amqpvalue_get_inplace_described_value(application_properties);
+        AMQP_VALUE key = amqpvalue_create_string(name);
+        AMQP_VALUE value;
+        const char* string_value;
+
+        if (map != NULL && key != NULL && (value = amqpvalue_get_map_value(map, key)) != NULL)
+        {
+            if (amqpvalue_get_string(value, &string_value) == 0 && mallocAndStrcpy_s(&result, string_value) != 0)
+            {
+                result = NULL;
+            }
+            amqpvalue_destroy(value);
+        }
+        if (key != NULL)
+        {
+            amqpvalue_destroy(key);
+        }
+        amqpvalue_destroy(application_properties);
+    }
+    return result;
+}
+
+static int set_map_entry(AMQP_VALUE map, const char* name, AMQP_VALUE value)
+{
+    int result;
+    AMQP_VALUE key = amqpvalue_create_string(name);
+
+    result = (key == NULL || value == NULL || amqpvalue_set_map_value(map, key, value) != 0) ? __FAILURE__ : 0;
+    if (key != NULL)
+    {
+        amqpvalue_destroy(key);
+    }
+    if (value != NULL)
+    {
+        amqpvalue_destroy(value);
+    }
+    return result;
+}
+
+static STANDIN_AMQP_LINK* find_link(STANDIN_AMQP_CONNECTION* connection, STANDIN_AMQP_LINK_TYPE type)
+{
+    STANDIN_AMQP_LINK* result = connection->links;
+
+    while (result != NULL && (result->type != type || !result->sender_open))
+    {
+        result = result->next;
+    }
+    return result;
+}
+
+static int add_authorization(STANDIN_AMQP_CONNECTION* connection, const char* device_id)
+{
+    int result;
+    STANDIN_AMQP_AUTHORIZATION* authorization = connection->authorizations;
+
+    while (authorization != NULL && strcmp(authorization->device_id, device_id) != 0)
+    {
+        authorization = authorization->next;
+    }
+
+    if (authorization != NULL)
+    {
+        // A token put again before the previous one expires
+        result = 0;
+    }
+    else if ((authorization = (STANDIN_AMQP_AUTHORIZATION*)malloc(sizeof(STANDIN_AMQP_AUTHORIZATION))) == NULL)
+    {
+        LogError("Failure allocating the authorization of %s", device_id);
+        result = __FAILURE__;
+    }
+    else if (mallocAndStrcpy_s(&authorization->device_id, device_id) != 0)
+    {
+        LogError("Failure allocating the authorization of %s", device_id);
+        free(authorization);
+        result = __FAILURE__;
+    }
+    else
+    {
+        authorization->next = connection->authorizations;
+        connection->authorizations = authorization;
+        result = 0;
+    }
+    return result;
+}
+
+static bool is_device_authorized(STANDIN_AMQP_CONNECTION* connection, const char* device_id)
+{
+    bool result;
+    IOTHUB_STANDIN* standin = connection->standin;
+    STANDIN_DEVICE* device = standin_find_device(standin, device_id);
+
+    if (device == NULL)
+    {
+        LogError("Link attached for the unknown device %s", device_id);
+        result = false;
+    }
+    else if (device->thumbprint != NULL)
+    {
+        // Authenticated by the TLS handshake, there is no token on $cbs
+        result = (connection->peer_thumbprint != NULL && strcasecmp(connection->peer_thumbprint, device->thumbprint) == 0);
+    }
+    else
+    {
+        STANDIN_AMQP_AUTHORIZATION* authorization = connection->authorizations;
+        while (authorization != NULL && strcmp(authorization->device_id, device_id) != 0)
+        {
+            authorization = authorization->next;
+        }
+        result = (authorization != NULL);
+    }
+
+    if (!result)
+    {
+        standin->stats.auth_failures++;
+    }
+    return result;
+}
+
+static void on_cbs_response_sent(void* context, MESSAGE_SEND_RESULT send_result)
+{
+    (void)context;
+    if (send_result == MESSAGE_SEND_ERROR)
+    {
+        LogError("The device did not accept the $cbs response");
+    }
+}
+
+static int send_cbs_response(STANDIN_AMQP_CONNECTION* connection, AMQP_VALUE correlation_id, int status_code, const char* status_description)
+{
+    int result;
+    STANDIN_AMQP_LINK* response_link = find_link(connection, STANDIN_AMQP_LINK_CBS_RESPONSES);
+    MESSAGE_HANDLE message = NULL;
+    PROPERTIES_HANDLE properties = NULL;
+    AMQP_VALUE application_properties = NULL;
+    AMQP_VALUE body = NULL;
+
+    if (response_link == NULL)
+    {
+        LogError("The device has no $cbs link to receive the response on");
+        result = __FAILURE__;
+    }
+    else if ((message = message_create()) == NULL ||
+        (properties = properties_create()) == NULL ||
+        properties_set_correlation_id(properties, correlation_id) != 0 ||
+        message_set_properties(message, properties) != 0 ||
+        (application_properties = amqpvalue_create_map()) == NULL ||
+        set_map_entry(application_properties, "status-code", amqpvalue_create_int(status_code)) != 0 ||
+        set_map_entry(application_properties, "status-description", amqpvalue_create_string(status_description)) != 0 ||
+        message_set_application_properties(message, application_properties) != 0 ||
+        (body = amqpvalue_create_null()) == NULL ||
+        message_set_body_amqp_value(message, body) != 0)
+    {
+        LogError("Failure building the $cbs response");
+        result = __FAILURE__;
+    }
+    else if (messagesender_send_async(response_link->sender, message, on_cbs_response_sent, NULL, 0) == NULL)
+    {
+        LogError("Failure sending the $cbs response");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+
+    if (body != NULL)
+    {
+        amqpvalue_destroy(body);
+    }
+    if (application_properties != NULL)
+    {
+        amqpvalue_destroy(application_properties);
+    }
+    if (properties != NULL)
+    {
+        properties_destroy(properties);
+    }
+    if (message != NULL)
+    {
+        message_destroy(message);
+    }
+    return result;
+}
+
+static AMQP_VALUE on_cbs_request_received(const void* context, MESSAGE_HANDLE message)
+{
+    AMQP_VALUE result;
+    STANDIN_AMQP_LINK* link = (STANDIN_AMQP_LINK*)context;
+    STANDIN_AMQP_CONNECTION* connection = link->connection;
+    IOTHUB_STANDIN* standin = connection->standin;
+    PROPERTIES_HANDLE properties = NULL;
+    AMQP_VALUE message_id;
+    AMQP_VALUE body;
+    const char* token;
+    char* operation = NULL;
+    char* name = NULL;
+
+    if (message_get_properties(message, &properties) != 0 || properties == NULL ||
+        properties_get_message_id(properties, &message_id) != 0 ||
+        (operation = get_application_property(message, "operation")) == NULL ||
+        (name = get_application_property(message, "name")) == NULL ||
+        message_get_body_amqp_value_in_place(message, &body) != 0 ||
+        amqpvalue_get_string(body, &token) != 0)
+    {
+        LogError("Malformed $cbs request");
+        result = messaging_delivery_rejected("amqp:decode-error", "Malformed $cbs request");
+    }
+    else if (standin_drop_request(standin))
+    {
+        // Never answered, the device times out waiting for the status
+        result = messaging_delivery_accepted();
+    }
+    else
+    {
+        int status_code;
+        const char* status_description;
+        char* device_id = NULL;
+        STANDIN_DEVICE* device = NULL;
+
+        if (strcmp(operation, PUT_TOKEN_OPERATION) != 0)
+        {
+            status_code = 400;
+            status_description = "Unsupported operation";
+        }
+        else if ((device_id = get_device_id(name, "")) == NULL || (device = standin_find_device(standin, device_id)) == NULL)
+        {
+            standin->stats.auth_failures++;
+            status_code = 404;
+            status_description = "Unknown device";
+        }
+        else if (standin_authenticate_device(standin, device, token, NULL) != 0)
+        {
+            status_code = 401;
+            status_description = "Unauthorized";
+        }
+        else if (add_authorization(connection, device_id) != 0)
+        {
+            status_code = 500;
+            status_description = "Internal error";
+        }
+        else
+        {
+            status_code = 200;
+            status_description = "OK";
+        }
+
+        (void)send_cbs_response(connection, message_id, status_code, status_description);
+        free(device_id);
+        result = messaging_delivery_accepted();
+    }
+
+    free(operation);
+    free(name);
+    if (properties != NULL)
+    {
+        properties_destroy(properties);
+    }
+    return result;
+}
+
+static void on_batched_value_decoded(void* context, AMQP_VALUE decoded_value)
+{
+    STANDIN_AMQP_EVENT_DECODING* decoding = (STANDIN_AMQP_EVENT_DECODING*)context;
+    AMQP_VALUE descriptor = amqpvalue_get_inplace_descriptor(decoded_value);
+    uint64_t descriptor_code;
+    amqp_binary data;
+
+    // A batched message is the sections of the message encoded one after the other, only the data counts
+    if (descriptor != NULL && amqpvalue_get_ulong(descriptor, &descriptor_code) == 0 && descriptor_code == AMQP_DATA_DESCRIPTOR &&
+        amqpvalue_get_binary(amqpvalue_get_inplace_described_value(decoded_value), &data) == 0)
+    {
+        standin_record_event(decoding->standin, decoding->device, (const unsigned char*)data.bytes, data.length);
+    }
+}
+
+static int record_events(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, MESSAGE_HANDLE message, bool is_batch)
+{
+    int result;
+    size_t data_count;
+
+    if (message_get_body_amqp_data_count(message, &data_count) != 0)
+    {
+        LogError("Telemetry from %s without data", device->device_id);
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t index;
+
+        result = 0;
+        for (index = 0; result == 0 && index < data_count; index++)
+        {
+            BINARY_DATA data;
+
+            if (message_get_body_amqp_data_in_place(message, index, &data) != 0)
+            {
+                LogError("Failure reading the telemetry from %s", device->device_id);
+                result = __FAILURE__;
+            }
+            else if (!is_batch)
+            {
+                standin_record_event(standin, device, data.bytes, data.length);
+            }
+            else
+            {
+                STANDIN_AMQP_EVENT_DECODING decoding;
+                AMQPVALUE_DECODER_HANDLE decoder;
+
+                decoding.standin = standin;
+                decoding.device = device;
+                if ((decoder = amqpvalue_decoder_create(on_batched_value_decoded, &decoding)) == NULL)
+                {
+                    LogError("Failure creating the AMQP decoder");
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    if (amqpvalue_decode_bytes(decoder, data.bytes, data.length) != 0)
+                    {
+                        LogError("Malformed batched telemetry from %s", device->device_id);
+                        result = __FAILURE__;
+                    }
+                    amqpvalue_decoder_destroy(decoder);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static AMQP_VALUE on_event_received(const void* context, MESSAGE_HANDLE message)
+{
+    AMQP_VALUE result;
+    STANDIN_AMQP_LINK* link = (STANDIN_AMQP_LINK*)context;
+    IOTHUB_STANDIN* standin = link->connection->standin;
+    STANDIN_DEVICE* device = standin_find_device(standin, link->device_id);
+    uint32_t message_format;
+
+    if (device == NULL)
+    {
+        LogError("Telemetry from the unknown device %s", link->device_id);
+        result = messaging_delivery_rejected("amqp:not-found", "Unknown device");
+    }
+    else if (message_get_message_format(message, &message_format) != 0)
+    {
+        LogError("Failure reading the message format");
+        result = messaging_delivery_rejected("amqp:decode-error", "Malformed telemetry");
+    }
+    else if (standin_drop_request(standin))
+    {
+        // Not processed, the device has to send it again
+        result = messaging_delivery_released();
+    }
+    else if (record_events(standin, device, message, message_format == AMQP_BATCHING_FORMAT) != 0)
+    {
+        result = messaging_delivery_rejected("amqp:decode-error", "Malformed telemetry");
+    }
+    else
+    {
+        result = messaging_delivery_accepted();
+    }
+    return result;
+}
+
+static void on_c2d_send_complete(void* context, MESSAGE_SEND_RESULT send_result)
+{
+    STANDIN_AMQP_DELIVERY* delivery = (STANDIN_AMQP_DELIVERY*)context;
+    STANDIN_AMQP_LINK* link = delivery->link;
+    IOTHUB_STANDIN* standin = link->connection->standin;
+    STANDIN_DEVICE* device = standin_find_device(standin, link->device_id);
+    STANDIN_C2D_MESSAGE* message = NULL;
+
+    if (device != NULL)
+    {
+        message = device->c2d_head;
+        while (message != NULL && message->sequence != delivery->sequence)
+        {
+            message = message->next;
+        }
+    }
+
+    if (message != NULL)
+    {
+        if (send_result == MESSAGE_SEND_OK)
+        {
+            standin->stats.c2d_delivered++;
+            standin_remove_c2d(device, message);
+        }
+        else if (send_result == MESSAGE_SEND_ERROR)
+        {
+            // Rejected or abandoned by the device, uAMQP does not tell the outcomes apart
+            standin_remove_c2d(device, message);
+        }
+        else
+        {
+            // The link went away before the device settled the message
+            message->state = STANDIN_C2D_QUEUED;
+            if (device->amqp_c2d_link != NULL && device->amqp_c2d_link != link)
+            {
+                standin_amqp_deliver_c2d(standin, device);
+            }
+        }
+    }
+    free(delivery);
+}
+
+static int send_c2d(STANDIN_AMQP_LINK* link, STANDIN_C2D_MESSAGE* c2d_message)
+{
+    int result;
+    STANDIN_AMQP_DELIVERY* delivery;
+    MESSAGE_HANDLE message = NULL;
+    PROPERTIES_HANDLE properties = NULL;
+    AMQP_VALUE message_id = NULL;
+    char message_id_string[32];
+    BINARY_DATA body;
+
+    (void)snprintf(message_id_string, sizeof(message_id_string), "%lu", c2d_message->sequence);
+    body.bytes = c2d_message->data;
+    body.length = c2d_message->size;
+
+    if ((delivery = (STANDIN_AMQP_DELIVERY*)malloc(sizeof(STANDIN_AMQP_DELIVERY))) == NULL)
+    {
+        LogError("Failure allocating the cloud to device delivery");
+        result = __FAILURE__;
+    }
+    else if ((message = message_create()) == NULL ||
+        (properties = properties_create()) == NULL ||
+        (message_id = amqpvalue_create_string(message_id_string)) == NULL ||
+        properties_set_message_id(properties, message_id) != 0 ||
+        message_set_properties(message, properties) != 0 ||
+        message_add_body_amqp_data(message, body) != 0)
+    {
+        LogError("Failure building the cloud to device message");
+        free(delivery);
+        result = __FAILURE__;
+    }
+    else
+    {
+        delivery->link = link;
+        delivery->sequence = c2d_message->sequence;
+        if (messagesender_send_async(link->sender, message, on_c2d_send_complete, delivery, 0) == NULL)
+        {
+            LogError("Failure sending the cloud to device message");
+            free(delivery);
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    if (message_id != NULL)
+    {
+        amqpvalue_destroy(message_id);
+    }
+    if (properties != NULL)
+    {
+        properties_destroy(properties);
+    }
+    if (message != NULL)
+    {
+        message_destroy(message);
+    }
+    return result;
+}
+
+static void on_message_sender_state_changed(void* context, MESSAGE_SENDER_STATE new_state, MESSAGE_SENDER_STATE previous_state)
+{
+    STANDIN_AMQP_LINK* link = (STANDIN_AMQP_LINK*)context;
+    (void)previous_state;
+
+    link->sender_open = (new_state == MESSAGE_SENDER_STATE_OPEN);
+    if (link->sender_open && link->type == STANDIN_AMQP_LINK_C2D)
+    {
+        IOTHUB_STANDIN* standin = link->connection->standin;
+        STANDIN_DEVICE* device = standin_find_device(standin, link->device_id);
+        if (device != NULL && device->amqp_c2d_link == link)
+        {
+            standin_amqp_deliver_c2d(standin, device);
+        }
+    }
+}
+
+static void destroy_link(STANDIN_AMQP_LINK* link)
+{
+    if (link->type == STANDIN_AMQP_LINK_C2D)
+    {
+        STANDIN_DEVICE* device = standin_find_device(link->connection->standin, link->device_id);
+        if (device != NULL && device->amqp_c2d_link == link)
+        {
+            device->amqp_c2d_link = NULL;
+        }
+    }
+    link->sender_open = false;
+
+    if (link->receiver != NULL)
+    {
+        messagereceiver_destroy(link->receiver);
+    }
+    if (link->sender != NULL)
+    {
+        // Completes what the device did not settle with MESSAGE_SEND_CANCELLED
+        messagesender_destroy(link->sender);
+    }
+    if (link->link != NULL)
+    {
+        link_destroy(link->link);
+    }
+    free(link->device_id);
+    free(link);
+}
+
+static int open_link(STANDIN_AMQP_LINK* link)
+{
+    int result;
+
+    if (link->type == STANDIN_AMQP_LINK_CBS_REQUESTS || link->type == STANDIN_AMQP_LINK_EVENTS)
+    {
+        ON_MESSAGE_RECEIVED on_message_received = (link->type == STANDIN_AMQP_LINK_EVENTS) ? on_event_received : on_cbs_request_received;
+
+        // The SDK sizes its telemetry batches after the maximum message size of the stand-in
+        if (link_set_rcv_settle_mode(link->link, receiver_settle_mode_first) != 0 ||
+            link_set_max_message_size(link->link, STANDIN_MAX_PACKET_SIZE) != 0 ||
+            (link->receiver = messagereceiver_create(link->link, NULL, NULL)) == NULL ||
+            messagereceiver_open(link->receiver, on_message_received, link) != 0)
+        {
+            LogError("Failure opening the message receiver");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    else
+    {
+        if ((link->sender = messagesender_create(link->link, on_message_sender_state_changed, link)) == NULL ||
+            messagesender_open(link->sender) != 0)
+        {
+            LogError("Failure opening the message sender");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static bool on_link_attached(void* context, LINK_ENDPOINT_HANDLE new_link_endpoint, const char* name, role role, AMQP_VALUE source, AMQP_VALUE target)
+{
+    bool result;
+    STANDIN_AMQP_SESSION* session = (STANDIN_AMQP_SESSION*)context;
+    STANDIN_AMQP_CONNECTION* connection = session->connection;
+    STANDIN_AMQP_LINK* link;
+    char* address;
+
+    if ((address = get_node_address(role, source, target)) == NULL)
+    {
+        LogError("Link %s attached without an address", name);
+        result = false;
+    }
+    else if ((link = (STANDIN_AMQP_LINK*)malloc(sizeof(STANDIN_AMQP_LINK))) == NULL)
+    {
+        LogError("Failure allocating the link %s", name);
+        free(address);
+        result = false;
+    }
+    else
+    {
+        memset(link, 0, sizeof(STANDIN_AMQP_LINK));
+        link->connection = connection;
+
+        if (strcmp(address, CBS_NODE) == 0)
+        {
+            link->type = (role == role_sender) ? STANDIN_AMQP_LINK_CBS_REQUESTS : STANDIN_AMQP_LINK_CBS_RESPONSES;
+            result = true;
+        }
+        else if (role == role_sender && (link->device_id = get_device_id(address, EVENTS_SUFFIX)) != NULL)
+        {
+            link->type = STANDIN_AMQP_LINK_EVENTS;
+            result = is_device_authorized(connection, link->device_id);
+        }
+        else if (role == role_receiver && (link->device_id = get_device_id(address, C2D_SUFFIX)) != NULL)
+        {
+            link->type = STANDIN_AMQP_LINK_C2D;
+            result = is_device_authorized(connection, link->device_id);
+        }
+        else
+        {
+            LogInfo("Refusing the link to %s, only telemetry and cloud to device are served over AMQP", address);
+            result = false;
+        }
+
+        if (!result)
+        {
+            if (link->device_id != NULL)
+            {
+                LogError("Refusing the link of %s, the device is not authenticated", link->device_id);
+            }
+            destroy_link(link);
+        }
+        // uAMQP turns the role of the peer around and swaps source and target
+        else if ((link->link = link_create_from_endpoint(session->session, new_link_endpoint, name, role, source, target)) == NULL ||
+            open_link(link) != 0)
+        {
+            LogError("Failure creating the link %s", name);
+            destroy_link(link);
+            result = false;
+        }
+        else
+        {
+            link->next = connection->links;
+            connection->links = link;
+
+            if (link->type == STANDIN_AMQP_LINK_C2D)
+            {
+                // A device attaching again replaces its previous link, the messages follow when that one closes
+                standin_find_device(connection->standin, link->device_id)->amqp_c2d_link = link;
+            }
+        }
+        free(address);
+    }
+    return result;
+}
+
+static bool on_new_session_endpoint(void* context, ENDPOINT_HANDLE new_endpoint)
+{
+    bool result;
+    STANDIN_AMQP_CONNECTION* connection = (STANDIN_AMQP_CONNECTION*)context;
+    STANDIN_AMQP_SESSION* session;
+
+    if ((session = (STANDIN_AMQP_SESSION*)malloc(sizeof(STANDIN_AMQP_SESSION))) == NULL)
+    {
+        LogError("Failure allocating the session");
+        result = false;
+    }
+    else
+    {
+        session->connection = connection;
+        if ((session->session = session_create_from_endpoint(connection->connection, new_endpoint, on_link_attached, session)) == NULL)
+        {
+            LogError("Failure creating the session");
+            free(session);
+            result = false;
+        }
+        else if (session_set_incoming_window(session->session, AMQP_INCOMING_WINDOW) != 0 || session_begin(session->session) != 0)
+        {
+            LogError("Failure beginning the session");
+            session_destroy(session->session);
+            free(session);
+            result = false;
+        }
+        else
+        {
+            session->next = connection->sessions;
+            connection->sessions = session;
+            result = true;
+        }
+    }
+    return result;
+}
+
+static void on_connection_state_changed(void* context, CONNECTION_STATE new_connection_state, CONNECTION_STATE previous_connection_state)
+{
+    STANDIN_AMQP_CONNECTION* connection = (STANDIN_AMQP_CONNECTION*)context;
+    (void)previous_connection_state;
+
+    if (new_connection_state == CONNECTION_STATE_END || new_connection_state == CONNECTION_STATE_ERROR || new_connection_state == CONNECTION_STATE_DISCARDING)
+    {
+        connection->closing = true;
+    }
+}
+
+static void on_connection_io_error(void* context)
+{
+    ((STANDIN_AMQP_CONNECTION*)context)->closing = true;
+}
+
+static void destroy_connection(STANDIN_AMQP_CONNECTION* connection)
+{
+    while (connection->links != NULL)
+    {
+        STANDIN_AMQP_LINK* link = connection->links;
+        connection->links = link->next;
+        destroy_link(link);
+    }
+    while (connection->sessions != NULL)
+    {
+        STANDIN_AMQP_SESSION* session = connection->sessions;
+        connection->sessions = session->next;
+        session_destroy(session->session);
+        free(session);
+    }
+    while (connection->authorizations != NULL)
+    {
+        STANDIN_AMQP_AUTHORIZATION* authorization = connection->authorizations;
+        connection->authorizations = authorization->next;
+        free(authorization->device_id);
+        free(authorization);
+    }
+
+    if (connection->connection != NULL)
+    {
+        connection_destroy(connection->connection);
+    }
+    if (connection->header_detect_io != NULL)
+    {
+        xio_destroy(connection->header_detect_io);
+    }
+    if (connection->transport_io != NULL)
+    {
+        xio_destroy(connection->transport_io);
+    }
+    // Closes the socket
+    xio_destroy(connection->socket_io);
+    free(connection->peer_thumbprint);
+    free(connection);
+}
+
+static int start_connection(IOTHUB_STANDIN* standin, STANDIN_AMQP_CONNECTION* connection)
+{
+    int result;
+    STANDIN_AMQP_IO_CONFIG amqp_io_config;
+    HEADER_DETECT_ENTRY header_detect_entry;
+    HEADER_DETECT_IO_CONFIG header_detect_io_config;
+
+    amqp_io_config.underlying_io = connection->socket_io;
+    amqp_io_config.standin = standin;
+    amqp_io_config.peer_thumbprint = &connection->peer_thumbprint;
+
+    // Only AMQP is expected once SASL is done, the connection is the last layer
+    header_detect_entry.header = header_detect_io_get_amqp_header();
+    header_detect_entry.io_interface_description = NULL;
+
+    if ((connection->transport_io = xio_create(standin_amqp_io_get_interface_description(), &amqp_io_config)) == NULL)
+    {
+        LogError("Failure creating the AMQP IO");
+        result = __FAILURE__;
+    }
+    else
+    {
+        header_detect_io_config.underlying_io = connection->transport_io;
+        header_detect_io_config.header_detect_entries = &header_detect_entry;
+        header_detect_io_config.header_detect_entry_count = 1;
+
+        if ((connection->header_detect_io = xio_create(header_detect_io_get_interface_description(), &header_detect_io_config)) == NULL)
+        {
+            LogError("Failure creating the header detection IO");
+            result = __FAILURE__;
+        }
+        else if ((connection->connection = connection_create2(connection->header_detect_io, standin->host_name, AMQP_CONTAINER_ID,
+            on_new_session_endpoint, connection, on_connection_state_changed, connection, on_connection_io_error, connection)) == NULL)
+        {
+            LogError("Failure creating the AMQP connection");
+            result = __FAILURE__;
+        }
+        else if (connection_listen(connection->connection) != 0)
+        {
+            LogError("Failure listening on the AMQP connection");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void on_socket_accepted(void* context, const IO_INTERFACE_DESCRIPTION* interface_description, void* io_parameters)
+{
+    STANDIN_AMQP* amqp = (STANDIN_AMQP*)context;
+    IOTHUB_STANDIN* standin = amqp->standin;
+    int socket = *(int*)((SOCKETIO_CONFIG*)io_parameters)->accepted_socket;
+    int no_delay = 1;
+    STANDIN_AMQP_CONNECTION* connection;
+
+    // The listener hands the socket over blocking
+    (void)setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    if (standin_set_non_blocking(socket) != 0)
+    {
+        LogError("Failure configuring the socket");
+        (void)close(socket);
+    }
+    else if ((connection = (STANDIN_AMQP_CONNECTION*)malloc(sizeof(STANDIN_AMQP_CONNECTION))) == NULL)
+    {
+        LogError("Failure allocating the connection");
+        (void)close(socket);
+    }
+    else
+    {
+        memset(connection, 0, sizeof(STANDIN_AMQP_CONNECTION));
+        connection->standin = standin;
+
+        if ((connection->socket_io = xio_create(interface_description, io_parameters)) == NULL)
+        {
+            LogError("Failure creating the socket IO");
+            (void)close(socket);
+            free(connection);
+        }
+        else if (start_connection(standin, connection) != 0)
+        {
+            destroy_connection(connection);
+        }
+        else
+        {
+            connection->next = amqp->connections;
+            amqp->connections = connection;
+            standin->stats.connections++;
+        }
+    }
+}
+
+int standin_amqp_create(IOTHUB_STANDIN* standin, int port)
+{
+    int result;
+    STANDIN_AMQP* amqp;
+
+    if ((amqp = (STANDIN_AMQP*)malloc(sizeof(STANDIN_AMQP))) == NULL)
+    {
+        LogError("Failure allocating the AMQP listener");
+        result = __FAILURE__;
+    }
+    else
+    {
+        memset(amqp, 0, sizeof(STANDIN_AMQP));
+        amqp->standin = standin;
+
+        if ((amqp->listener = socketlistener_create(port)) == NULL)
+        {
+            LogError("Failure creating the AMQP listener on port %d", port);
+            free(amqp);
+            result = __FAILURE__;
+        }
+        else if (socketlistener_start(amqp->listener, on_socket_accepted, amqp) != 0)
+        {
+            LogError("Failure listening on port %d", port);
+            socketlistener_destroy(amqp->listener);
+            free(amqp);
+            result = __FAILURE__;
+        }
+        else
+        {
+            standin->amqp = amqp;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+void standin_amqp_destroy(IOTHUB_STANDIN* standin)
+{
+    STANDIN_AMQP* amqp = standin->amqp;
+
+    while (amqp->connections != NULL)
+    {
+        STANDIN_AMQP_CONNECTION* connection = amqp->connections;
+        amqp->connections = connection->next;
+        destroy_connection(connection);
+    }
+    (void)socketlistener_stop(amqp->listener);
+    socketlistener_destroy(amqp->listener);
+    free(amqp);
+    standin->amqp = NULL;
+}
+
+void standin_amqp_dowork(IOTHUB_STANDIN* standin)
+{
+    STANDIN_AMQP* amqp = standin->amqp;
+    STANDIN_AMQP_CONNECTION* connection;
+    STANDIN_AMQP_CONNECTION** link;
+
+    socketlistener_dowork(amqp->listener);
+
+    for (connection = amqp->connections; connection != NULL; connection = connection->next)
+    {
+        if (!connection->closing)
+        {
+            connection_dowork(connection->connection);
+        }
+    }
+
+    link = &amqp->connections;
+    while (*link != NULL)
+    {
+        connection = *link;
+        if (connection->closing)
+        {
+            *link = connection->next;
+            destroy_connection(connection);
+        }
+        else
+        {
+            link = &connection->next;
+        }
+    }
+}
+
+uint64_t standin_amqp_get_deadline(IOTHUB_STANDIN* standin, uint64_t now)
+{
+    return now + ((standin->amqp->connections != NULL) ? AMQP_BUSY_POLL_MS : AMQP_IDLE_POLL_MS);
+}
+
+void standin_amqp_deliver_c2d(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device)
+{
+    STANDIN_AMQP_LINK* link = device->amqp_c2d_link;
+    (void)standin;
+
+    if (link != NULL && link->sender_open)
+    {
+        STANDIN_C2D_MESSAGE* message;
+
+        for (message = device->c2d_head; message != NULL; message = message->next)
+        {
+            if (message->state == STANDIN_C2D_QUEUED)
+            {
+                if (send_c2d(link, message) != 0)
+                {
+                    LogError("Failure sending the cloud to device message to %s", device->device_id);
+                    break;
+                }
+                message->state = STANDIN_C2D_IN_FLIGHT;
+            }
+        }
+    }
+}
+
+void standin_amqp_on_delete_device(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device)
+{
+    device->amqp_c2d_link = NULL;
+
+    // Like MQTT, the connections of a deleted device are closed
+    if (standin->amqp != NULL)
+    {
+        STANDIN_AMQP_CONNECTION* connection;
+
+        for (connection = standin->amqp->connections; connection != NULL; connection = connection->next)
+        {
+            STANDIN_AMQP_LINK* link = connection->links;
+            STANDIN_AMQP_AUTHORIZATION* authorization = connection->authorizations;
+
+            while (link != NULL && (link->device_id == NULL || strcmp(link->device_id, device->device_id) != 0))
+            {
+                link = link->next;
+            }
+            while (authorization != NULL && strcmp(authorization->device_id, device->device_id) != 0)
+            {
+                authorization = authorization->next;
+            }
+            if (link != NULL || authorization != NULL)
+            {
+                connection->closing = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,643 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* IO between the socket of an AMQP device and the header detection of its uAMQP connection. It
+terminates TLS, answers the SASL exchange (any mechanism is accepted, the device puts its SAS token
+on $cbs afterwards) and holds back what the stand-in sends for the latency model, like standin_send
+does for the MQTT and HTTPS connections. Devices using a certificate skip SASL, their AMQP header is
+passed on untouched. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/ssl.h>
+
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/xio.h"
+
+#include "standin_private.h"
+
+#define PROTOCOL_HEADER_SIZE    8
+#define SASL_FRAME_HEADER_SIZE  8
+#define SASL_FRAME_TYPE         0x01
+#define TLS_CHUNK_SIZE          4096
+
+static const unsigned char SASL_HEADER[PROTOCOL_HEADER_SIZE] = { 'A', 'M', 'Q', 'P', 3, 1, 0, 0 };
+static const unsigned char AMQP_HEADER[PROTOCOL_HEADER_SIZE] = { 'A', 'M', 'Q', 'P', 0, 1, 0, 0 };
+
+// sasl-mechanisms offering MSSBCBS and ANONYMOUS
+static const unsigned char SASL_MECHANISMS_FRAME[] =
+{
+    0x00, 0x00, 0x00, 0x24, 0x02, SASL_FRAME_TYPE, 0x00, 0x00,
+    0x00, 0x53, 0x40, 0xC0, 0x17, 0x01, 0xE0, 0x14, 0x02, 0xA3,
+    0x07, 'M', 'S', 'S', 'B', 'C', 'B', 'S',
+    0x09, 'A', 'N', 'O', 'N', 'Y', 'M', 'O', 'U', 'S'
+};
+
+// sasl-outcome with the code ok
+static const unsigned char SASL_OUTCOME_FRAME[] =
+{
+    0x00, 0x00, 0x00, 0x10, 0x02, SASL_FRAME_TYPE, 0x00, 0x00,
+    0x00, 0x53, 0x44, 0xC0, 0x03, 0x01, 0x50, 0x00
+};
+
+typedef enum STANDIN_AMQP_IO_STATE_TAG
+{
+    STANDIN_AMQP_IO_STATE_CLOSED,
+    STANDIN_AMQP_IO_STATE_OPENING,      /* waiting for the socket */
+    STANDIN_AMQP_IO_STATE_HANDSHAKE,
+    STANDIN_AMQP_IO_STATE_HEADER,       /* waiting for the SASL or the AMQP header */
+    STANDIN_AMQP_IO_STATE_SASL_INIT,    /* mechanisms sent, waiting for sasl-init */
+    STANDIN_AMQP_IO_STATE_OPEN,
+    STANDIN_AMQP_IO_STATE_ERROR
+} STANDIN_AMQP_IO_STATE;
+
+typedef struct STANDIN_AMQP_OUTBOUND_TAG
+{
+    uint64_t release_ms;
+    unsigned char* data;
+    size_t size;
+    ON_SEND_COMPLETE on_send_complete;
+    void* on_send_complete_context;
+    struct STANDIN_AMQP_OUTBOUND_TAG* next;
+} STANDIN_AMQP_OUTBOUND;
+
+typedef struct STANDIN_AMQP_IO_TAG
+{
+    XIO_HANDLE underlying_io;
+    IOTHUB_STANDIN* standin;
+    char** peer_thumbprint;
+    STANDIN_AMQP_IO_STATE state;
+    SSL* ssl;
+    BIO* network_in;
+    BIO* network_out;
+
+    unsigned char* received;    /* plain text kept until SASL is done */
+    size_t received_size;
+
+    STANDIN_AMQP_OUTBOUND* outbound_head;
+    STANDIN_AMQP_OUTBOUND* outbound_tail;
+    uint64_t last_release_ms;
+
+    ON_IO_OPEN_COMPLETE on_io_open_complete;
+    void* on_io_open_complete_context;
+    ON_BYTES_RECEIVED on_bytes_received;
+    void* on_bytes_received_context;
+    ON_IO_ERROR on_io_error;
+    void* on_io_error_context;
+    ON_IO_CLOSE_COMPLETE on_io_close_complete;
+    void* on_io_close_complete_context;
+} STANDIN_AMQP_IO;
+
+static bool is_handshake_done(STANDIN_AMQP_IO* amqp_io)
+{
+    return amqp_io->state == STANDIN_AMQP_IO_STATE_HEADER || amqp_io->state == STANDIN_AMQP_IO_STATE_SASL_INIT || amqp_io->state == STANDIN_AMQP_IO_STATE_OPEN;
+}
+
+static void indicate_error(STANDIN_AMQP_IO* amqp_io)
+{
+    STANDIN_AMQP_IO_STATE previous_state = amqp_io->state;
+
+    amqp_io->state = STANDIN_AMQP_IO_STATE_ERROR;
+    if (previous_state == STANDIN_AMQP_IO_STATE_OPEN)
+    {
+        if (amqp_io->on_io_error != NULL)
+        {
+            amqp_io->on_io_error(amqp_io->on_io_error_context);
+        }
+    }
+    else if (previous_state != STANDIN_AMQP_IO_STATE_CLOSED && previous_state != STANDIN_AMQP_IO_STATE_ERROR)
+    {
+        amqp_io->on_io_open_complete(amqp_io->on_io_open_complete_context, IO_OPEN_ERROR);
+    }
+}
+
+static void discard_outbound(STANDIN_AMQP_IO* amqp_io, bool notify)
+{
+    while (amqp_io->outbound_head != NULL)
+    {
+        STANDIN_AMQP_OUTBOUND* outbound = amqp_io->outbound_head;
+        amqp_io->outbound_head = outbound->next;
+        if (notify && outbound->on_send_complete != NULL)
+        {
+            outbound->on_send_complete(outbound->on_send_complete_context, IO_SEND_CANCELLED);
+        }
+        free(outbound->data);
+        free(outbound);
+    }
+    amqp_io->outbound_tail = NULL;
+}
+
+static int queue_outbound(STANDIN_AMQP_IO* amqp_io, const unsigned char* data, size_t size, ON_SEND_COMPLETE on_send_complete, void* on_send_complete_context)
+{
+    int result;
+    STANDIN_AMQP_OUTBOUND* outbound;
+
+    if ((outbound = (STANDIN_AMQP_OUTBOUND*)malloc(sizeof(STANDIN_AMQP_OUTBOUND))) == NULL)
+    {
+        LogError("Failure allocating the outbound data");
+        result = __FAILURE__;
+    }
+    else if ((outbound->data = (unsigned char*)malloc(size)) == NULL)
+    {
+        LogError("Failure allocating the outbound data");
+        free(outbound);
+        result = __FAILURE__;
+    }
+    else
+    {
+        (void)memcpy(outbound->data, data, size);
+        outbound->size = size;
+        outbound->release_ms = standin_release_time(amqp_io->standin, &amqp_io->last_release_ms);
+        outbound->on_send_complete = on_send_complete;
+        outbound->on_send_complete_context = on_send_complete_context;
+        outbound->next = NULL;
+
+        if (amqp_io->outbound_tail == NULL)
+        {
+            amqp_io->outbound_head = outbound;
+        }
+        else
+        {
+            amqp_io->outbound_tail->next = outbound;
+        }
+        amqp_io->outbound_tail = outbound;
+        result = 0;
+    }
+    return result;
+}
+
+static int flush_tls_output(STANDIN_AMQP_IO* amqp_io)
+{
+    int result = 0;
+    unsigned char chunk[TLS_CHUNK_SIZE];
+    int size;
+
+    while (result == 0 && (size = BIO_read(amqp_io->network_out, chunk, sizeof(chunk))) > 0)
+    {
+        // socketio keeps a copy of what it cannot send right away
+        if (xio_send(amqp_io->underlying_io, chunk, (size_t)size, NULL, NULL) != 0)
+        {
+            LogError("Failure sending on the socket");
+            result = __FAILURE__;
+        }
+    }
+    return result;
+}
+
+static void release_outbound(STANDIN_AMQP_IO* amqp_io, uint64_t now)
+{
+    while (is_handshake_done(amqp_io) && amqp_io->outbound_head != NULL && amqp_io->outbound_head->release_ms <= now)
+    {
+        STANDIN_AMQP_OUTBOUND* outbound = amqp_io->outbound_head;
+        size_t offset = 0;
+        int write_result;
+
+        amqp_io->outbound_head = outbound->next;
+        if (amqp_io->outbound_head == NULL)
+        {
+            amqp_io->outbound_tail = NULL;
+        }
+
+        // The memory BIO takes everything, a short write only means one record at a time
+        while (offset < outbound->size && (write_result = SSL_write(amqp_io->ssl, outbound->data + offset, (int)(outbound->size - offset))) > 0)
+        {
+            offset += (size_t)write_result;
+        }
+
+        if (offset < outbound->size || flush_tls_output(amqp_io) != 0)
+        {
+            LogError("Failure sending %lu bytes", (unsigned long)outbound->size);
+            if (outbound->on_send_complete != NULL)
+            {
+                outbound->on_send_complete(outbound->on_send_complete_context, IO_SEND_ERROR);
+            }
+            indicate_error(amqp_io);
+        }
+        else if (outbound->on_send_complete != NULL)
+        {
+            outbound->on_send_complete(outbound->on_send_complete_context, IO_SEND_OK);
+        }
+        free(outbound->data);
+        free(outbound);
+    }
+}
+
+static void complete_open(STANDIN_AMQP_IO* amqp_io, size_t consumed)
+{
+    unsigned char* received = amqp_io->received;
+    size_t received_size = amqp_io->received_size;
+
+    amqp_io->received = NULL;
+    amqp_io->received_size = 0;
+    amqp_io->state = STANDIN_AMQP_IO_STATE_OPEN;
+    amqp_io->on_io_open_complete(amqp_io->on_io_open_complete_context, IO_OPEN_OK);
+
+    // What came after SASL (usually the AMQP header) belongs to the connection
+    if (amqp_io->state == STANDIN_AMQP_IO_STATE_OPEN && received_size > consumed)
+    {
+        amqp_io->on_bytes_received(amqp_io->on_bytes_received_context, received + consumed, received_size - consumed);
+    }
+    free(received);
+}
+
+static void process_sasl(STANDIN_AMQP_IO* amqp_io)
+{
+    size_t consumed = 0;
+
+    if (amqp_io->state == STANDIN_AMQP_IO_STATE_HEADER && amqp_io->received_size >= PROTOCOL_HEADER_SIZE)
+    {
+        if (memcmp(amqp_io->received, SASL_HEADER, PROTOCOL_HEADER_SIZE) == 0)
+        {
+            if (queue_outbound(amqp_io, SASL_HEADER, sizeof(SASL_HEADER), NULL, NULL) != 0 ||
+                queue_outbound(amqp_io, SASL_MECHANISMS_FRAME, sizeof(SASL_MECHANISMS_FRAME), NULL, NULL) != 0)
+            {
+                indicate_error(amqp_io);
+            }
+            else
+            {
+                consumed = PROTOCOL_HEADER_SIZE;
+                amqp_io->state = STANDIN_AMQP_IO_STATE_SASL_INIT;
+            }
+        }
+        else if (memcmp(amqp_io->received, AMQP_HEADER, PROTOCOL_HEADER_SIZE) == 0)
+        {
+            // No SASL, the device authenticates with its certificate
+            complete_open(amqp_io, 0);
+        }
+        else
+        {
+            LogError("Unexpected protocol header");
+            indicate_error(amqp_io);
+        }
+    }
+
+    if (amqp_io->state == STANDIN_AMQP_IO_STATE_SASL_INIT && amqp_io->received_size - consumed >= SASL_FRAME_HEADER_SIZE)
+    {
+        const unsigned char* frame = amqp_io->received + consumed;
+        size_t frame_size = ((size_t)frame[0] << 24) | ((size_t)frame[1] << 16) | ((size_t)frame[2] << 8) | (size_t)frame[3];
+
+        if (frame_size < SASL_FRAME_HEADER_SIZE || frame_size > STANDIN_MAX_PACKET_SIZE || frame[5] != SASL_FRAME_TYPE)
+        {
+            LogError("Malformed SASL frame");
+            indicate_error(amqp_io);
+        }
+        else if (amqp_io->received_size - consumed >= frame_size)
+        {
+            // Whatever the mechanism, the token is checked when the device puts it on $cbs
+            consumed += frame_size;
+            if (queue_outbound(amqp_io, SASL_OUTCOME_FRAME, sizeof(SASL_OUTCOME_FRAME), NULL, NULL) != 0)
+            {
+                indicate_error(amqp_io);
+            }
+            else
+            {
+                complete_open(amqp_io, consumed);
+                consumed = 0;
+            }
+        }
+    }
+
+    if (consumed > 0 && amqp_io->received != NULL)
+    {
+        (void)memmove(amqp_io->received, amqp_io->received + consumed, amqp_io->received_size - consumed);
+        amqp_io->received_size -= consumed;
+    }
+}
+
+static void on_plain_text_received(STANDIN_AMQP_IO* amqp_io, const unsigned char* data, size_t size)
+{
+    if (amqp_io->state == STANDIN_AMQP_IO_STATE_OPEN)
+    {
+        amqp_io->on_bytes_received(amqp_io->on_bytes_received_context, data, size);
+    }
+    else
+    {
+        unsigned char* received;
+
+        if (amqp_io->received_size + size > STANDIN_MAX_PACKET_SIZE ||
+            (received = (unsigned char*)realloc(amqp_io->received, amqp_io->received_size + size)) == NULL)
+        {
+            LogError("The peer sent more than the stand-in accepts before SASL completed");
+            indicate_error(amqp_io);
+        }
+        else
+        {
+            (void)memcpy(received + amqp_io->received_size, data, size);
+            amqp_io->received = received;
+            amqp_io->received_size += size;
+            process_sasl(amqp_io);
+        }
+    }
+}
+
+static void continue_handshake(STANDIN_AMQP_IO* amqp_io)
+{
+    int accept_result = SSL_accept(amqp_io->ssl);
+
+    if (flush_tls_output(amqp_io) != 0)
+    {
+        indicate_error(amqp_io);
+    }
+    else if (accept_result == 1)
+    {
+        if (amqp_io->peer_thumbprint != NULL)
+        {
+            *amqp_io->peer_thumbprint = standin_tls_get_peer_thumbprint(amqp_io->ssl);
+        }
+        amqp_io->state = STANDIN_AMQP_IO_STATE_HEADER;
+    }
+    else
+    {
+        int error = SSL_get_error(amqp_io->ssl, accept_result);
+        if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+        {
+            LogError("TLS handshake failed");
+            indicate_error(amqp_io);
+        }
+    }
+}
+
+static void read_plain_text(STANDIN_AMQP_IO* amqp_io)
+{
+    unsigned char chunk[TLS_CHUNK_SIZE];
+    int read_result = 0;
+
+    while (is_handshake_done(amqp_io) && (read_result = SSL_read(amqp_io->ssl, chunk, sizeof(chunk))) > 0)
+    {
+        on_plain_text_received(amqp_io, chunk, (size_t)read_result);
+    }
+
+    if (is_handshake_done(amqp_io) && read_result <= 0)
+    {
+        int error = SSL_get_error(amqp_io->ssl, read_result);
+        if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+        {
+            // The peer closed the connection or it failed
+            indicate_error(amqp_io);
+        }
+        else if (flush_tls_output(amqp_io) != 0)
+        {
+            indicate_error(amqp_io);
+        }
+    }
+}
+
+static void on_underlying_io_open_complete(void* context, IO_OPEN_RESULT open_result)
+{
+    STANDIN_AMQP_IO* amqp_io = (STANDIN_AMQP_IO*)context;
+
+    if (open_result != IO_OPEN_OK)
+    {
+        LogError("Failure opening the socket");
+        indicate_error(amqp_io);
+    }
+    else if (amqp_io->state == STANDIN_AMQP_IO_STATE_OPENING)
+    {
+        amqp_io->state = STANDIN_AMQP_IO_STATE_HANDSHAKE;
+    }
+}
+
+static void on_underlying_io_bytes_received(void* context, const unsigned char* buffer, size_t size)
+{
+    STANDIN_AMQP_IO* amqp_io = (STANDIN_AMQP_IO*)context;
+
+    if (amqp_io->state != STANDIN_AMQP_IO_STATE_CLOSED && amqp_io->state != STANDIN_AMQP_IO_STATE_ERROR)
+    {
+        if (BIO_write(amqp_io->network_in, buffer, (int)size) != (int)size)
+        {
+            LogError("Failure passing %lu bytes to TLS", (unsigned long)size);
+            indicate_error(amqp_io);
+        }
+        else
+        {
+            if (amqp_io->state == STANDIN_AMQP_IO_STATE_HANDSHAKE)
+            {
+                continue_handshake(amqp_io);
+            }
+            read_plain_text(amqp_io);
+        }
+    }
+}
+
+static void on_underlying_io_error(void* context)
+{
+    indicate_error((STANDIN_AMQP_IO*)context);
+}
+
+static void on_underlying_io_close_complete(void* context)
+{
+    STANDIN_AMQP_IO* amqp_io = (STANDIN_AMQP_IO*)context;
+
+    if (amqp_io->on_io_close_complete != NULL)
+    {
+        amqp_io->on_io_close_complete(amqp_io->on_io_close_complete_context);
+    }
+}
+
+static OPTIONHANDLER_HANDLE standin_amqp_io_retrieveoptions(CONCRETE_IO_HANDLE handle)
+{
+    (void)handle;
+    return NULL;
+}
+
+static CONCRETE_IO_HANDLE standin_amqp_io_create(void* io_create_parameters)
+{
+    STANDIN_AMQP_IO* result;
+    STANDIN_AMQP_IO_CONFIG* config = (STANDIN_AMQP_IO_CONFIG*)io_create_parameters;
+
+    if (config == NULL || config->underlying_io == NULL || config->standin == NULL)
+    {
+        LogError("Invalid argument (config=%p)", config);
+        result = NULL;
+    }
+    else if ((result = (STANDIN_AMQP_IO*)malloc(sizeof(STANDIN_AMQP_IO))) == NULL)
+    {
+        LogError("Failure allocating the AMQP IO");
+    }
+    else
+    {
+        memset(result, 0, sizeof(STANDIN_AMQP_IO));
+        result->underlying_io = config->underlying_io;
+        result->standin = config->standin;
+        result->peer_thumbprint = config->peer_thumbprint;
+        result->state = STANDIN_AMQP_IO_STATE_CLOSED;
+
+        if ((result->ssl = SSL_new(config->standin->ssl_ctx)) == NULL)
+        {
+            LogError("Failure creating the TLS session");
+            free(result);
+            result = NULL;
+        }
+        else if ((result->network_in = BIO_new(BIO_s_mem())) == NULL || (result->network_out = BIO_new(BIO_s_mem())) == NULL)
+        {
+            LogError("Failure creating the TLS buffers");
+            if (result->network_in != NULL)
+            {
+                (void)BIO_free(result->network_in);
+            }
+            SSL_free(result->ssl);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            // The TLS session owns the buffers from now on
+            SSL_set_bio(result->ssl, result->network_in, result->network_out);
+            SSL_set_accept_state(result->ssl);
+        }
+    }
+    return (CONCRETE_IO_HANDLE)result;
+}
+
+static void standin_amqp_io_destroy(CONCRETE_IO_HANDLE handle)
+{
+    STANDIN_AMQP_IO* amqp_io = (STANDIN_AMQP_IO*)handle;
+
+    if (amqp_io != NULL)
+    {
+        discard_outbound(amqp_io, false);
+        SSL_free(amqp_io->ssl);
+        free(amqp_io->received);
+        free(amqp_io);
+    }
+}
+
+static int standin_amqp_io_open(CONCRETE_IO_HANDLE handle, ON_IO_OPEN_COMPLETE on_io_open_complete, void* on_io_open_complete_context, ON_BYTES_RECEIVED on_bytes_received, void* on_bytes_received_context, ON_IO_ERROR on_io_error, void* on_io_error_context)
+{
+    int result;
+    STANDIN_AMQP_IO* amqp_io = (STANDIN_AMQP_IO*)handle;
+
+    if (amqp_io == NULL || on_io_open_complete == NULL || on_bytes_received == NULL)
+    {
+        LogError("Invalid argument (handle=%p, on_io_open_complete=%p, on_bytes_received=%p)", handle, on_io_open_complete, on_bytes_received);
+        result = __FAILURE__;
+    }
+    else if (amqp_io->state != STANDIN_AMQP_IO_STATE_CLOSED)
+    {
+        LogError("The AMQP IO is already open");
+        result = __FAILURE__;
+    }
+    else
+    {
+        amqp_io->on_io_open_complete = on_io_open_complete;
+        amqp_io->on_io_open_complete_context = on_io_open_complete_context;
+        amqp_io->on_bytes_received = on_bytes_received;
+        amqp_io->on_bytes_received_context = on_bytes_received_context;
+        amqp_io->on_io_error = on_io_error;
+        amqp_io->on_io_error_context = on_io_error_context;
+        // An accepted socket opens right away, from inside xio_open
+        amqp_io->state = STANDIN_AMQP_IO_STATE_OPENING;
+
+        if (xio_open(amqp_io->underlying_io, on_underlying_io_open_complete, amqp_io, on_underlying_io_bytes_received, amqp_io, on_underlying_io_error, amqp_io) != 0)
+        {
+            LogError("Failure opening the socket");
+            amqp_io->state = STANDIN_AMQP_IO_STATE_CLOSED;
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static int standin_amqp_io_close(CONCRETE_IO_HANDLE handle, ON_IO_CLOSE_COMPLETE on_io_close_complete, void* callback_context)
+{
+    int result;
+    STANDIN_AMQP_IO* amqp_io = (STANDIN_AMQP_IO*)handle;
+
+    if (amqp_io == NULL || amqp_io->state == STANDIN_AMQP_IO_STATE_CLOSED)
+    {
+        LogError("The AMQP IO is not open");
+        result = __FAILURE__;
+    }
+    else
+    {
+        STANDIN_AMQP_IO_STATE previous_state = amqp_io->state;
+
+        if (is_handshake_done(amqp_io))
+        {
+            (void)SSL_shutdown(amqp_io->ssl);
+            (void)flush_tls_output(amqp_io);
+        }
+        discard_outbound(amqp_io, true);
+        amqp_io->state = STANDIN_AMQP_IO_STATE_CLOSED;
+
+        if (previous_state != STANDIN_AMQP_IO_STATE_OPEN && previous_state != STANDIN_AMQP_IO_STATE_ERROR)
+        {
+            amqp_io->on_io_open_complete(amqp_io->on_io_open_complete_context, IO_OPEN_CANCELLED);
+        }
+
+        amqp_io->on_io_close_complete = on_io_close_complete;
+        amqp_io->on_io_close_complete_context = callback_context;
+        if (xio_close(amqp_io->underlying_io, on_underlying_io_close_complete, amqp_io) != 0)
+        {
+            // The socket is gone either way
+            on_underlying_io_close_complete(amqp_io);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static int standin_amqp_io_send(CONCRETE_IO_HANDLE handle, const void* buffer, size_t size, ON_SEND_COMPLETE on_send_complete, void* callback_context)
+{
+    int result;
+    STANDIN_AMQP_IO* amqp_io = (STANDIN_AMQP_IO*)handle;
+
+    if (amqp_io == NULL || buffer == NULL || size == 0)
+    {
+        LogError("Invalid argument (handle=%p, buffer=%p, size=%lu)", handle, buffer, (unsigned long)size);
+        result = __FAILURE__;
+    }
+    else if (amqp_io->state != STANDIN_AMQP_IO_STATE_OPEN)
+    {
+        LogError("The AMQP IO is not open");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = queue_outbound(amqp_io, (const unsigned char*)buffer, size, on_send_complete, callback_context);
+    }
+    return result;
+}
+
+static void standin_amqp_io_dowork(CONCRETE_IO_HANDLE handle)
+{
+    STANDIN_AMQP_IO* amqp_io = (STANDIN_AMQP_IO*)handle;
+
+    if (amqp_io != NULL && amqp_io->state != STANDIN_AMQP_IO_STATE_CLOSED)
+    {
+        xio_dowork(amqp_io->underlying_io);
+        release_outbound(amqp_io, standin_now_ms());
+    }
+}
+
+static int standin_amqp_io_setoption(CONCRETE_IO_HANDLE handle, const char* optionName, const void* value)
+{
+    (void)handle;
+    (void)value;
+    LogError("Unsupported option %s", optionName);
+    return __FAILURE__;
+}
+
+static const IO_INTERFACE_DESCRIPTION standin_amqp_io_interface_description =
+{
+    standin_amqp_io_retrieveoptions,
+    standin_amqp_io_create,
+    standin_amqp_io_destroy,
+    standin_amqp_io_open,
+    standin_amqp_io_close,
+    standin_amqp_io_send,
+    standin_amqp_io_dowork,
+    standin_amqp_io_setoption
+};
+
+const IO_INTERFACE_DESCRIPTION* standin_amqp_io_get_interface_description(void)
+{
+    return &standin_amqp_io_interface_description;
+}
@@ -0,0 +1,924 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/base64.h"
+
+#include "standin_private.h"
+
+#define MAX_PATH_SEGMENTS       8
+#define MAX_EVENTS_PER_RESPONSE 100
+
+static const char BATCH_CONTENT_TYPE[] = "application/vnd.microsoft.iothub.json";
+static const char JSON_CONTENT_TYPE[] = "application/json; charset=utf-8";
+static const char HEADER_END[] = "\r\n\r\n";
+
+typedef struct HTTP_REQUEST_TAG
+{
+    const char* method;
+    const char* query;
+    const char* authorization;
+    const char* content_type;
+    const char* if_match;
+    char* segments[MAX_PATH_SEGMENTS];
+    size_t segment_count;
+    bool keep_alive;
+    const unsigned char* body;
+    size_t body_size;
+} HTTP_REQUEST;
+
+static const char* get_reason_phrase(int status)
+{
+    const char* result;
+    switch (status)
+    {
+    case 100: result = "Continue"; break;
+    case 200: result = "OK"; break;
+    case 204: result = "No Content"; break;
+    case 400: result = "Bad Request"; break;
+    case 401: result = "Unauthorized"; break;
+    case 404: result = "Not Found"; break;
+    case 405: result = "Method Not Allowed"; break;
+    case 409: result = "Conflict"; break;
+    case 411: result = "Length Required"; break;
+    case 412: result = "Precondition Failed"; break;
+    case 413: result = "Payload Too Large"; break;
+    case 504: result = "Gateway Timeout"; break;
+    default: result = "Internal Server Error"; break;
+    }
+    return result;
+}
+
+static int send_response(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, int status, const char* extraHeaders, const unsigned char* body, size_t size, bool keepAlive)
+{
+    int result;
+    STRING_HANDLE head = STRING_construct_sprintf("HTTP/1.1 %d %s\r\nContent-Length: %lu\r\n%s%s%s%s\r\n",
+        status, get_reason_phrase(status), (unsigned long)size,
+        (size > 0) ? "Content-Type: " : "", (size > 0) ? JSON_CONTENT_TYPE : "", (size > 0) ? "\r\n" : "",
+        (extraHeaders == NULL) ? "" : extraHeaders);
+
+    if (head == NULL)
+    {
+        LogError("Failure building the HTTP response");
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t head_size = STRING_length(head);
+        unsigned char* response = (unsigned char*)malloc(head_size + size);
+
+        if (response == NULL)
+        {
+            LogError("Failure allocating the HTTP response");
+            result = __FAILURE__;
+        }
+        else
+        {
+            (void)memcpy(response, STRING_c_str(head), head_size);
+            if (size > 0)
+            {
+                (void)memcpy(response + head_size, body, size);
+            }
+            result = standin_send(standin, connection, response, head_size + size, !keepAlive);
+            free(response);
+        }
+        STRING_delete(head);
+    }
+    return result;
+}
+
+static int send_json(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, int status, JSON_Value* value, bool keepAlive)
+{
+    int result;
+    char* serialized;
+
+    if (value == NULL || (serialized = json_serialize_to_string(value)) == NULL)
+    {
+        LogError("Failure serializing the response");
+        result = send_response(standin, connection, 500, NULL, NULL, 0, keepAlive);
+    }
+    else
+    {
+        result = send_response(standin, connection, status, NULL, (const unsigned char*)serialized, strlen(serialized), keepAlive);
+        json_free_serialized_string(serialized);
+    }
+    return result;
+}
+
+static int send_error(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, int status, const char* message, bool keepAlive)
+{
+    int result;
+    STRING_HANDLE body = STRING_construct_sprintf("{\"Message\":\"%s\"}", message);
+
+    if (body == NULL)
+    {
+        result = send_response(standin, connection, status, NULL, NULL, 0, keepAlive);
+    }
+    else
+    {
+        result = send_response(standin, connection, status, NULL, (const unsigned char*)STRING_c_str(body), STRING_length(body), keepAlive);
+        STRING_delete(body);
+    }
+    return result;
+}
+
+/* Percent decoded value of a query parameter, NULL when the query does not have it */
+static char* get_query_value(const char* query, const char* name)
+{
+    char* result = NULL;
+    size_t name_length = strlen(name);
+
+    while (query != NULL && *query != '\0')
+    {
+        size_t length = strcspn(query, "&");
+        if (length > name_length && strncmp(query, name, name_length) == 0 && query[name_length] == '=')
+        {
+            result = standin_percent_decode(query + name_length + 1, length - name_length - 1);
+            break;
+        }
+        query = (query[length] == '\0') ? NULL : query + length + 1;
+    }
+    return result;
+}
+
+static JSON_Value* parse_body(const HTTP_REQUEST* request)
+{
+    JSON_Value* result;
+    char* body;
+
+    if ((body = (char*)malloc(request->body_size + 1)) == NULL)
+    {
+        LogError("Failure allocating the request body");
+        result = NULL;
+    }
+    else
+    {
+        (void)memcpy(body, request->body, request->body_size);
+        body[request->body_size] = '\0';
+        result = json_parse_string(body);
+        free(body);
+    }
+    return result;
+}
+
+static JSON_Value* create_device_json(STANDIN_DEVICE* device)
+{
+    JSON_Value* result;
+    char etag[32];
+    char generation[32];
+
+    (void)snprintf(generation, sizeof(generation), "%lu", device->generation);
+    (void)snprintf(etag, sizeof(etag), "\"%lu\"", device->generation);
+
+    if ((result = json_value_init_object()) != NULL)
+    {
+        JSON_Object* root = json_value_get_object(result);
+        if (json_object_set_string(root, "deviceId", device->device_id) != JSONSuccess ||
+            json_object_set_string(root, "generationId", generation) != JSONSuccess ||
+            json_object_set_string(root, "etag", etag) != JSONSuccess ||
+            json_object_set_string(root, "status", "enabled") != JSONSuccess ||
+            json_object_set_string(root, "connectionState", (device->mqtt_connection != NULL) ? "Connected" : "Disconnected") != JSONSuccess ||
+            json_object_dotset_string(root, "authentication.type", (device->thumbprint != NULL) ? "selfSigned" : "sas") != JSONSuccess ||
+            (device->thumbprint != NULL && json_object_dotset_string(root, "authentication.x509Thumbprint.primaryThumbprint", device->thumbprint) != JSONSuccess) ||
+            (device->thumbprint == NULL && json_object_dotset_string(root, "authentication.symmetricKey.primaryKey", device->primary_key) != JSONSuccess) ||
+            (device->thumbprint == NULL && json_object_dotset_string(root, "authentication.symmetricKey.secondaryKey", device->secondary_key) != JSONSuccess))
+        {
+            LogError("Failure building the device of %s", device->device_id);
+            json_value_free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+static JSON_Value* create_twin_json(STANDIN_DEVICE* device)
+{
+    JSON_Value* result = NULL;
+    char* properties;
+
+    if ((properties = standin_get_twin_properties(device)) != NULL)
+    {
+        JSON_Value* properties_value = json_parse_string(properties);
+        if (properties_value != NULL && (result = json_value_init_object()) != NULL)
+        {
+            JSON_Object* root = json_value_get_object(result);
+            if (json_object_set_string(root, "deviceId", device->device_id) != JSONSuccess ||
+                json_object_set_number(root, "version", (double)(device->desired_version + device->reported_version)) != JSONSuccess ||
+                json_object_set_value(root, "properties", properties_value) != JSONSuccess)
+            {
+                json_value_free(result);
+                result = NULL;
+            }
+            else
+            {
+                properties_value = NULL;
+            }
+        }
+        json_value_free(properties_value);
+        json_free_serialized_string(properties);
+    }
+    return result;
+}
+
+static int process_registry(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, HTTP_REQUEST* request, const char* deviceId)
+{
+    int result;
+    STANDIN_DEVICE* device = standin_find_device(standin, deviceId);
+
+    if (strcmp(request->method, "GET") == 0)
+    {
+        result = (device == NULL) ?
+            send_error(standin, connection, 404, "Device not found", request->keep_alive) :
+            send_json(standin, connection, 200, create_device_json(device), request->keep_alive);
+    }
+    else if (strcmp(request->method, "DELETE") == 0)
+    {
+        if (device == NULL)
+        {
+            result = send_error(standin, connection, 404, "Device not found", request->keep_alive);
+        }
+        else
+        {
+            standin_delete_device(standin, device);
+            result = send_response(standin, connection, 204, NULL, NULL, 0, request->keep_alive);
+        }
+    }
+    else if (strcmp(request->method, "PUT") == 0)
+    {
+        JSON_Value* body = parse_body(request);
+        JSON_Object* root = json_value_get_object(body);
+
+        if (root == NULL)
+        {
+            result = send_error(standin, connection, 400, "Invalid device", request->keep_alive);
+        }
+        else if (device != NULL && request->if_match == NULL)
+        {
+            result = send_error(standin, connection, 409, "Device already exists", request->keep_alive);
+        }
+        else
+        {
+            const char* type = json_object_dotget_string(root, "authentication.type");
+            const char* primary_key = json_object_dotget_string(root, "authentication.symmetricKey.primaryKey");
+            const char* secondary_key = json_object_dotget_string(root, "authentication.symmetricKey.secondaryKey");
+            const char* thumbprint = (type != NULL && strcmp(type, "selfSigned") == 0) ?
+                json_object_dotget_string(root, "authentication.x509Thumbprint.primaryThumbprint") : NULL;
+
+            // An update replaces the device, the connection of the device is closed like when its keys change
+            if (device != NULL)
+            {
+                standin_delete_device(standin, device);
+            }
+
+            if ((device = standin_create_device(standin, deviceId, primary_key, secondary_key, thumbprint)) == NULL)
+            {
+                result = send_response(standin, connection, 500, NULL, NULL, 0, request->keep_alive);
+            }
+            else
+            {
+                result = send_json(standin, connection, 200, create_device_json(device), request->keep_alive);
+            }
+        }
+        json_value_free(body);
+    }
+    else
+    {
+        result = send_error(standin, connection, 405, "Method not allowed", request->keep_alive);
+    }
+    return result;
+}
+
+static int process_twin(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, HTTP_REQUEST* request, STANDIN_DEVICE* device)
+{
+    int result;
+
+    if (strcmp(request->method, "GET") == 0)
+    {
+        result = send_json(standin, connection, 200, create_twin_json(device), request->keep_alive);
+    }
+    else if (strcmp(request->method, "PATCH") == 0 || strcmp(request->method, "PUT") == 0)
+    {
+        JSON_Value* body = parse_body(request);
+        JSON_Value* desired = json_object_dotget_value(json_value_get_object(body), "properties.desired");
+
+        if (desired == NULL)
+        {
+            // Tags are not kept by the stand-in
+            result = send_json(standin, connection, 200, create_twin_json(device), request->keep_alive);
+        }
+        else if (standin_update_desired(standin, device, desired) != 0)
+        {
+            result = send_error(standin, connection, 400, "Invalid desired properties", request->keep_alive);
+        }
+        else
+        {
+            result = send_json(standin, connection, 200, create_twin_json(device), request->keep_alive);
+        }
+        json_value_free(body);
+    }
+    else
+    {
+        result = send_error(standin, connection, 405, "Method not allowed", request->keep_alive);
+    }
+    return result;
+}
+
+static int process_method(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, HTTP_REQUEST* request, STANDIN_DEVICE* device)
+{
+    int result;
+    JSON_Value* body = parse_body(request);
+    JSON_Object* root = json_value_get_object(body);
+    const char* method_name = json_object_get_string(root, "methodName");
+    STANDIN_METHOD_CALL* call;
+
+    if (method_name == NULL)
+    {
+        result = send_error(standin, connection, 400, "Invalid method request", request->keep_alive);
+    }
+    else if ((call = (STANDIN_METHOD_CALL*)malloc(sizeof(STANDIN_METHOD_CALL))) == NULL)
+    {
+        LogError("Failure allocating the method call");
+        result = send_response(standin, connection, 500, NULL, NULL, 0, request->keep_alive);
+    }
+    else
+    {
+        JSON_Value* payload = json_object_get_value(root, "payload");
+        char* serialized_payload = (payload == NULL) ? NULL : json_serialize_to_string(payload);
+        double timeout = json_object_get_number(root, "timeout");
+
+        call->request_id = ++standin->next_sequence;
+        call->http_connection = connection;
+        call->device = device;
+        call->keep_alive = request->keep_alive;
+        call->deadline_ms = standin_now_ms() + (uint64_t)((timeout > 0) ? timeout : STANDIN_METHOD_DEFAULT_TIMEOUT) * 1000;
+
+        if (standin_mqtt_invoke_method(standin, device, method_name, (serialized_payload == NULL) ? "null" : serialized_payload, call->request_id) != 0)
+        {
+            free(call);
+            result = send_error(standin, connection, 404, "The device is not connected", request->keep_alive);
+        }
+        else
+        {
+            // The response is sent when the device answers or when the call times out
+            call->next = standin->method_calls;
+            standin->method_calls = call;
+            connection->waiting_for_method = true;
+            standin->stats.method_calls++;
+            result = 0;
+        }
+        json_free_serialized_string(serialized_payload);
+    }
+    json_value_free(body);
+    return result;
+}
+
+static int record_batch(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const HTTP_REQUEST* request)
+{
+    int result;
+    JSON_Value* body = parse_body(request);
+    JSON_Array* messages = json_value_get_array(body);
+
+    if (messages == NULL)
+    {
+        LogError("Invalid batch from %s", device->device_id);
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t count = json_array_get_count(messages);
+        size_t index;
+
+        result = 0;
+        for (index = 0; result == 0 && index < count; index++)
+        {
+            JSON_Object* message = json_array_get_object(messages, index);
+            const char* encoded = json_object_get_string(message, "body");
+            BUFFER_HANDLE decoded;
+
+            if (encoded == NULL || (decoded = Base64_Decoder(encoded)) == NULL)
+            {
+                LogError("Invalid message %lu in the batch from %s", (unsigned long)index, device->device_id);
+                result = __FAILURE__;
+            }
+            else
+            {
+                standin_record_event(standin, device, BUFFER_u_char(decoded), BUFFER_length(decoded));
+                BUFFER_delete(decoded);
+            }
+        }
+    }
+    json_value_free(body);
+    return result;
+}
+
+static STANDIN_C2D_MESSAGE* find_locked_message(STANDIN_DEVICE* device, const char* etag)
+{
+    STANDIN_C2D_MESSAGE* result = device->c2d_head;
+    unsigned long sequence = strtoul(etag, NULL, 10);
+
+    while (result != NULL && !(result->state == STANDIN_C2D_LOCKED && result->sequence == sequence))
+    {
+        result = result->next;
+    }
+    return result;
+}
+
+static int process_device_messages(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, HTTP_REQUEST* request, STANDIN_DEVICE* device)
+{
+    int result;
+    const char* resource = (request->segment_count > 3) ? request->segments[3] : "";
+
+    if (request->segment_count == 4 && strcmp(resource, "events") == 0 && strcmp(request->method, "POST") == 0)
+    {
+        if (request->content_type != NULL && strncmp(request->content_type, BATCH_CONTENT_TYPE, sizeof(BATCH_CONTENT_TYPE) - 1) == 0)
+        {
+            result = (record_batch(standin, device, request) == 0) ?
+                send_response(standin, connection, 204, NULL, NULL, 0, request->keep_alive) :
+                send_error(standin, connection, 400, "Invalid batch", request->keep_alive);
+        }
+        else
+        {
+            standin_record_event(standin, device, request->body, request->body_size);
+            result = send_response(standin, connection, 204, NULL, NULL, 0, request->keep_alive);
+        }
+    }
+    else if (strcasecmp(resource, "devicebound") != 0)
+    {
+        result = send_error(standin, connection, 404, "Unknown resource", request->keep_alive);
+    }
+    else if (request->segment_count == 4 && strcmp(request->method, "GET") == 0)
+    {
+        STANDIN_C2D_MESSAGE* message = device->c2d_head;
+
+        while (message != NULL && message->state != STANDIN_C2D_QUEUED)
+        {
+            message = message->next;
+        }
+
+        if (message == NULL)
+        {
+            result = send_response(standin, connection, 204, NULL, NULL, 0, request->keep_alive);
+        }
+        else
+        {
+            char headers[128];
+            (void)snprintf(headers, sizeof(headers), "ETag: \"%lu\"\r\niothub-messageid: %lu\r\n", message->sequence, message->sequence);
+            message->state = STANDIN_C2D_LOCKED;
+            result = send_response(standin, connection, 200, headers, message->data, message->size, request->keep_alive);
+        }
+    }
+    else if (request->segment_count == 5 && strcmp(request->method, "DELETE") == 0)
+    {
+        STANDIN_C2D_MESSAGE* message = find_locked_message(device, request->segments[4]);
+        if (message == NULL)
+        {
+            result = send_error(standin, connection, 412, "The message lock was lost", request->keep_alive);
+        }
+        else
+        {
+            // Rejected messages are dead lettered, they are not delivered
+            if (request->query == NULL || strstr(request->query, "reject") == NULL)
+            {
+                standin->stats.c2d_delivered++;
+            }
+            standin_remove_c2d(device, message);
+            result = send_response(standin, connection, 204, NULL, NULL, 0, request->keep_alive);
+        }
+    }
+    else if (request->segment_count == 6 && strcmp(request->segments[5], "abandon") == 0 && strcmp(request->method, "POST") == 0)
+    {
+        STANDIN_C2D_MESSAGE* message = find_locked_message(device, request->segments[4]);
+        if (message == NULL)
+        {
+            result = send_error(standin, connection, 412, "The message lock was lost", request->keep_alive);
+        }
+        else
+        {
+            message->state = STANDIN_C2D_QUEUED;
+            standin_mqtt_deliver_c2d(standin, device);
+            result = send_response(standin, connection, 204, NULL, NULL, 0, request->keep_alive);
+        }
+    }
+    else
+    {
+        result = send_error(standin, connection, 405, "Method not allowed", request->keep_alive);
+    }
+    return result;
+}
+
+/* Replaces the Event Hub for iothubtest, the events are returned oldest first */
+static int process_events(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, HTTP_REQUEST* request)
+{
+    int result;
+    char* device_id = get_query_value(request->query, "deviceId");
+    char* after = get_query_value(request->query, "after");
+    char* enqueued_after = get_query_value(request->query, "enqueuedAfter");
+    unsigned long after_sequence = (after == NULL) ? 0 : strtoul(after, NULL, 10);
+    uint64_t after_ms = (enqueued_after == NULL) ? 0 : (uint64_t)strtoull(enqueued_after, NULL, 10);
+    JSON_Value* root_value = json_value_init_object();
+    JSON_Value* events_value = json_value_init_array();
+
+    if (root_value == NULL || events_value == NULL ||
+        json_object_set_value(json_value_get_object(root_value), "events", events_value) != JSONSuccess)
+    {
+        LogError("Failure building the events");
+        json_value_free(events_value);
+        result = send_response(standin, connection, 500, NULL, NULL, 0, request->keep_alive);
+    }
+    else
+    {
+        JSON_Array* events = json_value_get_array(events_value);
+        unsigned long next = after_sequence;
+        size_t returned = 0;
+        size_t index;
+
+        result = 0;
+        for (index = 0; result == 0 && index < standin->event_count && returned < MAX_EVENTS_PER_RESPONSE; index++)
+        {
+            STANDIN_EVENT* event = &standin->events[(standin->event_head + index) % STANDIN_EVENT_CAPACITY];
+
+            if (event->device_id != NULL && event->sequence > after_sequence && event->enqueued_ms >= after_ms &&
+                (device_id == NULL || strcmp(device_id, event->device_id) == 0))
+            {
+                JSON_Value* item_value = json_value_init_object();
+                JSON_Object* item = json_value_get_object(item_value);
+                STRING_HANDLE body = Base64_Encode_Bytes(event->data, event->size);
+
+                if (item_value == NULL || body == NULL ||
+                    json_object_set_number(item, "sequence", (double)event->sequence) != JSONSuccess ||
+                    json_object_set_string(item, "deviceId", event->device_id) != JSONSuccess ||
+                    json_object_set_number(item, "enqueuedTimeUtc", (double)event->enqueued_ms) != JSONSuccess ||
+                    json_object_set_string(item, "body", STRING_c_str(body)) != JSONSuccess ||
+                    json_array_append_value(events, item_value) != JSONSuccess)
+                {
+                    LogError("Failure adding the event %lu", event->sequence);
+                    json_value_free(item_value);
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    next = event->sequence;
+                    returned++;
+                }
+                STRING_delete(body);
+            }
+        }
+
+        if (result != 0 || json_object_set_number(json_value_get_object(root_value), "next", (double)next) != JSONSuccess)
+        {
+            result = send_response(standin, connection, 500, NULL, NULL, 0, request->keep_alive);
+        }
+        else
+        {
+            result = send_json(standin, connection, 200, root_value, request->keep_alive);
+        }
+    }
+
+    json_value_free(root_value);
+    free(device_id);
+    free(after);
+    free(enqueued_after);
+    return result;
+}
+
+static int route_request(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, HTTP_REQUEST* request)
+{
+    int result;
+    const char* root = (request->segment_count > 0) ? request->segments[0] : "";
+    bool device_request = (strcmp(root, "devices") == 0 && request->segment_count > 2);
+    STANDIN_DEVICE* device = (request->segment_count > 1) ? standin_find_device(standin, request->segments[1]) : NULL;
+
+    if (device_request)
+    {
+        if (device == NULL || standin_authenticate_device(standin, device, request->authorization, connection) != 0)
+        {
+            result = send_error(standin, connection, 401, "Unauthorized", request->keep_alive);
+        }
+        else if (standin_drop_request(standin))
+        {
+            // Closed without an answer, the device has to send the request again
+            connection->closing = true;
+            result = 0;
+        }
+        else if (strcmp(request->segments[2], "messages") != 0)
+        {
+            result = send_error(standin, connection, 404, "Unknown resource", request->keep_alive);
+        }
+        else
+        {
+            result = process_device_messages(standin, connection, request, device);
+        }
+    }
+    else if (standin_authenticate_service(standin, request->authorization) != 0)
+    {
+        result = send_error(standin, connection, 401, "Unauthorized", request->keep_alive);
+    }
+    else if (strcmp(root, "devices") == 0 && request->segment_count == 2)
+    {
+        result = process_registry(standin, connection, request, request->segments[1]);
+    }
+    else if (strcmp(root, "twins") == 0 && (request->segment_count == 2 || request->segment_count == 3))
+    {
+        if (device == NULL)
+        {
+            result = send_error(standin, connection, 404, "Device not found", request->keep_alive);
+        }
+        else if (request->segment_count == 2)
+        {
+            result = process_twin(standin, connection, request, device);
+        }
+        else if (strcmp(request->segments[2], "methods") == 0 && strcmp(request->method, "POST") == 0)
+        {
+            result = process_method(standin, connection, request, device);
+        }
+        else
+        {
+            result = send_error(standin, connection, 404, "Unknown resource", request->keep_alive);
+        }
+    }
+    else if (strcmp(root, "standin") == 0 && request->segment_count == 2 && strcmp(request->segments[1], "events") == 0 && strcmp(request->method, "GET") == 0)
+    {
+        result = process_events(standin, connection, request);
+    }
+    else if (strcmp(root, "standin") == 0 && request->segment_count == 5 && strcmp(request->segments[1], "devices") == 0 &&
+        strcmp(request->segments[3], "messages") == 0 && strcasecmp(request->segments[4], "devicebound") == 0 && strcmp(request->method, "POST") == 0)
+    {
+        STANDIN_DEVICE* target = standin_find_device(standin, request->segments[2]);
+        if (target == NULL)
+        {
+            result = send_error(standin, connection, 404, "Device not found", request->keep_alive);
+        }
+        else if (standin_enqueue_c2d(standin, target, request->body, request->body_size) != 0)
+        {
+            result = send_response(standin, connection, 500, NULL, NULL, 0, request->keep_alive);
+        }
+        else
+        {
+            result = send_response(standin, connection, 204, NULL, NULL, 0, request->keep_alive);
+        }
+    }
+    else
+    {
+        result = send_error(standin, connection, 404, "Unknown resource", request->keep_alive);
+    }
+    return result;
+}
+
+/* Splits the path in percent decoded segments, the query is left as it is */
+static int split_path(HTTP_REQUEST* request, char* target)
+{
+    int result = 0;
+    char* query = strchr(target, '?');
+    char* segment;
+
+    if (query != NULL)
+    {
+        *query = '\0';
+        request->query = query + 1;
+    }
+
+    segment = (target[0] == '/') ? target + 1 : target;
+    while (result == 0 && *segment != '\0')
+    {
+        size_t length = strcspn(segment, "/");
+        if (request->segment_count == MAX_PATH_SEGMENTS)
+        {
+            result = __FAILURE__;
+        }
+        else if ((request->segments[request->segment_count] = standin_percent_decode(segment, length)) == NULL)
+        {
+            result = __FAILURE__;
+        }
+        else
+        {
+            request->segment_count++;
+            segment += length;
+            if (*segment == '/')
+            {
+                segment++;
+            }
+        }
+    }
+    return result;
+}
+
+static char* trim(char* value)
+{
+    size_t length;
+    while (*value == ' ' || *value == '\t')
+    {
+        value++;
+    }
+    length = strlen(value);
+    while (length > 0 && (value[length - 1] == ' ' || value[length - 1] == '\t'))
+    {
+        value[--length] = '\0';
+    }
+    return value;
+}
+
+/* Returns 0 and sets *consumed to 0 when the request is not complete yet */
+static int process_request(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, size_t* consumed)
+{
+    int result;
+    const char* received = (const char*)connection->received;
+    const char* header_end = NULL;
+    size_t index;
+
+    *consumed = 0;
+    for (index = 0; index + sizeof(HEADER_END) - 1 <= connection->received_size; index++)
+    {
+        if (memcmp(received + index, HEADER_END, sizeof(HEADER_END) - 1) == 0)
+        {
+            header_end = received + index;
+            break;
+        }
+    }
+
+    if (header_end == NULL)
+    {
+        result = (connection->received_size > STANDIN_MAX_PACKET_SIZE) ? __FAILURE__ : 0;
+    }
+    else
+    {
+        size_t header_size = (size_t)(header_end - received) + sizeof(HEADER_END) - 1;
+        char* head = (char*)malloc(header_size + 1);
+
+        if (head == NULL)
+        {
+            LogError("Failure allocating the request head");
+            result = __FAILURE__;
+        }
+        else
+        {
+            HTTP_REQUEST request;
+            char* line;
+            char* target;
+            char* version;
+            char* save = NULL;
+            size_t content_length = 0;
+            bool chunked = false;
+            bool expect_continue = false;
+
+            memset(&request, 0, sizeof(request));
+            (void)memcpy(head, received, header_size);
+            head[header_size] = '\0';
+
+            request.method = strtok_r(head, " ", &save);
+            target = strtok_r(NULL, " ", &save);
+            version = strtok_r(NULL, "\r\n", &save);
+            request.keep_alive = (version != NULL && strcmp(version, "HTTP/1.1") == 0);
+
+            while ((line = strtok_r(NULL, "\r\n", &save)) != NULL)
+            {
+                char* colon = strchr(line, ':');
+                if (colon != NULL)
+                {
+                    char* value;
+                    *colon = '\0';
+                    value = trim(colon + 1);
+
+                    if (strcasecmp(line, "Content-Length") == 0)
+                    {
+                        content_length = (size_t)strtoul(value, NULL, 10);
+                    }
+                    else if (strcasecmp(line, "Transfer-Encoding") == 0)
+                    {
+                        chunked = (strcasecmp(value, "identity") != 0);
+                    }
+                    else if (strcasecmp(line, "Connection") == 0)
+                    {
+                        request.keep_alive = (strcasecmp(value, "close") != 0);
+                    }
+                    else if (strcasecmp(line, "Expect") == 0)
+                    {
+                        expect_continue = (strcasecmp(value, "100-continue") == 0);
+                    }
+                    else if (strcasecmp(line, "Authorization") == 0)
+                    {
+                        request.authorization = value;
+                    }
+                    else if (strcasecmp(line, "Content-Type") == 0)
+                    {
+                        request.content_type = value;
+                    }
+                    else if (strcasecmp(line, "If-Match") == 0)
+                    {
+                        request.if_match = value;
+                    }
+                }
+            }
+
+            if (request.method == NULL || target == NULL || version == NULL || strncmp(version, "HTTP/1.", 7) != 0)
+            {
+                LogError("Malformed HTTP request");
+                result = __FAILURE__;
+            }
+            else if (chunked)
+            {
+                // The SDK always sends a Content-Length
+                *consumed = connection->received_size;
+                result = send_response(standin, connection, 411, NULL, NULL, 0, false);
+            }
+            else if (content_length > STANDIN_MAX_PACKET_SIZE)
+            {
+                *consumed = connection->received_size;
+                result = send_response(standin, connection, 413, NULL, NULL, 0, false);
+            }
+            else if (connection->received_size - header_size < content_length)
+            {
+                if (expect_continue && !connection->continue_sent)
+                {
+                    static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+                    connection->continue_sent = true;
+                    result = standin_send(standin, connection, (const unsigned char*)CONTINUE, sizeof(CONTINUE) - 1, false);
+                }
+                else
+                {
+                    result = 0;
+                }
+            }
+            else if (split_path(&request, target) != 0)
+            {
+                *consumed = header_size + content_length;
+                result = send_error(standin, connection, 400, "Invalid path", request.keep_alive);
+            }
+            else
+            {
+                request.body = connection->received + header_size;
+                request.body_size = content_length;
+                connection->continue_sent = false;
+
+                result = route_request(standin, connection, &request);
+                *consumed = header_size + content_length;
+            }
+
+            for (index = 0; index < request.segment_count; index++)
+            {
+                free(request.segments[index]);
+            }
+            free(head);
+        }
+    }
+    return result;
+}
+
+int standin_http_process(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection)
+{
+    int result = 0;
+    size_t consumed = 1;
+
+    // Pipelined requests wait for the answer of a pending direct method
+    while (result == 0 && consumed > 0 && connection->received_size > 0 && !connection->closing && !connection->waiting_for_method)
+    {
+        result = process_request(standin, connection, &consumed);
+        if (consumed > 0)
+        {
+            (void)memmove(connection->received, connection->received + consumed, connection->received_size - consumed);
+            connection->received_size -= consumed;
+        }
+    }
+    return result;
+}
+
+void standin_http_complete_method(IOTHUB_STANDIN* standin, STANDIN_METHOD_CALL* call, int status, const unsigned char* payload, size_t size)
+{
+    STANDIN_CONNECTION* connection = call->http_connection;
+    int send_result;
+
+    if (payload == NULL)
+    {
+        // The stand-in failed the call itself, the device did not answer
+        send_result = send_error(standin, connection, status, (status == 504) ? "Timed out waiting for the response from device" : "Device not found", call->keep_alive);
+    }
+    else
+    {
+        STRING_HANDLE body = STRING_construct_sprintf("{\"status\":%d,\"payload\":%.*s}", status, (size == 0) ? 4 : (int)size, (size == 0) ? "null" : (const char*)payload);
+        if (body == NULL)
+        {
+            send_result = send_response(standin, connection, 500, NULL, NULL, 0, call->keep_alive);
+        }
+        else
+        {
+            send_result = send_response(standin, connection, 200, NULL, (const unsigned char*)STRING_c_str(body), STRING_length(body), call->keep_alive);
+            STRING_delete(body);
+        }
+    }
+
+    if (send_result != 0)
+    {
+        connection->closing = true;
+    }
+    connection->waiting_for_method = false;
+    standin_remove_method_call(standin, call);
+}
@@ -0,0 +1,741 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/strings.h"
+
+#include "standin_private.h"
+
+/* MQTT 3.1.1 control packets, only what the device SDK sends and expects */
+#define MQTT_CONNECT        0x10
+#define MQTT_CONNACK        0x20
+#define MQTT_PUBLISH        0x30
+#define MQTT_PUBACK         0x40
+#define MQTT_SUBSCRIBE      0x82
+#define MQTT_SUBACK         0x90
+#define MQTT_UNSUBSCRIBE    0xA2
+#define MQTT_UNSUBACK       0xB0
+#define MQTT_PINGREQ        0xC0
+#define MQTT_PINGRESP       0xD0
+#define MQTT_DISCONNECT     0xE0
+
+#define CONNACK_ACCEPTED                0
+#define CONNACK_UNACCEPTABLE_PROTOCOL   1
+#define CONNACK_BAD_USER_NAME_PASSWORD  4
+#define CONNACK_NOT_AUTHORIZED          5
+
+#define SUBACK_FAILURE      0x80
+#define MQTT_PROTOCOL_LEVEL 4
+
+#define CONNECT_FLAG_USER_NAME  0x80
+#define CONNECT_FLAG_PASSWORD   0x40
+#define CONNECT_FLAG_WILL       0x04
+
+static const char TELEMETRY_TOPIC_FORMAT[] = "devices/%s/messages/events/";
+static const char C2D_TOPIC_FORMAT[] = "devices/%s/messages/devicebound/%%24.mid=%lu";
+static const char C2D_FILTER_FORMAT[] = "devices/%s/messages/devicebound/#";
+static const char TWIN_RESPONSE_FILTER[] = "$iothub/twin/res/#";
+static const char TWIN_DESIRED_FILTER[] = "$iothub/twin/PATCH/properties/desired/#";
+static const char METHODS_FILTER[] = "$iothub/methods/POST/#";
+static const char TWIN_GET_PREFIX[] = "$iothub/twin/GET/";
+static const char TWIN_REPORTED_PREFIX[] = "$iothub/twin/PATCH/properties/reported/";
+static const char METHOD_RESPONSE_PREFIX[] = "$iothub/methods/res/";
+static const char REQUEST_ID_PROPERTY[] = "$rid=";
+
+typedef struct MQTT_READER_TAG
+{
+    const unsigned char* data;
+    size_t size;
+    size_t position;
+} MQTT_READER;
+
+static bool read_uint16(MQTT_READER* reader, uint16_t* value)
+{
+    bool result;
+    if (reader->size - reader->position < 2)
+    {
+        result = false;
+    }
+    else
+    {
+        *value = (uint16_t)((reader->data[reader->position] << 8) | reader->data[reader->position + 1]);
+        reader->position += 2;
+        result = true;
+    }
+    return result;
+}
+
+/* Strings are returned NUL terminated and must be freed */
+static char* read_string(MQTT_READER* reader)
+{
+    char* result;
+    uint16_t length;
+
+    if (!read_uint16(reader, &length) || reader->size - reader->position < length)
+    {
+        result = NULL;
+    }
+    else if ((result = (char*)malloc((size_t)length + 1)) == NULL)
+    {
+        LogError("Failure allocating the MQTT string");
+    }
+    else
+    {
+        (void)memcpy(result, reader->data + reader->position, length);
+        result[length] = '\0';
+        reader->position += length;
+    }
+    return result;
+}
+
+static size_t encode_remaining_length(unsigned char* destination, size_t length)
+{
+    size_t result = 0;
+    do
+    {
+        unsigned char encoded = (unsigned char)(length % 128);
+        length /= 128;
+        destination[result++] = (unsigned char)(encoded | ((length > 0) ? 0x80 : 0));
+    } while (length > 0);
+    return result;
+}
+
+static int send_packet(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, unsigned char type, const unsigned char* variable, size_t variable_size, const unsigned char* payload, size_t payload_size)
+{
+    int result;
+    unsigned char* packet;
+
+    if ((packet = (unsigned char*)malloc(5 + variable_size + payload_size)) == NULL)
+    {
+        LogError("Failure allocating the MQTT packet");
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t header_size;
+
+        packet[0] = type;
+        header_size = 1 + encode_remaining_length(packet + 1, variable_size + payload_size);
+        if (variable_size > 0)
+        {
+            (void)memcpy(packet + header_size, variable, variable_size);
+        }
+        if (payload_size > 0)
+        {
+            (void)memcpy(packet + header_size + variable_size, payload, payload_size);
+        }
+        result = standin_send(standin, connection, packet, header_size + variable_size + payload_size, false);
+        free(packet);
+    }
+    return result;
+}
+
+static int send_packet_id(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, unsigned char type, uint16_t packetId)
+{
+    unsigned char variable[2];
+    variable[0] = (unsigned char)(packetId >> 8);
+    variable[1] = (unsigned char)(packetId & 0xFF);
+    return send_packet(standin, connection, type, variable, sizeof(variable), NULL, 0);
+}
+
+static int send_publish(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, const char* topic, uint16_t packetId, const unsigned char* payload, size_t size)
+{
+    int result;
+    size_t topic_length = strlen(topic);
+    unsigned char* variable;
+
+    if (topic_length > UINT16_MAX || (variable = (unsigned char*)malloc(topic_length + 4)) == NULL)
+    {
+        LogError("Failure building the PUBLISH of %s", topic);
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t variable_size = 2 + topic_length;
+
+        variable[0] = (unsigned char)(topic_length >> 8);
+        variable[1] = (unsigned char)(topic_length & 0xFF);
+        (void)memcpy(variable + 2, topic, topic_length);
+        if (packetId != 0)
+        {
+            variable[variable_size++] = (unsigned char)(packetId >> 8);
+            variable[variable_size++] = (unsigned char)(packetId & 0xFF);
+        }
+
+        // QoS 1 when a packet id is given, QoS 0 otherwise
+        result = send_packet(standin, connection, (unsigned char)(MQTT_PUBLISH | ((packetId != 0) ? 0x02 : 0)), variable, variable_size, payload, size);
+        free(variable);
+    }
+    return result;
+}
+
+static uint16_t next_packet_id(STANDIN_CONNECTION* connection)
+{
+    uint16_t result = connection->next_packet_id++;
+    if (connection->next_packet_id == 0)
+    {
+        connection->next_packet_id = 1;
+    }
+    return result;
+}
+
+/* Value of $rid in the properties of a topic, "" when it has none */
+static const char* find_request_id(const char* topic)
+{
+    const char* result = strstr(topic, REQUEST_ID_PROPERTY);
+    return (result == NULL) ? "" : result + sizeof(REQUEST_ID_PROPERTY) - 1;
+}
+
+static int send_twin_response(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, int status, const char* requestId, unsigned long version, const char* body)
+{
+    char topic[128];
+    size_t request_id_length = strcspn(requestId, "&");
+
+    if (version != 0)
+    {
+        (void)snprintf(topic, sizeof(topic), "$iothub/twin/res/%d/?$rid=%.*s&$version=%lu", status, (int)request_id_length, requestId, version);
+    }
+    else
+    {
+        (void)snprintf(topic, sizeof(topic), "$iothub/twin/res/%d/?$rid=%.*s", status, (int)request_id_length, requestId);
+    }
+    return send_publish(standin, connection, topic, 0, (const unsigned char*)body, (body == NULL) ? 0 : strlen(body));
+}
+
+static int process_connect(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, MQTT_READER* reader)
+{
+    int result;
+    char* protocol_name = read_string(reader);
+    char* client_id = NULL;
+    char* user_name = NULL;
+    char* password = NULL;
+    unsigned char connect_flags = 0;
+    unsigned char return_code;
+    uint16_t keep_alive;
+    STANDIN_DEVICE* device = NULL;
+
+    if (protocol_name == NULL || reader->size - reader->position < 2 ||
+        strcmp(protocol_name, "MQTT") != 0 || reader->data[reader->position] != MQTT_PROTOCOL_LEVEL)
+    {
+        return_code = CONNACK_UNACCEPTABLE_PROTOCOL;
+    }
+    else
+    {
+        connect_flags = reader->data[reader->position + 1];
+        reader->position += 2;
+
+        if (!read_uint16(reader, &keep_alive) || (client_id = read_string(reader)) == NULL)
+        {
+            return_code = CONNACK_UNACCEPTABLE_PROTOCOL;
+        }
+        else
+        {
+            if ((connect_flags & CONNECT_FLAG_WILL) != 0)
+            {
+                // The will is accepted and ignored, the SDK does not set one
+                free(read_string(reader));
+                free(read_string(reader));
+            }
+            if ((connect_flags & CONNECT_FLAG_USER_NAME) != 0)
+            {
+                user_name = read_string(reader);
+            }
+            if ((connect_flags & CONNECT_FLAG_PASSWORD) != 0)
+            {
+                password = read_string(reader);
+            }
+
+            if ((device = standin_find_device(standin, client_id)) == NULL)
+            {
+                LogError("Unknown device %s", client_id);
+                standin->stats.auth_failures++;
+                return_code = CONNACK_NOT_AUTHORIZED;
+            }
+            else if (device->thumbprint == NULL && password == NULL)
+            {
+                standin->stats.auth_failures++;
+                return_code = CONNACK_BAD_USER_NAME_PASSWORD;
+            }
+            else if (standin_authenticate_device(standin, device, password, connection) != 0)
+            {
+                LogError("Device %s failed to authenticate", client_id);
+                return_code = CONNACK_NOT_AUTHORIZED;
+            }
+            else
+            {
+                return_code = CONNACK_ACCEPTED;
+            }
+        }
+    }
+
+    {
+        unsigned char variable[2] = { 0, return_code };
+        result = send_packet(standin, connection, MQTT_CONNACK, variable, sizeof(variable), NULL, 0);
+    }
+
+    if (result == 0 && return_code == CONNACK_ACCEPTED)
+    {
+        // Like the IoT Hub, a new connection of the device closes the previous one
+        if (device->mqtt_connection != NULL)
+        {
+            device->mqtt_connection->device = NULL;
+            device->mqtt_connection->closing = true;
+        }
+        device->mqtt_connection = connection;
+        connection->device = device;
+    }
+    else if (result == 0)
+    {
+        // The CONNACK is sent before the connection is closed
+        result = standin_send(standin, connection, NULL, 0, true);
+    }
+
+    free(protocol_name);
+    free(client_id);
+    free(user_name);
+    free(password);
+    return result;
+}
+
+static int process_device_publish(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, const char* topic, const unsigned char* payload, size_t size)
+{
+    int result;
+    STANDIN_DEVICE* device = connection->device;
+    char telemetry_prefix[256];
+
+    (void)snprintf(telemetry_prefix, sizeof(telemetry_prefix), TELEMETRY_TOPIC_FORMAT, device->device_id);
+
+    if (strncmp(topic, telemetry_prefix, strlen(telemetry_prefix)) == 0)
+    {
+        standin_record_event(standin, device, payload, size);
+        result = 0;
+    }
+    else if (strncmp(topic, TWIN_GET_PREFIX, sizeof(TWIN_GET_PREFIX) - 1) == 0)
+    {
+        char* twin;
+
+        standin->stats.twin_requests++;
+        if ((twin = standin_get_twin_properties(device)) == NULL)
+        {
+            result = send_twin_response(standin, connection, 500, find_request_id(topic), 0, NULL);
+        }
+        else
+        {
+            result = send_twin_response(standin, connection, 200, find_request_id(topic), 0, twin);
+            json_free_serialized_string(twin);
+        }
+    }
+    else if (strncmp(topic, TWIN_REPORTED_PREFIX, sizeof(TWIN_REPORTED_PREFIX) - 1) == 0)
+    {
+        char* patch;
+
+        standin->stats.twin_requests++;
+        if ((patch = (char*)malloc(size + 1)) == NULL)
+        {
+            LogError("Failure allocating the reported properties");
+            result = __FAILURE__;
+        }
+        else
+        {
+            (void)memcpy(patch, payload, size);
+            patch[size] = '\0';
+            if (standin_update_reported(device, patch) != 0)
+            {
+                result = send_twin_response(standin, connection, 400, find_request_id(topic), 0, NULL);
+            }
+            else
+            {
+                result = send_twin_response(standin, connection, 204, find_request_id(topic), device->reported_version, NULL);
+            }
+            free(patch);
+        }
+    }
+    else if (strncmp(topic, METHOD_RESPONSE_PREFIX, sizeof(METHOD_RESPONSE_PREFIX) - 1) == 0)
+    {
+        int status = atoi(topic + sizeof(METHOD_RESPONSE_PREFIX) - 1);
+        STANDIN_METHOD_CALL* call = standin_find_method_call(standin, strtoul(find_request_id(topic), NULL, 16));
+
+        // Late answers, after the call timed out, are ignored like the IoT Hub does
+        if (call != NULL && call->device == device)
+        {
+            standin_http_complete_method(standin, call, status, payload, size);
+        }
+        result = 0;
+    }
+    else
+    {
+        LogError("Device %s published to an unknown topic %s", device->device_id, topic);
+        result = __FAILURE__;
+    }
+    return result;
+}
+
+static int process_publish(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, unsigned char flags, MQTT_READER* reader)
+{
+    int result;
+    unsigned int qos = (flags >> 1) & 0x03;
+    uint16_t packet_id = 0;
+    char* topic;
+
+    if (qos > 1)
+    {
+        LogError("QoS %u is not supported by the IoT Hub", qos);
+        result = __FAILURE__;
+    }
+    else if ((topic = read_string(reader)) == NULL || (qos == 1 && !read_uint16(reader, &packet_id)))
+    {
+        LogError("Malformed PUBLISH");
+        free(topic);
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (standin_drop_request(standin))
+        {
+            // Neither processed nor acknowledged, the device has to publish it again
+            result = 0;
+        }
+        else if ((result = process_device_publish(standin, connection, topic, reader->data + reader->position, reader->size - reader->position)) == 0 && qos == 1)
+        {
+            result = send_packet_id(standin, connection, MQTT_PUBACK, packet_id);
+        }
+        free(topic);
+    }
+    return result;
+}
+
+static int process_puback(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, MQTT_READER* reader)
+{
+    int result;
+    uint16_t packet_id;
+
+    if (!read_uint16(reader, &packet_id))
+    {
+        LogError("Malformed PUBACK");
+        result = __FAILURE__;
+    }
+    else
+    {
+        STANDIN_C2D_MESSAGE* message = connection->device->c2d_head;
+
+        while (message != NULL && !(message->state == STANDIN_C2D_IN_FLIGHT && message->packet_id == packet_id))
+        {
+            message = message->next;
+        }
+
+        if (message != NULL)
+        {
+            standin_remove_c2d(connection->device, message);
+            standin->stats.c2d_delivered++;
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static unsigned int get_subscription(STANDIN_DEVICE* device, const char* filter)
+{
+    unsigned int result;
+    char c2d_filter[256];
+
+    (void)snprintf(c2d_filter, sizeof(c2d_filter), C2D_FILTER_FORMAT, device->device_id);
+    if (strcmp(filter, c2d_filter) == 0)
+    {
+        result = STANDIN_SUBSCRIPTION_C2D;
+    }
+    else if (strcmp(filter, TWIN_RESPONSE_FILTER) == 0)
+    {
+        result = STANDIN_SUBSCRIPTION_TWIN_RESPONSE;
+    }
+    else if (strcmp(filter, TWIN_DESIRED_FILTER) == 0)
+    {
+        result = STANDIN_SUBSCRIPTION_TWIN_DESIRED;
+    }
+    else if (strcmp(filter, METHODS_FILTER) == 0)
+    {
+        result = STANDIN_SUBSCRIPTION_METHODS;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static int process_subscribe(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, MQTT_READER* reader, bool subscribe)
+{
+    int result;
+    uint16_t packet_id;
+    unsigned char* variable;
+
+    if (!read_uint16(reader, &packet_id) || (variable = (unsigned char*)malloc(2 + reader->size)) == NULL)
+    {
+        LogError("Malformed %s", subscribe ? "SUBSCRIBE" : "UNSUBSCRIBE");
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t variable_size = 2;
+        char* filter;
+
+        variable[0] = (unsigned char)(packet_id >> 8);
+        variable[1] = (unsigned char)(packet_id & 0xFF);
+        result = 0;
+
+        while (result == 0 && reader->position < reader->size)
+        {
+            unsigned int subscription;
+
+            if ((filter = read_string(reader)) == NULL || (subscribe && reader->position >= reader->size))
+            {
+                LogError("Malformed topic filter");
+                result = __FAILURE__;
+            }
+            else
+            {
+                subscription = get_subscription(connection->device, filter);
+                if (subscribe)
+                {
+                    unsigned char requested_qos = reader->data[reader->position++];
+                    if (subscription == 0)
+                    {
+                        LogError("Device %s subscribed to an unknown topic %s", connection->device->device_id, filter);
+                    }
+                    connection->subscriptions |= subscription;
+                    variable[variable_size++] = (subscription == 0) ? SUBACK_FAILURE : (unsigned char)((requested_qos > 1) ? 1 : requested_qos);
+                }
+                else
+                {
+                    connection->subscriptions &= ~subscription;
+                }
+            }
+            free(filter);
+        }
+
+        if (result == 0)
+        {
+            result = subscribe ?
+                send_packet(standin, connection, MQTT_SUBACK, variable, variable_size, NULL, 0) :
+                send_packet(standin, connection, MQTT_UNSUBACK, variable, 2, NULL, 0);
+        }
+        free(variable);
+
+        if (result == 0 && (connection->subscriptions & STANDIN_SUBSCRIPTION_C2D) != 0)
+        {
+            standin_mqtt_deliver_c2d(standin, connection->device);
+        }
+    }
+    return result;
+}
+
+static int process_packet(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, unsigned char header, MQTT_READER* reader)
+{
+    int result;
+    unsigned char type = (unsigned char)(header & 0xF0);
+
+    if (connection->device == NULL && type != MQTT_CONNECT)
+    {
+        LogError("MQTT packet 0x%02X before CONNECT", header);
+        result = __FAILURE__;
+    }
+    else if (connection->device != NULL && type == MQTT_CONNECT)
+    {
+        LogError("Second CONNECT on a connection");
+        result = __FAILURE__;
+    }
+    else
+    {
+        switch (type)
+        {
+        case MQTT_CONNECT:
+            result = process_connect(standin, connection, reader);
+            break;
+        case MQTT_PUBLISH:
+            result = process_publish(standin, connection, (unsigned char)(header & 0x0F), reader);
+            break;
+        case MQTT_PUBACK:
+            result = process_puback(standin, connection, reader);
+            break;
+        case (MQTT_SUBSCRIBE & 0xF0):
+            result = process_subscribe(standin, connection, reader, true);
+            break;
+        case (MQTT_UNSUBSCRIBE & 0xF0):
+            result = process_subscribe(standin, connection, reader, false);
+            break;
+        case MQTT_PINGREQ:
+            result = send_packet(standin, connection, MQTT_PINGRESP, NULL, 0, NULL, 0);
+            break;
+        case MQTT_DISCONNECT:
+            connection->closing = true;
+            result = 0;
+            break;
+        default:
+            LogError("Unexpected MQTT packet 0x%02X", header);
+            result = __FAILURE__;
+            break;
+        }
+    }
+    return result;
+}
+
+int standin_mqtt_process(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection)
+{
+    int result = 0;
+    size_t consumed = 0;
+
+    while (result == 0 && !connection->closing && connection->received_size - consumed >= 2)
+    {
+        const unsigned char* packet = connection->received + consumed;
+        size_t available = connection->received_size - consumed;
+        size_t remaining_length = 0;
+        size_t multiplier = 1;
+        size_t header_size = 1;
+        bool complete_length = false;
+
+        while (header_size < available && header_size <= 4)
+        {
+            remaining_length += (packet[header_size] & 0x7F) * multiplier;
+            multiplier *= 128;
+            if ((packet[header_size++] & 0x80) == 0)
+            {
+                complete_length = true;
+                break;
+            }
+        }
+
+        if (!complete_length)
+        {
+            if (header_size > 4)
+            {
+                LogError("Malformed MQTT remaining length");
+                result = __FAILURE__;
+            }
+            break;
+        }
+        else if (remaining_length > STANDIN_MAX_PACKET_SIZE)
+        {
+            LogError("MQTT packet of %lu bytes is too large", (unsigned long)remaining_length);
+            result = __FAILURE__;
+        }
+        else if (available - header_size < remaining_length)
+        {
+            // Waits for the rest of the packet
+            break;
+        }
+        else
+        {
+            MQTT_READER reader;
+            reader.data = packet + header_size;
+            reader.size = remaining_length;
+            reader.position = 0;
+
+            result = process_packet(standin, connection, packet[0], &reader);
+            consumed += header_size + remaining_length;
+        }
+    }
+
+    if (consumed > 0)
+    {
+        (void)memmove(connection->received, connection->received + consumed, connection->received_size - consumed);
+        connection->received_size -= consumed;
+    }
+    return result;
+}
+
+void standin_mqtt_deliver_c2d(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device)
+{
+    STANDIN_CONNECTION* connection = device->mqtt_connection;
+
+    if (connection != NULL && (connection->subscriptions & STANDIN_SUBSCRIPTION_C2D) != 0)
+    {
+        STANDIN_C2D_MESSAGE* message;
+
+        for (message = device->c2d_head; message != NULL; message = message->next)
+        {
+            if (message->state == STANDIN_C2D_QUEUED)
+            {
+                char topic[256];
+
+                (void)snprintf(topic, sizeof(topic), C2D_TOPIC_FORMAT, device->device_id, message->sequence);
+                message->packet_id = next_packet_id(connection);
+                if (send_publish(standin, connection, topic, message->packet_id, message->data, message->size) != 0)
+                {
+                    LogError("Failure sending the cloud to device message to %s", device->device_id);
+                    break;
+                }
+                message->state = STANDIN_C2D_IN_FLIGHT;
+            }
+        }
+    }
+}
+
+int standin_mqtt_send_desired(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const char* patch)
+{
+    int result;
+    char topic[128];
+
+    if (device->mqtt_connection == NULL)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        (void)snprintf(topic, sizeof(topic), "$iothub/twin/PATCH/properties/desired/?$version=%lu", device->desired_version);
+        result = send_publish(standin, device->mqtt_connection, topic, 0, (const unsigned char*)patch, strlen(patch));
+    }
+    return result;
+}
+
+int standin_mqtt_invoke_method(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const char* methodName, const char* payload, unsigned long requestId)
+{
+    int result;
+    STANDIN_CONNECTION* connection = device->mqtt_connection;
+
+    if (connection == NULL || (connection->subscriptions & STANDIN_SUBSCRIPTION_METHODS) == 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        STRING_HANDLE topic = STRING_construct_sprintf("$iothub/methods/POST/%s/?$rid=%lx", methodName, requestId);
+        if (topic == NULL)
+        {
+            LogError("Failure building the method topic");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = send_publish(standin, connection, STRING_c_str(topic), 0, (const unsigned char*)payload, strlen(payload));
+            STRING_delete(topic);
+        }
+    }
+    return result;
+}
+
+void standin_mqtt_on_close(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection)
+{
+    STANDIN_DEVICE* device = connection->device;
+    (void)standin;
+
+    if (device != NULL)
+    {
+        STANDIN_C2D_MESSAGE* message;
+
+        // Messages that were not acknowledged are delivered again on the next connection
+        for (message = device->c2d_head; message != NULL; message = message->next)
+        {
+            if (message->state == STANDIN_C2D_IN_FLIGHT)
+            {
+                message->state = STANDIN_C2D_QUEUED;
+            }
+        }
+        device->mqtt_connection = NULL;
+        connection->device = NULL;
+    }
+}
@@ -0,0 +1,231 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Internal state of the IoT Hub stand-in, shared by the core (iothub_standin.c), the protocols
+(standin_mqtt.c, standin_http.c, standin_amqp.c and standin_amqp_io.c), the TLS listener (standin_tls.c)
+and the SAS validation (standin_sas.c).
+Everything here is only touched by the thread that calls IoTHubStandIn_DoWork or with the lock held. */
+
+#ifndef STANDIN_PRIVATE_H
+#define STANDIN_PRIVATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <openssl/ssl.h>
+
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#ifdef USE_AMQP
+#include "azure_c_shared_utility/xio.h"
+#endif
+#include "parson.h"
+
+#include "iothub_standin.h"
+
+#define STANDIN_EVENT_CAPACITY          4096    /* device to cloud messages kept for the stand-in event endpoint */
+#define STANDIN_MAX_PACKET_SIZE         (256 * 1024)
+#define STANDIN_METHOD_DEFAULT_TIMEOUT  30      /* seconds, when the service request does not set one */
+
+#define STANDIN_SUBSCRIPTION_C2D            0x01
+#define STANDIN_SUBSCRIPTION_TWIN_RESPONSE  0x02
+#define STANDIN_SUBSCRIPTION_TWIN_DESIRED   0x04
+#define STANDIN_SUBSCRIPTION_METHODS        0x08
+
+typedef enum STANDIN_PROTOCOL_TAG
+{
+    STANDIN_PROTOCOL_MQTT,
+    STANDIN_PROTOCOL_HTTP
+} STANDIN_PROTOCOL;
+
+typedef enum STANDIN_C2D_STATE_TAG
+{
+    STANDIN_C2D_QUEUED,
+    STANDIN_C2D_LOCKED,     /* handed to an HTTP device, waiting for complete, abandon or reject */
+    STANDIN_C2D_IN_FLIGHT   /* sent to an MQTT or AMQP device, waiting for the PUBACK or the disposition */
+} STANDIN_C2D_STATE;
+
+typedef struct STANDIN_OUTBOUND_TAG
+{
+    uint64_t release_ms;
+    unsigned char* data;
+    size_t size;
+    size_t offset;
+    bool close_after;
+    struct STANDIN_OUTBOUND_TAG* next;
+} STANDIN_OUTBOUND;
+
+typedef struct STANDIN_C2D_MESSAGE_TAG
+{
+    unsigned long sequence;
+    unsigned char* data;
+    size_t size;
+    STANDIN_C2D_STATE state;
+    uint16_t packet_id;
+    struct STANDIN_C2D_MESSAGE_TAG* next;
+} STANDIN_C2D_MESSAGE;
+
+struct STANDIN_CONNECTION_TAG;
+struct STANDIN_AMQP_LINK_TAG;
+struct STANDIN_AMQP_TAG;
+
+typedef struct STANDIN_DEVICE_TAG
+{
+    char* device_id;
+    char* primary_key;
+    char* secondary_key;
+    char* thumbprint;
+    unsigned long generation;
+    JSON_Value* desired;
+    unsigned long desired_version;
+    JSON_Value* reported;
+    unsigned long reported_version;
+    STANDIN_C2D_MESSAGE* c2d_head;
+    struct STANDIN_CONNECTION_TAG* mqtt_connection;
+    struct STANDIN_AMQP_LINK_TAG* amqp_c2d_link;     /* cloud to device link of an AMQP device */
+    struct STANDIN_DEVICE_TAG* next;
+} STANDIN_DEVICE;
+
+typedef struct STANDIN_CONNECTION_TAG
+{
+    int socket;
+    SSL* ssl;
+    STANDIN_PROTOCOL protocol;
+    bool handshake_done;
+    bool want_write;
+    bool closing;
+
+    unsigned char* received;
+    size_t received_size;
+    size_t received_capacity;
+
+    STANDIN_OUTBOUND* outbound_head;
+    STANDIN_OUTBOUND* outbound_tail;
+    uint64_t last_release_ms;
+
+    /* MQTT */
+    STANDIN_DEVICE* device;
+    unsigned int subscriptions;
+    uint16_t next_packet_id;
+
+    /* HTTP */
+    bool continue_sent;
+    bool waiting_for_method;    /* a direct method call is waiting for the device */
+
+    struct STANDIN_CONNECTION_TAG* next;
+} STANDIN_CONNECTION;
+
+typedef struct STANDIN_METHOD_CALL_TAG
+{
+    unsigned long request_id;
+    STANDIN_CONNECTION* http_connection;
+    STANDIN_DEVICE* device;
+    uint64_t deadline_ms;
+    bool keep_alive;
+    struct STANDIN_METHOD_CALL_TAG* next;
+} STANDIN_METHOD_CALL;
+
+typedef struct STANDIN_EVENT_TAG
+{
+    unsigned long sequence;
+    char* device_id;
+    uint64_t enqueued_ms;
+    unsigned char* data;
+    size_t size;
+} STANDIN_EVENT;
+
+typedef struct IOTHUB_STANDIN_TAG
+{
+    char* host_name;
+    char* policy_name;
+    char* policy_key;
+    unsigned int latency_ms;
+    unsigned int jitter_ms;
+    unsigned int loss_percent;
+    uint32_t random_state;
+
+    int listeners[2];
+    STANDIN_PROTOCOL listener_protocols[2];
+    size_t listener_count;
+    SSL_CTX* ssl_ctx;
+    char* certificate;
+    struct STANDIN_AMQP_TAG* amqp;  /* AMQP listener and connections, NULL when AMQP is not served */
+
+    STANDIN_DEVICE* devices;
+    STANDIN_CONNECTION* connections;
+    STANDIN_METHOD_CALL* method_calls;
+    unsigned long next_sequence;
+
+    STANDIN_EVENT events[STANDIN_EVENT_CAPACITY];
+    size_t event_head;
+    size_t event_count;
+
+    IOTHUB_STANDIN_STATS stats;
+    IOTHUB_STANDIN_EVENT_CALLBACK event_callback;
+    void* event_callback_context;
+
+    LOCK_HANDLE lock;
+    int wakeup[2];              /* written to when the API queues something for the worker thread */
+    THREAD_HANDLE worker;
+    volatile bool keep_running;
+} IOTHUB_STANDIN;
+
+/* core */
+extern uint64_t standin_now_ms(void);
+extern uint64_t standin_release_time(IOTHUB_STANDIN* standin, uint64_t* lastReleaseMs);
+extern int standin_set_non_blocking(int socket);
+extern int standin_send(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection, const unsigned char* data, size_t size, bool close_after);
+extern bool standin_drop_request(IOTHUB_STANDIN* standin);
+extern STANDIN_DEVICE* standin_find_device(IOTHUB_STANDIN* standin, const char* deviceId);
+extern STANDIN_DEVICE* standin_create_device(IOTHUB_STANDIN* standin, const char* deviceId, const char* primaryKey, const char* secondaryKey, const char* thumbprint);
+extern void standin_delete_device(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device);
+extern int standin_authenticate_device(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const char* sasToken, STANDIN_CONNECTION* connection);
+extern int standin_authenticate_service(IOTHUB_STANDIN* standin, const char* sasToken);
+extern void standin_record_event(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const unsigned char* data, size_t size);
+extern int standin_enqueue_c2d(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const unsigned char* data, size_t size);
+extern void standin_remove_c2d(STANDIN_DEVICE* device, STANDIN_C2D_MESSAGE* message);
+extern char* standin_get_twin_properties(STANDIN_DEVICE* device);
+extern int standin_update_reported(STANDIN_DEVICE* device, const char* patch);
+extern int standin_update_desired(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, JSON_Value* patch);
+extern STANDIN_METHOD_CALL* standin_find_method_call(IOTHUB_STANDIN* standin, unsigned long requestId);
+extern void standin_remove_method_call(IOTHUB_STANDIN* standin, STANDIN_METHOD_CALL* call);
+extern char* standin_percent_decode(const char* value, size_t length);
+
+/* TLS */
+extern SSL_CTX* standin_tls_create_context(const char* certificateFile, const char* privateKeyFile, const char* hostName, char** certificate);
+extern char* standin_tls_get_peer_thumbprint(SSL* ssl);
+
+/* SAS */
+extern int standin_sas_validate(const char* sasToken, const char* key, const char* resource, const char* keyName);
+
+/* MQTT */
+extern int standin_mqtt_process(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection);
+extern void standin_mqtt_deliver_c2d(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device);
+extern int standin_mqtt_send_desired(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const char* patch);
+extern int standin_mqtt_invoke_method(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device, const char* methodName, const char* payload, unsigned long requestId);
+extern void standin_mqtt_on_close(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection);
+
+/* HTTP */
+extern int standin_http_process(IOTHUB_STANDIN* standin, STANDIN_CONNECTION* connection);
+extern void standin_http_complete_method(IOTHUB_STANDIN* standin, STANDIN_METHOD_CALL* call, int status, const unsigned char* payload, size_t size);
+
+#ifdef USE_AMQP
+/* AMQP */
+typedef struct STANDIN_AMQP_IO_CONFIG_TAG
+{
+    XIO_HANDLE underlying_io;
+    IOTHUB_STANDIN* standin;
+    char** peer_thumbprint;     /* set to the thumbprint of the client certificate after the handshake */
+} STANDIN_AMQP_IO_CONFIG;
+
+extern const IO_INTERFACE_DESCRIPTION* standin_amqp_io_get_interface_description(void);
+extern int standin_amqp_create(IOTHUB_STANDIN* standin, int port);
+extern void standin_amqp_destroy(IOTHUB_STANDIN* standin);
+extern void standin_amqp_dowork(IOTHUB_STANDIN* standin);
+extern uint64_t standin_amqp_get_deadline(IOTHUB_STANDIN* standin, uint64_t now);
+extern void standin_amqp_deliver_c2d(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device);
+extern void standin_amqp_on_delete_device(IOTHUB_STANDIN* standin, STANDIN_DEVICE* device);
+#endif
+
+#endif // STANDIN_PRIVATE_H
@@ -0,0 +1,217 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/base64.h"
+#include "azure_c_shared_utility/hmacsha256.h"
+
+#include "standin_private.h"
+
+static const char SAS_TOKEN_PREFIX[] = "SharedAccessSignature ";
+
+typedef struct SAS_FIELD_TAG
+{
+    const char* value;
+    size_t length;
+} SAS_FIELD;
+
+static bool sas_field_equals(const SAS_FIELD* field, const char* expected)
+{
+    bool result;
+    char* decoded;
+
+    if ((decoded = standin_percent_decode(field->value, field->length)) == NULL)
+    {
+        result = false;
+    }
+    else
+    {
+        // Host names are not case sensitive and neither are the device ids of the IoT Hub
+        result = (strcasecmp(decoded, expected) == 0);
+        free(decoded);
+    }
+    return result;
+}
+
+static int compute_signature(const char* key, const SAS_FIELD* resource, const SAS_FIELD* expiry, STRING_HANDLE* signature)
+{
+    int result;
+    BUFFER_HANDLE decoded_key;
+    BUFFER_HANDLE hash;
+    char* to_sign;
+    size_t to_sign_length = resource->length + 1 + expiry->length;
+
+    if ((decoded_key = Base64_Decoder(key)) == NULL)
+    {
+        LogError("Failure decoding the key");
+        result = __FAILURE__;
+    }
+    else
+    {
+        if ((hash = BUFFER_new()) == NULL)
+        {
+            LogError("Failure allocating the hash");
+            result = __FAILURE__;
+        }
+        else
+        {
+            if ((to_sign = (char*)malloc(to_sign_length)) == NULL)
+            {
+                LogError("Failure allocating the string to sign");
+                result = __FAILURE__;
+            }
+            else
+            {
+                // The signature covers the resource and the expiry as they appear in the token
+                (void)memcpy(to_sign, resource->value, resource->length);
+                to_sign[resource->length] = '\n';
+                (void)memcpy(to_sign + resource->length + 1, expiry->value, expiry->length);
+
+                if (HMACSHA256_ComputeHash(BUFFER_u_char(decoded_key), BUFFER_length(decoded_key), (const unsigned char*)to_sign, to_sign_length, hash) != HMACSHA256_OK)
+                {
+                    LogError("Failure computing the signature");
+                    result = __FAILURE__;
+                }
+                else if ((*signature = Base64_Encoder(hash)) == NULL)
+                {
+                    LogError("Failure encoding the signature");
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    result = 0;
+                }
+                free(to_sign);
+            }
+            BUFFER_delete(hash);
+        }
+        BUFFER_delete(decoded_key);
+    }
+    return result;
+}
+
+int standin_sas_validate(const char* sasToken, const char* key, const char* resource, const char* keyName)
+{
+    int result;
+
+    if (sasToken == NULL || key == NULL || resource == NULL)
+    {
+        result = __FAILURE__;
+    }
+    else if (strncmp(sasToken, SAS_TOKEN_PREFIX, sizeof(SAS_TOKEN_PREFIX) - 1) != 0)
+    {
+        LogError("The token is not a shared access signature");
+        result = __FAILURE__;
+    }
+    else
+    {
+        SAS_FIELD sr = { NULL, 0 };
+        SAS_FIELD sig = { NULL, 0 };
+        SAS_FIELD se = { NULL, 0 };
+        SAS_FIELD skn = { NULL, 0 };
+        const char* position = sasToken + sizeof(SAS_TOKEN_PREFIX) - 1;
+
+        while (*position != '\0')
+        {
+            const char* end = strchr(position, '&');
+            const char* equal = strchr(position, '=');
+            SAS_FIELD* field = NULL;
+
+            if (end == NULL)
+            {
+                end = position + strlen(position);
+            }
+
+            if (equal != NULL && equal < end)
+            {
+                size_t name_length = (size_t)(equal - position);
+                if (name_length == 2 && strncmp(position, "sr", 2) == 0)
+                {
+                    field = &sr;
+                }
+                else if (name_length == 3 && strncmp(position, "sig", 3) == 0)
+                {
+                    field = &sig;
+                }
+                else if (name_length == 2 && strncmp(position, "se", 2) == 0)
+                {
+                    field = &se;
+                }
+                else if (name_length == 3 && strncmp(position, "skn", 3) == 0)
+                {
+                    field = &skn;
+                }
+            }
+
+            if (field != NULL)
+            {
+                field->value = equal + 1;
+                field->length = (size_t)(end - equal - 1);
+            }
+            position = (*end == '\0') ? end : end + 1;
+        }
+
+        if (sr.value == NULL || sig.value == NULL || se.value == NULL)
+        {
+            LogError("The token misses sr, sig or se");
+            result = __FAILURE__;
+        }
+        else if (keyName != NULL ? (skn.value == NULL || !sas_field_equals(&skn, keyName)) : (skn.length != 0))
+        {
+            LogError("The token is not signed with the expected key name");
+            result = __FAILURE__;
+        }
+        else if (!sas_field_equals(&sr, resource))
+        {
+            LogError("The token is not valid for %s", resource);
+            result = __FAILURE__;
+        }
+        else if (strtoul(se.value, NULL, 10) < (unsigned long)time(NULL))
+        {
+            LogError("The token has expired");
+            result = __FAILURE__;
+        }
+        else
+        {
+            STRING_HANDLE expected = NULL;
+            char* signature;
+
+            if (compute_signature(key, &sr, &se, &expected) != 0)
+            {
+                result = __FAILURE__;
+            }
+            else
+            {
+                if ((signature = standin_percent_decode(sig.value, sig.length)) == NULL)
+                {
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    if (strcmp(signature, STRING_c_str(expected)) != 0)
+                    {
+                        LogError("The signature of the token does not match");
+                        result = __FAILURE__;
+                    }
+                    else
+                    {
+                        result = 0;
+                    }
+                    free(signature);
+                }
+                STRING_delete(expected);
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,283 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "standin_private.h"
+
+#define CERTIFICATE_VALIDITY_DAYS   30
+#define THUMBPRINT_LENGTH           20
+
+static int accept_any_client_certificate(int preverify_ok, X509_STORE_CTX* store)
+{
+    (void)preverify_ok;
+    (void)store;
+    // Client certificates are optional and are only checked against the thumbprint of the device
+    return 1;
+}
+
+static char* read_bio(BIO* bio)
+{
+    char* result;
+    char* data;
+    long length = BIO_get_mem_data(bio, &data);
+
+    if (length <= 0 || (result = (char*)malloc((size_t)length + 1)) == NULL)
+    {
+        LogError("Failure copying the certificate");
+        result = NULL;
+    }
+    else
+    {
+        (void)memcpy(result, data, (size_t)length);
+        result[length] = '\0';
+    }
+    return result;
+}
+
+static int add_extension(X509* certificate, int nid, const char* value)
+{
+    int result;
+    X509V3_CTX context;
+    X509_EXTENSION* extension;
+
+    X509V3_set_ctx_nodb(&context);
+    X509V3_set_ctx(&context, certificate, certificate, NULL, NULL, 0);
+    if ((extension = X509V3_EXT_conf_nid(NULL, &context, nid, (char*)value)) == NULL)
+    {
+        LogError("Failure creating the extension %s", value);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = (X509_add_ext(certificate, extension, -1) == 1) ? 0 : __FAILURE__;
+        X509_EXTENSION_free(extension);
+    }
+    return result;
+}
+
+static EVP_PKEY* generate_key(void)
+{
+    EVP_PKEY* result = NULL;
+    EVP_PKEY_CTX* context;
+
+    if ((context = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL)) == NULL)
+    {
+        LogError("Failure creating the key context");
+    }
+    else
+    {
+        if (EVP_PKEY_keygen_init(context) != 1 ||
+            EVP_PKEY_CTX_set_ec_paramgen_curve_nid(context, NID_X9_62_prime256v1) != 1 ||
+            EVP_PKEY_keygen(context, &result) != 1)
+        {
+            LogError("Failure generating the key");
+            result = NULL;
+        }
+        EVP_PKEY_CTX_free(context);
+    }
+    return result;
+}
+
+/* Self-signed certificate for host_name, localhost and 127.0.0.1, the clients have to trust it */
+static int use_generated_certificate(SSL_CTX* ssl_ctx, const char* hostName, char** certificate)
+{
+    int result;
+    EVP_PKEY* key;
+    X509* x509;
+
+    if ((key = generate_key()) == NULL)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        if ((x509 = X509_new()) == NULL)
+        {
+            LogError("Failure allocating the certificate");
+            result = __FAILURE__;
+        }
+        else
+        {
+            char subject_alt_name[256];
+            unsigned char address[16];
+            long serial;
+            X509_NAME* name = X509_get_subject_name(x509);
+            BIO* bio;
+
+            (void)RAND_bytes((unsigned char*)&serial, sizeof(serial));
+            (void)snprintf(subject_alt_name, sizeof(subject_alt_name), "DNS:localhost,IP:127.0.0.1,%s:%s",
+                (inet_pton(AF_INET, hostName, address) == 1 || inet_pton(AF_INET6, hostName, address) == 1) ? "IP" : "DNS", hostName);
+
+            if (X509_set_version(x509, 2) != 1 ||
+                ASN1_INTEGER_set(X509_get_serialNumber(x509), serial & 0x7FFFFFFF) != 1 ||
+                X509_gmtime_adj(X509_get_notBefore(x509), -3600) == NULL ||
+                X509_gmtime_adj(X509_get_notAfter(x509), 60L * 60 * 24 * CERTIFICATE_VALIDITY_DAYS) == NULL ||
+                X509_set_pubkey(x509, key) != 1 ||
+                X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)hostName, -1, -1, 0) != 1 ||
+                X509_NAME_add_entry_by_txt(name, "O", MBSTRING_ASC, (const unsigned char*)"IoT Hub stand-in", -1, -1, 0) != 1 ||
+                X509_set_issuer_name(x509, name) != 1 ||
+                add_extension(x509, NID_basic_constraints, "critical,CA:TRUE") != 0 ||
+                add_extension(x509, NID_key_usage, "critical,digitalSignature,keyCertSign") != 0 ||
+                add_extension(x509, NID_subject_alt_name, subject_alt_name) != 0 ||
+                X509_sign(x509, key, EVP_sha256()) == 0)
+            {
+                LogError("Failure building the certificate");
+                result = __FAILURE__;
+            }
+            else if (SSL_CTX_use_certificate(ssl_ctx, x509) != 1 || SSL_CTX_use_PrivateKey(ssl_ctx, key) != 1)
+            {
+                LogError("Failure setting the certificate");
+                result = __FAILURE__;
+            }
+            else if ((bio = BIO_new(BIO_s_mem())) == NULL)
+            {
+                LogError("Failure allocating the certificate BIO");
+                result = __FAILURE__;
+            }
+            else
+            {
+                if (PEM_write_bio_X509(bio, x509) != 1 || (*certificate = read_bio(bio)) == NULL)
+                {
+                    LogError("Failure writing the certificate");
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    result = 0;
+                }
+                BIO_free(bio);
+            }
+            X509_free(x509);
+        }
+        EVP_PKEY_free(key);
+    }
+    return result;
+}
+
+static int use_certificate_files(SSL_CTX* ssl_ctx, const char* certificateFile, const char* privateKeyFile, char** certificate)
+{
+    int result;
+    BIO* file;
+
+    if (SSL_CTX_use_certificate_chain_file(ssl_ctx, certificateFile) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ssl_ctx, privateKeyFile, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ssl_ctx) != 1)
+    {
+        LogError("Failure loading %s and %s", certificateFile, privateKeyFile);
+        result = __FAILURE__;
+    }
+    else if ((file = BIO_new_file(certificateFile, "r")) == NULL)
+    {
+        LogError("Failure opening %s", certificateFile);
+        result = __FAILURE__;
+    }
+    else
+    {
+        BIO* bio;
+        X509* x509;
+
+        if ((bio = BIO_new(BIO_s_mem())) == NULL)
+        {
+            LogError("Failure allocating the certificate BIO");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+            while (result == 0 && (x509 = PEM_read_bio_X509(file, NULL, NULL, NULL)) != NULL)
+            {
+                if (PEM_write_bio_X509(bio, x509) != 1)
+                {
+                    result = __FAILURE__;
+                }
+                X509_free(x509);
+            }
+
+            if (result != 0 || (*certificate = read_bio(bio)) == NULL)
+            {
+                LogError("Failure reading %s", certificateFile);
+                result = __FAILURE__;
+            }
+            BIO_free(bio);
+        }
+        BIO_free(file);
+    }
+    return result;
+}
+
+SSL_CTX* standin_tls_create_context(const char* certificateFile, const char* privateKeyFile, const char* hostName, char** certificate)
+{
+    SSL_CTX* result;
+
+    if ((result = SSL_CTX_new(SSLv23_server_method())) == NULL)
+    {
+        LogError("Failure creating the TLS context");
+    }
+    else
+    {
+        // Same floor as the IoT Hub
+        (void)SSL_CTX_set_options(result, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_TLSv1 | SSL_OP_NO_TLSv1_1);
+        (void)SSL_CTX_set_mode(result, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        SSL_CTX_set_verify(result, SSL_VERIFY_PEER, accept_any_client_certificate);
+
+        if ((certificateFile != NULL) ?
+            use_certificate_files(result, certificateFile, privateKeyFile, certificate) != 0 :
+            use_generated_certificate(result, hostName, certificate) != 0)
+        {
+            SSL_CTX_free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+char* standin_tls_get_peer_thumbprint(SSL* ssl)
+{
+    char* result;
+    X509* peer;
+
+    if ((peer = SSL_get_peer_certificate(ssl)) == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+
+        if (X509_digest(peer, EVP_sha1(), digest, &length) != 1 || length != THUMBPRINT_LENGTH)
+        {
+            LogError("Failure computing the thumbprint of the client certificate");
+            result = NULL;
+        }
+        else if ((result = (char*)malloc(THUMBPRINT_LENGTH * 2 + 1)) == NULL)
+        {
+            LogError("Failure allocating the thumbprint");
+        }
+        else
+        {
+            unsigned int index;
+            for (index = 0; index < length; index++)
+            {
+                (void)sprintf(result + index * 2, "%02X", digest[index]);
+            }
+        }
+        X509_free(peer);
+    }
+    return result;
+}
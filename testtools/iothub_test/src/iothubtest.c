@@ -27,6 +27,9 @@
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/urlencode.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/httpapiex.h"
+#include "azure_c_shared_utility/base64.h"
+#include "parson.h"
 
 #include "azure_c_shared_utility/threadapi.h"
 #include "iothubtest.h"
@@ -48,12 +51,16 @@ const char* AMQP_RECV_ADDRESS_FMT = "%s/ConsumerGroups/%s/Partitions/%u";
 const char* AMQP_ADDRESS_PATH_FMT = "/devices/%s/messages/deviceBound";
 const char* AMQP_SEND_TARGET_ADDRESS_FMT = "amqps://%s/messages/deviceBound";
 const char* AMQP_SEND_AUTHCID_FMT = "iothubowner@sas.root.%s";
+const char* STANDIN_ENDPOINT_PREFIX = "Endpoint=https://";
+const char* STANDIN_EVENTS_PATH_FMT = "/standin/events?deviceId=%s&after=%lu&enqueuedAfter=%llu";
+const char* STANDIN_SEND_PATH_FMT = "/standin/devices/%s/messages/devicebound";
 
 #define THREAD_CONTINUE             0
 #define THREAD_END                  1
 #define MAX_DRAIN_TIME              1000.0
 #define MAX_SHORT_VALUE             32767         /* maximum (signed) short value */
 #define INDEFINITE_TIME             ((time_t)-1)
+#define STANDIN_POLL_INTERVAL_MS    100
 
 DEFINE_ENUM_STRINGS(IOTHUB_TEST_CLIENT_RESULT, IOTHUB_TEST_CLIENT_RESULT_VALUES);
 
@@ -93,6 +100,9 @@ typedef struct IOTHUB_VALIDATION_INFO_TAG
     void* onMessageReceivedContext;
     THREAD_HANDLE asyncWorkThread;
     bool keepThreadAlive;
+    bool isStandIn;                         /* the IoT Hub is the local stand-in, events are read over HTTPS instead of the Event Hub */
+    unsigned long standInLastEvent;
+    unsigned long long standInEnqueuedAfter;
 } IOTHUB_VALIDATION_INFO;
 
 typedef struct MESSAGE_RECEIVER_CONTEXT_TAG
@@ -474,6 +484,11 @@ IOTHUB_TEST_HANDLE IoTHubTest_Initialize(const char* eventhubConnString, const c
             IoTHubTest_Deinit(devhubValInfo);
             result = NULL;
         }
+        else if (strncmp(eventhubConnString, STANDIN_ENDPOINT_PREFIX, strlen(STANDIN_ENDPOINT_PREFIX)) == 0)
+        {
+            devhubValInfo->isStandIn = true;
+            result = devhubValInfo;
+        }
         else if (RetrieveEventHubClientInfo(eventhubConnString, devhubValInfo) != 0)
         {
             IoTHubTest_Deinit(devhubValInfo);
@@ -977,6 +992,122 @@ static AMQP_CONN_INFO* createAmqpConnection(IOTHUB_VALIDATION_INFO* devhubValInf
     return result;
 }
 
+static IOTHUB_TEST_CLIENT_RESULT StandInExecuteRequest(IOTHUB_VALIDATION_INFO* devhubValInfo, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath, BUFFER_HANDLE requestContent, BUFFER_HANDLE responseContent)
+{
+    IOTHUB_TEST_CLIENT_RESULT result;
+    HTTPAPIEX_HANDLE httpApiExHandle;
+    HTTP_HEADERS_HANDLE requestHeaders;
+
+    if ((httpApiExHandle = HTTPAPIEX_Create(devhubValInfo->hostName)) == NULL)
+    {
+        LogError("Failed creating the HTTP API to the stand-in.");
+        result = IOTHUB_TEST_CLIENT_ERROR;
+    }
+    else
+    {
+        if ((requestHeaders = HTTPHeaders_Alloc()) == NULL ||
+            HTTPHeaders_AddHeaderNameValuePair(requestHeaders, "Authorization", devhubValInfo->iotSharedSig) != HTTP_HEADERS_OK ||
+            HTTPHeaders_AddHeaderNameValuePair(requestHeaders, "Content-Type", "application/octet-stream") != HTTP_HEADERS_OK)
+        {
+            LogError("Failed creating the HTTP headers for the stand-in.");
+            result = IOTHUB_TEST_CLIENT_ERROR;
+        }
+        else
+        {
+            unsigned int statusCode = 0;
+
+            if (HTTPAPIEX_ExecuteRequest(httpApiExHandle, requestType, relativePath, requestHeaders, requestContent, &statusCode, NULL, responseContent) != HTTPAPIEX_OK)
+            {
+                LogError("Failed sending %s to the stand-in.", relativePath);
+                result = IOTHUB_TEST_CLIENT_ERROR;
+            }
+            else if (statusCode >= 300)
+            {
+                LogError("The stand-in answered %u to %s.", statusCode, relativePath);
+                result = IOTHUB_TEST_CLIENT_ERROR;
+            }
+            else
+            {
+                result = IOTHUB_TEST_CLIENT_OK;
+            }
+        }
+        HTTPHeaders_Free(requestHeaders);
+        HTTPAPIEX_Destroy(httpApiExHandle);
+    }
+
+    return result;
+}
+
+/* Reads the events of the device sent since the last poll, the callback returns non-zero to stop */
+static IOTHUB_TEST_CLIENT_RESULT StandInPollEvents(IOTHUB_VALIDATION_INFO* devhubValInfo, pfIoTHubMessageCallback msgCallback, void* context, bool* stop)
+{
+    IOTHUB_TEST_CLIENT_RESULT result;
+    STRING_HANDLE encodedDeviceId;
+    STRING_HANDLE relativePath = NULL;
+    BUFFER_HANDLE responseContent = NULL;
+
+    if ((encodedDeviceId = URL_EncodeString(devhubValInfo->deviceId)) == NULL ||
+        (relativePath = STRING_construct_sprintf(STANDIN_EVENTS_PATH_FMT, STRING_c_str(encodedDeviceId), devhubValInfo->standInLastEvent, devhubValInfo->standInEnqueuedAfter)) == NULL ||
+        (responseContent = BUFFER_new()) == NULL)
+    {
+        LogError("Failed creating the events request.");
+        result = IOTHUB_TEST_CLIENT_ERROR;
+    }
+    else if ((result = StandInExecuteRequest(devhubValInfo, HTTPAPI_REQUEST_GET, STRING_c_str(relativePath), NULL, responseContent)) == IOTHUB_TEST_CLIENT_OK)
+    {
+        STRING_HANDLE response = STRING_from_byte_array(BUFFER_u_char(responseContent), BUFFER_length(responseContent));
+        JSON_Value* root = (response == NULL) ? NULL : json_parse_string(STRING_c_str(response));
+        JSON_Array* events = json_object_get_array(json_value_get_object(root), "events");
+
+        if (events == NULL)
+        {
+            LogError("Invalid events from the stand-in.");
+            result = IOTHUB_TEST_CLIENT_ERROR;
+        }
+        else
+        {
+            size_t index;
+            for (index = 0; index < json_array_get_count(events) && !*stop; index++)
+            {
+                JSON_Object* event = json_array_get_object(events, index);
+                const char* body = json_object_get_string(event, "body");
+                BUFFER_HANDLE data;
+
+                devhubValInfo->standInLastEvent = (unsigned long)json_object_get_number(event, "sequence");
+                if (body != NULL && (data = Base64_Decoder(body)) != NULL)
+                {
+                    if (msgCallback(context, (const char*)BUFFER_u_char(data), BUFFER_length(data)) != 0)
+                    {
+                        *stop = true;
+                    }
+                    BUFFER_delete(data);
+                }
+            }
+        }
+        json_value_free(root);
+        STRING_delete(response);
+    }
+
+    BUFFER_delete(responseContent);
+    STRING_delete(relativePath);
+    STRING_delete(encodedDeviceId);
+    return result;
+}
+
+static int standInPollFunction(void* context)
+{
+    IOTHUB_VALIDATION_INFO* devhubValInfo = (IOTHUB_VALIDATION_INFO*)context;
+
+    while (devhubValInfo->keepThreadAlive)
+    {
+        bool stop = false;
+        (void)StandInPollEvents(devhubValInfo, devhubValInfo->onMessageReceivedCallback, devhubValInfo->onMessageReceivedContext, &stop);
+        ThreadAPI_Sleep(STANDIN_POLL_INTERVAL_MS);
+    }
+
+    return 0;
+}
+
 IOTHUB_TEST_CLIENT_RESULT IoTHubTest_ListenForEventAsync(IOTHUB_TEST_HANDLE devhubHandle, size_t partitionCount, time_t receiveTimeRangeStart, pfIoTHubMessageCallback msgCallback, void* context)
 {
     IOTHUB_TEST_CLIENT_RESULT result;
@@ -1018,11 +1149,33 @@ IOTHUB_TEST_CLIENT_RESULT IoTHubTest_ListenForEventAsync(IOTHUB_TEST_HANDLE devh
         }
         else
         {
-            if (devhubValInfo->amqp_connection != NULL)
+            if (devhubValInfo->amqp_connection != NULL || devhubValInfo->asyncWorkThread != NULL)
             {
                 LogError("Already listening for messages");
                 result = IOTHUB_TEST_CLIENT_ERROR;
             }
+            else if (devhubValInfo->isStandIn)
+            {
+                devhubValInfo->keepThreadAlive = true;
+                devhubValInfo->onMessageReceivedCallback = msgCallback;
+                devhubValInfo->onMessageReceivedContext = context;
+                devhubValInfo->standInLastEvent = 0;
+                devhubValInfo->standInEnqueuedAfter = (unsigned long long)receiveTimeRangeStart * 1000;
+
+                if (ThreadAPI_Create(&devhubValInfo->asyncWorkThread, standInPollFunction, devhubValInfo) != THREADAPI_OK)
+                {
+                    LogError("Failed creating a thread to poll the stand-in");
+                    devhubValInfo->keepThreadAlive = false;
+                    devhubValInfo->asyncWorkThread = NULL;
+                    devhubValInfo->onMessageReceivedCallback = NULL;
+                    devhubValInfo->onMessageReceivedContext = NULL;
+                    result = IOTHUB_TEST_CLIENT_ERROR;
+                }
+                else
+                {
+                    result = IOTHUB_TEST_CLIENT_OK;
+                }
+            }
             else if ((devhubValInfo->amqp_connection = createAmqpConnection(devhubValInfo, partitionCount, receiveTimeRangeStart)) == NULL)
             {
                 LogError("Failed creating amqp components to listen for messages");
@@ -1063,6 +1216,30 @@ IOTHUB_TEST_CLIENT_RESULT IoTHubTest_ListenForEvent(IOTHUB_TEST_HANDLE devhubHan
         LogError("Invalid parameter given in IoTHubTest_ListenForEvent DevhubHandle: 0x%p\r\nMessage Callback: 0x%p.", devhubHandle, msgCallback);
         result = IOTHUB_TEST_CLIENT_ERROR;
     }
+    else if (((IOTHUB_VALIDATION_INFO*)devhubHandle)->isStandIn)
+    {
+        IOTHUB_VALIDATION_INFO* devhubValInfo = (IOTHUB_VALIDATION_INFO*)devhubHandle;
+        time_t beginExecutionTime = time(NULL);
+        bool message_received = false;
+
+        devhubValInfo->standInLastEvent = 0;
+        devhubValInfo->standInEnqueuedAfter = (unsigned long long)receiveTimeRangeStart * 1000;
+        result = IOTHUB_TEST_CLIENT_OK;
+
+        while (result == IOTHUB_TEST_CLIENT_OK && !message_received && difftime(time(NULL), beginExecutionTime) < maxDrainTimeInSeconds)
+        {
+            if ((result = StandInPollEvents(devhubValInfo, msgCallback, context, &message_received)) == IOTHUB_TEST_CLIENT_OK && !message_received)
+            {
+                ThreadAPI_Sleep(STANDIN_POLL_INTERVAL_MS);
+            }
+        }
+
+        if (result == IOTHUB_TEST_CLIENT_OK && !message_received)
+        {
+            LogError("No message was received, timed out.");
+            result = IOTHUB_TEST_CLIENT_ERROR;
+        }
+    }
     else 
     {
         XIO_HANDLE sasl_io = NULL;
@@ -1322,6 +1499,29 @@ IOTHUB_TEST_CLIENT_RESULT IoTHubTest_SendMessage(IOTHUB_TEST_HANDLE devhubHandle
         LogError("Invalid arguments for IoTHubTest_SendMessage, devhubHandle = %p, len = %lu, data = %p.", devhubHandle, (unsigned long)len, data);
         result = IOTHUB_TEST_CLIENT_ERROR;
     }
+    else if (((IOTHUB_VALIDATION_INFO*)devhubHandle)->isStandIn)
+    {
+        IOTHUB_VALIDATION_INFO* devhubValInfo = (IOTHUB_VALIDATION_INFO*)devhubHandle;
+        STRING_HANDLE encodedDeviceId;
+        STRING_HANDLE relativePath = NULL;
+        BUFFER_HANDLE requestContent = NULL;
+
+        if ((encodedDeviceId = URL_EncodeString(devhubValInfo->deviceId)) == NULL ||
+            (relativePath = STRING_construct_sprintf(STANDIN_SEND_PATH_FMT, STRING_c_str(encodedDeviceId))) == NULL ||
+            (requestContent = BUFFER_create(data, len)) == NULL)
+        {
+            LogError("Could not create the request to the stand-in.");
+            result = IOTHUB_TEST_CLIENT_ERROR;
+        }
+        else
+        {
+            result = StandInExecuteRequest(devhubValInfo, HTTPAPI_REQUEST_POST, STRING_c_str(relativePath), requestContent, NULL);
+        }
+
+        BUFFER_delete(requestContent);
+        STRING_delete(relativePath);
+        STRING_delete(encodedDeviceId);
+    }
     else
     {
         IOTHUB_VALIDATION_INFO* devhubValInfo = (IOTHUB_VALIDATION_INFO*)devhubHandle;